@@ -39,7 +39,11 @@ struct tagbstring SKY_ADD_EVENT_KEY_DATA = bsStatic("data");
 
 int sky_add_event_message_copy_data(sky_property_file *property_file,
     bool is_action, sky_add_event_message_data **msg_data, uint32_t msg_data_count,
-    sky_event_data ***event_data, uint32_t *event_data_count);
+    sky_event_data ***event_data, uint32_t *event_data_count,
+    sky_property **full_property);
+
+int sky_add_event_message_write_dictionary_full(sky_property *property,
+    FILE *output);
 
 size_t sky_add_event_message_sizeof_action(sky_add_event_message *message);
 
@@ -189,11 +193,12 @@ int sky_add_event_message_process(sky_server *server,
     
     // Create worker.
     worker = sky_worker_create(); check_mem(worker);
-    worker->context = server->context;
+    worker->pool = server->worker_pool;
     worker->map = sky_add_event_message_worker_map;
     worker->write = sky_add_event_message_worker_write;
     worker->free = sky_add_event_message_worker_free;
     worker->multi = header->multi;
+    worker->batchable = true;
     worker->input = input;
     worker->output = output;
     
@@ -228,13 +233,31 @@ int sky_add_event_message_process(sky_server *server,
     message->event = sky_event_create(message->object_id, message->timestamp, action->id);
     check_mem(message->event);
     
-    // Copy action data from message.
-    rc = sky_add_event_message_copy_data(table->property_file, true, message->action_data, message->action_data_count, &message->event->data, &message->event->data_count);
-    check(rc == 0, "Unable to copy event action data");
-    
-    // Copy data from message.
-    rc = sky_add_event_message_copy_data(table->property_file, false, message->data, message->data_count, &message->event->data, &message->event->data_count);
-    check(rc == 0, "Unable to copy event data");
+    // Copy action data and then object data from message.
+    sky_property *full_property = NULL;
+    rc = sky_add_event_message_copy_data(table->property_file, true, message->action_data, message->action_data_count, &message->event->data, &message->event->data_count, &full_property);
+    check(rc == 0 || rc == SKY_DICTIONARY_FULL, "Unable to copy event action data");
+    if(rc == 0) {
+        rc = sky_add_event_message_copy_data(table->property_file, false, message->data, message->data_count, &message->event->data, &message->event->data_count, &full_property);
+        check(rc == 0 || rc == SKY_DICTIONARY_FULL, "Unable to copy event data");
+    }
+
+    // Reject the event if one of its values can't be added to a full
+    // dictionary. Values that were added before the rejected one are kept.
+    if(rc == SKY_DICTIONARY_FULL) {
+        rc = sky_property_file_save_if_dirty(table->property_file);
+        check(rc == 0, "Unable to save property file");
+        rc = sky_add_event_message_write_dictionary_full(full_property, output);
+        check(rc == 0, "Unable to write error");
+        sky_add_event_message_free(message);
+        sky_worker_free(worker);
+        return 0;
+    }
+
+    // Save any new properties and dictionary values before the event that
+    // uses them is written.
+    rc = sky_property_file_save_if_dirty(table->property_file);
+    check(rc == 0, "Unable to save property file");
     
     // Attach the message to the worker.
     worker->data = (void*)message;
@@ -261,6 +284,44 @@ error:
     return -1;
 }
 
+// Writes the response for an event that was rejected because a new value
+// could not be added to a full dictionary.
+//
+// property - The property whose dictionary is full.
+// output   - The output stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_add_event_message_write_dictionary_full(sky_property *property,
+                                                FILE *output)
+{
+    size_t sz;
+    bstring error_message = NULL;
+    struct tagbstring status_str = bsStatic("status");
+    struct tagbstring error_str = bsStatic("error");
+    struct tagbstring message_str = bsStatic("message");
+    assert(property != NULL);
+    assert(output != NULL);
+
+    error_message = bformat("Dictionary is full for property: %s", bdatae(property->name, ""));
+    check_mem(error_message);
+
+    // Return.
+    //   {status:"error", message:""}
+    minipack_fwrite_map(output, 2, &sz);
+    check(sz > 0, "Unable to write output");
+    check(sky_minipack_fwrite_bstring(output, &status_str) == 0, "Unable to write status key");
+    check(sky_minipack_fwrite_bstring(output, &error_str) == 0, "Unable to write status value");
+    check(sky_minipack_fwrite_bstring(output, &message_str) == 0, "Unable to write message key");
+    check(sky_minipack_fwrite_bstring(output, error_message) == 0, "Unable to write message");
+
+    bdestroy(error_message);
+    return 0;
+
+error:
+    bdestroy(error_message);
+    return -1;
+}
+
 // Copies a set of data from the message to the event.
 //
 // property_file    - The property file.
@@ -270,14 +331,18 @@ error:
 // event_data       - A pointer to where the event data should be returned.
 // event_data_count - A pointer to where the event data count should be
 //                    returned.
+// full_property    - A pointer to where the property is returned if one of
+//                    its values can't be added to its full dictionary.
 //
-// Returns 0 if successful, otherwise returns -1.
+// Returns 0 if successful, SKY_DICTIONARY_FULL if a new value can't be added
+// to a full dictionary, otherwise returns -1.
 int sky_add_event_message_copy_data(sky_property_file *property_file,
                                     bool is_action,
                                     sky_add_event_message_data **msg_data,
                                     uint32_t msg_data_count,
                                     sky_event_data ***event_data,
-                                    uint32_t *event_data_count)
+                                    uint32_t *event_data_count,
+                                    sky_property **full_property)
 {
     int rc = 0;
     sky_property *property = NULL;
@@ -317,17 +382,21 @@ int sky_add_event_message_copy_data(sky_property_file *property_file,
             // Add property.
             rc = sky_property_file_add_property(property_file, property);
             check(rc == 0, "Unable to add property");
-            
-            // Save property file.
-            rc = sky_property_file_save(property_file);
-            check(rc == 0, "Unable to save property file");
         }
         
         // Create event data based on data type.
         switch(msg_item->data_type) {
-            case SKY_DATA_TYPE_STRING:
-                event_item = sky_event_data_create_string(property->id, msg_item->string_value);
+            case SKY_DATA_TYPE_STRING: {
+                bool added;
+                rc = sky_property_encode_string(property, msg_item->string_value, &event_item, &added);
+                if(rc == SKY_DICTIONARY_FULL) {
+                    log_err("Dictionary is full for property '%s'; rejected value: %s", bdata(property->name), bdatae(msg_item->string_value, ""));
+                    *full_property = property;
+                    return SKY_DICTIONARY_FULL;
+                }
+                check(rc == 0, "Unable to encode string value");
                 break;
+            }
             case SKY_DATA_TYPE_INT:
                 event_item = sky_event_data_create_int(property->id, msg_item->int_value);
                 break;
@@ -349,7 +418,7 @@ int sky_add_event_message_copy_data(sky_property_file *property_file,
     return 0;
 
 error:
-    if(property->property_file == NULL) sky_property_free(property);
+    if(property && property->property_file == NULL) sky_property_free(property);
     return -1;
 }
 
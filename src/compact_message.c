@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "types.h"
+#include "compact_message.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a 'compact' message object.
+//
+// Returns a new message.
+sky_compact_message *sky_compact_message_create()
+{
+    sky_compact_message *message = NULL;
+    message = calloc(1, sizeof(sky_compact_message)); check_mem(message);
+    return message;
+
+error:
+    sky_compact_message_free(message);
+    return NULL;
+}
+
+// Frees a 'compact' message object from memory.
+//
+// message - The message object to be freed.
+//
+// Returns nothing.
+void sky_compact_message_free(sky_compact_message *message)
+{
+    if(message) {
+        free(message);
+    }
+}
+
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+// Creates a message handler for the 'Compact' message.
+//
+// Returns a message handler.
+sky_message_handler *sky_compact_message_handler_create()
+{
+    sky_message_handler *handler = sky_message_handler_create(); check_mem(handler);
+    handler->scope = SKY_MESSAGE_HANDLER_SCOPE_TABLE;
+    handler->name = bfromcstr("compact");
+    handler->process = sky_compact_message_process;
+    return handler;
+
+error:
+    sky_message_handler_free(handler);
+    return NULL;
+}
+
+// Delegates compaction of each tablet to a worker so that it runs on the
+// servlet that owns the tablet.
+//
+// server - The server.
+// header - The message header.
+// table  - The table the message is working against
+// input  - The input file stream.
+// output - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_compact_message_process(sky_server *server,
+                                sky_message_header *header,
+                                sky_table *table,
+                                FILE *input, FILE *output)
+{
+    int rc = 0;
+    sky_compact_message *message = NULL;
+    sky_worker *worker = NULL;
+    assert(header != NULL);
+    assert(table != NULL);
+    assert(input != NULL);
+    assert(output != NULL);
+
+    // Create worker.
+    worker = sky_worker_create(); check_mem(worker);
+    worker->pool = server->worker_pool;
+    worker->map = sky_compact_message_worker_map;
+    worker->write = sky_compact_message_worker_write;
+    worker->free = sky_compact_message_worker_free;
+    worker->input = input;
+    worker->output = output;
+
+    // Attach servlets.
+    rc = sky_server_get_table_servlets(server, table, &worker->servlets, &worker->servlet_count);
+    check(rc == 0, "Unable to copy servlets to worker");
+
+    // Parse message.
+    message = sky_compact_message_create(); check_mem(message);
+    rc = sky_compact_message_unpack(message, input);
+    check(rc == 0, "Unable to unpack 'compact' message");
+    worker->data = (void*)message;
+
+    // Start worker.
+    rc = sky_worker_start(worker);
+    check(rc == 0, "Unable to start worker");
+
+    return 0;
+
+error:
+    sky_compact_message_free(message);
+    if(worker) worker->data = NULL;
+    sky_worker_free(worker);
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Serializes a 'compact' message to a file stream.
+//
+// message - The message.
+// file    - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_compact_message_pack(sky_compact_message *message, FILE *file)
+{
+    check(message != NULL, "Message required");
+    check(file != NULL, "File stream required");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Deserializes a 'compact' message from a file stream.
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_compact_message_unpack(sky_compact_message *message, FILE *file)
+{
+    check(message != NULL, "Message required");
+    check(file != NULL, "File stream required");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+// Compacts a single tablet.
+//
+// worker - The worker.
+// tablet - The tablet to work against.
+// ret    - Unused.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_compact_message_worker_map(sky_worker *worker, sky_tablet *tablet,
+                                   void **ret)
+{
+    int rc;
+    assert(worker != NULL);
+    assert(tablet != NULL);
+    assert(ret != NULL);
+
+    *ret = NULL;
+    rc = sky_tablet_compact(tablet);
+    check(rc == 0, "Unable to compact tablet: %s", bdata(tablet->path));
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes the results to an output stream.
+//
+// worker - The worker.
+// output - The output stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_compact_message_worker_write(sky_worker *worker, FILE *output)
+{
+    size_t sz;
+    assert(worker != NULL);
+    assert(output != NULL);
+
+    struct tagbstring status_str = bsStatic("status");
+    struct tagbstring ok_str = bsStatic("ok");
+
+    // Return.
+    //   {status:"ok"}
+    minipack_fwrite_map(output, 1, &sz);
+    check(sz > 0, "Unable to write output");
+    check(sky_minipack_fwrite_bstring(output, &status_str) == 0, "Unable to write status key");
+    check(sky_minipack_fwrite_bstring(output, &ok_str) == 0, "Unable to write status value");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Frees all data attached to the worker.
+//
+// worker - The worker.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_compact_message_worker_free(sky_worker *worker)
+{
+    assert(worker != NULL);
+
+    sky_compact_message_free((sky_compact_message*)worker->data);
+    worker->data = NULL;
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef _sky_compact_message_h
+#define _sky_compact_message_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "bstring.h"
+#include "message_handler.h"
+#include "table.h"
+#include "tablet.h"
+#include "worker.h"
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// A message for compacting each tablet of a table into a segment.
+typedef struct {
+    int64_t dummy;
+} sky_compact_message;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_compact_message *sky_compact_message_create();
+
+void sky_compact_message_free(sky_compact_message *message);
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+sky_message_handler *sky_compact_message_handler_create();
+
+int sky_compact_message_process(sky_server *server,
+    sky_message_header *header, sky_table *table, FILE *input, FILE *output);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_compact_message_pack(sky_compact_message *message, FILE *file);
+
+int sky_compact_message_unpack(sky_compact_message *message, FILE *file);
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int sky_compact_message_worker_map(sky_worker *worker, sky_tablet *tablet,
+    void **data);
+
+int sky_compact_message_worker_write(sky_worker *worker, FILE *output);
+
+int sky_compact_message_worker_free(sky_worker *worker);
+
+#endif
@@ -78,7 +78,10 @@ int sky_cursor_set_ptr(sky_cursor *cursor, void *ptr, size_t sz)
     cursor->startptr   = ptr;
     cursor->endptr     = ptr + sz;
     cursor->ptr        = NULL;
+    cursor->events     = NULL;
+    cursor->projection = NULL;
     cursor->in_session = true;
+    cursor->ts         = 0;
     cursor->last_timestamp      = 0;
     cursor->session_idle_in_sec = 0;
     cursor->session_event_index = -1;
@@ -95,10 +98,96 @@ error:
 }
 
 
+// Initializes the cursor to read a path that has already been decoded. Each
+// event is copied from the decoded events onto the cursor's data object
+// through a projection instead of being decoded again.
+//
+// cursor     - The cursor to update.
+// events     - The decoded events of the path.
+// projection - The projection from the decoded events to the data object.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_set_events(sky_cursor *cursor, sky_cursor_events *events,
+                          sky_data_projection *projection)
+{
+    int rc;
+    assert(cursor != NULL);
+    assert(events != NULL);
+    assert(projection != NULL);
+
+    cursor->startptr   = NULL;
+    cursor->endptr     = NULL;
+    cursor->ptr        = NULL;
+    cursor->events     = events;
+    cursor->projection = projection;
+    cursor->event_index = 0;
+    cursor->in_session = true;
+    cursor->ts         = 0;
+    cursor->last_timestamp      = 0;
+    cursor->session_idle_in_sec = 0;
+    cursor->session_event_index = -1;
+    cursor->eof        = (events->count == 0);
+
+    // Clear the data object if set.
+    rc = sky_cursor_clear_data(cursor);
+    check(rc == 0, "Unable to clear data");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
 //--------------------------------------
 // Iteration
 //--------------------------------------
 
+// Moves the cursor to the next event of a decoded path. Sessions are split
+// the same way as they are for raw events.
+//
+// cursor - The cursor.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_cursor_next_decoded_event(sky_cursor *cursor)
+{
+    sky_cursor_events *events = cursor->events;
+
+    // If there are no more events then set eof.
+    if(cursor->event_index >= events->count) {
+        cursor->eof        = true;
+        cursor->in_session = false;
+        cursor->events     = NULL;
+        cursor->projection = NULL;
+        return 0;
+    }
+
+    sky_data_descriptor *descriptor = events->data_descriptor;
+    void *event = events->data + ((size_t)cursor->event_index * descriptor->data_sz);
+    sky_timestamp_t ts = *((sky_timestamp_t*)(event + descriptor->timestamp_descriptor.ts_offset));
+    uint32_t timestamp = *((uint32_t*)(event + descriptor->timestamp_descriptor.timestamp_offset));
+
+    // Stay on the event and leave the session if the idle time has elapsed.
+    if(cursor->last_timestamp > 0 && cursor->session_idle_in_sec > 0) {
+        if(timestamp - cursor->last_timestamp >= cursor->session_idle_in_sec) {
+            cursor->in_session = false;
+        }
+    }
+    cursor->last_timestamp = timestamp;
+
+    // Only consume the event if we're still in session.
+    if(cursor->in_session) {
+        cursor->event_index++;
+        cursor->ts = ts;
+        cursor->session_event_index++;
+        if(cursor->data != NULL) {
+            sky_data_projection_apply(cursor->projection, event, cursor->data);
+        }
+    }
+
+    return 0;
+}
+
 // Moves the cursor to the next event in a path.
 //
 // cursor - The cursor.
@@ -108,6 +197,7 @@ int sky_cursor_next_event(sky_cursor *cursor)
 {
     int rc;
     size_t event_length = 0;
+    sky_timestamp_t prev_ts = cursor->ts;
     assert(cursor != NULL);
 
     // Ignore any calls when the cursor is out of session or EOF.
@@ -115,6 +205,11 @@ int sky_cursor_next_event(sky_cursor *cursor)
         return 0;
     }
 
+    // Decoded paths are read from their list of events.
+    if(cursor->events != NULL) {
+        return sky_cursor_next_decoded_event(cursor);
+    }
+
     // If the cursor hasn't started then initialize it.
     if(cursor->ptr == NULL) {
         cursor->ptr = cursor->startptr;
@@ -144,6 +239,10 @@ int sky_cursor_next_event(sky_cursor *cursor)
             errno=0; goto error;
         }
 
+        // Decode the timestamp. Delta encoded timestamps are relative to the
+        // previous event.
+        cursor->ts = sky_event_get_raw_ts(cursor->ptr, prev_ts);
+
         // Retrieve current timestamp.
         sky_timestamp_t ts;
         uint32_t timestamp;
@@ -158,6 +257,7 @@ int sky_cursor_next_event(sky_cursor *cursor)
             // and mark the cursor as being "out of session".
             if(timestamp - cursor->last_timestamp >= cursor->session_idle_in_sec) {
                 cursor->ptr -= event_length;
+                cursor->ts = prev_ts;
                 cursor->in_session = false;
             }
         }
@@ -181,6 +281,45 @@ error:
     return -1;
 }
 
+// Moves the start of the path past every event before a timestamp. Only
+// the event headers are read so the skipped events are not applied to the
+// data object. This is used along with a checkpoint's state and must be
+// called before the cursor moves to its first event.
+//
+// cursor - The cursor.
+// ts     - The shifted timestamp to seek to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_seek(sky_cursor *cursor, sky_timestamp_t ts)
+{
+    assert(cursor != NULL);
+    check(cursor->ptr == NULL, "Cursor has already started");
+
+    if(cursor->eof) {
+        return 0;
+    }
+
+    void *ptr = cursor->startptr;
+    sky_timestamp_t prev_ts = cursor->ts;
+    while(ptr < cursor->endptr) {
+        sky_timestamp_t event_ts = sky_event_get_raw_ts(ptr, prev_ts);
+        if(event_ts >= ts) {
+            break;
+        }
+        prev_ts = event_ts;
+        ptr += sky_event_sizeof_raw(ptr);
+    }
+
+    // Later events are delta encoded against the last skipped event.
+    cursor->startptr = ptr;
+    cursor->ts = prev_ts;
+    cursor->eof = !(cursor->startptr < cursor->endptr);
+    return 0;
+
+error:
+    return -1;
+}
+
 // Moves the cursor to the next event in a path and returns a flag stating
 // if the cursor is still valid (a.k.a. not EOF).
 //
@@ -217,6 +356,71 @@ bool sky_cursor_eos(sky_cursor *cursor)
 }
 
 
+//--------------------------------------
+// Decoded Events
+//--------------------------------------
+
+// Decodes every remaining event of the cursor's path into a list of events.
+// The list is reused between paths and only grows. The cursor is at the end
+// of the path afterward.
+//
+// cursor - The cursor.
+// events - The list to decode into. Its data descriptor must be the
+//          cursor's data descriptor.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_decode_events(sky_cursor *cursor, sky_cursor_events *events)
+{
+    int rc;
+    assert(cursor != NULL);
+    assert(events != NULL);
+    assert(cursor->data != NULL);
+    check(cursor->data_descriptor == events->data_descriptor, "Cursor and events use different data descriptors");
+
+    size_t data_sz = events->data_descriptor->data_sz;
+    events->count = 0;
+    while(true) {
+        rc = sky_cursor_next_event(cursor);
+        check(rc == 0, "Unable to decode event");
+        if(cursor->eof) {
+            break;
+        }
+
+        // Grow the list if it is full.
+        if(events->count == events->capacity) {
+            uint32_t capacity = (events->capacity > 0 ? events->capacity * 2 : 64);
+            void *data = realloc(events->data, data_sz * capacity);
+            check_mem(data);
+            events->data = data;
+            events->capacity = capacity;
+        }
+        memcpy(events->data + (data_sz * events->count), cursor->data, data_sz);
+        events->count++;
+    }
+
+    return 0;
+
+error:
+    events->count = 0;
+    return -1;
+}
+
+// Frees the decoded events of a list.
+//
+// events - The list of events.
+//
+// Returns nothing.
+void sky_cursor_events_uninit(sky_cursor_events *events)
+{
+    if(events) {
+        free(events->data);
+        events->data = NULL;
+        events->count = 0;
+        events->capacity = 0;
+    }
+}
+
+
 //--------------------------------------
 // Session Management
 //--------------------------------------
@@ -292,14 +496,49 @@ int sky_cursor_get_timestamp(sky_cursor *cursor, sky_timestamp_t *ts,
     assert(ts != NULL);
     assert(timestamp != NULL);
     
-    sky_timestamp_t ts_value = *((sky_timestamp_t*)(cursor->ptr+sizeof(sky_event_flag_t)));
-    *ts = ts_value;
-    *timestamp = (uint32_t)sky_timestamp_to_seconds(ts_value);
+    *ts = cursor->ts;
+    *timestamp = (uint32_t)sky_timestamp_to_seconds(cursor->ts);
     
     return 0;
 }
 
 
+// Assigns a series of packed property values to the data object.
+//
+// cursor - The cursor.
+// ptr    - A pointer to the packed values.
+// length - The number of bytes of packed values.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_cursor_set_values(sky_cursor *cursor, void *ptr, size_t length)
+{
+    int rc;
+    size_t sz;
+    void *end_ptr = ptr + length;
+
+    // Loop over data and assign values to data object.
+    while(ptr < end_ptr) {
+        // Read property id.
+        sky_property_id_t property_id = *((sky_property_id_t*)ptr);
+        ptr += sizeof(property_id);
+
+        // Assign value to data object member.
+        rc = sky_data_descriptor_set_value(cursor->data_descriptor, cursor->data, property_id, ptr, &sz);
+        check(rc == 0, "Unable to set value via data descriptor");
+
+        // If there is no size then move it forward manually.
+        if(sz == 0) {
+            sz = minipack_sizeof_elem_and_data(ptr);
+        }
+        ptr += sz;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
 // Updates a memory location based on the current event and a data descriptor.
 //
 // cursor    - The cursor.
@@ -318,27 +557,19 @@ int sky_cursor_set_data(sky_cursor *cursor)
     sky_data_descriptor *descriptor = cursor->data_descriptor;
     void *data = cursor->data;
 
-    // Retrieve the flag off the event.
-    void *ptr = cursor->ptr;
-    sky_event_flag_t event_flag = *((sky_event_flag_t*)ptr);
-    ptr += sizeof(sky_event_flag_t);
-    
     // Assign timestamp.
     sky_timestamp_t *ts = (sky_timestamp_t*)(data + descriptor->timestamp_descriptor.ts_offset);
     uint32_t *timestamp = (uint32_t*)(data + descriptor->timestamp_descriptor.timestamp_offset);
     rc = sky_cursor_get_timestamp(cursor, ts, timestamp);
     check(rc == 0, "Unable to retrieve cursor timestamp");
-    ptr += sizeof(sky_timestamp_t);
 
-    // Read action if this event contains an action.
+    // Read the action and data length from the event header.
+    void *ptr = cursor->ptr;
     sky_action_id_t *action_id = (sky_action_id_t*)(data + descriptor->action_descriptor.offset);
-    if(event_flag & SKY_EVENT_FLAG_ACTION) {
-        *action_id = *((sky_action_id_t*)ptr);
-        ptr += sizeof(sky_action_id_t);
-    }
-    else {
-        *action_id = 0;
-    }
+    sky_event_data_length_t data_length;
+    rc = sky_event_unpack_raw_hdr(ptr, 0, NULL, action_id, &data_length, &sz);
+    check(rc == 0, "Unable to read event header");
+    ptr += sz;
 
     // Process data descriptor if there are properties being tracked.
     if(descriptor->active_property_count > 0) {
@@ -347,28 +578,8 @@ int sky_cursor_set_data(sky_cursor *cursor)
         check(rc == 0, "Unable to clear action data via descriptor");
 
         // Read data if this event contains data.
-        if(event_flag & SKY_EVENT_FLAG_DATA) {
-            uint32_t data_length = *((uint32_t*)ptr);
-            ptr += sizeof(uint32_t);
-            void *end_ptr = ptr + data_length;
-
-            // Loop over data and assign values to data object.
-            while(ptr < end_ptr) {
-                // Read property id.
-                sky_property_id_t property_id = *((sky_property_id_t*)ptr);
-                ptr += sizeof(property_id);
-
-                // Assign value to data object member.
-                rc = sky_data_descriptor_set_value(descriptor, data, property_id, ptr, &sz);
-                check(rc == 0, "Unable to set value via data descriptor");
-            
-                // If there is no size then move it forward manually.
-                if(sz == 0) {
-                    sz = minipack_sizeof_elem_and_data(ptr);
-                }
-                ptr += sz;
-            }
-        }
+        rc = sky_cursor_set_values(cursor, ptr, data_length);
+        check(rc == 0, "Unable to set event data");
     }
     
     return 0;
@@ -377,6 +588,23 @@ error:
     return -1;
 }
 
+// Restores the object state on the data object from a checkpoint. The state
+// is packed the same way as event data.
+//
+// cursor - The cursor.
+// ptr    - A pointer to the packed state.
+// length - The number of bytes in the packed state.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_set_state(sky_cursor *cursor, void *ptr, size_t length)
+{
+    assert(cursor != NULL);
+    if(cursor->data == NULL || cursor->data_descriptor == NULL || cursor->data_descriptor->active_property_count == 0) {
+        return 0;
+    }
+    return sky_cursor_set_values(cursor, ptr, length);
+}
+
 // Clears the data object.
 //
 // cursor    - The cursor.
@@ -16,6 +16,16 @@
 //
 //==============================================================================
 
+// A list of the decoded events of a path. Each event is a copy of the data
+// object after the event was decoded so that several cursors can read the
+// path at their own pace without decoding it again.
+typedef struct sky_cursor_events {
+    sky_data_descriptor *data_descriptor;
+    void *data;
+    uint32_t count;
+    uint32_t capacity;
+} sky_cursor_events;
+
 typedef struct sky_cursor {
     void *data;
     int32_t session_event_index;
@@ -27,6 +37,10 @@ typedef struct sky_cursor {
     uint32_t last_timestamp;
     uint32_t session_idle_in_sec;
     sky_data_descriptor *data_descriptor;
+    sky_timestamp_t ts;
+    sky_cursor_events *events;
+    sky_data_projection *projection;
+    uint32_t event_index;
 } sky_cursor;
 
 
@@ -54,12 +68,25 @@ void sky_cursor_free(sky_cursor *cursor);
 
 int sky_cursor_set_ptr(sky_cursor *cursor, void *ptr, size_t sz);
 
+int sky_cursor_set_events(sky_cursor *cursor, sky_cursor_events *events,
+    sky_data_projection *projection);
+
+//--------------------------------------
+// Decoded Events
+//--------------------------------------
+
+int sky_cursor_decode_events(sky_cursor *cursor, sky_cursor_events *events);
+
+void sky_cursor_events_uninit(sky_cursor_events *events);
+
 //--------------------------------------
 // Iteration
 //--------------------------------------
 
 int sky_cursor_next_event(sky_cursor *cursor);
 
+int sky_cursor_seek(sky_cursor *cursor, sky_timestamp_t ts);
+
 bool sky_lua_cursor_next_event(sky_cursor *cursor);
 
 bool sky_cursor_eof(sky_cursor *cursor);
@@ -85,6 +112,8 @@ int sky_cursor_get_timestamp(sky_cursor *cursor, sky_timestamp_t *ts,
 
 int sky_cursor_set_data(sky_cursor *cursor);
 
+int sky_cursor_set_state(sky_cursor *cursor, void *ptr, size_t length);
+
 int sky_cursor_clear_data(sky_cursor *cursor);
 
 #endif
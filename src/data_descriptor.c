@@ -160,6 +160,86 @@ error:
 }
 
 
+// Returns the number of bytes that a property descriptor writes to the data
+// object.
+//
+// descriptor          - The data descriptor.
+// property_descriptor - The property descriptor.
+//
+// Returns the size of the property's value, in bytes.
+static uint16_t sky_data_descriptor_sizeof_property(sky_data_descriptor *descriptor,
+                                                    sky_data_property_descriptor *property_descriptor)
+{
+    if(property_descriptor->data_type == SKY_DATA_TYPE_INT) {
+        return (descriptor->int_type == SKY_DATA_DESCRIPTOR_INT32 ? sizeof(int32_t) : sizeof(int64_t));
+    }
+    return (uint16_t)sky_data_type_sizeof(property_descriptor->data_type);
+}
+
+// Initializes a data descriptor to track every property that is tracked by
+// any of a list of descriptors. The timestamp and action are tracked using
+// the sky_data_object type at the head of the data structure and each
+// property is given its own slot after it. This lets a path be decoded once
+// for several descriptors and then copied onto each of their data objects
+// with a projection.
+//
+// descriptor  - The data descriptor to initialize.
+// descriptors - The descriptors to combine.
+// count       - The number of descriptors.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_descriptor_init_union(sky_data_descriptor *descriptor,
+                                   sky_data_descriptor **descriptors,
+                                   uint32_t count)
+{
+    int rc;
+    uint32_t i, j;
+    assert(descriptor != NULL);
+    assert(descriptors != NULL || count == 0);
+
+    // Initialize the offset to start right after timestamp and action.
+    descriptor->data_sz = (uint32_t)sizeof(sky_data_object);
+    descriptor->timestamp_descriptor.timestamp_offset = offsetof(sky_data_object, timestamp);
+    descriptor->timestamp_descriptor.ts_offset = offsetof(sky_data_object, ts);
+    descriptor->action_descriptor.offset = offsetof(sky_data_object, action_id);
+    if(count > 0) {
+        descriptor->int_type = descriptors[0]->int_type;
+    }
+
+    for(i=0; i<count; i++) {
+        sky_data_descriptor *other = descriptors[i];
+        check(other->int_type == descriptor->int_type, "Descriptors use different integer types");
+
+        for(j=0; j<other->property_count; j++) {
+            sky_data_property_descriptor *property_descriptor = &other->property_descriptors[j];
+            if(property_descriptor->set_func == sky_data_descriptor_set_noop) {
+                continue;
+            }
+
+            // Properties tracked by an earlier descriptor share its slot.
+            sky_data_property_descriptor *existing = &descriptor->property_zero_descriptor[property_descriptor->property_id];
+            if(existing->set_func != sky_data_descriptor_set_noop) {
+                check(existing->data_type == property_descriptor->data_type, "Property %d is tracked with different types", property_descriptor->property_id);
+                continue;
+            }
+
+            rc = sky_data_descriptor_set_property(descriptor, property_descriptor->property_id, descriptor->data_sz, property_descriptor->data_type);
+            check(rc == 0, "Unable to set property on data descriptor");
+
+            size_t _sz = sky_data_type_sizeof(property_descriptor->data_type);
+            if(_sz < 8) _sz = 8;
+            descriptor->data_sz += _sz;
+        }
+    }
+
+    return 0;
+
+error:
+    descriptor->data_sz = 0;
+    return -1;
+}
+
+
 //--------------------------------------
 // Value Management
 //--------------------------------------
@@ -298,6 +378,7 @@ int sky_data_descriptor_set_property(sky_data_descriptor *descriptor,
     
     // Set the offset and set_func function on the descriptor.
     property_descriptor->offset = offset;
+    property_descriptor->data_type = data_type;
     switch(data_type) {
         case SKY_DATA_TYPE_NONE: {
             property_descriptor->set_func = sky_data_descriptor_set_noop;
@@ -362,6 +443,120 @@ error:
 }
 
 
+//--------------------------------------
+// Projection
+//--------------------------------------
+
+// Appends a field to a projection.
+//
+// projection    - The projection.
+// source_offset - The offset of the value in the source data object.
+// target_offset - The offset of the value in the target data object.
+// sz            - The size of the value, in bytes.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_data_projection_add_field(sky_data_projection *projection,
+                                         uint16_t source_offset,
+                                         uint16_t target_offset, uint16_t sz)
+{
+    projection->fields = realloc(projection->fields, sizeof(*projection->fields) * (projection->field_count+1));
+    check_mem(projection->fields);
+
+    sky_data_projection_field *field = &projection->fields[projection->field_count++];
+    field->source_offset = source_offset;
+    field->target_offset = target_offset;
+    field->sz = sz;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Initializes a projection that copies the timestamp, action and properties
+// of a data object decoded through the source descriptor onto a data object
+// of the target descriptor. Every property tracked by the target must also be
+// tracked by the source with the same type.
+//
+// projection - The projection.
+// source     - The descriptor that the data is decoded through.
+// target     - The descriptor of the data object that is copied onto.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_projection_init(sky_data_projection *projection,
+                             sky_data_descriptor *source,
+                             sky_data_descriptor *target)
+{
+    int rc;
+    assert(projection != NULL);
+    assert(source != NULL);
+    assert(target != NULL);
+    memset(projection, 0, sizeof(*projection));
+
+    rc = sky_data_projection_add_field(projection, source->timestamp_descriptor.ts_offset, target->timestamp_descriptor.ts_offset, sizeof(sky_timestamp_t));
+    check(rc == 0, "Unable to add ts field");
+    rc = sky_data_projection_add_field(projection, source->timestamp_descriptor.timestamp_offset, target->timestamp_descriptor.timestamp_offset, sizeof(uint32_t));
+    check(rc == 0, "Unable to add timestamp field");
+    rc = sky_data_projection_add_field(projection, source->action_descriptor.offset, target->action_descriptor.offset, sizeof(sky_action_id_t));
+    check(rc == 0, "Unable to add action id field");
+
+    uint32_t i;
+    for(i=0; i<target->property_count; i++) {
+        sky_data_property_descriptor *property_descriptor = &target->property_descriptors[i];
+        if(property_descriptor->set_func == sky_data_descriptor_set_noop) {
+            continue;
+        }
+
+        sky_data_property_descriptor *source_descriptor = &source->property_descriptors[i];
+        check(source_descriptor->set_func != sky_data_descriptor_set_noop, "Property %d is not tracked by the source", property_descriptor->property_id);
+        check(source_descriptor->data_type == property_descriptor->data_type && source->int_type == target->int_type, "Property %d is tracked with different types", property_descriptor->property_id);
+
+        rc = sky_data_projection_add_field(projection, source_descriptor->offset, property_descriptor->offset, sky_data_descriptor_sizeof_property(target, property_descriptor));
+        check(rc == 0, "Unable to add property field");
+    }
+
+    return 0;
+
+error:
+    sky_data_projection_uninit(projection);
+    return -1;
+}
+
+// Frees the fields of a projection.
+//
+// projection - The projection.
+//
+// Returns nothing.
+void sky_data_projection_uninit(sky_data_projection *projection)
+{
+    if(projection) {
+        free(projection->fields);
+        projection->fields = NULL;
+        projection->field_count = 0;
+    }
+}
+
+// Copies a source data object onto a target data object.
+//
+// projection - The projection.
+// source     - The data object decoded through the source descriptor.
+// target     - The data object of the target descriptor.
+//
+// Returns nothing.
+void sky_data_projection_apply(sky_data_projection *projection, void *source,
+                               void *target)
+{
+    assert(projection != NULL);
+    assert(source != NULL);
+    assert(target != NULL);
+
+    uint32_t i;
+    for(i=0; i<projection->field_count; i++) {
+        sky_data_projection_field *field = &projection->fields[i];
+        memcpy(target + field->target_offset, source + field->source_offset, field->sz);
+    }
+}
+
+
 //--------------------------------------
 // Setters
 //--------------------------------------
@@ -51,6 +51,7 @@ typedef struct {
 typedef struct {
     sky_property_id_t property_id;
     uint16_t offset;
+    sky_data_type_e data_type;
     sky_data_property_descriptor_set_func set_func;
     sky_data_property_descriptor_clear_func clear_func;
 } sky_data_property_descriptor;
@@ -69,6 +70,21 @@ typedef struct {
     sky_data_descriptor_int_type_e int_type;
 } sky_data_descriptor;
 
+// Defines a single value to copy from a data object of one descriptor to the
+// data object of another descriptor.
+typedef struct {
+    uint16_t source_offset;
+    uint16_t target_offset;
+    uint16_t sz;
+} sky_data_projection_field;
+
+// Defines how to copy a data object decoded through one descriptor onto the
+// data object of another descriptor that tracks a subset of its properties.
+typedef struct {
+    sky_data_projection_field *fields;
+    uint32_t field_count;
+} sky_data_projection;
+
 
 //==============================================================================
 //
@@ -87,6 +103,9 @@ void sky_data_descriptor_free(sky_data_descriptor *descriptor);
 int sky_data_descriptor_init_with_event(sky_data_descriptor *descriptor,
     sky_event *event);
 
+int sky_data_descriptor_init_union(sky_data_descriptor *descriptor,
+    sky_data_descriptor **descriptors, uint32_t count);
+
 //--------------------------------------
 // Value Management
 //--------------------------------------
@@ -116,4 +135,16 @@ int sky_data_descriptor_set_action_id_offset(sky_data_descriptor *descriptor,
 int sky_data_descriptor_set_property(sky_data_descriptor *descriptor,
     sky_property_id_t property_id, uint32_t offset, sky_data_type_e data_type);
 
+//--------------------------------------
+// Projection
+//--------------------------------------
+
+int sky_data_projection_init(sky_data_projection *projection,
+    sky_data_descriptor *source, sky_data_descriptor *target);
+
+void sky_data_projection_uninit(sky_data_projection *projection);
+
+void sky_data_projection_apply(sky_data_projection *projection, void *source,
+    void *target);
+
 #endif
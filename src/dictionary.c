@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "dictionary.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a reference to a dictionary.
+//
+// Returns a reference to the new dictionary if successful. Otherwise returns
+// null.
+sky_dictionary *sky_dictionary_create()
+{
+    sky_dictionary *dictionary = calloc(1, sizeof(sky_dictionary)); check_mem(dictionary);
+    return dictionary;
+
+error:
+    sky_dictionary_free(dictionary);
+    return NULL;
+}
+
+// Removes a dictionary reference from memory.
+//
+// dictionary - The dictionary to free.
+void sky_dictionary_free(sky_dictionary *dictionary)
+{
+    if(dictionary) {
+        uint32_t i;
+        for(i=0; i<dictionary->count; i++) {
+            bdestroy(dictionary->values[i]);
+        }
+        free(dictionary->values);
+        free(dictionary->index);
+        free(dictionary);
+    }
+}
+
+
+//--------------------------------------
+// Index
+//--------------------------------------
+
+// Finds the index slot for a value. The slot either holds the value or is
+// the empty slot where it should be inserted.
+//
+// dictionary - The dictionary.
+// value      - The value to find.
+//
+// Returns the slot number.
+static uint32_t sky_dictionary_find_slot(sky_dictionary *dictionary,
+                                         bstring value)
+{
+    uint32_t mask = dictionary->index_capacity - 1;
+    uint32_t slot = sky_bstring_fnv1a(value) & mask;
+    while(dictionary->index[slot] != 0) {
+        bstring existing = dictionary->values[dictionary->index[slot]-1];
+        if(blength(existing) == blength(value) && memcmp(bdatae(existing, ""), bdatae(value, ""), blength(value)) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Rebuilds the index with a new capacity.
+//
+// dictionary - The dictionary.
+// capacity   - The number of slots. This must be a power of two.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_dictionary_reindex(sky_dictionary *dictionary, uint32_t capacity)
+{
+    free(dictionary->index);
+    dictionary->index = calloc(capacity, sizeof(*dictionary->index));
+    check_mem(dictionary->index);
+    dictionary->index_capacity = capacity;
+
+    uint32_t i;
+    for(i=0; i<dictionary->count; i++) {
+        uint32_t slot = sky_dictionary_find_slot(dictionary, dictionary->values[i]);
+        dictionary->index[slot] = i + 1;
+    }
+
+    return 0;
+
+error:
+    dictionary->index_capacity = 0;
+    return -1;
+}
+
+// Appends a value to the dictionary without checking for duplicates.
+//
+// dictionary - The dictionary.
+// value      - The value to append. The dictionary takes ownership.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_dictionary_append(sky_dictionary *dictionary, bstring value)
+{
+    int rc;
+    check(dictionary->count < SKY_DICTIONARY_MAX_COUNT, "Dictionary is full");
+
+    if(dictionary->count == dictionary->capacity) {
+        dictionary->capacity = (dictionary->capacity > 0 ? dictionary->capacity * 2 : 16);
+        dictionary->values = realloc(dictionary->values, dictionary->capacity * sizeof(*dictionary->values));
+        check_mem(dictionary->values);
+    }
+    dictionary->values[dictionary->count++] = value;
+
+    if(dictionary->count * 2 > dictionary->index_capacity) {
+        rc = sky_dictionary_reindex(dictionary, dictionary->index_capacity > 0 ? dictionary->index_capacity * 2 : 32);
+        check(rc == 0, "Unable to index dictionary");
+    }
+    else {
+        uint32_t slot = sky_dictionary_find_slot(dictionary, value);
+        dictionary->index[slot] = dictionary->count;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Encoding
+//--------------------------------------
+
+// Retrieves the code for a value. The value is added to the dictionary if it
+// does not exist yet. Existing values can still be encoded once the
+// dictionary is full but new values are rejected.
+//
+// dictionary - The dictionary.
+// value      - The string value.
+// code       - A pointer to where the code is returned.
+// added      - A pointer to where a flag is returned stating if the value
+//              was added. This can be null.
+//
+// Returns 0 if successful, SKY_DICTIONARY_FULL if the value is new and the
+// dictionary is full, otherwise returns -1.
+int sky_dictionary_encode(sky_dictionary *dictionary, bstring value,
+                          int64_t *code, bool *added)
+{
+    int rc;
+    bstring copy = NULL;
+    assert(dictionary != NULL);
+    assert(code != NULL);
+
+    if(added != NULL) {
+        *added = false;
+    }
+
+    rc = sky_dictionary_find(dictionary, value, code);
+    check(rc == 0, "Unable to search dictionary");
+
+    if(*code == 0) {
+        if(dictionary->count >= SKY_DICTIONARY_MAX_COUNT) {
+            return SKY_DICTIONARY_FULL;
+        }
+        copy = (value != NULL ? bstrcpy(value) : bfromcstr("")); check_mem(copy);
+        rc = sky_dictionary_append(dictionary, copy);
+        check(rc == 0, "Unable to add dictionary value");
+        copy = NULL;
+        *code = dictionary->count;
+        if(added != NULL) {
+            *added = true;
+        }
+    }
+
+    return 0;
+
+error:
+    bdestroy(copy);
+    *code = 0;
+    return -1;
+}
+
+// Retrieves the code for a value without modifying the dictionary.
+//
+// dictionary - The dictionary.
+// value      - The string value.
+// code       - A pointer to where the code is returned. This is zero if the
+//              value is not in the dictionary.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_find(sky_dictionary *dictionary, bstring value,
+                        int64_t *code)
+{
+    struct tagbstring empty = bsStatic("");
+    assert(dictionary != NULL);
+    assert(code != NULL);
+
+    *code = 0;
+    if(dictionary->count > 0) {
+        uint32_t slot = sky_dictionary_find_slot(dictionary, (value != NULL ? value : &empty));
+        *code = dictionary->index[slot];
+    }
+
+    return 0;
+}
+
+// Retrieves the value for a code.
+//
+// dictionary - The dictionary.
+// code       - The code.
+//
+// Returns the value owned by the dictionary or null if the code is unknown.
+bstring sky_dictionary_decode(sky_dictionary *dictionary, int64_t code)
+{
+    assert(dictionary != NULL);
+    if(code < 1 || code > dictionary->count) {
+        return NULL;
+    }
+    return dictionary->values[code-1];
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Calculates the total number of bytes needed to store the dictionary.
+//
+// dictionary - The dictionary.
+//
+// Returns the number of bytes required to store the dictionary.
+size_t sky_dictionary_sizeof(sky_dictionary *dictionary)
+{
+    size_t sz = minipack_sizeof_array(dictionary->count);
+    uint32_t i;
+    for(i=0; i<dictionary->count; i++) {
+        sz += minipack_sizeof_raw(blength(dictionary->values[i])) + blength(dictionary->values[i]);
+    }
+    return sz;
+}
+
+// Serializes the values of a dictionary as an array in code order.
+//
+// dictionary - The dictionary.
+// file       - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_pack(sky_dictionary *dictionary, FILE *file)
+{
+    int rc;
+    size_t sz;
+    check(dictionary != NULL, "Dictionary required");
+    check(file != NULL, "File stream required");
+
+    rc = minipack_fwrite_array(file, dictionary->count, &sz);
+    check(rc == 0, "Unable to write dictionary array");
+
+    uint32_t i;
+    for(i=0; i<dictionary->count; i++) {
+        rc = sky_minipack_fwrite_bstring(file, dictionary->values[i]);
+        check(rc == 0, "Unable to write dictionary value");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Deserializes the values of a dictionary. The values are appended in order
+// so that they keep their codes.
+//
+// dictionary - The dictionary.
+// file       - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_unpack(sky_dictionary *dictionary, FILE *file)
+{
+    int rc;
+    size_t sz;
+    bstring value = NULL;
+    check(dictionary != NULL, "Dictionary required");
+    check(file != NULL, "File stream required");
+
+    uint32_t count = minipack_fread_array(file, &sz);
+    check(sz > 0, "Unable to read dictionary array");
+
+    uint32_t i;
+    for(i=0; i<count; i++) {
+        rc = sky_minipack_fread_bstring(file, &value);
+        check(rc == 0, "Unable to read dictionary value");
+        rc = sky_dictionary_append(dictionary, value);
+        check(rc == 0, "Unable to add dictionary value");
+        value = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(value);
+    return -1;
+}
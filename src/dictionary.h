@@ -0,0 +1,90 @@
+#ifndef _dictionary_h
+#define _dictionary_h
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_dictionary sky_dictionary;
+
+#include "bstring.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A dictionary maps the values of a low-cardinality string property to dense
+// integer codes. Codes start at one so that a zero code represents an unset
+// value. Events store the code as an integer instead of the string and the
+// dictionary is saved along with the property so codes can be decoded later.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The maximum number of distinct values that a dictionary can hold.
+#define SKY_DICTIONARY_MAX_COUNT 65535
+
+// The status returned when a new value can't be encoded because the
+// dictionary already holds the maximum number of values.
+#define SKY_DICTIONARY_FULL 1
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_dictionary {
+    bstring *values;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *index;
+    uint32_t index_capacity;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_dictionary *sky_dictionary_create();
+
+void sky_dictionary_free(sky_dictionary *dictionary);
+
+//--------------------------------------
+// Encoding
+//--------------------------------------
+
+int sky_dictionary_encode(sky_dictionary *dictionary, bstring value,
+    int64_t *code, bool *added);
+
+int sky_dictionary_find(sky_dictionary *dictionary, bstring value,
+    int64_t *code);
+
+bstring sky_dictionary_decode(sky_dictionary *dictionary, int64_t code);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+size_t sky_dictionary_sizeof(sky_dictionary *dictionary);
+
+int sky_dictionary_pack(sky_dictionary *dictionary, FILE *file);
+
+int sky_dictionary_unpack(sky_dictionary *dictionary, FILE *file);
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <string.h>
 
 #include "dbg.h"
 #include "sky_endian.h"
@@ -36,6 +37,64 @@ sky_event_flag_t sky_event_get_flag(sky_action_id_t action_id, uint32_t data_len
 }
 
 
+//--------------------------------------
+// Varint
+//--------------------------------------
+
+// Calculates the number of bytes needed to store an unsigned varint.
+//
+// value - The value.
+//
+// Returns the length of the encoded value.
+static size_t sky_event_varint_sizeof(uint64_t value)
+{
+    size_t sz = 1;
+    while(value >= 0x80) {
+        value >>= 7;
+        sz++;
+    }
+    return sz;
+}
+
+// Writes an unsigned varint using 7 bits per byte with the high bit set on
+// every byte except the last.
+//
+// value - The value.
+// ptr   - The pointer to write to.
+//
+// Returns the number of bytes written.
+static size_t sky_event_varint_pack(uint64_t value, void *ptr)
+{
+    uint8_t *p = (uint8_t*)ptr;
+    while(value >= 0x80) {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p - (uint8_t*)ptr;
+}
+
+// Reads an unsigned varint.
+//
+// value - A pointer to where the value is returned.
+// ptr   - The pointer to read from.
+//
+// Returns the number of bytes read.
+static size_t sky_event_varint_unpack(uint64_t *value, void *ptr)
+{
+    uint8_t *p = (uint8_t*)ptr;
+    uint64_t v = 0;
+    int shift = 0;
+    while(*p & 0x80) {
+        v |= ((uint64_t)(*p++ & 0x7F)) << shift;
+        shift += 7;
+    }
+    v |= ((uint64_t)*p++) << shift;
+    *value = v;
+    return p - (uint8_t*)ptr;
+}
+
+
 //--------------------------------------
 // Data Allocation
 //--------------------------------------
@@ -256,35 +315,71 @@ sky_event_data_length_t sky_event_sizeof_data(sky_event *event)
     return sz;
 }
 
-// Calculates the total length of an event element stored in raw format at the
-// given pointer.
+// Calculates the number of bytes needed to store an event in the version 2
+// format.
 //
-// ptr - A pointer to the raw event data.
+// event   - The event.
+// prev_ts - A pointer to the shifted timestamp of the previous event on the
+//           path or null if the event starts a chunk.
 //
-// Returns the length of the raw event data.
-size_t sky_event_sizeof_raw(void *ptr)
+// Returns the length of the encoded event or zero if the event has no action
+// and no data.
+size_t sky_event_sizeof_v2(sky_event *event, sky_timestamp_t *prev_ts)
 {
-    size_t sz = 0;
-    char event_flag = *((sky_event_flag_t*)ptr);
+    if(event->action_id == 0 && event->data_count == 0) {
+        return 0;
+    }
 
-    // Add event flag and timestamp.
-    sz += sizeof(sky_event_flag_t);
-    sz += sizeof(sky_timestamp_t);
+    sky_event_data_length_t data_length = sky_event_sizeof_data(event);
+    sky_timestamp_t ts = sky_timestamp_shift(event->timestamp);
+    return sky_event_sizeof_hdr_v2(ts, prev_ts, event->action_id, data_length) + data_length;
+}
 
-    // Add action length.
-    if(event_flag & SKY_EVENT_FLAG_ACTION) {
-        sz += sizeof(sky_action_id_t);
-    }
+// Calculates the number of bytes needed to store a version 2 event header.
+//
+// ts          - The shifted timestamp of the event.
+// prev_ts     - A pointer to the shifted timestamp of the previous event on
+//               the path or null if the event starts a chunk.
+// action_id   - The action id of the event.
+// data_length - The length, in bytes, of the data section of the event.
+//
+// Returns the length of the encoded header.
+size_t sky_event_sizeof_hdr_v2(sky_timestamp_t ts, sky_timestamp_t *prev_ts,
+                               sky_action_id_t action_id,
+                               sky_event_data_length_t data_length)
+{
+    size_t sz = sizeof(sky_event_flag_t);
 
-    // Add data length.
-    if(event_flag & SKY_EVENT_FLAG_DATA) {
-        sky_event_data_length_t data_length = *((sky_event_data_length_t*)(ptr+sz));
-        sz += sizeof(data_length);
-        sz += data_length;
+    if(prev_ts != NULL && ts >= *prev_ts) {
+        sz += sky_event_varint_sizeof((uint64_t)(ts - *prev_ts));
     }
-    
+    else {
+        sz += sizeof(sky_timestamp_t);
+    }
+    if(action_id != 0) {
+        sz += sky_event_varint_sizeof(action_id);
+    }
+    if(data_length > 0) {
+        sz += sky_event_varint_sizeof(data_length);
+    }
+
     return sz;
-}    
+}
+
+// Calculates the total length of an event element stored in raw format at the
+// given pointer. Both versions of the raw format are supported.
+//
+// ptr - A pointer to the raw event data.
+//
+// Returns the length of the raw event data.
+size_t sky_event_sizeof_raw(void *ptr)
+{
+    size_t sz;
+    sky_action_id_t action_id;
+    sky_event_data_length_t data_length;
+    sky_event_unpack_raw_hdr(ptr, 0, NULL, &action_id, &data_length, &sz);
+    return sz + data_length;
+}
 
 
 
@@ -387,6 +482,116 @@ error:
     return -1;
 }
 
+// Serializes an event to memory in the version 2 format.
+//
+// event   - The event to pack.
+// prev_ts - A pointer to the shifted timestamp of the previous event on the
+//           path or null if the event starts a chunk.
+// ptr     - The pointer to the current location.
+// sz      - The number of bytes written.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_pack_v2(sky_event *event, sky_timestamp_t *prev_ts, void *ptr,
+                      size_t *sz)
+{
+    int rc;
+    size_t _sz;
+    void *start = ptr;
+
+    // Validate.
+    check(event != NULL, "Event required");
+    check(ptr != NULL, "Pointer required");
+
+    // Pack header.
+    size_t data_length = sky_event_sizeof_data(event);
+    sky_timestamp_t ts = sky_timestamp_shift(event->timestamp);
+    rc = sky_event_pack_hdr_v2(ts, prev_ts, event->action_id, data_length, ptr, &_sz);
+    check(rc == 0, "Unable to pack event header");
+    ptr += _sz;
+
+    // Pack data.
+    uint64_t i;
+    for(i=0; i<event->data_count; i++) {
+        rc = sky_event_data_pack(event->data[i], ptr, &_sz);
+        check(rc == 0, "Unable to pack event data at %p", ptr);
+        ptr += _sz;
+    }
+
+    // Store number of bytes written.
+    if(sz != NULL) {
+        *sz = (ptr-start);
+    }
+
+    return 0;
+
+error:
+    if(sz != NULL) *sz = 0;
+    return -1;
+}
+
+// Serializes a version 2 event header to memory. The timestamp is delta
+// encoded against the previous event if there is one and the event does not
+// come before it.
+//
+// ts          - The shifted timestamp of the event.
+// prev_ts     - A pointer to the shifted timestamp of the previous event on
+//               the path or null if the event starts a chunk.
+// action_id   - The action id of the event.
+// data_length - The length, in bytes, of the data section of the event.
+// ptr         - The pointer to the current location.
+// sz          - The number of bytes written.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_pack_hdr_v2(sky_timestamp_t ts, sky_timestamp_t *prev_ts,
+                          sky_action_id_t action_id,
+                          sky_event_data_length_t data_length,
+                          void *ptr, size_t *sz)
+{
+    void *start = ptr;
+
+    // Validate.
+    check(ptr != NULL, "Pointer required");
+
+    // Write event flag.
+    bool delta = (prev_ts != NULL && ts >= *prev_ts);
+    sky_event_flag_t flag = sky_event_get_flag(action_id, data_length) | SKY_EVENT_FLAG_V2;
+    if(delta) {
+        flag |= SKY_EVENT_FLAG_DELTA;
+    }
+    *((sky_event_flag_t*)ptr) = flag;
+    ptr += sizeof(flag);
+
+    // Write timestamp.
+    if(delta) {
+        ptr += sky_event_varint_pack((uint64_t)(ts - *prev_ts), ptr);
+    }
+    else {
+        *((sky_timestamp_t*)ptr) = ts;
+        ptr += sizeof(sky_timestamp_t);
+    }
+
+    // Write action id.
+    if(action_id != 0) {
+        ptr += sky_event_varint_pack(action_id, ptr);
+    }
+
+    // Write data length.
+    if(data_length > 0) {
+        ptr += sky_event_varint_pack(data_length, ptr);
+    }
+
+    // Store number of bytes written.
+    if(sz != NULL) {
+        *sz = (ptr-start);
+    }
+
+    return 0;
+
+error:
+    if(sz != NULL) *sz = 0;
+    return -1;
+}
+
 // Deserializes an event from a given file at the file's current offset.
 //
 // event - The event to unpack into.
@@ -451,46 +656,171 @@ int sky_event_unpack_hdr(sky_timestamp_t *timestamp,
                          sky_event_data_length_t *data_length,
                          void *ptr, size_t *sz)
 {
-    void *start = ptr;
+    int rc;
+    sky_timestamp_t ts;
 
     // Validate.
     check(ptr != NULL, "Pointer required");
+    check(!(*((sky_event_flag_t*)ptr) & SKY_EVENT_FLAG_DELTA), "Delta encoded event requires the previous timestamp");
+
+    rc = sky_event_unpack_raw_hdr(ptr, 0, &ts, action_id, data_length, sz);
+    check(rc == 0, "Unable to unpack raw event header");
+    *timestamp = sky_timestamp_unshift(ts);
+
+    return 0;
+
+error:
+    if(sz != NULL) *sz = 0;
+    return -1;
+}
+
+// Deserializes the header of an event stored in either raw format.
+//
+// ptr         - The pointer to the current location.
+// prev_ts     - The shifted timestamp of the previous event on the path. This
+//               is only used if the event is delta encoded.
+// ts          - A pointer to where the shifted timestamp will be returned.
+//               This can be null if the timestamp is not needed.
+// action_id   - A pointer to where the event's action id will be returned.
+// data_length - A pointer to where the event's data length will be returned.
+// sz          - The number of bytes read.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_unpack_raw_hdr(void *ptr, sky_timestamp_t prev_ts,
+                             sky_timestamp_t *ts, sky_action_id_t *action_id,
+                             sky_event_data_length_t *data_length, size_t *sz)
+{
+    uint64_t value;
+    void *start = ptr;
 
     // Read event flag.
     sky_event_flag_t flag = *((sky_event_flag_t*)ptr);
     ptr += sizeof(flag);
 
-    // Read timestamp.
-    *timestamp = sky_timestamp_unshift(*((sky_timestamp_t*)ptr));
-    ptr += sizeof(sky_timestamp_t);
-    
-    // Read action if one exists.
-    if(flag & SKY_EVENT_FLAG_ACTION) {
-        *action_id = *((sky_action_id_t*)ptr);
-        ptr += sizeof(sky_action_id_t);
+    // Read version 1 header.
+    if(!(flag & SKY_EVENT_FLAG_V2)) {
+        if(ts != NULL) {
+            *ts = *((sky_timestamp_t*)ptr);
+        }
+        ptr += sizeof(sky_timestamp_t);
+
+        if(flag & SKY_EVENT_FLAG_ACTION) {
+            *action_id = *((sky_action_id_t*)ptr);
+            ptr += sizeof(sky_action_id_t);
+        }
+        else {
+            *action_id = 0;
+        }
+
+        if(flag & SKY_EVENT_FLAG_DATA) {
+            *data_length = *((sky_event_data_length_t*)ptr);
+            ptr += sizeof(sky_event_data_length_t);
+        }
+        else {
+            *data_length = 0;
+        }
     }
+    // Read version 2 header.
     else {
-        *action_id = 0;
+        if(flag & SKY_EVENT_FLAG_DELTA) {
+            ptr += sky_event_varint_unpack(&value, ptr);
+            if(ts != NULL) {
+                *ts = prev_ts + (sky_timestamp_t)value;
+            }
+        }
+        else {
+            if(ts != NULL) {
+                *ts = *((sky_timestamp_t*)ptr);
+            }
+            ptr += sizeof(sky_timestamp_t);
+        }
+
+        if(flag & SKY_EVENT_FLAG_ACTION) {
+            ptr += sky_event_varint_unpack(&value, ptr);
+            *action_id = (sky_action_id_t)value;
+        }
+        else {
+            *action_id = 0;
+        }
+
+        if(flag & SKY_EVENT_FLAG_DATA) {
+            ptr += sky_event_varint_unpack(&value, ptr);
+            *data_length = (sky_event_data_length_t)value;
+        }
+        else {
+            *data_length = 0;
+        }
     }
 
-    // Read data length.
-    if(flag & SKY_EVENT_FLAG_DATA) {
-        *data_length = *((sky_event_data_length_t*)ptr);
-        ptr += sizeof(sky_event_data_length_t);
+    // Store number of bytes read.
+    if(sz != NULL) {
+        *sz = (ptr-start);
+    }
+
+    return 0;
+}
+
+// Retrieves the shifted timestamp of an event stored in either raw format.
+//
+// ptr     - A pointer to the raw event data.
+// prev_ts - The shifted timestamp of the previous event on the path. This is
+//           only used if the event is delta encoded.
+//
+// Returns the shifted timestamp of the event.
+sky_timestamp_t sky_event_get_raw_ts(void *ptr, sky_timestamp_t prev_ts)
+{
+    sky_event_flag_t flag = *((sky_event_flag_t*)ptr);
+    if(flag & SKY_EVENT_FLAG_DELTA) {
+        uint64_t delta;
+        sky_event_varint_unpack(&delta, ptr+sizeof(flag));
+        return prev_ts + (sky_timestamp_t)delta;
     }
     else {
-        *data_length = 0;
+        return *((sky_timestamp_t*)(ptr+sizeof(flag)));
+    }
+}
+
+// Copies a raw event to a new location and re-encodes its header in the
+// version 2 format against a new previous event. This is used when the event
+// before it on a path changes or when it becomes the start of a chunk.
+//
+// ptr     - A pointer to the raw event data.
+// ts      - The shifted timestamp of the event.
+// prev_ts - A pointer to the shifted timestamp of the new previous event or
+//           null if the event starts a chunk.
+// dest    - The pointer to write the event to. This cannot overlap the
+//           source event.
+// sz      - The number of bytes written.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_rebase_raw(void *ptr, sky_timestamp_t ts,
+                         sky_timestamp_t *prev_ts, void *dest, size_t *sz)
+{
+    int rc;
+    size_t hdr_sz, _sz;
+    sky_action_id_t action_id;
+    sky_event_data_length_t data_length;
+
+    // Validate.
+    check(ptr != NULL, "Pointer required");
+    check(dest != NULL, "Destination required");
+
+    rc = sky_event_unpack_raw_hdr(ptr, 0, NULL, &action_id, &data_length, &hdr_sz);
+    check(rc == 0, "Unable to unpack raw event header");
+    rc = sky_event_pack_hdr_v2(ts, prev_ts, action_id, data_length, dest, &_sz);
+    check(rc == 0, "Unable to pack event header");
+    if(data_length > 0) {
+        memcpy(dest + _sz, ptr + hdr_sz, data_length);
     }
 
-    // Store number of bytes read.
     if(sz != NULL) {
-        *sz = (ptr-start);
+        *sz = _sz + data_length;
     }
 
     return 0;
 
 error:
-    *sz = 0;
+    if(sz != NULL) *sz = 0;
     return -1;
 }
 
@@ -32,6 +32,25 @@
  * change over time without destroying data stored in the past. That also means
  * that searches across the data will take into account the state of an object
  * at a specific point in time.
+ *
+ * Events are stored on a path in one of two raw formats. Both formats begin
+ * with a flag byte that states whether the event has an action and data.
+ *
+ * Version 1 events store a full shifted timestamp, a fixed width action id
+ * and a fixed width data length:
+ *
+ *   FLAG | TIMESTAMP(8) | [ACTION ID(2)] | [DATA LENGTH(4) | DATA]
+ *
+ * Version 2 events set the V2 flag and store the action id and data length as
+ * varints. If the DELTA flag is set then the timestamp is stored as a varint
+ * of the difference from the previous event's timestamp. Otherwise the full
+ * shifted timestamp is stored. The first event in every chunk is never delta
+ * encoded so chunks can be read independently:
+ *
+ *   FLAG | TIMESTAMP(8) or DELTA(varint) | [ACTION ID] | [DATA LENGTH | DATA]
+ *
+ * New events are written as version 2 but both formats can be mixed on the
+ * same path.
  */
 
 
@@ -47,9 +66,15 @@
 
 #define SKY_EVENT_FLAG_ACTION  1
 #define SKY_EVENT_FLAG_DATA    2
+#define SKY_EVENT_FLAG_V2      4
+#define SKY_EVENT_FLAG_DELTA   8
 
 #define SKY_EVENT_HEADER_LENGTH sizeof(sky_event_flag_t) + sizeof(sky_timestamp_t)
 
+// The largest version 2 header: a flag, a 10 byte delta, a 3 byte action id
+// and a 5 byte data length.
+#define SKY_EVENT_V2_MAX_HEADER_LENGTH 19
+
 
 //==============================================================================
 //
@@ -93,6 +118,11 @@ size_t sky_event_sizeof(sky_event *event);
 
 sky_event_data_length_t sky_event_sizeof_data(sky_event *event);
 
+size_t sky_event_sizeof_v2(sky_event *event, sky_timestamp_t *prev_ts);
+
+size_t sky_event_sizeof_hdr_v2(sky_timestamp_t ts, sky_timestamp_t *prev_ts,
+    sky_action_id_t action_id, sky_event_data_length_t data_length);
+
 size_t sky_event_sizeof_raw(void *ptr);
 
 int sky_event_pack(sky_event *event, void *ptr, size_t *sz);
@@ -100,11 +130,27 @@ int sky_event_pack(sky_event *event, void *ptr, size_t *sz);
 int sky_event_pack_hdr(sky_timestamp_t timestamp, sky_action_id_t action_id,
     sky_event_data_length_t data_length, void *ptr, size_t *sz);
 
+int sky_event_pack_v2(sky_event *event, sky_timestamp_t *prev_ts, void *ptr,
+    size_t *sz);
+
+int sky_event_pack_hdr_v2(sky_timestamp_t ts, sky_timestamp_t *prev_ts,
+    sky_action_id_t action_id, sky_event_data_length_t data_length, void *ptr,
+    size_t *sz);
+
 int sky_event_unpack(sky_event *event, void *ptr, size_t *sz);
 
 int sky_event_unpack_hdr(sky_timestamp_t *timestamp, sky_action_id_t *action_id,
     sky_event_data_length_t *data_length, void *ptr, size_t *sz);
 
+int sky_event_unpack_raw_hdr(void *ptr, sky_timestamp_t prev_ts,
+    sky_timestamp_t *ts, sky_action_id_t *action_id,
+    sky_event_data_length_t *data_length, size_t *sz);
+
+sky_timestamp_t sky_event_get_raw_ts(void *ptr, sky_timestamp_t prev_ts);
+
+int sky_event_rebase_raw(void *ptr, sky_timestamp_t ts,
+    sky_timestamp_t *prev_ts, void *dest, size_t *sz);
+
 //--------------------------------------
 // Data Management
 //--------------------------------------
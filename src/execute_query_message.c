@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "execute_query_message.h"
+#include "lua_aggregate_message.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+//--------------------------------------
+// String Constants
+//--------------------------------------
+
+#define SKY_EXECUTE_QUERY_KEY_COUNT 2
+
+struct tagbstring SKY_EXECUTE_QUERY_KEY_HANDLE     = bsStatic("handle");
+struct tagbstring SKY_EXECUTE_QUERY_KEY_PARAMETERS = bsStatic("parameters");
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates an 'execute_query' message object.
+//
+// Returns a new message.
+sky_execute_query_message *sky_execute_query_message_create()
+{
+    sky_execute_query_message *message = NULL;
+    message = calloc(1, sizeof(sky_execute_query_message)); check_mem(message);
+    return message;
+
+error:
+    sky_execute_query_message_free(message);
+    return NULL;
+}
+
+// Frees an 'execute_query' message object from memory.
+//
+// message - The message object to be freed.
+//
+// Returns nothing.
+void sky_execute_query_message_free(sky_execute_query_message *message)
+{
+    if(message) {
+        uint32_t i;
+        for(i=0; i<message->argument_count; i++) {
+            sky_query_argument_free(message->arguments[i]);
+        }
+        free(message->arguments);
+        message->arguments = NULL;
+        message->argument_count = 0;
+        free(message);
+    }
+}
+
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+// Creates a message handler for the 'execute_query' message.
+//
+// Returns a message handler.
+sky_message_handler *sky_execute_query_message_handler_create()
+{
+    sky_message_handler *handler = sky_message_handler_create(); check_mem(handler);
+    handler->scope = SKY_MESSAGE_HANDLER_SCOPE_TABLE;
+    handler->name = bfromcstr("execute_query");
+    handler->process = sky_execute_query_message_process;
+    return handler;
+
+error:
+    sky_message_handler_free(handler);
+    return NULL;
+}
+
+// Runs a registered query across a table. The query is run the same way as
+// a 'lua::aggregate' message with the arguments set as global variables.
+//
+// server - The server.
+// header - The message header.
+// table  - The table the message is working against
+// input  - The input file stream.
+// output - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_execute_query_message_process(sky_server *server,
+                                      sky_message_header *header,
+                                      sky_table *table, FILE *input,
+                                      FILE *output)
+{
+    int rc = 0;
+    uint32_t i, j;
+    sky_query *query = NULL;
+    sky_execute_query_message *message = NULL;
+    sky_lua_aggregate_message *aggregate_message = NULL;
+    assert(server != NULL);
+    assert(header != NULL);
+    assert(table != NULL);
+    assert(input != NULL);
+    assert(output != NULL);
+
+    // Parse message.
+    message = sky_execute_query_message_create(); check_mem(message);
+    rc = sky_execute_query_message_unpack(message, input);
+    check(rc == 0, "Unable to unpack 'execute_query' message");
+
+    // Find the query.
+    rc = sky_server_get_query(server, message->handle, &query);
+    check(rc == 0, "Unable to find query");
+    check(query != NULL, "Query not found: %d", message->handle);
+    check(biseq(query->table_path, table->path) == 1, "Query %d does not belong to table: %s", message->handle, bdata(table->path));
+
+    // Only declared parameters can be passed in.
+    for(i=0; i<message->argument_count; i++) {
+        bool found = false;
+        for(j=0; j<query->parameter_count && !found; j++) {
+            found = (biseq(message->arguments[i]->name, query->parameters[j]) == 1);
+        }
+        check(found, "Undeclared query parameter: %s", bdata(message->arguments[i]->name));
+    }
+
+    // Run the query as an aggregation. The arguments move to the new message.
+    aggregate_message = sky_lua_aggregate_message_create(); check_mem(aggregate_message);
+    aggregate_message->source = bstrcpy(query->source); check_mem(aggregate_message->source);
+    rc = sky_query_copy_parameters(query, &aggregate_message->parameters, &aggregate_message->parameter_count);
+    check(rc == 0, "Unable to copy query parameters");
+    aggregate_message->arguments = message->arguments;
+    aggregate_message->argument_count = message->argument_count;
+    message->arguments = NULL;
+    message->argument_count = 0;
+    sky_execute_query_message_free(message);
+    message = NULL;
+
+    return sky_lua_aggregate_message_start(server, aggregate_message, table, input, output);
+
+error:
+    sky_lua_aggregate_message_free(aggregate_message);
+    sky_execute_query_message_free(message);
+    if(!header->multi) {
+        fclose(input);
+        fclose(output);
+    }
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Serializes an 'execute_query' message to a file stream.
+//
+// message - The message.
+// file    - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_execute_query_message_pack(sky_execute_query_message *message,
+                                   FILE *file)
+{
+    int rc;
+    size_t sz;
+    uint32_t i;
+    assert(message != NULL);
+    assert(file != NULL);
+
+    // Map
+    check(minipack_fwrite_map(file, SKY_EXECUTE_QUERY_KEY_COUNT, &sz) == 0, "Unable to write map");
+
+    // Handle
+    check(sky_minipack_fwrite_bstring(file, &SKY_EXECUTE_QUERY_KEY_HANDLE) == 0, "Unable to pack handle key");
+    check(minipack_fwrite_uint(file, message->handle, &sz) == 0, "Unable to pack handle");
+
+    // Parameters
+    check(sky_minipack_fwrite_bstring(file, &SKY_EXECUTE_QUERY_KEY_PARAMETERS) == 0, "Unable to pack parameters key");
+    check(minipack_fwrite_map(file, message->argument_count, &sz) == 0, "Unable to pack parameters map");
+    for(i=0; i<message->argument_count; i++) {
+        check(sky_minipack_fwrite_bstring(file, message->arguments[i]->name) == 0, "Unable to pack parameter name");
+        rc = sky_query_argument_pack(message->arguments[i], file);
+        check(rc == 0, "Unable to pack parameter value");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Deserializes an 'execute_query' message from a file stream.
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_execute_query_message_unpack(sky_execute_query_message *message,
+                                     FILE *file)
+{
+    int rc;
+    size_t sz;
+    bstring key = NULL;
+    assert(message != NULL);
+    assert(file != NULL);
+
+    // Map
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read map");
+
+    // Map items
+    uint32_t i, j;
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read map key");
+
+        if(biseq(key, &SKY_EXECUTE_QUERY_KEY_HANDLE) == 1) {
+            message->handle = (uint32_t)minipack_fread_uint(file, &sz);
+            check(sz > 0, "Unable to read handle");
+        }
+        else if(biseq(key, &SKY_EXECUTE_QUERY_KEY_PARAMETERS) == 1) {
+            uint32_t count = minipack_fread_map(file, &sz);
+            check(sz > 0, "Unable to read parameters map");
+            check(message->arguments == NULL, "Duplicate parameters key");
+            if(count > 0) {
+                message->arguments = calloc(count, sizeof(*message->arguments));
+                check_mem(message->arguments);
+            }
+            for(j=0; j<count; j++) {
+                sky_query_argument *argument = sky_query_argument_create(); check_mem(argument);
+                message->arguments[message->argument_count++] = argument;
+                rc = sky_minipack_fread_bstring(file, &argument->name);
+                check(rc == 0, "Unable to read parameter name");
+                rc = sky_query_argument_unpack(argument, file);
+                check(rc == 0, "Unable to read parameter value");
+            }
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
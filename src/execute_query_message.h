@@ -0,0 +1,61 @@
+#ifndef _sky_execute_query_message_h
+#define _sky_execute_query_message_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "bstring.h"
+#include "message_handler.h"
+#include "query.h"
+#include "table.h"
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// A message for running a registered query with a set of arguments.
+typedef struct {
+    uint32_t handle;
+    sky_query_argument **arguments;
+    uint32_t argument_count;
+} sky_execute_query_message;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_execute_query_message *sky_execute_query_message_create();
+
+void sky_execute_query_message_free(sky_execute_query_message *message);
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+sky_message_handler *sky_execute_query_message_handler_create();
+
+int sky_execute_query_message_process(sky_server *server,
+    sky_message_header *header, sky_table *table, FILE *input, FILE *output);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_execute_query_message_pack(sky_execute_query_message *message,
+    FILE *file);
+
+int sky_execute_query_message_unpack(sky_execute_query_message *message,
+    FILE *file);
+
+#endif
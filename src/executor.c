@@ -0,0 +1,227 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "executor.h"
+#include "dbg.h"
+#include "mem.h"
+
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+void *sky_executor_run(void *_executor);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates an executor.
+//
+// thread_count - The number of threads.
+//
+// Returns a reference to the executor.
+sky_executor *sky_executor_create(uint32_t thread_count)
+{
+    sky_executor *executor = NULL;
+    check(thread_count > 0, "Thread count required");
+
+    executor = calloc(1, sizeof(sky_executor)); check_mem(executor);
+    executor->thread_count = thread_count;
+    check(pthread_mutex_init(&executor->mutex, NULL) == 0, "Unable to init executor mutex");
+    check(pthread_cond_init(&executor->cond, NULL) == 0, "Unable to init executor condition");
+
+    return executor;
+
+error:
+    sky_executor_free(executor);
+    return NULL;
+}
+
+// Stops an executor and frees it from memory.
+//
+// executor - The executor.
+//
+// Returns nothing.
+void sky_executor_free(sky_executor *executor)
+{
+    if(executor) {
+        sky_executor_stop(executor);
+        free(executor->tasks);
+        executor->tasks = NULL;
+        pthread_mutex_destroy(&executor->mutex);
+        pthread_cond_destroy(&executor->cond);
+        free(executor);
+    }
+}
+
+// Retrieves the number of threads needed to use every processor on the
+// machine.
+//
+// Returns the number of online processors.
+uint32_t sky_executor_get_default_thread_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0 ? (uint32_t)count : SKY_EXECUTOR_DEFAULT_THREAD_COUNT);
+}
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+// Starts the threads of an executor.
+//
+// executor - The executor.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_executor_start(sky_executor *executor)
+{
+    int rc;
+    check(executor != NULL, "Executor required");
+    check(!executor->running, "Executor is already running");
+
+    executor->stopping = false;
+    executor->threads = calloc(executor->thread_count, sizeof(*executor->threads));
+    check_mem(executor->threads);
+    executor->running = true;
+
+    for(executor->started_count=0; executor->started_count<executor->thread_count; executor->started_count++) {
+        rc = pthread_create(&executor->threads[executor->started_count], NULL, sky_executor_run, executor);
+        check(rc == 0, "Unable to create executor thread");
+    }
+
+    return 0;
+
+error:
+    if(executor) sky_executor_stop(executor);
+    return -1;
+}
+
+// Waits for queued tasks to finish and then stops the executor's threads.
+// Tasks that are submitted while the executor is stopping are still run.
+//
+// executor - The executor.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_executor_stop(sky_executor *executor)
+{
+    uint32_t i;
+    check(executor != NULL, "Executor required");
+
+    if(executor->running) {
+        pthread_mutex_lock(&executor->mutex);
+        executor->stopping = true;
+        pthread_cond_broadcast(&executor->cond);
+        pthread_mutex_unlock(&executor->mutex);
+
+        for(i=0; i<executor->started_count; i++) {
+            pthread_join(executor->threads[i], NULL);
+        }
+        free(executor->threads);
+        executor->threads = NULL;
+        executor->started_count = 0;
+        executor->running = false;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Scheduling
+//--------------------------------------
+
+// Queues a task to run on the next available executor thread. Tasks are run
+// in the order that they are submitted.
+//
+// executor - The executor.
+// func     - The function to run.
+// data     - The argument passed to the function.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_executor_submit(sky_executor *executor, sky_executor_func_t func,
+                        void *data)
+{
+    check(executor != NULL, "Executor required");
+    check(func != NULL, "Task function required");
+    check(executor->running, "Executor is not running");
+
+    pthread_mutex_lock(&executor->mutex);
+
+    // Grow the queue and unwrap any entries that wrapped around.
+    if(executor->task_count == executor->task_capacity) {
+        uint32_t capacity = (executor->task_capacity > 0 ? executor->task_capacity * 2 : 64);
+        sky_executor_task *tasks = calloc(capacity, sizeof(*tasks));
+        if(tasks == NULL) {
+            pthread_mutex_unlock(&executor->mutex);
+            sentinel("Unable to grow executor queue");
+        }
+        uint32_t i;
+        for(i=0; i<executor->task_count; i++) {
+            tasks[i] = executor->tasks[(executor->task_head + i) % executor->task_capacity];
+        }
+        free(executor->tasks);
+        executor->tasks = tasks;
+        executor->task_head = 0;
+        executor->task_capacity = capacity;
+    }
+
+    sky_executor_task *task = &executor->tasks[(executor->task_head + executor->task_count) % executor->task_capacity];
+    task->func = func;
+    task->data = data;
+    executor->task_count++;
+    pthread_cond_signal(&executor->cond);
+    pthread_mutex_unlock(&executor->mutex);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// The executor thread function. Tasks are taken off the queue and run until
+// the executor is stopped and the queue is empty.
+//
+// _executor - The executor.
+//
+// Returns NULL.
+void *sky_executor_run(void *_executor)
+{
+    sky_executor *executor = (sky_executor*)_executor;
+
+    while(true) {
+        pthread_mutex_lock(&executor->mutex);
+        while(executor->task_count == 0 && !executor->stopping) {
+            pthread_cond_wait(&executor->cond, &executor->mutex);
+        }
+        if(executor->task_count == 0) {
+            pthread_mutex_unlock(&executor->mutex);
+            break;
+        }
+        sky_executor_task task = executor->tasks[executor->task_head];
+        executor->task_head = (executor->task_head + 1) % executor->task_capacity;
+        executor->task_count--;
+        pthread_mutex_unlock(&executor->mutex);
+
+        task.func(task.data);
+    }
+
+    return NULL;
+}
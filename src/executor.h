@@ -0,0 +1,96 @@
+#ifndef _sky_executor_h
+#define _sky_executor_h
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct sky_executor sky_executor;
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The executor is a fixed set of threads shared by the whole server that
+// runs the tablet work of every open table. Servlets do not own threads.
+// Instead a servlet is queued on the executor when a worklet arrives and it
+// processes a single turn of work before it is queued again behind the
+// other waiting tasks. The number of threads is therefore set by the
+// machine instead of by the number of tablets that are open.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The thread count used when the number of processors cannot be found.
+#define SKY_EXECUTOR_DEFAULT_THREAD_COUNT 4
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// Defines a function that is run by an executor thread.
+typedef void (*sky_executor_func_t)(void *data);
+
+typedef struct sky_executor_task {
+    sky_executor_func_t func;
+    void *data;
+} sky_executor_task;
+
+struct sky_executor {
+    bool running;
+    bool stopping;
+    pthread_t *threads;
+    uint32_t thread_count;
+    uint32_t started_count;
+    sky_executor_task *tasks;
+    uint32_t task_head;
+    uint32_t task_count;
+    uint32_t task_capacity;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_executor *sky_executor_create(uint32_t thread_count);
+
+void sky_executor_free(sky_executor *executor);
+
+uint32_t sky_executor_get_default_thread_count();
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+int sky_executor_start(sky_executor *executor);
+
+int sky_executor_stop(sky_executor *executor);
+
+//--------------------------------------
+// Scheduling
+//--------------------------------------
+
+int sky_executor_submit(sky_executor *executor, sky_executor_func_t func,
+    void *data);
+
+#endif
@@ -0,0 +1,628 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#include "types.h"
+#include "funnel_message.h"
+#include "path_iterator.h"
+#include "sample.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+//--------------------------------------
+// String Constants
+//--------------------------------------
+
+struct tagbstring SKY_FUNNEL_STATUS_STR   = bsStatic("status");
+struct tagbstring SKY_FUNNEL_OK_STR       = bsStatic("ok");
+struct tagbstring SKY_FUNNEL_DATA_STR     = bsStatic("data");
+struct tagbstring SKY_FUNNEL_COUNT_STR    = bsStatic("count");
+struct tagbstring SKY_FUNNEL_AVG_TIME_STR = bsStatic("avg_time");
+struct tagbstring SKY_FUNNEL_MARGIN_STR   = bsStatic("count_margin");
+struct tagbstring SKY_FUNNEL_SAMPLE_STR   = bsStatic("sample");
+
+struct tagbstring SKY_FUNNEL_KEY_STEPS        = bsStatic("steps");
+struct tagbstring SKY_FUNNEL_KEY_WITHIN       = bsStatic("within");
+struct tagbstring SKY_FUNNEL_KEY_SESSION_IDLE = bsStatic("session_idle");
+struct tagbstring SKY_FUNNEL_KEY_ACTION_ID    = bsStatic("action_id");
+struct tagbstring SKY_FUNNEL_KEY_FILTERS      = bsStatic("filters");
+struct tagbstring SKY_FUNNEL_KEY_SAMPLE       = bsStatic("sample");
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a 'funnel' message object.
+//
+// Returns a new message.
+sky_funnel_message *sky_funnel_message_create()
+{
+    sky_funnel_message *message = NULL;
+    message = calloc(1, sizeof(sky_funnel_message)); check_mem(message);
+    message->plan = sky_query_plan_create(); check_mem(message->plan);
+    return message;
+
+error:
+    sky_funnel_message_free(message);
+    return NULL;
+}
+
+// Frees a 'funnel' message object from memory.
+//
+// message - The message object to be freed.
+//
+// Returns nothing.
+void sky_funnel_message_free(sky_funnel_message *message)
+{
+    if(message) {
+        sky_query_plan_free(message->plan);
+        message->plan = NULL;
+        free(message->steps);
+        message->steps = NULL;
+        message->step_count = 0;
+        free(message->results);
+        message->results = NULL;
+        free(message);
+    }
+}
+
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+// Creates a message handler for the 'funnel' message.
+//
+// Returns a message handler.
+sky_message_handler *sky_funnel_message_handler_create()
+{
+    sky_message_handler *handler = sky_message_handler_create(); check_mem(handler);
+    handler->scope = SKY_MESSAGE_HANDLER_SCOPE_TABLE;
+    handler->name = bfromcstr("funnel");
+    handler->process = sky_funnel_message_process;
+    return handler;
+
+error:
+    sky_message_handler_free(handler);
+    return NULL;
+}
+
+// Compiles the funnel against the table and delegates running it to a
+// worker.
+//
+// server  - The server.
+// header  - The message header.
+// table   - The table the message is working against
+// input   - The input file stream.
+// output  - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_funnel_message_process(sky_server *server, sky_message_header *header,
+                               sky_table *table, FILE *input, FILE *output)
+{
+    int rc = 0;
+    sky_worker *worker = NULL;
+    sky_funnel_message *message = NULL;
+    assert(server != NULL);
+    assert(header != NULL);
+    assert(table != NULL);
+    assert(input != NULL);
+    assert(output != NULL);
+
+    // Create worker.
+    worker = sky_worker_create(); check_mem(worker);
+    worker->pool = server->worker_pool;
+    worker->map = sky_funnel_message_worker_map;
+    worker->map_morsel = sky_funnel_message_worker_map_morsel;
+    worker->map_free = sky_funnel_message_worker_map_free;
+    worker->reduce = sky_funnel_message_worker_reduce;
+    worker->write = sky_funnel_message_worker_write;
+    worker->free = sky_funnel_message_worker_free;
+    worker->input = input;
+    worker->output = output;
+
+    // Parse and compile message.
+    message = sky_funnel_message_create(); check_mem(message);
+    rc = sky_funnel_message_unpack(message, input);
+    check(rc == 0, "Unable to unpack 'funnel' message");
+    rc = sky_funnel_message_compile(message, table->property_file);
+    check(rc == 0, "Unable to compile funnel");
+
+    // Attach servlets.
+    rc = sky_server_get_table_servlets(server, table, &worker->servlets, &worker->servlet_count);
+    check(rc == 0, "Unable to copy servlets to worker");
+
+    // Attach message to worker.
+    worker->data = (sky_funnel_message*)message;
+
+    // Start worker.
+    rc = sky_worker_start(worker);
+    check(rc == 0, "Unable to start worker");
+
+    return 0;
+
+error:
+    sky_funnel_message_free(message);
+    sky_worker_free(worker);
+    return -1;
+}
+
+// Compiles the filters of every step against a table's properties and
+// allocates the results.
+//
+// message       - The message.
+// property_file - The property file of the table the funnel runs against.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_funnel_message_compile(sky_funnel_message *message,
+                               sky_property_file *property_file)
+{
+    int rc;
+    assert(message != NULL);
+    assert(property_file != NULL);
+    check(message->step_count > 0, "At least one step required");
+    check(message->step_count <= SKY_FUNNEL_MESSAGE_MAX_STEP_COUNT, "Too many steps: %d", message->step_count);
+
+    rc = sky_query_plan_compile(message->plan, property_file);
+    check(rc == 0, "Unable to compile step filters");
+
+    message->results = calloc(message->step_count, sizeof(*message->results));
+    check_mem(message->results);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Appends an empty filter to the plan.
+//
+// plan - The query plan.
+// ret  - A pointer to where the filter should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_funnel_message_add_filter(sky_query_plan *plan,
+                                         sky_query_filter **ret)
+{
+    plan->filters = realloc(plan->filters, (plan->filter_count+1) * sizeof(*plan->filters));
+    check_mem(plan->filters);
+    *ret = &plan->filters[plan->filter_count++];
+    memset(*ret, 0, sizeof(**ret));
+    return 0;
+
+error:
+    *ret = NULL;
+    return -1;
+}
+
+// Deserializes a step from a file stream. The step's action is added to the
+// plan as a filter ahead of the step's own filters.
+//
+//   {"action_id":<id>, "filters":[...]}
+//
+// message - The message.
+// step    - The step.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_funnel_message_unpack_step(sky_funnel_message *message,
+                                          sky_funnel_step *step, FILE *file)
+{
+    int rc;
+    size_t sz;
+    uint32_t i, j;
+    bstring key = NULL;
+    sky_query_filter *filter = NULL;
+    sky_query_plan *plan = message->plan;
+
+    // Add the action filter first since it rejects most events.
+    step->filter_index = plan->filter_count;
+    rc = sky_funnel_message_add_filter(plan, &filter);
+    check(rc == 0, "Unable to add action filter");
+    step->filter_count = 1;
+    filter->field_name = bfromcstr("action_id"); check_mem(filter->field_name);
+    filter->op = SKY_QUERY_OP_EQ;
+    filter->value = sky_query_argument_create(); check_mem(filter->value);
+    filter->value->data_type = SKY_DATA_TYPE_INT;
+
+    bool has_action_id = false;
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read step map");
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read step key");
+
+        if(biseq(key, &SKY_FUNNEL_KEY_ACTION_ID) == 1) {
+            step->action_id = (sky_action_id_t)minipack_fread_uint(file, &sz);
+            check(sz > 0, "Unable to read step action id");
+            plan->filters[step->filter_index].value->int_value = step->action_id;
+            has_action_id = true;
+        }
+        else if(biseq(key, &SKY_FUNNEL_KEY_FILTERS) == 1) {
+            uint32_t count = minipack_fread_array(file, &sz);
+            check(sz > 0, "Unable to read step filters array");
+            for(j=0; j<count; j++) {
+                rc = sky_funnel_message_add_filter(plan, &filter);
+                check(rc == 0, "Unable to add step filter");
+                step->filter_count++;
+                rc = sky_query_plan_unpack_filter(filter, file);
+                check(rc == 0, "Unable to read step filter");
+            }
+        }
+        else {
+            sentinel("Invalid step key: %s", bdata(key));
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+    check(has_action_id, "Step action id required");
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+// Deserializes a 'funnel' message from a file stream.
+//
+//   {"steps":[...], "within":<seconds>, "session_idle":<seconds>, "sample":<rate>}
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_funnel_message_unpack(sky_funnel_message *message, FILE *file)
+{
+    int rc;
+    size_t sz;
+    uint32_t i, j;
+    bstring key = NULL;
+    assert(message != NULL);
+    assert(file != NULL);
+
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read map");
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read map key");
+
+        if(biseq(key, &SKY_FUNNEL_KEY_STEPS) == 1) {
+            uint32_t count = minipack_fread_array(file, &sz);
+            check(sz > 0, "Unable to read steps array");
+            check(message->steps == NULL, "Duplicate steps key");
+            check(count <= SKY_FUNNEL_MESSAGE_MAX_STEP_COUNT, "Too many steps: %d", count);
+            if(count > 0) {
+                message->steps = calloc(count, sizeof(*message->steps)); check_mem(message->steps);
+            }
+            for(j=0; j<count; j++) {
+                message->step_count++;
+                rc = sky_funnel_message_unpack_step(message, &message->steps[j], file);
+                check(rc == 0, "Unable to read step");
+            }
+        }
+        else if(biseq(key, &SKY_FUNNEL_KEY_WITHIN) == 1) {
+            message->within = (uint32_t)minipack_fread_uint(file, &sz);
+            check(sz > 0, "Unable to read conversion window");
+        }
+        else if(biseq(key, &SKY_FUNNEL_KEY_SESSION_IDLE) == 1) {
+            message->session_idle = (uint32_t)minipack_fread_uint(file, &sz);
+            check(sz > 0, "Unable to read session idle time");
+        }
+        else if(biseq(key, &SKY_FUNNEL_KEY_SAMPLE) == 1) {
+            rc = sky_sample_unpack_rate(&message->plan->sample_rate, file);
+            check(rc == 0, "Unable to read sample rate");
+        }
+        else {
+            sentinel("Invalid funnel key: %s", bdata(key));
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+// Maps tablet data to funnel step counts.
+//
+// worker - The worker.
+// tablet - The tablet to work against.
+// ret    - A pointer to where the step counts should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_funnel_message_worker_map(sky_worker *worker, sky_tablet *tablet,
+                                  void **ret)
+{
+    assert(tablet != NULL);
+    sky_morsel morsel;
+    memset(&morsel, 0, sizeof(morsel));
+    morsel.tablet = tablet;
+    return sky_funnel_message_worker_map_morsel(worker, &morsel, NULL, ret);
+}
+
+// Maps a range of tablet data to funnel step counts. Each path is walked
+// once and each session within it is matched against the steps in order.
+//
+// worker  - The worker.
+// morsel  - The range of the tablet to work against.
+// context - Unused.
+// ret     - A pointer to where the step counts should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_funnel_message_worker_map_morsel(sky_worker *worker, sky_morsel *morsel,
+                                         void **context, void **ret)
+{
+    int rc;
+    void *data = NULL;
+    sky_funnel_result *results = NULL;
+    assert(worker != NULL);
+    assert(morsel != NULL);
+    assert(ret != NULL);
+    UNUSED(context);
+
+    sky_funnel_message *message = (sky_funnel_message*)worker->data;
+    sky_query_plan *plan = message->plan;
+    sky_funnel_step *steps = message->steps;
+    uint32_t step_count = message->step_count;
+    uint32_t within = message->within;
+
+    // The time each step was entered at for the current session and the
+    // time each step was first reached at for the current path.
+    bool active[SKY_FUNNEL_MESSAGE_MAX_STEP_COUNT];
+    uint32_t entered_at[SKY_FUNNEL_MESSAGE_MAX_STEP_COUNT];
+    bool reached[SKY_FUNNEL_MESSAGE_MAX_STEP_COUNT];
+    uint32_t conversion_time[SKY_FUNNEL_MESSAGE_MAX_STEP_COUNT];
+
+    // Initialize the path iterator.
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    sky_cursor *cursor = &iterator.cursor;
+
+    data = calloc(1, plan->data_descriptor->data_sz); check_mem(data);
+    results = calloc(step_count, sizeof(*results)); check_mem(results);
+    sky_data_object *object = (sky_data_object*)data;
+
+    // Attach data and descriptor to cursor.
+    cursor->data_descriptor = plan->data_descriptor;
+    cursor->data = data;
+
+    // Only visit sampled objects if the funnel is sampled.
+    if(sky_sample_is_enabled(plan->sample_rate)) {
+        sky_path_iterator_set_sample_rate(&iterator, plan->sample_rate);
+    }
+
+    // Paths only count once they enter the first step.
+    sky_query_filters_prune(&plan->filters[steps[0].filter_index], steps[0].filter_count, &iterator);
+
+    rc = sky_path_iterator_set_range(&iterator, morsel->tablet, morsel->start, morsel->end);
+    check(rc == 0, "Unable to initialize path iterator");
+
+    // Iterate over each path.
+    uint64_t path_count  = 0;
+    uint64_t event_count = 0;
+    while(!iterator.eof) {
+        path_count++;
+        memset(reached, 0, step_count * sizeof(*reached));
+
+        rc = sky_cursor_set_session_idle(cursor, message->session_idle);
+        check(rc == 0, "Unable to set session idle time");
+
+        // Each session starts the funnel over.
+        while(!cursor->eof) {
+            rc = sky_cursor_next_session(cursor);
+            check(rc == 0, "Unable to start session");
+            memset(active, 0, step_count * sizeof(*active));
+
+            rc = sky_cursor_next_event(cursor);
+            check(rc == 0, "Unable to initialize cursor");
+
+            while(cursor->in_session) {
+                uint32_t timestamp = object->timestamp;
+
+                // Steps are checked from last to first so that an event only
+                // moves the path forward by a single step.
+                uint32_t i;
+                for(i=step_count; i>1; i--) {
+                    uint32_t prev = i-2;
+                    if(active[prev] && (within == 0 || timestamp - entered_at[prev] <= within)) {
+                        sky_funnel_step *step = &steps[i-1];
+                        if(sky_query_filters_match(&plan->filters[step->filter_index], step->filter_count, data)) {
+                            active[i-1] = true;
+                            entered_at[i-1] = entered_at[prev];
+                            if(!reached[i-1]) {
+                                reached[i-1] = true;
+                                conversion_time[i-1] = timestamp - entered_at[prev];
+                            }
+                        }
+                    }
+                }
+                if(sky_query_filters_match(&plan->filters[steps[0].filter_index], steps[0].filter_count, data)) {
+                    active[0] = true;
+                    entered_at[0] = timestamp;
+                    if(!reached[0]) {
+                        reached[0] = true;
+                        conversion_time[0] = 0;
+                    }
+                }
+
+                rc = sky_cursor_next_event(cursor);
+                check(rc == 0, "Unable to find next event");
+                event_count++;
+            }
+        }
+
+        // Count the path against every step it reached.
+        uint32_t i;
+        for(i=0; i<step_count; i++) {
+            if(reached[i]) {
+                results[i].count++;
+                results[i].total_time += conversion_time[i];
+            }
+        }
+
+        rc = sky_path_iterator_next(&iterator);
+        check(rc == 0, "Unable to find next path");
+    }
+
+    // These counts are only used for debugging so they are not updated
+    // atomically.
+    message->path_count  += path_count;
+    message->event_count += event_count;
+
+    *ret = (void*)results;
+
+    free(data);
+    sky_path_iterator_uninit(&iterator);
+    return 0;
+
+error:
+    *ret = NULL;
+    free(results);
+    free(data);
+    sky_path_iterator_uninit(&iterator);
+    return -1;
+}
+
+// Frees the step counts created by the map function.
+//
+// data - The step counts.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_funnel_message_worker_map_free(void *data)
+{
+    assert(data != NULL);
+    free(data);
+    return 0;
+}
+
+// Adds the step counts created by the map function to the counts saved
+// against the worker.
+//
+// worker - The worker.
+// data   - The step counts created by the map function.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_funnel_message_worker_reduce(sky_worker *worker, void *data)
+{
+    assert(worker != NULL);
+    assert(data != NULL);
+
+    sky_funnel_message *message = (sky_funnel_message*)worker->data;
+    sky_funnel_result *results = (sky_funnel_result*)data;
+
+    uint32_t i;
+    for(i=0; i<message->step_count; i++) {
+        message->results[i].count += results[i].count;
+        message->results[i].total_time += results[i].total_time;
+    }
+
+    return 0;
+}
+
+// Writes the step counts to an output stream.
+//
+// worker - The worker.
+// output - The output stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_funnel_message_worker_write(sky_worker *worker, FILE *output)
+{
+    size_t sz;
+    assert(worker != NULL);
+    assert(output != NULL);
+
+    sky_funnel_message *message = (sky_funnel_message*)worker->data;
+    double rate = message->plan->sample_rate;
+    bool sampled = sky_sample_is_enabled(rate);
+
+    // Return.
+    //   {status:"ok", data:[{count:<count>, avg_time:<seconds>}, ...]}
+    //
+    // Sampled funnels scale each count, add its margin of error and
+    // describe the sample.
+    //   {status:"ok", data:[{count:<count>, avg_time:<seconds>, count_margin:<count>}, ...], sample:{...}}
+    check(minipack_fwrite_map(output, (sampled ? 3 : 2), &sz) == 0, "Unable to write root map");
+    check(sky_minipack_fwrite_bstring(output, &SKY_FUNNEL_STATUS_STR) == 0, "Unable to write status key");
+    check(sky_minipack_fwrite_bstring(output, &SKY_FUNNEL_OK_STR) == 0, "Unable to write status value");
+    check(sky_minipack_fwrite_bstring(output, &SKY_FUNNEL_DATA_STR) == 0, "Unable to write data key");
+    check(minipack_fwrite_array(output, message->step_count, &sz) == 0, "Unable to write steps array");
+
+    uint32_t i;
+    for(i=0; i<message->step_count; i++) {
+        sky_funnel_result *result = &message->results[i];
+        double avg_time = (result->count > 0 ? (double)result->total_time / (double)result->count : 0);
+        uint64_t count = (sampled ? (uint64_t)round(result->count / rate) : result->count);
+        check(minipack_fwrite_map(output, (sampled ? 3 : 2), &sz) == 0, "Unable to write step map");
+        check(sky_minipack_fwrite_bstring(output, &SKY_FUNNEL_COUNT_STR) == 0, "Unable to write count key");
+        check(minipack_fwrite_uint(output, count, &sz) == 0, "Unable to write count");
+        check(sky_minipack_fwrite_bstring(output, &SKY_FUNNEL_AVG_TIME_STR) == 0, "Unable to write average time key");
+        check(minipack_fwrite_double(output, avg_time, &sz) == 0, "Unable to write average time");
+
+        // Each object adds at most one to a step so the sum of the squares
+        // of their contributions is the count itself.
+        if(sampled) {
+            check(sky_minipack_fwrite_bstring(output, &SKY_FUNNEL_MARGIN_STR) == 0, "Unable to write margin key");
+            check(minipack_fwrite_double(output, sky_sample_margin((double)result->count, rate), &sz) == 0, "Unable to write margin");
+        }
+    }
+
+    if(sampled) {
+        check(sky_minipack_fwrite_bstring(output, &SKY_FUNNEL_SAMPLE_STR) == 0, "Unable to write sample key");
+        check(sky_sample_pack(rate, output) == 0, "Unable to write sample value");
+    }
+
+    printf("[funnel] paths: %" PRIu64 ", events: %" PRIu64 "\n", message->path_count, message->event_count);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Frees all data attached to the worker.
+//
+// worker - The worker.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_funnel_message_worker_free(sky_worker *worker)
+{
+    assert(worker != NULL);
+
+    sky_funnel_message *message = (sky_funnel_message*)worker->data;
+    sky_funnel_message_free(message);
+    worker->data = NULL;
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+#ifndef _sky_funnel_message_h
+#define _sky_funnel_message_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "bstring.h"
+#include "message_header.h"
+#include "message_handler.h"
+#include "query_plan.h"
+#include "table.h"
+#include "tablet.h"
+#include "worker.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A funnel is an ordered list of steps that an object moves through. Each
+// step is an action along with an optional list of filters on the event.
+// An object enters the funnel on any event that matches the first step and
+// converts to each following step when a later event matches it within the
+// conversion window of the object entering the funnel. If a session idle
+// time is set then conversions can only happen within a single session.
+//
+// Each path is walked once. For every step the most recent entry time that
+// has reached that step is tracked so that a single event can only move a
+// path forward by one step and later entries are preferred because they
+// leave the most time in the window. An object is counted once for every
+// step that it reaches and the time it took to convert is recorded the
+// first time it reaches a step.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The maximum number of steps in a funnel.
+#define SKY_FUNNEL_MESSAGE_MAX_STEP_COUNT 32
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// A single step in a funnel. The step's filters are stored on the plan and
+// the first one always matches the step's action.
+typedef struct {
+    sky_action_id_t action_id;
+    uint32_t filter_index;
+    uint32_t filter_count;
+} sky_funnel_step;
+
+// The number of objects that reached a step and the total number of seconds
+// that it took them to convert from the first step.
+typedef struct {
+    uint64_t count;
+    uint64_t total_time;
+} sky_funnel_result;
+
+// A message for calculating how many objects move through an ordered list of
+// steps.
+typedef struct {
+    sky_query_plan *plan;
+    sky_funnel_step *steps;
+    uint32_t step_count;
+    uint32_t within;
+    uint32_t session_idle;
+    sky_funnel_result *results;
+    uint64_t path_count;
+    uint64_t event_count;
+} sky_funnel_message;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_funnel_message *sky_funnel_message_create();
+
+void sky_funnel_message_free(sky_funnel_message *message);
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+sky_message_handler *sky_funnel_message_handler_create();
+
+int sky_funnel_message_process(sky_server *server, sky_message_header *header,
+    sky_table *table, FILE *input, FILE *output);
+
+int sky_funnel_message_compile(sky_funnel_message *message,
+    sky_property_file *property_file);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_funnel_message_unpack(sky_funnel_message *message, FILE *file);
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int sky_funnel_message_worker_map(sky_worker *worker, sky_tablet *tablet,
+    void **data);
+
+int sky_funnel_message_worker_map_morsel(sky_worker *worker,
+    sky_morsel *morsel, void **context, void **ret);
+
+int sky_funnel_message_worker_map_free(void *data);
+
+int sky_funnel_message_worker_reduce(sky_worker *worker, void *data);
+
+int sky_funnel_message_worker_write(sky_worker *worker, FILE *output);
+
+int sky_funnel_message_worker_free(sky_worker *worker);
+
+#endif
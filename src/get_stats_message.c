@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+
+#include "types.h"
+#include "get_stats_message.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a 'get_stats' message object.
+//
+// Returns a new message.
+sky_get_stats_message *sky_get_stats_message_create()
+{
+    sky_get_stats_message *message = NULL;
+    message = calloc(1, sizeof(sky_get_stats_message)); check_mem(message);
+    return message;
+
+error:
+    sky_get_stats_message_free(message);
+    return NULL;
+}
+
+// Frees a 'get_stats' message object from memory.
+//
+// message - The message object to be freed.
+//
+// Returns nothing.
+void sky_get_stats_message_free(sky_get_stats_message *message)
+{
+    if(message) {
+        free(message);
+    }
+}
+
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+// Creates a message handler for the 'Get Stats' message.
+//
+// Returns a message handler.
+sky_message_handler *sky_get_stats_message_handler_create()
+{
+    sky_message_handler *handler = sky_message_handler_create(); check_mem(handler);
+    handler->scope = SKY_MESSAGE_HANDLER_SCOPE_TABLE;
+    handler->name = bfromcstr("get_stats");
+    handler->process = sky_get_stats_message_process;
+    return handler;
+
+error:
+    sky_message_handler_free(handler);
+    return NULL;
+}
+
+// Retrieves the write statistics summed across all tablets in a table. This
+// function is synchronous and does not use a worker.
+//
+// server - The server.
+// header - The message header.
+// table  - The table the message is working against
+// input  - The input file stream.
+// output - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_get_stats_message_process(sky_server *server,
+                                  sky_message_header *header,
+                                  sky_table *table, FILE *input, FILE *output)
+{
+    int rc = 0;
+    size_t sz;
+    sky_get_stats_message *message = NULL;
+    check(server != NULL, "Server required");
+    check(header != NULL, "Message header required");
+    check(table != NULL, "Table required");
+    check(input != NULL, "Input stream required");
+    check(output != NULL, "Output stream required");
+    
+    struct tagbstring status_str = bsStatic("status");
+    struct tagbstring ok_str = bsStatic("ok");
+    struct tagbstring stats_str = bsStatic("stats");
+    struct tagbstring append_count_str = bsStatic("append_count");
+    struct tagbstring merge_count_str = bsStatic("merge_count");
+    struct tagbstring write_count_str = bsStatic("write_count");
+
+    // Parse message.
+    message = sky_get_stats_message_create(); check_mem(message);
+    rc = sky_get_stats_message_unpack(message, input);
+    check(rc == 0, "Unable to parse 'get_stats' message");
+
+    // Sum the stats across tablets.
+    sky_tablet_stats stats;
+    rc = sky_table_get_stats(table, &stats);
+    check(rc == 0, "Unable to retrieve table stats");
+
+    // Return.
+    //   {status:"OK", stats:{append_count:0, merge_count:0, write_count:0}}
+    minipack_fwrite_map(output, 2, &sz);
+    check(sz > 0, "Unable to write output");
+    check(sky_minipack_fwrite_bstring(output, &status_str) == 0, "Unable to write status key");
+    check(sky_minipack_fwrite_bstring(output, &ok_str) == 0, "Unable to write status value");
+    check(sky_minipack_fwrite_bstring(output, &stats_str) == 0, "Unable to write stats key");
+
+    minipack_fwrite_map(output, 3, &sz);
+    check(sz > 0, "Unable to write stats map");
+    check(sky_minipack_fwrite_bstring(output, &append_count_str) == 0, "Unable to write append count key");
+    minipack_fwrite_uint(output, stats.append_count, &sz);
+    check(sz > 0, "Unable to write append count");
+    check(sky_minipack_fwrite_bstring(output, &merge_count_str) == 0, "Unable to write merge count key");
+    minipack_fwrite_uint(output, stats.merge_count, &sz);
+    check(sz > 0, "Unable to write merge count");
+    check(sky_minipack_fwrite_bstring(output, &write_count_str) == 0, "Unable to write write count key");
+    minipack_fwrite_uint(output, stats.write_count, &sz);
+    check(sz > 0, "Unable to write write count");
+
+    // Clean up.
+    sky_get_stats_message_free(message);
+    fclose(input);
+    fclose(output);
+
+    return 0;
+
+error:
+    if(input) fclose(input);
+    if(output) fclose(output);
+    sky_get_stats_message_free(message);
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Serializes a 'get_stats' message to a file stream.
+//
+// message - The message.
+// file    - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_get_stats_message_pack(sky_get_stats_message *message, FILE *file)
+{
+    check(message != NULL, "Message required");
+    check(file != NULL, "File stream required");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Deserializes a 'get_stats' message from a file stream.
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_get_stats_message_unpack(sky_get_stats_message *message, FILE *file)
+{
+    check(message != NULL, "Message required");
+    check(file != NULL, "File stream required");
+
+    return 0;
+
+error:
+    return -1;
+}
@@ -0,0 +1,312 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "hll.h"
+#include "dbg.h"
+#include "mem.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates an empty sketch.
+//
+// Returns a new sketch.
+sky_hll *sky_hll_create()
+{
+    sky_hll *hll = NULL;
+    hll = calloc(1, sizeof(sky_hll)); check_mem(hll);
+    return hll;
+
+error:
+    sky_hll_free(hll);
+    return NULL;
+}
+
+// Frees a sketch from memory.
+//
+// hll - The sketch.
+//
+// Returns nothing.
+void sky_hll_free(sky_hll *hll)
+{
+    if(hll) {
+        free(hll);
+    }
+}
+
+
+//--------------------------------------
+// Hashing
+//--------------------------------------
+
+// Mixes the bits of a 64-bit value so that every input bit affects every
+// output bit. This is the finalizer from MurmurHash3.
+//
+// value - The value to mix.
+//
+// Returns the mixed value.
+static uint64_t sky_hll_mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+
+//--------------------------------------
+// Sketching
+//--------------------------------------
+
+// Adds a hashed value to the sketch.
+//
+// hll  - The sketch.
+// hash - A 64-bit hash of the value.
+//
+// Returns nothing.
+void sky_hll_add_hash(sky_hll *hll, uint64_t hash)
+{
+    assert(hll != NULL);
+
+    // The top bits select the register. A guard bit below the remaining
+    // bits caps the rank so it always fits in a packed register.
+    uint32_t index = (uint32_t)(hash >> (64 - SKY_HLL_PRECISION));
+    uint64_t bits = (hash << SKY_HLL_PRECISION) | (1ULL << (SKY_HLL_PRECISION - 1));
+    uint8_t rank = (uint8_t)(__builtin_clzll(bits) + 1);
+
+    if(rank > hll->registers[index]) {
+        hll->registers[index] = rank;
+    }
+}
+
+// Adds an integer to the sketch.
+//
+// hll   - The sketch.
+// value - The value to add.
+//
+// Returns nothing.
+void sky_hll_add_int(sky_hll *hll, int64_t value)
+{
+    sky_hll_add_hash(hll, sky_hll_mix((uint64_t)value));
+}
+
+// Adds a number to the sketch. Whole numbers are added as integers so that
+// they count as the same value as integer properties.
+//
+// hll   - The sketch.
+// value - The value to add.
+//
+// Returns nothing.
+void sky_hll_add_number(sky_hll *hll, double value)
+{
+    if(value >= (double)INT64_MIN && value < (double)INT64_MAX && value == (double)(int64_t)value) {
+        sky_hll_add_int(hll, (int64_t)value);
+    }
+    else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        sky_hll_add_hash(hll, sky_hll_mix(bits ^ 0x9e3779b97f4a7c15ULL));
+    }
+}
+
+// Adds a string to the sketch.
+//
+// hll    - The sketch.
+// data   - A pointer to the string's bytes.
+// length - The number of bytes in the string.
+//
+// Returns nothing.
+void sky_hll_add_string(sky_hll *hll, const char *data, uint32_t length)
+{
+    assert(data != NULL || length == 0);
+
+    // FNV-1a over the bytes followed by a full mix of the result.
+    uint32_t i;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(i=0; i<length; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    sky_hll_add_hash(hll, sky_hll_mix(hash));
+}
+
+// Merges another sketch into a sketch. The result estimates the number of
+// distinct values added to either sketch.
+//
+// hll   - The sketch to merge into.
+// other - The sketch to merge from.
+//
+// Returns nothing.
+void sky_hll_merge(sky_hll *hll, sky_hll *other)
+{
+    assert(hll != NULL);
+    assert(other != NULL);
+
+    uint32_t i;
+    for(i=0; i<SKY_HLL_REGISTER_COUNT; i++) {
+        if(other->registers[i] > hll->registers[i]) {
+            hll->registers[i] = other->registers[i];
+        }
+    }
+}
+
+// Estimates the number of distinct values added to the sketch. Small
+// cardinalities where many registers are still empty are estimated with
+// linear counting instead.
+//
+// hll - The sketch.
+//
+// Returns the estimated number of distinct values.
+double sky_hll_count(sky_hll *hll)
+{
+    assert(hll != NULL);
+
+    uint32_t i;
+    uint32_t zero_count = 0;
+    double sum = 0;
+    double m = (double)SKY_HLL_REGISTER_COUNT;
+    for(i=0; i<SKY_HLL_REGISTER_COUNT; i++) {
+        sum += ldexp(1.0, -hll->registers[i]);
+        if(hll->registers[i] == 0) zero_count++;
+    }
+
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    if(estimate <= 2.5 * m && zero_count > 0) {
+        estimate = m * log(m / (double)zero_count);
+    }
+
+    return round(estimate);
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Packs a sketch into a buffer. The buffer must be able to hold at least
+// SKY_HLL_MAX_PACKED_SZ bytes.
+//
+// hll - The sketch.
+// ptr - The buffer to pack into.
+//
+// Returns the number of bytes written.
+uint32_t sky_hll_pack(sky_hll *hll, char *ptr)
+{
+    assert(hll != NULL);
+    assert(ptr != NULL);
+
+    uint32_t i;
+    uint32_t count = 0;
+    for(i=0; i<SKY_HLL_REGISTER_COUNT; i++) {
+        if(hll->registers[i] > 0) count++;
+    }
+
+    memcpy(ptr, SKY_HLL_MAGIC, SKY_HLL_MAGIC_SZ);
+    ptr[SKY_HLL_MAGIC_SZ] = SKY_HLL_PRECISION;
+    uint8_t *buffer = (uint8_t*)ptr + SKY_HLL_HEADER_SZ;
+
+    // Sparse sketches are a list of 16-bit positions and 8-bit values.
+    if(count * 3 < SKY_HLL_DENSE_SZ - SKY_HLL_HEADER_SZ) {
+        ptr[SKY_HLL_MAGIC_SZ+1] = SKY_HLL_ENCODING_SPARSE;
+        for(i=0; i<SKY_HLL_REGISTER_COUNT; i++) {
+            if(hll->registers[i] > 0) {
+                *buffer++ = (uint8_t)(i >> 8);
+                *buffer++ = (uint8_t)(i & 0xFF);
+                *buffer++ = hll->registers[i];
+            }
+        }
+        return SKY_HLL_HEADER_SZ + (count * 3);
+    }
+
+    // Dense sketches pack four 6-bit registers into every three bytes.
+    ptr[SKY_HLL_MAGIC_SZ+1] = SKY_HLL_ENCODING_DENSE;
+    for(i=0; i<SKY_HLL_REGISTER_COUNT; i+=4) {
+        uint32_t value = ((uint32_t)hll->registers[i] << 18) |
+                         ((uint32_t)hll->registers[i+1] << 12) |
+                         ((uint32_t)hll->registers[i+2] << 6) |
+                         ((uint32_t)hll->registers[i+3]);
+        *buffer++ = (uint8_t)(value >> 16);
+        *buffer++ = (uint8_t)(value >> 8);
+        *buffer++ = (uint8_t)value;
+    }
+    return SKY_HLL_DENSE_SZ;
+}
+
+// Unpacks a sketch from a buffer. Any registers already in the sketch are
+// replaced.
+//
+// hll - The sketch.
+// ptr - The packed sketch.
+// sz  - The number of bytes in the packed sketch.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_hll_unpack(sky_hll *hll, const char *ptr, uint32_t sz)
+{
+    uint32_t i;
+    assert(hll != NULL);
+    assert(ptr != NULL);
+    check(sky_hll_is_packed(ptr, sz), "Invalid packed sketch");
+    check((uint8_t)ptr[SKY_HLL_MAGIC_SZ] == SKY_HLL_PRECISION, "Sketch precision mismatch: %d", (uint8_t)ptr[SKY_HLL_MAGIC_SZ]);
+
+    memset(hll->registers, 0, sizeof(hll->registers));
+    const uint8_t *buffer = (const uint8_t*)ptr + SKY_HLL_HEADER_SZ;
+    uint32_t buffer_sz = sz - SKY_HLL_HEADER_SZ;
+
+    switch(ptr[SKY_HLL_MAGIC_SZ+1]) {
+        case SKY_HLL_ENCODING_SPARSE: {
+            check(buffer_sz % 3 == 0, "Invalid sparse sketch size: %d", sz);
+            for(i=0; i<buffer_sz; i+=3) {
+                uint32_t index = ((uint32_t)buffer[i] << 8) | buffer[i+1];
+                check(index < SKY_HLL_REGISTER_COUNT, "Invalid sketch register: %d", index);
+                hll->registers[index] = buffer[i+2];
+            }
+            break;
+        }
+
+        case SKY_HLL_ENCODING_DENSE: {
+            check(sz == SKY_HLL_DENSE_SZ, "Invalid dense sketch size: %d", sz);
+            for(i=0; i<SKY_HLL_REGISTER_COUNT; i+=4) {
+                uint32_t value = ((uint32_t)buffer[0] << 16) | ((uint32_t)buffer[1] << 8) | buffer[2];
+                hll->registers[i]   = (value >> 18) & 0x3F;
+                hll->registers[i+1] = (value >> 12) & 0x3F;
+                hll->registers[i+2] = (value >> 6) & 0x3F;
+                hll->registers[i+3] = value & 0x3F;
+                buffer += 3;
+            }
+            break;
+        }
+
+        default: {
+            sentinel("Invalid sketch encoding: %d", ptr[SKY_HLL_MAGIC_SZ+1]);
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Checks if a buffer holds a packed sketch.
+//
+// ptr - The buffer.
+// sz  - The number of bytes in the buffer.
+//
+// Returns true if the buffer starts with a sketch header.
+bool sky_hll_is_packed(const char *ptr, uint32_t sz)
+{
+    return (ptr != NULL && sz >= SKY_HLL_HEADER_SZ && memcmp(ptr, SKY_HLL_MAGIC, SKY_HLL_MAGIC_SZ) == 0);
+}
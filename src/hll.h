@@ -0,0 +1,122 @@
+#ifndef _sky_hll_h
+#define _sky_hll_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct sky_hll sky_hll;
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A HyperLogLog sketch estimates the number of distinct values that have
+// been added to it using a fixed amount of memory. Each value is hashed to
+// 64 bits. The top bits of the hash select a register and the register
+// keeps the longest run of leading zeros seen in the remaining bits. The
+// estimate is taken from the harmonic mean of the registers and has a
+// standard error of about 1.04/sqrt(m) for m registers.
+//
+// Two sketches are merged by taking the maximum of each register so the
+// partial sketches from each tablet can be combined without losing any
+// accuracy and without keeping the values themselves.
+//
+// Sketches are packed into a compact binary string so that they can travel
+// inside of msgpack encoded aggregate results. Sketches with only a few
+// registers set are packed as a list of register positions and values and
+// larger sketches are packed as an array of 6-bit registers. Packed sketches
+// begin with a byte that is never used in msgpack or UTF-8 so that they can
+// be found again when the results are decoded.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The number of hash bits used to select a register.
+#define SKY_HLL_PRECISION 14
+
+// The number of registers in a sketch.
+#define SKY_HLL_REGISTER_COUNT (1 << SKY_HLL_PRECISION)
+
+// The number of bits used to store a packed register.
+#define SKY_HLL_REGISTER_BITS 6
+
+// The magic header at the start of a packed sketch.
+#define SKY_HLL_MAGIC "\xC1HLL"
+
+#define SKY_HLL_MAGIC_SZ 4
+
+// The size of the header of a packed sketch. This is the magic followed by
+// the precision and the encoding.
+#define SKY_HLL_HEADER_SZ (SKY_HLL_MAGIC_SZ + 2)
+
+// The size of a packed sketch in the dense encoding.
+#define SKY_HLL_DENSE_SZ (SKY_HLL_HEADER_SZ + ((SKY_HLL_REGISTER_COUNT * SKY_HLL_REGISTER_BITS) / 8))
+
+// The largest size that a packed sketch can be.
+#define SKY_HLL_MAX_PACKED_SZ SKY_HLL_DENSE_SZ
+
+// The encodings of a packed sketch.
+#define SKY_HLL_ENCODING_SPARSE 0
+#define SKY_HLL_ENCODING_DENSE  1
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_hll {
+    uint8_t registers[SKY_HLL_REGISTER_COUNT];
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_hll *sky_hll_create();
+
+void sky_hll_free(sky_hll *hll);
+
+//--------------------------------------
+// Sketching
+//--------------------------------------
+
+void sky_hll_add_hash(sky_hll *hll, uint64_t hash);
+
+void sky_hll_add_int(sky_hll *hll, int64_t value);
+
+void sky_hll_add_number(sky_hll *hll, double value);
+
+void sky_hll_add_string(sky_hll *hll, const char *data, uint32_t length);
+
+void sky_hll_merge(sky_hll *hll, sky_hll *other);
+
+double sky_hll_count(sky_hll *hll);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+uint32_t sky_hll_pack(sky_hll *hll, char *ptr);
+
+int sky_hll_unpack(sky_hll *hll, const char *ptr, uint32_t sz);
+
+bool sky_hll_is_packed(const char *ptr, uint32_t sz);
+
+#endif
@@ -456,6 +456,11 @@ int sky_importer_process_property(sky_importer *importer, bstring source,
         else if(sky_importer_tokstr_equal(source, token, "name")) {
             property->name = sky_importer_token_parse_bstring(source, &tokens[*index]);
         }
+        else if(sky_importer_tokstr_equal(source, token, "dictionary")) {
+            if(bdata(source)[tokens[*index].start] == 't') {
+                property->dictionary = sky_dictionary_create(); check_mem(property->dictionary);
+            }
+        }
         else {
             sentinel("Invalid token at char %d", tokens[*index].start);
         }
@@ -494,6 +499,12 @@ int sky_importer_process_events(sky_importer *importer, bstring source,
         rc = sky_importer_process_event(importer, source, tokens, index);
         check(rc == 0, "Unable to process event import");
     }
+
+    // Save the dictionary values added by the events.
+    if(importer->table->opened) {
+        rc = sky_property_file_save_if_dirty(importer->table->property_file);
+        check(rc == 0, "Unable to save property file");
+    }
     
     return 0;
 
@@ -605,7 +616,17 @@ int sky_importer_process_event_data(sky_importer *importer, sky_event *event,
         char ch = bdata(source)[value_token->start];
         bstring value = sky_importer_token_parse_bstring(source, value_token);
         if(value_token->type == JSMN_STRING) {
-            event_data = sky_event_data_create_string(property->id, value); check_mem(event_data);
+            bool added;
+            rc = sky_property_encode_string(property, value, &event_data, &added);
+
+            // Leave out values that can't be added to a full dictionary.
+            if(rc == SKY_DICTIONARY_FULL) {
+                log_warn("Dictionary is full for property '%s'; skipped value: %s", bdata(property->name), bdatae(value, ""));
+                bdestroy(value);
+                event->data_count--;
+                continue;
+            }
+            check(rc == 0, "Unable to encode string value for: %s", bdata(property->name));
         }
         // Parse primitives.
         else if(value_token->type == JSMN_PRIMITIVE) {
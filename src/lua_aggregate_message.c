@@ -9,6 +9,9 @@
 #include "path_iterator.h"
 #include "action.h"
 #include "minipack.h"
+#include "hll.h"
+#include "tdigest.h"
+#include "sample.h"
 #include "mem.h"
 #include "dbg.h"
 
@@ -26,10 +29,28 @@
 #define SKY_LUA_AGGREGATE_KEY_COUNT 1
 
 struct tagbstring SKY_LUA_AGGREGATE_KEY_SOURCE = bsStatic("source");
+struct tagbstring SKY_LUA_AGGREGATE_KEY_SAMPLE = bsStatic("sample");
 
 struct tagbstring SKY_LUA_AGGREGATE_STATUS_STR = bsStatic("status");
 struct tagbstring SKY_LUA_AGGREGATE_OK_STR     = bsStatic("ok");
 struct tagbstring SKY_LUA_AGGREGATE_DATA_STR   = bsStatic("data");
+struct tagbstring SKY_LUA_AGGREGATE_SAMPLE_STR = bsStatic("sample");
+
+struct tagbstring SKY_LUA_AGGREGATE_HLL_MAGIC     = bsStatic(SKY_HLL_MAGIC);
+struct tagbstring SKY_LUA_AGGREGATE_TDIGEST_MAGIC = bsStatic(SKY_TDIGEST_MAGIC);
+
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+static int sky_lua_aggregate_message_checkout_context(sky_worker *worker,
+    sky_lua_cache *cache, sky_table *table, void **context);
+
+static int sky_lua_aggregate_message_shared_context_create(sky_worklet **worklets,
+    uint32_t count, sky_servlet *servlet, sky_table *table, void **context);
 
 
 //==============================================================================
@@ -49,6 +70,7 @@ sky_lua_aggregate_message *sky_lua_aggregate_message_create()
 {
     sky_lua_aggregate_message *message = NULL;
     message = calloc(1, sizeof(sky_lua_aggregate_message)); check_mem(message);
+    message->sample_rate = 1;
     return message;
 
 error:
@@ -64,8 +86,9 @@ error:
 void sky_lua_aggregate_message_free(sky_lua_aggregate_message *message)
 {
     if(message) {
-        if(message->L) lua_close(message->L);
-        message->L = NULL;
+        sky_lua_cache_checkin(message->cache, message->entry);
+        message->entry = NULL;
+        message->cache = NULL;
         
         bdestroy(message->source);
         message->source = NULL;
@@ -73,6 +96,21 @@ void sky_lua_aggregate_message_free(sky_lua_aggregate_message *message)
         bdestroy(message->results);
         message->results = NULL;
 
+        uint32_t i;
+        for(i=0; i<message->parameter_count; i++) {
+            bdestroy(message->parameters[i]);
+        }
+        free(message->parameters);
+        message->parameters = NULL;
+        message->parameter_count = 0;
+
+        for(i=0; i<message->argument_count; i++) {
+            sky_query_argument_free(message->arguments[i]);
+        }
+        free(message->arguments);
+        message->arguments = NULL;
+        message->argument_count = 0;
+
         free(message);
     }
 }
@@ -119,10 +157,49 @@ int sky_lua_aggregate_message_process(sky_server *server,
     assert(input != NULL);
     assert(output != NULL);
     
+    // Create and parse message object.
+    message = sky_lua_aggregate_message_create(); check_mem(message);
+    rc = sky_lua_aggregate_message_unpack(message, input);
+    check(rc == 0, "Unable to unpack 'lua::aggregate' message");
+    check(message->source != NULL, "Lua source required");
+
+    return sky_lua_aggregate_message_start(server, message, table, input, output);
+
+error:
+    sky_lua_aggregate_message_free(message);
+    return -1;
+}
+
+// Starts a worker that runs the script of a message across every tablet in
+// a table. The worker takes ownership of the message.
+//
+// server  - The server.
+// message - The message.
+// table   - The table the message is working against
+// input   - The input file stream.
+// output  - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_lua_aggregate_message_start(sky_server *server,
+                                    sky_lua_aggregate_message *message,
+                                    sky_table *table, FILE *input,
+                                    FILE *output)
+{
+    int rc = 0;
+    sky_worker *worker = NULL;
+    assert(server != NULL);
+    assert(message != NULL);
+    assert(table != NULL);
+
     // Create worker.
-    sky_worker *worker = sky_worker_create(); check_mem(worker);
-    worker->context = server->context;
+    worker = sky_worker_create(); check_mem(worker);
+    worker->pool = server->worker_pool;
     worker->map = sky_lua_aggregate_message_worker_map;
+    worker->map_morsel = sky_lua_aggregate_message_worker_map_morsel;
+    worker->map_shared = sky_lua_aggregate_message_worker_map_shared;
+    worker->context_create = sky_lua_aggregate_message_context_create;
+    worker->context_free = sky_lua_aggregate_message_context_free;
+    worker->shared_context_free = sky_lua_aggregate_message_shared_context_free;
     worker->map_free = sky_lua_aggregate_message_worker_map_free;
     worker->reduce = sky_lua_aggregate_message_worker_reduce;
     worker->write = sky_lua_aggregate_message_worker_write;
@@ -134,16 +211,13 @@ int sky_lua_aggregate_message_process(sky_server *server,
     rc = sky_server_get_table_servlets(server, table, &worker->servlets, &worker->servlet_count);
     check(rc == 0, "Unable to copy servlets to worker");
 
-    // Create and parse message object.
-    message = sky_lua_aggregate_message_create(); check_mem(message);
+    // Check out the compiled Lua script.
     message->results = bfromcstr("\x80"); check_mem(message->results);
-    rc = sky_lua_aggregate_message_unpack(message, input);
-    check(rc == 0, "Unable to unpack 'lua::aggregate' message");
-    check(message->source != NULL, "Lua source required");
-
-    // Compile Lua script.
-    rc = sky_lua_initscript_with_table(message->source, table, NULL, &message->L);
+    message->cache = server->lua_cache;
+    rc = sky_lua_cache_checkout(message->cache, message->source, table, &message->entry);
     check(rc == 0, "Unable to initialize script");
+    rc = sky_query_set_globals(message->entry->L, message->parameters, message->parameter_count, message->arguments, message->argument_count);
+    check(rc == 0, "Unable to set query parameters");
 
     // Attach message to worker.
     worker->data = (sky_lua_aggregate_message*)message;
@@ -173,9 +247,14 @@ error:
 size_t sky_lua_aggregate_message_sizeof(sky_lua_aggregate_message *message)
 {
     size_t sz = 0;
-    sz += minipack_sizeof_map(SKY_LUA_AGGREGATE_KEY_COUNT);
+    bool sampled = sky_sample_is_enabled(message->sample_rate);
+    sz += minipack_sizeof_map(SKY_LUA_AGGREGATE_KEY_COUNT + (sampled ? 1 : 0));
     sz += minipack_sizeof_raw((&SKY_LUA_AGGREGATE_KEY_SOURCE)->slen) + (&SKY_LUA_AGGREGATE_KEY_SOURCE)->slen;
     sz += minipack_sizeof_raw(blength(message->source)) + blength(message->source);
+    if(sampled) {
+        sz += minipack_sizeof_raw((&SKY_LUA_AGGREGATE_KEY_SAMPLE)->slen) + (&SKY_LUA_AGGREGATE_KEY_SAMPLE)->slen;
+        sz += minipack_sizeof_double();
+    }
     return sz;
 }
 
@@ -193,13 +272,20 @@ int sky_lua_aggregate_message_pack(sky_lua_aggregate_message *message,
     assert(file != NULL);
 
     // Map
-    minipack_fwrite_map(file, SKY_LUA_AGGREGATE_KEY_COUNT, &sz);
+    bool sampled = sky_sample_is_enabled(message->sample_rate);
+    minipack_fwrite_map(file, SKY_LUA_AGGREGATE_KEY_COUNT + (sampled ? 1 : 0), &sz);
     check(sz > 0, "Unable to write map");
     
     // Source
     check(sky_minipack_fwrite_bstring(file, &SKY_LUA_AGGREGATE_KEY_SOURCE) == 0, "Unable to pack source key");
     check(sky_minipack_fwrite_bstring(file, message->source) == 0, "Unable to pack source");
 
+    // Sample rate
+    if(sampled) {
+        check(sky_minipack_fwrite_bstring(file, &SKY_LUA_AGGREGATE_KEY_SAMPLE) == 0, "Unable to pack sample key");
+        check(minipack_fwrite_double(file, message->sample_rate, &sz) == 0, "Unable to pack sample rate");
+    }
+
     return 0;
 
 error:
@@ -235,6 +321,10 @@ int sky_lua_aggregate_message_unpack(sky_lua_aggregate_message *message,
             rc = sky_minipack_fread_bstring(file, &message->source);
             check(rc == 0, "Unable to read source");
         }
+        else if(biseq(key, &SKY_LUA_AGGREGATE_KEY_SAMPLE) == 1) {
+            rc = sky_sample_unpack_rate(&message->sample_rate, file);
+            check(rc == 0, "Unable to read sample rate");
+        }
         
         bdestroy(key);
         key = NULL;
@@ -264,29 +354,62 @@ int sky_lua_aggregate_message_worker_map(sky_worker *worker,
                                          void **ret)
 {
     int rc;
-    lua_State *L = NULL;
+    void *context = NULL;
+    assert(tablet != NULL);
+
+    sky_morsel morsel;
+    memset(&morsel, 0, sizeof(morsel));
+    morsel.tablet = tablet;
+    rc = sky_lua_aggregate_message_checkout_context(worker, NULL, tablet->table, &context);
+    if(rc == 0) {
+        rc = sky_lua_aggregate_message_worker_map_morsel(worker, &morsel, &context, ret);
+    }
+    sky_lua_aggregate_message_context_free(context);
+    return rc;
+}
+
+// Maps a range of tablet data by executing the aggregate() function over it.
+// The context holds the thread's compiled script and is reused for the rest
+// of the thread's morsels.
+//
+// worker  - The worker.
+// morsel  - The range of the tablet to work against.
+// context - A pointer to the thread's compiled script.
+// ret     - A pointer to where the msgpack encoded results should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_lua_aggregate_message_worker_map_morsel(sky_worker *worker,
+                                                sky_morsel *morsel,
+                                                void **context, void **ret)
+{
+    int rc;
     bstring msgpack_ret = NULL;
-    sky_data_descriptor *descriptor = NULL;
+    sky_lua_aggregate_context *ctx = NULL;
     assert(worker != NULL);
-    assert(tablet != NULL);
+    assert(morsel != NULL);
+    assert(context != NULL);
     assert(ret != NULL);
 
-    sky_lua_aggregate_message *message = (sky_lua_aggregate_message*)worker->data;
-    
     // Initialize the path iterator.
     sky_path_iterator iterator;
     sky_path_iterator_init(&iterator);
 
-    // Compile Lua script.
-    descriptor = sky_data_descriptor_create(); check_mem(descriptor);
-    rc = sky_lua_initscript_with_table(message->source, tablet->table, descriptor, &L);
-    check(rc == 0, "Unable to initialize script");
+    ctx = (sky_lua_aggregate_context*)*context;
+    check(ctx != NULL && ctx->entry != NULL && ctx->data != NULL, "Invalid aggregate context");
+    lua_State *L = ctx->entry->L;
+    memset(ctx->data, 0, ctx->entry->descriptor->data_sz);
     
-    iterator.cursor.data_descriptor = descriptor;
-    iterator.cursor.data = calloc(1, descriptor->data_sz); check_mem(iterator.cursor.data);
+    iterator.cursor.data_descriptor = ctx->entry->descriptor;
+    iterator.cursor.data = ctx->data;
 
-    // Assign the data file to iterate over.
-    rc = sky_path_iterator_set_tablet(&iterator, tablet);
+    // Only visit sampled objects if the message is sampled.
+    sky_lua_aggregate_message *message = (sky_lua_aggregate_message*)worker->data;
+    if(sky_sample_is_enabled(message->sample_rate)) {
+        sky_path_iterator_set_sample_rate(&iterator, message->sample_rate);
+    }
+
+    // Assign the range to iterate over.
+    rc = sky_path_iterator_set_range(&iterator, morsel->tablet, morsel->start, morsel->end);
     check(rc == 0, "Unable to initialize path iterator");
 
     // Execute function.
@@ -299,27 +422,352 @@ int sky_lua_aggregate_message_worker_map(sky_worker *worker,
     rc = sky_lua_msgpack_pack(L, &msgpack_ret);
     check(rc == 0, "Unable to execute Lua script");
 
-    // Close Lua.
-    lua_close(L);
-    
     // Return msgpack encoded response.
     *ret = (void*)msgpack_ret;
     
-    free(iterator.cursor.data);
-    sky_data_descriptor_free(descriptor);
     sky_path_iterator_uninit(&iterator);
     return 0;
 
 error:
     *ret = NULL;
     bdestroy(msgpack_ret);
-    if(L) lua_close(L);
-    free(iterator.cursor.data);
-    sky_data_descriptor_free(descriptor);
     sky_path_iterator_uninit(&iterator);
     return -1;
 }
 
+// Maps a morsel for several 'lua::aggregate' queries in a single pass. Each
+// path is read from the tablet and decoded once through the union of the
+// queries' data descriptors. The decoded events are then handed to the
+// aggregate() function of every query through the query's own cursor, which
+// copies each event onto the query's event struct. A query that fails is
+// dropped from the rest of the morsel and its output is left empty without
+// affecting the other queries.
+//
+// The morsel is scanned at the largest sample rate of the queries. Samples
+// are nested so each query checks the sample hash of the path against its
+// own threshold.
+//
+// worklets - The worklets of the queries.
+// count    - The number of worklets.
+// servlet  - The servlet whose turn is running or null for a helper.
+// morsel   - The range of the tablet to work against.
+// context  - A pointer to the thread's compiled scripts for the group.
+// ret      - A pointer to where the msgpack encoded results of each query
+//            should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_lua_aggregate_message_worker_map_shared(sky_worklet **worklets,
+                                                uint32_t count,
+                                                sky_servlet *servlet,
+                                                sky_morsel *morsel,
+                                                void **context, void ***ret)
+{
+    int rc;
+    uint32_t i;
+    bstring *results = NULL;
+    int *refs = NULL;
+    uint64_t *thresholds = NULL;
+    sky_lua_aggregate_shared_context *ctx = NULL;
+    assert(worklets != NULL);
+    assert(morsel != NULL);
+    assert(context != NULL);
+    assert(ret != NULL);
+
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+
+    // Check out the scripts of the group before the thread's first morsel.
+    if(*context == NULL) {
+        rc = sky_lua_aggregate_message_shared_context_create(worklets, count, servlet, morsel->tablet->table, context);
+        check(rc == 0, "Unable to create shared aggregate context");
+    }
+    ctx = (sky_lua_aggregate_shared_context*)*context;
+    check(ctx->count == count, "Invalid shared aggregate context");
+
+    results = calloc(count, sizeof(*results)); check_mem(results);
+    refs = calloc(count, sizeof(*refs)); check_mem(refs);
+    thresholds = calloc(count, sizeof(*thresholds)); check_mem(thresholds);
+    for(i=0; i<count; i++) {
+        refs[i] = LUA_NOREF;
+    }
+
+    // Find the sample of each query and the sample of the whole pass.
+    bool sampled = false;
+    double max_sample_rate = 0;
+    for(i=0; i<count; i++) {
+        sky_lua_aggregate_message *message = (sky_lua_aggregate_message*)worklets[i]->worker->data;
+        thresholds[i] = sky_sample_threshold(message->sample_rate);
+        sampled = sampled || sky_sample_is_enabled(message->sample_rate);
+        if(message->sample_rate > max_sample_rate) max_sample_rate = message->sample_rate;
+    }
+    if(sampled) {
+        sky_path_iterator_set_sample_rate(&iterator, max_sample_rate);
+    }
+
+    // Give each query an empty data table for the morsel.
+    for(i=0; i<count; i++) {
+        lua_newtable(ctx->contexts[i]->entry->L);
+        refs[i] = luaL_ref(ctx->contexts[i]->entry->L, LUA_REGISTRYINDEX);
+    }
+
+    // Paths are decoded through the union descriptor.
+    iterator.cursor.data_descriptor = ctx->descriptor;
+    iterator.cursor.data = ctx->data;
+    rc = sky_path_iterator_set_range(&iterator, morsel->tablet, morsel->start, morsel->end);
+    check(rc == 0, "Unable to initialize path iterator");
+
+    // Hand each path to every query that is still running.
+    while(!sky_path_iterator_eof(&iterator)) {
+        bool decoded = false;
+        for(i=0; i<count; i++) {
+            if(refs[i] == LUA_NOREF) continue;
+            if(sampled && iterator.sample_hash >= thresholds[i]) continue;
+            lua_State *L = ctx->contexts[i]->entry->L;
+
+            // Decode the path the first time a query reads it.
+            if(!decoded) {
+                rc = sky_cursor_decode_events(&iterator.cursor, &ctx->events);
+                check(rc == 0, "Unable to decode path");
+                decoded = true;
+            }
+
+            rc = sky_cursor_set_events(&ctx->cursors[i], &ctx->events, &ctx->projections[i]);
+            check(rc == 0, "Unable to set cursor events");
+            lua_getglobal(L, "sky_aggregate_cursor");
+            lua_pushlightuserdata(L, &ctx->cursors[i]);
+            lua_rawgeti(L, LUA_REGISTRYINDEX, refs[i]);
+            rc = lua_pcall(L, 2, 0, 0);
+            if(rc != 0) {
+                log_err("Unable to execute Lua script: %s", lua_tostring(L, -1));
+                lua_pop(L, 1);
+                luaL_unref(L, LUA_REGISTRYINDEX, refs[i]);
+                refs[i] = LUA_NOREF;
+            }
+        }
+
+        rc = sky_path_iterator_next(&iterator);
+        check(rc == 0, "Unable to move to next path");
+    }
+
+    // Return the msgpack encoded results of each query.
+    for(i=0; i<count; i++) {
+        if(refs[i] == LUA_NOREF) continue;
+        lua_State *L = ctx->contexts[i]->entry->L;
+        lua_getglobal(L, "sky_pack_sketches");
+        lua_rawgeti(L, LUA_REGISTRYINDEX, refs[i]);
+        rc = lua_pcall(L, 1, 1, 0);
+        check(rc == 0, "Unable to pack Lua sketches: %s", lua_tostring(L, -1));
+        rc = sky_lua_msgpack_pack(L, &results[i]);
+        check(rc == 0, "Unable to pack Lua results");
+    }
+
+    for(i=0; i<count; i++) {
+        if(refs[i] != LUA_NOREF) luaL_unref(ctx->contexts[i]->entry->L, LUA_REGISTRYINDEX, refs[i]);
+    }
+    free(refs);
+    free(thresholds);
+    sky_path_iterator_uninit(&iterator);
+
+    *ret = (void**)results;
+    return 0;
+
+error:
+    for(i=0; i<count; i++) {
+        if(results) bdestroy(results[i]);
+        if(ctx && refs && refs[i] != LUA_NOREF) luaL_unref(ctx->contexts[i]->entry->L, LUA_REGISTRYINDEX, refs[i]);
+    }
+    free(results);
+    free(refs);
+    free(thresholds);
+    sky_path_iterator_uninit(&iterator);
+    *ret = NULL;
+    return -1;
+}
+
+// Checks out a compiled script from a cache into a new context.
+//
+// worker  - The worker.
+// cache   - The cache to check out from or null to compile a new copy.
+// table   - The table the script runs against.
+// context - A pointer to where the context should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_lua_aggregate_message_checkout_context(sky_worker *worker,
+                                                      sky_lua_cache *cache,
+                                                      sky_table *table,
+                                                      void **context)
+{
+    int rc;
+    sky_lua_aggregate_context *ctx = NULL;
+    sky_lua_aggregate_message *message = (sky_lua_aggregate_message*)worker->data;
+
+    ctx = calloc(1, sizeof(*ctx)); check_mem(ctx);
+    ctx->cache = cache;
+    rc = sky_lua_cache_checkout(ctx->cache, message->source, table, &ctx->entry);
+    check(rc == 0, "Unable to initialize script");
+    ctx->data = calloc(1, ctx->entry->descriptor->data_sz); check_mem(ctx->data);
+    rc = sky_query_set_globals(ctx->entry->L, message->parameters, message->parameter_count, message->arguments, message->argument_count);
+    check(rc == 0, "Unable to set query parameters");
+    lua_pushnumber(ctx->entry->L, message->sample_rate);
+    lua_setglobal(ctx->entry->L, "sky_sample_rate");
+
+    *context = ctx;
+    return 0;
+
+error:
+    sky_lua_aggregate_message_context_free(ctx);
+    *context = NULL;
+    return -1;
+}
+
+// Checks out the compiled script for a thread that is about to map morsels.
+// Threads running a servlet's turn use the servlet's cache. Helpers compile
+// their own copy of the script.
+//
+// worker  - The worker.
+// servlet - The servlet whose turn is running or null for a helper.
+// context - A pointer to where the context should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_lua_aggregate_message_context_create(sky_worker *worker,
+                                             sky_servlet *servlet,
+                                             void **context)
+{
+    assert(worker != NULL);
+    assert(context != NULL);
+    check(servlet != NULL || worker->servlet_count > 0, "Servlet required");
+
+    if(servlet != NULL) {
+        return sky_lua_aggregate_message_checkout_context(worker, servlet->lua_cache, servlet->tablet->table, context);
+    }
+    else {
+        return sky_lua_aggregate_message_checkout_context(worker, NULL, worker->servlets[0]->tablet->table, context);
+    }
+
+error:
+    *context = NULL;
+    return -1;
+}
+
+// Returns the compiled script of a context to its cache and frees the
+// context.
+//
+// context - The context.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_lua_aggregate_message_context_free(void *context)
+{
+    sky_lua_aggregate_context *ctx = (sky_lua_aggregate_context*)context;
+    if(ctx) {
+        sky_lua_cache_checkin(ctx->cache, ctx->entry);
+        ctx->entry = NULL;
+        ctx->cache = NULL;
+        free(ctx->data);
+        ctx->data = NULL;
+        free(ctx);
+    }
+    return 0;
+}
+
+// Checks out the compiled script of every query in a shared scan for a thread
+// and combines their data descriptors into a union descriptor that each path
+// is decoded through. Threads running a servlet's turn use the servlet's
+// cache. Helpers compile their own copies of the scripts.
+//
+// worklets - The worklets of the queries.
+// count    - The number of worklets.
+// servlet  - The servlet whose turn is running or null for a helper.
+// table    - The table the scripts run against.
+// context  - A pointer to where the context should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_lua_aggregate_message_shared_context_create(sky_worklet **worklets,
+                                                           uint32_t count,
+                                                           sky_servlet *servlet,
+                                                           sky_table *table,
+                                                           void **context)
+{
+    int rc;
+    uint32_t i;
+    sky_data_descriptor **descriptors = NULL;
+    sky_lua_aggregate_shared_context *ctx = NULL;
+    assert(worklets != NULL);
+    assert(table != NULL);
+    assert(context != NULL);
+
+    ctx = calloc(1, sizeof(*ctx)); check_mem(ctx);
+    ctx->contexts = calloc(count, sizeof(*ctx->contexts)); check_mem(ctx->contexts);
+    ctx->projections = calloc(count, sizeof(*ctx->projections)); check_mem(ctx->projections);
+    ctx->cursors = calloc(count, sizeof(*ctx->cursors)); check_mem(ctx->cursors);
+    ctx->count = count;
+    descriptors = calloc(count, sizeof(*descriptors)); check_mem(descriptors);
+
+    // Check out the script of each query.
+    for(i=0; i<count; i++) {
+        rc = sky_lua_aggregate_message_checkout_context(worklets[i]->worker, (servlet ? servlet->lua_cache : NULL), table, (void**)&ctx->contexts[i]);
+        check(rc == 0, "Unable to check out script");
+        descriptors[i] = ctx->contexts[i]->entry->descriptor;
+    }
+
+    // Decode paths through the union of the query descriptors.
+    ctx->descriptor = sky_data_descriptor_create(); check_mem(ctx->descriptor);
+    rc = sky_data_descriptor_init_union(ctx->descriptor, descriptors, count);
+    check(rc == 0, "Unable to initialize union descriptor");
+    ctx->data = calloc(1, ctx->descriptor->data_sz); check_mem(ctx->data);
+    ctx->events.data_descriptor = ctx->descriptor;
+
+    // Give each query a cursor that copies decoded events onto its event.
+    for(i=0; i<count; i++) {
+        rc = sky_data_projection_init(&ctx->projections[i], ctx->descriptor, descriptors[i]);
+        check(rc == 0, "Unable to initialize projection");
+        sky_cursor_init(&ctx->cursors[i]);
+        ctx->cursors[i].data_descriptor = descriptors[i];
+        ctx->cursors[i].data = ctx->contexts[i]->data;
+    }
+
+    free(descriptors);
+    *context = ctx;
+    return 0;
+
+error:
+    free(descriptors);
+    sky_lua_aggregate_message_shared_context_free(ctx);
+    *context = NULL;
+    return -1;
+}
+
+// Returns the compiled scripts of a shared context to their caches and frees
+// the context.
+//
+// context - The context.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_lua_aggregate_message_shared_context_free(void *context)
+{
+    sky_lua_aggregate_shared_context *ctx = (sky_lua_aggregate_shared_context*)context;
+    if(ctx) {
+        uint32_t i;
+        for(i=0; i<ctx->count; i++) {
+            sky_lua_aggregate_message_context_free(ctx->contexts[i]);
+            sky_data_projection_uninit(&ctx->projections[i]);
+        }
+        free(ctx->contexts);
+        ctx->contexts = NULL;
+        free(ctx->projections);
+        ctx->projections = NULL;
+        free(ctx->cursors);
+        ctx->cursors = NULL;
+        ctx->count = 0;
+        sky_data_descriptor_free(ctx->descriptor);
+        ctx->descriptor = NULL;
+        free(ctx->data);
+        ctx->data = NULL;
+        sky_cursor_events_uninit(&ctx->events);
+        free(ctx);
+    }
+    return 0;
+}
+
 // Frees the data structure created and returned in the aggregate() function.
 //
 // data - A pointer to the data to be freed.
@@ -348,24 +796,24 @@ int sky_lua_aggregate_message_worker_reduce(sky_worker *worker, void *data)
     sky_lua_aggregate_message *message = (sky_lua_aggregate_message*)worker->data;
 
     // Retrieve ref to 'sky_merge()' function.
-    lua_getglobal(message->L, "sky_merge");
+    lua_getglobal(message->entry->L, "sky_merge");
 
     // Push 'results' table to the function.
-    rc = sky_lua_msgpack_unpack(message->L, message->results);
+    rc = sky_lua_msgpack_unpack(message->entry->L, message->results);
     check(rc == 0, "Unable to push results table to Lua");
     bdestroy(message->results);
     message->results = NULL;
 
     // Push aggregate 'data' table to the function.
-    rc = sky_lua_msgpack_unpack(message->L, (bstring)data);
+    rc = sky_lua_msgpack_unpack(message->entry->L, (bstring)data);
     check(rc == 0, "Unable to push aggregate data table to Lua");
     
     // Execute 'reduce(results, data)'.
-    rc = lua_pcall(message->L, 2, 1, 0);
-    check(rc == 0, "Unable to execute Lua script: %s", lua_tostring(message->L, -1));
+    rc = lua_pcall(message->entry->L, 2, 1, 0);
+    check(rc == 0, "Unable to execute Lua script: %s", lua_tostring(message->entry->L, -1));
 
     // Execute the script and return a msgpack variable.
-    rc = sky_lua_msgpack_pack(message->L, &message->results);
+    rc = sky_lua_msgpack_pack(message->entry->L, &message->results);
     check(rc == 0, "Unable to unpack results table from Lua script");
 
     return 0;
@@ -382,6 +830,7 @@ error:
 // Returns 0 if successful, otherwise returns -1.
 int sky_lua_aggregate_message_worker_write(sky_worker *worker, FILE *output)
 {
+    int rc;
     size_t sz;
     assert(worker != NULL);
     assert(output != NULL);
@@ -389,13 +838,35 @@ int sky_lua_aggregate_message_worker_write(sky_worker *worker, FILE *output)
     // Ease-of-use references.
     sky_lua_aggregate_message *message = (sky_lua_aggregate_message*)worker->data;
 
+    // Replace any sketches in the results with their estimates. Results
+    // without sketches are written as they are.
+    bool has_sketches = (binstr(message->results, 0, &SKY_LUA_AGGREGATE_HLL_MAGIC) != BSTR_ERR ||
+                         binstr(message->results, 0, &SKY_LUA_AGGREGATE_TDIGEST_MAGIC) != BSTR_ERR);
+    if(message->entry != NULL && has_sketches) {
+        lua_getglobal(message->entry->L, "sky_finalize_sketches");
+        rc = sky_lua_msgpack_unpack(message->entry->L, message->results);
+        check(rc == 0, "Unable to push results table to Lua");
+        rc = lua_pcall(message->entry->L, 1, 1, 0);
+        check(rc == 0, "Unable to finalize sketches: %s", lua_tostring(message->entry->L, -1));
+        bdestroy(message->results);
+        message->results = NULL;
+        rc = sky_lua_msgpack_pack(message->entry->L, &message->results);
+        check(rc == 0, "Unable to pack results table");
+    }
+
     // Return.
-    //   {status:"ok", data:{<action_id>:{count:0}, ...}}
-    check(minipack_fwrite_map(output, 2, &sz) == 0, "Unable to write root map");
+    //   {status:"ok", data:{<action_id>:{count:0}, ...}, sample:{...}}
+    bool sampled = sky_sample_is_enabled(message->sample_rate);
+    check(minipack_fwrite_map(output, (sampled ? 3 : 2), &sz) == 0, "Unable to write root map");
     check(sky_minipack_fwrite_bstring(output, &SKY_LUA_AGGREGATE_STATUS_STR) == 0, "Unable to write status key");
     check(sky_minipack_fwrite_bstring(output, &SKY_LUA_AGGREGATE_OK_STR) == 0, "Unable to write status value");
     check(sky_minipack_fwrite_bstring(output, &SKY_LUA_AGGREGATE_DATA_STR) == 0, "Unable to write data key");
     check(fwrite(bdatae(message->results, ""), blength(message->results), 1, output) == 1, "Unable to write data value");
+
+    if(sampled) {
+        check(sky_minipack_fwrite_bstring(output, &SKY_LUA_AGGREGATE_SAMPLE_STR) == 0, "Unable to write sample key");
+        check(sky_sample_pack(message->sample_rate, output) == 0, "Unable to write sample value");
+    }
     
     return 0;
 
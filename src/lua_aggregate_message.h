@@ -9,9 +9,12 @@
 #include "message_header.h"
 #include "message_handler.h"
 #include "sky_lua.h"
+#include "lua_cache.h"
+#include "query.h"
 #include "table.h"
 #include "tablet.h"
 #include "event.h"
+#include "cursor.h"
 #include "worker.h"
 
 
@@ -22,12 +25,44 @@
 //==============================================================================
 
 // A message for executing a distributed aggregation lua script across a table.
+// The script used to merge results is checked out of the server's cache. The
+// parameters and arguments are only set when a prepared query is executed.
+// A sampled script only sees the paths of sampled objects and is given the
+// sample rate as the 'sky_sample_rate' global so it can scale its results.
 typedef struct {
     bstring results;
     bstring source;
-    lua_State *L;
+    double sample_rate;
+    bstring *parameters;
+    uint32_t parameter_count;
+    sky_query_argument **arguments;
+    uint32_t argument_count;
+    sky_lua_cache *cache;
+    sky_lua_cache_entry *entry;
 } sky_lua_aggregate_message;
 
+// A compiled copy of the aggregation script that is owned by a single thread.
+// The script is checked out of the cache of the servlet that the thread is
+// running for and is checked back in once the thread is done with it.
+typedef struct {
+    sky_lua_cache *cache;
+    sky_lua_cache_entry *entry;
+    void *data;
+} sky_lua_aggregate_context;
+
+// The compiled scripts of a group of queries that share a scan on a single
+// thread. Each path is decoded once through the union of the queries' data
+// descriptors and is then projected onto the event of every query.
+typedef struct {
+    sky_lua_aggregate_context **contexts;
+    uint32_t count;
+    sky_data_descriptor *descriptor;
+    sky_data_projection *projections;
+    sky_cursor *cursors;
+    void *data;
+    sky_cursor_events events;
+} sky_lua_aggregate_shared_context;
+
 
 //==============================================================================
 //
@@ -53,6 +88,10 @@ sky_message_handler *sky_lua_aggregate_message_handler_create();
 int sky_lua_aggregate_message_process(sky_server *server,
     sky_message_header *header, sky_table *table, FILE *input, FILE *output);
 
+int sky_lua_aggregate_message_start(sky_server *server,
+    sky_lua_aggregate_message *message, sky_table *table, FILE *input,
+    FILE *output);
+
 //--------------------------------------
 // Serialization
 //--------------------------------------
@@ -70,6 +109,20 @@ int sky_lua_aggregate_message_unpack(sky_lua_aggregate_message *message,
 int sky_lua_aggregate_message_worker_map(sky_worker *worker,
     sky_tablet *tablet, void **data);
 
+int sky_lua_aggregate_message_worker_map_morsel(sky_worker *worker,
+    sky_morsel *morsel, void **context, void **ret);
+
+int sky_lua_aggregate_message_worker_map_shared(sky_worklet **worklets,
+    uint32_t count, sky_servlet *servlet, sky_morsel *morsel, void **context,
+    void ***ret);
+
+int sky_lua_aggregate_message_shared_context_free(void *context);
+
+int sky_lua_aggregate_message_context_create(sky_worker *worker,
+    sky_servlet *servlet, void **context);
+
+int sky_lua_aggregate_message_context_free(void *context);
+
 int sky_lua_aggregate_message_worker_map_free(void *data);
 
 int sky_lua_aggregate_message_worker_reduce(sky_worker *worker, void *data);
@@ -0,0 +1,255 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "lua_cache.h"
+#include "dbg.h"
+#include "mem.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a Lua cache.
+//
+// capacity - The maximum number of compiled scripts to keep.
+//
+// Returns a reference to the cache.
+sky_lua_cache *sky_lua_cache_create(uint32_t capacity)
+{
+    sky_lua_cache *cache = NULL;
+    check(capacity > 0, "Cache capacity required");
+
+    cache = calloc(1, sizeof(sky_lua_cache)); check_mem(cache);
+    cache->capacity = capacity;
+    check(pthread_mutex_init(&cache->mutex, NULL) == 0, "Unable to init cache mutex");
+
+    return cache;
+
+error:
+    free(cache);
+    return NULL;
+}
+
+// Frees a Lua cache and every entry that is checked in.
+//
+// cache - The cache.
+//
+// Returns nothing.
+void sky_lua_cache_free(sky_lua_cache *cache)
+{
+    if(cache) {
+        sky_lua_cache_entry *entry = cache->head;
+        while(entry != NULL) {
+            sky_lua_cache_entry *next = entry->next;
+            sky_lua_cache_entry_free(entry);
+            entry = next;
+        }
+        cache->head = cache->tail = NULL;
+        cache->count = 0;
+        pthread_mutex_destroy(&cache->mutex);
+        free(cache);
+    }
+}
+
+// Compiles a script against a table's properties into a new entry.
+//
+// source - The script source code.
+// table  - The table the script runs against.
+//
+// Returns a reference to the entry.
+sky_lua_cache_entry *sky_lua_cache_entry_create(bstring source,
+                                                sky_table *table)
+{
+    int rc;
+    sky_lua_cache_entry *entry = NULL;
+    check(source != NULL, "Source required");
+    check(table != NULL && table->property_file != NULL, "Table properties required");
+
+    entry = calloc(1, sizeof(sky_lua_cache_entry)); check_mem(entry);
+    entry->hash = sky_bstring_fnv1a(source);
+    entry->source = bstrcpy(source); check_mem(entry->source);
+    entry->property_file = table->property_file;
+
+    // Read the version before generating the header so that a change made
+    // during compilation leaves the entry looking stale.
+    entry->version = sky_property_file_get_version(table->property_file);
+
+    entry->descriptor = sky_data_descriptor_create(); check_mem(entry->descriptor);
+    rc = sky_lua_initscript_with_table(source, table, entry->descriptor, &entry->L);
+    check(rc == 0, "Unable to initialize script");
+
+    return entry;
+
+error:
+    sky_lua_cache_entry_free(entry);
+    return NULL;
+}
+
+// Frees a cache entry and closes its Lua state.
+//
+// entry - The entry.
+//
+// Returns nothing.
+void sky_lua_cache_entry_free(sky_lua_cache_entry *entry)
+{
+    if(entry) {
+        if(entry->L) lua_close(entry->L);
+        entry->L = NULL;
+        sky_data_descriptor_free(entry->descriptor);
+        entry->descriptor = NULL;
+        bdestroy(entry->source);
+        entry->source = NULL;
+        entry->property_file = NULL;
+        free(entry);
+    }
+}
+
+
+//--------------------------------------
+// List
+//--------------------------------------
+
+// Removes an entry from the cache's list. The cache's mutex must be held.
+//
+// cache - The cache.
+// entry - The entry.
+//
+// Returns nothing.
+static void sky_lua_cache_unlink(sky_lua_cache *cache,
+                                 sky_lua_cache_entry *entry)
+{
+    if(entry->prev) entry->prev->next = entry->next;
+    if(entry->next) entry->next->prev = entry->prev;
+    if(cache->head == entry) cache->head = entry->next;
+    if(cache->tail == entry) cache->tail = entry->prev;
+    entry->prev = entry->next = NULL;
+    cache->count--;
+}
+
+
+//--------------------------------------
+// Lookup
+//--------------------------------------
+
+// Checks out a compiled script from the cache. The script is compiled if
+// there is no entry for the current version of the table's properties.
+// Entries compiled against an older version of the same properties are
+// discarded along the way.
+//
+// cache  - The cache. If null then the script is always compiled.
+// source - The script source code.
+// table  - The table the script runs against.
+// ret    - A pointer to where the entry should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_lua_cache_checkout(sky_lua_cache *cache, bstring source,
+                           sky_table *table, sky_lua_cache_entry **ret)
+{
+    sky_lua_cache_entry *stale = NULL;
+    assert(ret != NULL);
+    check(source != NULL, "Source required");
+    check(table != NULL && table->property_file != NULL, "Table properties required");
+    *ret = NULL;
+
+    if(cache != NULL) {
+        uint32_t hash = sky_bstring_fnv1a(source);
+        uint64_t version = sky_property_file_get_version(table->property_file);
+
+        pthread_mutex_lock(&cache->mutex);
+        sky_lua_cache_entry *entry = cache->head;
+        while(entry != NULL) {
+            sky_lua_cache_entry *next = entry->next;
+            if(entry->property_file == table->property_file) {
+                if(entry->version != version) {
+                    sky_lua_cache_unlink(cache, entry);
+                    entry->next = stale;
+                    stale = entry;
+                }
+                else if(*ret == NULL && entry->hash == hash && biseq(entry->source, source) == 1) {
+                    sky_lua_cache_unlink(cache, entry);
+                    *ret = entry;
+                }
+            }
+            entry = next;
+        }
+        if(*ret != NULL) {
+            cache->hit_count++;
+        }
+        else {
+            cache->miss_count++;
+        }
+        pthread_mutex_unlock(&cache->mutex);
+
+        // Close stale states outside of the lock.
+        while(stale != NULL) {
+            sky_lua_cache_entry *next = stale->next;
+            sky_lua_cache_entry_free(stale);
+            stale = next;
+        }
+    }
+
+    if(*ret == NULL) {
+        *ret = sky_lua_cache_entry_create(source, table);
+        check(*ret != NULL, "Unable to compile script");
+    }
+
+    return 0;
+
+error:
+    *ret = NULL;
+    return -1;
+}
+
+// Returns a checked out script to the cache as its most recently used entry.
+// The least recently used entries are freed if the cache is over capacity.
+//
+// cache - The cache. If null then the entry is freed.
+// entry - The entry.
+//
+// Returns nothing.
+void sky_lua_cache_checkin(sky_lua_cache *cache, sky_lua_cache_entry *entry)
+{
+    sky_lua_cache_entry *evicted = NULL;
+    if(entry == NULL) {
+        return;
+    }
+    if(cache == NULL) {
+        sky_lua_cache_entry_free(entry);
+        return;
+    }
+
+    // Clear anything left on the stack by a failed call.
+    lua_settop(entry->L, 0);
+
+    pthread_mutex_lock(&cache->mutex);
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if(cache->head) cache->head->prev = entry;
+    cache->head = entry;
+    if(cache->tail == NULL) cache->tail = entry;
+    cache->count++;
+
+    while(cache->count > cache->capacity) {
+        sky_lua_cache_entry *tail = cache->tail;
+        sky_lua_cache_unlink(cache, tail);
+        tail->next = evicted;
+        evicted = tail;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    while(evicted != NULL) {
+        sky_lua_cache_entry *next = evicted->next;
+        sky_lua_cache_entry_free(evicted);
+        evicted = next;
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef _sky_lua_cache_h
+#define _sky_lua_cache_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct sky_lua_cache_entry sky_lua_cache_entry;
+typedef struct sky_lua_cache sky_lua_cache;
+
+#include "bstring.h"
+#include "sky_lua.h"
+#include "table.h"
+#include "property_file.h"
+#include "data_descriptor.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The Lua cache keeps compiled scripts around between queries so that a
+// script that is run repeatedly only has its header generated and its
+// source compiled once. Each entry holds an initialized Lua state and the
+// data descriptor built by the script.
+//
+// Entries are keyed by a hash of the source and by the version of the
+// property file the header was generated from. Adding a property or a new
+// dictionary value changes the version so stale entries are never returned
+// and they are discarded the next time the table's scripts are looked up.
+// Otherwise the least recently used entry is evicted once the cache is full.
+//
+// An entry is checked out of the cache while it is in use and checked back
+// in afterward so a Lua state is never shared between threads.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The number of compiled scripts kept by a cache.
+#define SKY_LUA_CACHE_DEFAULT_CAPACITY 32
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_lua_cache_entry {
+    uint32_t hash;
+    bstring source;
+    sky_property_file *property_file;
+    uint64_t version;
+    lua_State *L;
+    sky_data_descriptor *descriptor;
+    sky_lua_cache_entry *prev;
+    sky_lua_cache_entry *next;
+};
+
+struct sky_lua_cache {
+    uint32_t capacity;
+    uint32_t count;
+    sky_lua_cache_entry *head;
+    sky_lua_cache_entry *tail;
+    uint64_t hit_count;
+    uint64_t miss_count;
+    pthread_mutex_t mutex;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_lua_cache *sky_lua_cache_create(uint32_t capacity);
+
+void sky_lua_cache_free(sky_lua_cache *cache);
+
+sky_lua_cache_entry *sky_lua_cache_entry_create(bstring source,
+    sky_table *table);
+
+void sky_lua_cache_entry_free(sky_lua_cache_entry *entry);
+
+//--------------------------------------
+// Lookup
+//--------------------------------------
+
+int sky_lua_cache_checkout(sky_lua_cache *cache, bstring source,
+    sky_table *table, sky_lua_cache_entry **ret);
+
+void sky_lua_cache_checkin(sky_lua_cache *cache, sky_lua_cache_entry *entry);
+
+#endif
@@ -0,0 +1,391 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "morsel.h"
+#include "bstring.h"
+#include "dbg.h"
+#include "mem.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a morsel scheduler.
+//
+// set_count - The number of tablets that will publish morsels.
+//
+// Returns a reference to the scheduler.
+sky_morsel_scheduler *sky_morsel_scheduler_create(uint32_t set_count)
+{
+    sky_morsel_scheduler *scheduler = calloc(1, sizeof(sky_morsel_scheduler));
+    check_mem(scheduler);
+    check(pthread_mutex_init(&scheduler->mutex, NULL) == 0, "Unable to init scheduler mutex");
+    check(pthread_cond_init(&scheduler->cond, NULL) == 0, "Unable to init scheduler condition");
+
+    if(set_count > 0) {
+        scheduler->sets = calloc(set_count, sizeof(*scheduler->sets));
+        check_mem(scheduler->sets);
+    }
+    scheduler->set_count = set_count;
+    scheduler->ref_count = 1;
+
+    return scheduler;
+
+error:
+    sky_morsel_scheduler_free(scheduler);
+    return NULL;
+}
+
+// Frees a morsel scheduler from memory. The data attached to each morsel is
+// owned by the caller and must be freed beforehand.
+//
+// scheduler - The scheduler.
+//
+// Returns nothing.
+void sky_morsel_scheduler_free(sky_morsel_scheduler *scheduler)
+{
+    if(scheduler) {
+        uint32_t i, j;
+        for(i=0; i<scheduler->set_count; i++) {
+            sky_morsel_set *set = &scheduler->sets[i];
+            for(j=0; j<set->morsel_count; j++) {
+                bdestroy(set->morsels[j].start);
+                bdestroy(set->morsels[j].end);
+            }
+            free(set->morsels);
+        }
+        free(scheduler->sets);
+        scheduler->sets = NULL;
+        scheduler->set_count = 0;
+        pthread_mutex_destroy(&scheduler->mutex);
+        pthread_cond_destroy(&scheduler->cond);
+        free(scheduler);
+    }
+}
+
+// Removes a reference to a scheduler and frees it once no references
+// remain.
+//
+// scheduler - The scheduler.
+//
+// Returns nothing.
+void sky_morsel_scheduler_release(sky_morsel_scheduler *scheduler)
+{
+    if(scheduler) {
+        pthread_mutex_lock(&scheduler->mutex);
+        uint32_t ref_count = --scheduler->ref_count;
+        pthread_mutex_unlock(&scheduler->mutex);
+        if(ref_count == 0) {
+            sky_morsel_scheduler_free(scheduler);
+        }
+    }
+}
+
+
+//--------------------------------------
+// Scheduling
+//--------------------------------------
+
+// Splits a tablet into morsels and makes them available to the other
+// servlets in the scan. This must be called from the tablet's servlet.
+//
+// scheduler - The scheduler.
+// index     - The index of the tablet's set.
+// tablet    - The tablet to split.
+// max_count - The maximum number of morsels to split into.
+// min_size  - The minimum number of bytes in a morsel.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_morsel_scheduler_publish(sky_morsel_scheduler *scheduler,
+                                 uint32_t index, sky_tablet *tablet,
+                                 uint32_t max_count, size_t min_size)
+{
+    int rc;
+    uint32_t i;
+    bstring *keys = NULL;
+    uint32_t key_count = 0;
+    sky_morsel *morsels = NULL;
+    assert(scheduler != NULL);
+    assert(tablet != NULL);
+    check(index < scheduler->set_count, "Invalid morsel set index: %d", index);
+
+    // Split the tablet into key ranges.
+    rc = sky_tablet_get_split_keys(tablet, max_count, min_size, &keys, &key_count);
+    check(rc == 0, "Unable to split tablet");
+
+    // Create a morsel for each range. Each morsel owns copies of its bounds.
+    uint32_t morsel_count = key_count + 1;
+    morsels = calloc(morsel_count, sizeof(*morsels)); check_mem(morsels);
+    for(i=0; i<morsel_count; i++) {
+        morsels[i].tablet = tablet;
+        morsels[i].set_index = index;
+        if(i > 0) {
+            morsels[i].start = bstrcpy(keys[i-1]); check_mem(morsels[i].start);
+        }
+        if(i < key_count) {
+            morsels[i].end = keys[i];
+            keys[i] = NULL;
+        }
+    }
+
+    // Publish the morsels.
+    pthread_mutex_lock(&scheduler->mutex);
+    sky_morsel_set *set = &scheduler->sets[index];
+    set->morsels = morsels;
+    set->morsel_count = morsel_count;
+    set->head = 0;
+    set->tail = morsel_count;
+    set->running_count = 0;
+    set->published = true;
+    pthread_cond_broadcast(&scheduler->cond);
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    free(keys);
+    return 0;
+
+error:
+    if(keys) {
+        for(i=0; i<key_count; i++) {
+            bdestroy(keys[i]);
+        }
+    }
+    free(keys);
+    if(morsels) {
+        for(i=0; i<key_count+1; i++) {
+            bdestroy(morsels[i].start);
+            bdestroy(morsels[i].end);
+        }
+    }
+    free(morsels);
+    return -1;
+}
+
+// Takes a morsel from the back of the published set with the most morsels
+// remaining. The scheduler's mutex must be held.
+//
+// scheduler - The scheduler.
+//
+// Returns the morsel or null if there are no morsels left to take.
+static sky_morsel *sky_morsel_scheduler_take_stolen(sky_morsel_scheduler *scheduler)
+{
+    uint32_t i;
+    sky_morsel_set *victim = NULL;
+    for(i=0; i<scheduler->set_count; i++) {
+        sky_morsel_set *set = &scheduler->sets[i];
+        if(set->published && set->head < set->tail && (victim == NULL || set->tail - set->head > victim->tail - victim->head)) {
+            victim = set;
+        }
+    }
+    if(victim == NULL) {
+        return NULL;
+    }
+    victim->running_count++;
+    return &victim->morsels[--victim->tail];
+}
+
+// Retrieves the next morsel for a servlet to scan. Morsels are taken from the
+// front of the servlet's own set first. Otherwise a morsel is stolen from the
+// back of the published set with the most morsels remaining. If there is
+// nothing left to steal then the servlet waits until the morsels taken from
+// its own set have been completed by other servlets.
+//
+// scheduler - The scheduler.
+// index     - The index of the servlet's own set.
+// morsel    - A pointer to where the morsel should be returned. This is null
+//             once the servlet's own set is complete.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_morsel_scheduler_next(sky_morsel_scheduler *scheduler, uint32_t index,
+                              sky_morsel **morsel)
+{
+    assert(scheduler != NULL);
+    assert(morsel != NULL);
+    check(index < scheduler->set_count, "Invalid morsel set index: %d", index);
+    *morsel = NULL;
+
+    pthread_mutex_lock(&scheduler->mutex);
+    sky_morsel_set *own = &scheduler->sets[index];
+    while(true) {
+        // Take from the front of our own set.
+        if(own->head < own->tail) {
+            own->running_count++;
+            *morsel = &own->morsels[own->head++];
+            break;
+        }
+
+        // Steal from the back of the fullest published set.
+        *morsel = sky_morsel_scheduler_take_stolen(scheduler);
+        if(*morsel != NULL) {
+            break;
+        }
+
+        // Leave once our own morsels have all been completed.
+        if(own->running_count == 0) {
+            break;
+        }
+        pthread_cond_wait(&scheduler->cond, &scheduler->mutex);
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Steals a morsel for a helper without waiting.
+//
+// scheduler - The scheduler.
+// morsel    - A pointer to where the morsel should be returned. This is null
+//             if there is nothing left to steal.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_morsel_scheduler_steal(sky_morsel_scheduler *scheduler,
+                               sky_morsel **morsel)
+{
+    assert(scheduler != NULL);
+    assert(morsel != NULL);
+
+    pthread_mutex_lock(&scheduler->mutex);
+    *morsel = sky_morsel_scheduler_take_stolen(scheduler);
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    return 0;
+}
+
+// Marks a morsel as complete and wakes the servlet that owns it if its set
+// is finished.
+//
+// scheduler - The scheduler.
+// morsel    - The morsel.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_morsel_scheduler_complete(sky_morsel_scheduler *scheduler,
+                                  sky_morsel *morsel)
+{
+    assert(scheduler != NULL);
+    assert(morsel != NULL);
+    check(morsel->set_index < scheduler->set_count, "Invalid morsel set index: %d", morsel->set_index);
+
+    pthread_mutex_lock(&scheduler->mutex);
+    sky_morsel_set *set = &scheduler->sets[morsel->set_index];
+    set->running_count--;
+    if(set->running_count == 0 && set->head == set->tail) {
+        pthread_cond_broadcast(&scheduler->cond);
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+// Adds morsels that were mapped outside of the scheduler to a servlet's set
+// so that their data is reduced along with the set. Shared scans map the
+// morsels of several workers in a single pass and hand each worker its share
+// of the output this way. The morsels are already complete so they are never
+// stolen. The set must not have been published.
+//
+// scheduler - The scheduler.
+// index     - The index of the servlet's set.
+// tablet    - The tablet that was mapped.
+// data      - The output of each morsel.
+// count     - The number of morsels.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_morsel_scheduler_attach(sky_morsel_scheduler *scheduler,
+                                uint32_t index, sky_tablet *tablet,
+                                void **data, uint32_t count)
+{
+    uint32_t i;
+    sky_morsel *morsels = NULL;
+    assert(scheduler != NULL);
+    assert(data != NULL || count == 0);
+    check(index < scheduler->set_count, "Invalid morsel set index: %d", index);
+
+    if(count > 0) {
+        morsels = calloc(count, sizeof(*morsels)); check_mem(morsels);
+        for(i=0; i<count; i++) {
+            morsels[i].tablet = tablet;
+            morsels[i].set_index = index;
+            morsels[i].data = data[i];
+        }
+    }
+
+    pthread_mutex_lock(&scheduler->mutex);
+    sky_morsel_set *set = &scheduler->sets[index];
+    bool published = set->published;
+    if(!published) {
+        set->morsels = morsels;
+        set->morsel_count = count;
+        set->head = count;
+        set->tail = count;
+        set->running_count = 0;
+        set->published = true;
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+    check(!published, "Morsel set has already been published: %d", index);
+
+    return 0;
+
+error:
+    free(morsels);
+    return -1;
+}
+
+
+//--------------------------------------
+// Helpers
+//--------------------------------------
+
+// Registers a new helper if the scan has fewer than a given number of
+// helpers. The helper holds a reference to the scheduler until it is
+// removed.
+//
+// scheduler - The scheduler.
+// max_count - The maximum number of helpers.
+//
+// Returns true if the helper was added, otherwise returns false.
+bool sky_morsel_scheduler_add_helper(sky_morsel_scheduler *scheduler,
+                                     uint32_t max_count)
+{
+    bool added = false;
+    assert(scheduler != NULL);
+
+    pthread_mutex_lock(&scheduler->mutex);
+    if(scheduler->helper_count < max_count) {
+        scheduler->helper_count++;
+        scheduler->ref_count++;
+        added = true;
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    return added;
+}
+
+// Removes a helper and releases its reference to the scheduler.
+//
+// scheduler - The scheduler.
+//
+// Returns nothing.
+void sky_morsel_scheduler_remove_helper(sky_morsel_scheduler *scheduler)
+{
+    assert(scheduler != NULL);
+
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->helper_count--;
+    pthread_mutex_unlock(&scheduler->mutex);
+    sky_morsel_scheduler_release(scheduler);
+}
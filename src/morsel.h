@@ -0,0 +1,128 @@
+#ifndef _sky_morsel_h
+#define _sky_morsel_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct sky_morsel sky_morsel;
+typedef struct sky_morsel_set sky_morsel_set;
+typedef struct sky_morsel_scheduler sky_morsel_scheduler;
+
+#include "bstring.h"
+#include "tablet.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A morsel is a range of objects within a tablet that is scanned as a single
+// unit of work. When a servlet starts a scan it splits its tablet into a set
+// of morsels and publishes them to the scheduler shared by every servlet in
+// the scan. The servlet takes morsels from the front of its own set and
+// steals from the back of other published sets once its own set is empty.
+//
+// Idle executor threads can also join a scan as helpers. Helpers only steal
+// and leave as soon as there is nothing left to steal. The scheduler is
+// reference counted so that it stays allocated until the last helper has
+// left.
+//
+// A tablet is only read by other threads while its own servlet is inside
+// the scan so no writes can happen to it. The servlet does not leave the
+// scan until every morsel in its set has been completed.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The maximum number of morsels that a tablet is split into.
+#define SKY_MORSEL_MAX_COUNT 16
+
+// The minimum number of bytes in a morsel.
+#define SKY_MORSEL_MIN_SIZE  262144
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_morsel {
+    sky_tablet *tablet;
+    uint32_t set_index;
+    bstring start;
+    bstring end;
+    void *data;
+};
+
+struct sky_morsel_set {
+    bool published;
+    sky_morsel *morsels;
+    uint32_t morsel_count;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t running_count;
+};
+
+struct sky_morsel_scheduler {
+    sky_morsel_set *sets;
+    uint32_t set_count;
+    uint32_t ref_count;
+    uint32_t helper_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_morsel_scheduler *sky_morsel_scheduler_create(uint32_t set_count);
+
+void sky_morsel_scheduler_free(sky_morsel_scheduler *scheduler);
+
+void sky_morsel_scheduler_release(sky_morsel_scheduler *scheduler);
+
+//--------------------------------------
+// Scheduling
+//--------------------------------------
+
+int sky_morsel_scheduler_publish(sky_morsel_scheduler *scheduler,
+    uint32_t index, sky_tablet *tablet, uint32_t max_count, size_t min_size);
+
+int sky_morsel_scheduler_next(sky_morsel_scheduler *scheduler,
+    uint32_t index, sky_morsel **morsel);
+
+int sky_morsel_scheduler_steal(sky_morsel_scheduler *scheduler,
+    sky_morsel **morsel);
+
+int sky_morsel_scheduler_complete(sky_morsel_scheduler *scheduler,
+    sky_morsel *morsel);
+
+int sky_morsel_scheduler_attach(sky_morsel_scheduler *scheduler,
+    uint32_t index, sky_tablet *tablet, void **data, uint32_t count);
+
+//--------------------------------------
+// Helpers
+//--------------------------------------
+
+bool sky_morsel_scheduler_add_helper(sky_morsel_scheduler *scheduler,
+    uint32_t max_count);
+
+void sky_morsel_scheduler_remove_helper(sky_morsel_scheduler *scheduler);
+
+#endif
@@ -3,6 +3,7 @@
 #include <arpa/inet.h>
 #include <sys/time.h>
 #include <assert.h>
+#include <math.h>
 
 #include "types.h"
 #include "next_actions_message.h"
@@ -41,6 +42,11 @@ struct tagbstring SKY_NEXT_ACTIONS_STATUS_STR = bsStatic("status");
 struct tagbstring SKY_NEXT_ACTIONS_OK_STR     = bsStatic("ok");
 struct tagbstring SKY_NEXT_ACTIONS_DATA_STR   = bsStatic("data");
 struct tagbstring SKY_NEXT_ACTIONS_COUNT_STR  = bsStatic("count");
+struct tagbstring SKY_NEXT_ACTIONS_MARGIN_STR = bsStatic("count_margin");
+struct tagbstring SKY_NEXT_ACTIONS_SAMPLE_STR = bsStatic("sample");
+
+struct tagbstring SKY_NEXT_ACTIONS_KEY_PRIOR_ACTIONS = bsStatic("prior_actions");
+struct tagbstring SKY_NEXT_ACTIONS_KEY_SAMPLE        = bsStatic("sample");
 
 
 //==============================================================================
@@ -60,6 +66,7 @@ sky_next_actions_message *sky_next_actions_message_create()
 {
     sky_next_actions_message *message = NULL;
     message = calloc(1, sizeof(sky_next_actions_message)); check_mem(message);
+    message->sample_rate = 1;
     return message;
 
 error:
@@ -94,6 +101,10 @@ void sky_next_actions_message_free_deps(sky_next_actions_message *message)
         message->results = NULL;
         free(message->prior_action_ids);
         message->prior_action_ids = NULL;
+        bdestroy(message->pattern_source);
+        message->pattern_source = NULL;
+        sky_pattern_free(message->pattern);
+        message->pattern = NULL;
     }
 }
 
@@ -141,9 +152,10 @@ int sky_next_actions_message_process(sky_server *server,
     
     // Create worker.
     sky_worker *worker = sky_worker_create(); check_mem(worker);
-    worker->context = server->context;
+    worker->pool = server->worker_pool;
     worker->read = sky_next_actions_message_worker_read;
     worker->map = sky_next_actions_message_worker_map;
+    worker->map_morsel = sky_next_actions_message_worker_map_morsel;
     worker->map_free = sky_next_actions_message_worker_map_free;
     worker->reduce = sky_next_actions_message_worker_reduce;
     worker->write = sky_next_actions_message_worker_write;
@@ -215,18 +227,52 @@ error:
 }
 
 
+// Compiles the prior actions into a pattern.
+//
+// message - The message.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_next_actions_message_compile(sky_next_actions_message *message)
+{
+    int rc;
+    assert(message != NULL);
+    check(message->pattern == NULL, "Prior actions already compiled");
+
+    message->pattern = sky_pattern_create(); check_mem(message->pattern);
+    if(message->pattern_source != NULL) {
+        rc = sky_pattern_compile(message->pattern, message->pattern_source);
+        check(rc == 0, "Unable to compile prior action pattern");
+    }
+    else {
+        rc = sky_pattern_compile_sequence(message->pattern, message->prior_action_ids, message->prior_action_id_count);
+        check(rc == 0, "Unable to compile prior actions");
+    }
+
+    return 0;
+
+error:
+    sky_pattern_free(message->pattern);
+    message->pattern = NULL;
+    return -1;
+}
+
+
 //--------------------------------------
 // Serialization
 //--------------------------------------
 
-// Calculates the total number of bytes needed to store the message.
+// Calculates the total number of bytes needed to store the prior actions.
 //
 // message - The message.
 //
-// Returns the number of bytes required to store the message.
-size_t sky_next_actions_message_sizeof(sky_next_actions_message *message)
+// Returns the number of bytes required to store the prior actions.
+static size_t sky_next_actions_message_sizeof_prior_actions(sky_next_actions_message *message)
 {
     size_t sz = 0;
+    if(message->pattern_source != NULL) {
+        return minipack_sizeof_raw(blength(message->pattern_source)) + blength(message->pattern_source);
+    }
+
     sz += minipack_sizeof_array(message->prior_action_id_count);
 
     uint32_t i;
@@ -237,17 +283,39 @@ size_t sky_next_actions_message_sizeof(sky_next_actions_message *message)
     return sz;
 }
 
-// Serializes a 'next_actions' message to a file stream.
+// Calculates the total number of bytes needed to store the message.
+//
+// message - The message.
+//
+// Returns the number of bytes required to store the message.
+size_t sky_next_actions_message_sizeof(sky_next_actions_message *message)
+{
+    size_t sz = sky_next_actions_message_sizeof_prior_actions(message);
+    if(sky_sample_is_enabled(message->sample_rate)) {
+        sz += minipack_sizeof_map(2);
+        sz += minipack_sizeof_raw(blength(&SKY_NEXT_ACTIONS_KEY_PRIOR_ACTIONS)) + blength(&SKY_NEXT_ACTIONS_KEY_PRIOR_ACTIONS);
+        sz += minipack_sizeof_raw(blength(&SKY_NEXT_ACTIONS_KEY_SAMPLE)) + blength(&SKY_NEXT_ACTIONS_KEY_SAMPLE);
+        sz += minipack_sizeof_double();
+    }
+    return sz;
+}
+
+// Serializes the prior actions of a 'next_actions' message to a file
+// stream. Patterns are written as their source.
 //
 // message - The message.
 // file    - The file stream to write to.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_next_actions_message_pack(sky_next_actions_message *message, FILE *file)
+static int sky_next_actions_message_pack_prior_actions(sky_next_actions_message *message,
+                                                       FILE *file)
 {
     size_t sz;
-    assert(message != NULL);
-    assert(file != NULL);
+
+    if(message->pattern_source != NULL) {
+        check(sky_minipack_fwrite_bstring(file, message->pattern_source) == 0, "Unable to pack prior action pattern");
+        return 0;
+    }
 
     minipack_fwrite_array(file, message->prior_action_id_count, &sz);
     check(sz > 0, "Unable to pack prior action id array");
@@ -257,25 +325,72 @@ int sky_next_actions_message_pack(sky_next_actions_message *message, FILE *file)
         minipack_fwrite_int(file, message->prior_action_ids[i], &sz);
         check(sz > 0, "Unable to pack prior action id");
     }
-    
+
     return 0;
 
 error:
     return -1;
 }
 
-// Deserializes an 'next_actions' message from a file stream.
+// Serializes a 'next_actions' message to a file stream. Unsampled messages
+// are written as the bare prior actions. Sampled messages are written as a
+// map:
+//
+//   {"prior_actions":[...], "sample":<rate>}
 //
 // message - The message.
-// file    - The file stream to read from.
+// file    - The file stream to write to.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_next_actions_message_unpack(sky_next_actions_message *message, FILE *file)
+int sky_next_actions_message_pack(sky_next_actions_message *message, FILE *file)
 {
+    int rc;
     size_t sz;
     assert(message != NULL);
     assert(file != NULL);
 
+    if(!sky_sample_is_enabled(message->sample_rate)) {
+        return sky_next_actions_message_pack_prior_actions(message, file);
+    }
+
+    check(minipack_fwrite_map(file, 2, &sz) == 0, "Unable to pack map");
+    check(sky_minipack_fwrite_bstring(file, &SKY_NEXT_ACTIONS_KEY_PRIOR_ACTIONS) == 0, "Unable to pack prior actions key");
+    rc = sky_next_actions_message_pack_prior_actions(message, file);
+    check(rc == 0, "Unable to pack prior actions");
+    check(sky_minipack_fwrite_bstring(file, &SKY_NEXT_ACTIONS_KEY_SAMPLE) == 0, "Unable to pack sample key");
+    check(minipack_fwrite_double(file, message->sample_rate, &sz) == 0, "Unable to pack sample rate");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Deserializes the prior actions of a 'next_actions' message from a file
+// stream. The prior actions are either an array of action ids or a pattern
+// string.
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_next_actions_message_unpack_prior_actions(sky_next_actions_message *message,
+                                                         FILE *file)
+{
+    int rc;
+    size_t sz;
+
+    // Read the first byte of the prior actions to determine the type.
+    uint8_t buffer[1];
+    check(fread(buffer, sizeof(*buffer), 1, file) == 1, "Unable to read prior actions type");
+    ungetc(buffer[0], file);
+
+    if(minipack_is_raw((void*)buffer)) {
+        rc = sky_minipack_fread_bstring(file, &message->pattern_source);
+        check(rc == 0, "Unable to unpack prior action pattern");
+        return 0;
+    }
+
     message->prior_action_id_count = minipack_fread_array(file, &sz);
     check(sz > 0, "Unable to unpack prior action id array");
 
@@ -294,6 +409,63 @@ error:
     return -1;
 }
 
+// Deserializes an 'next_actions' message from a file stream. The message is
+// either the bare prior actions or a map that can also set a sample rate:
+//
+//   {"prior_actions":[...], "sample":<rate>}
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_next_actions_message_unpack(sky_next_actions_message *message, FILE *file)
+{
+    int rc;
+    size_t sz;
+    bstring key = NULL;
+    assert(message != NULL);
+    assert(file != NULL);
+
+    // Read the first byte of the message to determine the type.
+    uint8_t buffer[1];
+    check(fread(buffer, sizeof(*buffer), 1, file) == 1, "Unable to read message type");
+    ungetc(buffer[0], file);
+
+    if(!minipack_is_map((void*)buffer)) {
+        return sky_next_actions_message_unpack_prior_actions(message, file);
+    }
+
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read map");
+
+    uint32_t i;
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read map key");
+
+        if(biseq(key, &SKY_NEXT_ACTIONS_KEY_PRIOR_ACTIONS) == 1) {
+            rc = sky_next_actions_message_unpack_prior_actions(message, file);
+            check(rc == 0, "Unable to unpack prior actions");
+        }
+        else if(biseq(key, &SKY_NEXT_ACTIONS_KEY_SAMPLE) == 1) {
+            rc = sky_sample_unpack_rate(&message->sample_rate, file);
+            check(rc == 0, "Unable to read sample rate");
+        }
+        else {
+            sentinel("Invalid next actions key: %s", bdata(key));
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
 
 //--------------------------------------
 // Worker
@@ -315,7 +487,10 @@ int sky_next_actions_message_worker_read(sky_worker *worker, FILE *input)
     sky_next_actions_message *message = (sky_next_actions_message*)worker->data;
     rc = sky_next_actions_message_unpack(message, input);
     check(rc == 0, "Unable to unpack 'next_actions' message");
-    check(message->prior_action_id_count > 0, "Prior actions must be specified");
+    check(message->prior_action_id_count > 0 || message->pattern_source != NULL, "Prior actions must be specified");
+
+    rc = sky_next_actions_message_compile(message);
+    check(rc == 0, "Unable to compile prior actions");
 
     return 0;
 
@@ -332,11 +507,32 @@ error:
 // Returns 0 if successful, otherwise returns -1.
 int sky_next_actions_message_worker_map(sky_worker *worker, sky_tablet *tablet,
                                         void **ret)
+{
+    assert(tablet != NULL);
+    sky_morsel morsel;
+    memset(&morsel, 0, sizeof(morsel));
+    morsel.tablet = tablet;
+    return sky_next_actions_message_worker_map_morsel(worker, &morsel, NULL, ret);
+}
+
+// Maps a range of tablet data to a next action summation data structure.
+//
+// worker  - The worker.
+// morsel  - The range of the tablet to work against.
+// context - Unused.
+// ret     - A pointer to where the summation data structure should be
+//           returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_next_actions_message_worker_map_morsel(sky_worker *worker,
+                                               sky_morsel *morsel,
+                                               void **context, void **ret)
 {
     int rc;
     assert(worker != NULL);
-    assert(tablet != NULL);
+    assert(morsel != NULL);
     assert(ret != NULL);
+    UNUSED(context);
 
     sky_next_actions_message *message = (sky_next_actions_message*)worker->data;
 
@@ -344,20 +540,32 @@ int sky_next_actions_message_worker_map(sky_worker *worker, sky_tablet *tablet,
     sky_next_actions_data data;
     memset(&data, 0, sizeof(data));
     
+    // Initialize the path iterator.
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    sky_pattern_matcher matcher;
+    memset(&matcher, 0, sizeof(matcher));
+
     // Create an array to store data.
     uint32_t action_count = message->action_count;
     sky_next_actions_result *results = calloc(action_count+1, sizeof(*results));
     check_mem(results);
 
-    // Initialize the path iterator.
-    sky_path_iterator iterator;
-    sky_path_iterator_init(&iterator);
+    // Initialize the pattern matcher.
+    rc = sky_pattern_matcher_init(&matcher, message->pattern);
+    check(rc == 0, "Unable to initialize pattern matcher");
 
     // Attach data and descriptor to cursor.
     iterator.cursor.data_descriptor = message->data_descriptor;
     iterator.cursor.data = (void*)(&data);
 
-    rc = sky_path_iterator_set_tablet(&iterator, tablet);
+    // Only visit sampled objects if the message is sampled.
+    bool sampled = sky_sample_is_enabled(message->sample_rate);
+    if(sampled) {
+        sky_path_iterator_set_sample_rate(&iterator, message->sample_rate);
+    }
+
+    rc = sky_path_iterator_set_range(&iterator, morsel->tablet, morsel->start, morsel->end);
     check(rc == 0, "Unable to initialize path iterator");
 
     // Iterate over each path.
@@ -372,23 +580,17 @@ int sky_next_actions_message_worker_map(sky_worker *worker, sky_tablet *tablet,
         check(rc == 0, "Unable to initialize cursor");
 
         // Loop over each event in the path.
-        uint32_t prior_action_index = 0;
+        bool matched = false;
+        sky_pattern_matcher_reset(&matcher);
         while(!iterator.cursor.eof) {
-            // Aggregate if we've reached the match.
-            if(prior_action_index == message->prior_action_id_count) {
-                if(data.action_id <= action_count) {
-                    results[data.action_id].count++;
-                }
-                prior_action_index = 0;
+            // Aggregate if the previous event completed a match.
+            if(matched && data.action_id <= action_count) {
+                results[data.action_id].count++;
+                if(sampled) sky_sample_variance_add(&results[data.action_id].variance, path_count, 1);
             }
 
-            // Match against action list.
-            if(message->prior_action_ids[prior_action_index] == data.action_id) {
-                prior_action_index++;
-            }
-            else {
-                prior_action_index = 0;
-            }
+            // Match against the prior action pattern.
+            matched = sky_pattern_matcher_next(&matcher, data.action_id, data.timestamp);
 
             // Find next event.
             rc = sky_cursor_next_event(&iterator.cursor);
@@ -412,12 +614,14 @@ int sky_next_actions_message_worker_map(sky_worker *worker, sky_tablet *tablet,
     *ret = (void*)results;
 
     sky_path_iterator_uninit(&iterator);
+    sky_pattern_matcher_uninit(&matcher);
     return 0;
 
 error:
     free(results);
     *ret = NULL;
     sky_path_iterator_uninit(&iterator);
+    sky_pattern_matcher_uninit(&matcher);
     return -1;
 }
 
@@ -453,6 +657,7 @@ int sky_next_actions_message_worker_reduce(sky_worker *worker, void *data)
     uint32_t i;
     for(i=0; i<message->action_count+1; i++) {
         message->results[i].count += map_results[i].count;
+        sky_sample_variance_merge(&message->results[i].variance, &map_results[i].variance);
     }
     
     return 0;
@@ -472,6 +677,8 @@ int sky_next_actions_message_worker_write(sky_worker *worker, FILE *output)
     
     // Ease-of-use references.
     sky_next_actions_message *message = (sky_next_actions_message*)worker->data;
+    double rate = message->sample_rate;
+    bool sampled = sky_sample_is_enabled(rate);
 
     // Count the total number of return elements.
     uint32_t i, key_count = 0;
@@ -483,19 +690,34 @@ int sky_next_actions_message_worker_write(sky_worker *worker, FILE *output)
     
     // Return.
     //   {status:"ok", data:{<action_id>:{count:0}, ...}}
-    check(minipack_fwrite_map(output, 2, &sz) == 0, "Unable to write root map");
+    //
+    // Sampled messages scale each count, add its margin of error and
+    // describe the sample.
+    //   {status:"ok", data:{<action_id>:{count:0, count_margin:0}, ...}, sample:{...}}
+    check(minipack_fwrite_map(output, (sampled ? 3 : 2), &sz) == 0, "Unable to write root map");
     check(sky_minipack_fwrite_bstring(output, &SKY_NEXT_ACTIONS_STATUS_STR) == 0, "Unable to write status key");
     check(sky_minipack_fwrite_bstring(output, &SKY_NEXT_ACTIONS_OK_STR) == 0, "Unable to write status value");
     check(sky_minipack_fwrite_bstring(output, &SKY_NEXT_ACTIONS_DATA_STR) == 0, "Unable to write data key");
     check(minipack_fwrite_map(output, key_count, &sz) == 0, "Unable to write data key");
     for(i=0; i<message->action_count+1; i++) {
         if(message->results[i].count > 0) {
+            sky_next_actions_result *result = &message->results[i];
+            uint64_t count = (sampled ? (uint64_t)round(result->count / rate) : result->count);
             check(minipack_fwrite_uint(output, i, &sz) == 0, "Unable to write action id");
-            check(minipack_fwrite_map(output, 1, &sz) == 0, "Unable to write result map");
+            check(minipack_fwrite_map(output, (sampled ? 2 : 1), &sz) == 0, "Unable to write result map");
             check(sky_minipack_fwrite_bstring(output, &SKY_NEXT_ACTIONS_COUNT_STR) == 0, "Unable to write result count key");
-            check(minipack_fwrite_uint(output, message->results[i].count, &sz) == 0, "Unable to write result count");
+            check(minipack_fwrite_uint(output, count, &sz) == 0, "Unable to write result count");
+            if(sampled) {
+                check(sky_minipack_fwrite_bstring(output, &SKY_NEXT_ACTIONS_MARGIN_STR) == 0, "Unable to write margin key");
+                check(minipack_fwrite_double(output, sky_sample_margin(sky_sample_variance_sum_sq(&result->variance), rate), &sz) == 0, "Unable to write margin");
+            }
         }
     }
+
+    if(sampled) {
+        check(sky_minipack_fwrite_bstring(output, &SKY_NEXT_ACTIONS_SAMPLE_STR) == 0, "Unable to write sample key");
+        check(sky_sample_pack(rate, output) == 0, "Unable to write sample value");
+    }
     
     // Write total number of events to log.
     printf("[next_actions] paths: %" PRIu64 ", events: %" PRIu64 "\n", message->path_count, message->event_count);
@@ -11,7 +11,9 @@
 #include "table.h"
 #include "tablet.h"
 #include "event.h"
+#include "pattern.h"
 #include "worker.h"
+#include "sample.h"
 
 
 //==============================================================================
@@ -23,13 +25,19 @@
 // The result data to send back to the client.
 typedef struct {
     uint32_t count;
+    sky_sample_variance variance;
 } sky_next_actions_result;
 
 // A message for retrieving a count of the next immediate action following a
-// series of actions.
+// series of actions. The prior actions can either be an exact sequence of
+// action ids or the source of a pattern. Only a sample of the objects is
+// scanned if the sample rate is below one.
 typedef struct {
     sky_action_id_t *prior_action_ids;
     uint32_t prior_action_id_count;
+    bstring pattern_source;
+    sky_pattern *pattern;
+    double sample_rate;
     sky_next_actions_result *results;
     uint32_t action_count;
     sky_data_descriptor *data_descriptor;
@@ -66,6 +74,8 @@ int sky_next_actions_message_process(sky_server *server,
 int sky_next_actions_message_init_data_descriptor(sky_next_actions_message *message,
     sky_property_file *property_file);
 
+int sky_next_actions_message_compile(sky_next_actions_message *message);
+
 //--------------------------------------
 // Serialization
 //--------------------------------------
@@ -85,6 +95,9 @@ int sky_next_actions_message_worker_read(sky_worker *worker, FILE *input);
 int sky_next_actions_message_worker_map(sky_worker *worker, sky_tablet *tablet,
     void **data);
 
+int sky_next_actions_message_worker_map_morsel(sky_worker *worker,
+    sky_morsel *morsel, void **context, void **ret);
+
 int sky_next_actions_message_worker_map_free(void *data);
 
 int sky_next_actions_message_worker_reduce(sky_worker *worker, void *data);
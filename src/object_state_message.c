@@ -0,0 +1,519 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "types.h"
+#include "object_state_message.h"
+#include "property_file.h"
+#include "dictionary.h"
+#include "timestamp.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+#define SKY_OBJECT_STATE_KEY_COUNT 3
+
+struct tagbstring SKY_OBJECT_STATE_KEY_OBJECT_IDS = bsStatic("objectIds");
+struct tagbstring SKY_OBJECT_STATE_KEY_TIMESTAMP  = bsStatic("timestamp");
+struct tagbstring SKY_OBJECT_STATE_KEY_PROPERTIES = bsStatic("properties");
+
+struct tagbstring SKY_OBJECT_STATE_STATUS_STR  = bsStatic("status");
+struct tagbstring SKY_OBJECT_STATE_OK_STR      = bsStatic("ok");
+struct tagbstring SKY_OBJECT_STATE_OBJECTS_STR = bsStatic("objects");
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates an 'object_state' message object.
+//
+// Returns a new message.
+sky_object_state_message *sky_object_state_message_create()
+{
+    sky_object_state_message *message = NULL;
+    message = calloc(1, sizeof(sky_object_state_message)); check_mem(message);
+    return message;
+
+error:
+    sky_object_state_message_free(message);
+    return NULL;
+}
+
+// Frees an 'object_state' message object from memory.
+//
+// message - The message object to be freed.
+//
+// Returns nothing.
+void sky_object_state_message_free(sky_object_state_message *message)
+{
+    uint32_t i;
+    if(message) {
+        for(i=0; i<message->object_id_count; i++) {
+            bdestroy(message->object_ids[i]);
+            message->object_ids[i] = NULL;
+            if(message->states) sky_tablet_tail_uninit(&message->states[i]);
+        }
+        free(message->object_ids);
+        free(message->tablets);
+        free(message->states);
+        free(message->found);
+
+        for(i=0; i<message->property_name_count; i++) {
+            bdestroy(message->property_names[i]);
+            message->property_names[i] = NULL;
+        }
+        free(message->property_names);
+        free(message->properties);
+
+        free(message);
+    }
+}
+
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+// Creates a message handler for the 'object_state' message.
+//
+// Returns a message handler.
+sky_message_handler *sky_object_state_message_handler_create()
+{
+    sky_message_handler *handler = sky_message_handler_create(); check_mem(handler);
+    handler->scope = SKY_MESSAGE_HANDLER_SCOPE_TABLE;
+    handler->name = bfromcstr("object_state");
+    handler->process = sky_object_state_message_process;
+    return handler;
+
+error:
+    sky_message_handler_free(handler);
+    return NULL;
+}
+
+// Delegates processing of the 'object_state' message to a worker. The
+// worker is only sent to the servlets of the tablets that hold the objects.
+//
+// server - The server.
+// header - The message header.
+// table  - The table the message is working against
+// input  - The input file stream.
+// output - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_object_state_message_process(sky_server *server,
+                                     sky_message_header *header,
+                                     sky_table *table,
+                                     FILE *input, FILE *output)
+{
+    int rc = 0;
+    uint32_t i, j;
+    sky_object_state_message *message = NULL;
+    sky_worker *worker = NULL;
+    assert(header != NULL);
+    assert(table != NULL);
+    assert(input != NULL);
+    assert(output != NULL);
+
+    // Create worker.
+    worker = sky_worker_create(); check_mem(worker);
+    worker->pool = server->worker_pool;
+    worker->map = sky_object_state_message_worker_map;
+    worker->write = sky_object_state_message_worker_write;
+    worker->free = sky_object_state_message_worker_free;
+    worker->multi = header->multi;
+    worker->input = input;
+    worker->output = output;
+
+    // Parse message.
+    message = sky_object_state_message_create(); check_mem(message);
+    rc = sky_object_state_message_unpack(message, input);
+    check(rc == 0, "Unable to unpack 'object_state' message");
+    check(message->object_id_count > 0, "Object IDs required");
+
+    rc = sky_object_state_message_init(message, table);
+    check(rc == 0, "Unable to initialize 'object_state' message");
+
+    // Attach the servlet of each distinct tablet.
+    worker->servlets = calloc(message->object_id_count, sizeof(*worker->servlets));
+    check_mem(worker->servlets);
+    for(i=0; i<message->object_id_count; i++) {
+        sky_servlet *servlet = NULL;
+        rc = sky_server_get_tablet_servlet(server, message->tablets[i], &servlet);
+        check(rc == 0 && servlet != NULL, "Unable to find tablet servlet");
+
+        for(j=0; j<worker->servlet_count; j++) {
+            if(worker->servlets[j] == servlet) break;
+        }
+        if(j == worker->servlet_count) {
+            worker->servlets[worker->servlet_count++] = servlet;
+        }
+    }
+
+    // Attach the message to the worker.
+    worker->data = (void*)message;
+
+    // Start worker.
+    rc = sky_worker_start(worker);
+    check(rc == 0, "Unable to start worker");
+
+    return 0;
+
+error:
+    sky_object_state_message_free(message);
+    sky_worker_free(worker);
+    return -1;
+}
+
+// Resolves the properties of the message by name and the target tablet of
+// each object. Unknown properties are left null.
+//
+// message - The message.
+// table   - The table the message is working against.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_object_state_message_init(sky_object_state_message *message,
+                                  sky_table *table)
+{
+    int rc;
+    uint32_t i;
+    assert(message != NULL);
+    assert(table != NULL);
+
+    if(message->property_name_count > 0) {
+        message->properties = calloc(message->property_name_count, sizeof(*message->properties));
+        check_mem(message->properties);
+    }
+    for(i=0; i<message->property_name_count; i++) {
+        rc = sky_property_file_find_by_name(table->property_file, message->property_names[i], &message->properties[i]);
+        check(rc == 0, "Unable to search for property by name");
+    }
+
+    if(message->object_id_count > 0) {
+        message->tablets = calloc(message->object_id_count, sizeof(*message->tablets));
+        check_mem(message->tablets);
+        message->states = calloc(message->object_id_count, sizeof(*message->states));
+        check_mem(message->states);
+        message->found = calloc(message->object_id_count, sizeof(*message->found));
+        check_mem(message->found);
+    }
+    for(i=0; i<message->object_id_count; i++) {
+        rc = sky_table_get_target_tablet(table, message->object_ids[i], &message->tablets[i]);
+        check(rc == 0 && message->tablets[i] != NULL, "Unable to find target tablet: %s", bdata(message->object_ids[i]));
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Serializes an 'object_state' message to a file stream.
+//
+// message - The message.
+// file    - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_object_state_message_pack(sky_object_state_message *message,
+                                  FILE *file)
+{
+    int rc;
+    size_t sz;
+    uint32_t i;
+    check(message != NULL, "Message required");
+    check(file != NULL, "File stream required");
+
+    // Map
+    minipack_fwrite_map(file, SKY_OBJECT_STATE_KEY_COUNT, &sz);
+    check(sz > 0, "Unable to write map");
+
+    // Object ids.
+    check(sky_minipack_fwrite_bstring(file, &SKY_OBJECT_STATE_KEY_OBJECT_IDS) == 0, "Unable to write object ids key");
+    minipack_fwrite_array(file, message->object_id_count, &sz);
+    check(sz > 0, "Unable to write object ids array");
+    for(i=0; i<message->object_id_count; i++) {
+        rc = sky_minipack_fwrite_bstring(file, message->object_ids[i]);
+        check(rc == 0, "Unable to write object id");
+    }
+
+    // Timestamp.
+    check(sky_minipack_fwrite_bstring(file, &SKY_OBJECT_STATE_KEY_TIMESTAMP) == 0, "Unable to write timestamp key");
+    minipack_fwrite_int(file, message->timestamp, &sz);
+    check(sz > 0, "Unable to write timestamp");
+
+    // Property names.
+    check(sky_minipack_fwrite_bstring(file, &SKY_OBJECT_STATE_KEY_PROPERTIES) == 0, "Unable to write properties key");
+    minipack_fwrite_array(file, message->property_name_count, &sz);
+    check(sz > 0, "Unable to write properties array");
+    for(i=0; i<message->property_name_count; i++) {
+        rc = sky_minipack_fwrite_bstring(file, message->property_names[i]);
+        check(rc == 0, "Unable to write property name");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Deserializes an 'object_state' message from a file stream. The timestamp
+// is the number of microseconds since the epoch.
+//
+//   {"objectIds":["a", ...], "timestamp":<usec>, "properties":["p", ...]}
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_object_state_message_unpack(sky_object_state_message *message,
+                                    FILE *file)
+{
+    int rc;
+    size_t sz;
+    bstring key = NULL;
+    check(message != NULL, "Message required");
+    check(file != NULL, "File stream required");
+
+    // Map
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read map");
+
+    // Map items
+    uint32_t i, j;
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read map key");
+
+        // Object ids.
+        if(biseq(key, &SKY_OBJECT_STATE_KEY_OBJECT_IDS)) {
+            message->object_id_count = minipack_fread_array(file, &sz);
+            check(sz != 0, "Unable to read object ids array");
+
+            message->object_ids = calloc(message->object_id_count, sizeof(*message->object_ids));
+            check_mem(message->object_ids);
+
+            for(j=0; j<message->object_id_count; j++) {
+                rc = sky_minipack_fread_bstring(file, &message->object_ids[j]);
+                check(rc == 0, "Unable to read object id");
+            }
+        }
+        // Timestamp.
+        else if(biseq(key, &SKY_OBJECT_STATE_KEY_TIMESTAMP)) {
+            message->timestamp = (sky_timestamp_t)minipack_fread_int(file, &sz);
+            check(sz != 0, "Unable to read timestamp");
+        }
+        // Property names.
+        else if(biseq(key, &SKY_OBJECT_STATE_KEY_PROPERTIES)) {
+            message->property_name_count = minipack_fread_array(file, &sz);
+            check(sz != 0, "Unable to read properties array");
+
+            message->property_names = calloc(message->property_name_count, sizeof(*message->property_names));
+            check_mem(message->property_names);
+
+            for(j=0; j<message->property_name_count; j++) {
+                rc = sky_minipack_fread_bstring(file, &message->property_names[j]);
+                check(rc == 0, "Unable to read property name");
+            }
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+// Looks up the state of every object in the message that belongs to a given
+// tablet. Each object is only looked up by its own tablet so the states are
+// written straight into the message.
+//
+// worker - The worker.
+// tablet - The tablet to look up objects on.
+// ret    - Unused.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_object_state_message_worker_map(sky_worker *worker,
+                                        sky_tablet *tablet, void **ret)
+{
+    int rc;
+    uint32_t i;
+    assert(worker != NULL);
+    assert(tablet != NULL);
+    assert(ret != NULL);
+
+    sky_object_state_message *message = (sky_object_state_message*)worker->data;
+    sky_timestamp_t ts = sky_timestamp_shift(message->timestamp);
+    for(i=0; i<message->object_id_count; i++) {
+        if(message->tablets[i] == tablet) {
+            rc = sky_tablet_get_state(tablet, message->object_ids[i], ts, &message->states[i], &message->found[i]);
+            check(rc == 0, "Unable to retrieve object state: %s", bdata(message->object_ids[i]));
+        }
+    }
+
+    *ret = NULL;
+    return 0;
+
+error:
+    if(ret) *ret = NULL;
+    return -1;
+}
+
+// Writes the value of a single property from an object state.
+//
+// property - The property or null if the property doesn't exist.
+// state    - The object state.
+// output   - The output stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_object_state_message_write_value(sky_property *property,
+                                                sky_tablet_tail *state,
+                                                FILE *output)
+{
+    size_t sz;
+    uint32_t i;
+    sky_event_data *data = NULL;
+    if(property != NULL) {
+        for(i=0; i<state->data_count; i++) {
+            if(state->data[i]->key == property->id) {
+                data = state->data[i];
+                break;
+            }
+        }
+    }
+
+    if(data == NULL) {
+        check(minipack_fwrite_nil(output, &sz) == 0, "Unable to write nil value");
+        return 0;
+    }
+
+    switch(data->data_type) {
+        case SKY_DATA_TYPE_STRING: {
+            check(sky_minipack_fwrite_bstring(output, data->string_value) == 0, "Unable to write string value");
+            break;
+        }
+        case SKY_DATA_TYPE_INT: {
+            // Dictionary encoded strings are stored by their code.
+            if(property->dictionary != NULL) {
+                bstring value = sky_dictionary_decode(property->dictionary, data->int_value);
+                if(value != NULL) {
+                    check(sky_minipack_fwrite_bstring(output, value) == 0, "Unable to write string value");
+                }
+                else {
+                    check(minipack_fwrite_nil(output, &sz) == 0, "Unable to write nil value");
+                }
+            }
+            else {
+                check(minipack_fwrite_int(output, data->int_value, &sz) == 0, "Unable to write int value");
+            }
+            break;
+        }
+        case SKY_DATA_TYPE_DOUBLE: {
+            check(minipack_fwrite_double(output, data->double_value, &sz) == 0, "Unable to write double value");
+            break;
+        }
+        case SKY_DATA_TYPE_BOOLEAN: {
+            check(minipack_fwrite_bool(output, data->boolean_value, &sz) == 0, "Unable to write boolean value");
+            break;
+        }
+        default: {
+            check(minipack_fwrite_nil(output, &sz) == 0, "Unable to write nil value");
+            break;
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes the results to an output stream. Objects without any events at or
+// before the timestamp are returned as nil.
+//
+//   {status:"ok", objects:{<object_id>:{<property>:<value>, ...}, ...}}
+//
+// worker - The worker.
+// output - The output stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_object_state_message_worker_write(sky_worker *worker, FILE *output)
+{
+    int rc;
+    size_t sz;
+    uint32_t i, j;
+    assert(worker != NULL);
+    assert(output != NULL);
+
+    sky_object_state_message *message = (sky_object_state_message*)worker->data;
+
+    check(minipack_fwrite_map(output, 2, &sz) == 0, "Unable to write root map");
+    check(sky_minipack_fwrite_bstring(output, &SKY_OBJECT_STATE_STATUS_STR) == 0, "Unable to write status key");
+    check(sky_minipack_fwrite_bstring(output, &SKY_OBJECT_STATE_OK_STR) == 0, "Unable to write status value");
+    check(sky_minipack_fwrite_bstring(output, &SKY_OBJECT_STATE_OBJECTS_STR) == 0, "Unable to write objects key");
+    check(minipack_fwrite_map(output, message->object_id_count, &sz) == 0, "Unable to write objects map");
+
+    for(i=0; i<message->object_id_count; i++) {
+        check(sky_minipack_fwrite_bstring(output, message->object_ids[i]) == 0, "Unable to write object id");
+        if(!message->found[i]) {
+            check(minipack_fwrite_nil(output, &sz) == 0, "Unable to write nil state");
+            continue;
+        }
+
+        check(minipack_fwrite_map(output, message->property_name_count, &sz) == 0, "Unable to write state map");
+        for(j=0; j<message->property_name_count; j++) {
+            check(sky_minipack_fwrite_bstring(output, message->property_names[j]) == 0, "Unable to write property name");
+            rc = sky_object_state_message_write_value(message->properties[j], &message->states[i], output);
+            check(rc == 0, "Unable to write property value");
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Frees all data attached to the worker.
+//
+// worker - The worker.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_object_state_message_worker_free(sky_worker *worker)
+{
+    assert(worker != NULL);
+
+    // Clean up.
+    sky_object_state_message *message = (sky_object_state_message*)worker->data;
+    sky_object_state_message_free(message);
+    worker->data = NULL;
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#ifndef _sky_object_state_message_h
+#define _sky_object_state_message_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "bstring.h"
+#include "message_header.h"
+#include "message_handler.h"
+#include "property.h"
+#include "table.h"
+#include "tablet.h"
+#include "worker.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The object state message looks up the object properties of a list of
+// objects as of a given time. Each object id is routed to its tablet and
+// the objects on the same tablet are looked up together in a single turn of
+// the tablet's servlet. The state of an object at or after its last event
+// comes from the object's tail summary without reading its path. Earlier
+// states are replayed from the latest checkpoint before the timestamp.
+//
+// Only object properties hold state so action properties are always
+// returned as nil.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// A message for retrieving the state of objects at a point in time.
+typedef struct {
+    bstring *object_ids;
+    uint32_t object_id_count;
+    sky_timestamp_t timestamp;
+    bstring *property_names;
+    uint32_t property_name_count;
+    sky_property **properties;
+    sky_tablet **tablets;
+    sky_tablet_tail *states;
+    bool *found;
+} sky_object_state_message;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_object_state_message *sky_object_state_message_create();
+
+void sky_object_state_message_free(sky_object_state_message *message);
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+sky_message_handler *sky_object_state_message_handler_create();
+
+int sky_object_state_message_process(sky_server *server,
+    sky_message_header *header, sky_table *table, FILE *input, FILE *output);
+
+int sky_object_state_message_init(sky_object_state_message *message,
+    sky_table *table);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_object_state_message_pack(sky_object_state_message *message,
+    FILE *file);
+
+int sky_object_state_message_unpack(sky_object_state_message *message,
+    FILE *file);
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int sky_object_state_message_worker_map(sky_worker *worker,
+    sky_tablet *tablet, void **data);
+
+int sky_object_state_message_worker_write(sky_worker *worker, FILE *output);
+
+int sky_object_state_message_worker_free(sky_worker *worker);
+
+#endif
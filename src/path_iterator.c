@@ -1,7 +1,9 @@
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "path_iterator.h"
+#include "timestamp.h"
 #include "mem.h"
 #include "dbg.h"
 
@@ -46,6 +48,7 @@ sky_path_iterator *sky_path_iterator_alloc()
 void sky_path_iterator_init(sky_path_iterator *iterator)
 {
     memset(iterator, 0, sizeof(sky_path_iterator));
+    iterator->path.in_place = true;
 }
 
 // Uninitializes a path iterator.
@@ -54,8 +57,12 @@ void sky_path_iterator_init(sky_path_iterator *iterator)
 void sky_path_iterator_uninit(sky_path_iterator *iterator)
 {
     iterator->tablet = NULL;
+    iterator->end = NULL;
     if(iterator->leveldb_iterator) leveldb_iter_destroy(iterator->leveldb_iterator);
     iterator->leveldb_iterator = NULL;
+    if(iterator->checkpoint_iterator) leveldb_iter_destroy(iterator->checkpoint_iterator);
+    iterator->checkpoint_iterator = NULL;
+    sky_tablet_path_uninit(&iterator->path);
 }
 
 // Removes a path iterator reference from memory.
@@ -81,16 +88,43 @@ void sky_path_iterator_free(sky_path_iterator *iterator)
 //
 // Returns 0 if successful, otherwise returns -1.
 int sky_path_iterator_set_tablet(sky_path_iterator *iterator, sky_tablet *tablet)
+{
+    return sky_path_iterator_set_range(iterator, tablet, NULL, NULL);
+}
+
+// Assigns a range of objects within a tablet as the source.
+// 
+// iterator - The iterator.
+// tablet   - The data file to iterate over.
+// start    - The first object id in the range or null to start from the
+//            first object in the tablet.
+// end      - The object id that ends the range or null to continue to the
+//            last object in the tablet. The end is exclusive and must stay
+//            allocated while the iterator is in use.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_set_range(sky_path_iterator *iterator, sky_tablet *tablet,
+                                bstring start, bstring end)
 {
     int rc;
     assert(iterator != NULL);
     iterator->tablet = tablet;
+    iterator->segment_index = 0;
+    iterator->end = end;
     iterator->eof = false;
+    if(iterator->checkpoint_iterator) leveldb_iter_destroy(iterator->checkpoint_iterator);
+    iterator->checkpoint_iterator = NULL;
 
     // Initialize LevelDB iterator.
     iterator->leveldb_iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
     check(iterator->leveldb_iterator != NULL, "Unable to create LevelDB iterator");
-    leveldb_iter_seek_to_first(iterator->leveldb_iterator);
+    if(start != NULL) {
+        leveldb_iter_seek(iterator->leveldb_iterator, bdatae(start, ""), blength(start));
+        iterator->segment_index = sky_segment_lower_bound(tablet->segment, bdatae(start, ""), blength(start));
+    }
+    else {
+        leveldb_iter_seek_to_first(iterator->leveldb_iterator);
+    }
 
     // Move cursor to initial path.
     rc = sky_path_iterator_next(iterator);
@@ -102,12 +136,194 @@ error:
     return -1;
 }
 
+// Limits the iterator to the paths of a sample of objects. Objects outside
+// of the sample are skipped without reading their paths. The sample hash
+// of each path that is visited is kept on the iterator so that callers can
+// check it against smaller samples. This must be set before the source.
+//
+// iterator - The iterator.
+// rate     - The fraction of objects to visit.
+//
+// Returns nothing.
+void sky_path_iterator_set_sample_rate(sky_path_iterator *iterator,
+                                       double rate)
+{
+    assert(iterator != NULL);
+    iterator->sampled = true;
+    iterator->sample_threshold = sky_sample_threshold(rate);
+}
+
+
+//--------------------------------------
+// Pruning
+//--------------------------------------
+
+// Limits the iterator to paths that have an event within a time range.
+// Paths whose summary lies outside of the range are skipped without reading
+// their paths. Setting a range more than once limits the iterator to the
+// overlap of the ranges. This must be set before the source.
+//
+// iterator      - The iterator.
+// min_timestamp - The earliest timestamp, in seconds.
+// max_timestamp - The latest timestamp, in seconds.
+//
+// Returns nothing.
+void sky_path_iterator_set_time_range(sky_path_iterator *iterator,
+                                      uint32_t min_timestamp,
+                                      uint32_t max_timestamp)
+{
+    assert(iterator != NULL);
+    if(iterator->has_time_range) {
+        if(min_timestamp < iterator->min_timestamp) min_timestamp = iterator->min_timestamp;
+        if(max_timestamp > iterator->max_timestamp) max_timestamp = iterator->max_timestamp;
+    }
+    iterator->has_time_range = true;
+    iterator->min_timestamp = min_timestamp;
+    iterator->max_timestamp = max_timestamp;
+}
+
+// Limits the iterator to paths that may have at least one of a set of
+// actions. Each call adds an action to the set. Paths whose summary has
+// none of the actions are skipped without reading their paths. This must be
+// set before the source.
+//
+// iterator  - The iterator.
+// action_id - The action identifier.
+//
+// Returns nothing.
+void sky_path_iterator_add_action(sky_path_iterator *iterator,
+                                  sky_action_id_t action_id)
+{
+    assert(iterator != NULL);
+    iterator->has_actions = true;
+    sky_tablet_summary_set_action(iterator->actions, action_id);
+}
+
+// Starts each path at its latest checkpoint before the start of the
+// iterator's time range. The object state is restored from the checkpoint
+// and earlier events are skipped without being read so callers must not
+// depend on events before the time range. Paths without a checkpoint are
+// read in full. This must be set after the time range and before the
+// source.
+//
+// iterator - The iterator.
+//
+// Returns nothing.
+void sky_path_iterator_enable_seek(sky_path_iterator *iterator)
+{
+    assert(iterator != NULL);
+    if(iterator->has_time_range) {
+        iterator->path.seek = true;
+        iterator->path.seek_ts = sky_timestamp_shift((int64_t)iterator->min_timestamp * 1000000LL);
+    }
+}
+
+// Checks if a path can be skipped based on its summary. The summary is read
+// from the segment entry's records for paths that are only held in the
+// segment and from the LevelDB iterator's current position otherwise. Paths
+// without a summary are never skipped.
+//
+// iterator - The iterator.
+// entry    - The segment entry of a path only held in the segment or null.
+// skip     - A pointer to where the result should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_path_iterator_prune(sky_path_iterator *iterator,
+                                   sky_segment_entry *entry, bool *skip)
+{
+    int rc;
+    const void *value;
+    size_t value_length;
+    sky_tablet_summary summary;
+
+    *skip = false;
+    if(entry != NULL) {
+        bool found;
+        sky_segment_record record;
+        rc = sky_segment_find_record(iterator->tablet->segment, entry, SKY_TABLET_KEY_TYPE_SUMMARY, 0, &record, &found);
+        check(rc == 0, "Unable to find segment record");
+        if(!found) {
+            return 0;
+        }
+        value = record.value;
+        value_length = record.value_length;
+    }
+    else {
+        uint8_t key_type;
+        size_t key_length;
+        const char *key = leveldb_iter_key(iterator->leveldb_iterator, &key_length);
+        rc = sky_tablet_key_parse(key, key_length, NULL, &key_type, NULL);
+        check(rc == 0, "Invalid tablet key");
+        if(key_type != SKY_TABLET_KEY_TYPE_SUMMARY) {
+            return 0;
+        }
+        value = leveldb_iter_value(iterator->leveldb_iterator, &value_length);
+    }
+
+    rc = sky_tablet_summary_unpack(&summary, value, value_length);
+    check(rc == 0, "Unable to unpack path summary");
+    if(summary.event_count == 0) {
+        return 0;
+    }
+
+    if(iterator->has_time_range) {
+        int64_t min_timestamp = sky_timestamp_to_seconds(summary.min_ts);
+        int64_t max_timestamp = sky_timestamp_to_seconds(summary.max_ts);
+
+        // Cursors truncate timestamps to 32 bits so paths outside of that
+        // range are always read.
+        if(min_timestamp >= 0 && max_timestamp <= UINT32_MAX) {
+            if(max_timestamp < iterator->min_timestamp || min_timestamp > iterator->max_timestamp) {
+                *skip = true;
+            }
+        }
+    }
+    if(iterator->has_actions && !sky_tablet_summary_has_any_action(&summary, iterator->actions)) {
+        *skip = true;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
 
 //--------------------------------------
 // Iteration
 //--------------------------------------
 
-// Moves the iterator to point to the next path.
+// Compares an object id against the end of the iterator's range.
+//
+// iterator         - The iterator.
+// object_id        - The object id.
+// object_id_length - The length of the object id.
+//
+// Returns a negative number if the object id sorts before the end, zero if
+// it is equal and a positive number if it sorts after the end.
+static int sky_path_iterator_compare_end(sky_path_iterator *iterator,
+                                         const char *object_id,
+                                         size_t object_id_length)
+{
+    size_t end_length = blength(iterator->end);
+    size_t length = (object_id_length < end_length ? object_id_length : end_length);
+    int rc = memcmp(object_id, bdatae(iterator->end, ""), length);
+    if(rc != 0) {
+        return rc;
+    }
+    else if(object_id_length == end_length) {
+        return 0;
+    }
+    else {
+        return (object_id_length < end_length ? -1 : 1);
+    }
+}
+
+// Moves the iterator to point to the next path. Paths are read from the
+// tablet's segment and from LevelDB in object order. Paths that only exist
+// in the segment or that are held in a single chunk are read in place.
+// Otherwise the chunks of the path are stitched together into a buffer owned
+// by the iterator so the cursor can move across the full path.
 // 
 // iterator - The iterator.
 //
@@ -119,26 +335,128 @@ int sky_path_iterator_next(sky_path_iterator *iterator)
     assert(iterator->tablet != NULL);
     assert(iterator->leveldb_iterator != NULL);
 
-    // Move to next path.
-    if(leveldb_iter_valid(iterator->leveldb_iterator)) {
-        // Retrieve the path data for this object.
-        size_t data_length;
-        void *data = (void*)leveldb_iter_value(iterator->leveldb_iterator, &data_length);
-        
+    sky_segment *segment = iterator->tablet->segment;
+    leveldb_iterator_t *leveldb_iterator = iterator->leveldb_iterator;
+
+    // Move past the previous path if it was read in place.
+    rc = sky_tablet_path_release(&iterator->path, leveldb_iterator);
+    check(rc == 0, "Unable to release path");
+
+    // Move to the next non-empty path.
+    iterator->eof = true;
+    while(leveldb_iter_valid(leveldb_iterator) || iterator->segment_index < segment->entry_count) {
+        // Determine which source has the next object.
+        int cmp = -1;
+        const char *key = NULL;
+        size_t key_length, object_id_length = 0;
+        if(leveldb_iter_valid(leveldb_iterator)) {
+            key = leveldb_iter_key(leveldb_iterator, &key_length);
+            rc = sky_tablet_key_parse(key, key_length, &object_id_length, NULL, NULL);
+            check(rc == 0, "Invalid tablet key");
+            cmp = 1;
+        }
+        if(key != NULL && iterator->segment_index < segment->entry_count) {
+            cmp = sky_segment_compare(segment, &segment->entries[iterator->segment_index], key, object_id_length);
+        }
+
+        // Stop once the next object is past the end of the range.
+        if(iterator->end != NULL) {
+            if(cmp < 0) {
+                sky_segment_entry *entry = &segment->entries[iterator->segment_index];
+                key = sky_segment_get_object_id(segment, entry);
+                object_id_length = entry->object_id_length;
+            }
+            if(sky_path_iterator_compare_end(iterator, key, object_id_length) >= 0) {
+                break;
+            }
+        }
+
+        // Skip objects that are not in the sample.
+        if(iterator->sampled) {
+            const char *object_id = key;
+            size_t length = object_id_length;
+            if(cmp < 0) {
+                sky_segment_entry *entry = &segment->entries[iterator->segment_index];
+                object_id = sky_segment_get_object_id(segment, entry);
+                length = entry->object_id_length;
+            }
+            iterator->sample_hash = sky_sample_hash(object_id, length);
+            if(iterator->sample_hash >= iterator->sample_threshold) {
+                if(cmp <= 0) {
+                    iterator->segment_index++;
+                }
+                if(cmp >= 0) {
+                    rc = sky_tablet_path_skip(&iterator->path, leveldb_iterator);
+                    check(rc == 0, "Unable to skip path");
+                }
+                continue;
+            }
+        }
+
+        // Skip paths whose summary shows that none of their events can match.
+        if(iterator->has_time_range || iterator->has_actions) {
+            bool skip;
+            rc = sky_path_iterator_prune(iterator, (cmp < 0 ? &segment->entries[iterator->segment_index] : NULL), &skip);
+            check(rc == 0, "Unable to check path summary");
+            if(skip) {
+                if(cmp <= 0) {
+                    iterator->segment_index++;
+                }
+                if(cmp >= 0) {
+                    rc = sky_tablet_path_skip(&iterator->path, leveldb_iterator);
+                    check(rc == 0, "Unable to skip path");
+                }
+                continue;
+            }
+        }
+
+        void *data = NULL;
+        size_t data_length = 0;
+        if(cmp < 0) {
+            sky_segment_entry *entry = &segment->entries[iterator->segment_index++];
+            data = sky_segment_get_data(segment, entry);
+            data_length = entry->data_length;
+            rc = sky_tablet_path_read_segment_checkpoint(iterator->tablet, &iterator->path, entry);
+            check(rc == 0, "Unable to read checkpoint");
+        }
+        else {
+            // Retrieve the path data for this object. This moves the LevelDB
+            // iterator to the next object.
+            sky_segment_entry *entry = (cmp == 0 ? &segment->entries[iterator->segment_index++] : NULL);
+            rc = sky_tablet_path_read(&iterator->path, leveldb_iterator);
+            check(rc == 0, "Unable to read path");
+
+            // Paths held in place leave their checkpoint to be read with a
+            // separate iterator.
+            if(iterator->path.checkpoint_pending) {
+                if(iterator->checkpoint_iterator == NULL) {
+                    iterator->checkpoint_iterator = leveldb_create_iterator(iterator->tablet->leveldb_db, iterator->tablet->readoptions);
+                    check(iterator->checkpoint_iterator != NULL, "Unable to create LevelDB iterator");
+                }
+                rc = sky_tablet_path_read_checkpoint(&iterator->path, iterator->checkpoint_iterator);
+                check(rc == 0, "Unable to read checkpoint");
+            }
+            rc = sky_tablet_path_apply_segment(iterator->tablet, &iterator->path, entry, &data, &data_length);
+            check(rc == 0, "Unable to apply segment to path");
+        }
+
         // Set the pointer on the cursor.
-        rc = sky_cursor_set_ptr(&iterator->cursor, data, data_length);
-        check(rc == 0, "Unable to set cursor pointer");
+        if(data_length > 0) {
+            rc = sky_cursor_set_ptr(&iterator->cursor, data, data_length);
+            check(rc == 0, "Unable to set cursor pointer");
 
-        // Move to the next object.
-        leveldb_iter_next(iterator->leveldb_iterator);
-        
-        if(leveldb_iter_valid(iterator->leveldb_iterator)) {
+            // Resume from the checkpoint if one was found.
+            if(iterator->path.has_checkpoint) {
+                sky_tablet_checkpoint *checkpoint = &iterator->path.checkpoint;
+                rc = sky_cursor_set_state(&iterator->cursor, checkpoint->state, checkpoint->state_length);
+                check(rc == 0, "Unable to restore checkpoint state");
+                rc = sky_cursor_seek(&iterator->cursor, checkpoint->ts);
+                check(rc == 0, "Unable to seek to checkpoint");
+            }
             iterator->eof = false;
+            break;
         }
     }
-    else {
-        iterator->eof = true;
-    }
 
     return 0;
     
@@ -8,6 +8,7 @@
 #include "bstring.h"
 #include "tablet.h"
 #include "cursor.h"
+#include "sample.h"
 
 
 //==============================================================================
@@ -19,8 +20,20 @@
 typedef struct sky_path_iterator {
     sky_tablet *tablet;
     leveldb_iterator_t* leveldb_iterator;
+    leveldb_iterator_t* checkpoint_iterator;
+    uint64_t segment_index;
+    bstring end;
     bool running;
     bool eof;
+    bool sampled;
+    uint64_t sample_threshold;
+    uint32_t sample_hash;
+    bool has_time_range;
+    uint32_t min_timestamp;
+    uint32_t max_timestamp;
+    bool has_actions;
+    uint8_t actions[SKY_TABLET_SUMMARY_ACTION_BYTES];
+    sky_tablet_path path;
     sky_cursor cursor;
 } sky_path_iterator;
 
@@ -52,6 +65,24 @@ void sky_path_iterator_free(sky_path_iterator *iterator);
 int sky_path_iterator_set_tablet(sky_path_iterator *iterator,
     sky_tablet *tablet);
 
+int sky_path_iterator_set_range(sky_path_iterator *iterator,
+    sky_tablet *tablet, bstring start, bstring end);
+
+void sky_path_iterator_set_sample_rate(sky_path_iterator *iterator,
+    double rate);
+
+//--------------------------------------
+// Pruning
+//--------------------------------------
+
+void sky_path_iterator_set_time_range(sky_path_iterator *iterator,
+    uint32_t min_timestamp, uint32_t max_timestamp);
+
+void sky_path_iterator_add_action(sky_path_iterator *iterator,
+    sky_action_id_t action_id);
+
+void sky_path_iterator_enable_seek(sky_path_iterator *iterator);
+
 //--------------------------------------
 // Iteration
 //--------------------------------------
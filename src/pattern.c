@@ -0,0 +1,1002 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "pattern.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The maximum number of NFA states that a pattern can expand to.
+#define SKY_PATTERN_MAX_NFA_STATE_COUNT 4096
+
+// The maximum bound on a counted repetition.
+#define SKY_PATTERN_MAX_REPEAT 255
+
+// The maximum number of distinct action classes. This is limited by the
+// size of an entry in the class map.
+#define SKY_PATTERN_MAX_CLASS_COUNT 256
+
+// The upper bound of a repetition without a limit.
+#define SKY_PATTERN_UNBOUNDED -1
+
+
+//--------------------------------------
+// Syntax Tree
+//--------------------------------------
+
+typedef enum {
+    SKY_PATTERN_NODE_ACTION = 1,
+    SKY_PATTERN_NODE_ANY    = 2,
+    SKY_PATTERN_NODE_SEQ    = 3,
+    SKY_PATTERN_NODE_ALT    = 4,
+    SKY_PATTERN_NODE_REPEAT = 5,
+} sky_pattern_node_type_e;
+
+// A node in the parsed pattern. Children are referenced by their index in
+// the compiler's node list.
+typedef struct {
+    sky_pattern_node_type_e type;
+    sky_action_id_t action_id;
+    int32_t lhs;
+    int32_t rhs;
+    int32_t min;
+    int32_t max;
+} sky_pattern_node;
+
+
+//--------------------------------------
+// NFA
+//--------------------------------------
+
+typedef enum {
+    SKY_PATTERN_NFA_ACTION  = 1,
+    SKY_PATTERN_NFA_ANY     = 2,
+    SKY_PATTERN_NFA_SPLIT   = 3,
+    SKY_PATTERN_NFA_EPSILON = 4,
+    SKY_PATTERN_NFA_MATCH   = 5,
+} sky_pattern_nfa_type_e;
+
+// A state in the NFA. Action and any states move to `out` on a matching
+// event. Split and epsilon states move to their outputs without one.
+typedef struct {
+    sky_pattern_nfa_type_e type;
+    sky_action_id_t action_id;
+    int32_t out;
+    int32_t out1;
+} sky_pattern_nfa_state;
+
+// A partially built piece of the NFA. The end is always an epsilon state
+// whose output has not been set yet.
+typedef struct {
+    int32_t start;
+    int32_t end;
+} sky_pattern_fragment;
+
+
+//--------------------------------------
+// Compiler
+//--------------------------------------
+
+typedef struct {
+    const char *ptr;
+    const char *end;
+    sky_pattern_node *nodes;
+    uint32_t node_count;
+    sky_pattern_nfa_state *states;
+    uint32_t state_count;
+    uint32_t within;
+} sky_pattern_compiler;
+
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+static int sky_pattern_parse_alt(sky_pattern_compiler *compiler,
+    int32_t *ret);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a pattern.
+//
+// Returns a new pattern.
+sky_pattern *sky_pattern_create()
+{
+    sky_pattern *pattern = NULL;
+    pattern = calloc(1, sizeof(sky_pattern)); check_mem(pattern);
+    return pattern;
+
+error:
+    sky_pattern_free(pattern);
+    return NULL;
+}
+
+// Frees a pattern from memory.
+//
+// pattern - The pattern.
+//
+// Returns nothing.
+void sky_pattern_free(sky_pattern *pattern)
+{
+    if(pattern) {
+        bdestroy(pattern->source);
+        pattern->source = NULL;
+        free(pattern->classes);
+        pattern->classes = NULL;
+        free(pattern->transitions);
+        pattern->transitions = NULL;
+        free(pattern->accepting);
+        pattern->accepting = NULL;
+        free(pattern);
+    }
+}
+
+
+//--------------------------------------
+// Parsing
+//--------------------------------------
+
+// Skips over whitespace and commas between terms.
+//
+// compiler - The compiler.
+//
+// Returns nothing.
+static void sky_pattern_skip_whitespace(sky_pattern_compiler *compiler)
+{
+    while(compiler->ptr < compiler->end && (isspace(*compiler->ptr) || *compiler->ptr == ',')) {
+        compiler->ptr++;
+    }
+}
+
+// Checks if the parser is at the 'within' keyword.
+//
+// compiler - The compiler.
+//
+// Returns true if the next token is 'within', otherwise returns false.
+static bool sky_pattern_at_within(sky_pattern_compiler *compiler)
+{
+    size_t len = strlen("within");
+    return ((size_t)(compiler->end - compiler->ptr) >= len && strncmp(compiler->ptr, "within", len) == 0);
+}
+
+// Parses an unsigned integer.
+//
+// compiler - The compiler.
+// ret      - A pointer to where the number should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_parse_number(sky_pattern_compiler *compiler,
+                                    uint32_t *ret)
+{
+    uint64_t value = 0;
+    check(compiler->ptr < compiler->end && isdigit(*compiler->ptr), "Number expected in pattern");
+    while(compiler->ptr < compiler->end && isdigit(*compiler->ptr)) {
+        value = (value * 10) + (*compiler->ptr - '0');
+        check(value <= UINT32_MAX, "Number too large in pattern");
+        compiler->ptr++;
+    }
+    *ret = (uint32_t)value;
+    return 0;
+
+error:
+    *ret = 0;
+    return -1;
+}
+
+// Adds a node to the syntax tree.
+//
+// compiler - The compiler.
+// type     - The node type.
+// lhs      - The index of the first child or -1.
+// rhs      - The index of the second child or -1.
+// ret      - A pointer to where the node index should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_add_node(sky_pattern_compiler *compiler,
+                                sky_pattern_node_type_e type,
+                                int32_t lhs, int32_t rhs, int32_t *ret)
+{
+    compiler->nodes = realloc(compiler->nodes, (compiler->node_count+1) * sizeof(*compiler->nodes));
+    check_mem(compiler->nodes);
+
+    sky_pattern_node *node = &compiler->nodes[compiler->node_count];
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    node->lhs = lhs;
+    node->rhs = rhs;
+    *ret = (int32_t)compiler->node_count++;
+    return 0;
+
+error:
+    *ret = -1;
+    return -1;
+}
+
+// Parses a single action, the any action or a parenthesized pattern.
+//
+// compiler - The compiler.
+// ret      - A pointer to where the node index should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_parse_atom(sky_pattern_compiler *compiler,
+                                  int32_t *ret)
+{
+    int rc;
+    char c = *compiler->ptr;
+
+    if(isdigit(c)) {
+        uint32_t action_id = 0;
+        rc = sky_pattern_parse_number(compiler, &action_id);
+        check(rc == 0, "Unable to parse action id");
+        check(action_id > 0 && action_id <= UINT16_MAX, "Invalid action id in pattern: %d", action_id);
+        rc = sky_pattern_add_node(compiler, SKY_PATTERN_NODE_ACTION, -1, -1, ret);
+        check(rc == 0, "Unable to add action node");
+        compiler->nodes[*ret].action_id = (sky_action_id_t)action_id;
+    }
+    else if(c == '.') {
+        compiler->ptr++;
+        rc = sky_pattern_add_node(compiler, SKY_PATTERN_NODE_ANY, -1, -1, ret);
+        check(rc == 0, "Unable to add any node");
+    }
+    else if(c == '(') {
+        compiler->ptr++;
+        rc = sky_pattern_parse_alt(compiler, ret);
+        check(rc == 0, "Unable to parse group");
+        sky_pattern_skip_whitespace(compiler);
+        check(compiler->ptr < compiler->end && *compiler->ptr == ')', "Unbalanced parenthesis in pattern");
+        compiler->ptr++;
+    }
+    else {
+        sentinel("Unexpected character in pattern: '%c'", c);
+    }
+
+    return 0;
+
+error:
+    *ret = -1;
+    return -1;
+}
+
+// Parses an atom followed by any number of repetition operators.
+//
+// compiler - The compiler.
+// ret      - A pointer to where the node index should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_parse_repeat(sky_pattern_compiler *compiler,
+                                    int32_t *ret)
+{
+    int rc;
+    int32_t index = -1;
+
+    rc = sky_pattern_parse_atom(compiler, &index);
+    check(rc == 0, "Unable to parse atom");
+
+    while(compiler->ptr < compiler->end) {
+        int32_t min, max;
+        char c = *compiler->ptr;
+        if(c == '*') {
+            min = 0; max = SKY_PATTERN_UNBOUNDED;
+            compiler->ptr++;
+        }
+        else if(c == '+') {
+            min = 1; max = SKY_PATTERN_UNBOUNDED;
+            compiler->ptr++;
+        }
+        else if(c == '?') {
+            min = 0; max = 1;
+            compiler->ptr++;
+        }
+        else if(c == '{') {
+            uint32_t value = 0;
+            compiler->ptr++;
+            rc = sky_pattern_parse_number(compiler, &value);
+            check(rc == 0, "Unable to parse repetition minimum");
+            min = max = (int32_t)value;
+            if(compiler->ptr < compiler->end && *compiler->ptr == ',') {
+                compiler->ptr++;
+                max = SKY_PATTERN_UNBOUNDED;
+                if(compiler->ptr < compiler->end && isdigit(*compiler->ptr)) {
+                    rc = sky_pattern_parse_number(compiler, &value);
+                    check(rc == 0, "Unable to parse repetition maximum");
+                    max = (int32_t)value;
+                }
+            }
+            check(compiler->ptr < compiler->end && *compiler->ptr == '}', "Unterminated repetition in pattern");
+            compiler->ptr++;
+            check(min <= SKY_PATTERN_MAX_REPEAT && max <= SKY_PATTERN_MAX_REPEAT, "Repetition too large in pattern");
+            check(max == SKY_PATTERN_UNBOUNDED || min <= max, "Invalid repetition range in pattern");
+        }
+        else {
+            break;
+        }
+
+        int32_t child = index;
+        rc = sky_pattern_add_node(compiler, SKY_PATTERN_NODE_REPEAT, child, -1, &index);
+        check(rc == 0, "Unable to add repeat node");
+        compiler->nodes[index].min = min;
+        compiler->nodes[index].max = max;
+    }
+
+    *ret = index;
+    return 0;
+
+error:
+    *ret = -1;
+    return -1;
+}
+
+// Parses a sequence of terms.
+//
+// compiler - The compiler.
+// ret      - A pointer to where the node index should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_parse_seq(sky_pattern_compiler *compiler,
+                                 int32_t *ret)
+{
+    int rc;
+    int32_t index = -1;
+
+    while(true) {
+        sky_pattern_skip_whitespace(compiler);
+        if(compiler->ptr == compiler->end || *compiler->ptr == ')' || *compiler->ptr == '|' || sky_pattern_at_within(compiler)) {
+            break;
+        }
+
+        int32_t term = -1;
+        rc = sky_pattern_parse_repeat(compiler, &term);
+        check(rc == 0, "Unable to parse term");
+
+        if(index == -1) {
+            index = term;
+        }
+        else {
+            int32_t lhs = index;
+            rc = sky_pattern_add_node(compiler, SKY_PATTERN_NODE_SEQ, lhs, term, &index);
+            check(rc == 0, "Unable to add sequence node");
+        }
+    }
+    check(index != -1, "Empty pattern");
+
+    *ret = index;
+    return 0;
+
+error:
+    *ret = -1;
+    return -1;
+}
+
+// Parses alternatives separated by a pipe.
+//
+// compiler - The compiler.
+// ret      - A pointer to where the node index should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_parse_alt(sky_pattern_compiler *compiler,
+                                 int32_t *ret)
+{
+    int rc;
+    int32_t index = -1;
+
+    rc = sky_pattern_parse_seq(compiler, &index);
+    check(rc == 0, "Unable to parse alternative");
+
+    while(compiler->ptr < compiler->end && *compiler->ptr == '|') {
+        compiler->ptr++;
+        int32_t rhs = -1;
+        rc = sky_pattern_parse_seq(compiler, &rhs);
+        check(rc == 0, "Unable to parse alternative");
+
+        int32_t lhs = index;
+        rc = sky_pattern_add_node(compiler, SKY_PATTERN_NODE_ALT, lhs, rhs, &index);
+        check(rc == 0, "Unable to add alternation node");
+    }
+
+    *ret = index;
+    return 0;
+
+error:
+    *ret = -1;
+    return -1;
+}
+
+
+//--------------------------------------
+// NFA Construction
+//--------------------------------------
+
+// Adds a state to the NFA.
+//
+// compiler - The compiler.
+// type     - The state type.
+// ret      - A pointer to where the state index should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_add_nfa_state(sky_pattern_compiler *compiler,
+                                     sky_pattern_nfa_type_e type,
+                                     int32_t *ret)
+{
+    check(compiler->state_count < SKY_PATTERN_MAX_NFA_STATE_COUNT, "Pattern too large");
+    compiler->states = realloc(compiler->states, (compiler->state_count+1) * sizeof(*compiler->states));
+    check_mem(compiler->states);
+
+    sky_pattern_nfa_state *state = &compiler->states[compiler->state_count];
+    memset(state, 0, sizeof(*state));
+    state->type = type;
+    state->out = -1;
+    state->out1 = -1;
+    *ret = (int32_t)compiler->state_count++;
+    return 0;
+
+error:
+    *ret = -1;
+    return -1;
+}
+
+// Creates a fragment that matches an empty sequence.
+//
+// compiler - The compiler.
+// ret      - A pointer to where the fragment should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_empty_fragment(sky_pattern_compiler *compiler,
+                                      sky_pattern_fragment *ret)
+{
+    int rc;
+    int32_t index = -1;
+    rc = sky_pattern_add_nfa_state(compiler, SKY_PATTERN_NFA_EPSILON, &index);
+    check(rc == 0, "Unable to add epsilon state");
+    ret->start = ret->end = index;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Wraps a fragment so that it matches once or not at all or, if `loop` is
+// set, any number of times.
+//
+// compiler - The compiler.
+// fragment - The fragment to wrap.
+// loop     - A flag stating if the fragment can repeat.
+// ret      - A pointer to where the new fragment should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_optional_fragment(sky_pattern_compiler *compiler,
+                                         sky_pattern_fragment fragment,
+                                         bool loop,
+                                         sky_pattern_fragment *ret)
+{
+    int rc;
+    int32_t split = -1, end = -1;
+    rc = sky_pattern_add_nfa_state(compiler, SKY_PATTERN_NFA_EPSILON, &end);
+    check(rc == 0, "Unable to add epsilon state");
+    rc = sky_pattern_add_nfa_state(compiler, SKY_PATTERN_NFA_SPLIT, &split);
+    check(rc == 0, "Unable to add split state");
+    compiler->states[split].out = fragment.start;
+    compiler->states[split].out1 = end;
+    compiler->states[fragment.end].out = (loop ? split : end);
+    ret->start = split;
+    ret->end = end;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Builds the NFA fragment for a node in the syntax tree.
+//
+// compiler - The compiler.
+// index    - The node index.
+// ret      - A pointer to where the fragment should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_build_fragment(sky_pattern_compiler *compiler,
+                                      int32_t index,
+                                      sky_pattern_fragment *ret)
+{
+    int rc;
+    int32_t i;
+    sky_pattern_node node = compiler->nodes[index];
+    sky_pattern_fragment lhs, rhs;
+
+    switch(node.type) {
+        case SKY_PATTERN_NODE_ACTION:
+        case SKY_PATTERN_NODE_ANY: {
+            int32_t start = -1;
+            rc = sky_pattern_add_nfa_state(compiler, (node.type == SKY_PATTERN_NODE_ACTION ? SKY_PATTERN_NFA_ACTION : SKY_PATTERN_NFA_ANY), &start);
+            check(rc == 0, "Unable to add action state");
+            compiler->states[start].action_id = node.action_id;
+            rc = sky_pattern_empty_fragment(compiler, &lhs);
+            check(rc == 0, "Unable to add action fragment end");
+            compiler->states[start].out = lhs.start;
+            ret->start = start;
+            ret->end = lhs.end;
+            break;
+        }
+
+        case SKY_PATTERN_NODE_SEQ: {
+            rc = sky_pattern_build_fragment(compiler, node.lhs, &lhs);
+            check(rc == 0, "Unable to build sequence");
+            rc = sky_pattern_build_fragment(compiler, node.rhs, &rhs);
+            check(rc == 0, "Unable to build sequence");
+            compiler->states[lhs.end].out = rhs.start;
+            ret->start = lhs.start;
+            ret->end = rhs.end;
+            break;
+        }
+
+        case SKY_PATTERN_NODE_ALT: {
+            int32_t split = -1, end = -1;
+            rc = sky_pattern_build_fragment(compiler, node.lhs, &lhs);
+            check(rc == 0, "Unable to build alternative");
+            rc = sky_pattern_build_fragment(compiler, node.rhs, &rhs);
+            check(rc == 0, "Unable to build alternative");
+            rc = sky_pattern_add_nfa_state(compiler, SKY_PATTERN_NFA_SPLIT, &split);
+            check(rc == 0, "Unable to add split state");
+            rc = sky_pattern_add_nfa_state(compiler, SKY_PATTERN_NFA_EPSILON, &end);
+            check(rc == 0, "Unable to add epsilon state");
+            compiler->states[split].out = lhs.start;
+            compiler->states[split].out1 = rhs.start;
+            compiler->states[lhs.end].out = end;
+            compiler->states[rhs.end].out = end;
+            ret->start = split;
+            ret->end = end;
+            break;
+        }
+
+        // Repetitions are expanded into the required copies followed by
+        // optional copies or a single loop if there is no upper bound.
+        case SKY_PATTERN_NODE_REPEAT: {
+            rc = sky_pattern_empty_fragment(compiler, ret);
+            check(rc == 0, "Unable to build repetition");
+
+            int32_t copies = (node.max == SKY_PATTERN_UNBOUNDED ? node.min + 1 : node.max);
+            for(i=0; i<copies; i++) {
+                rc = sky_pattern_build_fragment(compiler, node.lhs, &rhs);
+                check(rc == 0, "Unable to build repetition");
+                if(i >= node.min) {
+                    rc = sky_pattern_optional_fragment(compiler, rhs, node.max == SKY_PATTERN_UNBOUNDED, &rhs);
+                    check(rc == 0, "Unable to build repetition");
+                }
+                compiler->states[ret->end].out = rhs.start;
+                ret->end = rhs.end;
+            }
+            break;
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// DFA Construction
+//--------------------------------------
+
+// Adds every state reachable without consuming an event to a set of NFA
+// states.
+//
+// compiler - The compiler.
+// set      - The set of NFA states.
+// stack    - A work list with room for every NFA state.
+//
+// Returns nothing.
+static void sky_pattern_closure(sky_pattern_compiler *compiler, uint64_t *set,
+                                int32_t *stack)
+{
+    uint32_t i, count = 0;
+    for(i=0; i<compiler->state_count; i++) {
+        if(set[i/64] & (1ULL << (i%64))) {
+            stack[count++] = (int32_t)i;
+        }
+    }
+
+    while(count > 0) {
+        sky_pattern_nfa_state *state = &compiler->states[stack[--count]];
+        if(state->type == SKY_PATTERN_NFA_SPLIT || state->type == SKY_PATTERN_NFA_EPSILON) {
+            int32_t outs[2] = {state->out, state->out1};
+            for(i=0; i<2; i++) {
+                int32_t out = outs[i];
+                if(out >= 0 && !(set[out/64] & (1ULL << (out%64)))) {
+                    set[out/64] |= (1ULL << (out%64));
+                    stack[count++] = out;
+                }
+            }
+        }
+    }
+}
+
+// Converts the NFA into a DFA using subset construction. Each DFA state is
+// a set of NFA states. If the DFA is unanchored then the start state is
+// added to every set so that a match can begin at any event.
+//
+// compiler  - The compiler.
+// start     - The NFA start state.
+// match     - The NFA match state.
+// anchored  - A flag stating if matches must begin with the first event.
+// pattern   - The pattern to store the DFA on.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_pattern_build_dfa(sky_pattern_compiler *compiler,
+                                 int32_t start, int32_t match, bool anchored,
+                                 sky_pattern *pattern)
+{
+    uint32_t i, j, k;
+    uint32_t word_count = (compiler->state_count + 63) / 64;
+    size_t set_sz = word_count * sizeof(uint64_t);
+    uint64_t *sets = NULL;
+    uint64_t *next = NULL;
+    int32_t *stack = NULL;
+    sky_action_id_t class_ids[SKY_PATTERN_MAX_CLASS_COUNT];
+
+    // Every action id mentioned in the pattern gets its own class. All other
+    // actions share class zero.
+    uint32_t class_count = 1;
+    uint32_t max_action_id = 0;
+    for(i=0; i<compiler->state_count; i++) {
+        if(compiler->states[i].type == SKY_PATTERN_NFA_ACTION) {
+            sky_action_id_t action_id = compiler->states[i].action_id;
+            for(j=1; j<class_count; j++) {
+                if(class_ids[j] == action_id) break;
+            }
+            if(j == class_count) {
+                check(class_count < SKY_PATTERN_MAX_CLASS_COUNT, "Too many distinct actions in pattern");
+                class_ids[class_count++] = action_id;
+                if(action_id > max_action_id) max_action_id = action_id;
+            }
+        }
+    }
+    pattern->class_count = class_count;
+    pattern->class_map_size = max_action_id + 1;
+    pattern->classes = calloc(pattern->class_map_size, sizeof(*pattern->classes));
+    check_mem(pattern->classes);
+    for(j=1; j<class_count; j++) {
+        pattern->classes[class_ids[j]] = (uint8_t)j;
+    }
+
+    stack = calloc(compiler->state_count, sizeof(*stack)); check_mem(stack);
+    next = calloc(1, set_sz); check_mem(next);
+
+    // State zero is the dead state and state one is the start state.
+    uint32_t state_count = 2;
+    sets = calloc(state_count, set_sz); check_mem(sets);
+    uint64_t *start_set = &sets[word_count];
+    start_set[start/64] |= (1ULL << (start%64));
+    sky_pattern_closure(compiler, start_set, stack);
+    check(!(start_set[match/64] & (1ULL << (match%64))), "Pattern cannot match an empty sequence");
+
+    pattern->transitions = calloc(state_count * class_count, sizeof(*pattern->transitions));
+    check_mem(pattern->transitions);
+    pattern->accepting = calloc(state_count, sizeof(*pattern->accepting));
+    check_mem(pattern->accepting);
+
+    for(i=1; i<state_count; i++) {
+        for(k=0; k<class_count; k++) {
+            // Move every NFA state in the set on the class.
+            memset(next, 0, set_sz);
+            uint64_t *set = &sets[i*word_count];
+            for(j=0; j<compiler->state_count; j++) {
+                if(set[j/64] & (1ULL << (j%64))) {
+                    sky_pattern_nfa_state *state = &compiler->states[j];
+                    if(state->type == SKY_PATTERN_NFA_ANY || (state->type == SKY_PATTERN_NFA_ACTION && k > 0 && state->action_id == class_ids[k])) {
+                        next[state->out/64] |= (1ULL << (state->out%64));
+                    }
+                }
+            }
+            if(!anchored) {
+                next[start/64] |= (1ULL << (start%64));
+            }
+            sky_pattern_closure(compiler, next, stack);
+
+            // Find the DFA state for the set or add a new one.
+            uint32_t target = SKY_PATTERN_DEAD_STATE;
+            for(j=0; j<set_sz/sizeof(uint64_t); j++) {
+                if(next[j] != 0) break;
+            }
+            if(j < word_count) {
+                for(target=1; target<state_count; target++) {
+                    if(memcmp(&sets[target*word_count], next, set_sz) == 0) break;
+                }
+                if(target == state_count) {
+                    check(state_count < SKY_PATTERN_MAX_STATE_COUNT, "Pattern too complex");
+                    state_count++;
+                    sets = realloc(sets, state_count * set_sz); check_mem(sets);
+                    memcpy(&sets[target*word_count], next, set_sz);
+                    pattern->transitions = realloc(pattern->transitions, state_count * class_count * sizeof(*pattern->transitions));
+                    check_mem(pattern->transitions);
+                    memset(&pattern->transitions[target*class_count], 0, class_count * sizeof(*pattern->transitions));
+                    pattern->accepting = realloc(pattern->accepting, state_count * sizeof(*pattern->accepting));
+                    check_mem(pattern->accepting);
+                    pattern->accepting[target] = ((next[match/64] & (1ULL << (match%64))) != 0);
+                }
+            }
+            pattern->transitions[i*class_count + k] = target;
+        }
+    }
+
+    pattern->state_count = state_count;
+    pattern->start_state = 1;
+
+    free(sets);
+    free(next);
+    free(stack);
+    return 0;
+
+error:
+    free(sets);
+    free(next);
+    free(stack);
+    return -1;
+}
+
+
+//--------------------------------------
+// Compilation
+//--------------------------------------
+
+// Compiles a pattern from its source.
+//
+// pattern - The pattern.
+// source  - The pattern source.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_pattern_compile(sky_pattern *pattern, bstring source)
+{
+    int rc;
+    int32_t root = -1, match = -1;
+    sky_pattern_fragment fragment;
+    sky_pattern_compiler compiler;
+    memset(&compiler, 0, sizeof(compiler));
+    check(pattern != NULL, "Pattern required");
+    check(pattern->transitions == NULL, "Pattern already compiled");
+    check(blength(source) > 0, "Pattern source required");
+
+    compiler.ptr = bdata(source);
+    compiler.end = compiler.ptr + blength(source);
+
+    // Parse the pattern and the optional time window.
+    rc = sky_pattern_parse_alt(&compiler, &root);
+    check(rc == 0, "Unable to parse pattern: %s", bdata(source));
+    sky_pattern_skip_whitespace(&compiler);
+    if(sky_pattern_at_within(&compiler)) {
+        compiler.ptr += strlen("within");
+        sky_pattern_skip_whitespace(&compiler);
+        rc = sky_pattern_parse_number(&compiler, &compiler.within);
+        check(rc == 0, "Unable to parse pattern window: %s", bdata(source));
+        check(compiler.within > 0, "Pattern window must be positive: %s", bdata(source));
+        sky_pattern_skip_whitespace(&compiler);
+    }
+    check(compiler.ptr == compiler.end, "Unexpected character in pattern: '%c'", *compiler.ptr);
+
+    // Build the NFA and convert it to a DFA.
+    rc = sky_pattern_build_fragment(&compiler, root, &fragment);
+    check(rc == 0, "Unable to build pattern: %s", bdata(source));
+    rc = sky_pattern_add_nfa_state(&compiler, SKY_PATTERN_NFA_MATCH, &match);
+    check(rc == 0, "Unable to add match state");
+    compiler.states[fragment.end].out = match;
+
+    pattern->within = compiler.within;
+    rc = sky_pattern_build_dfa(&compiler, fragment.start, match, compiler.within > 0, pattern);
+    check(rc == 0, "Unable to build pattern DFA: %s", bdata(source));
+
+    pattern->source = bstrcpy(source); check_mem(pattern->source);
+
+    free(compiler.nodes);
+    free(compiler.states);
+    return 0;
+
+error:
+    if(pattern) {
+        free(pattern->classes);
+        pattern->classes = NULL;
+        free(pattern->transitions);
+        pattern->transitions = NULL;
+        free(pattern->accepting);
+        pattern->accepting = NULL;
+        pattern->state_count = 0;
+    }
+    free(compiler.nodes);
+    free(compiler.states);
+    return -1;
+}
+
+// Compiles a pattern that matches an exact sequence of actions.
+//
+// pattern    - The pattern.
+// action_ids - The actions in the sequence.
+// count      - The number of actions.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_pattern_compile_sequence(sky_pattern *pattern,
+                                 sky_action_id_t *action_ids, uint32_t count)
+{
+    int rc;
+    bstring source = NULL;
+    check(count > 0, "At least one action required");
+
+    source = bfromcstr(""); check_mem(source);
+    uint32_t i;
+    for(i=0; i<count; i++) {
+        rc = bformata(source, (i > 0 ? " %d" : "%d"), action_ids[i]);
+        check(rc == BSTR_OK, "Unable to append action to pattern");
+    }
+
+    rc = sky_pattern_compile(pattern, source);
+    check(rc == 0, "Unable to compile sequence");
+
+    bdestroy(source);
+    return 0;
+
+error:
+    bdestroy(source);
+    return -1;
+}
+
+
+//--------------------------------------
+// Matching
+//--------------------------------------
+
+// Initializes a matcher for running a compiled pattern over a path.
+//
+// matcher - The matcher.
+// pattern - The compiled pattern.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_pattern_matcher_init(sky_pattern_matcher *matcher,
+                             sky_pattern *pattern)
+{
+    assert(matcher != NULL);
+    assert(pattern != NULL);
+    memset(matcher, 0, sizeof(*matcher));
+    matcher->pattern = pattern;
+
+    // Runs are only tracked individually when there is a time window.
+    if(pattern->within > 0) {
+        uint32_t count = pattern->state_count;
+        matcher->run_states = calloc(count, sizeof(*matcher->run_states)); check_mem(matcher->run_states);
+        matcher->run_starts = calloc(count, sizeof(*matcher->run_starts)); check_mem(matcher->run_starts);
+        matcher->next_states = calloc(count, sizeof(*matcher->next_states)); check_mem(matcher->next_states);
+        matcher->next_starts = calloc(count, sizeof(*matcher->next_starts)); check_mem(matcher->next_starts);
+        matcher->slots = calloc(count, sizeof(*matcher->slots)); check_mem(matcher->slots);
+    }
+
+    sky_pattern_matcher_reset(matcher);
+    return 0;
+
+error:
+    sky_pattern_matcher_uninit(matcher);
+    return -1;
+}
+
+// Frees the memory used by a matcher.
+//
+// matcher - The matcher.
+//
+// Returns nothing.
+void sky_pattern_matcher_uninit(sky_pattern_matcher *matcher)
+{
+    if(matcher) {
+        free(matcher->run_states);
+        free(matcher->run_starts);
+        free(matcher->next_states);
+        free(matcher->next_starts);
+        free(matcher->slots);
+        memset(matcher, 0, sizeof(*matcher));
+    }
+}
+
+// Resets a matcher to the start of a new path.
+//
+// matcher - The matcher.
+//
+// Returns nothing.
+void sky_pattern_matcher_reset(sky_pattern_matcher *matcher)
+{
+    assert(matcher != NULL);
+    matcher->state = matcher->pattern->start_state;
+    matcher->run_count = 0;
+}
+
+// Adds a run to the next set of runs. If a run is already in the same state
+// then only the latest start time is kept.
+//
+// matcher - The matcher.
+// count   - The number of runs in the next set.
+// state   - The state of the run.
+// start   - The time the run started.
+//
+// Returns the new number of runs.
+static uint32_t sky_pattern_matcher_add_run(sky_pattern_matcher *matcher,
+                                            uint32_t count, uint32_t state,
+                                            uint32_t start)
+{
+    uint32_t slot = matcher->slots[state];
+    if(slot == 0) {
+        matcher->next_states[count] = state;
+        matcher->next_starts[count] = start;
+        matcher->slots[state] = ++count;
+    }
+    else if(matcher->next_starts[slot-1] < start) {
+        matcher->next_starts[slot-1] = start;
+    }
+    return count;
+}
+
+// Advances the matcher by a single event.
+//
+// matcher   - The matcher.
+// action_id - The action of the event.
+// timestamp - The time of the event, in seconds.
+//
+// Returns true if a match ends on the event, otherwise returns false.
+bool sky_pattern_matcher_next(sky_pattern_matcher *matcher,
+                              sky_action_id_t action_id, uint32_t timestamp)
+{
+    uint32_t i;
+    sky_pattern *pattern = matcher->pattern;
+    uint32_t class_count = pattern->class_count;
+    uint32_t *transitions = pattern->transitions;
+    uint32_t cls = (action_id < pattern->class_map_size ? pattern->classes[action_id] : 0);
+
+    // Without a time window the unanchored DFA finds every match.
+    if(pattern->within == 0) {
+        matcher->state = transitions[matcher->state*class_count + cls];
+        return pattern->accepting[matcher->state];
+    }
+
+    // Advance every run that is still inside the window and start a new one.
+    uint32_t count = 0;
+    for(i=0; i<matcher->run_count; i++) {
+        if(timestamp - matcher->run_starts[i] <= pattern->within) {
+            uint32_t state = transitions[matcher->run_states[i]*class_count + cls];
+            if(state != SKY_PATTERN_DEAD_STATE) {
+                count = sky_pattern_matcher_add_run(matcher, count, state, matcher->run_starts[i]);
+            }
+        }
+    }
+    uint32_t state = transitions[pattern->start_state*class_count + cls];
+    if(state != SKY_PATTERN_DEAD_STATE) {
+        count = sky_pattern_matcher_add_run(matcher, count, state, timestamp);
+    }
+
+    bool matched = false;
+    for(i=0; i<count; i++) {
+        matcher->slots[matcher->next_states[i]] = 0;
+        matched = matched || pattern->accepting[matcher->next_states[i]];
+    }
+
+    uint32_t *tmp_states = matcher->run_states;
+    uint32_t *tmp_starts = matcher->run_starts;
+    matcher->run_states = matcher->next_states;
+    matcher->run_starts = matcher->next_starts;
+    matcher->next_states = tmp_states;
+    matcher->next_starts = tmp_starts;
+    matcher->run_count = count;
+
+    return matched;
+}
@@ -0,0 +1,124 @@
+#ifndef _sky_pattern_h
+#define _sky_pattern_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_pattern sky_pattern;
+typedef struct sky_pattern_matcher sky_pattern_matcher;
+
+#include "bstring.h"
+#include "types.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A pattern describes a sequence of actions in a path. Patterns are written
+// as a small regular expression language over action ids:
+//
+//   1 2 3          A sequence of actions.
+//   1 (2|3)        Either of two sub-patterns.
+//   1 2* 3         Zero or more, one or more (+) or zero or one (?) times.
+//   1 2{2,4}       Between two and four times. The upper bound is optional.
+//   1 .* 3         Any action. Gaps between steps are written as repeats
+//                  of any action such as `.*` or `.{0,3}`.
+//   1 2 within 60  The whole match must happen within 60 seconds.
+//
+// A pattern is compiled once into a DFA whose alphabet is the set of action
+// ids that the pattern mentions plus a single class for every other action.
+// Matching an event is a lookup of the action's class followed by a lookup
+// of the next state in the transition table so the cost per event does not
+// depend on how complex the pattern is.
+//
+// Matches are searched for at every event so overlapping matches are all
+// found. When a time window is set the DFA is run once for each start event
+// instead. Runs that land in the same state are merged and only the latest
+// start time is kept since it leaves the most time in the window so the
+// number of runs is bounded by the number of states.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The maximum number of states in a compiled pattern.
+#define SKY_PATTERN_MAX_STATE_COUNT 4096
+
+// The state that no match can continue from.
+#define SKY_PATTERN_DEAD_STATE 0
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_pattern {
+    bstring source;
+    uint32_t within;
+    uint32_t class_count;
+    uint8_t *classes;
+    uint32_t class_map_size;
+    uint32_t state_count;
+    uint32_t start_state;
+    uint32_t *transitions;
+    bool *accepting;
+};
+
+struct sky_pattern_matcher {
+    sky_pattern *pattern;
+    uint32_t state;
+    uint32_t run_count;
+    uint32_t *run_states;
+    uint32_t *run_starts;
+    uint32_t *next_states;
+    uint32_t *next_starts;
+    uint32_t *slots;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_pattern *sky_pattern_create();
+
+void sky_pattern_free(sky_pattern *pattern);
+
+//--------------------------------------
+// Compilation
+//--------------------------------------
+
+int sky_pattern_compile(sky_pattern *pattern, bstring source);
+
+int sky_pattern_compile_sequence(sky_pattern *pattern,
+    sky_action_id_t *action_ids, uint32_t count);
+
+//--------------------------------------
+// Matching
+//--------------------------------------
+
+int sky_pattern_matcher_init(sky_pattern_matcher *matcher,
+    sky_pattern *pattern);
+
+void sky_pattern_matcher_uninit(sky_pattern_matcher *matcher);
+
+void sky_pattern_matcher_reset(sky_pattern_matcher *matcher);
+
+bool sky_pattern_matcher_next(sky_pattern_matcher *matcher,
+    sky_action_id_t action_id, uint32_t timestamp);
+
+#endif
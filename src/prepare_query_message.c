@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "prepare_query_message.h"
+#include "lua_cache.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+//--------------------------------------
+// String Constants
+//--------------------------------------
+
+#define SKY_PREPARE_QUERY_KEY_COUNT 3
+
+struct tagbstring SKY_PREPARE_QUERY_KEY_NAME       = bsStatic("name");
+struct tagbstring SKY_PREPARE_QUERY_KEY_SOURCE     = bsStatic("source");
+struct tagbstring SKY_PREPARE_QUERY_KEY_PARAMETERS = bsStatic("parameters");
+
+struct tagbstring SKY_PREPARE_QUERY_STATUS_STR = bsStatic("status");
+struct tagbstring SKY_PREPARE_QUERY_OK_STR     = bsStatic("ok");
+struct tagbstring SKY_PREPARE_QUERY_HANDLE_STR = bsStatic("handle");
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a 'prepare_query' message object.
+//
+// Returns a new message.
+sky_prepare_query_message *sky_prepare_query_message_create()
+{
+    sky_prepare_query_message *message = NULL;
+    message = calloc(1, sizeof(sky_prepare_query_message)); check_mem(message);
+    message->query = sky_query_create(); check_mem(message->query);
+    return message;
+
+error:
+    sky_prepare_query_message_free(message);
+    return NULL;
+}
+
+// Frees a 'prepare_query' message object from memory. The query is only
+// freed if it has not been registered with a server.
+//
+// message - The message object to be freed.
+//
+// Returns nothing.
+void sky_prepare_query_message_free(sky_prepare_query_message *message)
+{
+    if(message) {
+        if(message->query && message->query->id == 0) {
+            sky_query_free(message->query);
+        }
+        message->query = NULL;
+        free(message);
+    }
+}
+
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+// Creates a message handler for the 'prepare_query' message.
+//
+// Returns a message handler.
+sky_message_handler *sky_prepare_query_message_handler_create()
+{
+    sky_message_handler *handler = sky_message_handler_create(); check_mem(handler);
+    handler->scope = SKY_MESSAGE_HANDLER_SCOPE_TABLE;
+    handler->name = bfromcstr("prepare_query");
+    handler->process = sky_prepare_query_message_process;
+    return handler;
+
+error:
+    sky_message_handler_free(handler);
+    return NULL;
+}
+
+// Compiles a script and registers it with the server as a named query. The
+// compiled script is kept in the server's cache so that the first execution
+// does not have to generate the header again. This function is synchronous
+// and does not use a worker.
+//
+// server - The server.
+// header - The message header.
+// table  - The table the message is working against
+// input  - The input file stream.
+// output - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_prepare_query_message_process(sky_server *server,
+                                      sky_message_header *header,
+                                      sky_table *table, FILE *input,
+                                      FILE *output)
+{
+    int rc = 0;
+    size_t sz;
+    sky_lua_cache_entry *entry = NULL;
+    sky_prepare_query_message *message = NULL;
+    check(server != NULL, "Server required");
+    check(header != NULL, "Message header required");
+    check(table != NULL, "Table required");
+    check(input != NULL, "Input stream required");
+    check(output != NULL, "Output stream required");
+
+    // Parse message.
+    message = sky_prepare_query_message_create(); check_mem(message);
+    rc = sky_prepare_query_message_unpack(message, input);
+    check(rc == 0, "Unable to parse 'prepare_query' message");
+    check(blength(message->query->name) > 0, "Query name required");
+    check(message->query->source != NULL, "Query source required");
+
+    // Compile the script so that errors are reported now.
+    rc = sky_lua_cache_checkout(server->lua_cache, message->query->source, table, &entry);
+    check(rc == 0, "Unable to compile query: %s", bdata(message->query->name));
+    sky_lua_cache_checkin(server->lua_cache, entry);
+    entry = NULL;
+
+    // Register query.
+    message->query->table_path = bstrcpy(table->path);
+    check_mem(message->query->table_path);
+    rc = sky_server_add_query(server, message->query);
+    check(rc == 0, "Unable to register query");
+
+    // Return.
+    //   {status:"ok", handle:<id>}
+    check(minipack_fwrite_map(output, 2, &sz) == 0, "Unable to write root map");
+    check(sky_minipack_fwrite_bstring(output, &SKY_PREPARE_QUERY_STATUS_STR) == 0, "Unable to write status key");
+    check(sky_minipack_fwrite_bstring(output, &SKY_PREPARE_QUERY_OK_STR) == 0, "Unable to write status value");
+    check(sky_minipack_fwrite_bstring(output, &SKY_PREPARE_QUERY_HANDLE_STR) == 0, "Unable to write handle key");
+    check(minipack_fwrite_uint(output, message->query->id, &sz) == 0, "Unable to write handle value");
+
+    // Clean up.
+    sky_prepare_query_message_free(message);
+    fclose(input);
+    fclose(output);
+
+    return 0;
+
+error:
+    sky_lua_cache_checkin(server->lua_cache, entry);
+    sky_prepare_query_message_free(message);
+    if(input) fclose(input);
+    if(output) fclose(output);
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Serializes a 'prepare_query' message to a file stream.
+//
+// message - The message.
+// file    - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_prepare_query_message_pack(sky_prepare_query_message *message,
+                                   FILE *file)
+{
+    size_t sz;
+    uint32_t i;
+    assert(message != NULL);
+    assert(file != NULL);
+
+    sky_query *query = message->query;
+
+    // Map
+    check(minipack_fwrite_map(file, SKY_PREPARE_QUERY_KEY_COUNT, &sz) == 0, "Unable to write map");
+
+    // Name
+    check(sky_minipack_fwrite_bstring(file, &SKY_PREPARE_QUERY_KEY_NAME) == 0, "Unable to pack name key");
+    check(sky_minipack_fwrite_bstring(file, query->name) == 0, "Unable to pack name");
+
+    // Source
+    check(sky_minipack_fwrite_bstring(file, &SKY_PREPARE_QUERY_KEY_SOURCE) == 0, "Unable to pack source key");
+    check(sky_minipack_fwrite_bstring(file, query->source) == 0, "Unable to pack source");
+
+    // Parameters
+    check(sky_minipack_fwrite_bstring(file, &SKY_PREPARE_QUERY_KEY_PARAMETERS) == 0, "Unable to pack parameters key");
+    check(minipack_fwrite_array(file, query->parameter_count, &sz) == 0, "Unable to pack parameters array");
+    for(i=0; i<query->parameter_count; i++) {
+        check(sky_minipack_fwrite_bstring(file, query->parameters[i]) == 0, "Unable to pack parameter");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Deserializes a 'prepare_query' message from a file stream.
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_prepare_query_message_unpack(sky_prepare_query_message *message,
+                                     FILE *file)
+{
+    int rc;
+    size_t sz;
+    bstring key = NULL;
+    assert(message != NULL);
+    assert(file != NULL);
+
+    sky_query *query = message->query;
+
+    // Map
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read map");
+
+    // Map items
+    uint32_t i, j;
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read map key");
+
+        if(biseq(key, &SKY_PREPARE_QUERY_KEY_NAME) == 1) {
+            rc = sky_minipack_fread_bstring(file, &query->name);
+            check(rc == 0, "Unable to read name");
+        }
+        else if(biseq(key, &SKY_PREPARE_QUERY_KEY_SOURCE) == 1) {
+            rc = sky_minipack_fread_bstring(file, &query->source);
+            check(rc == 0, "Unable to read source");
+        }
+        else if(biseq(key, &SKY_PREPARE_QUERY_KEY_PARAMETERS) == 1) {
+            uint32_t count = minipack_fread_array(file, &sz);
+            check(sz > 0, "Unable to read parameters array");
+            check(query->parameters == NULL, "Duplicate parameters key");
+            if(count > 0) {
+                query->parameters = calloc(count, sizeof(*query->parameters));
+                check_mem(query->parameters);
+            }
+            for(j=0; j<count; j++) {
+                rc = sky_minipack_fread_bstring(file, &query->parameters[j]);
+                check(rc == 0, "Unable to read parameter");
+                query->parameter_count++;
+                check(blength(query->parameters[j]) > 0, "Parameter name required");
+            }
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
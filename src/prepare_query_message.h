@@ -0,0 +1,59 @@
+#ifndef _sky_prepare_query_message_h
+#define _sky_prepare_query_message_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "bstring.h"
+#include "message_handler.h"
+#include "query.h"
+#include "table.h"
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// A message for registering a named aggregation script with the server.
+typedef struct {
+    sky_query *query;
+} sky_prepare_query_message;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_prepare_query_message *sky_prepare_query_message_create();
+
+void sky_prepare_query_message_free(sky_prepare_query_message *message);
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+sky_message_handler *sky_prepare_query_message_handler_create();
+
+int sky_prepare_query_message_process(sky_server *server,
+    sky_message_header *header, sky_table *table, FILE *input, FILE *output);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_prepare_query_message_pack(sky_prepare_query_message *message,
+    FILE *file);
+
+int sky_prepare_query_message_unpack(sky_prepare_query_message *message,
+    FILE *file);
+
+#endif
@@ -52,6 +52,8 @@ void sky_property_free(sky_property *property)
         property->data_type = SKY_DATA_TYPE_NONE;
         if(property->name) bdestroy(property->name);
         property->name = NULL;
+        sky_dictionary_free(property->dictionary);
+        property->dictionary = NULL;
         free(property);
     }
 }
@@ -82,6 +84,11 @@ size_t sky_property_sizeof(sky_property *property)
 
     sz += minipack_sizeof_raw(strlen("name")) + strlen("name");
     sz += blength(property->name);
+
+    if(property->dictionary != NULL) {
+        sz += minipack_sizeof_raw(strlen("dictionary")) + strlen("dictionary");
+        sz += sky_dictionary_sizeof(property->dictionary);
+    }
     return sz;
 }
 
@@ -102,13 +109,14 @@ int sky_property_pack(sky_property *property, FILE *file)
     struct tagbstring type_str = bsStatic("type");
     struct tagbstring data_type_str = bsStatic("dataType");
     struct tagbstring name_str = bsStatic("name");
+    struct tagbstring dictionary_str = bsStatic("dictionary");
 
     // Update the type just in case.
     rc = sky_property_update_type(property);
     check(rc == 0, "Unable to update property type");
 
     // Map
-    minipack_fwrite_map(file, 4, &sz);
+    minipack_fwrite_map(file, (property->dictionary != NULL ? 5 : 4), &sz);
     check(sz > 0, "Unable to write map");
     
     // ID
@@ -131,6 +139,13 @@ int sky_property_pack(sky_property *property, FILE *file)
     check(sky_minipack_fwrite_bstring(file, &name_str) == 0, "Unable to write name key");
     check(sky_minipack_fwrite_bstring(file, property->name) == 0, "Unable to write name value");
 
+    // Dictionary
+    if(property->dictionary != NULL) {
+        check(sky_minipack_fwrite_bstring(file, &dictionary_str) == 0, "Unable to write dictionary key");
+        rc = sky_dictionary_pack(property->dictionary, file);
+        check(rc == 0, "Unable to write dictionary value");
+    }
+
     return 0;
 
 error:
@@ -181,6 +196,28 @@ int sky_property_unpack(sky_property *property, FILE *file)
             rc = sky_minipack_fread_bstring(file, &property->name);
             check(rc == 0, "Unable to read property id");
         }
+        // The dictionary is either a list of values or "true" to enable
+        // dictionary encoding on a new property.
+        else if(biseqcstr(key, "dictionary")) {
+            int ch = fgetc(file);
+            check(ch != EOF, "Unable to read property dictionary");
+            ungetc(ch, file);
+            uint8_t byte = (uint8_t)ch;
+
+            sky_dictionary_free(property->dictionary);
+            property->dictionary = NULL;
+            if(minipack_is_bool(&byte)) {
+                if(minipack_fread_bool(file, &sz)) {
+                    property->dictionary = sky_dictionary_create(); check_mem(property->dictionary);
+                }
+                check(sz > 0, "Unable to read property dictionary flag");
+            }
+            else {
+                property->dictionary = sky_dictionary_create(); check_mem(property->dictionary);
+                rc = sky_dictionary_unpack(property->dictionary, file);
+                check(rc == 0, "Unable to read property dictionary");
+            }
+        }
         
         bdestroy(key);
     }
@@ -196,6 +233,61 @@ error:
 }
 
 
+//--------------------------------------
+// Dictionary
+//--------------------------------------
+
+// Creates event data for a string value of a property. If the property is
+// dictionary encoded then the value is stored as its integer code and new
+// values are added to the dictionary.
+//
+// property - The property.
+// value    - The string value.
+// data     - A pointer to where the new event data is returned.
+// added    - A pointer to where a flag is returned stating if a value was
+//            added to the dictionary. The property file is marked as dirty
+//            if it was.
+//
+// Returns 0 if successful, SKY_DICTIONARY_FULL if the value is new and the
+// property's dictionary is full, otherwise returns -1.
+int sky_property_encode_string(sky_property *property, bstring value,
+                               sky_event_data **data, bool *added)
+{
+    int rc;
+    check(property != NULL, "Property required");
+    check(data != NULL, "Data pointer required");
+
+    *added = false;
+    if(property->dictionary != NULL) {
+        int64_t code;
+        rc = sky_dictionary_encode(property->dictionary, value, &code, added);
+        if(rc == SKY_DICTIONARY_FULL) {
+            *data = NULL;
+            return SKY_DICTIONARY_FULL;
+        }
+        check(rc == 0, "Unable to encode value for property: %s", bdata(property->name));
+
+        // Scripts embed a snapshot of the dictionary so a new value changes
+        // the schema.
+        if(*added && property->property_file != NULL) {
+            property->property_file->dirty = true;
+            sky_property_file_update_version(property->property_file);
+        }
+        *data = sky_event_data_create_int(property->id, code);
+    }
+    else {
+        *data = sky_event_data_create_string(property->id, value);
+    }
+    check_mem(*data);
+
+    return 0;
+
+error:
+    if(data != NULL) *data = NULL;
+    return -1;
+}
+
+
 //--------------------------------------
 // Type
 //--------------------------------------
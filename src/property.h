@@ -10,6 +10,8 @@ typedef struct sky_property sky_property;
 #include "bstring.h"
 #include "file.h"
 #include "property_file.h"
+#include "dictionary.h"
+#include "event_data.h"
 
 //==============================================================================
 //
@@ -28,6 +30,7 @@ struct sky_property {
     sky_property_type_e type;
     sky_data_type_e data_type;
     bstring name;
+    sky_dictionary *dictionary;
 };
 
 
@@ -56,4 +59,11 @@ int sky_property_pack(sky_property *property, FILE *file);
 
 int sky_property_unpack(sky_property *property, FILE *file);
 
+//--------------------------------------
+// Dictionary
+//--------------------------------------
+
+int sky_property_encode_string(sky_property *property, bstring value,
+    sky_event_data **data, bool *added);
+
 #endif
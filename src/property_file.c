@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <inttypes.h>
+#include <unistd.h>
 #include <assert.h>
 
 #include "dbg.h"
@@ -9,6 +10,19 @@
 #include "property_file.h"
 #include "minipack.h"
 
+
+//==============================================================================
+//
+// Globals
+//
+//==============================================================================
+
+// The last version assigned to any property file. Versions are unique across
+// every property file in the process so a version identifies a single
+// schema even after its property file has been freed.
+static uint64_t sky_property_file_last_version = 0;
+
+
 //==============================================================================
 //
 // Functions
@@ -27,6 +41,7 @@ sky_property_file *sky_property_file_create()
 {
     sky_property_file *property_file = calloc(sizeof(sky_property_file), 1);
     check_mem(property_file);
+    sky_property_file_update_version(property_file);
     return property_file;
     
 error:
@@ -95,6 +110,36 @@ error:
 }
 
 
+//--------------------------------------
+// Versioning
+//--------------------------------------
+
+// Retrieves the current version of the property file. The version changes
+// whenever a property is added or a dictionary gains a new value so that
+// anything generated from the properties can tell when it is out of date.
+//
+// property_file - The property file.
+//
+// Returns the version.
+uint64_t sky_property_file_get_version(sky_property_file *property_file)
+{
+    assert(property_file != NULL);
+    return __atomic_load_n(&property_file->version, __ATOMIC_SEQ_CST);
+}
+
+// Assigns a new version to the property file.
+//
+// property_file - The property file.
+//
+// Returns nothing.
+void sky_property_file_update_version(sky_property_file *property_file)
+{
+    assert(property_file != NULL);
+    uint64_t version = __atomic_add_fetch(&sky_property_file_last_version, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&property_file->version, version, __ATOMIC_SEQ_CST);
+}
+
+
 //--------------------------------------
 // Persistence
 //--------------------------------------
@@ -153,6 +198,7 @@ int sky_property_file_load(sky_property_file *property_file)
     // Store property list on property file.
     property_file->properties = properties;
     property_file->property_count = count;
+    sky_property_file_update_version(property_file);
 
     return 0;
 
@@ -162,7 +208,9 @@ error:
     return -1;
 }
 
-// Saves properties to file.
+// Saves properties to file. The properties are written to a temporary file
+// which then replaces the property file so that a crash never leaves a
+// partially written file behind.
 //
 // property_file - The property file to save.
 //
@@ -172,12 +220,14 @@ int sky_property_file_save(sky_property_file *property_file)
     int rc;
     size_t sz;
     FILE *file = NULL;
+    bstring tmp_path = NULL;
     assert(property_file != NULL);
     assert(property_file->path != NULL);
 
     // Open file.
-    file = fopen(bdata(property_file->path), "w");
-    check(file, "Failed to open property file: %s", bdata(property_file->path));
+    tmp_path = bformat("%s.tmp", bdata(property_file->path)); check_mem(tmp_path);
+    file = fopen(bdata(tmp_path), "w");
+    check(file, "Failed to open property file: %s", bdata(tmp_path));
 
     // Write property array.
     rc = minipack_fwrite_array(file, property_file->property_count, &sz);
@@ -192,13 +242,43 @@ int sky_property_file_save(sky_property_file *property_file)
         check(rc == 0, "Unable to pack property");
     }
 
-    // Close the file.
+    // Close the file and move it into place.
+    check(fflush(file) == 0 && fsync(fileno(file)) == 0, "Unable to sync property file");
     fclose(file);
+    file = NULL;
+    rc = rename(bdata(tmp_path), bdata(property_file->path));
+    check(rc == 0, "Unable to replace property file: %s", bdata(property_file->path));
+    property_file->dirty = false;
 
+    bdestroy(tmp_path);
     return 0;
 
 error:
     if(file) fclose(file);
+    bdestroy(tmp_path);
+    return -1;
+}
+
+// Saves the properties to file if any have been added since the last save.
+// Values added to dictionaries are batched this way so that the file is
+// written once per message or import instead of once per value.
+//
+// property_file - The property file to save.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_property_file_save_if_dirty(sky_property_file *property_file)
+{
+    int rc;
+    assert(property_file != NULL);
+
+    if(property_file->dirty) {
+        rc = sky_property_file_save(property_file);
+        check(rc == 0, "Unable to save property file");
+    }
+
+    return 0;
+
+error:
     return -1;
 }
 
@@ -223,6 +303,8 @@ int sky_property_file_unload(sky_property_file *property_file)
         }
         
         property_file->property_count = 0;
+        property_file->dirty = false;
+        sky_property_file_update_version(property_file);
     }
     
     return 0;
@@ -344,6 +426,8 @@ int sky_property_file_add_property(sky_property_file *property_file,
     property_file->properties = realloc(property_file->properties, sizeof(sky_property*) * property_file->property_count);
     check_mem(property_file->properties);
     property_file->properties[property_file->property_count-1] = property;
+    property_file->dirty = true;
+    sky_property_file_update_version(property_file);
     
     return 0;
 
@@ -19,10 +19,14 @@ typedef struct sky_property_file sky_property_file;
 //
 //==============================================================================
 
+// The properties of a table. The dirty flag is set when a property or a
+// dictionary value has been added since the file was last saved.
 struct sky_property_file {
     bstring path;
     sky_property **properties;
     uint32_t property_count;
+    uint64_t version;
+    bool dirty;
 };
 
 
@@ -48,6 +52,14 @@ int sky_property_file_set_path(sky_property_file *property_file, bstring path);
 
 int sky_property_file_get_path(sky_property_file *property_file, bstring *path);
 
+//--------------------------------------
+// Versioning
+//--------------------------------------
+
+uint64_t sky_property_file_get_version(sky_property_file *property_file);
+
+void sky_property_file_update_version(sky_property_file *property_file);
+
 //--------------------------------------
 // Persistence
 //--------------------------------------
@@ -58,6 +70,8 @@ int sky_property_file_unload(sky_property_file *property_file);
 
 int sky_property_file_save(sky_property_file *property_file);
 
+int sky_property_file_save_if_dirty(sky_property_file *property_file);
+
 //--------------------------------------
 // Property Management
 //--------------------------------------
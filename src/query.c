@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "query.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a query.
+//
+// Returns a new query.
+sky_query *sky_query_create()
+{
+    sky_query *query = calloc(1, sizeof(sky_query)); check_mem(query);
+    return query;
+
+error:
+    sky_query_free(query);
+    return NULL;
+}
+
+// Frees a query from memory.
+//
+// query - The query.
+//
+// Returns nothing.
+void sky_query_free(sky_query *query)
+{
+    if(query) {
+        uint32_t i;
+        for(i=0; i<query->parameter_count; i++) {
+            bdestroy(query->parameters[i]);
+        }
+        free(query->parameters);
+        query->parameters = NULL;
+        query->parameter_count = 0;
+        bdestroy(query->table_path);
+        query->table_path = NULL;
+        bdestroy(query->name);
+        query->name = NULL;
+        bdestroy(query->source);
+        query->source = NULL;
+        free(query);
+    }
+}
+
+// Creates a query argument.
+//
+// Returns a new argument.
+sky_query_argument *sky_query_argument_create()
+{
+    sky_query_argument *argument = calloc(1, sizeof(sky_query_argument));
+    check_mem(argument);
+    return argument;
+
+error:
+    sky_query_argument_free(argument);
+    return NULL;
+}
+
+// Frees a query argument from memory.
+//
+// argument - The argument.
+//
+// Returns nothing.
+void sky_query_argument_free(sky_query_argument *argument)
+{
+    if(argument) {
+        bdestroy(argument->name);
+        argument->name = NULL;
+        bdestroy(argument->string_value);
+        argument->string_value = NULL;
+        free(argument);
+    }
+}
+
+
+//--------------------------------------
+// Parameters
+//--------------------------------------
+
+// Copies the parameter names of a query.
+//
+// query           - The query.
+// parameters      - A pointer to where the names should be returned.
+// parameter_count - A pointer to where the number of names should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_copy_parameters(sky_query *query, bstring **parameters,
+                              uint32_t *parameter_count)
+{
+    uint32_t i;
+    assert(query != NULL);
+    assert(parameters != NULL);
+    assert(parameter_count != NULL);
+
+    *parameters = NULL;
+    *parameter_count = 0;
+    if(query->parameter_count > 0) {
+        *parameters = calloc(query->parameter_count, sizeof(**parameters));
+        check_mem(*parameters);
+        *parameter_count = query->parameter_count;
+        for(i=0; i<query->parameter_count; i++) {
+            (*parameters)[i] = bstrcpy(query->parameters[i]);
+            check_mem((*parameters)[i]);
+        }
+    }
+
+    return 0;
+
+error:
+    if(*parameters) {
+        for(i=0; i<*parameter_count; i++) {
+            bdestroy((*parameters)[i]);
+        }
+        free(*parameters);
+    }
+    *parameters = NULL;
+    *parameter_count = 0;
+    return -1;
+}
+
+// Sets each parameter as a global variable in a Lua state. The value of a
+// parameter is taken from the argument with the same name or is nil if there
+// is no argument for it.
+//
+// L               - The Lua state.
+// parameters      - The names of the parameters.
+// parameter_count - The number of parameters.
+// arguments       - The arguments.
+// argument_count  - The number of arguments.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_set_globals(lua_State *L, bstring *parameters,
+                          uint32_t parameter_count,
+                          sky_query_argument **arguments,
+                          uint32_t argument_count)
+{
+    uint32_t i, j;
+    assert(L != NULL);
+
+    for(i=0; i<parameter_count; i++) {
+        sky_query_argument *argument = NULL;
+        for(j=0; j<argument_count; j++) {
+            if(biseq(arguments[j]->name, parameters[i]) == 1) {
+                argument = arguments[j];
+                break;
+            }
+        }
+
+        switch(argument != NULL ? argument->data_type : SKY_DATA_TYPE_NONE) {
+            case SKY_DATA_TYPE_STRING:
+                lua_pushlstring(L, bdatae(argument->string_value, ""), blength(argument->string_value));
+                break;
+            case SKY_DATA_TYPE_INT:
+                lua_pushnumber(L, (lua_Number)argument->int_value);
+                break;
+            case SKY_DATA_TYPE_DOUBLE:
+                lua_pushnumber(L, argument->double_value);
+                break;
+            case SKY_DATA_TYPE_BOOLEAN:
+                lua_pushboolean(L, argument->boolean_value);
+                break;
+            default:
+                lua_pushnil(L);
+                break;
+        }
+        lua_setglobal(L, bdata(parameters[i]));
+    }
+
+    return 0;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Serializes the value of an argument to a file stream.
+//
+// argument - The argument.
+// file     - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_argument_pack(sky_query_argument *argument, FILE *file)
+{
+    int rc;
+    size_t sz;
+    assert(argument != NULL);
+    assert(file != NULL);
+
+    switch(argument->data_type) {
+        case SKY_DATA_TYPE_STRING:
+            rc = sky_minipack_fwrite_bstring(file, argument->string_value);
+            check(rc == 0, "Unable to pack string value");
+            break;
+        case SKY_DATA_TYPE_INT:
+            rc = minipack_fwrite_int(file, argument->int_value, &sz);
+            check(rc == 0, "Unable to pack int value");
+            break;
+        case SKY_DATA_TYPE_DOUBLE:
+            rc = minipack_fwrite_double(file, argument->double_value, &sz);
+            check(rc == 0, "Unable to pack double value");
+            break;
+        case SKY_DATA_TYPE_BOOLEAN:
+            rc = minipack_fwrite_bool(file, argument->boolean_value, &sz);
+            check(rc == 0, "Unable to pack boolean value");
+            break;
+        default:
+            rc = minipack_fwrite_nil(file, &sz);
+            check(rc == 0, "Unable to pack nil value");
+            break;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Deserializes the value of an argument from a file stream.
+//
+// argument - The argument.
+// file     - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_argument_unpack(sky_query_argument *argument, FILE *file)
+{
+    int rc;
+    size_t sz;
+    assert(argument != NULL);
+    assert(file != NULL);
+
+    // Read the first byte of the value to determine the type.
+    uint8_t buffer[1];
+    check(fread(buffer, sizeof(*buffer), 1, file) == 1, "Unable to read argument type");
+    ungetc(buffer[0], file);
+
+    // Read in the appropriate data type.
+    if(minipack_is_raw((void*)buffer)) {
+        argument->data_type = SKY_DATA_TYPE_STRING;
+        rc = sky_minipack_fread_bstring(file, &argument->string_value);
+        check(rc == 0, "Unable to unpack string value");
+    }
+    else if(minipack_is_bool((void*)buffer)) {
+        argument->data_type = SKY_DATA_TYPE_BOOLEAN;
+        argument->boolean_value = minipack_fread_bool(file, &sz);
+        check(sz != 0, "Unable to unpack boolean value");
+    }
+    else if(minipack_is_double((void*)buffer)) {
+        argument->data_type = SKY_DATA_TYPE_DOUBLE;
+        argument->double_value = minipack_fread_double(file, &sz);
+        check(sz != 0, "Unable to unpack double value");
+    }
+    else if(minipack_is_nil((void*)buffer)) {
+        argument->data_type = SKY_DATA_TYPE_NONE;
+        minipack_fread_nil(file, &sz);
+        check(sz != 0, "Unable to unpack nil value");
+    }
+    else {
+        argument->data_type = SKY_DATA_TYPE_INT;
+        argument->int_value = minipack_fread_int(file, &sz);
+        check(sz != 0, "Unable to unpack int value");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
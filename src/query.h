@@ -0,0 +1,93 @@
+#ifndef _sky_query_h
+#define _sky_query_h
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_query sky_query;
+typedef struct sky_query_argument sky_query_argument;
+
+#include "bstring.h"
+#include "types.h"
+#include "sky_lua.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A query is an aggregation script that has been registered with the server
+// under a name so that clients can run it by handle instead of sending the
+// source with every request. A query declares the names of its parameters.
+// When the query is executed, each parameter is set as a global variable in
+// the script from the arguments sent with the request. Parameters without an
+// argument are set to nil so that values from an earlier run never leak
+// into the next one.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_query {
+    uint32_t id;
+    bstring table_path;
+    bstring name;
+    bstring source;
+    bstring *parameters;
+    uint32_t parameter_count;
+};
+
+struct sky_query_argument {
+    bstring name;
+    sky_data_type_e data_type;
+    bstring string_value;
+    int64_t int_value;
+    double double_value;
+    bool boolean_value;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_query *sky_query_create();
+
+void sky_query_free(sky_query *query);
+
+sky_query_argument *sky_query_argument_create();
+
+void sky_query_argument_free(sky_query_argument *argument);
+
+//--------------------------------------
+// Parameters
+//--------------------------------------
+
+int sky_query_copy_parameters(sky_query *query, bstring **parameters,
+    uint32_t *parameter_count);
+
+int sky_query_set_globals(lua_State *L, bstring *parameters,
+    uint32_t parameter_count, sky_query_argument **arguments,
+    uint32_t argument_count);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_query_argument_pack(sky_query_argument *argument, FILE *file);
+
+int sky_query_argument_unpack(sky_query_argument *argument, FILE *file);
+
+#endif
@@ -0,0 +1,384 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "types.h"
+#include "query_message.h"
+#include "path_iterator.h"
+#include "sample.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+//--------------------------------------
+// String Constants
+//--------------------------------------
+
+struct tagbstring SKY_QUERY_STATUS_STR = bsStatic("status");
+struct tagbstring SKY_QUERY_OK_STR     = bsStatic("ok");
+struct tagbstring SKY_QUERY_DATA_STR   = bsStatic("data");
+struct tagbstring SKY_QUERY_SAMPLE_STR = bsStatic("sample");
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a 'query' message object.
+//
+// Returns a new message.
+sky_query_message *sky_query_message_create()
+{
+    sky_query_message *message = NULL;
+    message = calloc(1, sizeof(sky_query_message)); check_mem(message);
+    message->plan = sky_query_plan_create(); check_mem(message->plan);
+    return message;
+
+error:
+    sky_query_message_free(message);
+    return NULL;
+}
+
+// Frees a 'query' message object from memory.
+//
+// message - The message object to be freed.
+//
+// Returns nothing.
+void sky_query_message_free(sky_query_message *message)
+{
+    if(message) {
+        sky_query_result_free(message->result);
+        message->result = NULL;
+        sky_query_plan_free(message->plan);
+        message->plan = NULL;
+        free(message);
+    }
+}
+
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+// Creates a message handler for the 'query' message.
+//
+// Returns a message handler.
+sky_message_handler *sky_query_message_handler_create()
+{
+    sky_message_handler *handler = sky_message_handler_create(); check_mem(handler);
+    handler->scope = SKY_MESSAGE_HANDLER_SCOPE_TABLE;
+    handler->name = bfromcstr("query");
+    handler->process = sky_query_message_process;
+    return handler;
+
+error:
+    sky_message_handler_free(handler);
+    return NULL;
+}
+
+// Compiles the query against the table and delegates running it to a
+// worker. The plan is compiled on the calling thread so that property and
+// dictionary lookups never race with writes.
+//
+// server  - The server.
+// header  - The message header.
+// table   - The table the message is working against
+// input   - The input file stream.
+// output  - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_message_process(sky_server *server, sky_message_header *header,
+                              sky_table *table, FILE *input, FILE *output)
+{
+    int rc = 0;
+    sky_worker *worker = NULL;
+    sky_query_message *message = NULL;
+    assert(server != NULL);
+    assert(header != NULL);
+    assert(table != NULL);
+    assert(input != NULL);
+    assert(output != NULL);
+
+    // Create worker.
+    worker = sky_worker_create(); check_mem(worker);
+    worker->pool = server->worker_pool;
+    worker->map = sky_query_message_worker_map;
+    worker->map_morsel = sky_query_message_worker_map_morsel;
+    worker->map_free = sky_query_message_worker_map_free;
+    worker->reduce = sky_query_message_worker_reduce;
+    worker->write = sky_query_message_worker_write;
+    worker->free = sky_query_message_worker_free;
+    worker->input = input;
+    worker->output = output;
+
+    // Parse and compile message.
+    message = sky_query_message_create(); check_mem(message);
+    rc = sky_query_message_unpack(message, input);
+    check(rc == 0, "Unable to unpack 'query' message");
+    rc = sky_query_plan_compile(message->plan, table->property_file);
+    check(rc == 0, "Unable to compile query");
+    message->result = sky_query_result_create(message->plan);
+    check_mem(message->result);
+
+    // Attach servlets.
+    rc = sky_server_get_table_servlets(server, table, &worker->servlets, &worker->servlet_count);
+    check(rc == 0, "Unable to copy servlets to worker");
+
+    // Attach message to worker.
+    worker->data = (sky_query_message*)message;
+
+    // Start worker.
+    rc = sky_worker_start(worker);
+    check(rc == 0, "Unable to start worker");
+
+    return 0;
+
+error:
+    sky_query_message_free(message);
+    sky_worker_free(worker);
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Deserializes a 'query' message from a file stream.
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_message_unpack(sky_query_message *message, FILE *file)
+{
+    int rc;
+    assert(message != NULL);
+    assert(file != NULL);
+
+    rc = sky_query_plan_unpack(message->plan, file);
+    check(rc == 0, "Unable to unpack query plan");
+    check(message->plan->selection_count > 0, "At least one selection required");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+// Maps tablet data to a query result.
+//
+// worker - The worker.
+// tablet - The tablet to work against.
+// ret    - A pointer to where the result should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_message_worker_map(sky_worker *worker, sky_tablet *tablet,
+                                 void **ret)
+{
+    assert(tablet != NULL);
+    sky_morsel morsel;
+    memset(&morsel, 0, sizeof(morsel));
+    morsel.tablet = tablet;
+    return sky_query_message_worker_map_morsel(worker, &morsel, NULL, ret);
+}
+
+// Maps a range of tablet data to a query result. Each event is decoded into
+// a data object laid out by the plan and added to the result if it passes
+// the plan's filters.
+//
+// worker  - The worker.
+// morsel  - The range of the tablet to work against.
+// context - Unused.
+// ret     - A pointer to where the result should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_message_worker_map_morsel(sky_worker *worker, sky_morsel *morsel,
+                                        void **context, void **ret)
+{
+    int rc;
+    void *data = NULL;
+    sky_query_result *result = NULL;
+    assert(worker != NULL);
+    assert(morsel != NULL);
+    assert(ret != NULL);
+    UNUSED(context);
+
+    sky_query_message *message = (sky_query_message*)worker->data;
+    sky_query_plan *plan = message->plan;
+
+    // Initialize the path iterator.
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+
+    data = calloc(1, plan->data_descriptor->data_sz); check_mem(data);
+    result = sky_query_result_create(plan); check_mem(result);
+
+    // Attach data and descriptor to cursor.
+    iterator.cursor.data_descriptor = plan->data_descriptor;
+    iterator.cursor.data = data;
+
+    // Only visit sampled objects if the plan is sampled.
+    if(sky_sample_is_enabled(plan->sample_rate)) {
+        sky_path_iterator_set_sample_rate(&iterator, plan->sample_rate);
+    }
+    sky_query_filters_prune(plan->filters, plan->filter_count, &iterator);
+
+    // Events are matched on their own so paths can start at a checkpoint.
+    sky_path_iterator_enable_seek(&iterator);
+
+    rc = sky_path_iterator_set_range(&iterator, morsel->tablet, morsel->start, morsel->end);
+    check(rc == 0, "Unable to initialize path iterator");
+
+    // Iterate over each path.
+    uint64_t path_count  = 0;
+    uint64_t event_count = 0;
+    while(!iterator.eof) {
+        path_count++;
+        result->path_id = path_count;
+
+        rc = sky_cursor_next_event(&iterator.cursor);
+        check(rc == 0, "Unable to initialize cursor");
+
+        // Add each matching event to the result.
+        while(!iterator.cursor.eof) {
+            if(sky_query_plan_matches(plan, data)) {
+                rc = sky_query_result_add(result, plan, data);
+                check(rc == 0, "Unable to add event to result");
+            }
+
+            rc = sky_cursor_next_event(&iterator.cursor);
+            check(rc == 0, "Unable to find next event");
+            event_count++;
+        }
+
+        rc = sky_path_iterator_next(&iterator);
+        check(rc == 0, "Unable to find next path");
+    }
+
+    // These counts are only used for debugging so they are not updated
+    // atomically.
+    message->path_count  += path_count;
+    message->event_count += event_count;
+
+    *ret = (void*)result;
+
+    free(data);
+    sky_path_iterator_uninit(&iterator);
+    return 0;
+
+error:
+    *ret = NULL;
+    sky_query_result_free(result);
+    free(data);
+    sky_path_iterator_uninit(&iterator);
+    return -1;
+}
+
+// Frees a result created by the map function.
+//
+// data - The result.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_message_worker_map_free(void *data)
+{
+    assert(data != NULL);
+    sky_query_result_free((sky_query_result*)data);
+    return 0;
+}
+
+// Merges a result created by the map function into the result saved
+// against the worker.
+//
+// worker - The worker.
+// data   - The result created by the map function.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_message_worker_reduce(sky_worker *worker, void *data)
+{
+    int rc;
+    assert(worker != NULL);
+    assert(data != NULL);
+
+    sky_query_message *message = (sky_query_message*)worker->data;
+    rc = sky_query_result_merge(message->result, message->plan, (sky_query_result*)data);
+    check(rc == 0, "Unable to merge query result");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes the results to an output stream.
+//
+// worker - The worker.
+// output - The output stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_message_worker_write(sky_worker *worker, FILE *output)
+{
+    int rc;
+    size_t sz;
+    assert(worker != NULL);
+    assert(output != NULL);
+
+    sky_query_message *message = (sky_query_message*)worker->data;
+    bool sampled = sky_sample_is_enabled(message->plan->sample_rate);
+
+    // Return.
+    //   {status:"ok", data:{...}, sample:{...}}
+    check(minipack_fwrite_map(output, (sampled ? 3 : 2), &sz) == 0, "Unable to write root map");
+    check(sky_minipack_fwrite_bstring(output, &SKY_QUERY_STATUS_STR) == 0, "Unable to write status key");
+    check(sky_minipack_fwrite_bstring(output, &SKY_QUERY_OK_STR) == 0, "Unable to write status value");
+    check(sky_minipack_fwrite_bstring(output, &SKY_QUERY_DATA_STR) == 0, "Unable to write data key");
+    rc = sky_query_result_pack(message->result, message->plan, output);
+    check(rc == 0, "Unable to write data value");
+
+    if(sampled) {
+        check(sky_minipack_fwrite_bstring(output, &SKY_QUERY_SAMPLE_STR) == 0, "Unable to write sample key");
+        rc = sky_sample_pack(message->plan->sample_rate, output);
+        check(rc == 0, "Unable to write sample value");
+    }
+
+    printf("[query] paths: %" PRIu64 ", events: %" PRIu64 "\n", message->path_count, message->event_count);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Frees all data attached to the worker.
+//
+// worker - The worker.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_message_worker_free(sky_worker *worker)
+{
+    assert(worker != NULL);
+
+    sky_query_message *message = (sky_query_message*)worker->data;
+    sky_query_message_free(message);
+    worker->data = NULL;
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef _sky_query_message_h
+#define _sky_query_message_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "bstring.h"
+#include "message_header.h"
+#include "message_handler.h"
+#include "query_plan.h"
+#include "table.h"
+#include "tablet.h"
+#include "worker.h"
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// A message for running a declarative aggregation without a script.
+typedef struct {
+    sky_query_plan *plan;
+    sky_query_result *result;
+    uint64_t path_count;
+    uint64_t event_count;
+} sky_query_message;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_query_message *sky_query_message_create();
+
+void sky_query_message_free(sky_query_message *message);
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+sky_message_handler *sky_query_message_handler_create();
+
+int sky_query_message_process(sky_server *server, sky_message_header *header,
+    sky_table *table, FILE *input, FILE *output);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_query_message_unpack(sky_query_message *message, FILE *file);
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int sky_query_message_worker_map(sky_worker *worker, sky_tablet *tablet,
+    void **data);
+
+int sky_query_message_worker_map_morsel(sky_worker *worker,
+    sky_morsel *morsel, void **context, void **ret);
+
+int sky_query_message_worker_map_free(void *data);
+
+int sky_query_message_worker_reduce(sky_worker *worker, void *data);
+
+int sky_query_message_worker_write(sky_worker *worker, FILE *output);
+
+int sky_query_message_worker_free(sky_worker *worker);
+
+#endif
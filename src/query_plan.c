@@ -0,0 +1,1352 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <assert.h>
+
+#include "query_plan.h"
+#include "property.h"
+#include "dictionary.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+//--------------------------------------
+// String Constants
+//--------------------------------------
+
+struct tagbstring SKY_QUERY_PLAN_KEY_FILTERS    = bsStatic("filters");
+struct tagbstring SKY_QUERY_PLAN_KEY_GROUPS     = bsStatic("groups");
+struct tagbstring SKY_QUERY_PLAN_KEY_SELECTIONS = bsStatic("selections");
+struct tagbstring SKY_QUERY_PLAN_KEY_FIELD      = bsStatic("field");
+struct tagbstring SKY_QUERY_PLAN_KEY_OP         = bsStatic("op");
+struct tagbstring SKY_QUERY_PLAN_KEY_VALUE      = bsStatic("value");
+struct tagbstring SKY_QUERY_PLAN_KEY_NAME       = bsStatic("name");
+struct tagbstring SKY_QUERY_PLAN_KEY_FN         = bsStatic("fn");
+struct tagbstring SKY_QUERY_PLAN_KEY_QUANTILE   = bsStatic("quantile");
+struct tagbstring SKY_QUERY_PLAN_KEY_SAMPLE     = bsStatic("sample");
+
+struct tagbstring SKY_QUERY_PLAN_TIMESTAMP_STR = bsStatic("timestamp");
+struct tagbstring SKY_QUERY_PLAN_ACTION_ID_STR = bsStatic("action_id");
+
+// The operator names in the order of their enum values.
+static const char *SKY_QUERY_OP_NAMES[] = {"==", "!=", "<", "<=", ">", ">="};
+
+// The function names in the order of their enum values.
+static const char *SKY_QUERY_FN_NAMES[] = {"count", "sum", "min", "max", "avg", "quantile"};
+
+
+//==============================================================================
+//
+// Filters
+//
+//==============================================================================
+
+// Generates a filter function for each operator on a field type along with
+// a table of them indexed by operator. Integer fields are widened to 64
+// bits before they are compared so that the filter value is never
+// truncated.
+#define SKY_QUERY_FILTER_FUNC(NAME, OPNAME, TYPE, CAST, MEMBER, OP) \
+    static bool sky_query_filter_##NAME##_##OPNAME(void *data, sky_query_filter *filter) { \
+        return ((CAST)(*((TYPE*)(data + filter->offset)))) OP filter->MEMBER; \
+    }
+
+#define SKY_QUERY_FILTER_FUNCS(NAME, TYPE, CAST, MEMBER) \
+    SKY_QUERY_FILTER_FUNC(NAME, eq, TYPE, CAST, MEMBER, ==) \
+    SKY_QUERY_FILTER_FUNC(NAME, ne, TYPE, CAST, MEMBER, !=) \
+    SKY_QUERY_FILTER_FUNC(NAME, lt, TYPE, CAST, MEMBER, <) \
+    SKY_QUERY_FILTER_FUNC(NAME, le, TYPE, CAST, MEMBER, <=) \
+    SKY_QUERY_FILTER_FUNC(NAME, gt, TYPE, CAST, MEMBER, >) \
+    SKY_QUERY_FILTER_FUNC(NAME, ge, TYPE, CAST, MEMBER, >=) \
+    static sky_query_filter_func_t sky_query_filter_##NAME##_funcs[] = { \
+        sky_query_filter_##NAME##_eq, sky_query_filter_##NAME##_ne, \
+        sky_query_filter_##NAME##_lt, sky_query_filter_##NAME##_le, \
+        sky_query_filter_##NAME##_gt, sky_query_filter_##NAME##_ge, \
+    };
+
+SKY_QUERY_FILTER_FUNCS(timestamp, uint32_t, int64_t, int_value)
+SKY_QUERY_FILTER_FUNCS(action_id, sky_action_id_t, int64_t, int_value)
+SKY_QUERY_FILTER_FUNCS(int, int64_t, int64_t, int_value)
+SKY_QUERY_FILTER_FUNCS(double, double, double, double_value)
+SKY_QUERY_FILTER_FUNCS(boolean, bool, int64_t, int_value)
+
+static bool sky_query_filter_string_eq(void *data, sky_query_filter *filter)
+{
+    return sky_string_equals((sky_string*)(data + filter->offset), &filter->string_value);
+}
+
+static bool sky_query_filter_string_ne(void *data, sky_query_filter *filter)
+{
+    return !sky_string_equals((sky_string*)(data + filter->offset), &filter->string_value);
+}
+
+static sky_query_filter_func_t sky_query_filter_string_funcs[] = {
+    sky_query_filter_string_eq, sky_query_filter_string_ne, NULL, NULL, NULL, NULL,
+};
+
+// Filters on a value that can't be stored, such as a string that is not in
+// a property's dictionary, never match on equality and always match on
+// inequality.
+static bool sky_query_filter_missing_eq(void *data, sky_query_filter *filter)
+{
+    (void)data; (void)filter;
+    return false;
+}
+
+static bool sky_query_filter_missing_ne(void *data, sky_query_filter *filter)
+{
+    (void)data; (void)filter;
+    return true;
+}
+
+static sky_query_filter_func_t sky_query_filter_missing_funcs[] = {
+    sky_query_filter_missing_eq, sky_query_filter_missing_ne, NULL, NULL, NULL, NULL,
+};
+
+
+//==============================================================================
+//
+// Field Readers
+//
+//==============================================================================
+
+static int64_t sky_query_key_timestamp(void *data, uint32_t offset)
+{
+    return (int64_t)*((uint32_t*)(data + offset));
+}
+
+static int64_t sky_query_key_action_id(void *data, uint32_t offset)
+{
+    return (int64_t)*((sky_action_id_t*)(data + offset));
+}
+
+static int64_t sky_query_key_int(void *data, uint32_t offset)
+{
+    return *((int64_t*)(data + offset));
+}
+
+static int64_t sky_query_key_double(void *data, uint32_t offset)
+{
+    int64_t key;
+    memcpy(&key, data + offset, sizeof(key));
+    return key;
+}
+
+static int64_t sky_query_key_boolean(void *data, uint32_t offset)
+{
+    return (int64_t)*((bool*)(data + offset));
+}
+
+static double sky_query_number_timestamp(void *data, uint32_t offset)
+{
+    return (double)*((uint32_t*)(data + offset));
+}
+
+static double sky_query_number_action_id(void *data, uint32_t offset)
+{
+    return (double)*((sky_action_id_t*)(data + offset));
+}
+
+static double sky_query_number_int(void *data, uint32_t offset)
+{
+    return (double)*((int64_t*)(data + offset));
+}
+
+static double sky_query_number_double(void *data, uint32_t offset)
+{
+    return *((double*)(data + offset));
+}
+
+static double sky_query_number_boolean(void *data, uint32_t offset)
+{
+    return (*((bool*)(data + offset)) ? 1 : 0);
+}
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a query plan.
+//
+// Returns a new query plan.
+sky_query_plan *sky_query_plan_create()
+{
+    sky_query_plan *plan = NULL;
+    plan = calloc(1, sizeof(sky_query_plan)); check_mem(plan);
+    plan->sample_rate = 1;
+    return plan;
+
+error:
+    sky_query_plan_free(plan);
+    return NULL;
+}
+
+// Frees a query plan from memory.
+//
+// plan - The query plan.
+//
+// Returns nothing.
+void sky_query_plan_free(sky_query_plan *plan)
+{
+    if(plan) {
+        uint32_t i;
+        for(i=0; i<plan->filter_count; i++) {
+            bdestroy(plan->filters[i].field_name);
+            sky_query_argument_free(plan->filters[i].value);
+        }
+        free(plan->filters);
+        plan->filters = NULL;
+        plan->filter_count = 0;
+
+        for(i=0; i<plan->group_count; i++) {
+            bdestroy(plan->group_names[i]);
+        }
+        free(plan->group_names);
+        plan->group_names = NULL;
+        plan->group_count = 0;
+
+        for(i=0; i<plan->selection_count; i++) {
+            bdestroy(plan->selections[i].name);
+            bdestroy(plan->selections[i].field_name);
+        }
+        free(plan->selections);
+        plan->selections = NULL;
+        plan->selection_count = 0;
+
+        for(i=0; i<plan->field_count; i++) {
+            bdestroy(plan->fields[i]->name);
+            free(plan->fields[i]->dictionary);
+            free(plan->fields[i]);
+        }
+        free(plan->fields);
+        plan->fields = NULL;
+        plan->field_count = 0;
+
+        sky_data_descriptor_free(plan->data_descriptor);
+        plan->data_descriptor = NULL;
+
+        free(plan);
+    }
+}
+
+// Creates an empty result for a compiled query plan.
+//
+// plan - The query plan.
+//
+// Returns a new result.
+sky_query_result *sky_query_result_create(sky_query_plan *plan)
+{
+    sky_query_result *result = NULL;
+    assert(plan != NULL);
+    result = calloc(1, sizeof(sky_query_result)); check_mem(result);
+    result->group_count = plan->group_count;
+    result->selection_count = plan->selection_count;
+    return result;
+
+error:
+    sky_query_result_free(result);
+    return NULL;
+}
+
+// Frees a query result from memory.
+//
+// result - The result.
+//
+// Returns nothing.
+void sky_query_result_free(sky_query_result *result)
+{
+    if(result) {
+        uint32_t i;
+        for(i=0; i<result->count * result->selection_count; i++) {
+            sky_tdigest_free(result->aggregates[i].digest);
+        }
+        free(result->keys);
+        result->keys = NULL;
+        free(result->aggregates);
+        result->aggregates = NULL;
+        free(result->index);
+        result->index = NULL;
+        free(result);
+    }
+}
+
+
+//--------------------------------------
+// Compilation
+//--------------------------------------
+
+// Finds a field on the plan by name or adds it if it has not been
+// referenced yet. New properties are given a slot in the data object and
+// are registered with the data descriptor.
+//
+// plan          - The query plan.
+// property_file - The property file to resolve names against.
+// name          - The field name.
+// ret           - A pointer to where the field should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_plan_resolve_field(sky_query_plan *plan,
+                                        sky_property_file *property_file,
+                                        bstring name, sky_query_field **ret)
+{
+    int rc;
+    uint32_t i;
+    sky_query_field *field = NULL;
+    sky_data_descriptor *descriptor = plan->data_descriptor;
+    check(blength(name) > 0, "Field name required");
+
+    for(i=0; i<plan->field_count; i++) {
+        if(biseq(plan->fields[i]->name, name) == 1) {
+            *ret = plan->fields[i];
+            return 0;
+        }
+    }
+
+    field = calloc(1, sizeof(*field)); check_mem(field);
+    field->name = bstrcpy(name); check_mem(field->name);
+
+    if(biseq(name, &SKY_QUERY_PLAN_TIMESTAMP_STR) == 1) {
+        field->type = SKY_QUERY_FIELD_TYPE_TIMESTAMP;
+        field->offset = offsetof(sky_data_object, timestamp);
+    }
+    else if(biseq(name, &SKY_QUERY_PLAN_ACTION_ID_STR) == 1) {
+        field->type = SKY_QUERY_FIELD_TYPE_ACTION_ID;
+        field->offset = offsetof(sky_data_object, action_id);
+    }
+    else {
+        sky_property *property = NULL;
+        rc = sky_property_file_find_by_name(property_file, name, &property);
+        check(rc == 0, "Unable to find property: %s", bdata(name));
+        check(property != NULL, "Property not found: %s", bdata(name));
+        field->property_id = property->id;
+
+        // Every property gets an 8 byte aligned slot after the fixed fields.
+        size_t sz = sizeof(int64_t);
+        sky_data_type_e data_type = property->data_type;
+        if(property->dictionary != NULL) {
+            field->type = SKY_QUERY_FIELD_TYPE_DICTIONARY;
+            data_type = SKY_DATA_TYPE_INT;
+
+            // The dictionary can grow while the query runs so the values
+            // known at compile time are copied for writing out group keys.
+            field->dictionary_count = property->dictionary->count;
+            if(field->dictionary_count > 0) {
+                field->dictionary = calloc(field->dictionary_count, sizeof(*field->dictionary));
+                check_mem(field->dictionary);
+                memcpy(field->dictionary, property->dictionary->values, field->dictionary_count * sizeof(*field->dictionary));
+            }
+        }
+        else {
+            switch(property->data_type) {
+                case SKY_DATA_TYPE_STRING: field->type = SKY_QUERY_FIELD_TYPE_STRING; sz = sizeof(sky_string); break;
+                case SKY_DATA_TYPE_INT: field->type = SKY_QUERY_FIELD_TYPE_INT; break;
+                case SKY_DATA_TYPE_DOUBLE: field->type = SKY_QUERY_FIELD_TYPE_DOUBLE; break;
+                case SKY_DATA_TYPE_BOOLEAN: field->type = SKY_QUERY_FIELD_TYPE_BOOLEAN; break;
+                default: sentinel("Invalid property data type: %s", bdata(name));
+            }
+        }
+
+        field->offset = descriptor->data_sz;
+        descriptor->data_sz += (uint32_t)((sz + 7) & ~((size_t)7));
+        rc = sky_data_descriptor_set_property(descriptor, property->id, field->offset, data_type);
+        check(rc == 0, "Unable to set property on data descriptor: %s", bdata(name));
+    }
+
+    plan->fields = realloc(plan->fields, (plan->field_count+1) * sizeof(*plan->fields));
+    check_mem(plan->fields);
+    plan->fields[plan->field_count++] = field;
+
+    *ret = field;
+    return 0;
+
+error:
+    if(field) {
+        bdestroy(field->name);
+        free(field->dictionary);
+        free(field);
+    }
+    *ret = NULL;
+    return -1;
+}
+
+// Compiles a filter into a function for its field type and operator.
+//
+// plan          - The query plan.
+// property_file - The property file to resolve names against.
+// filter        - The filter.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_plan_compile_filter(sky_query_plan *plan,
+                                         sky_property_file *property_file,
+                                         sky_query_filter *filter)
+{
+    int rc;
+    sky_query_argument *value = filter->value;
+    check(value != NULL, "Filter value required: %s", bdata(filter->field_name));
+
+    rc = sky_query_plan_resolve_field(plan, property_file, filter->field_name, &filter->field);
+    check(rc == 0, "Unable to resolve filter field");
+    filter->offset = filter->field->offset;
+
+    sky_query_filter_func_t *funcs = NULL;
+    switch(filter->field->type) {
+        case SKY_QUERY_FIELD_TYPE_TIMESTAMP:
+        case SKY_QUERY_FIELD_TYPE_ACTION_ID:
+        case SKY_QUERY_FIELD_TYPE_INT: {
+            check(value->data_type == SKY_DATA_TYPE_INT, "Integer filter value required: %s", bdata(filter->field_name));
+            filter->int_value = value->int_value;
+            funcs = (filter->field->type == SKY_QUERY_FIELD_TYPE_TIMESTAMP ? sky_query_filter_timestamp_funcs :
+                     filter->field->type == SKY_QUERY_FIELD_TYPE_ACTION_ID ? sky_query_filter_action_id_funcs :
+                     sky_query_filter_int_funcs);
+            break;
+        }
+        case SKY_QUERY_FIELD_TYPE_DOUBLE: {
+            check(value->data_type == SKY_DATA_TYPE_DOUBLE || value->data_type == SKY_DATA_TYPE_INT, "Numeric filter value required: %s", bdata(filter->field_name));
+            filter->double_value = (value->data_type == SKY_DATA_TYPE_DOUBLE ? value->double_value : (double)value->int_value);
+            funcs = sky_query_filter_double_funcs;
+            break;
+        }
+        case SKY_QUERY_FIELD_TYPE_BOOLEAN: {
+            check(value->data_type == SKY_DATA_TYPE_BOOLEAN, "Boolean filter value required: %s", bdata(filter->field_name));
+            check(filter->op == SKY_QUERY_OP_EQ || filter->op == SKY_QUERY_OP_NE, "Only equality filters are supported on booleans: %s", bdata(filter->field_name));
+            filter->int_value = (value->boolean_value ? 1 : 0);
+            funcs = sky_query_filter_boolean_funcs;
+            break;
+        }
+        case SKY_QUERY_FIELD_TYPE_STRING: {
+            check(value->data_type == SKY_DATA_TYPE_STRING, "String filter value required: %s", bdata(filter->field_name));
+            check(filter->op == SKY_QUERY_OP_EQ || filter->op == SKY_QUERY_OP_NE, "Only equality filters are supported on strings: %s", bdata(filter->field_name));
+            filter->string_value = sky_string_create(blength(value->string_value), bdatae(value->string_value, ""));
+            funcs = sky_query_filter_string_funcs;
+            break;
+        }
+        case SKY_QUERY_FIELD_TYPE_DICTIONARY: {
+            // Dictionary strings are compared by code. A value that is not
+            // in the dictionary has a code of zero, which is the same as an
+            // unset property, so it is compiled to a constant filter instead.
+            check(value->data_type == SKY_DATA_TYPE_STRING, "String filter value required: %s", bdata(filter->field_name));
+            check(filter->op == SKY_QUERY_OP_EQ || filter->op == SKY_QUERY_OP_NE, "Only equality filters are supported on strings: %s", bdata(filter->field_name));
+            sky_property *property = NULL;
+            rc = sky_property_file_find_by_id(property_file, filter->field->property_id, &property);
+            check(rc == 0 && property != NULL, "Unable to find property: %s", bdata(filter->field_name));
+            rc = sky_dictionary_find(property->dictionary, value->string_value, &filter->int_value);
+            check(rc == 0, "Unable to search dictionary: %s", bdata(filter->field_name));
+            funcs = (filter->int_value != 0 ? sky_query_filter_int_funcs : sky_query_filter_missing_funcs);
+            break;
+        }
+    }
+
+    filter->func = funcs[filter->op];
+    check(filter->func != NULL, "Invalid filter operator: %s", bdata(filter->field_name));
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Resolves every field referenced by a plan against a table's properties
+// and assigns the functions used to evaluate it.
+//
+// plan          - The query plan.
+// property_file - The property file of the table the plan runs against.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_plan_compile(sky_query_plan *plan,
+                           sky_property_file *property_file)
+{
+    int rc;
+    uint32_t i;
+    check(plan != NULL, "Query plan required");
+    check(property_file != NULL, "Property file required");
+    check(plan->data_descriptor == NULL, "Query plan already compiled");
+    check(plan->group_count <= SKY_QUERY_PLAN_MAX_GROUP_COUNT, "Too many group fields: %d", plan->group_count);
+
+    // The data object starts with the fixed event fields.
+    plan->data_descriptor = sky_data_descriptor_create(); check_mem(plan->data_descriptor);
+    plan->data_descriptor->data_sz = (uint32_t)((sizeof(sky_data_object) + 7) & ~((size_t)7));
+    plan->data_descriptor->timestamp_descriptor.timestamp_offset = offsetof(sky_data_object, timestamp);
+    plan->data_descriptor->timestamp_descriptor.ts_offset = offsetof(sky_data_object, ts);
+    plan->data_descriptor->action_descriptor.offset = offsetof(sky_data_object, action_id);
+
+    for(i=0; i<plan->filter_count; i++) {
+        rc = sky_query_plan_compile_filter(plan, property_file, &plan->filters[i]);
+        check(rc == 0, "Unable to compile filter");
+    }
+
+    for(i=0; i<plan->group_count; i++) {
+        sky_query_field *field = NULL;
+        rc = sky_query_plan_resolve_field(plan, property_file, plan->group_names[i], &field);
+        check(rc == 0, "Unable to resolve group field");
+        plan->groups[i] = field;
+        switch(field->type) {
+            case SKY_QUERY_FIELD_TYPE_TIMESTAMP: plan->group_funcs[i] = sky_query_key_timestamp; break;
+            case SKY_QUERY_FIELD_TYPE_ACTION_ID: plan->group_funcs[i] = sky_query_key_action_id; break;
+            case SKY_QUERY_FIELD_TYPE_INT: plan->group_funcs[i] = sky_query_key_int; break;
+            case SKY_QUERY_FIELD_TYPE_DICTIONARY: plan->group_funcs[i] = sky_query_key_int; break;
+            case SKY_QUERY_FIELD_TYPE_DOUBLE: plan->group_funcs[i] = sky_query_key_double; break;
+            case SKY_QUERY_FIELD_TYPE_BOOLEAN: plan->group_funcs[i] = sky_query_key_boolean; break;
+            default: sentinel("Only dictionary encoded strings can be grouped: %s", bdata(field->name));
+        }
+    }
+
+    for(i=0; i<plan->selection_count; i++) {
+        sky_query_selection *selection = &plan->selections[i];
+        if(selection->fn == SKY_QUERY_FN_COUNT) {
+            continue;
+        }
+        rc = sky_query_plan_resolve_field(plan, property_file, selection->field_name, &selection->field);
+        check(rc == 0, "Unable to resolve selection field");
+        switch(selection->field->type) {
+            case SKY_QUERY_FIELD_TYPE_TIMESTAMP: selection->func = sky_query_number_timestamp; break;
+            case SKY_QUERY_FIELD_TYPE_ACTION_ID: selection->func = sky_query_number_action_id; break;
+            case SKY_QUERY_FIELD_TYPE_INT: selection->func = sky_query_number_int; break;
+            case SKY_QUERY_FIELD_TYPE_DOUBLE: selection->func = sky_query_number_double; break;
+            case SKY_QUERY_FIELD_TYPE_BOOLEAN: selection->func = sky_query_number_boolean; break;
+            default: sentinel("Numeric field required for '%s': %s", SKY_QUERY_FN_NAMES[selection->fn], bdata(selection->field->name));
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Execution
+//--------------------------------------
+
+// Checks if the current event passes every filter of the plan.
+//
+// plan - The query plan.
+// data - The data object of the current event.
+//
+// Returns true if the event matches, otherwise returns false.
+bool sky_query_plan_matches(sky_query_plan *plan, void *data)
+{
+    return sky_query_filters_match(plan->filters, plan->filter_count, data);
+}
+
+// Checks if the current event passes every filter in a list of compiled
+// filters.
+//
+// filters - The filters.
+// count   - The number of filters.
+// data    - The data object of the current event.
+//
+// Returns true if the event matches, otherwise returns false.
+bool sky_query_filters_match(sky_query_filter *filters, uint32_t count,
+                             void *data)
+{
+    uint32_t i;
+    for(i=0; i<count; i++) {
+        sky_query_filter *filter = &filters[i];
+        if(!filter->func(data, filter)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Limits a path iterator to the paths that could have an event that passes
+// every filter in a list of compiled filters. Timestamp filters narrow the
+// iterator's time range and action equality filters narrow its actions.
+// Other filters cannot be checked against a path summary and are ignored.
+//
+// filters  - The filters.
+// count    - The number of filters.
+// iterator - The path iterator to limit.
+//
+// Returns nothing.
+void sky_query_filters_prune(sky_query_filter *filters, uint32_t count,
+                             sky_path_iterator *iterator)
+{
+    uint32_t i;
+    assert(iterator != NULL);
+
+    for(i=0; i<count; i++) {
+        sky_query_filter *filter = &filters[i];
+        if(filter->field == NULL) continue;
+
+        if(filter->field->type == SKY_QUERY_FIELD_TYPE_TIMESTAMP) {
+            int64_t min_timestamp = 0, max_timestamp = UINT32_MAX;
+            switch(filter->op) {
+                case SKY_QUERY_OP_EQ: min_timestamp = max_timestamp = filter->int_value; break;
+                case SKY_QUERY_OP_LT: max_timestamp = filter->int_value - 1; break;
+                case SKY_QUERY_OP_LE: max_timestamp = filter->int_value; break;
+                case SKY_QUERY_OP_GT: min_timestamp = filter->int_value + 1; break;
+                case SKY_QUERY_OP_GE: min_timestamp = filter->int_value; break;
+                default: continue;
+            }
+
+            // Ranges that fall outside of 32-bit timestamps match no events.
+            if(min_timestamp > UINT32_MAX || max_timestamp < 0 || min_timestamp > max_timestamp) {
+                min_timestamp = 1;
+                max_timestamp = 0;
+            }
+            if(min_timestamp < 0) min_timestamp = 0;
+            if(max_timestamp > UINT32_MAX) max_timestamp = UINT32_MAX;
+            sky_path_iterator_set_time_range(iterator, (uint32_t)min_timestamp, (uint32_t)max_timestamp);
+        }
+        else if(filter->field->type == SKY_QUERY_FIELD_TYPE_ACTION_ID) {
+            if(filter->op == SKY_QUERY_OP_EQ && filter->int_value > 0 && filter->int_value <= UINT16_MAX) {
+                sky_path_iterator_add_action(iterator, (sky_action_id_t)filter->int_value);
+            }
+        }
+    }
+}
+
+// Calculates the hash of a set of group keys.
+//
+// keys  - The group keys.
+// count - The number of keys.
+//
+// Returns the hash.
+static uint64_t sky_query_result_hash(int64_t *keys, uint32_t count)
+{
+    uint32_t i;
+    uint64_t hash = 14695981039346656037ULL;
+    for(i=0; i<count; i++) {
+        hash ^= (uint64_t)keys[i];
+        hash *= 1099511628211ULL;
+        hash ^= (hash >> 29);
+    }
+    return hash;
+}
+
+// Rebuilds the hash index of a result with a new capacity.
+//
+// result   - The result.
+// capacity - The number of slots in the index. Must be a power of two.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_result_reindex(sky_query_result *result, uint32_t capacity)
+{
+    uint32_t i;
+    uint32_t *index = calloc(capacity, sizeof(*index)); check_mem(index);
+    for(i=0; i<result->count; i++) {
+        uint32_t slot = (uint32_t)sky_query_result_hash(&result->keys[i * result->group_count], result->group_count) & (capacity - 1);
+        while(index[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        index[slot] = i + 1;
+    }
+
+    free(result->index);
+    result->index = index;
+    result->index_capacity = capacity;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Finds the entry for a set of group keys or adds an empty entry for them.
+//
+// result - The result.
+// keys   - The group keys.
+// ret    - A pointer to where the entry's index should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_result_find_or_add(sky_query_result *result,
+                                        int64_t *keys, uint32_t *ret)
+{
+    int rc;
+    uint32_t group_count = result->group_count;
+
+    // A result without groups only has a single entry.
+    if(group_count == 0 && result->count > 0) {
+        *ret = 0;
+        return 0;
+    }
+
+    uint32_t slot = 0;
+    if(group_count > 0) {
+        if(result->index_capacity > 0) {
+            slot = (uint32_t)sky_query_result_hash(keys, group_count) & (result->index_capacity - 1);
+            while(result->index[slot] != 0) {
+                uint32_t entry = result->index[slot] - 1;
+                if(memcmp(&result->keys[entry * group_count], keys, group_count * sizeof(*keys)) == 0) {
+                    *ret = entry;
+                    return 0;
+                }
+                slot = (slot + 1) & (result->index_capacity - 1);
+            }
+        }
+
+        // Keep the index under 70% full.
+        if((result->count + 1) * 10 >= result->index_capacity * 7) {
+            rc = sky_query_result_reindex(result, (result->index_capacity > 0 ? result->index_capacity * 2 : 64));
+            check(rc == 0, "Unable to grow result index");
+            slot = (uint32_t)sky_query_result_hash(keys, group_count) & (result->index_capacity - 1);
+            while(result->index[slot] != 0) {
+                slot = (slot + 1) & (result->index_capacity - 1);
+            }
+        }
+    }
+
+    // Add the entry.
+    if(result->count == result->capacity) {
+        result->capacity = (result->capacity > 0 ? result->capacity * 2 : 16);
+        if(group_count > 0) {
+            result->keys = realloc(result->keys, result->capacity * group_count * sizeof(*result->keys));
+            check_mem(result->keys);
+        }
+        result->aggregates = realloc(result->aggregates, result->capacity * result->selection_count * sizeof(*result->aggregates));
+        check_mem(result->aggregates);
+    }
+    uint32_t entry = result->count++;
+    if(group_count > 0) {
+        memcpy(&result->keys[entry * group_count], keys, group_count * sizeof(*keys));
+        result->index[slot] = entry + 1;
+    }
+    memset(&result->aggregates[entry * result->selection_count], 0, result->selection_count * sizeof(*result->aggregates));
+
+    *ret = entry;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Adds the current event to the result.
+//
+// result - The result.
+// plan   - The query plan.
+// data   - The data object of the current event.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_result_add(sky_query_result *result, sky_query_plan *plan,
+                         void *data)
+{
+    int rc;
+    uint32_t i, entry;
+    int64_t keys[SKY_QUERY_PLAN_MAX_GROUP_COUNT];
+    assert(result != NULL);
+    assert(plan != NULL);
+
+    for(i=0; i<plan->group_count; i++) {
+        keys[i] = plan->group_funcs[i](data, plan->groups[i]->offset);
+    }
+    rc = sky_query_result_find_or_add(result, keys, &entry);
+    check(rc == 0, "Unable to find result entry");
+
+    bool sampled = sky_sample_is_enabled(plan->sample_rate);
+    sky_query_aggregate *aggregates = &result->aggregates[entry * result->selection_count];
+    for(i=0; i<plan->selection_count; i++) {
+        sky_query_selection *selection = &plan->selections[i];
+        sky_query_aggregate *aggregate = &aggregates[i];
+        double value = (selection->func != NULL ? selection->func(data, selection->field->offset) : 0);
+        switch(selection->fn) {
+            case SKY_QUERY_FN_COUNT: {
+                if(sampled) sky_sample_variance_add(&aggregate->variance, result->path_id, 1);
+                break;
+            }
+            case SKY_QUERY_FN_SUM: {
+                aggregate->value += value;
+                if(sampled) sky_sample_variance_add(&aggregate->variance, result->path_id, value);
+                break;
+            }
+            case SKY_QUERY_FN_AVG: aggregate->value += value; break;
+            case SKY_QUERY_FN_MIN: if(aggregate->count == 0 || value < aggregate->value) aggregate->value = value; break;
+            case SKY_QUERY_FN_MAX: if(aggregate->count == 0 || value > aggregate->value) aggregate->value = value; break;
+            case SKY_QUERY_FN_QUANTILE: {
+                if(aggregate->digest == NULL) {
+                    aggregate->digest = sky_tdigest_create(); check_mem(aggregate->digest);
+                }
+                sky_tdigest_add(aggregate->digest, value, 1);
+                break;
+            }
+        }
+        aggregate->count++;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Merges the entries of one result into another.
+//
+// result - The result to merge into.
+// plan   - The query plan both results were created from.
+// other  - The result to merge from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_result_merge(sky_query_result *result, sky_query_plan *plan,
+                           sky_query_result *other)
+{
+    int rc;
+    uint32_t i, j, entry;
+    assert(result != NULL);
+    assert(plan != NULL);
+    assert(other != NULL);
+
+    for(i=0; i<other->count; i++) {
+        rc = sky_query_result_find_or_add(result, &other->keys[i * other->group_count], &entry);
+        check(rc == 0, "Unable to find result entry");
+
+        for(j=0; j<plan->selection_count; j++) {
+            sky_query_aggregate *aggregate = &result->aggregates[entry * result->selection_count + j];
+            sky_query_aggregate *source = &other->aggregates[i * other->selection_count + j];
+            if(source->count == 0) continue;
+            switch(plan->selections[j].fn) {
+                case SKY_QUERY_FN_COUNT: sky_sample_variance_merge(&aggregate->variance, &source->variance); break;
+                case SKY_QUERY_FN_SUM: {
+                    aggregate->value += source->value;
+                    sky_sample_variance_merge(&aggregate->variance, &source->variance);
+                    break;
+                }
+                case SKY_QUERY_FN_AVG: aggregate->value += source->value; break;
+                case SKY_QUERY_FN_MIN: if(aggregate->count == 0 || source->value < aggregate->value) aggregate->value = source->value; break;
+                case SKY_QUERY_FN_MAX: if(aggregate->count == 0 || source->value > aggregate->value) aggregate->value = source->value; break;
+                case SKY_QUERY_FN_QUANTILE: {
+                    if(aggregate->digest == NULL) {
+                        aggregate->digest = sky_tdigest_create(); check_mem(aggregate->digest);
+                    }
+                    sky_tdigest_merge(aggregate->digest, source->digest);
+                    break;
+                }
+            }
+            aggregate->count += source->count;
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Parses an operator name.
+//
+// name - The operator name.
+// ret  - A pointer to where the operator should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_plan_parse_op(bstring name, sky_query_op_e *ret)
+{
+    uint32_t i;
+    for(i=0; i<sizeof(SKY_QUERY_OP_NAMES)/sizeof(*SKY_QUERY_OP_NAMES); i++) {
+        if(biseqcstr(name, SKY_QUERY_OP_NAMES[i]) == 1) {
+            *ret = (sky_query_op_e)i;
+            return 0;
+        }
+    }
+    sentinel("Invalid filter operator: %s", bdata(name));
+
+error:
+    return -1;
+}
+
+// Parses an aggregate function name.
+//
+// name - The function name.
+// ret  - A pointer to where the function should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_plan_parse_fn(bstring name, sky_query_fn_e *ret)
+{
+    uint32_t i;
+    for(i=0; i<sizeof(SKY_QUERY_FN_NAMES)/sizeof(*SKY_QUERY_FN_NAMES); i++) {
+        if(biseqcstr(name, SKY_QUERY_FN_NAMES[i]) == 1) {
+            *ret = (sky_query_fn_e)i;
+            return 0;
+        }
+    }
+    sentinel("Invalid selection function: %s", bdata(name));
+
+error:
+    return -1;
+}
+
+// Deserializes a filter from a file stream.
+//
+//   {"field":"<name>", "op":"==", "value":<value>}
+//
+// filter - The filter.
+// file   - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_plan_unpack_filter(sky_query_filter *filter, FILE *file)
+{
+    int rc;
+    size_t sz;
+    uint32_t i;
+    bstring key = NULL;
+    bstring op = NULL;
+
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read filter map");
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read filter key");
+
+        if(biseq(key, &SKY_QUERY_PLAN_KEY_FIELD) == 1) {
+            rc = sky_minipack_fread_bstring(file, &filter->field_name);
+            check(rc == 0, "Unable to read filter field");
+        }
+        else if(biseq(key, &SKY_QUERY_PLAN_KEY_OP) == 1) {
+            rc = sky_minipack_fread_bstring(file, &op);
+            check(rc == 0, "Unable to read filter operator");
+            rc = sky_query_plan_parse_op(op, &filter->op);
+            check(rc == 0, "Unable to parse filter operator");
+        }
+        else if(biseq(key, &SKY_QUERY_PLAN_KEY_VALUE) == 1) {
+            check(filter->value == NULL, "Duplicate filter value");
+            filter->value = sky_query_argument_create(); check_mem(filter->value);
+            rc = sky_query_argument_unpack(filter->value, file);
+            check(rc == 0, "Unable to read filter value");
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+    check(op != NULL, "Filter operator required");
+
+    bdestroy(op);
+    return 0;
+
+error:
+    bdestroy(key);
+    bdestroy(op);
+    return -1;
+}
+
+// Deserializes a selection from a file stream.
+//
+//   {"name":"<name>", "fn":"sum", "field":"<name>"}
+//
+// Quantile selections also accept the quantile to estimate between 0 and 1
+// which defaults to the median:
+//
+//   {"fn":"quantile", "field":"<name>", "quantile":0.95}
+//
+// selection - The selection.
+// file      - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_plan_unpack_selection(sky_query_selection *selection,
+                                           FILE *file)
+{
+    int rc;
+    size_t sz;
+    uint32_t i;
+    bstring key = NULL;
+    bstring fn = NULL;
+    sky_query_argument *quantile = NULL;
+
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read selection map");
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read selection key");
+
+        if(biseq(key, &SKY_QUERY_PLAN_KEY_NAME) == 1) {
+            rc = sky_minipack_fread_bstring(file, &selection->name);
+            check(rc == 0, "Unable to read selection name");
+        }
+        else if(biseq(key, &SKY_QUERY_PLAN_KEY_FN) == 1) {
+            rc = sky_minipack_fread_bstring(file, &fn);
+            check(rc == 0, "Unable to read selection function");
+            rc = sky_query_plan_parse_fn(fn, &selection->fn);
+            check(rc == 0, "Unable to parse selection function");
+        }
+        else if(biseq(key, &SKY_QUERY_PLAN_KEY_FIELD) == 1) {
+            rc = sky_minipack_fread_bstring(file, &selection->field_name);
+            check(rc == 0, "Unable to read selection field");
+        }
+        else if(biseq(key, &SKY_QUERY_PLAN_KEY_QUANTILE) == 1) {
+            check(quantile == NULL, "Duplicate selection quantile");
+            quantile = sky_query_argument_create(); check_mem(quantile);
+            rc = sky_query_argument_unpack(quantile, file);
+            check(rc == 0, "Unable to read selection quantile");
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+    check(fn != NULL, "Selection function required");
+
+    // Quantiles default to the median.
+    selection->quantile = 0.5;
+    if(quantile != NULL) {
+        switch(quantile->data_type) {
+            case SKY_DATA_TYPE_INT: selection->quantile = (double)quantile->int_value; break;
+            case SKY_DATA_TYPE_DOUBLE: selection->quantile = quantile->double_value; break;
+            default: sentinel("Selection quantile must be a number");
+        }
+        check(selection->quantile >= 0 && selection->quantile <= 1, "Selection quantile must be between 0 and 1: %f", selection->quantile);
+    }
+
+    // Selections are named after their function by default.
+    if(blength(selection->name) == 0) {
+        bdestroy(selection->name);
+        selection->name = bfromcstr(SKY_QUERY_FN_NAMES[selection->fn]);
+        check_mem(selection->name);
+    }
+
+    bdestroy(fn);
+    sky_query_argument_free(quantile);
+    return 0;
+
+error:
+    bdestroy(key);
+    bdestroy(fn);
+    sky_query_argument_free(quantile);
+    return -1;
+}
+
+// Deserializes the definition of a query plan from a file stream.
+//
+//   {"filters":[...], "groups":["<name>", ...], "selections":[...], "sample":0.1}
+//
+// plan - The query plan.
+// file - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_plan_unpack(sky_query_plan *plan, FILE *file)
+{
+    int rc;
+    size_t sz;
+    bstring key = NULL;
+    assert(plan != NULL);
+    assert(file != NULL);
+
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read map");
+
+    uint32_t i, j;
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read map key");
+
+        if(biseq(key, &SKY_QUERY_PLAN_KEY_FILTERS) == 1) {
+            uint32_t count = minipack_fread_array(file, &sz);
+            check(sz > 0, "Unable to read filters array");
+            check(plan->filters == NULL, "Duplicate filters key");
+            if(count > 0) {
+                plan->filters = calloc(count, sizeof(*plan->filters)); check_mem(plan->filters);
+            }
+            for(j=0; j<count; j++) {
+                plan->filter_count++;
+                rc = sky_query_plan_unpack_filter(&plan->filters[j], file);
+                check(rc == 0, "Unable to read filter");
+            }
+        }
+        else if(biseq(key, &SKY_QUERY_PLAN_KEY_GROUPS) == 1) {
+            uint32_t count = minipack_fread_array(file, &sz);
+            check(sz > 0, "Unable to read groups array");
+            check(plan->group_names == NULL, "Duplicate groups key");
+            if(count > 0) {
+                plan->group_names = calloc(count, sizeof(*plan->group_names)); check_mem(plan->group_names);
+            }
+            for(j=0; j<count; j++) {
+                plan->group_count++;
+                rc = sky_minipack_fread_bstring(file, &plan->group_names[j]);
+                check(rc == 0, "Unable to read group");
+            }
+        }
+        else if(biseq(key, &SKY_QUERY_PLAN_KEY_SELECTIONS) == 1) {
+            uint32_t count = minipack_fread_array(file, &sz);
+            check(sz > 0, "Unable to read selections array");
+            check(plan->selections == NULL, "Duplicate selections key");
+            if(count > 0) {
+                plan->selections = calloc(count, sizeof(*plan->selections)); check_mem(plan->selections);
+            }
+            for(j=0; j<count; j++) {
+                plan->selection_count++;
+                rc = sky_query_plan_unpack_selection(&plan->selections[j], file);
+                check(rc == 0, "Unable to read selection");
+            }
+        }
+        else if(biseq(key, &SKY_QUERY_PLAN_KEY_SAMPLE) == 1) {
+            rc = sky_sample_unpack_rate(&plan->sample_rate, file);
+            check(rc == 0, "Unable to read sample rate");
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+// Writes a number the same way that Lua numbers are encoded so that results
+// match those of an equivalent script. Whole numbers are written as
+// integers and other numbers are written as floats if no precision is lost.
+//
+// file  - The file stream to write to.
+// value - The number.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_result_fwrite_number(FILE *file, double value)
+{
+    size_t sz;
+    if(value >= -9.2e18 && value <= 9.2e18 && (double)((int64_t)value) == value) {
+        if(value >= 0) {
+            check(minipack_fwrite_uint(file, (uint64_t)value, &sz) == 0, "Unable to write number");
+        }
+        else {
+            check(minipack_fwrite_int(file, (int64_t)value, &sz) == 0, "Unable to write number");
+        }
+    }
+    else if((double)((float)value) == value) {
+        check(minipack_fwrite_float(file, (float)value, &sz) == 0, "Unable to write number");
+    }
+    else {
+        check(minipack_fwrite_double(file, value, &sz) == 0, "Unable to write number");
+    }
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes a group key in the type of its field.
+//
+// file  - The file stream to write to.
+// field - The group field.
+// key   - The key.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_result_fwrite_key(FILE *file, sky_query_field *field,
+                                       int64_t key)
+{
+    size_t sz;
+    struct tagbstring empty = bsStatic("");
+    switch(field->type) {
+        case SKY_QUERY_FIELD_TYPE_DOUBLE: {
+            double value;
+            memcpy(&value, &key, sizeof(value));
+            return sky_query_result_fwrite_number(file, value);
+        }
+        case SKY_QUERY_FIELD_TYPE_BOOLEAN: {
+            check(minipack_fwrite_bool(file, key != 0, &sz) == 0, "Unable to write key");
+            break;
+        }
+        case SKY_QUERY_FIELD_TYPE_DICTIONARY: {
+            bstring value = (key >= 1 && key <= field->dictionary_count ? field->dictionary[key-1] : &empty);
+            check(sky_minipack_fwrite_bstring(file, value) == 0, "Unable to write key");
+            break;
+        }
+        default: {
+            return sky_query_result_fwrite_number(file, (double)key);
+        }
+    }
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes the selections of a single entry as a map.
+//
+// result     - The result.
+// plan       - The query plan.
+// aggregates - The aggregates of the entry or null if nothing matched.
+// file       - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_result_fwrite_entry(sky_query_result *result,
+                                         sky_query_plan *plan,
+                                         sky_query_aggregate *aggregates,
+                                         FILE *file)
+{
+    int rc;
+    size_t sz;
+    uint32_t i;
+    bstring margin_name = NULL;
+
+    // Sampled counts and sums are followed by their margin of error.
+    double rate = plan->sample_rate;
+    bool sampled = sky_sample_is_enabled(rate);
+    uint32_t key_count = result->selection_count;
+    for(i=0; i<plan->selection_count && sampled; i++) {
+        if(plan->selections[i].fn == SKY_QUERY_FN_COUNT || plan->selections[i].fn == SKY_QUERY_FN_SUM) {
+            key_count++;
+        }
+    }
+
+    check(minipack_fwrite_map(file, key_count, &sz) == 0, "Unable to write selection map");
+    for(i=0; i<plan->selection_count; i++) {
+        sky_query_selection *selection = &plan->selections[i];
+        uint64_t count = (aggregates != NULL ? aggregates[i].count : 0);
+        double value = (aggregates != NULL ? aggregates[i].value : 0);
+
+        check(sky_minipack_fwrite_bstring(file, selection->name) == 0, "Unable to write selection name");
+        switch(selection->fn) {
+            case SKY_QUERY_FN_COUNT: rc = (sampled ? sky_query_result_fwrite_number(file, round(count / rate)) : minipack_fwrite_uint(file, count, &sz)); break;
+            case SKY_QUERY_FN_SUM: rc = sky_query_result_fwrite_number(file, value / rate); break;
+            case SKY_QUERY_FN_AVG: rc = (count > 0 ? sky_query_result_fwrite_number(file, value / count) : minipack_fwrite_nil(file, &sz)); break;
+            case SKY_QUERY_FN_QUANTILE: rc = (count > 0 ? sky_query_result_fwrite_number(file, sky_tdigest_quantile(aggregates[i].digest, selection->quantile)) : minipack_fwrite_nil(file, &sz)); break;
+            default: rc = (count > 0 ? sky_query_result_fwrite_number(file, value) : minipack_fwrite_nil(file, &sz)); break;
+        }
+        check(rc == 0, "Unable to write selection value");
+
+        if(sampled && (selection->fn == SKY_QUERY_FN_COUNT || selection->fn == SKY_QUERY_FN_SUM)) {
+            double sum_sq = (aggregates != NULL ? sky_sample_variance_sum_sq(&aggregates[i].variance) : 0);
+            margin_name = bformat("%s_margin", bdatae(selection->name, "")); check_mem(margin_name);
+            check(sky_minipack_fwrite_bstring(file, margin_name) == 0, "Unable to write margin name");
+            check(sky_query_result_fwrite_number(file, sky_sample_margin(sum_sq, rate)) == 0, "Unable to write margin");
+            bdestroy(margin_name);
+            margin_name = NULL;
+        }
+    }
+    return 0;
+
+error:
+    bdestroy(margin_name);
+    return -1;
+}
+
+// Compares the group keys of two entries for sorting.
+static int sky_query_result_compare_entries(const void *a, const void *b,
+                                            void *_result)
+{
+    uint32_t i;
+    sky_query_result *result = (sky_query_result*)_result;
+    int64_t *keys_a = &result->keys[*((uint32_t*)a) * result->group_count];
+    int64_t *keys_b = &result->keys[*((uint32_t*)b) * result->group_count];
+    for(i=0; i<result->group_count; i++) {
+        if(keys_a[i] != keys_b[i]) {
+            return (keys_a[i] < keys_b[i] ? -1 : 1);
+        }
+    }
+    return 0;
+}
+
+// Writes a range of sorted entries as a map nested by group. Each level of
+// the map is keyed by the values of one group field.
+//
+// result  - The result.
+// plan    - The query plan.
+// entries - The entry indices sorted by group keys.
+// start   - The index of the first entry in the range.
+// end     - The index after the last entry in the range.
+// level   - The group level of the map.
+// file    - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_query_result_fwrite_level(sky_query_result *result,
+                                         sky_query_plan *plan,
+                                         uint32_t *entries, uint32_t start,
+                                         uint32_t end, uint32_t level,
+                                         FILE *file)
+{
+    int rc;
+    size_t sz;
+    uint32_t i;
+    uint32_t group_count = result->group_count;
+    #define SKY_QUERY_RESULT_KEY(INDEX) result->keys[entries[INDEX] * group_count + level]
+
+    // Count the distinct keys at this level.
+    uint32_t key_count = 0;
+    for(i=start; i<end; i++) {
+        if(i == start || SKY_QUERY_RESULT_KEY(i) != SKY_QUERY_RESULT_KEY(i-1)) {
+            key_count++;
+        }
+    }
+    check(minipack_fwrite_map(file, key_count, &sz) == 0, "Unable to write group map");
+
+    // Write each run of entries that share a key.
+    uint32_t run_start = start;
+    while(run_start < end) {
+        uint32_t run_end = run_start + 1;
+        while(run_end < end && SKY_QUERY_RESULT_KEY(run_end) == SKY_QUERY_RESULT_KEY(run_start)) {
+            run_end++;
+        }
+
+        rc = sky_query_result_fwrite_key(file, plan->groups[level], SKY_QUERY_RESULT_KEY(run_start));
+        check(rc == 0, "Unable to write group key");
+        if(level == group_count - 1) {
+            rc = sky_query_result_fwrite_entry(result, plan, &result->aggregates[entries[run_start] * result->selection_count], file);
+            check(rc == 0, "Unable to write entry");
+        }
+        else {
+            rc = sky_query_result_fwrite_level(result, plan, entries, run_start, run_end, level + 1, file);
+            check(rc == 0, "Unable to write group level");
+        }
+
+        run_start = run_end;
+    }
+
+    #undef SKY_QUERY_RESULT_KEY
+    return 0;
+
+error:
+    return -1;
+}
+
+// Serializes a result to a file stream. A result without groups is written
+// as a map of selection names to values. Otherwise the selections are
+// nested in a map for each group field.
+//
+// result - The result.
+// plan   - The query plan.
+// file   - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_query_result_pack(sky_query_result *result, sky_query_plan *plan,
+                          FILE *file)
+{
+    int rc;
+    size_t sz;
+    uint32_t i;
+    uint32_t *entries = NULL;
+    assert(result != NULL);
+    assert(plan != NULL);
+    assert(file != NULL);
+
+    if(result->group_count == 0) {
+        rc = sky_query_result_fwrite_entry(result, plan, (result->count > 0 ? result->aggregates : NULL), file);
+        check(rc == 0, "Unable to write entry");
+    }
+    else if(result->count == 0) {
+        check(minipack_fwrite_map(file, 0, &sz) == 0, "Unable to write empty map");
+    }
+    else {
+        entries = calloc(result->count, sizeof(*entries)); check_mem(entries);
+        for(i=0; i<result->count; i++) {
+            entries[i] = i;
+        }
+        qsort_r(entries, result->count, sizeof(*entries), sky_query_result_compare_entries, result);
+
+        rc = sky_query_result_fwrite_level(result, plan, entries, 0, result->count, 0, file);
+        check(rc == 0, "Unable to write groups");
+    }
+
+    free(entries);
+    return 0;
+
+error:
+    free(entries);
+    return -1;
+}
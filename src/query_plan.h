@@ -0,0 +1,234 @@
+#ifndef _sky_query_plan_h
+#define _sky_query_plan_h
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_query_plan sky_query_plan;
+typedef struct sky_query_field sky_query_field;
+typedef struct sky_query_filter sky_query_filter;
+typedef struct sky_query_selection sky_query_selection;
+typedef struct sky_query_result sky_query_result;
+
+#include "bstring.h"
+#include "types.h"
+#include "sky_string.h"
+#include "query.h"
+#include "property_file.h"
+#include "data_descriptor.h"
+#include "tdigest.h"
+#include "sample.h"
+#include "path_iterator.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A query plan is the compiled form of a declarative aggregation. It is
+// made up of a list of filters that an event must pass, a list of fields to
+// group matching events by and a list of selections to calculate for each
+// group. Filters are ANDed together.
+//
+// When a plan is compiled, every field it references is resolved against
+// the table's properties and given a slot in a data object that only holds
+// those fields. Each filter is compiled into a function pointer for its
+// field type and operator and group keys and selection values are read
+// through function pointers for their field type. Events are decoded
+// straight into the data object by the cursor so no scripting runtime is
+// involved while scanning.
+//
+// Matching events are accumulated into a result that is keyed by the values
+// of the group fields. Results from separate scans can be merged together
+// and are only converted to MessagePack once the final result is written.
+// Quantiles are estimated from a t-digest in each group so that memory
+// stays bounded no matter how many events match.
+//
+// A plan can be limited to a sample of objects. Counts and sums are then
+// scaled up by the sample rate and written along with their margin of
+// error. The result's path id must be changed for each path that is added
+// so that each object's contribution to the variance can be found.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The maximum number of fields that a plan can group by.
+#define SKY_QUERY_PLAN_MAX_GROUP_COUNT 4
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// The types of field that a plan can reference.
+typedef enum {
+    SKY_QUERY_FIELD_TYPE_TIMESTAMP  = 1,
+    SKY_QUERY_FIELD_TYPE_ACTION_ID  = 2,
+    SKY_QUERY_FIELD_TYPE_INT        = 3,
+    SKY_QUERY_FIELD_TYPE_DOUBLE     = 4,
+    SKY_QUERY_FIELD_TYPE_BOOLEAN    = 5,
+    SKY_QUERY_FIELD_TYPE_STRING     = 6,
+    SKY_QUERY_FIELD_TYPE_DICTIONARY = 7,
+} sky_query_field_type_e;
+
+// The comparison operators that a filter can use.
+typedef enum {
+    SKY_QUERY_OP_EQ = 0,
+    SKY_QUERY_OP_NE = 1,
+    SKY_QUERY_OP_LT = 2,
+    SKY_QUERY_OP_LE = 3,
+    SKY_QUERY_OP_GT = 4,
+    SKY_QUERY_OP_GE = 5,
+} sky_query_op_e;
+
+// The aggregate functions that a selection can calculate.
+typedef enum {
+    SKY_QUERY_FN_COUNT = 0,
+    SKY_QUERY_FN_SUM   = 1,
+    SKY_QUERY_FN_MIN   = 2,
+    SKY_QUERY_FN_MAX   = 3,
+    SKY_QUERY_FN_AVG   = 4,
+    SKY_QUERY_FN_QUANTILE = 5,
+} sky_query_fn_e;
+
+// Defines a function that checks if an event passes a filter.
+typedef bool (*sky_query_filter_func_t)(void *data, sky_query_filter *filter);
+
+// Defines a function that reads a field from an event as a group key.
+typedef int64_t (*sky_query_key_func_t)(void *data, uint32_t offset);
+
+// Defines a function that reads a field from an event as a number.
+typedef double (*sky_query_number_func_t)(void *data, uint32_t offset);
+
+struct sky_query_field {
+    bstring name;
+    sky_query_field_type_e type;
+    sky_property_id_t property_id;
+    uint32_t offset;
+    bstring *dictionary;
+    uint32_t dictionary_count;
+};
+
+struct sky_query_filter {
+    bstring field_name;
+    sky_query_op_e op;
+    sky_query_argument *value;
+    sky_query_field *field;
+    sky_query_filter_func_t func;
+    uint32_t offset;
+    int64_t int_value;
+    double double_value;
+    sky_string string_value;
+};
+
+struct sky_query_selection {
+    bstring name;
+    sky_query_fn_e fn;
+    bstring field_name;
+    sky_query_field *field;
+    sky_query_number_func_t func;
+    double quantile;
+};
+
+struct sky_query_plan {
+    sky_query_filter *filters;
+    uint32_t filter_count;
+    bstring *group_names;
+    uint32_t group_count;
+    sky_query_selection *selections;
+    uint32_t selection_count;
+    sky_query_field **fields;
+    uint32_t field_count;
+    sky_query_field *groups[SKY_QUERY_PLAN_MAX_GROUP_COUNT];
+    sky_query_key_func_t group_funcs[SKY_QUERY_PLAN_MAX_GROUP_COUNT];
+    sky_data_descriptor *data_descriptor;
+    double sample_rate;
+};
+
+// The running state of a single selection within a group. Quantile
+// selections keep a digest of their values instead of a single value and
+// counts and sums track their variance when the plan is sampled.
+typedef struct {
+    uint64_t count;
+    double value;
+    sky_tdigest *digest;
+    sky_sample_variance variance;
+} sky_query_aggregate;
+
+struct sky_query_result {
+    uint64_t path_id;
+    uint32_t group_count;
+    uint32_t selection_count;
+    uint32_t count;
+    uint32_t capacity;
+    int64_t *keys;
+    sky_query_aggregate *aggregates;
+    uint32_t *index;
+    uint32_t index_capacity;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_query_plan *sky_query_plan_create();
+
+void sky_query_plan_free(sky_query_plan *plan);
+
+sky_query_result *sky_query_result_create(sky_query_plan *plan);
+
+void sky_query_result_free(sky_query_result *result);
+
+//--------------------------------------
+// Compilation
+//--------------------------------------
+
+int sky_query_plan_compile(sky_query_plan *plan,
+    sky_property_file *property_file);
+
+//--------------------------------------
+// Execution
+//--------------------------------------
+
+bool sky_query_plan_matches(sky_query_plan *plan, void *data);
+
+bool sky_query_filters_match(sky_query_filter *filters, uint32_t count,
+    void *data);
+
+void sky_query_filters_prune(sky_query_filter *filters, uint32_t count,
+    sky_path_iterator *iterator);
+
+int sky_query_result_add(sky_query_result *result, sky_query_plan *plan,
+    void *data);
+
+int sky_query_result_merge(sky_query_result *result, sky_query_plan *plan,
+    sky_query_result *other);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_query_plan_unpack(sky_query_plan *plan, FILE *file);
+
+int sky_query_plan_unpack_filter(sky_query_filter *filter, FILE *file);
+
+int sky_query_result_pack(sky_query_result *result, sky_query_plan *plan,
+    FILE *file);
+
+#endif
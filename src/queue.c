@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <assert.h>
+
+#if defined(linux) || defined(__linux__)
+#include <sys/eventfd.h>
+#define SKY_QUEUE_EVENTFD 1
+#endif
+
+#include "queue.h"
+#include "dbg.h"
+#include "mem.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a queue. Slots are pushed and popped in order using a sequence
+// number on each slot so producers only contend on the head position.
+//
+// capacity - The minimum number of slots. This is rounded up to a power of
+//            two.
+//
+// Returns a reference to the new queue if successful. Otherwise returns
+// null.
+sky_queue *sky_queue_create(uint32_t capacity)
+{
+    sky_queue *queue = calloc(1, sizeof(sky_queue)); check_mem(queue);
+    queue->fds[0] = queue->fds[1] = -1;
+
+    uint64_t slot_count = 2;
+    while(slot_count < capacity) {
+        slot_count *= 2;
+    }
+    queue->slots = calloc(slot_count, sizeof(*queue->slots));
+    check_mem(queue->slots);
+    queue->mask = slot_count - 1;
+
+    uint64_t i;
+    for(i=0; i<slot_count; i++) {
+        queue->slots[i].sequence = i;
+    }
+
+    // Create the descriptor that sleeping consumers wait on.
+#ifdef SKY_QUEUE_EVENTFD
+    queue->fds[0] = queue->fds[1] = eventfd(0, 0);
+    check(queue->fds[0] != -1, "Unable to create queue event");
+#else
+    check(pipe(queue->fds) == 0, "Unable to create queue pipe");
+    check(fcntl(queue->fds[1], F_SETFL, O_NONBLOCK) == 0, "Unable to set queue pipe to non-blocking");
+#endif
+
+    return queue;
+
+error:
+    sky_queue_free(queue);
+    return NULL;
+}
+
+// Frees a queue. Any values left in the queue are not freed.
+//
+// queue - The queue.
+//
+// Returns nothing.
+void sky_queue_free(sky_queue *queue)
+{
+    if(queue) {
+        if(queue->fds[0] != -1) close(queue->fds[0]);
+        if(queue->fds[1] != -1 && queue->fds[1] != queue->fds[0]) close(queue->fds[1]);
+        free(queue->slots);
+        free(queue);
+    }
+}
+
+
+//--------------------------------------
+// Push / Pop
+//--------------------------------------
+
+// Wakes a consumer that is sleeping on the queue.
+//
+// queue - The queue.
+//
+// Returns nothing.
+static void sky_queue_wake(sky_queue *queue)
+{
+#ifdef SKY_QUEUE_EVENTFD
+    uint64_t count = 1;
+    ssize_t sz = write(queue->fds[1], &count, sizeof(count));
+#else
+    char byte = 0;
+    ssize_t sz = write(queue->fds[1], &byte, sizeof(byte));
+#endif
+    (void)sz;
+}
+
+// Adds a value to the end of the queue. This can be called from any thread.
+// If the queue is full then the caller yields until a slot is free.
+//
+// queue - The queue.
+// value - The value to push. This can be null.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_queue_push(sky_queue *queue, void *value)
+{
+    assert(queue != NULL);
+
+    // Claim the slot at the head.
+    sky_queue_slot *slot;
+    uint64_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    while(true) {
+        slot = &queue->slots[pos & queue->mask];
+        uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)sequence - (int64_t)pos;
+        if(diff == 0) {
+            if(__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else {
+            if(diff < 0) {
+                sched_yield();
+            }
+            pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Publish the value and wake the consumer if it is sleeping.
+    slot->value = value;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&queue->waiting, __ATOMIC_RELAXED)) {
+        sky_queue_wake(queue);
+    }
+
+    return 0;
+}
+
+// Removes the value at the front of the queue if there is one. This must
+// only be called from the consumer thread.
+//
+// queue - The queue.
+// value - A pointer to where the value should be returned.
+//
+// Returns true if a value was popped.
+bool sky_queue_try_pop(sky_queue *queue, void **value)
+{
+    assert(queue != NULL);
+    assert(value != NULL);
+
+    uint64_t pos = queue->tail;
+    sky_queue_slot *slot = &queue->slots[pos & queue->mask];
+    uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if(sequence != pos + 1) {
+        *value = NULL;
+        return false;
+    }
+
+    *value = slot->value;
+    __atomic_store_n(&slot->sequence, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    queue->tail = pos + 1;
+    return true;
+}
+
+// Removes the value at the front of the queue and waits for one if the queue
+// is empty. This must only be called from the consumer thread.
+//
+// queue - The queue.
+// value - A pointer to where the value should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_queue_pop(sky_queue *queue, void **value)
+{
+    assert(queue != NULL);
+    assert(value != NULL);
+
+    while(true) {
+        if(sky_queue_try_pop(queue, value)) {
+            return 0;
+        }
+
+        // Announce that we're going to sleep and check again so a push that
+        // raced with the announcement is not missed.
+        __atomic_store_n(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if(sky_queue_try_pop(queue, value)) {
+            __atomic_store_n(&queue->waiting, 0, __ATOMIC_RELAXED);
+            return 0;
+        }
+
+#ifdef SKY_QUEUE_EVENTFD
+        uint64_t count;
+#else
+        char count[64];
+#endif
+        ssize_t sz = read(queue->fds[0], &count, sizeof(count));
+        check(sz > 0 || errno == EINTR, "Unable to wait on queue");
+        __atomic_store_n(&queue->waiting, 0, __ATOMIC_RELAXED);
+    }
+
+error:
+    *value = NULL;
+    return -1;
+}
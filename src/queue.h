@@ -0,0 +1,79 @@
+#ifndef _sky_queue_h
+#define _sky_queue_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_queue sky_queue;
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A queue passes pointers between threads in the same process. It is a
+// bounded ring buffer that any number of threads can push to without
+// locking but only a single thread can pop from. A consumer that finds the
+// queue empty sleeps on an event descriptor until a producer wakes it.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The default number of slots in a queue.
+#define SKY_QUEUE_DEFAULT_CAPACITY 4096
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+typedef struct {
+    volatile uint64_t sequence;
+    void *value;
+} sky_queue_slot;
+
+struct sky_queue {
+    sky_queue_slot *slots;
+    uint64_t mask;
+    volatile uint64_t head;
+    char _pad0[64];
+    volatile uint64_t tail;
+    volatile int waiting;
+    char _pad1[64];
+    int fds[2];
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_queue *sky_queue_create(uint32_t capacity);
+
+void sky_queue_free(sky_queue *queue);
+
+//--------------------------------------
+// Push / Pop
+//--------------------------------------
+
+int sky_queue_push(sky_queue *queue, void *value);
+
+int sky_queue_pop(sky_queue *queue, void **value);
+
+bool sky_queue_try_pop(sky_queue *queue, void **value);
+
+#endif
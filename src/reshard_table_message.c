@@ -0,0 +1,430 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "types.h"
+#include "reshard_table_message.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+struct tagbstring SKY_RESHARD_TABLE_MESSAGE_TABLET_COUNT_STR = bsStatic("tabletCount");
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a 'reshard_table' message object.
+//
+// Returns a new message.
+sky_reshard_table_message *sky_reshard_table_message_create()
+{
+    sky_reshard_table_message *message = NULL;
+    message = calloc(1, sizeof(sky_reshard_table_message)); check_mem(message);
+    return message;
+
+error:
+    sky_reshard_table_message_free(message);
+    return NULL;
+}
+
+// Frees a 'reshard_table' message object from memory.
+//
+// message - The message object to be freed.
+//
+// Returns nothing.
+void sky_reshard_table_message_free(sky_reshard_table_message *message)
+{
+    if(message) {
+        message->table = NULL;
+        free(message);
+    }
+}
+
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+// Creates a message handler for the 'Reshard Table' message.
+//
+// Returns a message handler.
+sky_message_handler *sky_reshard_table_message_handler_create()
+{
+    sky_message_handler *handler = sky_message_handler_create(); check_mem(handler);
+    handler->scope = SKY_MESSAGE_HANDLER_SCOPE_TABLE;
+    handler->name = bfromcstr("reshard_table");
+    handler->process = sky_reshard_table_message_process;
+    return handler;
+
+error:
+    sky_message_handler_free(handler);
+    return NULL;
+}
+
+// Creates the tablets for a new layout and delegates copying the objects of
+// each existing tablet to a worker. Copying runs in rounds on the servlet that
+// owns the tablet so that other messages continue to be processed. The server
+// switches the table over to the new layout once the copy has finished.
+//
+// server - The server.
+// header - The message header.
+// table  - The table the message is working against
+// input  - The input file stream.
+// output - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_reshard_table_message_process(sky_server *server,
+                                      sky_message_header *header,
+                                      sky_table *table,
+                                      FILE *input, FILE *output)
+{
+    int rc = 0;
+    size_t sz;
+    sky_reshard_table_message *message = NULL;
+    sky_worker *worker = NULL;
+    assert(header != NULL);
+    assert(table != NULL);
+    assert(input != NULL);
+    assert(output != NULL);
+
+    struct tagbstring status_str = bsStatic("status");
+    struct tagbstring error_str = bsStatic("error");
+    struct tagbstring message_str = bsStatic("message");
+    struct tagbstring in_progress_str = bsStatic("Table is already being resharded");
+
+    // Parse message.
+    message = sky_reshard_table_message_create(); check_mem(message);
+    message->table = table;
+    rc = sky_reshard_table_message_unpack(message, input);
+    check(rc == 0, "Unable to unpack 'reshard_table' message");
+    check(message->tablet_count > 0, "Tablet count required");
+
+    // Only one reshard can run against a table at a time.
+    if(table->reshard != NULL) {
+        // Return.
+        //   {status:"error", message:""}
+        minipack_fwrite_map(output, 2, &sz);
+        check(sz > 0, "Unable to write output");
+        check(sky_minipack_fwrite_bstring(output, &status_str) == 0, "Unable to write status key");
+        check(sky_minipack_fwrite_bstring(output, &error_str) == 0, "Unable to write status value");
+        check(sky_minipack_fwrite_bstring(output, &message_str) == 0, "Unable to write message key");
+        check(sky_minipack_fwrite_bstring(output, &in_progress_str) == 0, "Unable to write message");
+
+        if(!header->multi) {
+            fclose(input);
+            fclose(output);
+        }
+        sky_reshard_table_message_free(message);
+        return 0;
+    }
+
+    // Create the tablets of the new layout.
+    rc = sky_table_begin_reshard(table, message->tablet_count);
+    check(rc == 0, "Unable to begin reshard: %s", bdata(table->path));
+
+    // Create worker.
+    worker = sky_worker_create(); check_mem(worker);
+    worker->pool = server->worker_pool;
+    worker->map = sky_reshard_table_message_worker_map;
+    worker->map_free = sky_reshard_table_message_worker_map_free;
+    worker->requeue = sky_reshard_table_message_worker_requeue;
+    worker->reduce = sky_reshard_table_message_worker_reduce;
+    worker->write = sky_reshard_table_message_worker_write;
+    worker->free = sky_reshard_table_message_worker_free;
+    worker->input = input;
+    worker->output = output;
+    worker->data = (void*)message;
+
+    // Attach servlets.
+    rc = sky_server_get_table_servlets(server, table, &worker->servlets, &worker->servlet_count);
+    check(rc == 0, "Unable to copy servlets to worker");
+
+    // Start worker.
+    rc = sky_worker_start(worker);
+    check(rc == 0, "Unable to start worker");
+
+    return 0;
+
+error:
+    if(table->reshard != NULL) {
+        sky_table_set_reshard_state(table, SKY_TABLE_RESHARD_STATE_FAILED);
+    }
+    sky_reshard_table_message_free(message);
+    if(worker) worker->data = NULL;
+    sky_worker_free(worker);
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Serializes a 'reshard_table' message to a file stream.
+//
+// message - The message.
+// file    - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_reshard_table_message_pack(sky_reshard_table_message *message,
+                                   FILE *file)
+{
+    size_t sz;
+    check(message != NULL, "Message required");
+    check(file != NULL, "File stream required");
+
+    // Map
+    minipack_fwrite_map(file, 1, &sz);
+    check(sz > 0, "Unable to write map");
+
+    // Tablet count
+    check(sky_minipack_fwrite_bstring(file, &SKY_RESHARD_TABLE_MESSAGE_TABLET_COUNT_STR) == 0, "Unable to write tablet count key");
+    minipack_fwrite_uint(file, message->tablet_count, &sz);
+    check(sz > 0, "Unable to write tablet count value");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Deserializes a 'reshard_table' message from a file stream.
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_reshard_table_message_unpack(sky_reshard_table_message *message,
+                                     FILE *file)
+{
+    int rc;
+    size_t sz;
+    bstring key = NULL;
+    check(message != NULL, "Message required");
+    check(file != NULL, "File stream required");
+
+    // Map
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read map");
+
+    // Map items
+    uint32_t i;
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read map key");
+
+        if(biseq(key, &SKY_RESHARD_TABLE_MESSAGE_TABLET_COUNT_STR)) {
+            message->tablet_count = (uint32_t)minipack_fread_uint(file, &sz);
+            check(sz > 0, "Unable to read tablet count");
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+// Copies the next batch of objects from a tablet into the new layout. Writes
+// to the tablet are tracked from the first round so that objects which change
+// after being copied can be copied again during the switchover.
+//
+// worker - The worker.
+// tablet - The tablet to work against.
+// ret    - A pointer to the copy position of the tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_reshard_table_message_worker_map(sky_worker *worker, sky_tablet *tablet,
+                                         void **ret)
+{
+    int rc;
+    bstring *object_ids = NULL;
+    uint32_t object_id_count = 0;
+    assert(worker != NULL);
+    assert(tablet != NULL);
+    assert(ret != NULL);
+
+    sky_reshard_table_message *message = (sky_reshard_table_message*)worker->data;
+
+    // Start tracking changes on the first round.
+    sky_reshard_table_message_cursor *cursor = *ret;
+    if(cursor == NULL) {
+        cursor = calloc(1, sizeof(*cursor)); check_mem(cursor);
+        *ret = cursor;
+        tablet->track_changes = true;
+    }
+
+    // Copy the next batch of objects.
+    rc = sky_tablet_get_object_ids(tablet, cursor->object_id, SKY_RESHARD_TABLE_MESSAGE_BATCH_SIZE, &object_ids, &object_id_count);
+    check(rc == 0, "Unable to retrieve object ids: %s", bdata(tablet->path));
+
+    uint32_t i;
+    for(i=0; i<object_id_count; i++) {
+        sky_tablet *target = NULL;
+        rc = sky_table_get_reshard_target(message->table, object_ids[i], &target);
+        check(rc == 0, "Unable to determine reshard target");
+        rc = sky_tablet_copy_object(tablet, object_ids[i], target);
+        check(rc == 0, "Unable to copy object: %s", bdata(object_ids[i]));
+    }
+
+    // Move the cursor past the last copied object.
+    if(object_id_count > 0) {
+        bdestroy(cursor->object_id);
+        cursor->object_id = object_ids[object_id_count-1];
+        object_ids[object_id_count-1] = NULL;
+    }
+    cursor->done = (object_id_count < SKY_RESHARD_TABLE_MESSAGE_BATCH_SIZE);
+
+    for(i=0; i<object_id_count; i++) {
+        bdestroy(object_ids[i]);
+    }
+    free(object_ids);
+    return 0;
+
+error:
+    if(cursor) cursor->error = true;
+    for(i=0; i<object_id_count; i++) {
+        bdestroy(object_ids[i]);
+    }
+    free(object_ids);
+    return -1;
+}
+
+// Frees the copy position of a tablet.
+//
+// data - The cursor.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_reshard_table_message_worker_map_free(void *data)
+{
+    sky_reshard_table_message_cursor *cursor = (sky_reshard_table_message_cursor*)data;
+    if(cursor) {
+        bdestroy(cursor->object_id);
+        free(cursor);
+    }
+    return 0;
+}
+
+// Determines if a tablet still has objects left to copy.
+//
+// worker - The worker.
+// data   - The cursor.
+//
+// Returns true if the worklet should run another round.
+bool sky_reshard_table_message_worker_requeue(sky_worker *worker, void *data)
+{
+    assert(worker != NULL);
+    sky_reshard_table_message_cursor *cursor = (sky_reshard_table_message_cursor*)data;
+    return (cursor != NULL && !cursor->done && !cursor->error);
+}
+
+// Records any copy failure of a tablet.
+//
+// worker - The worker.
+// data   - The cursor.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_reshard_table_message_worker_reduce(sky_worker *worker, void *data)
+{
+    assert(worker != NULL);
+    assert(data != NULL);
+
+    sky_reshard_table_message *message = (sky_reshard_table_message*)worker->data;
+    sky_reshard_table_message_cursor *cursor = (sky_reshard_table_message_cursor*)data;
+    if(cursor->error) {
+        message->error = true;
+    }
+
+    return 0;
+}
+
+// Marks the copy as finished and writes the results to an output stream.
+//
+// worker - The worker.
+// output - The output stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_reshard_table_message_worker_write(sky_worker *worker, FILE *output)
+{
+    size_t sz;
+    assert(worker != NULL);
+    assert(output != NULL);
+
+    sky_reshard_table_message *message = (sky_reshard_table_message*)worker->data;
+
+    struct tagbstring status_str = bsStatic("status");
+    struct tagbstring ok_str = bsStatic("ok");
+    struct tagbstring error_str = bsStatic("error");
+    struct tagbstring message_str = bsStatic("message");
+    struct tagbstring copy_failed_str = bsStatic("Unable to copy objects");
+
+    // The switchover happens before the next message for the table is
+    // processed so the state must be set before responding.
+    if(message->error) {
+        sky_table_set_reshard_state(message->table, SKY_TABLE_RESHARD_STATE_FAILED);
+
+        // Return.
+        //   {status:"error", message:""}
+        minipack_fwrite_map(output, 2, &sz);
+        check(sz > 0, "Unable to write output");
+        check(sky_minipack_fwrite_bstring(output, &status_str) == 0, "Unable to write status key");
+        check(sky_minipack_fwrite_bstring(output, &error_str) == 0, "Unable to write status value");
+        check(sky_minipack_fwrite_bstring(output, &message_str) == 0, "Unable to write message key");
+        check(sky_minipack_fwrite_bstring(output, &copy_failed_str) == 0, "Unable to write message");
+    }
+    else {
+        sky_table_set_reshard_state(message->table, SKY_TABLE_RESHARD_STATE_COPIED);
+
+        // Return.
+        //   {status:"ok"}
+        minipack_fwrite_map(output, 1, &sz);
+        check(sz > 0, "Unable to write output");
+        check(sky_minipack_fwrite_bstring(output, &status_str) == 0, "Unable to write status key");
+        check(sky_minipack_fwrite_bstring(output, &ok_str) == 0, "Unable to write status value");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Frees all data attached to the worker.
+//
+// worker - The worker.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_reshard_table_message_worker_free(sky_worker *worker)
+{
+    assert(worker != NULL);
+
+    sky_reshard_table_message_free((sky_reshard_table_message*)worker->data);
+    worker->data = NULL;
+
+    return 0;
+}
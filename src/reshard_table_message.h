@@ -0,0 +1,96 @@
+#ifndef _sky_reshard_table_message_h
+#define _sky_reshard_table_message_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "bstring.h"
+#include "message_handler.h"
+#include "table.h"
+#include "tablet.h"
+#include "worker.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The number of objects each tablet copies before yielding to other messages.
+#define SKY_RESHARD_TABLE_MESSAGE_BATCH_SIZE 1000
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// A message for moving the objects of a table into a new tablet layout.
+typedef struct {
+    uint32_t tablet_count;
+    sky_table *table;
+    bool error;
+} sky_reshard_table_message;
+
+// The copy position of a single tablet.
+typedef struct {
+    bstring object_id;
+    bool done;
+    bool error;
+} sky_reshard_table_message_cursor;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_reshard_table_message *sky_reshard_table_message_create();
+
+void sky_reshard_table_message_free(sky_reshard_table_message *message);
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+sky_message_handler *sky_reshard_table_message_handler_create();
+
+int sky_reshard_table_message_process(sky_server *server,
+    sky_message_header *header, sky_table *table, FILE *input, FILE *output);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_reshard_table_message_pack(sky_reshard_table_message *message,
+    FILE *file);
+
+int sky_reshard_table_message_unpack(sky_reshard_table_message *message,
+    FILE *file);
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int sky_reshard_table_message_worker_map(sky_worker *worker,
+    sky_tablet *tablet, void **data);
+
+int sky_reshard_table_message_worker_map_free(void *data);
+
+bool sky_reshard_table_message_worker_requeue(sky_worker *worker, void *data);
+
+int sky_reshard_table_message_worker_reduce(sky_worker *worker, void *data);
+
+int sky_reshard_table_message_worker_write(sky_worker *worker, FILE *output);
+
+int sky_reshard_table_message_worker_free(sky_worker *worker);
+
+#endif
@@ -0,0 +1,568 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#include "types.h"
+#include "retention_message.h"
+#include "path_iterator.h"
+#include "sample.h"
+#include "minipack.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+//--------------------------------------
+// String Constants
+//--------------------------------------
+
+struct tagbstring SKY_RETENTION_STATUS_STR = bsStatic("status");
+struct tagbstring SKY_RETENTION_OK_STR     = bsStatic("ok");
+struct tagbstring SKY_RETENTION_DATA_STR   = bsStatic("data");
+struct tagbstring SKY_RETENTION_SIZES_STR  = bsStatic("sizes");
+struct tagbstring SKY_RETENTION_COUNTS_STR = bsStatic("counts");
+struct tagbstring SKY_RETENTION_SAMPLE_STR = bsStatic("sample");
+
+struct tagbstring SKY_RETENTION_SIZE_MARGINS_STR  = bsStatic("size_margins");
+struct tagbstring SKY_RETENTION_COUNT_MARGINS_STR = bsStatic("count_margins");
+
+struct tagbstring SKY_RETENTION_KEY_COHORT_ACTION_ID = bsStatic("cohort_action_id");
+struct tagbstring SKY_RETENTION_KEY_RETURN_ACTION_ID = bsStatic("return_action_id");
+struct tagbstring SKY_RETENTION_KEY_START            = bsStatic("start");
+struct tagbstring SKY_RETENTION_KEY_BUCKET_SIZE      = bsStatic("bucket_size");
+struct tagbstring SKY_RETENTION_KEY_BUCKET_COUNT     = bsStatic("bucket_count");
+struct tagbstring SKY_RETENTION_KEY_SAMPLE           = bsStatic("sample");
+
+
+//--------------------------------------
+// Results
+//--------------------------------------
+
+// The results are stored as the size of each cohort followed by the count
+// of each period for each cohort.
+#define SKY_RETENTION_RESULT_COUNT(K) ((K) + ((K) * (K)))
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a 'retention' message object.
+//
+// Returns a new message.
+sky_retention_message *sky_retention_message_create()
+{
+    sky_retention_message *message = NULL;
+    message = calloc(1, sizeof(sky_retention_message)); check_mem(message);
+    message->sample_rate = 1;
+    return message;
+
+error:
+    sky_retention_message_free(message);
+    return NULL;
+}
+
+// Frees a 'retention' message object from memory.
+//
+// message - The message object to be freed.
+//
+// Returns nothing.
+void sky_retention_message_free(sky_retention_message *message)
+{
+    if(message) {
+        sky_data_descriptor_free(message->data_descriptor);
+        message->data_descriptor = NULL;
+        free(message->results);
+        message->results = NULL;
+        free(message);
+    }
+}
+
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+// Creates a message handler for the 'retention' message.
+//
+// Returns a message handler.
+sky_message_handler *sky_retention_message_handler_create()
+{
+    sky_message_handler *handler = sky_message_handler_create(); check_mem(handler);
+    handler->scope = SKY_MESSAGE_HANDLER_SCOPE_TABLE;
+    handler->name = bfromcstr("retention");
+    handler->process = sky_retention_message_process;
+    return handler;
+
+error:
+    sky_message_handler_free(handler);
+    return NULL;
+}
+
+// Delegates processing of the 'retention' message to a worker.
+//
+// server  - The server.
+// header  - The message header.
+// table   - The table the message is working against
+// input   - The input file stream.
+// output  - The output file stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_retention_message_process(sky_server *server,
+                                  sky_message_header *header,
+                                  sky_table *table,
+                                  FILE *input, FILE *output)
+{
+    int rc = 0;
+    sky_worker *worker = NULL;
+    sky_retention_message *message = NULL;
+    assert(server != NULL);
+    assert(header != NULL);
+    assert(table != NULL);
+    assert(input != NULL);
+    assert(output != NULL);
+
+    // Create worker.
+    worker = sky_worker_create(); check_mem(worker);
+    worker->pool = server->worker_pool;
+    worker->map = sky_retention_message_worker_map;
+    worker->map_morsel = sky_retention_message_worker_map_morsel;
+    worker->map_free = sky_retention_message_worker_map_free;
+    worker->reduce = sky_retention_message_worker_reduce;
+    worker->write = sky_retention_message_worker_write;
+    worker->free = sky_retention_message_worker_free;
+    worker->input = input;
+    worker->output = output;
+
+    // Parse message.
+    message = sky_retention_message_create(); check_mem(message);
+    rc = sky_retention_message_unpack(message, input);
+    check(rc == 0, "Unable to unpack 'retention' message");
+    rc = sky_retention_message_init(message);
+    check(rc == 0, "Unable to initialize 'retention' message");
+
+    // Attach servlets.
+    rc = sky_server_get_table_servlets(server, table, &worker->servlets, &worker->servlet_count);
+    check(rc == 0, "Unable to copy servlets to worker");
+
+    // Attach message to worker.
+    worker->data = (sky_retention_message*)message;
+
+    // Start worker.
+    rc = sky_worker_start(worker);
+    check(rc == 0, "Unable to start worker");
+
+    return 0;
+
+error:
+    sky_retention_message_free(message);
+    sky_worker_free(worker);
+    return -1;
+}
+
+// Validates the message and creates the data descriptor and results.
+//
+// message - The message.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_retention_message_init(sky_retention_message *message)
+{
+    sky_data_descriptor *descriptor = NULL;
+    assert(message != NULL);
+    check(message->cohort_action_id > 0, "Cohort action required");
+    check(message->return_action_id > 0, "Return action required");
+    check(message->bucket_size > 0, "Bucket size required");
+    check(message->bucket_count > 0 && message->bucket_count <= SKY_RETENTION_MESSAGE_MAX_BUCKET_COUNT, "Invalid bucket count: %d", message->bucket_count);
+
+    // Only the timestamp and action are needed from each event.
+    descriptor = sky_data_descriptor_create(); check_mem(descriptor);
+    descriptor->data_sz = (uint32_t)sizeof(sky_data_object);
+    descriptor->timestamp_descriptor.timestamp_offset = offsetof(sky_data_object, timestamp);
+    descriptor->timestamp_descriptor.ts_offset = offsetof(sky_data_object, ts);
+    descriptor->action_descriptor.offset = offsetof(sky_data_object, action_id);
+    message->data_descriptor = descriptor;
+
+    message->results = calloc(SKY_RETENTION_RESULT_COUNT(message->bucket_count), sizeof(*message->results));
+    check_mem(message->results);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Deserializes a 'retention' message from a file stream.
+//
+//   {"cohort_action_id":<id>, "return_action_id":<id>, "start":<seconds>,
+//    "bucket_size":<seconds>, "bucket_count":<count>, "sample":<rate>}
+//
+// message - The message.
+// file    - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_retention_message_unpack(sky_retention_message *message, FILE *file)
+{
+    int rc;
+    size_t sz;
+    bstring key = NULL;
+    assert(message != NULL);
+    assert(file != NULL);
+
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read map");
+
+    uint32_t i;
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read map key");
+
+        // The sample rate is the only key that isn't an integer.
+        if(biseq(key, &SKY_RETENTION_KEY_SAMPLE) == 1) {
+            rc = sky_sample_unpack_rate(&message->sample_rate, file);
+            check(rc == 0, "Unable to read sample rate");
+            bdestroy(key);
+            key = NULL;
+            continue;
+        }
+
+        uint64_t value = minipack_fread_uint(file, &sz);
+        check(sz > 0, "Unable to read map value: %s", bdata(key));
+
+        if(biseq(key, &SKY_RETENTION_KEY_COHORT_ACTION_ID) == 1) {
+            message->cohort_action_id = (sky_action_id_t)value;
+        }
+        else if(biseq(key, &SKY_RETENTION_KEY_RETURN_ACTION_ID) == 1) {
+            message->return_action_id = (sky_action_id_t)value;
+        }
+        else if(biseq(key, &SKY_RETENTION_KEY_START) == 1) {
+            message->start = (uint32_t)value;
+        }
+        else if(biseq(key, &SKY_RETENTION_KEY_BUCKET_SIZE) == 1) {
+            message->bucket_size = (uint32_t)value;
+        }
+        else if(biseq(key, &SKY_RETENTION_KEY_BUCKET_COUNT) == 1) {
+            message->bucket_count = (uint32_t)value;
+        }
+        else {
+            sentinel("Invalid retention key: %s", bdata(key));
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+// Maps tablet data to a retention matrix.
+//
+// worker - The worker.
+// tablet - The tablet to work against.
+// ret    - A pointer to where the matrix should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_retention_message_worker_map(sky_worker *worker, sky_tablet *tablet,
+                                     void **ret)
+{
+    assert(tablet != NULL);
+    sky_morsel morsel;
+    memset(&morsel, 0, sizeof(morsel));
+    morsel.tablet = tablet;
+    return sky_retention_message_worker_map_morsel(worker, &morsel, NULL, ret);
+}
+
+// Maps a range of tablet data to a retention matrix.
+//
+// worker  - The worker.
+// morsel  - The range of the tablet to work against.
+// context - Unused.
+// ret     - A pointer to where the matrix should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_retention_message_worker_map_morsel(sky_worker *worker,
+                                            sky_morsel *morsel,
+                                            void **context, void **ret)
+{
+    int rc;
+    uint64_t *results = NULL;
+    assert(worker != NULL);
+    assert(morsel != NULL);
+    assert(ret != NULL);
+    UNUSED(context);
+
+    sky_retention_message *message = (sky_retention_message*)worker->data;
+    uint32_t bucket_count = message->bucket_count;
+    uint32_t bucket_size = message->bucket_size;
+    uint32_t start = message->start;
+
+    // Initialize data object.
+    sky_data_object data;
+    memset(&data, 0, sizeof(data));
+
+    // Initialize the path iterator.
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+
+    results = calloc(SKY_RETENTION_RESULT_COUNT(bucket_count), sizeof(*results));
+    check_mem(results);
+    uint64_t *sizes = results;
+    uint64_t *counts = results + bucket_count;
+
+    // Attach data and descriptor to cursor.
+    iterator.cursor.data_descriptor = message->data_descriptor;
+    iterator.cursor.data = (void*)(&data);
+
+    // Only visit sampled objects if the message is sampled.
+    if(sky_sample_is_enabled(message->sample_rate)) {
+        sky_path_iterator_set_sample_rate(&iterator, message->sample_rate);
+    }
+
+    // Objects only join a cohort through a cohort action within the buckets.
+    uint64_t end = (uint64_t)start + ((uint64_t)bucket_count * bucket_size) - 1;
+    sky_path_iterator_set_time_range(&iterator, start, (end < UINT32_MAX ? (uint32_t)end : UINT32_MAX));
+    sky_path_iterator_add_action(&iterator, message->cohort_action_id);
+
+    rc = sky_path_iterator_set_range(&iterator, morsel->tablet, morsel->start, morsel->end);
+    check(rc == 0, "Unable to initialize path iterator");
+
+    // Iterate over each path.
+    bool active[SKY_RETENTION_MESSAGE_MAX_BUCKET_COUNT];
+    uint64_t path_count  = 0;
+    uint64_t event_count = 0;
+    while(!iterator.eof) {
+        path_count++;
+
+        rc = sky_cursor_next_event(&iterator.cursor);
+        check(rc == 0, "Unable to initialize cursor");
+
+        // The cohort is -1 until the cohort action is found. If it is found
+        // outside of the buckets then the rest of the path is skipped.
+        int64_t cohort = -1;
+        memset(active, 0, bucket_count * sizeof(*active));
+        while(!iterator.cursor.eof) {
+            int64_t bucket = ((int64_t)data.timestamp - (int64_t)start);
+            bucket = (bucket >= 0 ? bucket / bucket_size : -1);
+
+            if(cohort == -1 && data.action_id == message->cohort_action_id) {
+                if(bucket < 0 || bucket >= bucket_count) {
+                    break;
+                }
+                cohort = bucket;
+            }
+            if(cohort != -1 && data.action_id == message->return_action_id) {
+                int64_t period = bucket - cohort;
+                if(period < bucket_count) {
+                    active[period] = true;
+                }
+            }
+
+            rc = sky_cursor_next_event(&iterator.cursor);
+            check(rc == 0, "Unable to find next event");
+            event_count++;
+        }
+
+        // Add the object to its cohort.
+        if(cohort != -1) {
+            sizes[cohort]++;
+            uint64_t *row = &counts[cohort * bucket_count];
+            uint32_t i;
+            for(i=0; i<bucket_count; i++) {
+                row[i] += active[i];
+            }
+        }
+
+        rc = sky_path_iterator_next(&iterator);
+        check(rc == 0, "Unable to find next path");
+    }
+
+    // These counts are only used for debugging so they are not updated
+    // atomically.
+    message->path_count  += path_count;
+    message->event_count += event_count;
+
+    *ret = (void*)results;
+
+    sky_path_iterator_uninit(&iterator);
+    return 0;
+
+error:
+    *ret = NULL;
+    free(results);
+    sky_path_iterator_uninit(&iterator);
+    return -1;
+}
+
+// Frees the matrix created by the map function.
+//
+// data - The matrix.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_retention_message_worker_map_free(void *data)
+{
+    assert(data != NULL);
+    free(data);
+    return 0;
+}
+
+// Adds the matrix created by the map function to the matrix saved against
+// the worker.
+//
+// worker - The worker.
+// data   - The matrix created by the map function.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_retention_message_worker_reduce(sky_worker *worker, void *data)
+{
+    assert(worker != NULL);
+    assert(data != NULL);
+
+    sky_retention_message *message = (sky_retention_message*)worker->data;
+    uint64_t *results = (uint64_t*)data;
+
+    uint32_t i;
+    uint32_t count = SKY_RETENTION_RESULT_COUNT(message->bucket_count);
+    for(i=0; i<count; i++) {
+        message->results[i] += results[i];
+    }
+
+    return 0;
+}
+
+// Writes a list of distinct object counts to an output stream. Sampled
+// counts are scaled by the sample rate. If margins are requested then the
+// margin of error of each count is written instead of the count. Each object
+// adds at most one to a count so the sum of the squares of their
+// contributions is the count itself.
+//
+// output - The output stream.
+// counts - The counts.
+// count  - The number of counts.
+// rate   - The sample rate.
+// margin - A flag stating if the margins of error should be written.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_retention_message_fwrite_counts(FILE *output, uint64_t *counts,
+                                               uint32_t count, double rate,
+                                               bool margin)
+{
+    size_t sz;
+    uint32_t i;
+
+    check(minipack_fwrite_array(output, count, &sz) == 0, "Unable to write counts array");
+    for(i=0; i<count; i++) {
+        if(margin) {
+            check(minipack_fwrite_double(output, sky_sample_margin((double)counts[i], rate), &sz) == 0, "Unable to write margin");
+        }
+        else {
+            uint64_t value = (sky_sample_is_enabled(rate) ? (uint64_t)round(counts[i] / rate) : counts[i]);
+            check(minipack_fwrite_uint(output, value, &sz) == 0, "Unable to write count");
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes the matrix to an output stream.
+//
+// worker - The worker.
+// output - The output stream.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_retention_message_worker_write(sky_worker *worker, FILE *output)
+{
+    size_t sz;
+    uint32_t i;
+    assert(worker != NULL);
+    assert(output != NULL);
+
+    sky_retention_message *message = (sky_retention_message*)worker->data;
+    uint32_t bucket_count = message->bucket_count;
+    uint64_t *sizes = message->results;
+    uint64_t *counts = message->results + bucket_count;
+    double rate = message->sample_rate;
+    bool sampled = sky_sample_is_enabled(rate);
+
+    // Return.
+    //   {status:"ok", data:{sizes:[...], counts:[[...], ...]}}
+    //
+    // Sampled matrices are scaled and include margins of error.
+    //   {status:"ok", data:{sizes:[...], counts:[[...], ...],
+    //    size_margins:[...], count_margins:[[...], ...]}, sample:{...}}
+    check(minipack_fwrite_map(output, (sampled ? 3 : 2), &sz) == 0, "Unable to write root map");
+    check(sky_minipack_fwrite_bstring(output, &SKY_RETENTION_STATUS_STR) == 0, "Unable to write status key");
+    check(sky_minipack_fwrite_bstring(output, &SKY_RETENTION_OK_STR) == 0, "Unable to write status value");
+    check(sky_minipack_fwrite_bstring(output, &SKY_RETENTION_DATA_STR) == 0, "Unable to write data key");
+    check(minipack_fwrite_map(output, (sampled ? 4 : 2), &sz) == 0, "Unable to write data map");
+
+    uint32_t margin;
+    for(margin=0; margin<(sampled ? 2 : 1); margin++) {
+        bstring sizes_key = (margin ? &SKY_RETENTION_SIZE_MARGINS_STR : &SKY_RETENTION_SIZES_STR);
+        bstring counts_key = (margin ? &SKY_RETENTION_COUNT_MARGINS_STR : &SKY_RETENTION_COUNTS_STR);
+
+        check(sky_minipack_fwrite_bstring(output, sizes_key) == 0, "Unable to write sizes key");
+        check(sky_retention_message_fwrite_counts(output, sizes, bucket_count, rate, margin) == 0, "Unable to write cohort sizes");
+
+        check(sky_minipack_fwrite_bstring(output, counts_key) == 0, "Unable to write counts key");
+        check(minipack_fwrite_array(output, bucket_count, &sz) == 0, "Unable to write counts array");
+        for(i=0; i<bucket_count; i++) {
+            check(sky_retention_message_fwrite_counts(output, &counts[i*bucket_count], bucket_count, rate, margin) == 0, "Unable to write period counts");
+        }
+    }
+
+    if(sampled) {
+        check(sky_minipack_fwrite_bstring(output, &SKY_RETENTION_SAMPLE_STR) == 0, "Unable to write sample key");
+        check(sky_sample_pack(rate, output) == 0, "Unable to write sample value");
+    }
+
+    printf("[retention] paths: %" PRIu64 ", events: %" PRIu64 "\n", message->path_count, message->event_count);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Frees all data attached to the worker.
+//
+// worker - The worker.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_retention_message_worker_free(sky_worker *worker)
+{
+    assert(worker != NULL);
+
+    sky_retention_message *message = (sky_retention_message*)worker->data;
+    sky_retention_message_free(message);
+    worker->data = NULL;
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#ifndef _sky_retention_message_h
+#define _sky_retention_message_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "bstring.h"
+#include "message_header.h"
+#include "message_handler.h"
+#include "table.h"
+#include "tablet.h"
+#include "worker.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The retention message groups objects into cohorts by the time bucket of
+// the first time they performed the cohort action. Each later occurrence of
+// the return action marks the object as active in the period that it falls
+// in, counted in buckets since the cohort's bucket. Objects whose cohort
+// action first happened outside of the requested buckets are ignored.
+//
+// Each path is streamed once and the result is a dense matrix of distinct
+// object counts by cohort and period along with the size of each cohort.
+// Partial matrices from each morsel are summed by the worker.
+//
+// When the message is sampled every count is scaled by the sample rate and
+// the margin of error of each count is returned alongside the matrix.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The maximum number of buckets in a retention matrix.
+#define SKY_RETENTION_MESSAGE_MAX_BUCKET_COUNT 128
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// A message for calculating the retention of objects by cohort.
+typedef struct {
+    sky_action_id_t cohort_action_id;
+    sky_action_id_t return_action_id;
+    uint32_t start;
+    uint32_t bucket_size;
+    uint32_t bucket_count;
+    double sample_rate;
+    uint64_t *results;
+    sky_data_descriptor *data_descriptor;
+    uint64_t path_count;
+    uint64_t event_count;
+} sky_retention_message;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_retention_message *sky_retention_message_create();
+
+void sky_retention_message_free(sky_retention_message *message);
+
+//--------------------------------------
+// Message Handler
+//--------------------------------------
+
+sky_message_handler *sky_retention_message_handler_create();
+
+int sky_retention_message_process(sky_server *server,
+    sky_message_header *header, sky_table *table, FILE *input, FILE *output);
+
+int sky_retention_message_init(sky_retention_message *message);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_retention_message_unpack(sky_retention_message *message, FILE *file);
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int sky_retention_message_worker_map(sky_worker *worker, sky_tablet *tablet,
+    void **data);
+
+int sky_retention_message_worker_map_morsel(sky_worker *worker,
+    sky_morsel *morsel, void **context, void **ret);
+
+int sky_retention_message_worker_map_free(void *data);
+
+int sky_retention_message_worker_reduce(sky_worker *worker, void *data);
+
+int sky_retention_message_worker_write(sky_worker *worker, FILE *output);
+
+int sky_retention_message_worker_free(sky_worker *worker);
+
+#endif
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "sample.h"
+#include "minipack.h"
+#include "dbg.h"
+#include "mem.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+//--------------------------------------
+// String Constants
+//--------------------------------------
+
+struct tagbstring SKY_SAMPLE_RATE_STR       = bsStatic("rate");
+struct tagbstring SKY_SAMPLE_CONFIDENCE_STR = bsStatic("confidence");
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Membership
+//--------------------------------------
+
+// Calculates the hash that decides whether an object is in a sample.
+//
+// object_id - A pointer to the object id.
+// length    - The length of the object id.
+//
+// Returns the sample hash of the object.
+uint32_t sky_sample_hash(const char *object_id, size_t length)
+{
+    struct tagbstring str;
+    btfromblk(str, object_id, length);
+    uint32_t hash = sky_bstring_fnv1a(&str);
+
+    // Mix the bits so the sample is independent of the tablet layout.
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// Calculates the hash threshold for a sample rate. Objects whose sample
+// hash is below the threshold are in the sample.
+//
+// rate - The fraction of objects to sample.
+//
+// Returns the threshold.
+uint64_t sky_sample_threshold(double rate)
+{
+    if(rate >= 1) return (1ULL << 32);
+    if(rate <= 0) return 0;
+    return (uint64_t)(rate * (double)(1ULL << 32));
+}
+
+// Checks if a sample rate only includes some of the objects.
+//
+// rate - The fraction of objects to sample.
+//
+// Returns true if the rate samples objects.
+bool sky_sample_is_enabled(double rate)
+{
+    return (rate < 1);
+}
+
+
+//--------------------------------------
+// Estimation
+//--------------------------------------
+
+// Adds a path's contribution to a total.
+//
+// variance - The variance of the total.
+// path_id  - An identifier of the current path that is unique within the
+//            scan that creates the variance.
+// value    - The value to add.
+//
+// Returns nothing.
+void sky_sample_variance_add(sky_sample_variance *variance, uint64_t path_id,
+                             double value)
+{
+    assert(variance != NULL);
+    if(variance->path_id != path_id) {
+        variance->sum_sq += variance->path_total * variance->path_total;
+        variance->path_total = 0;
+        variance->path_id = path_id;
+    }
+    variance->path_total += value;
+}
+
+// Merges the variance of a total from a separate scan. Separate scans never
+// share an object so the other scan's current path is finished.
+//
+// variance - The variance to merge into.
+// other    - The variance to merge from.
+//
+// Returns nothing.
+void sky_sample_variance_merge(sky_sample_variance *variance,
+                               sky_sample_variance *other)
+{
+    assert(variance != NULL);
+    assert(other != NULL);
+    variance->sum_sq += sky_sample_variance_sum_sq(other);
+}
+
+// Calculates the sum of the squares of each path's contribution.
+//
+// variance - The variance.
+//
+// Returns the sum of squares.
+double sky_sample_variance_sum_sq(sky_sample_variance *variance)
+{
+    assert(variance != NULL);
+    return variance->sum_sq + (variance->path_total * variance->path_total);
+}
+
+// Calculates the margin of error of a scaled total.
+//
+// sum_sq - The sum of the squares of each sampled object's contribution.
+// rate   - The sample rate.
+//
+// Returns the margin of error.
+double sky_sample_margin(double sum_sq, double rate)
+{
+    if(!sky_sample_is_enabled(rate) || rate <= 0) return 0;
+    return SKY_SAMPLE_Z * sqrt((1 - rate) * sum_sq) / rate;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Deserializes a sample rate from a file stream. Rates must be greater
+// than zero and no more than one.
+//
+// rate - A pointer to where the rate should be returned.
+// file - The file stream to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_sample_unpack_rate(double *rate, FILE *file)
+{
+    size_t sz;
+    assert(rate != NULL);
+    assert(file != NULL);
+
+    // Read the first byte of the value to determine the type.
+    uint8_t buffer[1];
+    check(fread(buffer, sizeof(*buffer), 1, file) == 1, "Unable to read sample rate");
+    ungetc(buffer[0], file);
+
+    if(minipack_is_double((void*)buffer)) {
+        *rate = minipack_fread_double(file, &sz);
+    }
+    else {
+        *rate = (double)minipack_fread_uint(file, &sz);
+    }
+    check(sz > 0, "Unable to read sample rate");
+    check(*rate > 0 && *rate <= 1, "Sample rate must be greater than 0 and at most 1: %f", *rate);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Serializes the description of a sample to a file stream.
+//
+//   {"rate":0.01, "confidence":0.95}
+//
+// rate - The sample rate.
+// file - The file stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_sample_pack(double rate, FILE *file)
+{
+    size_t sz;
+    assert(file != NULL);
+
+    check(minipack_fwrite_map(file, 2, &sz) == 0, "Unable to write sample map");
+    check(sky_minipack_fwrite_bstring(file, &SKY_SAMPLE_RATE_STR) == 0, "Unable to write sample rate key");
+    check(minipack_fwrite_double(file, rate, &sz) == 0, "Unable to write sample rate");
+    check(sky_minipack_fwrite_bstring(file, &SKY_SAMPLE_CONFIDENCE_STR) == 0, "Unable to write confidence key");
+    check(minipack_fwrite_double(file, SKY_SAMPLE_CONFIDENCE, &sz) == 0, "Unable to write confidence");
+
+    return 0;
+
+error:
+    return -1;
+}
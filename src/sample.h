@@ -0,0 +1,103 @@
+#ifndef _sky_sample_h
+#define _sky_sample_h
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bstring.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// Sampling trades exactness for speed by only scanning a fraction of the
+// objects in a table. An object is in the sample when the hash of its
+// object id falls below the sample rate's share of the hash space. The
+// hash only depends on the object id so repeated runs see the same sample
+// and a smaller sample is always a subset of a larger one. The FNV-1a hash
+// of the object id is mixed before it is compared since its raw value also
+// decides which tablet the object is stored on.
+//
+// Totals over the sample are scaled up by the inverse of the rate. Each
+// object's contribution to a total is treated as one draw so the variance
+// of a scaled total is estimated from the sum of the squares of each
+// object's contribution:
+//
+//   Var = ((1 - rate) / rate^2) * sum(y^2)
+//
+// Margins of error are reported at a 95% confidence level.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The z-score of the confidence level used for margins of error.
+#define SKY_SAMPLE_Z 1.96
+
+// The confidence level that margins of error are reported at.
+#define SKY_SAMPLE_CONFIDENCE 0.95
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// The running sum of the squares of each object's contribution to a total.
+// Contributions are added up for the current path and squared once a
+// contribution from a different path is added.
+typedef struct {
+    uint64_t path_id;
+    double path_total;
+    double sum_sq;
+} sky_sample_variance;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Membership
+//--------------------------------------
+
+uint32_t sky_sample_hash(const char *object_id, size_t length);
+
+uint64_t sky_sample_threshold(double rate);
+
+bool sky_sample_is_enabled(double rate);
+
+//--------------------------------------
+// Estimation
+//--------------------------------------
+
+void sky_sample_variance_add(sky_sample_variance *variance, uint64_t path_id,
+    double value);
+
+void sky_sample_variance_merge(sky_sample_variance *variance,
+    sky_sample_variance *other);
+
+double sky_sample_variance_sum_sq(sky_sample_variance *variance);
+
+double sky_sample_margin(double sum_sq, double rate);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_sample_unpack_rate(double *rate, FILE *file);
+
+int sky_sample_pack(double rate, FILE *file);
+
+#endif
@@ -0,0 +1,601 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <assert.h>
+
+#include "segment.h"
+#include "event.h"
+#include "file.h"
+#include "mem.h"
+#include "dbg.h"
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+typedef struct sky_segment_entry_v1 {
+    uint64_t object_id_offset;
+    uint64_t data_offset;
+    uint64_t data_length;
+    sky_timestamp_t max_timestamp;
+    uint32_t object_id_length;
+    uint32_t reserved;
+} sky_segment_entry_v1;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a reference to a segment.
+//
+// Returns a reference to the new segment if successful. Otherwise returns
+// null.
+sky_segment *sky_segment_create()
+{
+    sky_segment *segment = calloc(1, sizeof(sky_segment)); check_mem(segment);
+    return segment;
+
+error:
+    sky_segment_free(segment);
+    return NULL;
+}
+
+// Removes a segment reference from memory.
+//
+// segment - The segment to free.
+void sky_segment_free(sky_segment *segment)
+{
+    if(segment) {
+        sky_segment_close(segment);
+        free(segment);
+    }
+}
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+// Maps a segment file into memory. The segment is left empty if the file
+// does not exist.
+//
+// segment - The segment.
+// path    - The path to the segment file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_segment_open(sky_segment *segment, bstring path)
+{
+    int fd = -1;
+    assert(segment != NULL);
+    check(path != NULL, "Segment path required");
+
+    sky_segment_close(segment);
+    segment->path = bstrcpy(path); check_mem(segment->path);
+
+    if(!sky_file_exists(path)) {
+        return 0;
+    }
+
+    // Map the whole file.
+    fd = open(bdatae(path, ""), O_RDONLY);
+    check(fd != -1, "Unable to open segment: %s", bdata(path));
+    off_t file_length = sky_file_get_size(path);
+    check(file_length >= (off_t)sizeof(sky_segment_header), "Segment is too small: %s", bdata(path));
+    segment->data = mmap(NULL, file_length, PROT_READ, MAP_SHARED, fd, 0);
+    check(segment->data != MAP_FAILED, "Unable to map segment: %s", bdata(path));
+    segment->data_length = file_length;
+    close(fd);
+    fd = -1;
+
+    // Validate the header. Version 1 entries are copied into the current
+    // layout with no records.
+    sky_segment_header *header = (sky_segment_header*)segment->data;
+    if(memcmp(header->magic, SKY_SEGMENT_MAGIC_V1, SKY_SEGMENT_MAGIC_LENGTH) == 0) {
+        check(header->entries_offset + (header->entry_count * sizeof(sky_segment_entry_v1)) <= segment->data_length, "Truncated segment: %s", bdata(path));
+        sky_segment_entry_v1 *entries = (sky_segment_entry_v1*)(segment->data + header->entries_offset);
+        if(header->entry_count > 0) {
+            segment->entries = calloc(header->entry_count, sizeof(*segment->entries));
+            check_mem(segment->entries);
+            segment->owns_entries = true;
+        }
+        uint64_t i;
+        for(i=0; i<header->entry_count; i++) {
+            segment->entries[i].object_id_offset = entries[i].object_id_offset;
+            segment->entries[i].data_offset = entries[i].data_offset;
+            segment->entries[i].data_length = entries[i].data_length;
+            segment->entries[i].max_timestamp = entries[i].max_timestamp;
+            segment->entries[i].object_id_length = entries[i].object_id_length;
+        }
+    }
+    else {
+        check(memcmp(header->magic, SKY_SEGMENT_MAGIC, SKY_SEGMENT_MAGIC_LENGTH) == 0, "Invalid segment: %s", bdata(path));
+        check(header->entries_offset + (header->entry_count * sizeof(sky_segment_entry)) <= segment->data_length, "Truncated segment: %s", bdata(path));
+        segment->entries = (sky_segment_entry*)(segment->data + header->entries_offset);
+        segment->has_records = true;
+    }
+    segment->generation = header->generation;
+    segment->entry_count = header->entry_count;
+
+    return 0;
+
+error:
+    if(fd != -1) close(fd);
+    if(segment->data == MAP_FAILED) segment->data = NULL;
+    sky_segment_close(segment);
+    return -1;
+}
+
+// Unmaps the segment file.
+//
+// segment - The segment.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_segment_close(sky_segment *segment)
+{
+    assert(segment != NULL);
+
+    if(segment->data != NULL) {
+        munmap(segment->data, segment->data_length);
+    }
+    if(segment->owns_entries) {
+        free(segment->entries);
+    }
+    bdestroy(segment->path);
+    segment->path = NULL;
+    segment->data = NULL;
+    segment->data_length = 0;
+    segment->generation = 0;
+    segment->entries = NULL;
+    segment->entry_count = 0;
+    segment->has_records = false;
+    segment->owns_entries = false;
+
+    return 0;
+}
+
+
+//--------------------------------------
+// Entries
+//--------------------------------------
+
+// Compares an entry's object id with another object id. Object ids are
+// ordered the same way as they are in LevelDB.
+//
+// segment          - The segment.
+// entry            - The entry.
+// object_id        - The object id to compare against.
+// object_id_length - The length of the object id.
+//
+// Returns a negative number if the entry sorts first, a positive number if
+// the entry sorts after and zero if the object ids are equal.
+int sky_segment_compare(sky_segment *segment, sky_segment_entry *entry,
+                        const char *object_id, size_t object_id_length)
+{
+    size_t length = (entry->object_id_length < object_id_length ? entry->object_id_length : object_id_length);
+    int rc = memcmp(sky_segment_get_object_id(segment, entry), object_id, length);
+    if(rc != 0) {
+        return rc;
+    }
+    else if(entry->object_id_length == object_id_length) {
+        return 0;
+    }
+    else {
+        return (entry->object_id_length < object_id_length ? -1 : 1);
+    }
+}
+
+// Finds the entry for an object using a binary search.
+//
+// segment          - The segment.
+// object_id        - The object id.
+// object_id_length - The length of the object id.
+//
+// Returns the entry or null if the object is not in the segment.
+sky_segment_entry *sky_segment_find(sky_segment *segment, const char *object_id,
+                                    size_t object_id_length)
+{
+    assert(segment != NULL);
+
+    uint64_t low = 0, high = segment->entry_count;
+    while(low < high) {
+        uint64_t mid = low + ((high - low) / 2);
+        int rc = sky_segment_compare(segment, &segment->entries[mid], object_id, object_id_length);
+        if(rc == 0) {
+            return &segment->entries[mid];
+        }
+        else if(rc < 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+// Finds the index of the first entry whose object id does not sort before a
+// given object id using a binary search.
+//
+// segment          - The segment.
+// object_id        - The object id.
+// object_id_length - The length of the object id.
+//
+// Returns the entry index or the entry count if all entries sort before it.
+uint64_t sky_segment_lower_bound(sky_segment *segment, const char *object_id,
+                                 size_t object_id_length)
+{
+    assert(segment != NULL);
+
+    uint64_t low = 0, high = segment->entry_count;
+    while(low < high) {
+        uint64_t mid = low + ((high - low) / 2);
+        if(sky_segment_compare(segment, &segment->entries[mid], object_id, object_id_length) < 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Finds the index of the first entry whose object id sorts after a given
+// object id using a binary search.
+//
+// segment          - The segment.
+// object_id        - The object id.
+// object_id_length - The length of the object id.
+//
+// Returns the entry index or the entry count if no entries sort after it.
+uint64_t sky_segment_upper_bound(sky_segment *segment, const char *object_id,
+                                 size_t object_id_length)
+{
+    assert(segment != NULL);
+
+    uint64_t low = 0, high = segment->entry_count;
+    while(low < high) {
+        uint64_t mid = low + ((high - low) / 2);
+        if(sky_segment_compare(segment, &segment->entries[mid], object_id, object_id_length) <= 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Retrieves a pointer to the object id of an entry.
+//
+// segment - The segment.
+// entry   - The entry.
+//
+// Returns a pointer to the object id within the mapped file.
+void *sky_segment_get_object_id(sky_segment *segment, sky_segment_entry *entry)
+{
+    return segment->data + entry->object_id_offset;
+}
+
+// Retrieves a pointer to the path data of an entry.
+//
+// segment - The segment.
+// entry   - The entry.
+//
+// Returns a pointer to the path data within the mapped file.
+void *sky_segment_get_data(sky_segment *segment, sky_segment_entry *entry)
+{
+    return segment->data + entry->data_offset;
+}
+
+// Retrieves a pointer to the records of an entry.
+//
+// segment - The segment.
+// entry   - The entry.
+//
+// Returns a pointer to the records within the mapped file.
+void *sky_segment_get_records(sky_segment *segment, sky_segment_entry *entry)
+{
+    return segment->data + entry->records_offset;
+}
+
+
+//--------------------------------------
+// Records
+//--------------------------------------
+
+// Appends a record to a buffer of packed records. Records must be appended in
+// type and timestamp order.
+//
+// records      - The buffer to append to.
+// type         - The record type.
+// ts           - The record timestamp.
+// value        - The record value.
+// value_length - The length of the record value.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_segment_record_pack(bstring records, uint8_t type, sky_timestamp_t ts,
+                            const void *value, size_t value_length)
+{
+    int rc;
+    assert(records != NULL);
+
+    char header[SKY_SEGMENT_RECORD_HEADER_LENGTH];
+    uint64_t length = value_length;
+    memcpy(header, &type, sizeof(type));
+    memcpy(header + sizeof(type), &ts, sizeof(ts));
+    memcpy(header + sizeof(type) + sizeof(ts), &length, sizeof(length));
+    rc = bcatblk(records, header, sizeof(header));
+    check(rc == BSTR_OK, "Unable to append record header");
+    if(value_length > 0) {
+        rc = bcatblk(records, value, value_length);
+        check(rc == BSTR_OK, "Unable to append record value");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Reads a packed record. The record's value points into the packed data.
+//
+// record - The record to read into.
+// ptr    - A pointer to the packed record.
+// length - The number of bytes available at the pointer.
+// sz     - A pointer to where the size of the packed record is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_segment_record_unpack(sky_segment_record *record, const void *ptr,
+                              size_t length, size_t *sz)
+{
+    assert(record != NULL);
+    assert(ptr != NULL);
+    check(length >= SKY_SEGMENT_RECORD_HEADER_LENGTH, "Invalid segment record");
+
+    uint64_t value_length;
+    memcpy(&record->type, ptr, sizeof(record->type));
+    memcpy(&record->ts, ptr + sizeof(record->type), sizeof(record->ts));
+    memcpy(&value_length, ptr + sizeof(record->type) + sizeof(record->ts), sizeof(value_length));
+    check(value_length <= length - SKY_SEGMENT_RECORD_HEADER_LENGTH, "Invalid segment record");
+    record->value = ptr + SKY_SEGMENT_RECORD_HEADER_LENGTH;
+    record->value_length = value_length;
+    if(sz != NULL) {
+        *sz = SKY_SEGMENT_RECORD_HEADER_LENGTH + value_length;
+    }
+
+    return 0;
+
+error:
+    memset(record, 0, sizeof(*record));
+    return -1;
+}
+
+// Finds the last record of a given type on an entry at or before a
+// timestamp.
+//
+// segment - The segment.
+// entry   - The entry.
+// type    - The record type.
+// ts      - The timestamp.
+// record  - The record to read into.
+// found   - A pointer to where the existence of the record is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_segment_find_record(sky_segment *segment, sky_segment_entry *entry,
+                            uint8_t type, sky_timestamp_t ts,
+                            sky_segment_record *record, bool *found)
+{
+    int rc;
+    assert(segment != NULL);
+    assert(entry != NULL);
+    assert(record != NULL);
+    assert(found != NULL);
+
+    *found = false;
+    void *ptr = sky_segment_get_records(segment, entry);
+    void *endptr = ptr + entry->records_length;
+    while(ptr < endptr) {
+        size_t sz;
+        sky_segment_record current;
+        rc = sky_segment_record_unpack(&current, ptr, endptr - ptr, &sz);
+        check(rc == 0, "Unable to unpack segment record");
+        if(current.type > type || (current.type == type && current.ts > ts)) {
+            break;
+        }
+        if(current.type == type) {
+            *record = current;
+            *found = true;
+        }
+        ptr += sz;
+    }
+
+    return 0;
+
+error:
+    *found = false;
+    return -1;
+}
+
+
+//--------------------------------------
+// Writer
+//--------------------------------------
+
+// Creates a segment file for writing. Paths must be written in object id
+// order.
+//
+// path       - The path to the segment file.
+// generation - The generation number of the segment.
+//
+// Returns a reference to the new writer if successful. Otherwise returns
+// null.
+sky_segment_writer *sky_segment_writer_create(bstring path, uint64_t generation)
+{
+    sky_segment_writer *writer = NULL;
+    check(path != NULL, "Segment path required");
+
+    writer = calloc(1, sizeof(sky_segment_writer)); check_mem(writer);
+    writer->path = bstrcpy(path); check_mem(writer->path);
+    writer->generation = generation;
+    writer->object_ids = bfromcstr(""); check_mem(writer->object_ids);
+
+    // Reserve space for the header. It is written when the writer closes.
+    writer->file = fopen(bdatae(path, ""), "w");
+    check(writer->file != NULL, "Unable to create segment: %s", bdata(path));
+    sky_segment_header header;
+    memset(&header, 0, sizeof(header));
+    check(fwrite(&header, sizeof(header), 1, writer->file) == 1, "Unable to write segment header");
+    writer->data_offset = sizeof(header);
+
+    return writer;
+
+error:
+    sky_segment_writer_free(writer);
+    return NULL;
+}
+
+// Removes a segment writer from memory. Any open file is closed without
+// being completed.
+//
+// writer - The writer.
+void sky_segment_writer_free(sky_segment_writer *writer)
+{
+    if(writer) {
+        if(writer->file) fclose(writer->file);
+        bdestroy(writer->path);
+        bdestroy(writer->object_ids);
+        free(writer->entries);
+        free(writer);
+    }
+}
+
+// Writes the path and records for a single object to the segment.
+//
+// writer           - The writer.
+// object_id        - The object id.
+// object_id_length - The length of the object id.
+// data             - The path data.
+// data_length      - The length of the path data.
+// records          - The packed records.
+// records_length   - The length of the packed records.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_segment_writer_write(sky_segment_writer *writer, const char *object_id,
+                             size_t object_id_length, void *data,
+                             size_t data_length, void *records,
+                             size_t records_length)
+{
+    int rc;
+    assert(writer != NULL);
+    check(writer->file != NULL, "Segment writer is closed");
+
+    // Find the timestamp of the last event on the path.
+    sky_timestamp_t max_timestamp = 0;
+    void *ptr = data;
+    while(ptr < data + data_length) {
+        max_timestamp = sky_event_get_raw_ts(ptr, max_timestamp);
+        ptr += sky_event_sizeof_raw(ptr);
+    }
+
+    // Write path data.
+    if(data_length > 0) {
+        check(fwrite(data, data_length, 1, writer->file) == 1, "Unable to write segment path");
+    }
+    if(records_length > 0) {
+        check(fwrite(records, records_length, 1, writer->file) == 1, "Unable to write segment records");
+    }
+
+    // Add entry.
+    if(writer->entry_count == writer->entry_capacity) {
+        writer->entry_capacity = (writer->entry_capacity > 0 ? writer->entry_capacity * 2 : 1024);
+        writer->entries = realloc(writer->entries, writer->entry_capacity * sizeof(*writer->entries));
+        check_mem(writer->entries);
+    }
+    sky_segment_entry *entry = &writer->entries[writer->entry_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->object_id_offset = blength(writer->object_ids);
+    entry->object_id_length = object_id_length;
+    entry->data_offset = writer->data_offset;
+    entry->data_length = data_length;
+    entry->records_offset = writer->data_offset + data_length;
+    entry->records_length = records_length;
+    entry->max_timestamp = max_timestamp;
+    writer->data_offset += data_length + records_length;
+
+    rc = bcatblk(writer->object_ids, object_id, object_id_length);
+    check(rc == BSTR_OK, "Unable to append object id");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes the object ids and entries, completes the header and syncs the
+// segment file to disk.
+//
+// writer - The writer.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_segment_writer_close(sky_segment_writer *writer)
+{
+    assert(writer != NULL);
+    check(writer->file != NULL, "Segment writer is closed");
+
+    // Write object ids and move entry offsets to be relative to the file.
+    uint64_t object_ids_offset = writer->data_offset;
+    if(blength(writer->object_ids) > 0) {
+        check(fwrite(bdatae(writer->object_ids, ""), blength(writer->object_ids), 1, writer->file) == 1, "Unable to write segment object ids");
+    }
+    uint64_t i;
+    for(i=0; i<writer->entry_count; i++) {
+        writer->entries[i].object_id_offset += object_ids_offset;
+    }
+
+    // Pad so that the entries are aligned in memory.
+    uint64_t entries_offset = object_ids_offset + blength(writer->object_ids);
+    while(entries_offset % sizeof(uint64_t) != 0) {
+        check(fputc(0, writer->file) != EOF, "Unable to write segment padding");
+        entries_offset++;
+    }
+
+    // Write entries.
+    sky_segment_header header;
+    memcpy(header.magic, SKY_SEGMENT_MAGIC, SKY_SEGMENT_MAGIC_LENGTH);
+    header.generation = writer->generation;
+    header.entry_count = writer->entry_count;
+    header.entries_offset = entries_offset;
+    if(writer->entry_count > 0) {
+        check(fwrite(writer->entries, sizeof(*writer->entries), writer->entry_count, writer->file) == writer->entry_count, "Unable to write segment entries");
+    }
+
+    // Write header.
+    check(fseek(writer->file, 0, SEEK_SET) == 0, "Unable to seek to segment header");
+    check(fwrite(&header, sizeof(header), 1, writer->file) == 1, "Unable to write segment header");
+
+    // Sync to disk.
+    check(fflush(writer->file) == 0, "Unable to flush segment");
+    check(fsync(fileno(writer->file)) == 0, "Unable to sync segment");
+    fclose(writer->file);
+    writer->file = NULL;
+
+    return 0;
+
+error:
+    return -1;
+}
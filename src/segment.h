@@ -0,0 +1,182 @@
+#ifndef _sky_segment_h
+#define _sky_segment_h
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+typedef struct sky_segment sky_segment;
+
+#include "bstring.h"
+#include "types.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A segment is an immutable file containing compacted object paths for a
+// single tablet. The file is memory mapped so that paths can be scanned in
+// place without going through LevelDB. The file is laid out as:
+//
+//   HEADER | PATH DATA & RECORDS | OBJECT IDS | ENTRIES
+//
+// The entries are sorted by object id and each one references the object id,
+// the path data and the records for a single object. Records hold the
+// object's other tablet values, such as its tail summary and checkpoints, so
+// that compacted objects need nothing from LevelDB. Each record is stored as:
+//
+//   TYPE (1) | TIMESTAMP (8) | LENGTH (8) | VALUE
+//
+// Records are sorted by type and then timestamp. All values are stored in
+// native byte order. Version 1 segments had no records and are still read.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+#define SKY_SEGMENT_MAGIC "SKYSEG02"
+
+#define SKY_SEGMENT_MAGIC_V1 "SKYSEG01"
+
+#define SKY_SEGMENT_MAGIC_LENGTH 8
+
+#define SKY_SEGMENT_RECORD_HEADER_LENGTH (sizeof(uint8_t) + sizeof(sky_timestamp_t) + sizeof(uint64_t))
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+typedef struct sky_segment_header {
+    char magic[SKY_SEGMENT_MAGIC_LENGTH];
+    uint64_t generation;
+    uint64_t entry_count;
+    uint64_t entries_offset;
+} sky_segment_header;
+
+typedef struct sky_segment_entry {
+    uint64_t object_id_offset;
+    uint64_t data_offset;
+    uint64_t data_length;
+    uint64_t records_offset;
+    uint64_t records_length;
+    sky_timestamp_t max_timestamp;
+    uint32_t object_id_length;
+    uint32_t reserved;
+} sky_segment_entry;
+
+typedef struct sky_segment_record {
+    uint8_t type;
+    sky_timestamp_t ts;
+    const void *value;
+    size_t value_length;
+} sky_segment_record;
+
+struct sky_segment {
+    bstring path;
+    void *data;
+    size_t data_length;
+    uint64_t generation;
+    sky_segment_entry *entries;
+    uint64_t entry_count;
+    bool has_records;
+    bool owns_entries;
+};
+
+typedef struct sky_segment_writer {
+    bstring path;
+    FILE *file;
+    uint64_t generation;
+    uint64_t data_offset;
+    sky_segment_entry *entries;
+    uint64_t entry_count;
+    uint64_t entry_capacity;
+    bstring object_ids;
+} sky_segment_writer;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_segment *sky_segment_create();
+
+void sky_segment_free(sky_segment *segment);
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+int sky_segment_open(sky_segment *segment, bstring path);
+
+int sky_segment_close(sky_segment *segment);
+
+
+//--------------------------------------
+// Entries
+//--------------------------------------
+
+sky_segment_entry *sky_segment_find(sky_segment *segment, const char *object_id,
+    size_t object_id_length);
+
+uint64_t sky_segment_lower_bound(sky_segment *segment, const char *object_id,
+    size_t object_id_length);
+
+uint64_t sky_segment_upper_bound(sky_segment *segment, const char *object_id,
+    size_t object_id_length);
+
+int sky_segment_compare(sky_segment *segment, sky_segment_entry *entry,
+    const char *object_id, size_t object_id_length);
+
+void *sky_segment_get_object_id(sky_segment *segment, sky_segment_entry *entry);
+
+void *sky_segment_get_data(sky_segment *segment, sky_segment_entry *entry);
+
+void *sky_segment_get_records(sky_segment *segment, sky_segment_entry *entry);
+
+
+//--------------------------------------
+// Records
+//--------------------------------------
+
+int sky_segment_record_pack(bstring records, uint8_t type, sky_timestamp_t ts,
+    const void *value, size_t value_length);
+
+int sky_segment_record_unpack(sky_segment_record *record, const void *ptr,
+    size_t length, size_t *sz);
+
+int sky_segment_find_record(sky_segment *segment, sky_segment_entry *entry,
+    uint8_t type, sky_timestamp_t ts, sky_segment_record *record, bool *found);
+
+
+//--------------------------------------
+// Writer
+//--------------------------------------
+
+sky_segment_writer *sky_segment_writer_create(bstring path,
+    uint64_t generation);
+
+void sky_segment_writer_free(sky_segment_writer *writer);
+
+int sky_segment_writer_write(sky_segment_writer *writer, const char *object_id,
+    size_t object_id_length, void *data, size_t data_length, void *records,
+    size_t records_length);
+
+int sky_segment_writer_close(sky_segment_writer *writer);
+
+#endif
@@ -3,8 +3,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <poll.h>
+#include <errno.h>
 #include <assert.h>
-#include <zmq.h>
 
 #include "bstring.h"
 #include "server.h"
@@ -19,14 +20,23 @@
 #include "get_property_message.h"
 #include "get_properties_message.h"
 #include "lookup_message.h"
+#include "object_state_message.h"
 #include "create_table_message.h"
 #include "delete_table_message.h"
 #include "get_table_message.h"
 #include "get_tables_message.h"
+#include "get_stats_message.h"
+#include "compact_message.h"
+#include "reshard_table_message.h"
 #include "ping_message.h"
 #include "lua_aggregate_message.h"
+#include "prepare_query_message.h"
+#include "execute_query_message.h"
+#include "query_message.h"
+#include "funnel_message.h"
+#include "retention_message.h"
 #include "multi_message.h"
-#include "sky_zmq.h"
+#include "queue.h"
 #include "dbg.h"
 
 
@@ -40,6 +50,8 @@ int sky_server_create_servlets(sky_server *server, sky_table *table);
 
 int sky_server_stop_servlets(sky_server *server, sky_table *table);
 
+int sky_server_finish_reshard(sky_server *server, sky_table *table);
+
 
 //==============================================================================
 //
@@ -76,7 +88,17 @@ sky_server *sky_server_create(bstring path)
     server->path = bstrcpy(path);
     if(path) check_mem(server->path);
     server->port = SKY_DEFAULT_PORT;
-    server->context = zmq_ctx_new();
+    server->durability = SKY_TABLET_DURABILITY_ASYNC;
+    server->sync_interval = SKY_DEFAULT_SYNC_INTERVAL;
+    server->block_cache_size = SKY_DEFAULT_BLOCK_CACHE_SIZE;
+    server->worker_thread_count = SKY_WORKER_POOL_DEFAULT_THREAD_COUNT;
+    server->executor_thread_count = sky_executor_get_default_thread_count();
+    sky_table_config_init(&server->table_config);
+    server->shutdown_queue = sky_queue_create(SKY_QUEUE_DEFAULT_CAPACITY);
+    check_mem(server->shutdown_queue);
+    server->lua_cache = sky_lua_cache_create(SKY_LUA_CACHE_DEFAULT_CAPACITY);
+    check_mem(server->lua_cache);
+    server->next_query_id = 1;
     
     return server;
 
@@ -142,6 +164,25 @@ void sky_server_free_message_handlers(sky_server *server)
     }
 }
 
+// Frees the registered queries on a server instance.
+//
+// server - The server.
+//
+// Returns nothing.
+void sky_server_free_queries(sky_server *server)
+{
+    if(server) {
+        uint32_t i;
+        for(i=0; i<server->query_count; i++) {
+            sky_query_free(server->queries[i]);
+            server->queries[i] = NULL;
+        }
+        free(server->queries);
+        server->queries = NULL;
+        server->query_count = 0;
+    }
+}
+
 // Frees a server instance from memory.
 //
 // server - The server object to free.
@@ -154,7 +195,19 @@ void sky_server_free(sky_server *server)
         sky_server_free_tables(server);
         sky_server_free_servlets(server);
         sky_server_free_message_handlers(server);
-        zmq_ctx_destroy(server->context);
+        sky_worker_pool_free(server->worker_pool);
+        server->worker_pool = NULL;
+        sky_executor_free(server->executor);
+        server->executor = NULL;
+        sky_queue_free(server->shutdown_queue);
+        server->shutdown_queue = NULL;
+        sky_lua_cache_free(server->lua_cache);
+        server->lua_cache = NULL;
+        sky_server_free_queries(server);
+
+        // The block cache is destroyed after all tablets are closed.
+        if(server->block_cache) leveldb_cache_destroy(server->block_cache);
+        server->block_cache = NULL;
 
         free(server);
     }
@@ -203,6 +256,12 @@ int sky_server_start(sky_server *server)
     rc = listen(server->socket, SKY_LISTEN_BACKLOG);
     check(rc != -1, "Unable to listen on socket");
     
+    // Start the threads that run workers.
+    server->worker_pool = sky_worker_pool_create(server->worker_thread_count);
+    check_mem(server->worker_pool);
+    rc = sky_worker_pool_start(server->worker_pool);
+    check(rc == 0, "Unable to start worker pool");
+    
     // Update server state.
     server->state = SKY_SERVER_STATE_RUNNING;
     
@@ -236,10 +295,37 @@ int sky_server_stop(sky_server *server)
     }
     server->sockaddr = NULL;
     
+    // Let queued workers finish before their servlets are shut down.
+    if(server->worker_pool) {
+        rc = sky_worker_pool_stop(server->worker_pool);
+        check(rc == 0, "Unable to stop worker pool");
+    }
+
     // Send a shutdown signal to all servlets and wait for response.
     rc = sky_server_stop_servlets(server, NULL);
     check(rc == 0, "Unable to stop servlets");
 
+    // Servlets no longer reply to the pool so its channels can be freed.
+    sky_worker_pool_free(server->worker_pool);
+    server->worker_pool = NULL;
+
+    // Stop the executor once the servlets have shut down.
+    if(server->executor) {
+        rc = sky_executor_stop(server->executor);
+        check(rc == 0, "Unable to stop executor");
+    }
+
+    // Switch over any tables that finished copying to a new layout.
+    uint32_t i;
+    for(i=0; i<server->table_count; i++) {
+        sky_table *table = server->tables[i];
+        int state = sky_table_get_reshard_state(table);
+        if(state == SKY_TABLE_RESHARD_STATE_COPIED || state == SKY_TABLE_RESHARD_STATE_FAILED) {
+            rc = sky_table_finish_reshard(table);
+            check(rc == 0, "Unable to finish reshard: %s", bdata(table->path));
+        }
+    }
+
     // Update server state.
     server->state = SKY_SERVER_STATE_STOPPED;
     
@@ -260,41 +346,17 @@ error:
 int sky_server_stop_servlets(sky_server *server, sky_table *table)
 {
     int rc;
-    void *pull_socket = NULL;
-    void *push_socket = NULL;
     assert(server != NULL);
 
-    // Create pull socket.
-    pull_socket = zmq_socket(server->context, ZMQ_PULL);
-    check(pull_socket != NULL, "Unable to create server shutdown socket");
-
-    // Bind pull socket.
-    rc = zmq_bind(pull_socket, SKY_SERVER_SHUTDOWN_URI);
-    check(rc == 0, "Unable to bind server shutdown socket");
-
     // Send a shutdown message to each servlet.
     uint32_t i, j;
     uint32_t count = 0;
     for(i=0; i<server->servlet_count; i++) {
         // Check if this servlet matches the table.
         if(table == NULL || server->servlets[i]->tablet->table == table) {
-            // Create push socket.
-            push_socket = zmq_socket(server->context, ZMQ_PUSH);
-            check(push_socket != NULL, "Unable to create shutdown push socket");
-    
-            // Connect to servlet.
-            rc = zmq_connect(push_socket, bdata(server->servlets[i]->uri));
-            check(rc == 0, "Unable to connect to servlet for shutdown");
-
             // Send NULL worklet for shutdown.
-            void *ptr = NULL;
-            rc = sky_zmq_send_ptr(push_socket, &ptr);
+            rc = sky_servlet_push(server->servlets[i], NULL);
             check(rc == 0, "Unable to send worklet message");
-        
-            // Close socket.
-            rc = zmq_close(push_socket);
-            check(rc == 0, "Unable to close server shutdown push socket");
-            push_socket = NULL;
             
             // Clear the servlet.
             for(j=i+1; j<server->servlet_count; j++) {
@@ -309,18 +371,15 @@ int sky_server_stop_servlets(sky_server *server, sky_table *table)
         }
     }
 
-    // Read in one pull message for every push message sent.
+    // Wait for a shutdown response from every servlet.
     for(i=0; i<count; i++) {
         // Receive servlet ref on shutdown.
         sky_servlet *servlet = NULL;
-        rc = sky_zmq_recv_ptr(pull_socket, (void**)&servlet);
+        rc = sky_queue_pop(server->shutdown_queue, (void**)&servlet);
         check(rc == 0, "Server unable to receive shutdown response");
+        sky_servlet_free(servlet);
     }
 
-    // Clean up socket.
-    rc = zmq_close(pull_socket);
-    check(rc == 0, "Unable to close server shutdown pull socket");
-
     // Clean up servlets.
     if(server->servlet_count == 0) {
         free(server->servlets);
@@ -330,13 +389,13 @@ int sky_server_stop_servlets(sky_server *server, sky_table *table)
     return 0;
 
 error:
-    if(pull_socket) zmq_close(pull_socket);
-    if(push_socket) zmq_close(push_socket);
     return -1;
 }
 
 // Accepts a connection on a running server. Once a connection is accepted then
-// the message is parsed and processed.
+// the message is parsed and processed. In interval durability mode the
+// server waits no longer than the sync interval for a connection so that
+// tablets which have stopped receiving writes are still synced.
 //
 // server - The server.
 //
@@ -348,6 +407,18 @@ int sky_server_accept(sky_server *server)
     FILE *output = NULL;
     assert(server != NULL);
 
+    // Sync idle tablets while waiting for a connection.
+    if(server->durability == SKY_TABLET_DURABILITY_INTERVAL) {
+        while(true) {
+            struct pollfd pollfd = {.fd = server->socket, .events = POLLIN};
+            rc = poll(&pollfd, 1, (int)server->sync_interval);
+            check(rc != -1 || errno == EINTR, "Unable to poll socket");
+            rc = sky_server_sync_tablets(server);
+            check(rc == 0, "Unable to sync tablets");
+            if(pollfd.revents != 0) break;
+        }
+    }
+
     // Accept the next connection.
     int sockaddr_size = sizeof(struct sockaddr_in);
     int socket = accept(server->socket, (struct sockaddr*)server->sockaddr, (socklen_t *)&sockaddr_size);
@@ -371,6 +442,34 @@ error:
     return -1;
 }
 
+// Syncs the tablets of every open table that have writes waiting for their
+// sync interval. Tables are only opened and closed on the server's thread so
+// the tablets can't be freed while they are synced. Servlets can keep
+// writing to the tablets meanwhile.
+//
+// server - The server.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_server_sync_tablets(sky_server *server)
+{
+    int rc;
+    uint32_t i, j;
+    assert(server != NULL);
+
+    for(i=0; i<server->table_count; i++) {
+        sky_table *table = server->tables[i];
+        for(j=0; j<table->tablet_count; j++) {
+            rc = sky_tablet_sync_if_due(table->tablets[j]);
+            check(rc == 0, "Unable to sync tablet: %s", bdata(table->tablets[j]->path));
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
 
 //--------------------------------------
 // Message Processing
@@ -608,6 +707,11 @@ int sky_server_add_default_message_handlers(sky_server *server)
     rc = sky_server_add_message_handler(server, handler);
     check(rc == 0, "Unable to add message handler");
 
+    // 'Object State' message.
+    handler = sky_object_state_message_handler_create(); check_mem(handler);
+    rc = sky_server_add_message_handler(server, handler);
+    check(rc == 0, "Unable to add message handler");
+
     // 'Add Table' message.
     handler = sky_create_table_message_handler_create(); check_mem(handler);
     rc = sky_server_add_message_handler(server, handler);
@@ -628,6 +732,21 @@ int sky_server_add_default_message_handlers(sky_server *server)
     rc = sky_server_add_message_handler(server, handler);
     check(rc == 0, "Unable to add message handler");
 
+    // 'Get Stats' message.
+    handler = sky_get_stats_message_handler_create(); check_mem(handler);
+    rc = sky_server_add_message_handler(server, handler);
+    check(rc == 0, "Unable to add message handler");
+
+    // 'Compact' message.
+    handler = sky_compact_message_handler_create(); check_mem(handler);
+    rc = sky_server_add_message_handler(server, handler);
+    check(rc == 0, "Unable to add message handler");
+
+    // 'Reshard Table' message.
+    handler = sky_reshard_table_message_handler_create(); check_mem(handler);
+    rc = sky_server_add_message_handler(server, handler);
+    check(rc == 0, "Unable to add message handler");
+
     // 'Ping' message.
     handler = sky_ping_message_handler_create(); check_mem(handler);
     rc = sky_server_add_message_handler(server, handler);
@@ -638,6 +757,31 @@ int sky_server_add_default_message_handlers(sky_server *server)
     rc = sky_server_add_message_handler(server, handler);
     check(rc == 0, "Unable to add message handler");
 
+    // 'Prepare Query' message.
+    handler = sky_prepare_query_message_handler_create(); check_mem(handler);
+    rc = sky_server_add_message_handler(server, handler);
+    check(rc == 0, "Unable to add message handler");
+
+    // 'Execute Query' message.
+    handler = sky_execute_query_message_handler_create(); check_mem(handler);
+    rc = sky_server_add_message_handler(server, handler);
+    check(rc == 0, "Unable to add message handler");
+
+    // 'Query' message.
+    handler = sky_query_message_handler_create(); check_mem(handler);
+    rc = sky_server_add_message_handler(server, handler);
+    check(rc == 0, "Unable to add message handler");
+
+    // 'Funnel' message.
+    handler = sky_funnel_message_handler_create(); check_mem(handler);
+    rc = sky_server_add_message_handler(server, handler);
+    check(rc == 0, "Unable to add message handler");
+
+    // 'Retention' message.
+    handler = sky_retention_message_handler_create(); check_mem(handler);
+    rc = sky_server_add_message_handler(server, handler);
+    check(rc == 0, "Unable to add message handler");
+
     // 'Multi' message.
     handler = sky_multi_message_handler_create(); check_mem(handler);
     rc = sky_server_add_message_handler(server, handler);
@@ -691,6 +835,14 @@ int sky_server_get_table(sky_server *server, bstring name, sky_table **ret)
         rc = sky_server_open_table(server, name, path, ret);
         check(rc == 0, "Unable to open table");
     }
+    // Otherwise switch over to a new tablet layout if a reshard has finished.
+    else {
+        int state = sky_table_get_reshard_state(*ret);
+        if(state == SKY_TABLE_RESHARD_STATE_COPIED || state == SKY_TABLE_RESHARD_STATE_FAILED) {
+            rc = sky_server_finish_reshard(server, *ret);
+            check(rc == 0, "Unable to finish reshard");
+        }
+    }
 
     bdestroy(path);
     return 0;
@@ -727,6 +879,16 @@ int sky_server_open_table(sky_server *server, bstring name, bstring path,
         // Create the table.
         table = sky_table_create(); check_mem(table);
         table->name = bstrcpy(name); check_mem(table->name);
+        table->durability = server->durability;
+        table->sync_interval = server->sync_interval;
+        table->config = server->table_config;
+
+        // Share a single block cache across all tablets on the server.
+        if(server->block_cache == NULL && server->block_cache_size > 0) {
+            server->block_cache = leveldb_cache_create_lru(server->block_cache_size);
+            check_mem(server->block_cache);
+        }
+        table->block_cache = server->block_cache;
         rc = sky_table_set_path(table, path);
         check(rc == 0, "Unable to set table path");
 
@@ -795,6 +957,36 @@ error:
 }
 
 
+// Switches a table over to the tablet layout of a finished reshard. The
+// table's servlets are stopped while the remaining changes are copied and are
+// then recreated for the new tablets.
+//
+// server - The server.
+// table  - The table.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_server_finish_reshard(sky_server *server, sky_table *table)
+{
+    int rc;
+    assert(server != NULL);
+    assert(table != NULL);
+
+    rc = sky_server_stop_servlets(server, table);
+    check(rc == 0, "Unable to shutdown servlets related to table: %s", bdata(table->path));
+
+    rc = sky_table_finish_reshard(table);
+    check(rc == 0, "Unable to finish reshard: %s", bdata(table->path));
+
+    rc = sky_server_create_servlets(server, table);
+    check(rc == 0, "Unable to create servlets for table");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
 //--------------------------------------
 // Servlet Management
 //--------------------------------------
@@ -881,6 +1073,15 @@ int sky_server_create_servlets(sky_server *server, sky_table *table)
     assert(server != NULL);
     assert(table);
     
+    // Start the threads that run tablet work for every table when the first
+    // table is opened.
+    if(server->executor == NULL) {
+        server->executor = sky_executor_create(server->executor_thread_count);
+        check_mem(server->executor);
+        rc = sky_executor_start(server->executor);
+        check(rc == 0, "Unable to start executor");
+    }
+
     // Allocate additional space for the new servlets.
     uint32_t new_servlet_count = table->tablet_count;
     server->servlets = realloc(server->servlets, (server->servlet_count + new_servlet_count) * sizeof(*server->servlets));
@@ -912,3 +1113,72 @@ error:
     return -1;
 }
 
+
+//--------------------------------------
+// Query Management
+//--------------------------------------
+
+// Registers a query with the server and assigns it a handle. A query that
+// replaces an earlier query with the same name on the same table keeps the
+// earlier query's handle. The server takes ownership of the query.
+//
+// server - The server.
+// query  - The query.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_server_add_query(sky_server *server, sky_query *query)
+{
+    uint32_t i;
+    assert(server != NULL);
+    check(query != NULL, "Query required");
+    check(blength(query->name) > 0, "Query name required");
+    check(query->table_path != NULL, "Query table required");
+
+    // Replace an existing query with the same name.
+    for(i=0; i<server->query_count; i++) {
+        sky_query *existing = server->queries[i];
+        if(biseq(existing->table_path, query->table_path) == 1 && biseq(existing->name, query->name) == 1) {
+            query->id = existing->id;
+            sky_query_free(existing);
+            server->queries[i] = query;
+            return 0;
+        }
+    }
+
+    // Otherwise append it with a new handle.
+    sky_query **queries = realloc(server->queries, sizeof(*queries) * (server->query_count+1));
+    check_mem(queries);
+    server->queries = queries;
+    query->id = server->next_query_id++;
+    server->queries[server->query_count++] = query;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Retrieves a registered query by handle.
+//
+// server - The server.
+// id     - The query handle.
+// ret    - A pointer to where the query should be returned. This is null if
+//          no query has the handle.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_server_get_query(sky_server *server, uint32_t id, sky_query **ret)
+{
+    uint32_t i;
+    assert(server != NULL);
+    assert(ret != NULL);
+
+    *ret = NULL;
+    for(i=0; i<server->query_count; i++) {
+        if(server->queries[i]->id == id) {
+            *ret = server->queries[i];
+            break;
+        }
+    }
+
+    return 0;
+}
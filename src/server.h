@@ -13,6 +13,11 @@ typedef struct sky_server sky_server;
 #include "table.h"
 #include "event.h"
 #include "message_handler.h"
+#include "worker_pool.h"
+#include "executor.h"
+#include "lua_cache.h"
+#include "query.h"
+#include "queue.h"
 
 
 //==============================================================================
@@ -25,8 +30,6 @@ typedef struct sky_server sky_server;
 
 #define SKY_LISTEN_BACKLOG 511
 
-#define SKY_SERVER_SHUTDOWN_URI "inproc://server.shutdown"
-
 
 //==============================================================================
 //
@@ -45,6 +48,11 @@ struct sky_server {
     uint32_t id;
     bstring path;
     int port;
+    int durability;
+    int64_t sync_interval;
+    sky_table_config table_config;
+    size_t block_cache_size;
+    leveldb_cache_t *block_cache;
     struct sockaddr_in* sockaddr;
     int socket;
     sky_servlet **servlets;
@@ -54,7 +62,15 @@ struct sky_server {
     uint32_t table_count;
     sky_message_handler **message_handlers;
     uint32_t message_handler_count;
-    void *context;
+    uint32_t worker_thread_count;
+    sky_worker_pool *worker_pool;
+    uint32_t executor_thread_count;
+    sky_executor *executor;
+    sky_lua_cache *lua_cache;
+    sky_query **queries;
+    uint32_t query_count;
+    uint32_t next_query_id;
+    sky_queue *shutdown_queue;
 };
 
 
@@ -83,6 +99,8 @@ int sky_server_stop(sky_server *server);
 
 int sky_server_accept(sky_server *server);
 
+int sky_server_sync_tablets(sky_server *server);
+
 //--------------------------------------
 // Servlet Management
 //--------------------------------------
@@ -126,4 +144,12 @@ int sky_server_open_table(sky_server *server, bstring name, bstring path,
 
 int sky_server_close_table(sky_server *server, sky_table *table);
 
+//--------------------------------------
+// Query Management
+//--------------------------------------
+
+int sky_server_add_query(sky_server *server, sky_query *query);
+
+int sky_server_get_query(sky_server *server, uint32_t id, sky_query **ret);
+
 #endif
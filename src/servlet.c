@@ -1,13 +1,12 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <pthread.h>
-#include <zmq.h>
+#include <string.h>
+#include <assert.h>
 
 #include "servlet.h"
 #include "worker.h"
 #include "worklet.h"
-#include "sky_zmq.h"
 #include "dbg.h"
 
 
@@ -17,7 +16,7 @@
 //
 //==============================================================================
 
-void *sky_servlet_run(void *_servlet);
+void sky_servlet_run(void *_servlet);
 
 
 //==============================================================================
@@ -57,8 +56,10 @@ sky_servlet *sky_servlet_create(sky_server *server, sky_tablet *tablet)
     servlet->id = server->next_servlet_id++;
     servlet->name = bformat("%s.%d.%d", bdata(tablet->table->name), server->id, tablet->index);
     check_mem(servlet->name);
-    servlet->uri = bformat("inproc://servlet.%s", bdata(servlet->name));
-    check_mem(servlet->uri);
+    servlet->queue = sky_queue_create(SKY_QUEUE_DEFAULT_CAPACITY);
+    check_mem(servlet->queue);
+    servlet->lua_cache = sky_lua_cache_create(SKY_LUA_CACHE_DEFAULT_CAPACITY);
+    check_mem(servlet->lua_cache);
     servlet->server = server;
     servlet->tablet = tablet;
     
@@ -81,10 +82,13 @@ void sky_servlet_free(sky_servlet *servlet)
         servlet->server = NULL;
         if(servlet->name) bdestroy(servlet->name);
         servlet->name = NULL;
-        if(servlet->uri) bdestroy(servlet->uri);
-        servlet->uri = NULL;
-        if(servlet->pull_socket) zmq_close(servlet->pull_socket);
-        servlet->pull_socket = NULL;
+        sky_queue_free(servlet->queue);
+        servlet->queue = NULL;
+        free(servlet->worklets);
+        servlet->worklets = NULL;
+        servlet->worklet_count = 0;
+        sky_lua_cache_free(servlet->lua_cache);
+        servlet->lua_cache = NULL;
         free(servlet);
     }
 }
@@ -95,41 +99,22 @@ void sky_servlet_free(sky_servlet *servlet)
 //--------------------------------------
 
 // Starts a servlet. Once a servlet is started, it cannot be stopped until the
-// server has stopped.
+// server has stopped. The servlet runs on the server's executor whenever it
+// has worklets to process.
 //
 // servlet - The servlet.
 //
 // Returns 0 if successful, otherwise returns -1.
 int sky_servlet_start(sky_servlet *servlet)
 {
-    int rc;
     check(servlet != NULL, "Servlet required");
-    check(servlet->uri != NULL, "Servlet URI required");
+    check(servlet->queue != NULL, "Servlet queue required");
+    check(servlet->server->executor != NULL, "Server executor required");
     check(servlet->state == SKY_SERVLET_STATE_STOPPED, "Servlet already running");
 
-    // Create a listening queue.
-    void *context = servlet->server->context;
-    servlet->pull_socket = zmq_socket(context, ZMQ_PULL);
-    check_mem(servlet->pull_socket);
-    rc = zmq_bind(servlet->pull_socket, bdata(servlet->uri));
-    check(rc == 0, "Unable to connect servlet pull socket");
-    
     // Update servlet state.
     servlet->state = SKY_SERVLET_STATE_RUNNING;
 
-    // Setup thread attributes.
-    pthread_attr_t attr;
-    check(pthread_attr_init(&attr) == 0, "Unable to init thread attributes");
-    check(pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) == 0, "Unable to set thread detach state");
-
-    // Create the worker thread.
-    rc = pthread_create(&servlet->thread, NULL, sky_servlet_run, (void*)servlet);
-    check(rc == 0, "Unable to create servlet thread");
-
-    // Destory thread attributes & detach thread.
-    check(pthread_attr_destroy(&attr) == 0, "Unable to destroy thread attributes");
-    check(pthread_detach(servlet->thread) == 0, "Unable to detach worker thread");
-
     return 0;
 
 error:
@@ -144,33 +129,53 @@ error:
 int sky_servlet_send_shutdown_message(sky_servlet *servlet)
 {
     int rc;
-    void *socket = NULL;
     check(servlet != NULL, "Servlet required");
     check(servlet->state == SKY_SERVLET_STATE_RUNNING, "Servlet is not running");
 
-    // Send a shutdown response to the server.
-    socket = zmq_socket(servlet->server->context, ZMQ_PUSH);
-    check(socket != NULL, "Unable to create servlet shutdown push socket");
-
-    // Connect to server.
-    rc = zmq_connect(socket, SKY_SERVER_SHUTDOWN_URI);
-    check(rc == 0, "Unable to connect to server for shutdown");
+    // Update servlet state.
+    servlet->state = SKY_SERVLET_STATE_STOPPED;
 
     // Send pointer to servlet for shutdown.
-    rc = sky_zmq_send_ptr(socket, &servlet);
+    rc = sky_queue_push(servlet->server->shutdown_queue, servlet);
     check(rc == 0, "Unable to send servlet shutdown message");
 
-    // Close shutdown socket.
-    rc = zmq_close(socket);
-    check(rc == 0, "Unable to close servlet shutdown socket");
+    return 0;
+
+error:
+    return -1;
+}
 
-    // Update servlet state.
-    servlet->state = SKY_SERVLET_STATE_STOPPED;
+
+//--------------------------------------
+// Messaging
+//--------------------------------------
+
+// Sends a worklet to a servlet. The servlet is queued on the executor if it
+// is not already waiting to run. A null worklet shuts the servlet down once
+// the worklets before it have been processed.
+//
+// servlet - The servlet.
+// worklet - The worklet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_servlet_push(sky_servlet *servlet, sky_worklet *worklet)
+{
+    int rc;
+    check(servlet != NULL, "Servlet required");
+
+    rc = sky_queue_push(servlet->queue, worklet);
+    check(rc == 0, "Unable to push worklet");
+
+    // The message count covers every message that has been sent but not yet
+    // processed. Whoever moves it off of zero schedules the servlet.
+    if(__atomic_fetch_add(&servlet->message_count, 1, __ATOMIC_SEQ_CST) == 0) {
+        rc = sky_executor_submit(servlet->server->executor, sky_servlet_run, servlet);
+        check(rc == 0, "Unable to schedule servlet");
+    }
 
     return 0;
 
 error:
-    if(socket) zmq_close(socket);
     return -1;
 }
 
@@ -179,62 +184,274 @@ error:
 // Processing
 //--------------------------------------
 
-// The worker function for the servlet thread.
+// Sends a processed worklet back to the channel of its worker.
 //
 // servlet - The servlet.
+// worklet - The worklet.
 //
-// Returns NULL.
-void *sky_servlet_run(void *_servlet)
+// Returns 0 if successful, otherwise returns -1.
+static int sky_servlet_send_worklet(sky_servlet *servlet, sky_worklet *worklet)
 {
     int rc;
-    sky_worklet *worklet = NULL;
-    sky_servlet *servlet = (sky_servlet *)_servlet;
-    void *push_socket = NULL;
-    check(servlet != NULL, "Servlet required");
+    assert(servlet != NULL);
+
+    rc = sky_queue_push(worklet->worker->channel->queue, worklet);
+    check(rc == 0, "Unable to send worklet message");
     
-    // Read in messages from pull socket.
-    void *context = servlet->server->context;
-    while(true) {
-        // Read in worklet.
-        rc = sky_zmq_recv_ptr(servlet->pull_socket, (void**)(&worklet));
-        check(rc == 0, "Unable to receive worklet message");
-        
+    return 0;
+
+error:
+    return -1;
+}
+
+// Moves the messages waiting on the servlet's queue into its list of
+// pending worklets. Worklets stay in the servlet's message count until they
+// are processed so only the shutdown message is counted here.
+//
+// servlet - The servlet.
+// count   - A pointer to where the number of messages consumed is added.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_servlet_receive(sky_servlet *servlet, int32_t *count)
+{
+    int rc;
+    sky_worklet *worklet = NULL;
+    while(!servlet->stopping && sky_queue_try_pop(servlet->queue, (void**)(&worklet))) {
         // If worklet is NULL then stop the servlet.
         if(worklet == NULL) {
+            (*count)++;
+            servlet->stopping = true;
             break;
         }
-        
-        // Process worklet.
-        sky_worker *worker = worklet->worker;
-        worker->map(worker, servlet->tablet, &worklet->data);
-        
-        // Connect back to worker.
-        push_socket = zmq_socket(context, ZMQ_PUSH); check_mem(push_socket);
-        rc = zmq_connect(push_socket, bdata(worker->pull_socket_uri));
-        check(rc == 0, "Unable to connect servlet push socket");
-
-        // Send back worklet.
-        rc = sky_zmq_send_ptr(push_socket, (void*)(&worklet));
-        check(rc == 0, "Unable to send worklet message");
-        
-        // Close socket.
-        zmq_close(push_socket);
-        push_socket = NULL;
-    }
-
-    // Close pull socket.
-    zmq_close(servlet->pull_socket);
-    check(rc == 0, "Unable to close servlet pull socket");
-    servlet->pull_socket = NULL;
-    
-    // Notify server that servlet is being shutdown.
-    rc = sky_servlet_send_shutdown_message(servlet);
-    check(rc == 0, "Unable to send servlet shutdown message");
 
-    sky_servlet_free(servlet);
-    return NULL;
+        // A worklet that can't be held is failed right away so that its
+        // worker isn't left waiting on it.
+        if(servlet->worklet_count == servlet->worklet_capacity) {
+            uint32_t capacity = (servlet->worklet_capacity > 0 ? servlet->worklet_capacity * 2 : 64);
+            sky_worklet **worklets = realloc(servlet->worklets, capacity * sizeof(*servlet->worklets));
+            if(worklets == NULL) {
+                worklet->failed = true;
+                (*count)++;
+                rc = sky_servlet_send_worklet(servlet, worklet);
+                check(rc == 0, "Unable to send failed worklet");
+                sentinel("Unable to allocate pending worklets");
+            }
+            servlet->worklets = worklets;
+            servlet->worklet_capacity = capacity;
+        }
+        servlet->worklets[servlet->worklet_count++] = worklet;
+    }
+
+    return 0;
 
 error:
-    if(push_socket) zmq_close(push_socket);
-    return NULL;
+    return -1;
+}
+
+// Removes worklets from the front of the servlet's pending list.
+//
+// servlet - The servlet.
+// index   - The index of the first worklet to remove.
+// count   - The number of worklets to remove.
+//
+// Returns nothing.
+static void sky_servlet_remove_worklets(sky_servlet *servlet, uint32_t index,
+                                        uint32_t count)
+{
+    memmove(&servlet->worklets[index], &servlet->worklets[index+count], (servlet->worklet_count - index - count) * sizeof(*servlet->worklets));
+    servlet->worklet_count -= count;
+}
+
+// Processes a run of batchable worklets from the front of the pending list.
+// Their writes are committed to the tablet in a single batch and the
+// worklets are only sent back to their workers once the batch has been
+// committed. The writes of a worklet that fails to map are rolled back
+// before the batch is committed. Worklets are always sent back and removed
+// from the list, even if they fail, so that their workers are never left
+// waiting.
+//
+// servlet - The servlet.
+// count   - A pointer to where the number of processed worklets is added.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_servlet_process_batch(sky_servlet *servlet, int32_t *count)
+{
+    int rc;
+    uint32_t i;
+
+    uint32_t batch_count = 0;
+    while(batch_count < servlet->worklet_count && batch_count < SKY_SERVLET_MAX_BATCH_SIZE && servlet->worklets[batch_count]->worker->batchable) {
+        batch_count++;
+    }
+
+    rc = sky_tablet_begin_batch(servlet->tablet);
+    if(rc == 0) {
+        for(i=0; i<batch_count && rc == 0; i++) {
+            sky_worklet *worklet = servlet->worklets[i];
+            // Undo the partial writes of a failed worklet so that only the
+            // writes of successful worklets are committed.
+            rc = sky_tablet_save_batch(servlet->tablet);
+            if(rc == 0 && sky_worker_map(worklet->worker, worklet, servlet) != 0) {
+                log_err("Unable to map worklet");
+                worklet->failed = true;
+                rc = sky_tablet_rollback_batch(servlet->tablet);
+            }
+        }
+
+        // Commit writes before acknowledging the worklets.
+        if(rc == 0) {
+            rc = sky_tablet_end_batch(servlet->tablet);
+        }
+    }
+
+    // None of the batch's writes are kept if it can't be committed.
+    if(rc != 0) {
+        log_err("Unable to commit tablet batch");
+        sky_tablet_discard_batch(servlet->tablet);
+        for(i=0; i<batch_count; i++) {
+            servlet->worklets[i]->failed = true;
+        }
+    }
+
+    int result = 0;
+    for(i=0; i<batch_count; i++) {
+        rc = sky_servlet_send_worklet(servlet, servlet->worklets[i]);
+        if(rc != 0) {
+            log_err("Unable to send worklet");
+            result = -1;
+        }
+    }
+    sky_servlet_remove_worklets(servlet, 0, batch_count);
+    *count += batch_count;
+
+    return result;
+}
+
+// Maps the readers at the front of the pending list. Of those readers, the
+// one whose worker has received the least mapping time is chosen. If its
+// worker supports shared scans then the other waiting readers that scan the
+// same way are mapped along with it in a single pass over the tablet.
+// Writes are never reordered around a reader.
+//
+// servlet - The servlet.
+// count   - A pointer to where the number of processed worklets is added.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_servlet_process_reader(sky_servlet *servlet, int32_t *count)
+{
+    int rc;
+    uint32_t i;
+
+    uint32_t index = 0;
+    uint32_t reader_count = 1;
+    for(i=1; i<servlet->worklet_count && !servlet->worklets[i]->worker->batchable; i++) {
+        if(__atomic_load_n(&servlet->worklets[i]->worker->service_time, __ATOMIC_RELAXED) < __atomic_load_n(&servlet->worklets[index]->worker->service_time, __ATOMIC_RELAXED)) {
+            index = i;
+        }
+        reader_count++;
+    }
+
+    sky_worklet *worklet = servlet->worklets[index];
+    sky_worker_map_shared_func_t map_shared = worklet->worker->map_shared;
+
+    // Gather the readers that can share a pass with the chosen reader. The
+    // remaining readers are compacted toward the front of the list.
+    sky_worklet *group[SKY_SERVLET_MAX_SHARED_SCAN_SIZE];
+    uint32_t group_count = 0;
+    uint32_t remaining_count = 0;
+    group[group_count++] = worklet;
+    for(i=0; i<reader_count; i++) {
+        sky_worklet *reader = servlet->worklets[i];
+        if(i != index && map_shared != NULL && reader->worker->map_shared == map_shared && group_count < SKY_SERVLET_MAX_SHARED_SCAN_SIZE) {
+            group[group_count++] = reader;
+        }
+        else if(i != index) {
+            servlet->worklets[remaining_count++] = reader;
+        }
+    }
+    sky_servlet_remove_worklets(servlet, remaining_count, reader_count - remaining_count);
+
+    if(group_count > 1) {
+        rc = sky_worker_map_shared(group, group_count, servlet);
+    }
+    else {
+        rc = sky_worker_map(worklet->worker, worklet, servlet);
+    }
+    if(rc != 0) {
+        log_err("Unable to map worklet");
+        for(i=0; i<group_count; i++) {
+            group[i]->failed = true;
+        }
+    }
+
+    int result = 0;
+    for(i=0; i<group_count; i++) {
+        rc = sky_servlet_send_worklet(servlet, group[i]);
+        if(rc != 0) {
+            log_err("Unable to send worklet");
+            result = -1;
+        }
+    }
+    *count += group_count;
+
+    return result;
+}
+
+// Runs a single turn of the servlet on an executor thread. The servlet is
+// queued on the executor again if messages are still waiting afterward.
+//
+// _servlet - The servlet.
+//
+// Returns nothing.
+void sky_servlet_run(void *_servlet)
+{
+    int rc;
+    int32_t count = 0;
+    sky_servlet *servlet = (sky_servlet *)_servlet;
+    check(servlet != NULL, "Servlet required");
+
+    // Failures are logged but the turn always runs to the end so that the
+    // processed messages are released from the message count and the
+    // servlet is scheduled again for any that are still waiting.
+    rc = sky_servlet_receive(servlet, &count);
+    if(rc != 0) {
+        log_err("Unable to receive worklets");
+    }
+
+    if(servlet->worklet_count > 0) {
+        if(servlet->worklets[0]->worker->batchable) {
+            rc = sky_servlet_process_batch(servlet, &count);
+            if(rc != 0) {
+                log_err("Unable to process batch");
+            }
+        }
+        else {
+            rc = sky_servlet_process_reader(servlet, &count);
+            if(rc != 0) {
+                log_err("Unable to process worklet");
+            }
+        }
+    }
+
+    // Notify server that servlet is being shutdown. The server frees the
+    // servlet once it receives the notification so it cannot be used
+    // afterward.
+    if(servlet->stopping && servlet->worklet_count == 0) {
+        free(servlet->worklets);
+        servlet->worklets = NULL;
+        rc = sky_servlet_send_shutdown_message(servlet);
+        check(rc == 0, "Unable to send servlet shutdown message");
+        return;
+    }
+
+    // Run again later if more messages are waiting.
+    if(__atomic_sub_fetch(&servlet->message_count, count, __ATOMIC_SEQ_CST) > 0) {
+        rc = sky_executor_submit(servlet->server->executor, sky_servlet_run, servlet);
+        check(rc == 0, "Unable to reschedule servlet");
+    }
+
+    return;
+
+error:
+    return;
 }
@@ -4,13 +4,57 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include <stdbool.h>
-#include <pthread.h>
 
 typedef struct sky_servlet sky_servlet;
 
 #include "bstring.h"
 #include "server.h"
 #include "tablet.h"
+#include "queue.h"
+#include "worklet.h"
+#include "lua_cache.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A servlet processes the worklets sent to a single tablet. Servlets run on
+// the server's executor and a servlet is only ever run by one executor
+// thread at a time so the tablet is never accessed concurrently by its own
+// work. Each time a servlet runs it processes one turn of worklets and is
+// then queued behind the other waiting servlets if it still has work.
+//
+// A turn either commits a run of batchable writes together or maps a single
+// worklet that reads the tablet. When several readers are waiting at the
+// front of the queue, the one whose worker has received the least mapping
+// time so far is run first so that a large query does not hold up smaller
+// queries on the same tablets.
+//
+// Readers that support shared scans are grouped together so that several
+// queries waiting on the same tablet are answered by a single pass over it.
+// The pass is split into morsels that other threads can help with, the same
+// as the scan of a single reader.
+//
+// Each servlet keeps its own cache of compiled Lua scripts. The cache is
+// only used during the servlet's turns so it is never contended.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The maximum number of pending worklets that are processed together before
+// the servlet's tablet writes are committed.
+#define SKY_SERVLET_MAX_BATCH_SIZE 1024
+
+// The maximum number of pending readers that share a single pass over the
+// servlet's tablet.
+#define SKY_SERVLET_MAX_SHARED_SCAN_SIZE 16
 
 
 //==============================================================================
@@ -31,9 +75,13 @@ struct sky_servlet {
     sky_server *server;
     sky_tablet *tablet;
     bstring name;
-    bstring uri;
-    void *pull_socket;
-    pthread_t thread;
+    sky_queue *queue;
+    int32_t message_count;
+    bool stopping;
+    sky_worklet **worklets;
+    uint32_t worklet_count;
+    uint32_t worklet_capacity;
+    sky_lua_cache *lua_cache;
 };
 
 
@@ -57,4 +105,10 @@ void sky_servlet_free(sky_servlet *servlet);
 
 int sky_servlet_start(sky_servlet *servlet);
 
+//--------------------------------------
+// Messaging
+//--------------------------------------
+
+int sky_servlet_push(sky_servlet *servlet, sky_worklet *worklet);
+
 #endif
@@ -1,13 +1,59 @@
 #include <ctype.h>
 #include <assert.h>
+#include <string.h>
 
 #include "sky_lua.h"
 #include "path_iterator.h"
 #include "cursor.h"
+#include "hll.h"
+#include "tdigest.h"
 #include "dbg.h"
 #include "mem.h"
 
 
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The size of the buffer used to pack sketches in Lua. This must be large
+// enough to hold any type of packed sketch.
+#define SKY_LUA_SKETCH_BUFFER_SZ (SKY_HLL_MAX_PACKED_SZ > SKY_TDIGEST_MAX_PACKED_SZ ? SKY_HLL_MAX_PACKED_SZ : SKY_TDIGEST_MAX_PACKED_SZ)
+
+
+//==============================================================================
+//
+// Globals
+//
+//==============================================================================
+
+// Functions that are only called from Lua through the FFI. Referencing them
+// here keeps them in the binary when it is linked against the static library.
+void *SKY_LUA_FFI_FUNCTIONS[] = {
+    (void*)sky_hll_create,
+    (void*)sky_hll_free,
+    (void*)sky_hll_add_number,
+    (void*)sky_hll_add_string,
+    (void*)sky_hll_merge,
+    (void*)sky_hll_count,
+    (void*)sky_hll_pack,
+    (void*)sky_hll_unpack,
+    (void*)sky_hll_is_packed,
+    (void*)sky_tdigest_create,
+    (void*)sky_tdigest_free,
+    (void*)sky_tdigest_add,
+    (void*)sky_tdigest_merge,
+    (void*)sky_tdigest_count,
+    (void*)sky_tdigest_quantile,
+    (void*)sky_tdigest_min,
+    (void*)sky_tdigest_max,
+    (void*)sky_tdigest_pack,
+    (void*)sky_tdigest_unpack,
+    (void*)sky_tdigest_is_packed,
+};
+
+
 //==============================================================================
 //
 // Functions
@@ -235,6 +281,30 @@ int sky_lua_generate_header(bstring source, sky_table *table, bstring *ret)
         "bool sky_lua_cursor_next_event(sky_cursor_t *);\n"
         "bool sky_lua_cursor_next_session(sky_cursor_t *);\n"
         "bool sky_cursor_set_session_idle(sky_cursor_t *, uint32_t);\n"
+        "\n"
+        "typedef struct sky_hll_t sky_hll_t;\n"
+        "sky_hll_t *sky_hll_create();\n"
+        "void sky_hll_free(sky_hll_t *);\n"
+        "void sky_hll_add_number(sky_hll_t *, double);\n"
+        "void sky_hll_add_string(sky_hll_t *, const char *, uint32_t);\n"
+        "void sky_hll_merge(sky_hll_t *, sky_hll_t *);\n"
+        "double sky_hll_count(sky_hll_t *);\n"
+        "uint32_t sky_hll_pack(sky_hll_t *, char *);\n"
+        "int sky_hll_unpack(sky_hll_t *, const char *, uint32_t);\n"
+        "bool sky_hll_is_packed(const char *, uint32_t);\n"
+        "\n"
+        "typedef struct sky_tdigest_t sky_tdigest_t;\n"
+        "sky_tdigest_t *sky_tdigest_create();\n"
+        "void sky_tdigest_free(sky_tdigest_t *);\n"
+        "void sky_tdigest_add(sky_tdigest_t *, double, double);\n"
+        "void sky_tdigest_merge(sky_tdigest_t *, sky_tdigest_t *);\n"
+        "double sky_tdigest_count(sky_tdigest_t *);\n"
+        "double sky_tdigest_quantile(sky_tdigest_t *, double);\n"
+        "double sky_tdigest_min(sky_tdigest_t *);\n"
+        "double sky_tdigest_max(sky_tdigest_t *);\n"
+        "uint32_t sky_tdigest_pack(sky_tdigest_t *, char *);\n"
+        "int sky_tdigest_unpack(sky_tdigest_t *, const char *, uint32_t);\n"
+        "bool sky_tdigest_is_packed(const char *, uint32_t);\n"
         "]])\n"
         "ffi.metatype('sky_data_descriptor_t', {\n"
         "  __index = {\n"
@@ -261,6 +331,74 @@ int sky_lua_generate_header(bstring source, sky_table *table, bstring *ret)
         "    set_session_idle = function(cursor, seconds) return ffi.C.sky_cursor_set_session_idle(cursor, seconds) end,\n"
         "  }\n"
         "})\n"
+        "ffi.metatype('sky_hll_t', {\n"
+        "  __index = {\n"
+        "    add = function(hll, value) if type(value) == 'string' then ffi.C.sky_hll_add_string(hll, value, #value) else ffi.C.sky_hll_add_number(hll, value) end return hll end,\n"
+        "    merge = function(hll, other) if other ~= nil then ffi.C.sky_hll_merge(hll, other) end return hll end,\n"
+        "    count = function(hll) return ffi.C.sky_hll_count(hll) end,\n"
+        "  }\n"
+        "})\n"
+        "function sky_hll() return ffi.gc(ffi.C.sky_hll_create(), ffi.C.sky_hll_free) end\n"
+        "ffi.metatype('sky_tdigest_t', {\n"
+        "  __index = {\n"
+        "    add = function(digest, value, weight) ffi.C.sky_tdigest_add(digest, value, weight or 1) return digest end,\n"
+        "    merge = function(digest, other) if other ~= nil then ffi.C.sky_tdigest_merge(digest, other) end return digest end,\n"
+        "    count = function(digest) return ffi.C.sky_tdigest_count(digest) end,\n"
+        "    quantile = function(digest, q) return ffi.C.sky_tdigest_quantile(digest, q) end,\n"
+        "    min = function(digest) return ffi.C.sky_tdigest_min(digest) end,\n"
+        "    max = function(digest) return ffi.C.sky_tdigest_max(digest) end,\n"
+        "  }\n"
+        "})\n"
+        "function sky_tdigest() return ffi.gc(ffi.C.sky_tdigest_create(), ffi.C.sky_tdigest_free) end\n"
+        "\n"
+        "-- Sketches are packed into strings before results are encoded and are\n"
+        "-- unpacked again before they are merged.\n"
+        "local sky_sketch_buffer = ffi.new('char[?]', %d)\n"
+        "local function sky_pack_sketch(v)\n"
+        "  if ffi.istype('sky_hll_t', v) then return ffi.string(sky_sketch_buffer, ffi.C.sky_hll_pack(v, sky_sketch_buffer)) end\n"
+        "  if ffi.istype('sky_tdigest_t', v) then return ffi.string(sky_sketch_buffer, ffi.C.sky_tdigest_pack(v, sky_sketch_buffer)) end\n"
+        "  return v\n"
+        "end\n"
+        "local function sky_unpack_sketch(v)\n"
+        "  if ffi.C.sky_hll_is_packed(v, #v) then\n"
+        "    local hll = sky_hll()\n"
+        "    if ffi.C.sky_hll_unpack(hll, v, #v) == 0 then return hll end\n"
+        "  elseif ffi.C.sky_tdigest_is_packed(v, #v) then\n"
+        "    local digest = sky_tdigest()\n"
+        "    if ffi.C.sky_tdigest_unpack(digest, v, #v) == 0 then return digest end\n"
+        "  end\n"
+        "  return v\n"
+        "end\n"
+        "function sky_pack_sketches(value)\n"
+        "  for k, v in pairs(value) do\n"
+        "    if type(v) == 'table' then sky_pack_sketches(v)\n"
+        "    elseif type(v) == 'cdata' then value[k] = sky_pack_sketch(v) end\n"
+        "  end\n"
+        "  return value\n"
+        "end\n"
+        "function sky_unpack_sketches(value)\n"
+        "  for k, v in pairs(value) do\n"
+        "    if type(v) == 'table' then sky_unpack_sketches(v)\n"
+        "    elseif type(v) == 'string' then value[k] = sky_unpack_sketch(v) end\n"
+        "  end\n"
+        "  return value\n"
+        "end\n"
+        "\n"
+        "-- Replaces sketches in the final results with their estimates. Digests\n"
+        "-- are replaced with a summary of common percentiles.\n"
+        "function sky_finalize_sketches(value)\n"
+        "  for k, v in pairs(value) do\n"
+        "    if type(v) == 'table' then sky_finalize_sketches(v)\n"
+        "    elseif type(v) == 'string' then\n"
+        "      v = sky_unpack_sketch(v)\n"
+        "      if type(v) == 'cdata' and ffi.istype('sky_hll_t', v) then value[k] = v:count()\n"
+        "      elseif type(v) == 'cdata' and ffi.istype('sky_tdigest_t', v) then\n"
+        "        value[k] = {count=v:count(), min=v:min(), max=v:max(), p50=v:quantile(0.5), p90=v:quantile(0.9), p95=v:quantile(0.95), p99=v:quantile(0.99)}\n"
+        "      end\n"
+        "    end\n"
+        "  end\n"
+        "  return value\n"
+        "end\n"
         "%s\n"
         "\n"
         "%s\n"
@@ -272,19 +410,25 @@ int sky_lua_generate_header(bstring source, sky_table *table, bstring *ret)
         "    aggregate(cursor, data)\n"
         "    iterator:next()\n"
         "  end\n"
-        "  return data\n"
+        "  return sky_pack_sketches(data)\n"
+        "end\n"
+        "\n"
+        "-- The wrapper for a single path of a shared scan.\n"
+        "function sky_aggregate_cursor(_cursor, data)\n"
+        "  aggregate(ffi.cast('sky_cursor_t*', _cursor), data)\n"
         "end\n"
         "\n"
         "-- The wrapper for the merge.\n"
         "function sky_merge(results, data)\n"
         "  if data ~= nil then\n"
-        "    merge(results, data)\n"
+        "    merge(sky_unpack_sketches(results), sky_unpack_sketches(data))\n"
         "  end"
-        "  return results\n"
+        "  return sky_pack_sketches(results)\n"
         "end\n"
         "-- SKY GENERATED CODE END --\n"
         ,
         bdata(event_decl),
+        SKY_LUA_SKETCH_BUFFER_SZ,
         bdata(event_metatype),
         bdata(init_descriptor_func)
     );
@@ -303,6 +447,57 @@ error:
 }
 
 
+// Appends a Lua table to a header that maps the dictionary codes of a
+// property to their string values.
+//
+// ret      - The string to append the table to.
+// property - The dictionary encoded property.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_lua_append_dictionary(bstring ret, sky_property *property)
+{
+    int rc;
+    assert(ret != NULL);
+    assert(property != NULL);
+    assert(property->dictionary != NULL);
+
+    rc = bformata(ret, "sky_dictionary_%s = {", bdata(property->name));
+    check(rc == BSTR_OK, "Unable to append dictionary");
+
+    uint32_t i;
+    for(i=0; i<property->dictionary->count; i++) {
+        bstring value = property->dictionary->values[i];
+        rc = bcatcstr(ret, (i > 0 ? ", '" : "'"));
+        check(rc == BSTR_OK, "Unable to append dictionary value");
+
+        // Escape the value so it is a valid Lua string literal.
+        int j;
+        for(j=0; j<blength(value); j++) {
+            unsigned char ch = (unsigned char)bchar(value, j);
+            if(ch == '\'' || ch == '\\') {
+                rc = bformata(ret, "\\%c", ch);
+            }
+            else if(ch < 32 || ch > 126) {
+                rc = bformata(ret, "\\%03d", ch);
+            }
+            else {
+                rc = bconchar(ret, ch);
+            }
+            check(rc == BSTR_OK, "Unable to append dictionary value");
+        }
+        rc = bconchar(ret, '\'');
+        check(rc == BSTR_OK, "Unable to append dictionary value");
+    }
+
+    rc = bcatcstr(ret, "}\n");
+    check(rc == BSTR_OK, "Unable to append dictionary");
+
+    return 0;
+
+error:
+    return -1;
+}
+
 // Generates the LuaJIT header given a Lua script and a property file. The
 // header file is generated based on the property usage of the 'event'
 // variable in the script.
@@ -322,6 +517,7 @@ int sky_lua_generate_event_info(bstring source,
 {
     int rc;
     bstring identifier = NULL;
+    bstring dictionaries = NULL;
     assert(source != NULL);
     assert(property_file != NULL);
     assert(event_decl != NULL);
@@ -337,6 +533,7 @@ int sky_lua_generate_event_info(bstring source,
     check_mem(*event_decl);
     
     *event_metatype = bfromcstr(""); check_mem(*event_metatype);
+    dictionaries = bfromcstr(""); check_mem(dictionaries);
     
     *init_descriptor_func = bfromcstr(
         "  descriptor:set_data_sz(ffi.sizeof('sky_lua_event_t'));\n"
@@ -389,9 +586,35 @@ int sky_lua_generate_event_info(bstring source,
                 sky_property *property = NULL;
                 rc = sky_property_file_find_by_name(property_file, identifier, &property);
                 check(rc == 0, "Unable to find property by name: %s", bdata(identifier));
+
+                // Dictionary codes are referenced with a "_code" suffix.
+                if(property == NULL && blength(identifier) > 5 && strcmp(bdata(identifier) + blength(identifier) - 5, "_code") == 0) {
+                    btrunc(identifier, blength(identifier) - 5);
+                    rc = sky_property_file_find_by_name(property_file, identifier, &property);
+                    check(rc == 0, "Unable to find property by name: %s", bdata(identifier));
+                    check(property == NULL || property->dictionary != NULL, "Property is not dictionary encoded: %s", bdata(identifier));
+                }
                 check(property != NULL, "Property not found: %s", bdata(identifier));
             
-                if(!lookup[property->id-SKY_PROPERTY_ID_MIN]) {
+                if(!lookup[property->id-SKY_PROPERTY_ID_MIN] && property->dictionary != NULL) {
+                    // Dictionary encoded strings are stored as codes and
+                    // decoded through a snapshot of the dictionary.
+                    bformata(*event_decl, "  int32_t _%s;\n", bdata(property->name));
+                    check_mem(*event_decl);
+
+                    rc = sky_lua_append_dictionary(dictionaries, property);
+                    check(rc == 0, "Unable to generate dictionary: %s", bdata(property->name));
+
+                    bformata(*event_metatype, "    %s = function(event) return sky_dictionary_%s[event._%s] or '' end,\n", bdata(property->name), bdata(property->name), bdata(property->name));
+                    bformata(*event_metatype, "    %s_code = function(event) return event._%s end,\n", bdata(property->name), bdata(property->name));
+                    check_mem(*event_metatype);
+
+                    bformata(*init_descriptor_func, "  descriptor:set_property(%d, ffi.offsetof('sky_lua_event_t', '_%s'), %d);\n", property->id, bdata(property->name), SKY_DATA_TYPE_INT);
+                    check_mem(*init_descriptor_func);
+
+                    lookup[property->id - SKY_PROPERTY_ID_MIN] = true;
+                }
+                else if(!lookup[property->id-SKY_PROPERTY_ID_MIN]) {
                     // Append property definition to event decl and function.
                     switch(property->data_type) {
                         case SKY_DATA_TYPE_STRING: {
@@ -442,11 +665,13 @@ int sky_lua_generate_event_info(bstring source,
 
     // Wrap event metatype.
     bassignformat(*event_metatype,
+        "%s"
         "ffi.metatype('sky_lua_event_t', {\n"
         "  __index = {\n"
         "%s"
         "  }\n"
         "})\n",
+        bdata(dictionaries),
         bdata(*event_metatype)
     );
     check_mem(*event_metatype);
@@ -461,10 +686,12 @@ int sky_lua_generate_event_info(bstring source,
     );
     check_mem(*init_descriptor_func);
 
+    bdestroy(dictionaries);
     return 0;
 
 error:
     bdestroy(identifier);
+    bdestroy(dictionaries);
     bdestroy(*event_decl);
     *event_decl = NULL;
     bdestroy(*init_descriptor_func);
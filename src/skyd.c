@@ -3,6 +3,7 @@
 #include <getopt.h>
 #include <signal.h>
 #include <unistd.h>
+#include <string.h>
 
 #include "bstring.h"
 #include "bandicoot/bandicoot.h"
@@ -22,6 +23,13 @@
 typedef struct {
     bstring path;
     int port;
+    int durability;
+    int64_t sync_interval;
+    int64_t block_cache_size;
+    int bloom_bits_per_key;
+    int64_t write_buffer_size;
+    int worker_thread_count;
+    int thread_count;
 } skyd_options;
 
 
@@ -62,6 +70,23 @@ int main(int argc, char **argv)
     sky_server *server = NULL;
     rc = skyd_server_create(options->path, options->port, &server);
     check(rc == 0, "Unable to create server");
+    server->durability = options->durability;
+    server->sync_interval = options->sync_interval;
+    if(options->block_cache_size >= 0) {
+        server->block_cache_size = (size_t)options->block_cache_size;
+    }
+    if(options->bloom_bits_per_key >= 0) {
+        server->table_config.bloom_bits_per_key = options->bloom_bits_per_key;
+    }
+    if(options->write_buffer_size > 0) {
+        server->table_config.write_buffer_size = (size_t)options->write_buffer_size;
+    }
+    if(options->worker_thread_count > 0) {
+        server->worker_thread_count = (uint32_t)options->worker_thread_count;
+    }
+    if(options->thread_count > 0) {
+        server->executor_thread_count = (uint32_t)options->thread_count;
+    }
     
     // Display status.
     printf("Sky Server v%s\n", SKY_VERSION);
@@ -152,17 +177,27 @@ skyd_options *skyd_options_parse(int argc, char **argv)
 {
     skyd_options *options = calloc(1, sizeof(*options));
     check_mem(options);
+    options->durability = SKY_TABLET_DURABILITY_ASYNC;
+    options->sync_interval = SKY_DEFAULT_SYNC_INTERVAL;
+    options->block_cache_size = -1;
+    options->bloom_bits_per_key = -1;
     
     // Command line options.
     struct option long_options[] = {
         {"port", optional_argument, 0, 'p'},
+        {"durability", optional_argument, 0, 'd'},
+        {"cache-size", optional_argument, 0, 'c'},
+        {"bloom-bits", optional_argument, 0, 'b'},
+        {"write-buffer-size", optional_argument, 0, 'w'},
+        {"worker-threads", optional_argument, 0, 'W'},
+        {"threads", optional_argument, 0, 't'},
         {0, 0, 0, 0}
     };
 
     // Parse command line options.
     while(1) {
         int option_index = 0;
-        int c = getopt_long(argc, argv, "p:", long_options, &option_index);
+        int c = getopt_long(argc, argv, "p:d:c:b:w:W:t:", long_options, &option_index);
         
         // Check for end of options.
         if(c == -1) {
@@ -171,10 +206,68 @@ skyd_options *skyd_options_parse(int argc, char **argv)
         
         // Parse each option.
         switch(c) {
-            case 'i': {
+            case 'p': {
                 options->port = atoi(optarg);
                 break;
             }
+
+            // Durability is either "sync", "async" or the number of
+            // milliseconds between syncs.
+            case 'd': {
+                if(strcmp(optarg, "sync") == 0) {
+                    options->durability = SKY_TABLET_DURABILITY_SYNC;
+                }
+                else if(strcmp(optarg, "async") == 0) {
+                    options->durability = SKY_TABLET_DURABILITY_ASYNC;
+                }
+                else {
+                    options->durability = SKY_TABLET_DURABILITY_INTERVAL;
+                    options->sync_interval = atoll(optarg);
+                    if(options->sync_interval <= 0) {
+                        fprintf(stderr, "Error: Invalid durability: %s\n\n", optarg);
+                        exit(1);
+                    }
+                }
+                break;
+            }
+
+            // The shared block cache size, in megabytes.
+            case 'c': {
+                options->block_cache_size = atoll(optarg) * 1024 * 1024;
+                break;
+            }
+
+            case 'b': {
+                options->bloom_bits_per_key = atoi(optarg);
+                break;
+            }
+
+            // The LevelDB write buffer size, in megabytes.
+            case 'w': {
+                options->write_buffer_size = atoll(optarg) * 1024 * 1024;
+                break;
+            }
+
+            // The number of threads that coordinate requests across servlets.
+            case 'W': {
+                options->worker_thread_count = atoi(optarg);
+                if(options->worker_thread_count <= 0) {
+                    fprintf(stderr, "Error: Invalid worker thread count: %s\n\n", optarg);
+                    exit(1);
+                }
+                break;
+            }
+
+            // The number of threads that run tablet work for all tables.
+            // This defaults to the number of processors.
+            case 't': {
+                options->thread_count = atoi(optarg);
+                if(options->thread_count <= 0) {
+                    fprintf(stderr, "Error: Invalid thread count: %s\n\n", optarg);
+                    exit(1);
+                }
+                break;
+            }
         }
     }
     
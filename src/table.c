@@ -5,6 +5,7 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <math.h>
+#include <string.h>
 #include <assert.h>
 
 #include "dbg.h"
@@ -36,6 +37,22 @@ int sky_table_load_tablets(sky_table *table);
 
 int sky_table_unload_tablets(sky_table *table);
 
+//--------------------------------------
+// Config file
+//--------------------------------------
+
+int sky_table_load_config(sky_table *table);
+
+//--------------------------------------
+// Layout file
+//--------------------------------------
+
+int sky_table_load_layout(sky_table *table);
+
+int sky_table_save_layout(sky_table *table, uint32_t generation, int hashing);
+
+int sky_table_remove_generation(sky_table *table, uint32_t generation);
+
 //--------------------------------------
 // Action file
 //--------------------------------------
@@ -72,6 +89,9 @@ sky_table *sky_table_create()
 {
     sky_table *table = calloc(sizeof(sky_table), 1); check_mem(table);
     table->default_tablet_count = DEFAULT_TABLET_COUNT;
+    table->durability = SKY_TABLET_DURABILITY_ASYNC;
+    table->sync_interval = SKY_DEFAULT_SYNC_INTERVAL;
+    sky_table_config_init(&table->config);
     return table;
     
 error:
@@ -140,8 +160,7 @@ int sky_table_get_target_tablet(sky_table *table, bstring object_id,
     check(table->tablet_count, "Table must have tablets available");
     
     // Calculate the tablet index.
-    uint32_t hash_code = sky_bstring_fnv1a(object_id);
-    uint32_t target_index = hash_code % table->tablet_count;
+    uint32_t target_index = sky_table_get_tablet_index(table->hashing, object_id, table->tablet_count);
     *ret = table->tablets[target_index];
     
     return 0;
@@ -151,6 +170,54 @@ error:
     return -1;
 }
 
+// Calculates the index of the tablet that an object id is assigned to.
+//
+// hashing      - The hashing scheme of the tablet layout.
+// object_id    - The object id.
+// tablet_count - The number of tablets in the layout.
+//
+// Returns the tablet index.
+uint32_t sky_table_get_tablet_index(int hashing, bstring object_id,
+                                    uint32_t tablet_count)
+{
+    assert(tablet_count > 0);
+    uint32_t hash_code = sky_bstring_fnv1a(object_id);
+
+    if(hashing == SKY_TABLE_HASHING_JUMP) {
+        // Jump consistent hash (Lamping & Veach).
+        uint64_t key = hash_code;
+        int64_t b = -1, j = 0;
+        while(j < (int64_t)tablet_count) {
+            b = j;
+            key = key * 2862933555777941757ULL + 1;
+            j = (int64_t)((b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1)));
+        }
+        return (uint32_t)b;
+    }
+    else {
+        return hash_code % tablet_count;
+    }
+}
+
+// Creates the path to a tablet within a layout generation. Generation zero
+// keeps its tablets directly in the table directory.
+//
+// table      - The table.
+// generation - The layout generation.
+// index      - The tablet index.
+//
+// Returns the path.
+static bstring sky_table_get_tablet_path(sky_table *table, uint32_t generation,
+                                         uint32_t index)
+{
+    if(generation == 0) {
+        return bformat("%s/%d", bdata(table->path), index);
+    }
+    else {
+        return bformat("%s/tablets.%d/%d", bdata(table->path), generation, index);
+    }
+}
+
 // Retrieves the number of existing tablets on a table based on the numeric
 // directories in a table's path.
 //
@@ -166,7 +233,7 @@ int sky_table_get_tablet_count(sky_table *table, uint32_t *ret)
     // Find the last tablet path.
     uint32_t index = 0;
     while(true) {
-        path = bformat("%s/%d", bdata(table->path), index); check_mem(path);
+        path = sky_table_get_tablet_path(table, table->generation, index); check_mem(path);
 
         // If we can't find the tablet path then the next 'index' is our
         // count since the index is zero-based.
@@ -227,7 +294,9 @@ int sky_table_load_tablets(sky_table *table)
     for(i=0; i<table->tablet_count; i++) {
         tablet = sky_tablet_create(table); check_mem(tablet);
         tablet->index = i;
-        tablet->path = bformat("%s/%d", bdata(table->path), i); check_mem(tablet->path);
+        tablet->durability = table->durability;
+        tablet->sync_interval = table->sync_interval;
+        tablet->path = sky_table_get_tablet_path(table, table->generation, i); check_mem(tablet->path);
         table->tablets[i] = tablet;
         tablet = NULL;
     }
@@ -268,6 +337,190 @@ int sky_table_unload_tablets(sky_table *table)
 }
 
 
+//--------------------------------------
+// Config file management
+//--------------------------------------
+
+// Reads the table's config file and applies it over the current config.
+//
+// table - The table.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_load_config(sky_table *table)
+{
+    int rc;
+    bstring path = NULL;
+    assert(table != NULL);
+    check(table->path != NULL, "Table path required");
+
+    path = bformat("%s/%s", bdata(table->path), SKY_TABLE_CONFIG_FILENAME);
+    check_mem(path);
+    rc = sky_table_config_load(&table->config, path);
+    check(rc == 0, "Unable to load config: %s", bdata(path));
+
+    bdestroy(path);
+    return 0;
+
+error:
+    bdestroy(path);
+    return -1;
+}
+
+
+//--------------------------------------
+// Layout file management
+//--------------------------------------
+
+// Reads the table's layout file. Any tablets left behind by a reshard that
+// did not finish are removed.
+//
+// table - The table.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_load_layout(sky_table *table)
+{
+    int rc;
+    FILE *file = NULL;
+    bstring path = NULL;
+    assert(table != NULL);
+    check(table->path != NULL, "Table path required");
+
+    table->generation = 0;
+    table->hashing = SKY_TABLE_HASHING_MODULO;
+
+    path = bformat("%s/%s", bdata(table->path), SKY_TABLE_LAYOUT_FILENAME);
+    check_mem(path);
+    if(sky_file_exists(path)) {
+        file = fopen(bdata(path), "r");
+        check(file != NULL, "Unable to open layout file: %s", bdata(path));
+
+        char line[256];
+        while(fgets(line, sizeof(line), file) != NULL) {
+            char name[64], value[64];
+            int count = sscanf(line, "%63s %63s", name, value);
+            if(count <= 0 || name[0] == '#') {
+                continue;
+            }
+            check(count == 2, "Missing layout value: %s", name);
+
+            if(strcmp(name, "generation") == 0) {
+                table->generation = (uint32_t)strtoul(value, NULL, 10);
+            }
+            else if(strcmp(name, "hashing") == 0) {
+                if(strcmp(value, "jump") == 0) {
+                    table->hashing = SKY_TABLE_HASHING_JUMP;
+                }
+                else if(strcmp(value, "modulo") == 0) {
+                    table->hashing = SKY_TABLE_HASHING_MODULO;
+                }
+                else {
+                    sentinel("Invalid hashing: %s", value);
+                }
+            }
+        }
+        fclose(file);
+        file = NULL;
+    }
+
+    // Remove an unfinished reshard and the layout it replaced.
+    rc = sky_table_remove_generation(table, table->generation + 1);
+    check(rc == 0, "Unable to remove unfinished reshard");
+    if(table->generation > 0) {
+        rc = sky_table_remove_generation(table, table->generation - 1);
+        check(rc == 0, "Unable to remove previous layout");
+    }
+
+    bdestroy(path);
+    return 0;
+
+error:
+    if(file) fclose(file);
+    bdestroy(path);
+    return -1;
+}
+
+// Writes the table's layout file. The file is replaced atomically so the
+// switch to a new layout happens in a single step.
+//
+// table      - The table.
+// generation - The layout generation.
+// hashing    - The hashing scheme.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_save_layout(sky_table *table, uint32_t generation, int hashing)
+{
+    int rc;
+    FILE *file = NULL;
+    bstring path = NULL;
+    bstring tmp_path = NULL;
+    assert(table != NULL);
+
+    path = bformat("%s/%s", bdata(table->path), SKY_TABLE_LAYOUT_FILENAME);
+    check_mem(path);
+    tmp_path = bformat("%s.tmp", bdata(path)); check_mem(tmp_path);
+
+    file = fopen(bdata(tmp_path), "w");
+    check(file != NULL, "Unable to open layout file: %s", bdata(tmp_path));
+    rc = fprintf(file, "generation %d\nhashing %s\n", generation, (hashing == SKY_TABLE_HASHING_JUMP ? "jump" : "modulo"));
+    check(rc > 0, "Unable to write layout file");
+    check(fflush(file) == 0 && fsync(fileno(file)) == 0, "Unable to sync layout file");
+    fclose(file);
+    file = NULL;
+
+    rc = rename(bdata(tmp_path), bdata(path));
+    check(rc == 0, "Unable to replace layout file: %s", bdata(path));
+
+    bdestroy(path);
+    bdestroy(tmp_path);
+    return 0;
+
+error:
+    if(file) fclose(file);
+    bdestroy(path);
+    bdestroy(tmp_path);
+    return -1;
+}
+
+// Removes the tablets of a layout generation from disk.
+//
+// table      - The table.
+// generation - The layout generation.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_remove_generation(sky_table *table, uint32_t generation)
+{
+    int rc;
+    bstring path = NULL;
+    assert(table != NULL);
+
+    if(generation > 0) {
+        path = bformat("%s/tablets.%d", bdata(table->path), generation); check_mem(path);
+        rc = sky_file_rm_r(path);
+        check(rc == 0, "Unable to remove tablets: %s", bdata(path));
+    }
+    else {
+        uint32_t i;
+        for(i=0; ; i++) {
+            path = sky_table_get_tablet_path(table, 0, i); check_mem(path);
+            if(!sky_file_exists(path)) {
+                break;
+            }
+            rc = sky_file_rm_r(path);
+            check(rc == 0, "Unable to remove tablet: %s", bdata(path));
+            bdestroy(path);
+            path = NULL;
+        }
+    }
+
+    bdestroy(path);
+    return 0;
+
+error:
+    bdestroy(path);
+    return -1;
+}
+
+
 //--------------------------------------
 // Action file management
 //--------------------------------------
@@ -361,14 +614,21 @@ error:
 // Returns 0 if successful, otherwise returns -1.
 int sky_table_unload_property_file(sky_table *table)
 {
+    int rc;
     assert(table != NULL);
 
+    // Save any values that were added since the last save.
     if(table->property_file) {
+        rc = sky_property_file_save_if_dirty(table->property_file);
+        check(rc == 0, "Unable to save property file");
         sky_property_file_free(table->property_file);
         table->property_file = NULL;
     }
 
     return 0;
+
+error:
+    return -1;
 }
 
 
@@ -398,6 +658,14 @@ int sky_table_open(sky_table *table)
     rc = sky_table_lock(table);
     check(rc == 0, "Unable to obtain lock");
 
+    // Apply any config overrides for the table.
+    rc = sky_table_load_config(table);
+    check(rc == 0, "Unable to load config file");
+
+    // Determine the tablet layout.
+    rc = sky_table_load_layout(table);
+    check(rc == 0, "Unable to load layout file");
+
     // Load data file.
     rc = sky_table_load_tablets(table);
     check(rc == 0, "Unable to load tablets");
@@ -430,6 +698,9 @@ int sky_table_close(sky_table *table)
     int rc;
     assert(table != NULL);
 
+    // Discard any unfinished reshard.
+    sky_table_abort_reshard(table);
+
     // Unload tablets.
     rc = sky_table_unload_tablets(table);
     check(rc == 0, "Unable to unload data file");
@@ -521,6 +792,228 @@ error:
 }
 
 
+//--------------------------------------
+// Resharding
+//--------------------------------------
+
+// Creates the tablets of a new layout that the table's objects will be
+// copied into. The new layout uses jump consistent hashing so that later
+// changes to the tablet count only move a fraction of the objects. The
+// current tablets continue to serve reads and writes until the reshard is
+// finished.
+//
+// table        - The table.
+// tablet_count - The number of tablets in the new layout.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_begin_reshard(sky_table *table, uint32_t tablet_count)
+{
+    int rc;
+    sky_table_reshard *reshard = NULL;
+    bstring path = NULL;
+    assert(table != NULL);
+    check(table->opened, "Table must be open to reshard");
+    check(table->reshard == NULL, "Table is already being resharded");
+    check(tablet_count > 0, "Tablet count must be greater than zero");
+
+    reshard = calloc(1, sizeof(*reshard)); check_mem(reshard);
+    reshard->generation = table->generation + 1;
+    reshard->state = SKY_TABLE_RESHARD_STATE_COPYING;
+
+    // Start from an empty generation directory.
+    rc = sky_table_remove_generation(table, reshard->generation);
+    check(rc == 0, "Unable to remove existing tablets");
+    path = bformat("%s/tablets.%d", bdata(table->path), reshard->generation); check_mem(path);
+    rc = mkdir(bdatae(path, ""), S_IRWXU);
+    check(rc == 0, "Unable to create tablets directory: %s", bdata(path));
+
+    reshard->tablets = calloc(tablet_count, sizeof(*reshard->tablets));
+    check_mem(reshard->tablets);
+    reshard->tablet_count = tablet_count;
+
+    uint32_t i;
+    for(i=0; i<tablet_count; i++) {
+        sky_tablet *tablet = sky_tablet_create(table); check_mem(tablet);
+        reshard->tablets[i] = tablet;
+        tablet->index = i;
+        tablet->durability = table->durability;
+        tablet->sync_interval = table->sync_interval;
+        tablet->path = sky_table_get_tablet_path(table, reshard->generation, i); check_mem(tablet->path);
+        rc = sky_tablet_open(tablet);
+        check(rc == 0, "Unable to open tablet: %s", bdata(tablet->path));
+    }
+
+    table->reshard = reshard;
+
+    bdestroy(path);
+    return 0;
+
+error:
+    if(reshard) {
+        table->reshard = reshard;
+        sky_table_abort_reshard(table);
+    }
+    bdestroy(path);
+    return -1;
+}
+
+// Retrieves the tablet in the new layout that an object id is assigned to.
+//
+// table     - The table.
+// object_id - The object id.
+// ret       - A pointer to where the tablet should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_get_reshard_target(sky_table *table, bstring object_id,
+                                 sky_tablet **ret)
+{
+    assert(table != NULL);
+    assert(ret != NULL);
+    check(table->reshard != NULL, "Table is not being resharded");
+
+    uint32_t index = sky_table_get_tablet_index(SKY_TABLE_HASHING_JUMP, object_id, table->reshard->tablet_count);
+    *ret = table->reshard->tablets[index];
+    return 0;
+
+error:
+    *ret = NULL;
+    return -1;
+}
+
+// Retrieves the state of the table's reshard. This can be called from any
+// thread.
+//
+// table - The table.
+//
+// Returns the reshard state or -1 if the table is not being resharded.
+int sky_table_get_reshard_state(sky_table *table)
+{
+    assert(table != NULL);
+    if(table->reshard == NULL) {
+        return -1;
+    }
+    return __sync_fetch_and_add(&table->reshard->state, 0);
+}
+
+// Marks the copy of a reshard as complete or failed. This can be called from
+// any thread.
+//
+// table - The table.
+// state - The new state.
+//
+// Returns nothing.
+void sky_table_set_reshard_state(sky_table *table, int state)
+{
+    assert(table != NULL);
+    assert(table->reshard != NULL);
+    __sync_bool_compare_and_swap(&table->reshard->state, SKY_TABLE_RESHARD_STATE_COPYING, state);
+}
+
+// Compares two object ids for sorting.
+static int sky_table_object_id_cmp(const void *a, const void *b)
+{
+    return bstrcmp(*((bstring*)a), *((bstring*)b));
+}
+
+// Copies the objects that changed while the reshard was copying and then
+// switches the table over to the new layout. No other thread can be using
+// the table's tablets while this runs.
+//
+// table - The table.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_finish_reshard(sky_table *table)
+{
+    int rc;
+    assert(table != NULL);
+    check(table->reshard != NULL, "Table is not being resharded");
+    sky_table_reshard *reshard = table->reshard;
+
+    // Discard the new layout if the copy failed.
+    if(sky_table_get_reshard_state(table) == SKY_TABLE_RESHARD_STATE_FAILED) {
+        sky_table_abort_reshard(table);
+        return 0;
+    }
+    check(sky_table_get_reshard_state(table) == SKY_TABLE_RESHARD_STATE_COPIED, "Reshard copy has not finished");
+
+    // Copy each changed object again.
+    uint32_t i, j;
+    for(i=0; i<table->tablet_count; i++) {
+        sky_tablet *tablet = table->tablets[i];
+        qsort(tablet->changed_object_ids, tablet->changed_object_id_count, sizeof(*tablet->changed_object_ids), sky_table_object_id_cmp);
+        for(j=0; j<tablet->changed_object_id_count; j++) {
+            bstring object_id = tablet->changed_object_ids[j];
+            if(j > 0 && biseq(object_id, tablet->changed_object_ids[j-1]) == 1) {
+                continue;
+            }
+
+            sky_tablet *target = NULL;
+            rc = sky_table_get_reshard_target(table, object_id, &target);
+            check(rc == 0, "Unable to determine reshard target");
+            rc = sky_tablet_copy_object(tablet, object_id, target);
+            check(rc == 0, "Unable to copy object: %s", bdata(object_id));
+        }
+        sky_tablet_clear_changes(tablet);
+    }
+
+    // Make sure the new tablets are on disk before switching to them.
+    for(i=0; i<reshard->tablet_count; i++) {
+        rc = sky_tablet_sync(reshard->tablets[i]);
+        check(rc == 0, "Unable to sync tablet: %s", bdata(reshard->tablets[i]->path));
+    }
+    rc = sky_table_save_layout(table, reshard->generation, SKY_TABLE_HASHING_JUMP);
+    check(rc == 0, "Unable to save layout");
+
+    // Replace the current tablets with the new layout.
+    uint32_t generation = table->generation;
+    rc = sky_table_unload_tablets(table);
+    check(rc == 0, "Unable to unload tablets");
+    table->tablets = reshard->tablets;
+    table->tablet_count = reshard->tablet_count;
+    table->generation = reshard->generation;
+    table->hashing = SKY_TABLE_HASHING_JUMP;
+    table->reshard = NULL;
+    free(reshard);
+
+    rc = sky_table_remove_generation(table, generation);
+    check(rc == 0, "Unable to remove previous tablets");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Discards the new layout of an unfinished reshard. No other thread can be
+// using the table's tablets while this runs.
+//
+// table - The table.
+//
+// Returns nothing.
+void sky_table_abort_reshard(sky_table *table)
+{
+    assert(table != NULL);
+
+    sky_table_reshard *reshard = table->reshard;
+    if(reshard != NULL) {
+        uint32_t i;
+        for(i=0; i<table->tablet_count; i++) {
+            sky_tablet_clear_changes(table->tablets[i]);
+        }
+        for(i=0; i<reshard->tablet_count; i++) {
+            sky_tablet_free(reshard->tablets[i]);
+        }
+        free(reshard->tablets);
+        table->reshard = NULL;
+
+        if(table->path != NULL) {
+            sky_table_remove_generation(table, reshard->generation);
+        }
+        free(reshard);
+    }
+}
+
+
 //--------------------------------------
 // Event Management
 //--------------------------------------
@@ -553,3 +1046,31 @@ error:
     return -1;
 }
 
+
+//--------------------------------------
+// Stats
+//--------------------------------------
+
+// Sums the write statistics across all tablets in the table. The counters
+// are read atomically since the servlets may be writing to the tablets.
+//
+// table - The table.
+// stats - A pointer to where the combined stats should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_get_stats(sky_table *table, sky_tablet_stats *stats)
+{
+    assert(table != NULL);
+    assert(stats != NULL);
+    memset(stats, 0, sizeof(*stats));
+
+    uint32_t i;
+    for(i=0; i<table->tablet_count; i++) {
+        sky_tablet_stats *tablet_stats = &table->tablets[i]->stats;
+        stats->append_count += __atomic_load_n(&tablet_stats->append_count, __ATOMIC_RELAXED);
+        stats->merge_count += __atomic_load_n(&tablet_stats->merge_count, __ATOMIC_RELAXED);
+        stats->write_count += __atomic_load_n(&tablet_stats->write_count, __ATOMIC_RELAXED);
+    }
+
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <leveldb/c.h>
 
 typedef struct sky_table sky_table;
 
@@ -14,6 +15,7 @@ typedef struct sky_table sky_table;
 #include "event.h"
 #include "types.h"
 #include "tablet.h"
+#include "table_config.h"
 #include "action_file.h"
 #include "property_file.h"
 
@@ -28,6 +30,35 @@ typedef struct sky_table sky_table;
 
 #define DEFAULT_TABLET_COUNT 4
 
+// The name of the file that records the table's current tablet layout. The
+// file uses the same "<name> <value>" format as the table config. Tables
+// without a layout file use generation zero and modulo hashing.
+#define SKY_TABLE_LAYOUT_FILENAME "layout"
+
+// Objects are assigned to a tablet using their hash modulo the tablet count.
+// Changing the tablet count moves almost every object.
+#define SKY_TABLE_HASHING_MODULO    0
+
+// Objects are assigned to a tablet using jump consistent hashing. Changing
+// the tablet count from N to M only moves about |M-N|/max(M,N) of the objects.
+#define SKY_TABLE_HASHING_JUMP      1
+
+// The states of a reshard. The state is changed from the worker thread that
+// copies the data and read from the main thread.
+#define SKY_TABLE_RESHARD_STATE_COPYING 0
+#define SKY_TABLE_RESHARD_STATE_COPIED  1
+#define SKY_TABLE_RESHARD_STATE_FAILED  2
+
+// A new tablet layout that a table's objects are being copied into. The new
+// tablets are stored under the next layout generation and replace the
+// current tablets once all objects have been copied.
+typedef struct sky_table_reshard {
+    sky_tablet **tablets;
+    uint32_t tablet_count;
+    uint32_t generation;
+    int state;
+} sky_table_reshard;
+
 // The table is a collection of tablets. Data is shared into tablets but
 // action and property data is managed by the table as a whole.
 struct sky_table {
@@ -39,6 +70,13 @@ struct sky_table {
     bstring path;
     bool opened;
     uint32_t default_tablet_count;
+    int durability;
+    int64_t sync_interval;
+    sky_table_config config;
+    leveldb_cache_t *block_cache;
+    uint32_t generation;
+    int hashing;
+    sky_table_reshard *reshard;
     FILE *lock_file;
 };
 
@@ -72,6 +110,26 @@ int sky_table_get_tablet_count(sky_table *table, uint32_t *ret);
 int sky_table_get_target_tablet(sky_table *table, bstring object_id,
     sky_tablet **ret);
 
+uint32_t sky_table_get_tablet_index(int hashing, bstring object_id,
+    uint32_t tablet_count);
+
+//--------------------------------------
+// Resharding
+//--------------------------------------
+
+int sky_table_begin_reshard(sky_table *table, uint32_t tablet_count);
+
+int sky_table_get_reshard_target(sky_table *table, bstring object_id,
+    sky_tablet **ret);
+
+int sky_table_get_reshard_state(sky_table *table);
+
+void sky_table_set_reshard_state(sky_table *table, int state);
+
+int sky_table_finish_reshard(sky_table *table);
+
+void sky_table_abort_reshard(sky_table *table);
+
 //--------------------------------------
 // State
 //--------------------------------------
@@ -87,4 +145,11 @@ int sky_table_close(sky_table *table);
 
 int sky_table_add_event(sky_table *table, sky_event *event);
 
+
+//--------------------------------------
+// Stats
+//--------------------------------------
+
+int sky_table_get_stats(sky_table *table, sky_tablet_stats *stats);
+
 #endif
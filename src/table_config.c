@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "dbg.h"
+#include "bstring.h"
+#include "file.h"
+#include "table_config.h"
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Initializes a table config with the default options.
+//
+// config - The config.
+void sky_table_config_init(sky_table_config *config)
+{
+    assert(config != NULL);
+    config->bloom_bits_per_key = SKY_DEFAULT_BLOOM_BITS_PER_KEY;
+    config->write_buffer_size = SKY_DEFAULT_WRITE_BUFFER_SIZE;
+    config->block_size = SKY_DEFAULT_BLOCK_SIZE;
+    config->max_open_files = SKY_DEFAULT_MAX_OPEN_FILES;
+    config->compression = true;
+}
+
+
+//--------------------------------------
+// Persistence
+//--------------------------------------
+
+// Reads options from a config file. Options that are not in the file keep
+// their current values. Nothing is changed if the file does not exist.
+//
+// config - The config.
+// path   - The path to the config file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_config_load(sky_table_config *config, bstring path)
+{
+    FILE *file = NULL;
+    assert(config != NULL);
+    check(path != NULL, "Config file path required");
+
+    if(!sky_file_exists(path)) {
+        return 0;
+    }
+
+    file = fopen(bdata(path), "r");
+    check(file != NULL, "Unable to open config file: %s", bdata(path));
+
+    char line[256];
+    uint32_t line_number = 0;
+    while(fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+
+        // Skip blank lines and comments.
+        char name[64], value[64];
+        int count = sscanf(line, "%63s %63s", name, value);
+        if(count <= 0 || name[0] == '#') {
+            continue;
+        }
+        check(count == 2, "Missing config value on line %d: %s", line_number, name);
+
+        if(strcmp(name, "bloom_bits_per_key") == 0) {
+            config->bloom_bits_per_key = atoi(value);
+            check(config->bloom_bits_per_key >= 0, "Invalid bloom_bits_per_key: %s", value);
+        }
+        else if(strcmp(name, "write_buffer_size") == 0) {
+            config->write_buffer_size = strtoull(value, NULL, 10);
+            check(config->write_buffer_size > 0, "Invalid write_buffer_size: %s", value);
+        }
+        else if(strcmp(name, "block_size") == 0) {
+            config->block_size = strtoull(value, NULL, 10);
+            check(config->block_size > 0, "Invalid block_size: %s", value);
+        }
+        else if(strcmp(name, "max_open_files") == 0) {
+            config->max_open_files = atoi(value);
+            check(config->max_open_files > 0, "Invalid max_open_files: %s", value);
+        }
+        else if(strcmp(name, "compression") == 0) {
+            check(strcmp(value, "snappy") == 0 || strcmp(value, "none") == 0, "Invalid compression: %s", value);
+            config->compression = (strcmp(value, "snappy") == 0);
+        }
+        else {
+            sentinel("Unknown config option on line %d: %s", line_number, name);
+        }
+    }
+
+    fclose(file);
+    return 0;
+
+error:
+    if(file) fclose(file);
+    return -1;
+}
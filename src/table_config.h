@@ -0,0 +1,87 @@
+#ifndef _table_config_h
+#define _table_config_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_table_config sky_table_config;
+
+#include "bstring.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The table config holds the LevelDB tuning options used when opening a
+// table's tablets. The server provides the defaults and each table can
+// override them with a "config" file in its directory. The file contains
+// one option per line in the form "<name> <value>". Blank lines and lines
+// starting with "#" are ignored.
+//
+//   bloom_bits_per_key  - Bits per key used by the bloom filter. Zero
+//                         disables the filter.
+//   write_buffer_size   - Bytes written to the log before a memtable is
+//                         flushed to disk.
+//   block_size          - Uncompressed size of each data block, in bytes.
+//   max_open_files      - Number of files LevelDB can keep open per tablet.
+//   compression         - Either "snappy" or "none".
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+#define SKY_TABLE_CONFIG_FILENAME "config"
+
+#define SKY_DEFAULT_BLOOM_BITS_PER_KEY  10
+
+#define SKY_DEFAULT_WRITE_BUFFER_SIZE   (8 * 1024 * 1024)
+
+#define SKY_DEFAULT_BLOCK_SIZE          4096
+
+#define SKY_DEFAULT_MAX_OPEN_FILES      1000
+
+// The default size of the block cache shared by all tablets on a server.
+#define SKY_DEFAULT_BLOCK_CACHE_SIZE    (64 * 1024 * 1024)
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_table_config {
+    int bloom_bits_per_key;
+    size_t write_buffer_size;
+    size_t block_size;
+    int max_open_files;
+    bool compression;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+void sky_table_config_init(sky_table_config *config);
+
+
+//--------------------------------------
+// Persistence
+//--------------------------------------
+
+int sky_table_config_load(sky_table_config *config, bstring path);
+
+#endif
@@ -4,15 +4,30 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/time.h>
 #include <math.h>
 #include <assert.h>
+#include <stdio.h>
 
 #include "tablet.h"
 #include "cursor.h"
 #include "sky_string.h"
 #include "timestamp.h"
+#include "sky_endian.h"
 #include "mem.h"
 #include "dbg.h"
+#include "file.h"
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+static int sky_tablet_open_segment(sky_tablet *tablet);
+
+static int sky_tablet_migrate(sky_tablet *tablet);
+
 
 //==============================================================================
 //
@@ -37,8 +52,14 @@ sky_tablet *sky_tablet_create(sky_table *table)
     assert(table != NULL);
     tablet = calloc(sizeof(sky_tablet), 1); check_mem(tablet);
     tablet->table = table;
+    tablet->max_chunk_size = SKY_DEFAULT_MAX_CHUNK_SIZE;
     tablet->readoptions = leveldb_readoptions_create();
     tablet->writeoptions = leveldb_writeoptions_create();
+    tablet->sync_writeoptions = leveldb_writeoptions_create();
+    leveldb_writeoptions_set_sync(tablet->sync_writeoptions, true);
+    tablet->durability = SKY_TABLET_DURABILITY_ASYNC;
+    tablet->sync_interval = SKY_DEFAULT_SYNC_INTERVAL;
+    tablet->segment = sky_segment_create(); check_mem(tablet->segment);
     return tablet;
     
 error:
@@ -66,7 +87,14 @@ void sky_tablet_free(sky_tablet *tablet)
         if(tablet->writeoptions) leveldb_writeoptions_destroy(tablet->writeoptions);
         tablet->writeoptions = NULL;
 
+        if(tablet->sync_writeoptions) leveldb_writeoptions_destroy(tablet->sync_writeoptions);
+        tablet->sync_writeoptions = NULL;
+
+        sky_tablet_discard_batch(tablet);
+        sky_tablet_clear_changes(tablet);
         sky_tablet_close(tablet);
+        sky_segment_free(tablet->segment);
+        tablet->segment = NULL;
         free(tablet);
     }
 }
@@ -103,13 +131,15 @@ error:
 //--------------------------------------
 
 // Opens the tablet for reading and writing. This should be called directly.
-// Only the owning table should open a tablet.
+// Only the owning table should open a tablet. LevelDB is tuned using the
+// table's config and shares the table's block cache if it has one.
 //
 // tablet - The tablet.
 //
 // Returns 0 if successful, otherwise returns -1.
 int sky_tablet_open(sky_tablet *tablet)
 {
+    int rc;
     char* errptr = NULL;
     leveldb_options_t* options = NULL;
 
@@ -120,12 +150,34 @@ int sky_tablet_open(sky_tablet *tablet)
     sky_tablet_close(tablet);
     
     // Initialize data file.
+    sky_table_config *config = &tablet->table->config;
     options = leveldb_options_create();
     leveldb_options_set_create_if_missing(options, true);
+    leveldb_options_set_write_buffer_size(options, config->write_buffer_size);
+    leveldb_options_set_block_size(options, config->block_size);
+    leveldb_options_set_max_open_files(options, config->max_open_files);
+    leveldb_options_set_compression(options, (config->compression ? leveldb_snappy_compression : leveldb_no_compression));
+    if(tablet->table->block_cache != NULL) {
+        leveldb_options_set_cache(options, tablet->table->block_cache);
+    }
+    if(config->bloom_bits_per_key > 0) {
+        tablet->filter_policy = leveldb_filterpolicy_create_bloom(config->bloom_bits_per_key);
+        check_mem(tablet->filter_policy);
+        leveldb_options_set_filter_policy(options, tablet->filter_policy);
+    }
     tablet->leveldb_db = leveldb_open(options, bdata(tablet->path), &errptr);
     check(errptr == NULL, "LevelDB Error: %s", errptr);
     check(tablet->leveldb_db != NULL, "Unable to create LevelDB data file");
     leveldb_options_destroy(options);
+    options = NULL;
+
+    // Map the compacted segment.
+    rc = sky_tablet_open_segment(tablet);
+    check(rc == 0, "Unable to open segment: %s", bdata(tablet->path));
+
+    // Move paths written in the old key format into chunks.
+    rc = sky_tablet_migrate(tablet);
+    check(rc == 0, "Unable to migrate tablet: %s", bdata(tablet->path));
 
     return 0;
 error:
@@ -149,6 +201,78 @@ int sky_tablet_close(sky_tablet *tablet)
         tablet->leveldb_db = NULL;
     }
 
+    // The filter policy must outlive the database that uses it.
+    if(tablet->filter_policy) {
+        leveldb_filterpolicy_destroy(tablet->filter_policy);
+        tablet->filter_policy = NULL;
+    }
+
+    if(tablet->segment) {
+        sky_segment_close(tablet->segment);
+    }
+
+    return 0;
+}
+
+
+//--------------------------------------
+// Keys
+//--------------------------------------
+
+// Creates a LevelDB key for an object. The timestamp is stored big-endian with
+// the sign bit flipped so that keys for an object sort by timestamp.
+//
+// object_id - The object identifier.
+// key_type  - The type of value stored under the key.
+// timestamp - The timestamp associated with the key.
+//
+// Returns a new key if successful, otherwise returns null.
+bstring sky_tablet_key_create(bstring object_id, uint8_t key_type,
+                              sky_timestamp_t timestamp)
+{
+    bstring key = NULL;
+    char suffix[SKY_TABLET_KEY_SUFFIX_LENGTH];
+    assert(object_id != NULL);
+
+    uint64_t value = htonll(((uint64_t)timestamp) ^ 0x8000000000000000ULL);
+    suffix[0] = 0;
+    suffix[1] = (char)key_type;
+    memcpy(&suffix[2], &value, sizeof(value));
+
+    key = bstrcpy(object_id); check_mem(key);
+    check(bcatblk(key, suffix, sizeof(suffix)) == BSTR_OK, "Unable to append key suffix");
+    return key;
+
+error:
+    bdestroy(key);
+    return NULL;
+}
+
+// Parses a LevelDB key into its object identifier length, key type and
+// timestamp.
+//
+// key              - The raw key.
+// key_length       - The number of bytes in the key.
+// object_id_length - A pointer to where the object id length should be returned.
+// key_type         - A pointer to where the key type should be returned.
+// timestamp        - A pointer to where the timestamp should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_key_parse(const char *key, size_t key_length,
+                         size_t *object_id_length, uint8_t *key_type,
+                         sky_timestamp_t *timestamp)
+{
+    uint64_t value;
+    assert(key != NULL);
+
+    if(key_length < SKY_TABLET_KEY_SUFFIX_LENGTH) return -1;
+    const char *suffix = key + (key_length - SKY_TABLET_KEY_SUFFIX_LENGTH);
+    if(suffix[0] != 0) return -1;
+
+    memcpy(&value, &suffix[2], sizeof(value));
+    if(object_id_length != NULL) *object_id_length = key_length - SKY_TABLET_KEY_SUFFIX_LENGTH;
+    if(key_type != NULL) *key_type = (uint8_t)suffix[1];
+    if(timestamp != NULL) *timestamp = (sky_timestamp_t)(ntohll(value) ^ 0x8000000000000000ULL);
     return 0;
 }
 
@@ -157,27 +281,417 @@ int sky_tablet_close(sky_tablet *tablet)
 // Path Management
 //--------------------------------------
 
-// Retrieves a path for an object in the tablet.
+// Moves a LevelDB iterator forward to the first key that doesn't belong to
+// an object.
+//
+// iterator  - The LevelDB iterator.
+// object_id - The object identifier.
+//
+// Returns nothing.
+static void sky_tablet_iter_skip_object(leveldb_iterator_t *iterator,
+                                        bstring object_id)
+{
+    while(leveldb_iter_valid(iterator)) {
+        size_t key_length, object_id_length;
+        const char *key = leveldb_iter_key(iterator, &key_length);
+        int rc = sky_tablet_key_parse(key, key_length, &object_id_length, NULL, NULL);
+        if(rc != 0 || object_id_length != (size_t)blength(object_id) || memcmp(key, bdatae(object_id, ""), object_id_length) != 0) {
+            break;
+        }
+        leveldb_iter_next(iterator);
+    }
+}
+
+// Reads all the chunks for the object at the iterator's current position and
+// stitches them together into a single path. The iterator is left positioned
+// at the first key after the object unless the path is read in place. In
+// that case the iterator is held on the path's only chunk until the path is
+// released and the path is marked if its checkpoint still has to be read
+// with sky_tablet_path_read_checkpoint().
+//
+// path     - The path to read into.
+// iterator - The LevelDB iterator.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_path_read(sky_tablet_path *path, leveldb_iterator_t *iterator)
+{
+    int rc;
+    uint8_t key_type;
+    sky_timestamp_t timestamp;
+    sky_tablet_summary summary; memset(&summary, 0, sizeof(summary));
+    size_t key_length, value_length, object_id_length;
+    assert(path != NULL);
+    assert(iterator != NULL);
+    check(leveldb_iter_valid(iterator), "Iterator is not positioned on a key");
+
+    path->data = path->buffer;
+    path->data_length = 0;
+    path->chunk_count = 0;
+    path->has_checkpoint = false;
+    path->checkpoint_pending = false;
+    path->held = false;
+
+    // Determine the object from the first key.
+    const char *key = leveldb_iter_key(iterator, &key_length);
+    rc = sky_tablet_key_parse(key, key_length, &object_id_length, NULL, NULL);
+    check(rc == 0, "Invalid tablet key");
+    if(path->object_id == NULL) {
+        path->object_id = blk2bstr(key, object_id_length);
+        check_mem(path->object_id);
+    }
+    else {
+        rc = bassignblk(path->object_id, key, object_id_length);
+        check(rc == BSTR_OK, "Unable to assign object id");
+    }
+
+    // Append each chunk until we move past the object.
+    while(leveldb_iter_valid(iterator)) {
+        key = leveldb_iter_key(iterator, &key_length);
+        rc = sky_tablet_key_parse(key, key_length, &object_id_length, &key_type, &timestamp);
+        if(rc != 0 || object_id_length != (size_t)blength(path->object_id) || memcmp(key, bdatae(path->object_id, ""), object_id_length) != 0) {
+            break;
+        }
+
+        // The summary sorts first and tells if the first chunk is the last.
+        if(key_type == SKY_TABLET_KEY_TYPE_SUMMARY && path->in_place) {
+            const char *value = leveldb_iter_value(iterator, &value_length);
+            rc = sky_tablet_summary_unpack(&summary, value, value_length);
+            check(rc == 0, "Unable to unpack path summary");
+        }
+        else if(key_type == SKY_TABLET_KEY_TYPE_CHUNK) {
+            const char *value = leveldb_iter_value(iterator, &value_length);
+            bool hold = (path->chunk_count == 0 && summary.has_chunk_ts && summary.chunk_ts == timestamp);
+
+            // Grow the data buffer if necessary.
+            if(!hold && path->data_length + value_length > path->buffer_capacity) {
+                size_t capacity = (path->buffer_capacity > 0 ? path->buffer_capacity : 1024);
+                while(capacity < path->data_length + value_length) {
+                    capacity *= 2;
+                }
+                path->buffer = realloc(path->buffer, capacity);
+                check_mem(path->buffer);
+                path->buffer_capacity = capacity;
+                path->data = path->buffer;
+            }
+
+            // Grow the chunk list if necessary.
+            if(path->chunk_count == path->chunk_capacity) {
+                path->chunk_capacity = (path->chunk_capacity > 0 ? path->chunk_capacity * 2 : 8);
+                path->chunks = realloc(path->chunks, path->chunk_capacity * sizeof(*path->chunks));
+                check_mem(path->chunks);
+            }
+
+            sky_tablet_chunk *chunk = &path->chunks[path->chunk_count++];
+            chunk->min_timestamp = timestamp;
+            chunk->offset = path->data_length;
+            chunk->length = value_length;
+
+            // Leave the iterator on a path held in a single chunk. The
+            // checkpoints sort after the chunk so if one can be at or before
+            // the seek timestamp then it has to be read separately. None can
+            // be if the path has no checkpoints or if the seek timestamp is
+            // not after the first event.
+            if(hold) {
+                path->data = (void*)value;
+                path->data_length = value_length;
+                path->held = true;
+                path->checkpoint_pending = (path->seek && summary.checkpoint_event_count > 0 && path->seek_ts > summary.min_ts);
+                return 0;
+            }
+
+            memcpy(path->data + path->data_length, value, value_length);
+            path->data_length += value_length;
+        }
+        // Keep the latest checkpoint at or before the seek timestamp.
+        else if(key_type == SKY_TABLET_KEY_TYPE_CHECKPOINT && path->seek && timestamp <= path->seek_ts) {
+            const char *value = leveldb_iter_value(iterator, &value_length);
+            rc = sky_tablet_checkpoint_unpack(&path->checkpoint, timestamp, value, value_length);
+            check(rc == 0, "Unable to unpack checkpoint");
+            path->has_checkpoint = true;
+        }
+
+        leveldb_iter_next(iterator);
+    }
+
+    return 0;
+
+error:
+    path->data = path->buffer;
+    path->data_length = 0;
+    path->chunk_count = 0;
+    path->has_checkpoint = false;
+    path->checkpoint_pending = false;
+    path->held = false;
+    return -1;
+}
+
+// Moves the iterator past the rest of a path that was read in place. The
+// path's data is no longer valid afterward. Nothing is done if the path was
+// copied.
+//
+// path     - The path.
+// iterator - The LevelDB iterator that the path was read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_path_release(sky_tablet_path *path, leveldb_iterator_t *iterator)
+{
+    assert(path != NULL);
+    assert(iterator != NULL);
+
+    if(!path->held) {
+        return 0;
+    }
+    path->data = path->buffer;
+    path->data_length = 0;
+    path->chunk_count = 0;
+    path->held = false;
+
+    // The remaining keys are the tail and checkpoints. A checkpoint that was
+    // needed has already been read with another iterator.
+    leveldb_iter_next(iterator);
+    sky_tablet_iter_skip_object(iterator, path->object_id);
+
+    return 0;
+}
+
+// Moves the iterator past all the keys of the object at its current
+// position without reading any of its chunks. Object ids may share a prefix
+// that ends in a zero byte with the keys of another object, so no single
+// seek is guaranteed to land on the next object. Instead each key's parsed
+// object id is compared, which only reads keys and not values. The path's
+// object id is set to the skipped object.
+//
+// path     - The path whose object id buffer is used for the seek.
+// iterator - The LevelDB iterator.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_path_skip(sky_tablet_path *path, leveldb_iterator_t *iterator)
+{
+    int rc;
+    size_t key_length, object_id_length;
+    assert(path != NULL);
+    assert(iterator != NULL);
+    check(leveldb_iter_valid(iterator), "Iterator is not positioned on a key");
+
+    const char *key = leveldb_iter_key(iterator, &key_length);
+    rc = sky_tablet_key_parse(key, key_length, &object_id_length, NULL, NULL);
+    check(rc == 0, "Invalid tablet key");
+    if(path->object_id == NULL) {
+        path->object_id = blk2bstr(key, object_id_length);
+        check_mem(path->object_id);
+    }
+    else {
+        rc = bassignblk(path->object_id, key, object_id_length);
+        check(rc == BSTR_OK, "Unable to assign object id");
+    }
+
+    sky_tablet_iter_skip_object(iterator, path->object_id);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Frees the buffers owned by a stitched path.
+//
+// path - The path.
+void sky_tablet_path_uninit(sky_tablet_path *path)
+{
+    if(path) {
+        if(path->iterator) leveldb_iter_destroy(path->iterator);
+        bdestroy(path->object_id);
+        free(path->buffer);
+        free(path->chunks);
+        sky_tablet_checkpoint_uninit(&path->checkpoint);
+        memset(path, 0, sizeof(*path));
+    }
+}
+
+// Combines the chunks read from LevelDB for an object with the object's copy
+// of the path in the tablet's segment. The segment copy is used directly if
+// there are no chunks. If the chunks only hold events newer than the segment
+// copy then the segment copy is prepended to the path buffer. Otherwise the
+// chunks hold the full path and the segment copy is ignored.
+//
+// tablet      - The tablet.
+// path        - The path read from LevelDB.
+// entry       - The segment entry for the object or null if there is none.
+// data        - A pointer to where the path data should be returned.
+// data_length - A pointer to where the path data length should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_path_apply_segment(sky_tablet *tablet, sky_tablet_path *path,
+                                  sky_segment_entry *entry, void **data,
+                                  size_t *data_length)
+{
+    assert(tablet != NULL);
+    assert(path != NULL);
+
+    *data = path->data;
+    *data_length = path->data_length;
+
+    if(entry == NULL || entry->data_length == 0) {
+        return 0;
+    }
+
+    void *segment_data = sky_segment_get_data(tablet->segment, entry);
+    if(path->chunk_count == 0) {
+        *data = segment_data;
+        *data_length = entry->data_length;
+    }
+    else if(path->chunks[0].min_timestamp > entry->max_timestamp) {
+        // Grow the data buffer if necessary. The buffer may not hold the
+        // chunks yet if the path was read in place.
+        size_t length = path->data_length + entry->data_length;
+        if(length > path->buffer_capacity) {
+            if(path->data == path->buffer) {
+                path->buffer = realloc(path->buffer, length);
+                check_mem(path->buffer);
+                path->data = path->buffer;
+            }
+            else {
+                free(path->buffer);
+                path->buffer_capacity = 0;
+                path->buffer = malloc(length);
+                check_mem(path->buffer);
+            }
+            path->buffer_capacity = length;
+        }
+
+        // Shift the chunks over and copy in the segment data.
+        memmove(path->buffer + entry->data_length, path->data, path->data_length);
+        memcpy(path->buffer, segment_data, entry->data_length);
+        path->data = path->buffer;
+        path->data_length = length;
+
+        uint32_t i;
+        for(i=0; i<path->chunk_count; i++) {
+            path->chunks[i].offset += entry->data_length;
+        }
+
+        *data = path->data;
+        *data_length = path->data_length;
+    }
+
+    return 0;
+
+error:
+    *data = NULL;
+    *data_length = 0;
+    return -1;
+}
+
+// Loads all the chunks for a single object into a path. If the path is read
+// in place then the path keeps the iterator that holds it until the path is
+// uninitialized.
+//
+// tablet    - The tablet.
+// object_id - The object identifier.
+// path      - The path to read into.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_load_path(sky_tablet *tablet, bstring object_id,
+                                sky_tablet_path *path)
+{
+    int rc;
+    bstring key = NULL;
+    leveldb_iterator_t *iterator = NULL;
+    assert(tablet != NULL);
+    assert(object_id != NULL);
+    assert(path != NULL);
+
+    if(path->iterator) {
+        leveldb_iter_destroy(path->iterator);
+        path->iterator = NULL;
+    }
+    path->data = path->buffer;
+    path->data_length = 0;
+    path->chunk_count = 0;
+    path->held = false;
+
+    // Seek to the first key for the object.
+    key = sky_tablet_key_create(object_id, 0, INT64_MIN);
+    check_mem(key);
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    leveldb_iter_seek(iterator, bdata(key), blength(key));
+
+    // Read the path only if the key belongs to the object.
+    if(leveldb_iter_valid(iterator)) {
+        size_t key_length, object_id_length;
+        const char *found_key = leveldb_iter_key(iterator, &key_length);
+        rc = sky_tablet_key_parse(found_key, key_length, &object_id_length, NULL, NULL);
+        if(rc == 0 && object_id_length == (size_t)blength(object_id) && memcmp(found_key, bdatae(object_id, ""), object_id_length) == 0) {
+            rc = sky_tablet_path_read(path, iterator);
+            check(rc == 0, "Unable to read path");
+        }
+    }
+
+    if(path->held) {
+        path->iterator = iterator;
+    }
+    else {
+        leveldb_iter_destroy(iterator);
+    }
+    bdestroy(key);
+    return 0;
+
+error:
+    if(iterator) leveldb_iter_destroy(iterator);
+    bdestroy(key);
+    return -1;
+}
+
+// Retrieves a path for an object in the tablet. The chunks of the path are
+// stitched together into a single block of memory which is owned by the
+// caller.
 //
 // tablet      - The tablet.
 // object_id   - The object identifier for the path.
 // data        - A pointer to where the path data should be returned.
 // data_length - A pointer to where the length of the path data should be returned.
-// 
 //
 // Returns 0 if successful, otherwise returns -1.
 int sky_tablet_get_path(sky_tablet *tablet, bstring object_id,
                         void **data, size_t *data_length)
 {
-    char *errptr = NULL;
+    int rc;
+    sky_tablet_path path; memset(&path, 0, sizeof(path));
     assert(tablet != NULL);
+    assert(data != NULL);
+    assert(data_length != NULL);
+
+    *data = NULL;
+    *data_length = 0;
+
+    rc = sky_tablet_load_path(tablet, object_id, &path);
+    check(rc == 0, "Unable to load path");
+
+    // Combine the path with the segment's copy.
+    void *ptr = NULL;
+    size_t length = 0;
+    sky_segment_entry *entry = sky_segment_find(tablet->segment, bdatae(object_id, ""), blength(object_id));
+    rc = sky_tablet_path_apply_segment(tablet, &path, entry, &ptr, &length);
+    check(rc == 0, "Unable to apply segment to path");
+
+    // Hand off the path data to the caller.
+    if(length > 0 && ptr == path.buffer) {
+        *data = path.buffer;
+        *data_length = length;
+        path.buffer = NULL;
+    }
+    else if(length > 0) {
+        *data = malloc(length); check_mem(*data);
+        memcpy(*data, ptr, length);
+        *data_length = length;
+    }
 
-    // Retrieve the existing value.
-    *data = (void*)leveldb_get(tablet->leveldb_db, tablet->readoptions, (const char*)bdata(object_id), blength(object_id), data_length, &errptr);
-    check(errptr == NULL, "LevelDB get path error: %s", errptr);
+    sky_tablet_path_uninit(&path);
     return 0;
 
 error:
+    sky_tablet_path_uninit(&path);
     *data = NULL;
     *data_length = 0;
     return -1;
@@ -185,173 +699,3527 @@ error:
 
 
 //--------------------------------------
-// Event Management
+// Write Batch
 //--------------------------------------
 
-// Adds an event to the tablet.
+// Finds the pending write for a key in the tablet's current batch.
 //
-// tablet - The tablet.
-// event  - The event to add.
+// batch - The batch.
+// key   - The key to find.
 //
-// Returns 0 if successful, otherwise returns -1.
-int sky_tablet_add_event(sky_tablet *tablet, sky_event *event)
+// Returns the matching entry or null if the key has no pending write.
+static sky_tablet_batch_entry *sky_tablet_batch_find(sky_tablet_batch *batch,
+                                                     bstring key)
 {
-    int rc;
-    char *errptr = NULL;
-    void *new_data = NULL;
-    void *data = NULL;
-    sky_data_object *data_object = NULL;
-    sky_data_descriptor *descriptor = NULL;
-    sky_cursor cursor; memset(&cursor, 0, sizeof(cursor));
-    assert(tablet != NULL);
-    assert(event != NULL);
-
-    // Make sure that this event is being added to the correct tablet.
-    sky_tablet *target_tablet = NULL;
-    rc = sky_table_get_target_tablet(tablet->table, event->object_id, &target_tablet);
-    check(rc == 0, "Unable to determine target tablet");
-    check(tablet == target_tablet, "Event added to invalid tablet; IDX:%d of %d", tablet->index, tablet->table->tablet_count);
+    if(batch->index_capacity == 0) return NULL;
 
-    // Retrieve the existing value.
-    size_t data_length;
-    data = (void*)leveldb_get(tablet->leveldb_db, tablet->readoptions, (const char*)bdata(event->object_id), blength(event->object_id), &data_length, &errptr);
-    check(errptr == NULL, "LevelDB get error: %s", errptr);
-    
-    // Find the insertion point on the path.
-    size_t insert_offset = 0;
-    size_t event_length;
-    
-    // If the object doesn't exist yet then just set the single event. Easy peasy.
-    if(data == NULL) {
-        event_length = sky_event_sizeof(event);
-        new_data = calloc(1, event_length); check_mem(new_data);
-        insert_offset = 0;
-    }
-    // If the object does exist, we need to find where to insert the event data.
-    // Also, we need to strip off any state which is redundant at the point of
-    // insertion.
-    else {
-        void *insert_ptr = NULL;
-        sky_timestamp_t event_ts = sky_timestamp_shift(event->timestamp);
-        
-        // Initialize data descriptor.
-        descriptor = sky_data_descriptor_create(); check_mem(descriptor);
-        rc = sky_data_descriptor_init_with_event(descriptor, event);
-        check(rc == 0, "Unable to initialize data descriptor for event insert");
-    
-        // Initialize data object.
-        data_object = calloc(1, descriptor->data_sz); check_mem(data);
-
-        // Attach data & descriptor to the cursor.
-        cursor.data_descriptor = descriptor;
-        cursor.data = (void*)data_object;
-
-        // Initialize the cursor.
-        rc = sky_cursor_set_ptr(&cursor, data, data_length);
-        check(rc == 0, "Unable to set pointer on cursor");
-        check(sky_cursor_next_event(&cursor) == 0, "Unable to move to next event");
-        
-        // Loop over cursor until we reach the event insertion point.
-        while(!cursor.eof) {
-            // Retrieve event insertion pointer once the timestamp is reached.
-            if(data_object->ts >= event_ts) {
-                insert_ptr = cursor.ptr;
-                break;
-            }
-            
-            // Move to next event.
-            check(sky_cursor_next_event(&cursor) == 0, "Unable to move to next event");
+    uint32_t mask = batch->index_capacity - 1;
+    uint32_t slot = sky_bstring_fnv1a(key) & mask;
+    while(batch->index[slot] != 0) {
+        sky_tablet_batch_entry *entry = &batch->entries[batch->index[slot]-1];
+        if(biseq(entry->key, key) == 1) {
+            return entry;
         }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+// Rebuilds the hash index of a batch with a given capacity.
+//
+// batch    - The batch.
+// capacity - The number of index slots. This must be a power of two.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_batch_reindex(sky_tablet_batch *batch, uint32_t capacity)
+{
+    free(batch->index);
+    batch->index = calloc(capacity, sizeof(*batch->index));
+    check_mem(batch->index);
+    batch->index_capacity = capacity;
 
-        // If no insertion point was found then append the event to the
-        // end of the path.
-        if(insert_ptr == NULL) {
-            insert_ptr = data + data_length;
+    uint32_t i;
+    uint32_t mask = capacity - 1;
+    for(i=0; i<batch->entry_count; i++) {
+        uint32_t slot = sky_bstring_fnv1a(batch->entries[i].key) & mask;
+        while(batch->index[slot] != 0) {
+            slot = (slot + 1) & mask;
         }
-        insert_offset = insert_ptr - data;
+        batch->index[slot] = i + 1;
+    }
+    return 0;
 
-        // Clear off any object data on the event that matches
-        // what is the current state of the event in the database.
-        uint32_t i;
-        for(i=0; i<event->data_count; i++) {
-            // Ignore any action properties.
-            if(event->data[i]->key > 0) {
-                sky_data_property_descriptor *property_descriptor = &descriptor->property_zero_descriptor[event->data[i]->key];
-
-                // If the values match then splice this from the array.
-                // Compare strings.
-                void *a = &event->data[i]->value;
-                void *b = ((void*)data_object)+property_descriptor->offset;
-                size_t n = sky_data_type_sizeof(event->data[i]->data_type);
-                
-                bool is_equal = false;
-                if(event->data[i]->data_type == SKY_DATA_TYPE_STRING) {
-                    is_equal = sky_string_bequals((sky_string*)b, event->data[i]->string_value);
-                }
-                // Compare other types.
-                else if(memcmp(a, b, n) == 0) {
-                    is_equal = true;
-                }
+error:
+    batch->index_capacity = 0;
+    return -1;
+}
 
-                // If the data is equal then remove it.
-                if(is_equal) {
-                    sky_event_data_free(event->data[i]);
-                    if(i < event->data_count - 1) {
-                        memmove(&event->data[i], &event->data[i+1], (event->data_count-i-1) * sizeof(*event->data));
-                    }
-                    i--;
-                    event->data_count--;
-                }
-            }
+// Frees the values held in a batch's undo log and clears the saved flags of
+// their entries.
+//
+// batch - The batch.
+//
+// Returns nothing.
+static void sky_tablet_batch_release_undos(sky_tablet_batch *batch)
+{
+    uint32_t i;
+    for(i=0; i<batch->undo_count; i++) {
+        if(batch->undos[i].index < batch->entry_count) {
+            batch->entries[batch->undos[i].index].saved = false;
         }
+        free(batch->undos[i].value);
+    }
+    batch->undo_count = 0;
+}
 
-        // Determine the serialized size of the event. If the event is
-        // completely redundant (e.g. it is a data-only event and the event
-        // matches the current object state) then don't allocate space for a
-        // new path value.
-        event_length = sky_event_sizeof(event);
-        if(event_length > 0) {
-            // Allocate space for the existing data plus the new data.
-            new_data = calloc(1, data_length + event_length); check_mem(new_data);
-
-            // Copy in data before event.
-            if(insert_offset > 0) {
-                memmove(new_data, data, insert_ptr-data);
-            }
+// Adds a pending write to the tablet's current batch and takes ownership of
+// the value, which is freed even if the write fails. A later write to the
+// same key replaces the earlier one so that each key is only written once
+// when the batch is flushed.
+//
+// tablet       - The tablet.
+// key          - The key to write.
+// copy         - The allocated value to write or null if the key should be
+//                deleted.
+// value_length - The number of bytes in the value.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_batch_put_owned(sky_tablet *tablet, bstring key,
+                                      void *copy, size_t value_length)
+{
+    int rc;
+    sky_tablet_batch *batch = tablet->batch;
+    assert(batch != NULL);
 
-            // Copy in data after event.
-            if(insert_offset < data_length) {
-                event_length = sky_event_sizeof(event);
-                memmove(new_data+insert_offset+event_length, data+insert_offset, data_length-insert_offset);
+    // Replace an existing write to the key. The value that the entry held at
+    // the savepoint is kept so that it can be restored on rollback.
+    sky_tablet_batch_entry *entry = sky_tablet_batch_find(batch, key);
+    if(entry != NULL) {
+        uint32_t index = (uint32_t)(entry - batch->entries);
+        if(batch->has_savepoint && index < batch->savepoint_count && !entry->saved) {
+            if(batch->undo_count == batch->undo_capacity) {
+                uint32_t capacity = (batch->undo_capacity > 0 ? batch->undo_capacity * 2 : 64);
+                sky_tablet_batch_undo *undos = realloc(batch->undos, capacity * sizeof(*batch->undos));
+                check_mem(undos);
+                batch->undos = undos;
+                batch->undo_capacity = capacity;
             }
+            sky_tablet_batch_undo *undo = &batch->undos[batch->undo_count++];
+            undo->index = index;
+            undo->value = entry->value;
+            undo->value_length = entry->value_length;
+            entry->saved = true;
+        }
+        else {
+            free(entry->value);
         }
+        entry->value = copy;
+        entry->value_length = value_length;
+        return 0;
     }
-    
-    // If no space was allocated then it means the event is redundant and
-    // should be ignored.
-    if(new_data != NULL) {
-        // If the object doesn't exist then just set the event as the data.
-        size_t event_sz;
-        rc = sky_event_pack(event, new_data + insert_offset, &event_sz);
-        check(rc == 0, "Unable to pack event");
-        check(event_sz == event_length, "Expected event size (%ld) does not match actual event size (%ld)", event_length, event_sz);
 
-        leveldb_put(tablet->leveldb_db, tablet->writeoptions, (const char*)bdata(event->object_id), blength(event->object_id), new_data, data_length + event_length, &errptr);
-        check(errptr == NULL, "LevelDB put error: %s", errptr);
+    // Otherwise append a new entry and index it.
+    if(batch->entry_count == batch->entry_capacity) {
+        batch->entry_capacity = (batch->entry_capacity > 0 ? batch->entry_capacity * 2 : 64);
+        batch->entries = realloc(batch->entries, batch->entry_capacity * sizeof(*batch->entries));
+        check_mem(batch->entries);
     }
-    
-    free(data_object);
-    sky_data_descriptor_free(descriptor);
-    free(data);
-    free(new_data);
-    
+    entry = &batch->entries[batch->entry_count++];
+    entry->key = bstrcpy(key); check_mem(entry->key);
+    entry->value = copy;
+    entry->value_length = value_length;
+    entry->saved = false;
+    copy = NULL;
+
+    if(batch->entry_count * 2 > batch->index_capacity) {
+        rc = sky_tablet_batch_reindex(batch, batch->index_capacity > 0 ? batch->index_capacity * 2 : 128);
+        check(rc == 0, "Unable to index batch");
+    }
+    else {
+        uint32_t mask = batch->index_capacity - 1;
+        uint32_t slot = sky_bstring_fnv1a(key) & mask;
+        while(batch->index[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        batch->index[slot] = batch->entry_count;
+    }
+
     return 0;
 
 error:
-    if(errptr) leveldb_free(errptr);
-    sky_data_descriptor_free(descriptor);
-    if(data) free(data);
-    if(new_data) free(new_data);
-    if(data_object) free(data_object);
+    free(copy);
+    return -1;
+}
+
+// Adds a copy of a pending write to the tablet's current batch.
+//
+// tablet       - The tablet.
+// key          - The key to write.
+// value        - The value to write or null if the key should be deleted.
+// value_length - The number of bytes in the value.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_batch_put(sky_tablet *tablet, bstring key, void *value,
+                                size_t value_length)
+{
+    void *copy = NULL;
+    if(value != NULL) {
+        copy = malloc(value_length > 0 ? value_length : 1); check_mem(copy);
+        memcpy(copy, value, value_length);
+    }
+    return sky_tablet_batch_put_owned(tablet, key, copy, value_length);
+
+error:
+    return -1;
+}
+
+// Adds a pending write of a chunk to the tablet's current batch. The first
+// event of a chunk must hold a full timestamp so it is re-encoded if it is
+// delta encoded against an event in another chunk.
+//
+// tablet      - The tablet.
+// object_id   - The object identifier.
+// min_ts      - The shifted timestamp of the first event in the chunk.
+// data        - The chunk data.
+// data_length - The length of the chunk data, in bytes.
+// writebatch  - The LevelDB batch to write the chunk to or null if it should
+//               be written to the tablet's current batch.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_put_chunk(sky_tablet *tablet, bstring object_id,
+                                sky_timestamp_t min_ts, void *data,
+                                size_t data_length,
+                                leveldb_writebatch_t *writebatch)
+{
+    int rc;
+    void *new_data = NULL;
+    bstring key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_CHUNK, min_ts);
+    check_mem(key);
+
+    if(data_length > 0 && (*((sky_event_flag_t*)data) & SKY_EVENT_FLAG_DELTA)) {
+        size_t event_length = sky_event_sizeof_raw(data);
+        size_t event_sz;
+        new_data = malloc(data_length + SKY_EVENT_V2_MAX_HEADER_LENGTH); check_mem(new_data);
+        rc = sky_event_rebase_raw(data, min_ts, NULL, new_data, &event_sz);
+        check(rc == 0, "Unable to re-encode first event of chunk");
+        memcpy(new_data + event_sz, data + event_length, data_length - event_length);
+        data = new_data;
+        data_length = data_length - event_length + event_sz;
+    }
+
+    if(writebatch != NULL) {
+        leveldb_writebatch_put(writebatch, bdata(key), blength(key), data, data_length);
+    }
+    else {
+        rc = sky_tablet_batch_put(tablet, key, data, data_length);
+        check(rc == 0, "Unable to write chunk");
+    }
+
+    bdestroy(key);
+    free(new_data);
+    return 0;
+
+error:
+    bdestroy(key);
+    free(new_data);
+    return -1;
+}
+
+// Retrieves the value for a key. Pending writes in the tablet's current
+// batch take precedence over the values stored in LevelDB. The returned
+// value is owned by the caller.
+//
+// tablet       - The tablet.
+// key          - The key to retrieve.
+// value        - A pointer to where the value should be returned.
+// value_length - A pointer to where the value length should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_get(sky_tablet *tablet, bstring key, char **value,
+                          size_t *value_length)
+{
+    char *errptr = NULL;
+
+    *value = NULL;
+    *value_length = 0;
+
+    sky_tablet_batch_entry *entry = (tablet->batch ? sky_tablet_batch_find(tablet->batch, key) : NULL);
+    if(entry != NULL) {
+        if(entry->value != NULL) {
+            *value = malloc(entry->value_length > 0 ? entry->value_length : 1);
+            check_mem(*value);
+            memcpy(*value, entry->value, entry->value_length);
+            *value_length = entry->value_length;
+        }
+    }
+    else {
+        *value = leveldb_get(tablet->leveldb_db, tablet->readoptions, bdata(key), blength(key), value_length, &errptr);
+        check(errptr == NULL, "LevelDB get error: %s", errptr);
+    }
+
+    return 0;
+
+error:
+    if(errptr) leveldb_free(errptr);
+    *value = NULL;
+    *value_length = 0;
+    return -1;
+}
+
+// Retrieves the value for one of an object's keys. Objects that haven't been
+// written to since they were compacted have no keys in LevelDB so their
+// values are copied from the segment's records instead. The returned value
+// is owned by the caller.
+//
+// tablet       - The tablet.
+// object_id    - The object identifier.
+// key_type     - The type of the key.
+// ts           - The timestamp of the key.
+// value        - A pointer to where the value should be returned.
+// value_length - A pointer to where the value length should be returned.
+// in_segment   - A pointer to where it is returned whether the value was
+//                read from the segment or null.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_get_object_value(sky_tablet *tablet, bstring object_id,
+                                       uint8_t key_type, sky_timestamp_t ts,
+                                       char **value, size_t *value_length,
+                                       bool *in_segment)
+{
+    int rc;
+    bstring key = NULL;
+
+    if(in_segment != NULL) {
+        *in_segment = false;
+    }
+
+    key = sky_tablet_key_create(object_id, key_type, ts); check_mem(key);
+    rc = sky_tablet_get(tablet, key, value, value_length);
+    check(rc == 0, "Unable to retrieve value");
+
+    if(*value == NULL) {
+        sky_segment_entry *entry = sky_segment_find(tablet->segment, bdatae(object_id, ""), blength(object_id));
+        if(entry != NULL && entry->records_length > 0) {
+            bool found;
+            sky_segment_record record;
+            rc = sky_segment_find_record(tablet->segment, entry, key_type, ts, &record, &found);
+            check(rc == 0, "Unable to find segment record");
+            if(found && record.ts == ts) {
+                *value = malloc(record.value_length > 0 ? record.value_length : 1);
+                check_mem(*value);
+                memcpy(*value, record.value, record.value_length);
+                *value_length = record.value_length;
+                if(in_segment != NULL) {
+                    *in_segment = true;
+                }
+            }
+        }
+    }
+
+    bdestroy(key);
+    return 0;
+
+error:
+    free(*value);
+    *value = NULL;
+    *value_length = 0;
+    bdestroy(key);
+    return -1;
+}
+
+// Retrieves the current wall clock time.
+//
+// Returns the number of milliseconds since the epoch.
+static int64_t sky_tablet_now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((int64_t)tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+// Determines the write options for the next write based on the tablet's
+// durability mode.
+//
+// tablet - The tablet.
+//
+// Returns the write options to use.
+static leveldb_writeoptions_t *sky_tablet_get_writeoptions(sky_tablet *tablet)
+{
+    switch(tablet->durability) {
+        case SKY_TABLET_DURABILITY_SYNC:
+            return tablet->sync_writeoptions;
+
+        case SKY_TABLET_DURABILITY_INTERVAL: {
+            // Sync the log once the interval has elapsed since the last sync.
+            // LevelDB syncs all earlier writes along with a synced write.
+            int64_t now = sky_tablet_now();
+            if(now - __atomic_load_n(&tablet->last_sync_time, __ATOMIC_SEQ_CST) >= tablet->sync_interval) {
+                __atomic_store_n(&tablet->last_sync_time, now, __ATOMIC_SEQ_CST);
+                return tablet->sync_writeoptions;
+            }
+            return tablet->writeoptions;
+        }
+
+        default:
+            return tablet->writeoptions;
+    }
+}
+
+// Starts batching writes on the tablet. Writes are held in memory until the
+// batch is flushed so that multiple events for the same object only rewrite
+// its chunk and tail summary once.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_begin_batch(sky_tablet *tablet)
+{
+    assert(tablet != NULL);
+    check(tablet->batch == NULL, "Tablet batch already started");
+
+    tablet->batch = calloc(1, sizeof(*tablet->batch));
+    check_mem(tablet->batch);
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes all pending writes in the tablet's batch to LevelDB as a single
+// atomic write. The batch remains open afterward.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_flush_batch(sky_tablet *tablet)
+{
+    char *errptr = NULL;
+    leveldb_writebatch_t *writebatch = NULL;
+    assert(tablet != NULL);
+    check(tablet->batch != NULL, "Tablet batch not started");
+
+    sky_tablet_batch *batch = tablet->batch;
+    if(batch->entry_count > 0) {
+        writebatch = leveldb_writebatch_create(); check_mem(writebatch);
+
+        uint32_t i;
+        for(i=0; i<batch->entry_count; i++) {
+            sky_tablet_batch_entry *entry = &batch->entries[i];
+            if(entry->value != NULL) {
+                leveldb_writebatch_put(writebatch, bdata(entry->key), blength(entry->key), entry->value, entry->value_length);
+            }
+            else {
+                leveldb_writebatch_delete(writebatch, bdata(entry->key), blength(entry->key));
+            }
+        }
+
+        leveldb_writeoptions_t *writeoptions = sky_tablet_get_writeoptions(tablet);
+        leveldb_write(tablet->leveldb_db, writeoptions, writebatch, &errptr);
+        check(errptr == NULL, "LevelDB write error: %s", errptr);
+        leveldb_writebatch_destroy(writebatch);
+        writebatch = NULL;
+
+        // Unsynced writes in interval mode are synced later by the server
+        // even if the tablet receives no more writes.
+        if(tablet->durability == SKY_TABLET_DURABILITY_INTERVAL && writeoptions != tablet->sync_writeoptions) {
+            __atomic_store_n(&tablet->unsynced, true, __ATOMIC_SEQ_CST);
+        }
+        __atomic_add_fetch(&tablet->stats.write_count, 1, __ATOMIC_RELAXED);
+    }
+
+    // Clear the pending writes. The committed writes can no longer be
+    // rolled back so the savepoint moves to the flush.
+    uint32_t i;
+    for(i=0; i<batch->entry_count; i++) {
+        bdestroy(batch->entries[i].key);
+        free(batch->entries[i].value);
+    }
+    batch->entry_count = 0;
+    if(batch->index_capacity > 0) {
+        memset(batch->index, 0, batch->index_capacity * sizeof(*batch->index));
+    }
+    sky_tablet_batch_release_undos(batch);
+    batch->savepoint_count = 0;
+
+    return 0;
+
+error:
+    if(errptr) leveldb_free(errptr);
+    if(writebatch) leveldb_writebatch_destroy(writebatch);
+    return -1;
+}
+
+// Flushes and closes the tablet's batch.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_end_batch(sky_tablet *tablet)
+{
+    int rc;
+    assert(tablet != NULL);
+    check(tablet->batch != NULL, "Tablet batch not started");
+
+    rc = sky_tablet_flush_batch(tablet);
+    sky_tablet_discard_batch(tablet);
+    check(rc == 0, "Unable to flush batch");
+    
+    return 0;
+
+error:
+    return -1;
+}
+
+// Closes the tablet's batch without writing any pending writes.
+//
+// tablet - The tablet.
+void sky_tablet_discard_batch(sky_tablet *tablet)
+{
+    assert(tablet != NULL);
+
+    sky_tablet_batch *batch = tablet->batch;
+    if(batch) {
+        uint32_t i;
+        for(i=0; i<batch->entry_count; i++) {
+            bdestroy(batch->entries[i].key);
+            free(batch->entries[i].value);
+        }
+        sky_tablet_batch_release_undos(batch);
+        free(batch->entries);
+        free(batch->index);
+        free(batch->undos);
+        free(batch);
+        tablet->batch = NULL;
+    }
+}
+
+// Marks the current end of the tablet's batch as a savepoint. Writes made
+// after the savepoint can be undone with a rollback unless the batch is
+// flushed in between. Any earlier savepoint is released.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_save_batch(sky_tablet *tablet)
+{
+    assert(tablet != NULL);
+    check(tablet->batch != NULL, "Tablet batch not started");
+
+    sky_tablet_batch *batch = tablet->batch;
+    sky_tablet_batch_release_undos(batch);
+    batch->has_savepoint = true;
+    batch->savepoint_count = batch->entry_count;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Undoes every write made to the tablet's batch since its savepoint or
+// since its last flush, whichever is later. The savepoint remains in place.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_rollback_batch(sky_tablet *tablet)
+{
+    int rc;
+    uint32_t i;
+    assert(tablet != NULL);
+    check(tablet->batch != NULL, "Tablet batch not started");
+    check(tablet->batch->has_savepoint, "Tablet batch has no savepoint");
+
+    // Restore the replaced values.
+    sky_tablet_batch *batch = tablet->batch;
+    for(i=0; i<batch->undo_count; i++) {
+        sky_tablet_batch_entry *entry = &batch->entries[batch->undos[i].index];
+        free(entry->value);
+        entry->value = batch->undos[i].value;
+        entry->value_length = batch->undos[i].value_length;
+        entry->saved = false;
+    }
+    batch->undo_count = 0;
+
+    // Remove the entries added since the savepoint.
+    if(batch->entry_count > batch->savepoint_count) {
+        for(i=batch->savepoint_count; i<batch->entry_count; i++) {
+            bdestroy(batch->entries[i].key);
+            free(batch->entries[i].value);
+        }
+        batch->entry_count = batch->savepoint_count;
+        rc = sky_tablet_batch_reindex(batch, batch->index_capacity);
+        check(rc == 0, "Unable to index batch");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Tail Summary
+//--------------------------------------
+
+// Frees the state held by a tail summary.
+//
+// tail - The tail summary.
+void sky_tablet_tail_uninit(sky_tablet_tail *tail)
+{
+    if(tail) {
+        uint32_t i;
+        for(i=0; i<tail->data_count; i++) {
+            sky_event_data_free(tail->data[i]);
+        }
+        free(tail->data);
+        memset(tail, 0, sizeof(*tail));
+    }
+}
+
+// Retrieves the object state data for a given property from a tail summary.
+//
+// tail - The tail summary.
+// key  - The property id.
+//
+// Returns the matching data or null if the property is not set.
+static sky_event_data *sky_tablet_tail_get_data(sky_tablet_tail *tail,
+                                                sky_property_id_t key)
+{
+    uint32_t i;
+    for(i=0; i<tail->data_count; i++) {
+        if(tail->data[i]->key == key) {
+            return tail->data[i];
+        }
+    }
+    return NULL;
+}
+
+// Sets the object state for a property on a tail summary. The tail takes
+// ownership of the data.
+//
+// tail - The tail summary.
+// data - The event data to set.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_tail_set_data(sky_tablet_tail *tail, sky_event_data *data)
+{
+    uint32_t i;
+    for(i=0; i<tail->data_count; i++) {
+        if(tail->data[i]->key == data->key) {
+            sky_event_data_free(tail->data[i]);
+            tail->data[i] = data;
+            return 0;
+        }
+    }
+
+    tail->data = realloc(tail->data, (tail->data_count+1) * sizeof(*tail->data));
+    check_mem(tail->data);
+    tail->data[tail->data_count++] = data;
+    return 0;
+
+error:
+    sky_event_data_free(data);
+    return -1;
+}
+
+// Updates a tail summary with a series of raw events.
+//
+// tail        - The tail summary.
+// ptr         - A pointer to the start of the raw events.
+// data_length - The number of bytes of raw events.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_tail_apply(sky_tablet_tail *tail, void *ptr,
+                                 size_t data_length)
+{
+    int rc;
+    size_t sz;
+    sky_event_data *data = NULL;
+    void *endptr = ptr + data_length;
+
+    while(ptr < endptr) {
+        sky_action_id_t action_id;
+        sky_event_data_length_t event_data_length;
+
+        rc = sky_event_unpack_raw_hdr(ptr, tail->ts, &tail->ts, &action_id, &event_data_length, &sz);
+        check(rc == 0, "Unable to unpack event header");
+        ptr += sz;
+
+        // Only object data is carried forward as state.
+        void *data_endptr = ptr + event_data_length;
+        while(ptr < data_endptr) {
+            data = sky_event_data_create(0); check_mem(data);
+            rc = sky_event_data_unpack(data, ptr, &sz);
+            check(rc == 0, "Unable to unpack event data");
+            ptr += sz;
+
+            if(data->key > 0) {
+                rc = sky_tablet_tail_set_data(tail, data);
+                data = NULL;
+                check(rc == 0, "Unable to set tail state");
+            }
+            else {
+                sky_event_data_free(data);
+                data = NULL;
+            }
+        }
+    }
+
+    return 0;
+
+error:
+    sky_event_data_free(data);
+    return -1;
+}
+
+// Retrieves the tail summary for an object and whether it was read from the
+// segment's records.
+//
+// tablet     - The tablet.
+// object_id  - The object identifier.
+// tail       - The tail summary to read into.
+// found      - A pointer to where the existence of the summary is returned.
+// in_segment - A pointer to where it is returned whether the summary was
+//              read from the segment.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_read_tail(sky_tablet *tablet, bstring object_id,
+                                sky_tablet_tail *tail, bool *found,
+                                bool *in_segment)
+{
+    int rc;
+    size_t sz;
+    char *value = NULL;
+    sky_event_data *data = NULL;
+    assert(tablet != NULL);
+    assert(object_id != NULL);
+    assert(tail != NULL);
+    assert(found != NULL);
+
+    sky_tablet_tail_uninit(tail);
+    *found = false;
+
+    size_t value_length;
+    rc = sky_tablet_get_object_value(tablet, object_id, SKY_TABLET_KEY_TYPE_TAIL, 0, &value, &value_length, in_segment);
+    check(rc == 0, "Unable to retrieve tail summary");
+
+    if(value != NULL) {
+        void *ptr = value;
+        void *endptr = value + value_length;
+        check(value_length >= sizeof(sky_timestamp_t) * 2, "Invalid tail summary");
+
+        tail->ts = *((sky_timestamp_t*)ptr);
+        ptr += sizeof(sky_timestamp_t);
+        tail->chunk_ts = *((sky_timestamp_t*)ptr);
+        ptr += sizeof(sky_timestamp_t);
+
+        while(ptr < endptr) {
+            data = sky_event_data_create(0); check_mem(data);
+            rc = sky_event_data_unpack(data, ptr, &sz);
+            check(rc == 0, "Unable to unpack tail state");
+            ptr += sz;
+
+            rc = sky_tablet_tail_set_data(tail, data);
+            data = NULL;
+            check(rc == 0, "Unable to set tail state");
+        }
+        *found = true;
+    }
+
+    free(value);
+    return 0;
+
+error:
+    sky_event_data_free(data);
+    sky_tablet_tail_uninit(tail);
+    free(value);
+    return -1;
+}
+
+// Retrieves the tail summary for an object. The summary holds the timestamp
+// of the last event on the path, the minimum timestamp of the last chunk and
+// the object state at the end of the path.
+//
+// tablet    - The tablet.
+// object_id - The object identifier.
+// tail      - The tail summary to read into.
+// found     - A pointer to where the existence of the summary is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_get_tail(sky_tablet *tablet, bstring object_id,
+                        sky_tablet_tail *tail, bool *found)
+{
+    bool in_segment;
+    return sky_tablet_read_tail(tablet, object_id, tail, found, &in_segment);
+}
+
+// Adds a tail summary for an object to the tablet's current batch.
+//
+// tablet    - The tablet.
+// tail      - The tail summary.
+// object_id - The object identifier.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_put_tail(sky_tablet *tablet, sky_tablet_tail *tail,
+                               bstring object_id)
+{
+    int rc;
+    size_t sz;
+    uint32_t i;
+    void *value = NULL;
+    bstring key = NULL;
+
+    size_t value_length = sizeof(sky_timestamp_t) * 2;
+    for(i=0; i<tail->data_count; i++) {
+        value_length += sky_event_data_sizeof(tail->data[i]);
+    }
+    value = calloc(1, value_length); check_mem(value);
+
+    void *ptr = value;
+    *((sky_timestamp_t*)ptr) = tail->ts;
+    ptr += sizeof(sky_timestamp_t);
+    *((sky_timestamp_t*)ptr) = tail->chunk_ts;
+    ptr += sizeof(sky_timestamp_t);
+    for(i=0; i<tail->data_count; i++) {
+        rc = sky_event_data_pack(tail->data[i], ptr, &sz);
+        check(rc == 0, "Unable to pack tail state");
+        ptr += sz;
+    }
+
+    key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_TAIL, 0);
+    check_mem(key);
+    rc = sky_tablet_batch_put(tablet, key, value, value_length);
+    check(rc == 0, "Unable to write tail summary");
+
+    free(value);
+    bdestroy(key);
+    return 0;
+
+error:
+    free(value);
+    bdestroy(key);
+    return -1;
+}
+
+
+//--------------------------------------
+// Path Summary
+//--------------------------------------
+
+// Marks an action in an action bitset.
+//
+// actions   - The action bitset.
+// action_id - The action identifier.
+//
+// Returns nothing.
+void sky_tablet_summary_set_action(uint8_t *actions, sky_action_id_t action_id)
+{
+    uint32_t bit = action_id % (SKY_TABLET_SUMMARY_ACTION_BYTES * 8);
+    actions[bit / 8] |= (1 << (bit % 8));
+}
+
+// Adds a single event to a path summary.
+//
+// summary   - The path summary.
+// ts        - The shifted timestamp of the event.
+// action_id - The action of the event or zero if it has no action.
+//
+// Returns nothing.
+void sky_tablet_summary_add(sky_tablet_summary *summary, sky_timestamp_t ts,
+                            sky_action_id_t action_id)
+{
+    assert(summary != NULL);
+    if(summary->event_count == 0 || ts < summary->min_ts) summary->min_ts = ts;
+    if(summary->event_count == 0 || ts > summary->max_ts) summary->max_ts = ts;
+    summary->event_count++;
+    if(action_id > 0) {
+        sky_tablet_summary_set_action(summary->actions, action_id);
+    }
+}
+
+// Checks if a path may contain any of the actions in an action bitset.
+// Actions that share a bit with an action on the path are reported as
+// present.
+//
+// summary - The path summary.
+// actions - The action bitset.
+//
+// Returns true if any of the actions may be on the path.
+bool sky_tablet_summary_has_any_action(sky_tablet_summary *summary,
+                                       uint8_t *actions)
+{
+    uint32_t i;
+    assert(summary != NULL);
+    assert(actions != NULL);
+    for(i=0; i<SKY_TABLET_SUMMARY_ACTION_BYTES; i++) {
+        if(summary->actions[i] & actions[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reads a packed path summary.
+//
+// summary - The path summary to read into.
+// ptr     - A pointer to the packed summary.
+// length  - The number of bytes in the packed summary.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_summary_unpack(sky_tablet_summary *summary, const void *ptr,
+                              size_t length)
+{
+    assert(summary != NULL);
+    assert(ptr != NULL);
+    check(length == SKY_TABLET_SUMMARY_LENGTH || length == SKY_TABLET_SUMMARY_V1_LENGTH, "Invalid path summary");
+
+    memcpy(&summary->min_ts, ptr, sizeof(summary->min_ts));
+    ptr += sizeof(summary->min_ts);
+    memcpy(&summary->max_ts, ptr, sizeof(summary->max_ts));
+    ptr += sizeof(summary->max_ts);
+    memcpy(&summary->event_count, ptr, sizeof(summary->event_count));
+    ptr += sizeof(summary->event_count);
+    memcpy(&summary->checkpoint_event_count, ptr, sizeof(summary->checkpoint_event_count));
+    ptr += sizeof(summary->checkpoint_event_count);
+    memcpy(summary->actions, ptr, SKY_TABLET_SUMMARY_ACTION_BYTES);
+    ptr += SKY_TABLET_SUMMARY_ACTION_BYTES;
+
+    // Older summaries don't know where the last chunk starts.
+    summary->has_chunk_ts = (length == SKY_TABLET_SUMMARY_LENGTH);
+    summary->chunk_ts = 0;
+    if(summary->has_chunk_ts) {
+        memcpy(&summary->chunk_ts, ptr, sizeof(summary->chunk_ts));
+    }
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes a path summary in its packed form. Summaries are always packed with
+// the minimum timestamp of the last chunk.
+//
+// summary - The path summary.
+// ptr     - A pointer to SKY_TABLET_SUMMARY_LENGTH bytes to write to.
+//
+// Returns nothing.
+static void sky_tablet_summary_pack(sky_tablet_summary *summary, void *ptr)
+{
+    assert(summary != NULL);
+    assert(summary->has_chunk_ts);
+    memcpy(ptr, &summary->min_ts, sizeof(summary->min_ts));
+    ptr += sizeof(summary->min_ts);
+    memcpy(ptr, &summary->max_ts, sizeof(summary->max_ts));
+    ptr += sizeof(summary->max_ts);
+    memcpy(ptr, &summary->event_count, sizeof(summary->event_count));
+    ptr += sizeof(summary->event_count);
+    memcpy(ptr, &summary->checkpoint_event_count, sizeof(summary->checkpoint_event_count));
+    ptr += sizeof(summary->checkpoint_event_count);
+    memcpy(ptr, summary->actions, SKY_TABLET_SUMMARY_ACTION_BYTES);
+    ptr += SKY_TABLET_SUMMARY_ACTION_BYTES;
+    memcpy(ptr, &summary->chunk_ts, sizeof(summary->chunk_ts));
+}
+
+// Retrieves the path summary for an object. Paths that were written before
+// summaries were kept have no summary until they are next merged into.
+//
+// tablet    - The tablet.
+// object_id - The object identifier.
+// summary   - The path summary to read into.
+// found     - A pointer to where the existence of the summary is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_get_summary(sky_tablet *tablet, bstring object_id,
+                           sky_tablet_summary *summary, bool *found)
+{
+    int rc;
+    char *value = NULL;
+    size_t value_length;
+    assert(tablet != NULL);
+    assert(object_id != NULL);
+    assert(summary != NULL);
+    assert(found != NULL);
+
+    memset(summary, 0, sizeof(*summary));
+    *found = false;
+
+    rc = sky_tablet_get_object_value(tablet, object_id, SKY_TABLET_KEY_TYPE_SUMMARY, 0, &value, &value_length, NULL);
+    check(rc == 0, "Unable to retrieve path summary");
+    if(value != NULL) {
+        rc = sky_tablet_summary_unpack(summary, value, value_length);
+        check(rc == 0, "Unable to unpack path summary");
+        *found = true;
+    }
+
+    free(value);
+    return 0;
+
+error:
+    memset(summary, 0, sizeof(*summary));
+    free(value);
+    return -1;
+}
+
+// Adds a path summary for an object to the tablet's current batch.
+//
+// tablet    - The tablet.
+// summary   - The path summary.
+// object_id - The object identifier.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_put_summary(sky_tablet *tablet,
+                                  sky_tablet_summary *summary,
+                                  bstring object_id)
+{
+    int rc;
+    bstring key = NULL;
+    char value[SKY_TABLET_SUMMARY_LENGTH];
+
+    sky_tablet_summary_pack(summary, value);
+
+    key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_SUMMARY, 0);
+    check_mem(key);
+    rc = sky_tablet_batch_put(tablet, key, value, sizeof(value));
+    check(rc == 0, "Unable to write path summary");
+
+    bdestroy(key);
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+
+//--------------------------------------
+// Checkpoints
+//--------------------------------------
+
+// Frees the state held by a checkpoint.
+//
+// checkpoint - The checkpoint.
+void sky_tablet_checkpoint_uninit(sky_tablet_checkpoint *checkpoint)
+{
+    if(checkpoint) {
+        free(checkpoint->state);
+        memset(checkpoint, 0, sizeof(*checkpoint));
+    }
+}
+
+// Reads a packed checkpoint. The state is copied into a buffer owned by the
+// checkpoint which is reused when the checkpoint is read into again.
+//
+// checkpoint - The checkpoint to read into.
+// ts         - The timestamp of the checkpoint's key.
+// ptr        - A pointer to the packed checkpoint.
+// length     - The number of bytes in the packed checkpoint.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_checkpoint_unpack(sky_tablet_checkpoint *checkpoint,
+                                 sky_timestamp_t ts, const void *ptr,
+                                 size_t length)
+{
+    assert(checkpoint != NULL);
+    assert(ptr != NULL);
+    size_t header_length = sizeof(checkpoint->prev_ts) + sizeof(checkpoint->event_index);
+    check(length >= header_length, "Invalid checkpoint");
+
+    checkpoint->ts = ts;
+    memcpy(&checkpoint->prev_ts, ptr, sizeof(checkpoint->prev_ts));
+    ptr += sizeof(checkpoint->prev_ts);
+    memcpy(&checkpoint->event_index, ptr, sizeof(checkpoint->event_index));
+    ptr += sizeof(checkpoint->event_index);
+
+    checkpoint->state_length = length - header_length;
+    if(checkpoint->state_length > checkpoint->state_capacity) {
+        checkpoint->state = realloc(checkpoint->state, checkpoint->state_length);
+        check_mem(checkpoint->state);
+        checkpoint->state_capacity = checkpoint->state_length;
+    }
+    if(checkpoint->state_length > 0) {
+        memcpy(checkpoint->state, ptr, checkpoint->state_length);
+    }
+    return 0;
+
+error:
+    checkpoint->state_length = 0;
+    return -1;
+}
+
+// Moves a LevelDB iterator to the latest checkpoint on an object's path at
+// or before a given timestamp and reads it.
+//
+// iterator   - The LevelDB iterator.
+// object_id  - The object identifier.
+// ts         - The shifted timestamp to find a checkpoint for.
+// checkpoint - The checkpoint to read into.
+// found      - A pointer to where the existence of the checkpoint is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_iter_read_checkpoint(leveldb_iterator_t *iterator,
+                                           bstring object_id,
+                                           sky_timestamp_t ts,
+                                           sky_tablet_checkpoint *checkpoint,
+                                           bool *found)
+{
+    int rc;
+    bstring key = NULL;
+    assert(iterator != NULL);
+    assert(object_id != NULL);
+    assert(checkpoint != NULL);
+    assert(found != NULL);
+
+    *found = false;
+
+    // Seek to the first key after the timestamp and step back to the
+    // checkpoint before it unless the checkpoint is at the timestamp.
+    key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_CHECKPOINT, ts);
+    check_mem(key);
+    leveldb_iter_seek(iterator, bdata(key), blength(key));
+    if(!leveldb_iter_valid(iterator)) {
+        leveldb_iter_seek_to_last(iterator);
+    }
+    else {
+        size_t key_length;
+        const char *found_key = leveldb_iter_key(iterator, &key_length);
+        if(key_length != (size_t)blength(key) || memcmp(found_key, bdatae(key, ""), key_length) != 0) {
+            leveldb_iter_prev(iterator);
+        }
+    }
+
+    if(leveldb_iter_valid(iterator)) {
+        uint8_t key_type;
+        sky_timestamp_t timestamp;
+        size_t key_length, value_length, object_id_length;
+        const char *found_key = leveldb_iter_key(iterator, &key_length);
+        rc = sky_tablet_key_parse(found_key, key_length, &object_id_length, &key_type, &timestamp);
+        if(rc == 0 && key_type == SKY_TABLET_KEY_TYPE_CHECKPOINT && object_id_length == (size_t)blength(object_id) && memcmp(found_key, bdatae(object_id, ""), object_id_length) == 0) {
+            const char *value = leveldb_iter_value(iterator, &value_length);
+            rc = sky_tablet_checkpoint_unpack(checkpoint, timestamp, value, value_length);
+            check(rc == 0, "Unable to unpack checkpoint");
+            *found = true;
+        }
+    }
+
+    bdestroy(key);
+    return 0;
+
+error:
+    *found = false;
+    bdestroy(key);
+    return -1;
+}
+
+// Checks whether LevelDB holds any keys for an object.
+//
+// iterator  - The LevelDB iterator.
+// object_id - The object identifier.
+// found     - A pointer to where the existence of the object is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_iter_has_object(leveldb_iterator_t *iterator,
+                                      bstring object_id, bool *found)
+{
+    bstring key = NULL;
+    assert(iterator != NULL);
+    assert(object_id != NULL);
+    assert(found != NULL);
+
+    *found = false;
+    key = sky_tablet_key_create(object_id, 0, INT64_MIN); check_mem(key);
+    leveldb_iter_seek(iterator, bdata(key), blength(key));
+    if(leveldb_iter_valid(iterator)) {
+        size_t key_length, object_id_length;
+        const char *found_key = leveldb_iter_key(iterator, &key_length);
+        *found = (sky_tablet_key_parse(found_key, key_length, &object_id_length, NULL, NULL) == 0 && object_id_length == (size_t)blength(object_id) && memcmp(found_key, bdatae(object_id, ""), object_id_length) == 0);
+    }
+
+    bdestroy(key);
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+// Reads the latest checkpoint on an object's path at or before a given
+// timestamp. The checkpoint is read from the segment's records if LevelDB
+// holds no keys for the object.
+//
+// tablet     - The tablet.
+// iterator   - The LevelDB iterator.
+// object_id  - The object identifier.
+// ts         - The shifted timestamp to find a checkpoint for.
+// checkpoint - The checkpoint to read into.
+// found      - A pointer to where the existence of the checkpoint is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_read_checkpoint(sky_tablet *tablet,
+                                      leveldb_iterator_t *iterator,
+                                      bstring object_id, sky_timestamp_t ts,
+                                      sky_tablet_checkpoint *checkpoint,
+                                      bool *found)
+{
+    int rc;
+    assert(tablet != NULL);
+
+    bool in_leveldb = true;
+    sky_segment_entry *entry = sky_segment_find(tablet->segment, bdatae(object_id, ""), blength(object_id));
+    if(entry != NULL && entry->records_length > 0) {
+        rc = sky_tablet_iter_has_object(iterator, object_id, &in_leveldb);
+        check(rc == 0, "Unable to check object");
+    }
+
+    if(in_leveldb) {
+        rc = sky_tablet_iter_read_checkpoint(iterator, object_id, ts, checkpoint, found);
+        check(rc == 0, "Unable to read checkpoint");
+    }
+    else {
+        sky_segment_record record;
+        rc = sky_segment_find_record(tablet->segment, entry, SKY_TABLET_KEY_TYPE_CHECKPOINT, ts, &record, found);
+        check(rc == 0, "Unable to find segment record");
+        if(*found) {
+            rc = sky_tablet_checkpoint_unpack(checkpoint, record.ts, record.value, record.value_length);
+            check(rc == 0, "Unable to unpack checkpoint");
+        }
+    }
+
+    return 0;
+
+error:
+    *found = false;
+    return -1;
+}
+
+// Retrieves the latest checkpoint on an object's path at or before a given
+// timestamp. Checkpoints are read directly from LevelDB, or from the segment
+// for compacted objects, so pending writes in the tablet's current batch are
+// not included.
+//
+// tablet     - The tablet.
+// object_id  - The object identifier.
+// ts         - The shifted timestamp to find a checkpoint for.
+// checkpoint - The checkpoint to read into.
+// found      - A pointer to where the existence of the checkpoint is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_get_checkpoint(sky_tablet *tablet, bstring object_id,
+                              sky_timestamp_t ts,
+                              sky_tablet_checkpoint *checkpoint, bool *found)
+{
+    int rc;
+    leveldb_iterator_t *iterator = NULL;
+    assert(tablet != NULL);
+
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    rc = sky_tablet_read_checkpoint(tablet, iterator, object_id, ts, checkpoint, found);
+    check(rc == 0, "Unable to read checkpoint");
+
+    leveldb_iter_destroy(iterator);
+    return 0;
+
+error:
+    *found = false;
+    if(iterator) leveldb_iter_destroy(iterator);
+    return -1;
+}
+
+// Reads the checkpoint of a path that was read in place while seeking. The
+// path's own iterator is held on its chunk so a second iterator is used to
+// find the latest checkpoint at or before the seek timestamp. Nothing is
+// done if the path has no pending checkpoint.
+//
+// path     - The path.
+// iterator - A LevelDB iterator other than the one the path is held on.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_path_read_checkpoint(sky_tablet_path *path,
+                                    leveldb_iterator_t *iterator)
+{
+    int rc;
+    assert(path != NULL);
+    assert(iterator != NULL);
+
+    if(!path->checkpoint_pending) {
+        return 0;
+    }
+    path->checkpoint_pending = false;
+
+    rc = sky_tablet_iter_read_checkpoint(iterator, path->object_id, path->seek_ts, &path->checkpoint, &path->has_checkpoint);
+    check(rc == 0, "Unable to read checkpoint");
+    return 0;
+
+error:
+    return -1;
+}
+
+// Reads the checkpoint of a path that is only held in the tablet's segment.
+// The latest checkpoint at or before the seek timestamp is kept if the path
+// is seeking.
+//
+// tablet - The tablet.
+// path   - The path.
+// entry  - The path's segment entry.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_path_read_segment_checkpoint(sky_tablet *tablet,
+                                            sky_tablet_path *path,
+                                            sky_segment_entry *entry)
+{
+    int rc;
+    assert(tablet != NULL);
+    assert(path != NULL);
+    assert(entry != NULL);
+
+    path->has_checkpoint = false;
+    path->checkpoint_pending = false;
+    if(!path->seek) {
+        return 0;
+    }
+
+    sky_segment_record record;
+    rc = sky_segment_find_record(tablet->segment, entry, SKY_TABLET_KEY_TYPE_CHECKPOINT, path->seek_ts, &record, &path->has_checkpoint);
+    check(rc == 0, "Unable to find segment record");
+    if(path->has_checkpoint) {
+        rc = sky_tablet_checkpoint_unpack(&path->checkpoint, record.ts, record.value, record.value_length);
+        check(rc == 0, "Unable to unpack checkpoint");
+    }
+    return 0;
+
+error:
+    path->has_checkpoint = false;
+    return -1;
+}
+
+// Adds a checkpoint of the object state held by a tail summary to the
+// tablet's current batch.
+//
+// tablet      - The tablet.
+// object_id   - The object identifier.
+// tail        - The tail summary of the path before the checkpoint.
+// ts          - The shifted timestamp of the first event after the checkpoint.
+// event_index - The number of events before the checkpoint.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_put_checkpoint(sky_tablet *tablet, bstring object_id,
+                                     sky_tablet_tail *tail, sky_timestamp_t ts,
+                                     uint64_t event_index)
+{
+    int rc;
+    size_t sz;
+    uint32_t i;
+    void *value = NULL;
+    bstring key = NULL;
+
+    size_t value_length = sizeof(sky_timestamp_t) + sizeof(uint64_t);
+    for(i=0; i<tail->data_count; i++) {
+        value_length += sky_event_data_sizeof(tail->data[i]);
+    }
+    value = calloc(1, value_length); check_mem(value);
+
+    void *ptr = value;
+    memcpy(ptr, &tail->ts, sizeof(tail->ts));
+    ptr += sizeof(tail->ts);
+    memcpy(ptr, &event_index, sizeof(event_index));
+    ptr += sizeof(event_index);
+    for(i=0; i<tail->data_count; i++) {
+        rc = sky_event_data_pack(tail->data[i], ptr, &sz);
+        check(rc == 0, "Unable to pack checkpoint state");
+        ptr += sz;
+    }
+
+    key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_CHECKPOINT, ts);
+    check_mem(key);
+    rc = sky_tablet_batch_put(tablet, key, value, value_length);
+    check(rc == 0, "Unable to write checkpoint");
+
+    free(value);
+    bdestroy(key);
+    return 0;
+
+error:
+    free(value);
+    bdestroy(key);
+    return -1;
+}
+
+// Adds a checkpoint before the next event on a path if enough events have
+// passed since the last checkpoint and the event's timestamp is after the
+// previous event's.
+//
+// tablet    - The tablet.
+// object_id - The object identifier.
+// tail      - The tail summary of the path before the next event.
+// summary   - The path summary of the path before the next event.
+// ts        - The shifted timestamp of the next event.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_put_due_checkpoint(sky_tablet *tablet, bstring object_id,
+                                         sky_tablet_tail *tail,
+                                         sky_tablet_summary *summary,
+                                         sky_timestamp_t ts)
+{
+    int rc;
+    if(summary->event_count == 0 || ts <= tail->ts) {
+        return 0;
+    }
+    if(summary->event_count - summary->checkpoint_event_count < SKY_TABLET_CHECKPOINT_INTERVAL) {
+        return 0;
+    }
+
+    rc = sky_tablet_put_checkpoint(tablet, object_id, tail, ts, summary->event_count);
+    check(rc == 0, "Unable to write checkpoint");
+    summary->checkpoint_event_count = summary->event_count;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Removes the checkpoints on an object's path at or after a timestamp.
+// Checkpoints are found in LevelDB so any pending writes must be flushed
+// first.
+//
+// tablet    - The tablet.
+// object_id - The object identifier.
+// min_ts    - The shifted timestamp of the first checkpoint to remove.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_delete_checkpoints(sky_tablet *tablet, bstring object_id,
+                                         sky_timestamp_t min_ts)
+{
+    int rc;
+    bstring key = NULL;
+    bstring found_key = NULL;
+    leveldb_iterator_t *iterator = NULL;
+
+    key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_CHECKPOINT, min_ts);
+    check_mem(key);
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    for(leveldb_iter_seek(iterator, bdata(key), blength(key)); leveldb_iter_valid(iterator); leveldb_iter_next(iterator)) {
+        uint8_t key_type;
+        size_t key_length, object_id_length;
+        const char *raw_key = leveldb_iter_key(iterator, &key_length);
+        rc = sky_tablet_key_parse(raw_key, key_length, &object_id_length, &key_type, NULL);
+        if(rc != 0 || key_type != SKY_TABLET_KEY_TYPE_CHECKPOINT || object_id_length != (size_t)blength(object_id) || memcmp(raw_key, bdatae(object_id, ""), object_id_length) != 0) {
+            break;
+        }
+
+        found_key = blk2bstr(raw_key, key_length); check_mem(found_key);
+        rc = sky_tablet_batch_put(tablet, found_key, NULL, 0);
+        check(rc == 0, "Unable to delete checkpoint");
+        bdestroy(found_key);
+        found_key = NULL;
+    }
+
+    leveldb_iter_destroy(iterator);
+    bdestroy(key);
+    return 0;
+
+error:
+    if(iterator) leveldb_iter_destroy(iterator);
+    bdestroy(found_key);
+    bdestroy(key);
+    return -1;
+}
+
+// Rebuilds the tail summary, path summary and checkpoints of a path from a
+// series of raw events. The events must follow the events that have already
+// been applied.
+//
+// tablet      - The tablet.
+// object_id   - The object identifier.
+// tail        - The tail summary.
+// summary     - The path summary.
+// ptr         - A pointer to the start of the raw events.
+// data_length - The number of bytes of raw events.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_rebuild_apply(sky_tablet *tablet, bstring object_id,
+                                    sky_tablet_tail *tail,
+                                    sky_tablet_summary *summary, void *ptr,
+                                    size_t data_length)
+{
+    int rc;
+    size_t sz;
+    void *endptr = ptr + data_length;
+
+    while(ptr < endptr) {
+        sky_timestamp_t ts;
+        sky_action_id_t action_id;
+        sky_event_data_length_t event_data_length;
+        rc = sky_event_unpack_raw_hdr(ptr, tail->ts, &ts, &action_id, &event_data_length, &sz);
+        check(rc == 0, "Unable to unpack event header");
+
+        rc = sky_tablet_put_due_checkpoint(tablet, object_id, tail, summary, ts);
+        check(rc == 0, "Unable to write checkpoint");
+
+        rc = sky_tablet_tail_apply(tail, ptr, sz + event_data_length);
+        check(rc == 0, "Unable to apply event to tail summary");
+        sky_tablet_summary_add(summary, ts, action_id);
+        ptr += sz + event_data_length;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Object State
+//--------------------------------------
+
+// Replays a block of raw events onto an object state up to a timestamp.
+// Events before the checkpoint only have their headers read since the
+// checkpoint already holds their data.
+//
+// state       - The object state.
+// checkpoint  - The checkpoint the state started from or null.
+// ptr         - A pointer to the start of the raw events.
+// data_length - The number of bytes of raw events.
+// ts          - The shifted timestamp to stop after.
+// found       - A pointer to where the application of an event is flagged.
+// done        - A pointer to where reaching an event after the timestamp is
+//               flagged.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_state_replay(sky_tablet_tail *state,
+                                   sky_tablet_checkpoint *checkpoint,
+                                   const void *ptr, size_t data_length,
+                                   sky_timestamp_t ts, bool *found, bool *done)
+{
+    int rc;
+    size_t sz;
+    const void *endptr = ptr + data_length;
+
+    while(ptr < endptr) {
+        sky_timestamp_t event_ts;
+        sky_action_id_t action_id;
+        sky_event_data_length_t event_data_length;
+        rc = sky_event_unpack_raw_hdr((void*)ptr, state->ts, &event_ts, &action_id, &event_data_length, &sz);
+        check(rc == 0, "Unable to unpack event header");
+        if(event_ts > ts) {
+            *done = true;
+            break;
+        }
+
+        if(checkpoint != NULL && event_ts < checkpoint->ts) {
+            state->ts = event_ts;
+        }
+        else {
+            rc = sky_tablet_tail_apply(state, (void*)ptr, sz + event_data_length);
+            check(rc == 0, "Unable to apply event to object state");
+            *found = true;
+        }
+        ptr += sz + event_data_length;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Checks if a LevelDB iterator is positioned on a chunk of an object.
+//
+// iterator  - The LevelDB iterator.
+// object_id - The object identifier.
+// timestamp - A pointer to where the chunk's minimum timestamp is returned.
+//
+// Returns true if the key is one of the object's chunks.
+static bool sky_tablet_iter_on_chunk(leveldb_iterator_t *iterator,
+                                     bstring object_id,
+                                     sky_timestamp_t *timestamp)
+{
+    uint8_t key_type;
+    size_t key_length, object_id_length;
+    if(!leveldb_iter_valid(iterator)) {
+        return false;
+    }
+    const char *key = leveldb_iter_key(iterator, &key_length);
+    int rc = sky_tablet_key_parse(key, key_length, &object_id_length, &key_type, timestamp);
+    return (rc == 0 && key_type == SKY_TABLET_KEY_TYPE_CHUNK && object_id_length == (size_t)blength(object_id) && memcmp(key, bdatae(object_id, ""), object_id_length) == 0);
+}
+
+// Moves a LevelDB iterator to the last chunk of an object that starts at or
+// before a timestamp. If there is none then the iterator is left on the
+// first key after the timestamp, which is the object's first chunk if it
+// has any.
+//
+// iterator  - The LevelDB iterator.
+// object_id - The object identifier.
+// ts        - The shifted timestamp.
+// found     - A pointer to where the existence of a chunk at or before the
+//             timestamp is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_iter_seek_chunk(leveldb_iterator_t *iterator,
+                                      bstring object_id, sky_timestamp_t ts,
+                                      bool *found)
+{
+    sky_timestamp_t chunk_ts;
+    bstring key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_CHUNK, ts);
+    check_mem(key);
+
+    leveldb_iter_seek(iterator, bdata(key), blength(key));
+    *found = (sky_tablet_iter_on_chunk(iterator, object_id, &chunk_ts) && chunk_ts == ts);
+    if(!*found) {
+        if(leveldb_iter_valid(iterator)) {
+            leveldb_iter_prev(iterator);
+        }
+        else {
+            leveldb_iter_seek_to_last(iterator);
+        }
+        *found = sky_tablet_iter_on_chunk(iterator, object_id, &chunk_ts);
+        if(!*found) {
+            leveldb_iter_seek(iterator, bdata(key), blength(key));
+        }
+    }
+
+    bdestroy(key);
+    return 0;
+
+error:
+    *found = false;
+    return -1;
+}
+
+// Sets the object state held by a checkpoint on a tail summary. The tail's
+// timestamp is set to the event before the checkpoint.
+//
+// checkpoint - The checkpoint.
+// tail       - The tail summary.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_checkpoint_restore(sky_tablet_checkpoint *checkpoint,
+                                         sky_tablet_tail *tail)
+{
+    int rc;
+    size_t sz;
+    sky_event_data *event_data = NULL;
+    void *ptr = checkpoint->state;
+    void *endptr = checkpoint->state + checkpoint->state_length;
+
+    while(ptr < endptr) {
+        event_data = sky_event_data_create(0); check_mem(event_data);
+        rc = sky_event_data_unpack(event_data, ptr, &sz);
+        check(rc == 0, "Unable to unpack checkpoint state");
+        ptr += sz;
+
+        rc = sky_tablet_tail_set_data(tail, event_data);
+        event_data = NULL;
+        check(rc == 0, "Unable to set object state");
+    }
+    tail->ts = checkpoint->prev_ts;
+    return 0;
+
+error:
+    sky_event_data_free(event_data);
+    return -1;
+}
+
+// Retrieves the object state of an object as of a given timestamp. The state
+// holds the object data set by every event at or before the timestamp and
+// is returned in the form of a tail summary whose timestamp is the last
+// event that was applied. States at or after the last event are taken
+// straight from the tail summary. Otherwise the state is restored from the
+// latest checkpoint before the timestamp and only the chunk that holds the
+// checkpoint and the later chunks up to the timestamp are read. Chunks are
+// split between events with different timestamps and a checkpoint always
+// precedes an event with a later timestamp than the one before it, so the
+// chunk holding the checkpoint is the last one starting at or before it.
+//
+// tablet    - The tablet.
+// object_id - The object identifier.
+// ts        - The shifted timestamp to find the state at.
+// state     - The tail summary to read the state into.
+// found     - A pointer to where the existence of an event at or before the
+//             timestamp is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_get_state(sky_tablet *tablet, bstring object_id,
+                         sky_timestamp_t ts, sky_tablet_tail *state,
+                         bool *found)
+{
+    int rc;
+    leveldb_iterator_t *iterator = NULL;
+    sky_tablet_checkpoint checkpoint; memset(&checkpoint, 0, sizeof(checkpoint));
+    assert(tablet != NULL);
+    assert(object_id != NULL);
+    assert(state != NULL);
+    assert(found != NULL);
+
+    rc = sky_tablet_get_tail(tablet, object_id, state, found);
+    check(rc == 0, "Unable to retrieve tail summary");
+    if(!*found || ts >= state->ts) {
+        return 0;
+    }
+    sky_tablet_tail_uninit(state);
+    *found = false;
+
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+
+    // Start from the state at the latest checkpoint.
+    bool has_checkpoint;
+    rc = sky_tablet_read_checkpoint(tablet, iterator, object_id, ts, &checkpoint, &has_checkpoint);
+    check(rc == 0, "Unable to retrieve checkpoint");
+    if(has_checkpoint) {
+        rc = sky_tablet_checkpoint_restore(&checkpoint, state);
+        check(rc == 0, "Unable to restore checkpoint");
+        *found = true;
+    }
+
+    // Move to the last chunk starting at or before the checkpoint. Without
+    // one the checkpoint is in the segment's copy of the path.
+    bool done = false;
+    bool has_start_chunk;
+    sky_timestamp_t chunk_ts;
+    sky_timestamp_t start_ts = (has_checkpoint ? checkpoint.ts : INT64_MIN);
+    rc = sky_tablet_iter_seek_chunk(iterator, object_id, start_ts, &has_start_chunk);
+    check(rc == 0, "Unable to seek to chunk");
+    if(!has_start_chunk) {
+        // Replay the segment's copy unless the chunks hold the full path.
+        sky_segment_entry *entry = sky_segment_find(tablet->segment, bdatae(object_id, ""), blength(object_id));
+        bool has_chunk = sky_tablet_iter_on_chunk(iterator, object_id, &chunk_ts);
+        if(entry != NULL && entry->data_length > 0 && (!has_chunk || chunk_ts > entry->max_timestamp)) {
+            void *data = sky_segment_get_data(tablet->segment, entry);
+            rc = sky_tablet_state_replay(state, (has_checkpoint ? &checkpoint : NULL), data, entry->data_length, ts, found, &done);
+            check(rc == 0, "Unable to replay segment path");
+        }
+    }
+
+    // Replay the chunks up to the timestamp.
+    while(!done && sky_tablet_iter_on_chunk(iterator, object_id, &chunk_ts) && chunk_ts <= ts) {
+        size_t value_length;
+        const char *value = leveldb_iter_value(iterator, &value_length);
+        rc = sky_tablet_state_replay(state, (has_checkpoint ? &checkpoint : NULL), value, value_length, ts, found, &done);
+        check(rc == 0, "Unable to replay chunk");
+        leveldb_iter_next(iterator);
+    }
+
+    sky_tablet_checkpoint_uninit(&checkpoint);
+    leveldb_iter_destroy(iterator);
+    return 0;
+
+error:
+    sky_tablet_checkpoint_uninit(&checkpoint);
+    sky_tablet_tail_uninit(state);
+    if(iterator) leveldb_iter_destroy(iterator);
+    *found = false;
+    return -1;
+}
+
+
+//--------------------------------------
+// Compaction
+//--------------------------------------
+
+// Creates the key that stores the generation of the last segment whose
+// chunks have been removed from LevelDB.
+//
+// Returns the key.
+static bstring sky_tablet_generation_key()
+{
+    struct tagbstring empty = bsStatic("");
+    return sky_tablet_key_create(&empty, SKY_TABLET_KEY_TYPE_META, 0);
+}
+
+// Removes all compacted keys from LevelDB and records the segment generation
+// that they were compacted into. Both happen in a single synced write. Only
+// chunks are removed for segments without records.
+//
+// tablet     - The tablet.
+// generation - The segment generation.
+// records    - Whether the segment holds the objects' records.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_delete_compacted(sky_tablet *tablet, uint64_t generation,
+                                       bool records)
+{
+    char *errptr = NULL;
+    bstring key = NULL;
+    leveldb_iterator_t *iterator = NULL;
+    leveldb_writebatch_t *writebatch = NULL;
+    assert(tablet != NULL);
+
+    writebatch = leveldb_writebatch_create(); check_mem(writebatch);
+
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    for(leveldb_iter_seek_to_first(iterator); leveldb_iter_valid(iterator); leveldb_iter_next(iterator)) {
+        uint8_t key_type;
+        size_t key_length, object_id_length;
+        const char *found_key = leveldb_iter_key(iterator, &key_length);
+        if(sky_tablet_key_parse(found_key, key_length, &object_id_length, &key_type, NULL) == 0 && object_id_length > 0 && (records || key_type == SKY_TABLET_KEY_TYPE_CHUNK)) {
+            leveldb_writebatch_delete(writebatch, found_key, key_length);
+        }
+    }
+    leveldb_iter_destroy(iterator);
+    iterator = NULL;
+
+    key = sky_tablet_generation_key(); check_mem(key);
+    leveldb_writebatch_put(writebatch, bdata(key), blength(key), (char*)&generation, sizeof(generation));
+
+    leveldb_write(tablet->leveldb_db, tablet->sync_writeoptions, writebatch, &errptr);
+    check(errptr == NULL, "LevelDB write error: %s", errptr);
+    __atomic_add_fetch(&tablet->stats.write_count, 1, __ATOMIC_RELAXED);
+
+    leveldb_writebatch_destroy(writebatch);
+    bdestroy(key);
+    return 0;
+
+error:
+    if(errptr) leveldb_free(errptr);
+    if(iterator) leveldb_iter_destroy(iterator);
+    if(writebatch) leveldb_writebatch_destroy(writebatch);
+    bdestroy(key);
+    return -1;
+}
+
+// Maps the tablet's segment file. If a compaction was interrupted after the
+// segment was written but before its keys were removed from LevelDB then
+// the keys are removed now.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_open_segment(sky_tablet *tablet)
+{
+    int rc;
+    char *errptr = NULL;
+    char *value = NULL;
+    bstring key = NULL;
+    bstring path = NULL;
+    bstring tmp_path = NULL;
+    assert(tablet != NULL);
+
+    path = bformat("%s/%s", bdata(tablet->path), SKY_TABLET_SEGMENT_FILENAME);
+    check_mem(path);
+    tmp_path = bformat("%s.tmp", bdata(path)); check_mem(tmp_path);
+
+    // Remove any incomplete segment.
+    if(sky_file_exists(tmp_path)) {
+        check(unlink(bdatae(tmp_path, "")) == 0, "Unable to remove incomplete segment: %s", bdata(tmp_path));
+    }
+
+    rc = sky_segment_open(tablet->segment, path);
+    check(rc == 0, "Unable to open segment");
+
+    // Check which generation was last applied to LevelDB.
+    uint64_t generation = 0;
+    size_t value_length;
+    key = sky_tablet_generation_key(); check_mem(key);
+    value = leveldb_get(tablet->leveldb_db, tablet->readoptions, bdata(key), blength(key), &value_length, &errptr);
+    check(errptr == NULL, "LevelDB get error: %s", errptr);
+    if(value != NULL) {
+        check(value_length == sizeof(generation), "Invalid segment generation");
+        memcpy(&generation, value, sizeof(generation));
+    }
+
+    if(tablet->segment->generation > generation) {
+        rc = sky_tablet_delete_compacted(tablet, tablet->segment->generation, tablet->segment->has_records);
+        check(rc == 0, "Unable to complete compaction");
+    }
+
+    free(value);
+    bdestroy(key);
+    bdestroy(path);
+    bdestroy(tmp_path);
+    return 0;
+
+error:
+    if(errptr) leveldb_free(errptr);
+    free(value);
+    bdestroy(key);
+    bdestroy(path);
+    bdestroy(tmp_path);
+    return -1;
+}
+
+// Splits a full path into chunks between events with different timestamps
+// and writes them to the tablet.
+//
+// tablet      - The tablet.
+// object_id   - The object identifier.
+// data        - The path data.
+// data_length - The length of the path data, in bytes.
+// writebatch  - The LevelDB batch to write the chunks to or null if they
+//               should be written to the tablet's current batch.
+// chunk_ts    - A pointer to where the minimum timestamp of the last chunk
+//               should be returned or null.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_put_chunks(sky_tablet *tablet, bstring object_id,
+                                 void *data, size_t data_length,
+                                 leveldb_writebatch_t *writebatch,
+                                 sky_timestamp_t *chunk_ts)
+{
+    int rc;
+    size_t start = 0, offset = 0;
+    sky_timestamp_t prev_ts = 0, min_ts = 0;
+    while(offset <= data_length) {
+        sky_timestamp_t ts = 0;
+        size_t sz = 0;
+        if(offset < data_length) {
+            ts = sky_event_get_raw_ts(data+offset, prev_ts);
+            sz = sky_event_sizeof_raw(data+offset);
+        }
+
+        if(offset == data_length || (offset > start && ts > prev_ts && (offset - start) + sz > tablet->max_chunk_size)) {
+            if(offset > start) {
+                rc = sky_tablet_put_chunk(tablet, object_id, min_ts, data+start, offset-start, writebatch);
+                check(rc == 0, "Unable to write chunk");
+                if(chunk_ts != NULL) *chunk_ts = min_ts;
+            }
+            start = offset;
+        }
+        if(offset == start) {
+            min_ts = ts;
+        }
+        if(offset == data_length) {
+            break;
+        }
+
+        prev_ts = ts;
+        offset += sz;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Copies an object's path from the segment into LevelDB chunks so that an
+// older event can be merged into it. Nothing is copied if the object is not
+// in the segment or if LevelDB already holds the full path. The chunks only
+// repeat the segment's copy of the path so they are written straight to
+// LevelDB instead of the tablet's batch, which lets the merge read them
+// without flushing the batch again.
+//
+// tablet    - The tablet.
+// object_id - The object identifier.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_copy_segment_path(sky_tablet *tablet, bstring object_id)
+{
+    int rc;
+    char *errptr = NULL;
+    leveldb_iterator_t *iterator = NULL;
+    leveldb_writebatch_t *writebatch = NULL;
+    assert(tablet != NULL);
+    assert(object_id != NULL);
+
+    sky_segment_entry *entry = sky_segment_find(tablet->segment, bdatae(object_id, ""), blength(object_id));
+    if(entry == NULL || entry->data_length == 0) {
+        return 0;
+    }
+
+    // LevelDB holds the full path if its first chunk isn't newer than the
+    // segment's copy.
+    bool found;
+    sky_timestamp_t chunk_ts;
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    rc = sky_tablet_iter_seek_chunk(iterator, object_id, INT64_MIN, &found);
+    check(rc == 0, "Unable to seek to chunk");
+    bool has_chunk = sky_tablet_iter_on_chunk(iterator, object_id, &chunk_ts);
+    leveldb_iter_destroy(iterator);
+    iterator = NULL;
+
+    if(!has_chunk || chunk_ts > entry->max_timestamp) {
+        writebatch = leveldb_writebatch_create(); check_mem(writebatch);
+        void *data = sky_segment_get_data(tablet->segment, entry);
+        rc = sky_tablet_put_chunks(tablet, object_id, data, entry->data_length, writebatch, NULL);
+        check(rc == 0, "Unable to write chunks");
+        leveldb_write(tablet->leveldb_db, tablet->writeoptions, writebatch, &errptr);
+        check(errptr == NULL, "LevelDB write error: %s", errptr);
+        __atomic_add_fetch(&tablet->stats.write_count, 1, __ATOMIC_RELAXED);
+        leveldb_writebatch_destroy(writebatch);
+    }
+
+    return 0;
+
+error:
+    if(errptr) leveldb_free(errptr);
+    if(iterator) leveldb_iter_destroy(iterator);
+    if(writebatch) leveldb_writebatch_destroy(writebatch);
+    return -1;
+}
+
+// Packs an object's tail summary, path summary and checkpoints from LevelDB
+// into segment records. The object's chunks are skipped over.
+//
+// iterator  - The LevelDB iterator.
+// object_id - The object identifier.
+// records   - The buffer to append the records to.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_iter_pack_records(leveldb_iterator_t *iterator,
+                                        bstring object_id, bstring records)
+{
+    int rc;
+    bstring key = NULL;
+    assert(iterator != NULL);
+    assert(object_id != NULL);
+    assert(records != NULL);
+
+    key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_SUMMARY, INT64_MIN);
+    check_mem(key);
+    leveldb_iter_seek(iterator, bdata(key), blength(key));
+    while(leveldb_iter_valid(iterator)) {
+        uint8_t key_type;
+        sky_timestamp_t ts;
+        size_t key_length, value_length, object_id_length;
+        const char *found_key = leveldb_iter_key(iterator, &key_length);
+        rc = sky_tablet_key_parse(found_key, key_length, &object_id_length, &key_type, &ts);
+        if(rc != 0 || object_id_length != (size_t)blength(object_id) || memcmp(found_key, bdatae(object_id, ""), object_id_length) != 0) {
+            break;
+        }
+
+        // Jump past the chunks to the tail summary.
+        if(key_type == SKY_TABLET_KEY_TYPE_CHUNK) {
+            bdestroy(key);
+            key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_TAIL, INT64_MIN);
+            check_mem(key);
+            leveldb_iter_seek(iterator, bdata(key), blength(key));
+            continue;
+        }
+
+        const char *value = leveldb_iter_value(iterator, &value_length);
+        rc = sky_segment_record_pack(records, key_type, ts, value, value_length);
+        check(rc == 0, "Unable to pack segment record");
+        leveldb_iter_next(iterator);
+    }
+
+    bdestroy(key);
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+// Writes every path in the tablet into a new segment file along with each
+// object's tail summary, path summary and checkpoints and then removes the
+// objects from LevelDB. The segment replaces any previous segment. Scans of
+// objects that aren't written to afterward only read the segment.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_compact(sky_tablet *tablet)
+{
+    int rc;
+    bstring path = NULL;
+    bstring tmp_path = NULL;
+    bstring records = NULL;
+    leveldb_iterator_t *iterator = NULL;
+    leveldb_iterator_t *records_iterator = NULL;
+    sky_segment_writer *writer = NULL;
+    sky_tablet_path tablet_path; memset(&tablet_path, 0, sizeof(tablet_path));
+    assert(tablet != NULL);
+
+    // Paths are written straight to the segment so they can be read in
+    // place.
+    tablet_path.in_place = true;
+
+    // Include any pending writes.
+    if(tablet->batch != NULL) {
+        rc = sky_tablet_flush_batch(tablet);
+        check(rc == 0, "Unable to flush batch");
+    }
+
+    path = bformat("%s/%s", bdata(tablet->path), SKY_TABLET_SEGMENT_FILENAME);
+    check_mem(path);
+    tmp_path = bformat("%s.tmp", bdata(path)); check_mem(tmp_path);
+
+    uint64_t generation = tablet->segment->generation + 1;
+    writer = sky_segment_writer_create(tmp_path, generation);
+    check(writer != NULL, "Unable to create segment writer");
+
+    // Walk the LevelDB paths and the current segment together in object
+    // order.
+    sky_segment *segment = tablet->segment;
+    uint64_t index = 0;
+    records = bfromcstr(""); check_mem(records);
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    records_iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(records_iterator != NULL, "Unable to create LevelDB iterator");
+    leveldb_iter_seek_to_first(iterator);
+    while(leveldb_iter_valid(iterator) || index < segment->entry_count) {
+        int cmp = -1;
+        if(leveldb_iter_valid(iterator) && index < segment->entry_count) {
+            size_t key_length, object_id_length;
+            const char *key = leveldb_iter_key(iterator, &key_length);
+            rc = sky_tablet_key_parse(key, key_length, &object_id_length, NULL, NULL);
+            check(rc == 0, "Invalid tablet key");
+            cmp = sky_segment_compare(segment, &segment->entries[index], key, object_id_length);
+        }
+        else if(leveldb_iter_valid(iterator)) {
+            cmp = 1;
+        }
+
+        // Copy objects that only exist in the segment.
+        if(cmp < 0) {
+            sky_segment_entry *entry = &segment->entries[index++];
+            rc = sky_segment_writer_write(writer, sky_segment_get_object_id(segment, entry), entry->object_id_length, sky_segment_get_data(segment, entry), entry->data_length, sky_segment_get_records(segment, entry), entry->records_length);
+            check(rc == 0, "Unable to write segment path");
+        }
+        // Otherwise combine the LevelDB chunks with the segment. LevelDB
+        // holds all of the object's records so the segment's are replaced.
+        else {
+            sky_segment_entry *entry = (cmp == 0 ? &segment->entries[index++] : NULL);
+            rc = sky_tablet_path_read(&tablet_path, iterator);
+            check(rc == 0, "Unable to read path");
+
+            void *data;
+            size_t data_length;
+            rc = sky_tablet_path_apply_segment(tablet, &tablet_path, entry, &data, &data_length);
+            check(rc == 0, "Unable to apply segment to path");
+            btrunc(records, 0);
+            if(blength(tablet_path.object_id) > 0) {
+                rc = sky_tablet_iter_pack_records(records_iterator, tablet_path.object_id, records);
+                check(rc == 0, "Unable to pack records");
+            }
+            if(data_length > 0 || blength(records) > 0) {
+                rc = sky_segment_writer_write(writer, bdata(tablet_path.object_id), blength(tablet_path.object_id), data, data_length, bdata(records), blength(records));
+                check(rc == 0, "Unable to write segment path");
+            }
+            rc = sky_tablet_path_release(&tablet_path, iterator);
+            check(rc == 0, "Unable to release path");
+        }
+    }
+    leveldb_iter_destroy(iterator);
+    iterator = NULL;
+    leveldb_iter_destroy(records_iterator);
+    records_iterator = NULL;
+
+    rc = sky_segment_writer_close(writer);
+    check(rc == 0, "Unable to close segment writer");
+    sky_segment_writer_free(writer);
+    writer = NULL;
+
+    // Replace the segment and then remove the objects from LevelDB. If this
+    // is interrupted then they are removed when the tablet is next opened.
+    check(rename(bdatae(tmp_path, ""), bdatae(path, "")) == 0, "Unable to replace segment: %s", bdata(path));
+    rc = sky_tablet_delete_compacted(tablet, generation, true);
+    check(rc == 0, "Unable to remove compacted keys");
+    rc = sky_segment_open(tablet->segment, path);
+    check(rc == 0, "Unable to open segment");
+
+    sky_tablet_path_uninit(&tablet_path);
+    bdestroy(records);
+    bdestroy(path);
+    bdestroy(tmp_path);
+    return 0;
+
+error:
+    if(iterator) leveldb_iter_destroy(iterator);
+    if(records_iterator) leveldb_iter_destroy(records_iterator);
+    sky_segment_writer_free(writer);
+    sky_tablet_path_uninit(&tablet_path);
+    bdestroy(records);
+    bdestroy(path);
+    bdestroy(tmp_path);
+    return -1;
+}
+
+
+//--------------------------------------
+// Migration
+//--------------------------------------
+
+// Creates the key that stores the version of the tablet's key format.
+//
+// Returns the key.
+static bstring sky_tablet_format_key()
+{
+    struct tagbstring empty = bsStatic("");
+    return sky_tablet_key_create(&empty, SKY_TABLET_KEY_TYPE_META, 1);
+}
+
+// Moves a path stored under its bare object id into chunks. The tail
+// summary, path summary and checkpoints are built from the path's events.
+//
+// tablet      - The tablet.
+// object_id   - The object identifier, which is also the old key.
+// data        - The path data.
+// data_length - The length of the path data, in bytes.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_migrate_path(sky_tablet *tablet, bstring object_id,
+                                   void *data, size_t data_length)
+{
+    int rc;
+    sky_timestamp_t chunk_ts = 0;
+    sky_tablet_tail tail; memset(&tail, 0, sizeof(tail));
+    sky_tablet_summary summary; memset(&summary, 0, sizeof(summary));
+
+    if(data_length > 0) {
+        rc = sky_tablet_put_chunks(tablet, object_id, data, data_length, NULL, &chunk_ts);
+        check(rc == 0, "Unable to write chunks");
+        rc = sky_tablet_rebuild_apply(tablet, object_id, &tail, &summary, data, data_length);
+        check(rc == 0, "Unable to apply path");
+
+        tail.chunk_ts = chunk_ts;
+        summary.has_chunk_ts = true;
+        summary.chunk_ts = chunk_ts;
+        rc = sky_tablet_put_tail(tablet, &tail, object_id);
+        check(rc == 0, "Unable to write tail summary");
+        rc = sky_tablet_put_summary(tablet, &summary, object_id);
+        check(rc == 0, "Unable to write path summary");
+    }
+
+    rc = sky_tablet_batch_put(tablet, object_id, NULL, 0);
+    check(rc == 0, "Unable to delete old path");
+
+    sky_tablet_tail_uninit(&tail);
+    return 0;
+
+error:
+    sky_tablet_tail_uninit(&tail);
+    return -1;
+}
+
+// Rewrites the paths that were stored under their bare object id before
+// paths were split into chunks. Old keys are the ones that don't parse as
+// chunked keys, which holds as long as object ids don't contain null bytes.
+// The key format version is recorded afterward so the tablet is only
+// scanned once.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_migrate(sky_tablet *tablet)
+{
+    int rc;
+    char *errptr = NULL;
+    char *value = NULL;
+    bstring key = NULL;
+    bstring object_id = NULL;
+    leveldb_iterator_t *iterator = NULL;
+    assert(tablet != NULL);
+    assert(tablet->batch == NULL);
+
+    // Skip tablets that are already in the current format.
+    uint32_t version = 0;
+    size_t value_length;
+    key = sky_tablet_format_key(); check_mem(key);
+    value = leveldb_get(tablet->leveldb_db, tablet->readoptions, bdata(key), blength(key), &value_length, &errptr);
+    check(errptr == NULL, "LevelDB get error: %s", errptr);
+    if(value != NULL) {
+        check(value_length == sizeof(version), "Invalid tablet format version");
+        memcpy(&version, value, sizeof(version));
+    }
+    free(value);
+    value = NULL;
+    if(version >= SKY_TABLET_FORMAT_VERSION) {
+        bdestroy(key);
+        return 0;
+    }
+
+    rc = sky_tablet_begin_batch(tablet);
+    check(rc == 0, "Unable to begin batch");
+
+    uint32_t count = 0;
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    for(leveldb_iter_seek_to_first(iterator); leveldb_iter_valid(iterator); leveldb_iter_next(iterator)) {
+        size_t key_length;
+        const char *found_key = leveldb_iter_key(iterator, &key_length);
+        if(sky_tablet_key_parse(found_key, key_length, NULL, NULL, NULL) == 0) {
+            continue;
+        }
+
+        // The iterator reads from a snapshot so the batch can be flushed
+        // as the paths are moved.
+        object_id = blk2bstr(found_key, key_length); check_mem(object_id);
+        const char *data = leveldb_iter_value(iterator, &value_length);
+        rc = sky_tablet_migrate_path(tablet, object_id, (void*)data, value_length);
+        check(rc == 0, "Unable to migrate path: %s", bdata(object_id));
+        bdestroy(object_id);
+        object_id = NULL;
+
+        if(++count % SKY_TABLET_MIGRATE_BATCH_SIZE == 0) {
+            rc = sky_tablet_flush_batch(tablet);
+            check(rc == 0, "Unable to flush batch");
+        }
+    }
+    leveldb_iter_destroy(iterator);
+    iterator = NULL;
+
+    rc = sky_tablet_end_batch(tablet);
+    check(rc == 0, "Unable to end batch");
+
+    // Record the format once the paths are synced.
+    version = SKY_TABLET_FORMAT_VERSION;
+    leveldb_put(tablet->leveldb_db, tablet->sync_writeoptions, bdata(key), blength(key), (char*)&version, sizeof(version), &errptr);
+    check(errptr == NULL, "LevelDB write error: %s", errptr);
+
+    if(count > 0) {
+        log_info("Migrated %u paths to chunks: %s", count, bdata(tablet->path));
+    }
+
+    bdestroy(key);
+    return 0;
+
+error:
+    if(errptr) leveldb_free(errptr);
+    if(iterator) leveldb_iter_destroy(iterator);
+    if(tablet->batch) sky_tablet_discard_batch(tablet);
+    free(value);
+    bdestroy(object_id);
+    bdestroy(key);
+    return -1;
+}
+
+
+//--------------------------------------
+// Splitting
+//--------------------------------------
+
+// Compares two split candidates for sorting.
+static int sky_tablet_split_key_cmp(const void *a, const void *b)
+{
+    return bstrcmp(*((bstring*)a), *((bstring*)b));
+}
+
+// Appends object ids that are evenly spaced between two object ids to a list
+// of split candidates. The ids are interpolated from the eight bytes that
+// follow the common prefix of the two ids. Null bytes are not allowed in a
+// candidate because they would sort before the key suffix of a shorter id.
+//
+// first        - The first object id.
+// first_length - The length of the first object id.
+// last         - The last object id.
+// last_length  - The length of the last object id.
+// count        - The number of ranges to split into.
+// candidates   - The candidate array to append to.
+// candidate_count - A pointer to the number of candidates in the array.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_interpolate_split_keys(const char *first,
+                                             size_t first_length,
+                                             const char *last,
+                                             size_t last_length,
+                                             uint32_t count,
+                                             bstring *candidates,
+                                             uint32_t *candidate_count)
+{
+    size_t i, prefix_length = 0;
+    while(prefix_length < first_length && prefix_length < last_length && first[prefix_length] == last[prefix_length]) {
+        prefix_length++;
+    }
+
+    uint64_t a = 0, b = 0;
+    for(i=0; i<8; i++) {
+        a = (a << 8) | (prefix_length+i < first_length ? (uint8_t)first[prefix_length+i] : 0);
+        b = (b << 8) | (prefix_length+i < last_length ? (uint8_t)last[prefix_length+i] : 0);
+    }
+    if(b <= a) {
+        return 0;
+    }
+
+    uint64_t step = (b - a) / count;
+    uint32_t j;
+    for(j=1; j<count && step > 0; j++) {
+        uint64_t value = a + (step * j);
+        char buffer[8];
+        size_t length = 8;
+        for(i=0; i<8; i++) {
+            buffer[i] = (char)((value >> (56 - (i*8))) & 0xFF);
+        }
+        while(length > 0 && buffer[length-1] == 0) {
+            length--;
+        }
+        for(i=0; i<length; i++) {
+            if(buffer[i] == 0) buffer[i] = 1;
+        }
+
+        bstring candidate = blk2bstr(first, prefix_length); check_mem(candidate);
+        candidates[(*candidate_count)++] = candidate;
+        check(bcatblk(candidate, buffer, length) == BSTR_OK, "Unable to build split key");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Finds object ids that split the tablet into ranges of roughly equal size.
+// Candidate split points are taken from evenly spaced segment entries and
+// from ids interpolated between the first and last LevelDB keys. Each
+// candidate range is weighed by the bytes its segment entries hold plus the
+// approximate size that LevelDB reports for it, and neighbouring ranges are
+// merged until they reach the target size.
+//
+// Data that is still in the LevelDB memtable is not counted so small tablets
+// are usually not split.
+//
+// tablet    - The tablet.
+// max_count - The maximum number of ranges to split into.
+// min_size  - The minimum number of bytes in a range.
+// keys      - A pointer to where the array of split keys should be returned.
+//             Each key is the inclusive start of a range. The array and
+//             keys are owned by the caller.
+// count     - A pointer to where the number of split keys is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_get_split_keys(sky_tablet *tablet, uint32_t max_count,
+                              size_t min_size, bstring **keys,
+                              uint32_t *count)
+{
+    int rc;
+    uint32_t i;
+    bstring first = NULL;
+    bstring limit = NULL;
+    bstring *candidates = NULL;
+    uint32_t candidate_count = 0;
+    uint64_t *sizes = NULL;
+    const char **start_keys = NULL;
+    const char **limit_keys = NULL;
+    size_t *start_lengths = NULL;
+    size_t *limit_lengths = NULL;
+    leveldb_iterator_t *iterator = NULL;
+    assert(tablet != NULL);
+    assert(keys != NULL);
+    assert(count != NULL);
+
+    *keys = NULL;
+    *count = 0;
+    if(max_count < 2) {
+        return 0;
+    }
+
+    // Find the first and last object keys in LevelDB.
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    for(leveldb_iter_seek_to_first(iterator); leveldb_iter_valid(iterator); leveldb_iter_next(iterator)) {
+        size_t key_length, object_id_length;
+        const char *key = leveldb_iter_key(iterator, &key_length);
+        rc = sky_tablet_key_parse(key, key_length, &object_id_length, NULL, NULL);
+        check(rc == 0, "Invalid tablet key");
+        if(object_id_length > 0) {
+            first = blk2bstr(key, object_id_length); check_mem(first);
+            break;
+        }
+    }
+    if(first != NULL) {
+        size_t key_length;
+        leveldb_iter_seek_to_last(iterator);
+        const char *key = leveldb_iter_key(iterator, &key_length);
+        limit = blk2bstr(key, key_length); check_mem(limit);
+        check(bconchar(limit, (char)0xFF) == BSTR_OK, "Unable to build limit key");
+    }
+    leveldb_iter_destroy(iterator);
+    iterator = NULL;
+
+    // Collect candidate split keys from both sources.
+    uint32_t candidate_ranges = max_count * SKY_TABLET_SPLIT_CANDIDATES_PER_RANGE;
+    candidates = calloc((candidate_ranges * 2), sizeof(*candidates)); check_mem(candidates);
+    sky_segment *segment = tablet->segment;
+    if(segment->entry_count > 1) {
+        for(i=1; i<candidate_ranges; i++) {
+            sky_segment_entry *entry = &segment->entries[(segment->entry_count * i) / candidate_ranges];
+            candidates[candidate_count] = blk2bstr(sky_segment_get_object_id(segment, entry), entry->object_id_length);
+            check_mem(candidates[candidate_count]);
+            candidate_count++;
+        }
+    }
+    if(first != NULL) {
+        size_t object_id_length;
+        rc = sky_tablet_key_parse(bdata(limit), blength(limit)-1, &object_id_length, NULL, NULL);
+        check(rc == 0, "Invalid tablet key");
+        rc = sky_tablet_interpolate_split_keys(bdata(first), blength(first), bdata(limit), object_id_length, candidate_ranges, candidates, &candidate_count);
+        check(rc == 0, "Unable to interpolate split keys");
+    }
+
+    // Sort the candidates and remove duplicates.
+    qsort(candidates, candidate_count, sizeof(*candidates), sky_tablet_split_key_cmp);
+    uint32_t unique_count = 0;
+    for(i=0; i<candidate_count; i++) {
+        bstring candidate = candidates[i];
+        candidates[i] = NULL;
+        if(blength(candidate) == 0 || (unique_count > 0 && biseq(candidate, candidates[unique_count-1]))) {
+            bdestroy(candidate);
+        }
+        else {
+            candidates[unique_count++] = candidate;
+        }
+    }
+    candidate_count = unique_count;
+
+    // Weigh each candidate range. The ranges are bounded by the candidates
+    // so there is one more range than there are candidates.
+    uint32_t range_count = candidate_count + 1;
+    sizes = calloc(range_count, sizeof(*sizes)); check_mem(sizes);
+    if(first != NULL) {
+        start_keys = calloc(range_count, sizeof(*start_keys)); check_mem(start_keys);
+        limit_keys = calloc(range_count, sizeof(*limit_keys)); check_mem(limit_keys);
+        start_lengths = calloc(range_count, sizeof(*start_lengths)); check_mem(start_lengths);
+        limit_lengths = calloc(range_count, sizeof(*limit_lengths)); check_mem(limit_lengths);
+        for(i=0; i<range_count; i++) {
+            start_keys[i] = (i > 0 ? bdata(candidates[i-1]) : "");
+            start_lengths[i] = (i > 0 ? (size_t)blength(candidates[i-1]) : 0);
+            limit_keys[i] = (i < candidate_count ? bdata(candidates[i]) : bdata(limit));
+            limit_lengths[i] = (size_t)(i < candidate_count ? blength(candidates[i]) : blength(limit));
+        }
+        leveldb_approximate_sizes(tablet->leveldb_db, (int)range_count, start_keys, start_lengths, limit_keys, limit_lengths, sizes);
+    }
+
+    uint64_t total = 0;
+    uint64_t segment_index = 0;
+    for(i=0; i<range_count; i++) {
+        uint64_t end_index = segment->entry_count;
+        if(i < candidate_count) {
+            end_index = sky_segment_lower_bound(segment, bdata(candidates[i]), blength(candidates[i]));
+        }
+        for(; segment_index < end_index; segment_index++) {
+            sizes[i] += segment->entries[segment_index].data_length + segment->entries[segment_index].records_length;
+        }
+        total += sizes[i];
+    }
+
+    // Merge neighbouring ranges until they reach the target size.
+    if(total > 0 && total >= min_size * 2) {
+        uint64_t target = total / max_count;
+        if(target < min_size) {
+            target = min_size;
+        }
+
+        *keys = calloc(max_count - 1, sizeof(**keys)); check_mem(*keys);
+        uint64_t size = 0;
+        for(i=0; i<candidate_count && *count < max_count-1; i++) {
+            size += sizes[i];
+            if(size >= target) {
+                (*keys)[(*count)++] = candidates[i];
+                candidates[i] = NULL;
+                size = 0;
+            }
+        }
+    }
+
+    for(i=0; i<candidate_count; i++) {
+        bdestroy(candidates[i]);
+    }
+    free(candidates);
+    free(sizes);
+    free(start_keys);
+    free(limit_keys);
+    free(start_lengths);
+    free(limit_lengths);
+    bdestroy(first);
+    bdestroy(limit);
+    return 0;
+
+error:
+    if(*keys) {
+        for(i=0; i<*count; i++) {
+            bdestroy((*keys)[i]);
+        }
+        free(*keys);
+    }
+    *keys = NULL;
+    *count = 0;
+    if(candidates) {
+        for(i=0; i<candidate_count; i++) {
+            bdestroy(candidates[i]);
+        }
+    }
+    free(candidates);
+    free(sizes);
+    free(start_keys);
+    free(limit_keys);
+    free(start_lengths);
+    free(limit_lengths);
+    bdestroy(first);
+    bdestroy(limit);
+    if(iterator) leveldb_iter_destroy(iterator);
+    return -1;
+}
+
+
+//--------------------------------------
+// Resharding
+//--------------------------------------
+
+// Retrieves the identifiers of the objects in the tablet that sort after a
+// given identifier. Objects are found in both LevelDB and the segment.
+//
+// tablet     - The tablet.
+// after      - The object identifier to start after or null to start from
+//              the first object.
+// max_count  - The maximum number of identifiers to return.
+// object_ids - A pointer to where the array of identifiers should be
+//              returned. The array and identifiers are owned by the caller.
+// count      - A pointer to where the number of identifiers should be
+//              returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_get_object_ids(sky_tablet *tablet, bstring after,
+                              uint32_t max_count, bstring **object_ids,
+                              uint32_t *count)
+{
+    int rc;
+    bstring key = NULL;
+    leveldb_iterator_t *iterator = NULL;
+    assert(tablet != NULL);
+    assert(object_ids != NULL);
+    assert(count != NULL);
+
+    *object_ids = NULL;
+    *count = 0;
+    if(max_count == 0) {
+        return 0;
+    }
+    *object_ids = calloc(max_count, sizeof(**object_ids)); check_mem(*object_ids);
+
+    // Position both sources after the starting object.
+    sky_segment *segment = tablet->segment;
+    uint64_t segment_index = 0;
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    if(after != NULL) {
+        key = sky_tablet_key_create(after, UINT8_MAX, INT64_MAX); check_mem(key);
+        leveldb_iter_seek(iterator, bdata(key), blength(key));
+        segment_index = sky_segment_upper_bound(segment, bdatae(after, ""), blength(after));
+    }
+    else {
+        leveldb_iter_seek_to_first(iterator);
+    }
+
+    // Merge the object ids from both sources in order.
+    while(*count < max_count) {
+        const char *object_id = NULL;
+        size_t object_id_length = 0;
+        bool from_leveldb = false;
+
+        // Skip metadata keys which have an empty object id.
+        while(leveldb_iter_valid(iterator)) {
+            size_t key_length;
+            const char *found_key = leveldb_iter_key(iterator, &key_length);
+            rc = sky_tablet_key_parse(found_key, key_length, &object_id_length, NULL, NULL);
+            check(rc == 0, "Invalid tablet key");
+            if(object_id_length > 0) {
+                object_id = found_key;
+                from_leveldb = true;
+                break;
+            }
+            leveldb_iter_next(iterator);
+        }
+
+        // Use the segment entry if it sorts first.
+        if(segment_index < segment->entry_count) {
+            sky_segment_entry *entry = &segment->entries[segment_index];
+            int cmp = (object_id != NULL ? sky_segment_compare(segment, entry, object_id, object_id_length) : -1);
+            if(cmp <= 0) {
+                object_id = sky_segment_get_object_id(segment, entry);
+                object_id_length = entry->object_id_length;
+                from_leveldb = (cmp == 0);
+                segment_index++;
+            }
+            else {
+                from_leveldb = true;
+            }
+        }
+        if(object_id == NULL) {
+            break;
+        }
+
+        (*object_ids)[*count] = blk2bstr(object_id, object_id_length);
+        check_mem((*object_ids)[*count]);
+        (*count)++;
+
+        // Move LevelDB past all keys for the object.
+        if(from_leveldb) {
+            bstring last_key = sky_tablet_key_create((*object_ids)[*count-1], UINT8_MAX, INT64_MAX);
+            check_mem(last_key);
+            leveldb_iter_seek(iterator, bdata(last_key), blength(last_key));
+            bdestroy(last_key);
+        }
+    }
+
+    leveldb_iter_destroy(iterator);
+    bdestroy(key);
+    return 0;
+
+error:
+    if(iterator) leveldb_iter_destroy(iterator);
+    bdestroy(key);
+    if(*object_ids != NULL) {
+        uint32_t i;
+        for(i=0; i<*count; i++) {
+            bdestroy((*object_ids)[i]);
+        }
+        free(*object_ids);
+    }
+    *object_ids = NULL;
+    *count = 0;
+    return -1;
+}
+
+// Copies the full path, tail summary, path summary and checkpoints of an
+// object into another tablet.
+// Any data that the target already holds for the object is replaced. The
+// target is written directly so it can be written to from multiple threads
+// as long as each object is only copied by one thread.
+//
+// tablet    - The tablet to copy from.
+// object_id - The object identifier.
+// target    - The tablet to copy to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_copy_object(sky_tablet *tablet, bstring object_id,
+                           sky_tablet *target)
+{
+    int rc;
+    char *errptr = NULL;
+    void *data = NULL;
+    size_t data_length = 0;
+    char *tail = NULL;
+    size_t tail_length = 0;
+    char *summary = NULL;
+    size_t summary_length = 0;
+    bstring key = NULL;
+    leveldb_iterator_t *iterator = NULL;
+    leveldb_writebatch_t *writebatch = NULL;
+    assert(tablet != NULL);
+    assert(object_id != NULL);
+    assert(target != NULL);
+
+    bool in_segment;
+    rc = sky_tablet_get_path(tablet, object_id, &data, &data_length);
+    check(rc == 0, "Unable to retrieve path");
+    rc = sky_tablet_get_object_value(tablet, object_id, SKY_TABLET_KEY_TYPE_TAIL, 0, &tail, &tail_length, &in_segment);
+    check(rc == 0, "Unable to retrieve tail summary");
+    rc = sky_tablet_get_object_value(tablet, object_id, SKY_TABLET_KEY_TYPE_SUMMARY, 0, &summary, &summary_length, NULL);
+    check(rc == 0, "Unable to retrieve path summary");
+
+    writebatch = leveldb_writebatch_create(); check_mem(writebatch);
+
+    // Remove any existing keys for the object on the target.
+    key = sky_tablet_key_create(object_id, 0, INT64_MIN); check_mem(key);
+    iterator = leveldb_create_iterator(target->leveldb_db, target->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+    for(leveldb_iter_seek(iterator, bdata(key), blength(key)); leveldb_iter_valid(iterator); leveldb_iter_next(iterator)) {
+        size_t key_length, object_id_length;
+        const char *found_key = leveldb_iter_key(iterator, &key_length);
+        rc = sky_tablet_key_parse(found_key, key_length, &object_id_length, NULL, NULL);
+        if(rc != 0 || object_id_length != (size_t)blength(object_id) || memcmp(found_key, bdatae(object_id, ""), object_id_length) != 0) {
+            break;
+        }
+        leveldb_writebatch_delete(writebatch, found_key, key_length);
+    }
+    leveldb_iter_destroy(iterator);
+    iterator = NULL;
+
+    // Write the path and the summaries. The path may be split into chunks
+    // differently on the target so the summaries are pointed at the
+    // target's last chunk.
+    sky_timestamp_t chunk_ts = 0;
+    if(data_length > 0) {
+        rc = sky_tablet_put_chunks(target, object_id, data, data_length, writebatch, &chunk_ts);
+        check(rc == 0, "Unable to write chunks");
+    }
+    if(tail != NULL) {
+        check(tail_length >= sizeof(sky_timestamp_t) * 2, "Invalid tail summary");
+        if(data_length > 0) {
+            memcpy(tail + sizeof(sky_timestamp_t), &chunk_ts, sizeof(chunk_ts));
+        }
+        bdestroy(key);
+        key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_TAIL, 0);
+        check_mem(key);
+        leveldb_writebatch_put(writebatch, bdata(key), blength(key), tail, tail_length);
+    }
+    if(summary != NULL) {
+        sky_tablet_summary path_summary;
+        char value[SKY_TABLET_SUMMARY_LENGTH];
+        rc = sky_tablet_summary_unpack(&path_summary, summary, summary_length);
+        check(rc == 0, "Unable to unpack path summary");
+        path_summary.has_chunk_ts = true;
+        path_summary.chunk_ts = chunk_ts;
+        sky_tablet_summary_pack(&path_summary, value);
+
+        bdestroy(key);
+        key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_SUMMARY, 0);
+        check_mem(key);
+        leveldb_writebatch_put(writebatch, bdata(key), blength(key), value, sizeof(value));
+    }
+
+    // Copy the checkpoints as-is since they don't depend on the chunks.
+    // Compacted objects hold them in the segment's records.
+    if(in_segment) {
+        sky_segment_entry *entry = sky_segment_find(tablet->segment, bdatae(object_id, ""), blength(object_id));
+        check(entry != NULL, "Object not found in segment");
+        void *ptr = sky_segment_get_records(tablet->segment, entry);
+        void *endptr = ptr + entry->records_length;
+        while(ptr < endptr) {
+            size_t sz;
+            sky_segment_record record;
+            rc = sky_segment_record_unpack(&record, ptr, endptr - ptr, &sz);
+            check(rc == 0, "Unable to unpack segment record");
+            ptr += sz;
+            if(record.type == SKY_TABLET_KEY_TYPE_CHECKPOINT) {
+                bdestroy(key);
+                key = sky_tablet_key_create(object_id, record.type, record.ts);
+                check_mem(key);
+                leveldb_writebatch_put(writebatch, bdata(key), blength(key), record.value, record.value_length);
+            }
+        }
+    }
+    else {
+        bdestroy(key);
+        key = sky_tablet_key_create(object_id, SKY_TABLET_KEY_TYPE_CHECKPOINT, INT64_MIN);
+        check_mem(key);
+        iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+        check(iterator != NULL, "Unable to create LevelDB iterator");
+        for(leveldb_iter_seek(iterator, bdata(key), blength(key)); leveldb_iter_valid(iterator); leveldb_iter_next(iterator)) {
+            uint8_t key_type;
+            size_t key_length, value_length, object_id_length;
+            const char *found_key = leveldb_iter_key(iterator, &key_length);
+            rc = sky_tablet_key_parse(found_key, key_length, &object_id_length, &key_type, NULL);
+            if(rc != 0 || key_type != SKY_TABLET_KEY_TYPE_CHECKPOINT || object_id_length != (size_t)blength(object_id) || memcmp(found_key, bdatae(object_id, ""), object_id_length) != 0) {
+                break;
+            }
+            const char *value = leveldb_iter_value(iterator, &value_length);
+            leveldb_writebatch_put(writebatch, found_key, key_length, value, value_length);
+        }
+        leveldb_iter_destroy(iterator);
+        iterator = NULL;
+    }
+
+    leveldb_write(target->leveldb_db, target->writeoptions, writebatch, &errptr);
+    check(errptr == NULL, "LevelDB write error: %s", errptr);
+
+    leveldb_writebatch_destroy(writebatch);
+    bdestroy(key);
+    free(data);
+    free(tail);
+    free(summary);
+    return 0;
+
+error:
+    if(errptr) leveldb_free(errptr);
+    if(iterator) leveldb_iter_destroy(iterator);
+    if(writebatch) leveldb_writebatch_destroy(writebatch);
+    bdestroy(key);
+    free(data);
+    free(tail);
+    free(summary);
+    return -1;
+}
+
+// Syncs all previous writes to the tablet's log to disk.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_sync(sky_tablet *tablet)
+{
+    char *errptr = NULL;
+    leveldb_writebatch_t *writebatch = NULL;
+    assert(tablet != NULL);
+
+    writebatch = leveldb_writebatch_create(); check_mem(writebatch);
+    leveldb_write(tablet->leveldb_db, tablet->sync_writeoptions, writebatch, &errptr);
+    check(errptr == NULL, "LevelDB write error: %s", errptr);
+
+    leveldb_writebatch_destroy(writebatch);
+    return 0;
+
+error:
+    if(errptr) leveldb_free(errptr);
+    if(writebatch) leveldb_writebatch_destroy(writebatch);
+    return -1;
+}
+
+// Syncs the tablet's log if the tablet is in interval mode, has writes that
+// have not been synced and the sync interval has elapsed since its last sync.
+// This is safe to call from a thread other than the tablet's servlet.
+//
+// tablet - The tablet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_sync_if_due(sky_tablet *tablet)
+{
+    int rc;
+    assert(tablet != NULL);
+
+    if(tablet->durability != SKY_TABLET_DURABILITY_INTERVAL) {
+        return 0;
+    }
+    int64_t now = sky_tablet_now();
+    if(now - __atomic_load_n(&tablet->last_sync_time, __ATOMIC_SEQ_CST) < tablet->sync_interval) {
+        return 0;
+    }
+
+    // Writes that finish after the flag is cleared set it again so they are
+    // synced on a later call.
+    if(!__atomic_exchange_n(&tablet->unsynced, false, __ATOMIC_SEQ_CST)) {
+        return 0;
+    }
+    __atomic_store_n(&tablet->last_sync_time, now, __ATOMIC_SEQ_CST);
+    rc = sky_tablet_sync(tablet);
+    if(rc != 0) {
+        __atomic_store_n(&tablet->unsynced, true, __ATOMIC_SEQ_CST);
+    }
+    check(rc == 0, "Unable to sync tablet");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Records that an object was written while changes are being tracked.
+//
+// tablet    - The tablet.
+// object_id - The object identifier.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_add_change(sky_tablet *tablet, bstring object_id)
+{
+    // Skip consecutive writes to the same object.
+    uint32_t count = tablet->changed_object_id_count;
+    if(count > 0 && biseq(tablet->changed_object_ids[count-1], object_id) == 1) {
+        return 0;
+    }
+
+    tablet->changed_object_ids = realloc(tablet->changed_object_ids, (count + 1) * sizeof(*tablet->changed_object_ids));
+    check_mem(tablet->changed_object_ids);
+    tablet->changed_object_ids[count] = bstrcpy(object_id);
+    check_mem(tablet->changed_object_ids[count]);
+    tablet->changed_object_id_count++;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Stops tracking changes and frees the list of changed objects.
+//
+// tablet - The tablet.
+//
+// Returns nothing.
+void sky_tablet_clear_changes(sky_tablet *tablet)
+{
+    assert(tablet != NULL);
+
+    uint32_t i;
+    for(i=0; i<tablet->changed_object_id_count; i++) {
+        bdestroy(tablet->changed_object_ids[i]);
+    }
+    free(tablet->changed_object_ids);
+    tablet->changed_object_ids = NULL;
+    tablet->changed_object_id_count = 0;
+    tablet->track_changes = false;
+}
+
+
+//--------------------------------------
+// Event Management
+//--------------------------------------
+
+// Finds an event boundary near the middle of a chunk where it can be split.
+// Chunks are only split between events with different timestamps so that
+// the minimum timestamp of each chunk remains unique.
+//
+// data        - The chunk data.
+// data_length - The length of the chunk data, in bytes.
+// split_ts    - A pointer to where the timestamp of the event at the split
+//               offset is returned.
+//
+// Returns the split offset or zero if the chunk cannot be split.
+static size_t sky_tablet_find_split_offset(void *data, size_t data_length,
+                                           sky_timestamp_t *split_ts)
+{
+    size_t split_offset = 0;
+    size_t middle = data_length / 2;
+    sky_timestamp_t prev_ts = 0;
+
+    void *ptr = data;
+    while(ptr < data + data_length) {
+        size_t offset = ptr - data;
+        sky_timestamp_t ts = sky_event_get_raw_ts(ptr, prev_ts);
+        if(offset > 0 && ts > prev_ts) {
+            size_t distance = (offset > middle ? offset - middle : middle - offset);
+            size_t best_distance = (split_offset > middle ? split_offset - middle : middle - split_offset);
+            if(split_offset == 0 || distance < best_distance) {
+                split_offset = offset;
+                *split_ts = ts;
+            }
+            else if(offset > middle) {
+                break;
+            }
+        }
+        prev_ts = ts;
+        ptr += sky_event_sizeof_raw(ptr);
+    }
+
+    return split_offset;
+}
+
+// Checks if event data matches the object state for the same property.
+// Properties that have never been set are compared against the zero value
+// of their type to match the object state that the cursor produces.
+//
+// data  - The event data.
+// state - The current object state for the property or null if unset.
+//
+// Returns true if the data is redundant, otherwise returns false.
+static bool sky_tablet_data_equals(sky_event_data *data, sky_event_data *state)
+{
+    if(state != NULL && state->data_type != data->data_type) {
+        return false;
+    }
+
+    switch(data->data_type) {
+        case SKY_DATA_TYPE_STRING: {
+            bstring value = (state != NULL ? state->string_value : NULL);
+            return blength(data->string_value) == blength(value) &&
+                memcmp(bdatae(data->string_value, ""), bdatae(value, ""), blength(value)) == 0;
+        }
+        case SKY_DATA_TYPE_INT:
+            return data->int_value == (state != NULL ? state->int_value : 0);
+        case SKY_DATA_TYPE_DOUBLE:
+            return data->double_value == (state != NULL ? state->double_value : 0);
+        case SKY_DATA_TYPE_BOOLEAN:
+            return data->boolean_value == (state != NULL ? state->boolean_value : false);
+        default:
+            return false;
+    }
+}
+
+// Finds the first event in a block of raw events whose timestamp is at or
+// after a given timestamp.
+//
+// data        - A pointer to the start of the raw events.
+// data_length - The number of bytes of raw events.
+// ts          - The shifted timestamp.
+// prev_ts     - A pointer to the timestamp of the event before the block.
+//               It is updated to the timestamp of the event before the
+//               returned offset.
+//
+// Returns the offset of the event or the data length if there is none.
+static size_t sky_tablet_find_ts_offset(void *data, size_t data_length,
+                                        sky_timestamp_t ts,
+                                        sky_timestamp_t *prev_ts)
+{
+    size_t offset = 0;
+    while(offset < data_length) {
+        sky_timestamp_t event_ts = sky_event_get_raw_ts(data + offset, *prev_ts);
+        if(event_ts >= ts) {
+            break;
+        }
+        *prev_ts = event_ts;
+        offset += sky_event_sizeof_raw(data + offset);
+    }
+    return offset;
+}
+
+// Replays a chunk onto the tail summary and checkpoint counts of a path that
+// is being rebuilt from a checkpoint. Events before the checkpoint are
+// already held by it so only their headers are read.
+//
+// tablet      - The tablet.
+// object_id   - The object identifier.
+// tail        - The tail summary.
+// counts      - The path summary that counts the rebuilt events.
+// start_ts    - The shifted timestamp of the checkpoint.
+// data        - The chunk data.
+// data_length - The length of the chunk data, in bytes.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_replay_chunk(sky_tablet *tablet, bstring object_id,
+                                   sky_tablet_tail *tail,
+                                   sky_tablet_summary *counts,
+                                   sky_timestamp_t start_ts, void *data,
+                                   size_t data_length)
+{
+    size_t offset = sky_tablet_find_ts_offset(data, data_length, start_ts, &tail->ts);
+    return sky_tablet_rebuild_apply(tablet, object_id, tail, counts, data + offset, data_length - offset);
+}
+
+// Merges an event into an object's path at its timestamp. The chunk that
+// the event falls into is found by seeking to its key and only that chunk
+// is rewritten. If the chunk grows beyond the tablet's maximum chunk size
+// then it is split in two.
+//
+// The checkpoints at or before the event are unaffected. The path is
+// replayed from the latest of them to rebuild the tail summary and the
+// later checkpoints, and the path summary is extended with the event. Paths
+// written before summaries were kept are replayed from the start instead
+// and gain a summary. The chunks are read directly from LevelDB so the
+// batch must be flushed and LevelDB must hold the full path.
+//
+// tablet - The tablet.
+// event  - The event to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_merge_event(sky_tablet *tablet, sky_event *event)
+{
+    int rc;
+    void *chunk_data = NULL;
+    void *new_data = NULL;
+    bstring old_key = NULL;
+    leveldb_iterator_t *iterator = NULL;
+    sky_tablet_tail tail; memset(&tail, 0, sizeof(tail));
+    sky_tablet_summary summary; memset(&summary, 0, sizeof(summary));
+    sky_tablet_summary counts; memset(&counts, 0, sizeof(counts));
+    sky_tablet_checkpoint checkpoint; memset(&checkpoint, 0, sizeof(checkpoint));
+    assert(tablet != NULL);
+    assert(event != NULL);
+
+    sky_timestamp_t event_ts = sky_timestamp_shift(event->timestamp);
+    iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    check(iterator != NULL, "Unable to create LevelDB iterator");
+
+    // Find the chunk that the event falls into. Events that fall between two
+    // chunks are appended to the earlier chunk unless they share the later
+    // chunk's minimum timestamp. Events before the first chunk are prepended
+    // to it.
+    bool found;
+    size_t chunk_length = 0;
+    sky_timestamp_t chunk_ts = 0;
+    rc = sky_tablet_iter_seek_chunk(iterator, event->object_id, event_ts, &found);
+    check(rc == 0, "Unable to seek to chunk");
+    bool has_chunk = sky_tablet_iter_on_chunk(iterator, event->object_id, &chunk_ts);
+    if(has_chunk) {
+        const char *value = leveldb_iter_value(iterator, &chunk_length);
+        chunk_data = malloc(chunk_length > 0 ? chunk_length : 1); check_mem(chunk_data);
+        memcpy(chunk_data, value, chunk_length);
+    }
+
+    // Start from the latest checkpoint at or before the event.
+    bool has_summary, has_checkpoint = false;
+    rc = sky_tablet_get_summary(tablet, event->object_id, &summary, &has_summary);
+    check(rc == 0, "Unable to retrieve path summary");
+    if(has_summary) {
+        rc = sky_tablet_iter_read_checkpoint(iterator, event->object_id, event_ts, &checkpoint, &has_checkpoint);
+        check(rc == 0, "Unable to retrieve checkpoint");
+    }
+    sky_timestamp_t start_ts = (has_checkpoint ? checkpoint.ts : INT64_MIN);
+    if(has_checkpoint) {
+        rc = sky_tablet_checkpoint_restore(&checkpoint, &tail);
+        check(rc == 0, "Unable to restore checkpoint");
+        counts.event_count = checkpoint.event_index;
+        counts.checkpoint_event_count = checkpoint.event_index;
+    }
+
+    // Replay the chunks from the checkpoint up to the event's chunk.
+    sky_timestamp_t ts;
+    rc = sky_tablet_iter_seek_chunk(iterator, event->object_id, start_ts, &found);
+    check(rc == 0, "Unable to seek to chunk");
+    while(has_chunk && sky_tablet_iter_on_chunk(iterator, event->object_id, &ts) && ts < chunk_ts) {
+        size_t value_length;
+        void *value = (void*)leveldb_iter_value(iterator, &value_length);
+        rc = sky_tablet_replay_chunk(tablet, event->object_id, &tail, &counts, start_ts, value, value_length);
+        check(rc == 0, "Unable to replay chunk");
+        leveldb_iter_next(iterator);
+    }
+
+    // Replay the event's chunk up to the insertion point so the tail holds
+    // the object state before the event.
+    size_t offset = 0;
+    if(has_chunk) {
+        size_t start = sky_tablet_find_ts_offset(chunk_data, chunk_length, start_ts, &tail.ts);
+        sky_timestamp_t prev_ts = tail.ts;
+        offset = start + sky_tablet_find_ts_offset(chunk_data + start, chunk_length - start, event_ts, &prev_ts);
+        rc = sky_tablet_rebuild_apply(tablet, event->object_id, &tail, &counts, chunk_data + start, offset - start);
+        check(rc == 0, "Unable to replay chunk");
+    }
+
+    // Clear off any object data on the event that matches the object state
+    // at the insertion point.
+    uint32_t i;
+    for(i=0; i<event->data_count; i++) {
+        if(event->data[i]->key > 0) {
+            sky_event_data *state = sky_tablet_tail_get_data(&tail, event->data[i]->key);
+            if(sky_tablet_data_equals(event->data[i], state)) {
+                sky_event_data_free(event->data[i]);
+                if(i < event->data_count - 1) {
+                    memmove(&event->data[i], &event->data[i+1], (event->data_count-i-1) * sizeof(*event->data));
+                }
+                i--;
+                event->data_count--;
+            }
+        }
+    }
+
+    // If the event is completely redundant (e.g. it is a data-only event and
+    // the event matches the current object state) then it should be ignored.
+    if(sky_event_sizeof(event) > 0) {
+        // The event is delta encoded against the event before it in the
+        // chunk.
+        sky_timestamp_t *prev_ts_ptr = (offset > 0 ? &tail.ts : NULL);
+        size_t event_length = sky_event_sizeof_v2(event, prev_ts_ptr);
+
+        // Splice the event into a copy of the chunk. The event after the
+        // insertion point is re-encoded against the new event.
+        size_t event_sz;
+        new_data = calloc(1, chunk_length + event_length + SKY_EVENT_V2_MAX_HEADER_LENGTH); check_mem(new_data);
+        if(offset > 0) {
+            memmove(new_data, chunk_data, offset);
+        }
+        rc = sky_event_pack_v2(event, prev_ts_ptr, new_data + offset, &event_sz);
+        check(rc == 0, "Unable to pack event");
+        check(event_sz == event_length, "Expected event size (%ld) does not match actual event size (%ld)", event_length, event_sz);
+        size_t new_data_length = offset + event_length;
+        if(offset < chunk_length) {
+            void *next_ptr = chunk_data + offset;
+            size_t next_length = sky_event_sizeof_raw(next_ptr);
+            sky_timestamp_t next_ts = sky_event_get_raw_ts(next_ptr, tail.ts);
+            rc = sky_event_rebase_raw(next_ptr, next_ts, &event_ts, new_data + new_data_length, &event_sz);
+            check(rc == 0, "Unable to re-encode event");
+            new_data_length += event_sz;
+            memmove(new_data + new_data_length, next_ptr + next_length, chunk_length - offset - next_length);
+            new_data_length += chunk_length - offset - next_length;
+        }
+
+        // Remove the old chunk key if the chunk's minimum timestamp changed.
+        sky_timestamp_t min_ts = (offset == 0 ? event_ts : chunk_ts);
+        if(has_chunk && chunk_ts != min_ts) {
+            old_key = sky_tablet_key_create(event->object_id, SKY_TABLET_KEY_TYPE_CHUNK, chunk_ts);
+            check_mem(old_key);
+            rc = sky_tablet_batch_put(tablet, old_key, NULL, 0);
+            check(rc == 0, "Unable to delete chunk");
+        }
+
+        // Split the chunk if it has grown too large.
+        size_t split_offset = 0;
+        sky_timestamp_t split_ts = 0;
+        if(new_data_length > tablet->max_chunk_size) {
+            split_offset = sky_tablet_find_split_offset(new_data, new_data_length, &split_ts);
+        }
+
+        if(split_offset > 0) {
+            rc = sky_tablet_put_chunk(tablet, event->object_id, min_ts, new_data, split_offset, NULL);
+            check(rc == 0, "Unable to write chunk");
+            rc = sky_tablet_put_chunk(tablet, event->object_id, split_ts, new_data+split_offset, new_data_length-split_offset, NULL);
+            check(rc == 0, "Unable to write chunk");
+        }
+        else {
+            rc = sky_tablet_put_chunk(tablet, event->object_id, min_ts, new_data, new_data_length, NULL);
+            check(rc == 0, "Unable to write chunk");
+        }
+
+        // Rewrite the checkpoints after the event while replaying the rest
+        // of the path from the insertion point.
+        rc = sky_tablet_delete_checkpoints(tablet, event->object_id, (has_summary ? event_ts + 1 : INT64_MIN));
+        check(rc == 0, "Unable to delete checkpoints");
+        rc = sky_tablet_rebuild_apply(tablet, event->object_id, &tail, &counts, new_data + offset, new_data_length - offset);
+        check(rc == 0, "Unable to apply chunk");
+
+        sky_timestamp_t last_chunk_ts = (split_offset > 0 ? split_ts : min_ts);
+        if(has_chunk) {
+            leveldb_iter_next(iterator);
+            while(sky_tablet_iter_on_chunk(iterator, event->object_id, &ts)) {
+                size_t value_length;
+                void *value = (void*)leveldb_iter_value(iterator, &value_length);
+                rc = sky_tablet_rebuild_apply(tablet, event->object_id, &tail, &counts, value, value_length);
+                check(rc == 0, "Unable to apply chunk");
+                last_chunk_ts = ts;
+                leveldb_iter_next(iterator);
+            }
+        }
+
+        // Extend the path summary with the event. Paths without a summary
+        // take the one counted from the start of the path.
+        if(has_summary) {
+            sky_tablet_summary_add(&summary, event_ts, event->action_id);
+            summary.checkpoint_event_count = counts.checkpoint_event_count;
+        }
+        else {
+            summary = counts;
+        }
+        tail.chunk_ts = last_chunk_ts;
+        summary.has_chunk_ts = true;
+        summary.chunk_ts = last_chunk_ts;
+        rc = sky_tablet_put_tail(tablet, &tail, event->object_id);
+        check(rc == 0, "Unable to write tail summary");
+        rc = sky_tablet_put_summary(tablet, &summary, event->object_id);
+        check(rc == 0, "Unable to write path summary");
+    }
+
+    // New objects don't require a scan so they count as appends.
+    if(has_chunk) {
+        __atomic_add_fetch(&tablet->stats.merge_count, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_add_fetch(&tablet->stats.append_count, 1, __ATOMIC_RELAXED);
+    }
+
+    bdestroy(old_key);
+    leveldb_iter_destroy(iterator);
+    sky_tablet_checkpoint_uninit(&checkpoint);
+    sky_tablet_tail_uninit(&tail);
+    free(chunk_data);
+    free(new_data);
+    return 0;
+
+error:
+    bdestroy(old_key);
+    if(iterator) leveldb_iter_destroy(iterator);
+    sky_tablet_checkpoint_uninit(&checkpoint);
+    sky_tablet_tail_uninit(&tail);
+    free(chunk_data);
+    free(new_data);
+    return -1;
+}
+
+// Appends an event to the end of an object's path using its tail summary.
+// The event is added to the last chunk, or starts a new chunk if the last
+// chunk is full, so the existing path never needs to be scanned. The path
+// summary is extended with the event and a checkpoint is added before it
+// when one is due.
+//
+// tablet - The tablet.
+// event  - The event to add.
+// tail   - The tail summary of the object's path.
+// is_new - A flag stating if the object has no existing path.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_append_event(sky_tablet *tablet, sky_event *event,
+                                   sky_tablet_tail *tail, bool is_new)
+{
+    int rc;
+    bool found;
+    sky_tablet_summary summary;
+    char *chunk_data = NULL;
+    bstring key = NULL;
+    sky_event_data *data = NULL;
+    sky_timestamp_t event_ts = sky_timestamp_shift(event->timestamp);
+
+    // Clear off any object data on the event that matches the current state
+    // at the end of the path.
+    uint32_t i;
+    for(i=0; i<event->data_count; i++) {
+        if(event->data[i]->key > 0) {
+            sky_event_data *state = sky_tablet_tail_get_data(tail, event->data[i]->key);
+            if(sky_tablet_data_equals(event->data[i], state)) {
+                sky_event_data_free(event->data[i]);
+                if(i < event->data_count - 1) {
+                    memmove(&event->data[i], &event->data[i+1], (event->data_count-i-1) * sizeof(*event->data));
+                }
+                i--;
+                event->data_count--;
+            }
+        }
+    }
+
+    // Ignore the event if it is completely redundant.
+    if(sky_event_sizeof(event) > 0) {
+        // Retrieve the last chunk on the path.
+        size_t chunk_length = 0;
+        key = sky_tablet_key_create(event->object_id, SKY_TABLET_KEY_TYPE_CHUNK, tail->chunk_ts);
+        check_mem(key);
+        rc = sky_tablet_get(tablet, key, &chunk_data, &chunk_length);
+        check(rc == 0, "Unable to retrieve chunk");
+
+        // The event is delta encoded against the last event on the path
+        // unless it starts a new chunk.
+        sky_timestamp_t *prev_ts = &tail->ts;
+        size_t event_length = sky_event_sizeof_v2(event, prev_ts);
+
+        // Start a new chunk if the last chunk is full.
+        if(chunk_data == NULL || chunk_length + event_length > tablet->max_chunk_size) {
+            free(chunk_data);
+            chunk_data = NULL;
+            chunk_length = 0;
+            prev_ts = NULL;
+            event_length = sky_event_sizeof_v2(event, prev_ts);
+            tail->chunk_ts = event_ts;
+            bdestroy(key);
+            key = sky_tablet_key_create(event->object_id, SKY_TABLET_KEY_TYPE_CHUNK, event_ts);
+            check_mem(key);
+        }
+
+        // Append the event to the chunk in the buffer that it was read into.
+        size_t event_sz;
+        void *new_data = realloc(chunk_data, chunk_length + event_length);
+        check_mem(new_data);
+        chunk_data = new_data;
+        rc = sky_event_pack_v2(event, prev_ts, chunk_data + chunk_length, &event_sz);
+        check(rc == 0, "Unable to pack event");
+        check(event_sz == event_length, "Expected event size (%ld) does not match actual event size (%ld)", event_length, event_sz);
+
+        // Existing paths without a summary are left without one since their
+        // events are unknown here. Checkpoints are only kept for paths with
+        // a summary and hold the state from before the event.
+        rc = sky_tablet_get_summary(tablet, event->object_id, &summary, &found);
+        check(rc == 0, "Unable to retrieve path summary");
+        if(found || is_new) {
+            rc = sky_tablet_put_due_checkpoint(tablet, event->object_id, tail, &summary, event_ts);
+            check(rc == 0, "Unable to write checkpoint");
+            sky_tablet_summary_add(&summary, event_ts, event->action_id);
+            summary.has_chunk_ts = true;
+            summary.chunk_ts = tail->chunk_ts;
+            rc = sky_tablet_put_summary(tablet, &summary, event->object_id);
+            check(rc == 0, "Unable to write path summary");
+        }
+
+        // Carry the event's object data forward into the tail summary.
+        tail->ts = event_ts;
+        for(i=0; i<event->data_count; i++) {
+            if(event->data[i]->key > 0) {
+                rc = sky_event_data_copy(event->data[i], &data);
+                check(rc == 0, "Unable to copy event data");
+                rc = sky_tablet_tail_set_data(tail, data);
+                data = NULL;
+                check(rc == 0, "Unable to set tail state");
+            }
+        }
+
+        // Write the chunk and the tail summary together.
+        rc = sky_tablet_batch_put_owned(tablet, key, chunk_data, chunk_length + event_length);
+        chunk_data = NULL;
+        check(rc == 0, "Unable to write chunk");
+        rc = sky_tablet_put_tail(tablet, tail, event->object_id);
+        check(rc == 0, "Unable to write tail summary");
+    }
+
+    __atomic_add_fetch(&tablet->stats.append_count, 1, __ATOMIC_RELAXED);
+
+    bdestroy(key);
+    free(chunk_data);
+    return 0;
+
+error:
+    sky_event_data_free(data);
+    bdestroy(key);
+    free(chunk_data);
+    return -1;
+}
+
+// Copies the records of an object that has been compacted back into the
+// tablet's current batch so that LevelDB holds all of the object's records
+// again once the object is written to.
+//
+// tablet    - The tablet.
+// object_id - The object identifier.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_tablet_put_segment_records(sky_tablet *tablet,
+                                          bstring object_id)
+{
+    int rc;
+    bstring key = NULL;
+    assert(tablet != NULL);
+    assert(object_id != NULL);
+
+    sky_segment_entry *entry = sky_segment_find(tablet->segment, bdatae(object_id, ""), blength(object_id));
+    check(entry != NULL, "Object not found in segment");
+
+    void *ptr = sky_segment_get_records(tablet->segment, entry);
+    void *endptr = ptr + entry->records_length;
+    while(ptr < endptr) {
+        size_t sz;
+        sky_segment_record record;
+        rc = sky_segment_record_unpack(&record, ptr, endptr - ptr, &sz);
+        check(rc == 0, "Unable to unpack segment record");
+        ptr += sz;
+
+        key = sky_tablet_key_create(object_id, record.type, record.ts);
+        check_mem(key);
+        rc = sky_tablet_batch_put(tablet, key, (void*)record.value, record.value_length);
+        check(rc == 0, "Unable to write segment record");
+        bdestroy(key);
+        key = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(key);
+    return -1;
+}
+
+// Adds an event to the tablet. Events that are newer than the end of the
+// object's path are appended using the path's tail summary. All other events
+// are merged into the chunk that they fall into.
+//
+// If a batch has been started on the tablet then the writes are held until
+// the batch is flushed. Otherwise the event is written immediately.
+//
+// tablet - The tablet.
+// event  - The event to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tablet_add_event(sky_tablet *tablet, sky_event *event)
+{
+    int rc;
+    bool found;
+    bool owns_batch = false;
+    sky_tablet_tail tail; memset(&tail, 0, sizeof(tail));
+    assert(tablet != NULL);
+    assert(event != NULL);
+
+    // Make sure that this event is being added to the correct tablet.
+    sky_tablet *target_tablet = NULL;
+    rc = sky_table_get_target_tablet(tablet->table, event->object_id, &target_tablet);
+    check(rc == 0, "Unable to determine target tablet");
+    check(tablet == target_tablet, "Event added to invalid tablet; IDX:%d of %d", tablet->index, tablet->table->tablet_count);
+
+    // Write the event by itself if no batch has been started.
+    if(tablet->batch == NULL) {
+        rc = sky_tablet_begin_batch(tablet);
+        check(rc == 0, "Unable to begin batch");
+        owns_batch = true;
+    }
+
+    // Retrieve the tail summary of the path. Compacted objects have their
+    // records copied back into LevelDB before they are written to.
+    bool in_segment;
+    rc = sky_tablet_read_tail(tablet, event->object_id, &tail, &found, &in_segment);
+    check(rc == 0, "Unable to retrieve tail summary");
+    if(in_segment) {
+        rc = sky_tablet_put_segment_records(tablet, event->object_id);
+        check(rc == 0, "Unable to restore segment records");
+    }
+
+    // New objects have no existing path so they are appended as well.
+    if(!found || sky_timestamp_shift(event->timestamp) > tail.ts) {
+        rc = sky_tablet_append_event(tablet, event, &tail, !found);
+        check(rc == 0, "Unable to append event");
+    }
+    else {
+        // Merges read the path directly from LevelDB so it must hold the
+        // full path and all pending writes must be committed first.
+        rc = sky_tablet_flush_batch(tablet);
+        check(rc == 0, "Unable to flush batch");
+        rc = sky_tablet_copy_segment_path(tablet, event->object_id);
+        check(rc == 0, "Unable to copy segment path");
+        rc = sky_tablet_merge_event(tablet, event);
+        check(rc == 0, "Unable to merge event");
+    }
+
+    if(owns_batch) {
+        owns_batch = false;
+        rc = sky_tablet_end_batch(tablet);
+        check(rc == 0, "Unable to end batch");
+    }
+
+    // Record the object so it can be copied again after a reshard.
+    if(tablet->track_changes) {
+        rc = sky_tablet_add_change(tablet, event->object_id);
+        check(rc == 0, "Unable to track change");
+    }
+
+    sky_tablet_tail_uninit(&tail);
+    return 0;
+
+error:
+    if(owns_batch) sky_tablet_discard_batch(tablet);
+    sky_tablet_tail_uninit(&tail);
     return -1;
 }
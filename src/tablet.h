@@ -7,10 +7,92 @@
 #include <leveldb/c.h>
 
 typedef struct sky_tablet sky_tablet;
+typedef struct sky_tablet_stats sky_tablet_stats;
+typedef struct sky_tablet_batch sky_tablet_batch;
 
 #include "bstring.h"
 #include "table.h"
 #include "event.h"
+#include "segment.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The default maximum number of bytes stored in a single path chunk before
+// the chunk is split in two.
+#define SKY_DEFAULT_MAX_CHUNK_SIZE  65536
+
+// The number of bytes appended to an object identifier to form a LevelDB key.
+// The suffix is a null separator, a key type and a big-endian timestamp.
+#define SKY_TABLET_KEY_SUFFIX_LENGTH 10
+
+// The key type for the summary of an object's whole path. It sorts before
+// the object's chunks so scans can read it before deciding to read them.
+#define SKY_TABLET_KEY_TYPE_SUMMARY 0
+
+// The key type for a chunk of an object's path.
+#define SKY_TABLET_KEY_TYPE_CHUNK   1
+
+// The key type for the summary of the end of an object's path.
+#define SKY_TABLET_KEY_TYPE_TAIL    2
+
+// The key type for tablet metadata. Metadata is stored under an empty
+// object identifier.
+#define SKY_TABLET_KEY_TYPE_META    3
+
+// The key type for a checkpoint of the object state partway along an
+// object's path. Checkpoints sort after the object's other keys in
+// timestamp order so they can be found with a single seek.
+#define SKY_TABLET_KEY_TYPE_CHECKPOINT 4
+
+// The version of the tablet's key format. Tablets without a version store
+// each path under its bare object id and are migrated when they are opened.
+#define SKY_TABLET_FORMAT_VERSION 1
+
+// The number of paths that are moved into chunks per write while a tablet
+// is migrated.
+#define SKY_TABLET_MIGRATE_BATCH_SIZE 1000
+
+// The file name of the compacted segment within the tablet directory.
+#define SKY_TABLET_SEGMENT_FILENAME "segment"
+
+// Writes are not synced to disk. A process crash loses nothing but a
+// machine crash can lose recent writes.
+#define SKY_TABLET_DURABILITY_ASYNC     0
+
+// Every write is synced to disk before it is acknowledged.
+#define SKY_TABLET_DURABILITY_SYNC      1
+
+// Writes are synced to disk at most once per sync interval. A write is
+// synced along with the next write after the interval has elapsed and the
+// server syncs tablets that have stopped receiving writes so no write waits
+// much longer than the interval.
+#define SKY_TABLET_DURABILITY_INTERVAL  2
+
+// The default number of milliseconds between syncs in interval mode.
+#define SKY_DEFAULT_SYNC_INTERVAL       1000
+
+// The number of candidate split points considered for each range when a
+// tablet is split into key ranges.
+#define SKY_TABLET_SPLIT_CANDIDATES_PER_RANGE 4
+
+// The number of bytes in the action bitset of a path summary. Action ids
+// are folded into the bitset so larger ids can share a bit.
+#define SKY_TABLET_SUMMARY_ACTION_BYTES 32
+
+// The number of bytes in a packed path summary.
+#define SKY_TABLET_SUMMARY_LENGTH ((sizeof(sky_timestamp_t) * 3) + (sizeof(uint64_t) * 2) + SKY_TABLET_SUMMARY_ACTION_BYTES)
+
+// The number of bytes in a packed path summary that was written before
+// summaries held the minimum timestamp of the last chunk.
+#define SKY_TABLET_SUMMARY_V1_LENGTH ((sizeof(sky_timestamp_t) * 2) + (sizeof(uint64_t) * 2) + SKY_TABLET_SUMMARY_ACTION_BYTES)
+
+// The minimum number of events between the checkpoints on a path.
+#define SKY_TABLET_CHECKPOINT_INTERVAL 1024
 
 
 //==============================================================================
@@ -19,16 +101,167 @@ typedef struct sky_tablet sky_tablet;
 //
 //==============================================================================
 
+// Counters for how events are written to a tablet. The counters are only
+// updated and read with atomic operations since the tablet's servlet
+// updates them while other threads sum them.
+struct sky_tablet_stats {
+    uint64_t append_count;
+    uint64_t merge_count;
+    uint64_t write_count;
+};
+
+// A pending write to a key within a tablet batch. A null value marks a
+// deleted key. The saved flag is set once the entry's value as of the
+// batch's savepoint has been recorded.
+typedef struct sky_tablet_batch_entry {
+    bstring key;
+    void *value;
+    size_t value_length;
+    bool saved;
+} sky_tablet_batch_entry;
+
+// The value that a batch entry held when the batch's savepoint was taken.
+typedef struct sky_tablet_batch_undo {
+    uint32_t index;
+    void *value;
+    size_t value_length;
+} sky_tablet_batch_undo;
+
+// A set of pending writes that are held in memory and then committed to
+// LevelDB as a single write. The index is an open-addressed hash table of
+// one-based entry positions.
+//
+// A savepoint marks the number of entries in the batch and the undo log
+// keeps the replaced values of those entries so that the writes made after
+// the savepoint can be rolled back. Flushing the batch moves the savepoint
+// to the flush.
+struct sky_tablet_batch {
+    sky_tablet_batch_entry *entries;
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+    uint32_t *index;
+    uint32_t index_capacity;
+    bool has_savepoint;
+    uint32_t savepoint_count;
+    sky_tablet_batch_undo *undos;
+    uint32_t undo_count;
+    uint32_t undo_capacity;
+};
+
 // The tablet is a reference to the disk location where data is stored.
+//
+// Each object's path is split into one or more chunks which are stored
+// under the key "<object_id>\0<type><min_timestamp>" so that inserting an
+// event only rewrites the chunk that it falls into.
+//
+// Compaction moves all chunks into an immutable segment file. Chunks written
+// afterward only hold events newer than the segment's copy of the path
+// unless the path has been copied back into LevelDB to merge an older event.
+// In that case the chunks hold the full path and the segment copy is
+// ignored. The tail summary, path summary and checkpoints move into the
+// segment's records as well. They are copied back into LevelDB the next time
+// an event is added to the object so LevelDB holds either all or none of an
+// object's records.
 struct sky_tablet {
     sky_table *table;
     leveldb_t *leveldb_db;
+    leveldb_filterpolicy_t *filter_policy;
+    sky_segment *segment;
     uint32_t index;
     bstring path;
+    size_t max_chunk_size;
+    sky_tablet_stats stats;
+    sky_tablet_batch *batch;
+    int durability;
+    int64_t sync_interval;
+    int64_t last_sync_time;
+    bool unsynced;
     leveldb_readoptions_t* readoptions;
     leveldb_writeoptions_t* writeoptions;
+    leveldb_writeoptions_t* sync_writeoptions;
+    bool track_changes;
+    bstring *changed_object_ids;
+    uint32_t changed_object_id_count;
 };
 
+// A reference to a single stored chunk within a stitched path.
+typedef struct sky_tablet_chunk {
+    sky_timestamp_t min_timestamp;
+    size_t offset;
+    size_t length;
+} sky_tablet_chunk;
+
+// The object state partway along an object's path. The state holds the
+// object data set by every event before the first event at the checkpoint's
+// timestamp and is packed the same way as event data. Checkpoints are only
+// placed between events with different timestamps so they don't depend on
+// how the path is split into chunks.
+typedef struct sky_tablet_checkpoint {
+    sky_timestamp_t ts;
+    sky_timestamp_t prev_ts;
+    uint64_t event_index;
+    void *state;
+    size_t state_length;
+    size_t state_capacity;
+} sky_tablet_checkpoint;
+
+// A full object path that has been stitched together from its chunks. The
+// buffers are reused when the same path is read multiple times. If a seek
+// timestamp is set then the latest checkpoint at or before it is kept too.
+//
+// If in_place is set then a path held in a single chunk is not copied into
+// the buffer. Its data points at the chunk's value and the LevelDB iterator
+// is held on the chunk until the path is released. Only paths whose summary
+// shows that the first chunk is also the last are read in place. The
+// checkpoint of a held path is read separately so checkpoint_pending is set
+// when one may be at or before the seek timestamp.
+typedef struct sky_tablet_path {
+    bstring object_id;
+    void *data;
+    size_t data_length;
+    void *buffer;
+    size_t buffer_capacity;
+    sky_tablet_chunk *chunks;
+    uint32_t chunk_count;
+    uint32_t chunk_capacity;
+    bool seek;
+    sky_timestamp_t seek_ts;
+    bool has_checkpoint;
+    bool checkpoint_pending;
+    sky_tablet_checkpoint checkpoint;
+    bool in_place;
+    bool held;
+    leveldb_iterator_t *iterator;
+} sky_tablet_path;
+
+// A summary of the end of an object's path. This holds the timestamp of the
+// last event, the minimum timestamp of the last chunk and the object state
+// after the last event so that newer events can be appended without
+// scanning the path.
+typedef struct sky_tablet_tail {
+    sky_timestamp_t ts;
+    sky_timestamp_t chunk_ts;
+    sky_event_data **data;
+    uint32_t data_count;
+} sky_tablet_tail;
+
+// A summary of an object's whole path. This holds the range of the event
+// timestamps, the number of events and a bitset of the actions performed so
+// that scans can skip paths that cannot match without reading them. The
+// summary covers the segment's copy of the path as well as the chunks. It
+// also holds the number of events before the path's last checkpoint and the
+// minimum timestamp of the last chunk, which summaries written by older
+// versions don't have.
+typedef struct sky_tablet_summary {
+    sky_timestamp_t min_ts;
+    sky_timestamp_t max_ts;
+    uint64_t event_count;
+    uint64_t checkpoint_event_count;
+    uint8_t actions[SKY_TABLET_SUMMARY_ACTION_BYTES];
+    bool has_chunk_ts;
+    sky_timestamp_t chunk_ts;
+} sky_tablet_summary;
+
 
 //==============================================================================
 //
@@ -62,12 +295,138 @@ int sky_tablet_close(sky_tablet *tablet);
 
 
 //--------------------------------------
-// Event Management
+// Keys
+//--------------------------------------
+
+bstring sky_tablet_key_create(bstring object_id, uint8_t key_type,
+    sky_timestamp_t timestamp);
+
+int sky_tablet_key_parse(const char *key, size_t key_length,
+    size_t *object_id_length, uint8_t *key_type, sky_timestamp_t *timestamp);
+
+
+//--------------------------------------
+// Path Management
 //--------------------------------------
 
 int sky_tablet_get_path(sky_tablet *tablet, bstring object_id,
     void **data, size_t *data_length);
 
+int sky_tablet_path_read(sky_tablet_path *path,
+    leveldb_iterator_t *iterator);
+
+int sky_tablet_path_skip(sky_tablet_path *path,
+    leveldb_iterator_t *iterator);
+
+int sky_tablet_path_release(sky_tablet_path *path,
+    leveldb_iterator_t *iterator);
+
+void sky_tablet_path_uninit(sky_tablet_path *path);
+
+int sky_tablet_path_apply_segment(sky_tablet *tablet, sky_tablet_path *path,
+    sky_segment_entry *entry, void **data, size_t *data_length);
+
+int sky_tablet_get_tail(sky_tablet *tablet, bstring object_id,
+    sky_tablet_tail *tail, bool *found);
+
+void sky_tablet_tail_uninit(sky_tablet_tail *tail);
+
+
+//--------------------------------------
+// Path Summary
+//--------------------------------------
+
+int sky_tablet_get_summary(sky_tablet *tablet, bstring object_id,
+    sky_tablet_summary *summary, bool *found);
+
+void sky_tablet_summary_add(sky_tablet_summary *summary, sky_timestamp_t ts,
+    sky_action_id_t action_id);
+
+void sky_tablet_summary_set_action(uint8_t *actions, sky_action_id_t action_id);
+
+bool sky_tablet_summary_has_any_action(sky_tablet_summary *summary,
+    uint8_t *actions);
+
+int sky_tablet_summary_unpack(sky_tablet_summary *summary, const void *ptr,
+    size_t length);
+
+
+//--------------------------------------
+// Checkpoints
+//--------------------------------------
+
+int sky_tablet_get_checkpoint(sky_tablet *tablet, bstring object_id,
+    sky_timestamp_t ts, sky_tablet_checkpoint *checkpoint, bool *found);
+
+int sky_tablet_path_read_checkpoint(sky_tablet_path *path,
+    leveldb_iterator_t *iterator);
+
+int sky_tablet_path_read_segment_checkpoint(sky_tablet *tablet,
+    sky_tablet_path *path, sky_segment_entry *entry);
+
+int sky_tablet_checkpoint_unpack(sky_tablet_checkpoint *checkpoint,
+    sky_timestamp_t ts, const void *ptr, size_t length);
+
+void sky_tablet_checkpoint_uninit(sky_tablet_checkpoint *checkpoint);
+
+
+//--------------------------------------
+// Object State
+//--------------------------------------
+
+int sky_tablet_get_state(sky_tablet *tablet, bstring object_id,
+    sky_timestamp_t ts, sky_tablet_tail *state, bool *found);
+
+
+//--------------------------------------
+// Write Batch
+//--------------------------------------
+
+int sky_tablet_begin_batch(sky_tablet *tablet);
+
+int sky_tablet_flush_batch(sky_tablet *tablet);
+
+int sky_tablet_end_batch(sky_tablet *tablet);
+
+void sky_tablet_discard_batch(sky_tablet *tablet);
+
+int sky_tablet_save_batch(sky_tablet *tablet);
+
+int sky_tablet_rollback_batch(sky_tablet *tablet);
+
+
+//--------------------------------------
+// Compaction
+//--------------------------------------
+
+int sky_tablet_compact(sky_tablet *tablet);
+
+
+//--------------------------------------
+// Splitting
+//--------------------------------------
+
+int sky_tablet_get_split_keys(sky_tablet *tablet, uint32_t max_count,
+    size_t min_size, bstring **keys, uint32_t *count);
+
+
+//--------------------------------------
+// Resharding
+//--------------------------------------
+
+int sky_tablet_get_object_ids(sky_tablet *tablet, bstring after,
+    uint32_t max_count, bstring **object_ids, uint32_t *count);
+
+int sky_tablet_copy_object(sky_tablet *tablet, bstring object_id,
+    sky_tablet *target);
+
+int sky_tablet_sync(sky_tablet *tablet);
+
+int sky_tablet_sync_if_due(sky_tablet *tablet);
+
+void sky_tablet_clear_changes(sky_tablet *tablet);
+
+
 //--------------------------------------
 // Event Management
 //--------------------------------------
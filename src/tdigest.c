@@ -0,0 +1,375 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "tdigest.h"
+#include "sky_endian.h"
+#include "dbg.h"
+#include "mem.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates an empty digest.
+//
+// Returns a new digest.
+sky_tdigest *sky_tdigest_create()
+{
+    sky_tdigest *digest = NULL;
+    digest = calloc(1, sizeof(sky_tdigest)); check_mem(digest);
+    return digest;
+
+error:
+    sky_tdigest_free(digest);
+    return NULL;
+}
+
+// Frees a digest from memory.
+//
+// digest - The digest.
+//
+// Returns nothing.
+void sky_tdigest_free(sky_tdigest *digest)
+{
+    if(digest) {
+        free(digest);
+    }
+}
+
+
+//--------------------------------------
+// Scale Function
+//--------------------------------------
+
+// Converts a quantile to the scale used to limit centroid sizes. The scale
+// is steepest at the tails so centroids there stay small.
+//
+// q - The quantile.
+//
+// Returns the scale at the quantile.
+static double sky_tdigest_k(double q)
+{
+    return (SKY_TDIGEST_COMPRESSION / (2 * M_PI)) * asin((2 * q) - 1);
+}
+
+// Converts a scale back to a quantile.
+//
+// k - The scale.
+//
+// Returns the quantile at the scale.
+static double sky_tdigest_q(double k)
+{
+    if(k >= SKY_TDIGEST_COMPRESSION / 4.0) return 1;
+    return (sin(k * (2 * M_PI) / SKY_TDIGEST_COMPRESSION) + 1) / 2;
+}
+
+
+//--------------------------------------
+// Sketching
+//--------------------------------------
+
+// Orders centroids by their mean.
+static int sky_tdigest_centroid_cmp(const void *_a, const void *_b)
+{
+    const sky_tdigest_centroid *a = (const sky_tdigest_centroid*)_a;
+    const sky_tdigest_centroid *b = (const sky_tdigest_centroid*)_b;
+    if(a->mean < b->mean) return -1;
+    if(a->mean > b->mean) return 1;
+    return 0;
+}
+
+// Sorts the centroids of a digest and merges neighbors together as long as
+// each merged centroid stays within the size limit of its quantile.
+//
+// digest - The digest.
+//
+// Returns nothing.
+void sky_tdigest_compress(sky_tdigest *digest)
+{
+    uint32_t i;
+    assert(digest != NULL);
+    if(digest->count == digest->merged_count) return;
+
+    sky_tdigest_centroid *centroids = digest->centroids;
+    qsort(centroids, digest->count, sizeof(*centroids), sky_tdigest_centroid_cmp);
+
+    double total = 0;
+    for(i=0; i<digest->count; i++) {
+        total += centroids[i].weight;
+    }
+
+    uint32_t index = 0;
+    double weight_so_far = 0;
+    double limit = total * sky_tdigest_q(sky_tdigest_k(0) + 1);
+    for(i=1; i<digest->count; i++) {
+        sky_tdigest_centroid *current = &centroids[index];
+        if(weight_so_far + current->weight + centroids[i].weight <= limit) {
+            current->weight += centroids[i].weight;
+            current->mean += (centroids[i].mean - current->mean) * centroids[i].weight / current->weight;
+        }
+        else {
+            weight_so_far += current->weight;
+            limit = total * sky_tdigest_q(sky_tdigest_k(weight_so_far / total) + 1);
+            centroids[++index] = centroids[i];
+        }
+    }
+
+    digest->count = digest->merged_count = index + 1;
+}
+
+// Adds a centroid to the digest and compresses the digest when it is full.
+//
+// digest - The digest.
+// mean   - The mean of the centroid.
+// weight - The weight of the centroid.
+//
+// Returns nothing.
+static void sky_tdigest_add_centroid(sky_tdigest *digest, double mean,
+                                     double weight)
+{
+    if(digest->count == SKY_TDIGEST_CAPACITY) {
+        sky_tdigest_compress(digest);
+    }
+    digest->centroids[digest->count].mean = mean;
+    digest->centroids[digest->count].weight = weight;
+    digest->count++;
+}
+
+// Adds a value to the digest.
+//
+// digest - The digest.
+// value  - The value to add.
+// weight - The number of times the value occurred.
+//
+// Returns nothing.
+void sky_tdigest_add(sky_tdigest *digest, double value, double weight)
+{
+    assert(digest != NULL);
+    if(isnan(value) || !(weight > 0)) return;
+
+    if(digest->count == 0 || value < digest->min) digest->min = value;
+    if(digest->count == 0 || value > digest->max) digest->max = value;
+    sky_tdigest_add_centroid(digest, value, weight);
+}
+
+// Merges another digest into a digest.
+//
+// digest - The digest to merge into.
+// other  - The digest to merge from.
+//
+// Returns nothing.
+void sky_tdigest_merge(sky_tdigest *digest, sky_tdigest *other)
+{
+    uint32_t i;
+    assert(digest != NULL);
+    assert(other != NULL);
+    if(other->count == 0) return;
+
+    if(digest->count == 0 || other->min < digest->min) digest->min = other->min;
+    if(digest->count == 0 || other->max > digest->max) digest->max = other->max;
+    for(i=0; i<other->count; i++) {
+        sky_tdigest_add_centroid(digest, other->centroids[i].mean, other->centroids[i].weight);
+    }
+}
+
+// Calculates the total weight of all values added to the digest.
+//
+// digest - The digest.
+//
+// Returns the number of values.
+double sky_tdigest_count(sky_tdigest *digest)
+{
+    uint32_t i;
+    double total = 0;
+    assert(digest != NULL);
+    for(i=0; i<digest->count; i++) {
+        total += digest->centroids[i].weight;
+    }
+    return total;
+}
+
+// Estimates the value at a given quantile. Values between the centers of
+// two centroids are interpolated and the tails are interpolated towards the
+// minimum and maximum values.
+//
+// digest - The digest.
+// q      - The quantile between 0 and 1.
+//
+// Returns the estimated value or NaN if the digest is empty.
+double sky_tdigest_quantile(sky_tdigest *digest, double q)
+{
+    uint32_t i;
+    assert(digest != NULL);
+    if(digest->count == 0) return NAN;
+    if(q <= 0) return digest->min;
+    if(q >= 1) return digest->max;
+
+    sky_tdigest_compress(digest);
+    sky_tdigest_centroid *centroids = digest->centroids;
+    uint32_t count = digest->count;
+    if(count == 1) return centroids[0].mean;
+
+    double total = sky_tdigest_count(digest);
+    double index = q * total;
+
+    // Interpolate between the minimum and the center of the first centroid.
+    if(index < centroids[0].weight / 2) {
+        return digest->min + (index / (centroids[0].weight / 2)) * (centroids[0].mean - digest->min);
+    }
+
+    // Interpolate between the center of the last centroid and the maximum.
+    if(index > total - (centroids[count-1].weight / 2)) {
+        double remaining = total - index;
+        return digest->max - (remaining / (centroids[count-1].weight / 2)) * (digest->max - centroids[count-1].mean);
+    }
+
+    // Interpolate between the centers of neighboring centroids.
+    double weight_so_far = centroids[0].weight / 2;
+    for(i=0; i<count-1; i++) {
+        double delta = (centroids[i].weight + centroids[i+1].weight) / 2;
+        if(weight_so_far + delta >= index) {
+            double t = (index - weight_so_far) / delta;
+            return centroids[i].mean + t * (centroids[i+1].mean - centroids[i].mean);
+        }
+        weight_so_far += delta;
+    }
+
+    return digest->max;
+}
+
+// Retrieves the smallest value added to the digest.
+//
+// digest - The digest.
+//
+// Returns the minimum or NaN if the digest is empty.
+double sky_tdigest_min(sky_tdigest *digest)
+{
+    assert(digest != NULL);
+    return (digest->count > 0 ? digest->min : NAN);
+}
+
+// Retrieves the largest value added to the digest.
+//
+// digest - The digest.
+//
+// Returns the maximum or NaN if the digest is empty.
+double sky_tdigest_max(sky_tdigest *digest)
+{
+    assert(digest != NULL);
+    return (digest->count > 0 ? digest->max : NAN);
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Writes a double to a buffer in big endian order.
+static void sky_tdigest_write_double(char *ptr, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits = htonll(bits);
+    memcpy(ptr, &bits, sizeof(bits));
+}
+
+// Reads a big endian double from a buffer.
+static double sky_tdigest_read_double(const char *ptr)
+{
+    uint64_t bits;
+    double value;
+    memcpy(&bits, ptr, sizeof(bits));
+    bits = ntohll(bits);
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Compresses a digest and packs it into a buffer. The buffer must be able
+// to hold at least SKY_TDIGEST_MAX_PACKED_SZ bytes.
+//
+// digest - The digest.
+// ptr    - The buffer to pack into.
+//
+// Returns the number of bytes written.
+uint32_t sky_tdigest_pack(sky_tdigest *digest, char *ptr)
+{
+    uint32_t i;
+    assert(digest != NULL);
+    assert(ptr != NULL);
+
+    sky_tdigest_compress(digest);
+
+    uint32_t count = htonl(digest->count);
+    memcpy(ptr, SKY_TDIGEST_MAGIC, SKY_TDIGEST_MAGIC_SZ);
+    memcpy(ptr + SKY_TDIGEST_MAGIC_SZ, &count, sizeof(count));
+    sky_tdigest_write_double(ptr + SKY_TDIGEST_MAGIC_SZ + 4, digest->min);
+    sky_tdigest_write_double(ptr + SKY_TDIGEST_MAGIC_SZ + 12, digest->max);
+
+    char *buffer = ptr + SKY_TDIGEST_HEADER_SZ;
+    for(i=0; i<digest->count; i++) {
+        sky_tdigest_write_double(buffer, digest->centroids[i].mean);
+        sky_tdigest_write_double(buffer + 8, digest->centroids[i].weight);
+        buffer += SKY_TDIGEST_CENTROID_SZ;
+    }
+
+    return SKY_TDIGEST_HEADER_SZ + (digest->count * SKY_TDIGEST_CENTROID_SZ);
+}
+
+// Unpacks a digest from a buffer. Any centroids already in the digest are
+// replaced.
+//
+// digest - The digest.
+// ptr    - The packed digest.
+// sz     - The number of bytes in the packed digest.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_tdigest_unpack(sky_tdigest *digest, const char *ptr, uint32_t sz)
+{
+    uint32_t i, count;
+    assert(digest != NULL);
+    assert(ptr != NULL);
+    check(sky_tdigest_is_packed(ptr, sz), "Invalid packed digest");
+
+    memcpy(&count, ptr + SKY_TDIGEST_MAGIC_SZ, sizeof(count));
+    count = ntohl(count);
+    check(count <= SKY_TDIGEST_CAPACITY, "Too many digest centroids: %d", count);
+    check(sz == SKY_TDIGEST_HEADER_SZ + (count * SKY_TDIGEST_CENTROID_SZ), "Invalid packed digest size: %d", sz);
+
+    digest->min = sky_tdigest_read_double(ptr + SKY_TDIGEST_MAGIC_SZ + 4);
+    digest->max = sky_tdigest_read_double(ptr + SKY_TDIGEST_MAGIC_SZ + 12);
+
+    const char *buffer = ptr + SKY_TDIGEST_HEADER_SZ;
+    for(i=0; i<count; i++) {
+        digest->centroids[i].mean = sky_tdigest_read_double(buffer);
+        digest->centroids[i].weight = sky_tdigest_read_double(buffer + 8);
+        buffer += SKY_TDIGEST_CENTROID_SZ;
+    }
+
+    // Packed centroids are always sorted and compressed.
+    digest->count = digest->merged_count = count;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Checks if a buffer holds a packed digest.
+//
+// ptr - The buffer.
+// sz  - The number of bytes in the buffer.
+//
+// Returns true if the buffer starts with a digest header.
+bool sky_tdigest_is_packed(const char *ptr, uint32_t sz)
+{
+    return (ptr != NULL && sz >= SKY_TDIGEST_HEADER_SZ && memcmp(ptr, SKY_TDIGEST_MAGIC, SKY_TDIGEST_MAGIC_SZ) == 0);
+}
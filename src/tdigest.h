@@ -0,0 +1,124 @@
+#ifndef _sky_tdigest_h
+#define _sky_tdigest_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct sky_tdigest sky_tdigest;
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A t-digest estimates quantiles of a stream of numbers using a bounded
+// number of centroids. Each centroid is the mean and weight of a run of
+// nearby values. Centroids near the median can absorb many values while
+// centroids near either tail stay small so that extreme quantiles such as
+// the p99 remain accurate.
+//
+// New values are appended to the centroid list unsorted. When the list is
+// full it is sorted and compressed in a single pass which merges neighbors
+// as long as the merged centroid stays within the size limit for its
+// quantile. Merging two digests works the same way so partial digests from
+// each tablet can be combined in any order.
+//
+// Digests are packed into a binary string that begins with the same unused
+// msgpack byte as other sketches followed by the minimum, the maximum and
+// the centroids in big endian order.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+// The compression of a digest. Larger values keep more centroids.
+#define SKY_TDIGEST_COMPRESSION 200
+
+// The number of centroids that a digest can hold before it compresses.
+#define SKY_TDIGEST_CAPACITY (SKY_TDIGEST_COMPRESSION * 6)
+
+// The magic header at the start of a packed digest.
+#define SKY_TDIGEST_MAGIC "\xC1TDG"
+
+#define SKY_TDIGEST_MAGIC_SZ 4
+
+// The size of the header of a packed digest. This is the magic followed by
+// the centroid count, the minimum and the maximum.
+#define SKY_TDIGEST_HEADER_SZ (SKY_TDIGEST_MAGIC_SZ + 4 + 8 + 8)
+
+// The size of a single packed centroid.
+#define SKY_TDIGEST_CENTROID_SZ 16
+
+// The largest size that a packed digest can be.
+#define SKY_TDIGEST_MAX_PACKED_SZ (SKY_TDIGEST_HEADER_SZ + (SKY_TDIGEST_CAPACITY * SKY_TDIGEST_CENTROID_SZ))
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+typedef struct {
+    double mean;
+    double weight;
+} sky_tdigest_centroid;
+
+struct sky_tdigest {
+    uint32_t count;
+    uint32_t merged_count;
+    double min;
+    double max;
+    sky_tdigest_centroid centroids[SKY_TDIGEST_CAPACITY];
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_tdigest *sky_tdigest_create();
+
+void sky_tdigest_free(sky_tdigest *digest);
+
+//--------------------------------------
+// Sketching
+//--------------------------------------
+
+void sky_tdigest_add(sky_tdigest *digest, double value, double weight);
+
+void sky_tdigest_merge(sky_tdigest *digest, sky_tdigest *other);
+
+void sky_tdigest_compress(sky_tdigest *digest);
+
+double sky_tdigest_count(sky_tdigest *digest);
+
+double sky_tdigest_quantile(sky_tdigest *digest, double q);
+
+double sky_tdigest_min(sky_tdigest *digest);
+
+double sky_tdigest_max(sky_tdigest *digest);
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+uint32_t sky_tdigest_pack(sky_tdigest *digest, char *ptr);
+
+int sky_tdigest_unpack(sky_tdigest *digest, const char *ptr, uint32_t sz);
+
+bool sky_tdigest_is_packed(const char *ptr, uint32_t sz);
+
+#endif
@@ -2,24 +2,37 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/time.h>
-#include <pthread.h>
-#include <zmq.h>
+#include <time.h>
+#include <assert.h>
 
 #include "worker.h"
 #include "worklet.h"
+#include "server.h"
 #include "bstring.h"
-#include "sky_zmq.h"
 #include "dbg.h"
 #include "mem.h"
 
 
 //==============================================================================
 //
-// Forward Declarations
+// Typedefs
 //
 //==============================================================================
 
-void *sky_worker_run(void *_worker);
+// A group of worklets that are mapped together in a single pass over the
+// tablet of a servlet.
+typedef struct sky_worker_group {
+    sky_worklet **worklets;
+    uint32_t count;
+} sky_worker_group;
+
+// An executor task that steals morsels from a scan. The helper maps morsels
+// for a single worker or for every worker of a shared scan's group.
+typedef struct sky_worker_helper {
+    sky_worker *worker;
+    sky_worker_group *group;
+    sky_morsel_scheduler *scheduler;
+} sky_worker_helper;
 
 
 //==============================================================================
@@ -59,67 +72,43 @@ error:
     return NULL;
 }
 
-// Closes and frees the push sockets on the worker.
+// Frees the list of servlets the worker is attached to.
 //
 // worker - The worker.
 //
 // Returns nothing.
-void sky_worker_free_push_sockets(sky_worker *worker)
+void sky_worker_free_servlets(sky_worker *worker)
 {
-    int rc;
     if(worker) {
         uint32_t i;
-        for(i=0; i<worker->push_socket_count; i++) {
-            rc = zmq_close(worker->push_sockets[i]);
-            check(rc == 0, "Unable to close worker push socket: %d", i);
-            worker->push_sockets[i] = NULL;
-        }
-        free(worker->push_sockets);
-        worker->push_sockets = NULL;
-        worker->push_socket_count = 0;
-    }
-
-error:
-    return;
-}
-
-// Closes and frees the pull socket on the worker.
-//
-// worker - The worker.
-//
-// Returns nothing.
-void sky_worker_free_pull_socket(sky_worker *worker)
-{
-    int rc;
-    if(worker) {
-        if(worker->pull_socket) {
-            rc = zmq_close(worker->pull_socket);
-            check(rc == 0, "Unable to close worker pull socket");
-            worker->pull_socket = NULL;
+        for(i=0; i<worker->servlet_count; i++) {
+            worker->servlets[i] = NULL;
         }
-        bdestroy(worker->pull_socket_uri);
-        worker->pull_socket_uri = NULL;
+        free(worker->servlets);
+        worker->servlets = NULL;
+        worker->servlet_count = 0;
     }
-
-error:
-    return;
 }
 
-// Frees the list of servlets the worker is attached to.
+// Frees the morsel scheduler of a worker along with any morsel data that has
+// not been reduced.
 //
 // worker - The worker.
 //
 // Returns nothing.
-void sky_worker_free_servlets(sky_worker *worker)
+static void sky_worker_free_scheduler(sky_worker *worker)
 {
-    if(worker) {
-        uint32_t i;
-        for(i=0; i<worker->servlet_count; i++) {
-            worker->servlets[i] = NULL;
+    if(worker && worker->scheduler) {
+        uint32_t i, j;
+        for(i=0; i<worker->scheduler->set_count; i++) {
+            sky_morsel_set *set = &worker->scheduler->sets[i];
+            for(j=0; j<set->morsel_count; j++) {
+                if(worker->map_free && set->morsels[j].data) worker->map_free(set->morsels[j].data);
+                set->morsels[j].data = NULL;
+            }
         }
-        free(worker->servlets);
-        worker->servlets = NULL;
-        worker->servlet_count = 0;
+        sky_morsel_scheduler_release(worker->scheduler);
+        worker->scheduler = NULL;
     }
 }
 
@@ -132,9 +121,9 @@ void sky_worker_free(sky_worker *worker)
 {
     if(worker) {
         sky_worker_free_servlets(worker);
-        sky_worker_free_push_sockets(worker);
-        sky_worker_free_pull_socket(worker);
-        worker->context = NULL;
+        sky_worker_free_scheduler(worker);
+        worker->pool = NULL;
+        worker->channel = NULL;
         if(worker->input && !worker->multi) fclose(worker->input);
         worker->input = NULL;
         if(worker->output && !worker->multi) fclose(worker->output);
@@ -188,8 +177,9 @@ error:
 // State
 //--------------------------------------
 
-// Starts a worker and opens push/pull sockets to communicate with the
-// servlets.
+// Starts a worker. Workers that are part of a group run serially on the
+// calling thread. Otherwise the worker is queued on the worker pool and is
+// freed by the pool once it finishes.
 //
 // worker - The worker.
 //
@@ -200,66 +190,23 @@ int sky_worker_start(sky_worker *worker)
     check(worker != NULL, "Worker required");
     check(worker->state == SKY_WORKER_STATE_STOPPED, "Cannot start a running worker");
     check(worker->servlet_count > 0, "Worker must be associated with servlets before starting");
+    check(worker->pool != NULL && worker->pool->running, "Worker must be associated with a running pool");
     
-    // Allocate space for sockets.
-    worker->push_socket_count = worker->servlet_count;
-    worker->push_sockets = calloc(worker->push_socket_count, sizeof(*worker->push_sockets));
-    check_mem(worker->push_sockets);
-    
-    // Generate a push socket for each servlet.
-    uint32_t i;
-    for(i=0; i<worker->push_socket_count; i++) {
-        // Create push socket.
-        worker->push_sockets[i] = zmq_socket(worker->context, ZMQ_PUSH);
-        check(worker->push_sockets[i] != NULL, "Unable to create worker push socket");
-        
-        // Connect to servlet.
-        rc = zmq_connect(worker->push_sockets[i], bdata(worker->servlets[i]->uri));
-        check(rc == 0, "Unable to connect worker to servlet");
-    }
-
-    // Create pull socket.
-    worker->pull_socket = zmq_socket(worker->context, ZMQ_PULL);
-    check(worker->pull_socket != NULL, "Unable to create worker pull socket");
-
-    // Bind pull socket.
-    worker->pull_socket_uri = bformat("inproc://worker.%" PRId64 ".pull", worker->id);
-    check_mem(worker->pull_socket_uri);
-    rc = zmq_bind(worker->pull_socket, bdata(worker->pull_socket_uri));
-    check(rc == 0, "Unable to bind worker pull socket");
-
-    // If this worker is part of a group then run it serially.
+    // If this worker is part of a group then run it serially. The worker is
+    // freed by the run even if it fails.
     if(worker->multi) {
-        void *ret = sky_worker_run(worker);
-        check(ret == NULL, "Serial worker failed to execute");
+        worker->channel = worker->pool->serial_channel;
+        sky_worker_run(worker);
     }
-    // Otherwise start the worker as a detached thread.
+    // Otherwise hand the worker to the pool.
     else {
-        // Setup thread attributes.
-        pthread_attr_t attr;
-        rc = pthread_attr_init(&attr);
-        check(rc == 0, "Unable to init thread attributes");
-        rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-        check(rc == 0, "Unable to set thread detach state");
-
-        // Create the worker thread.
-        rc = pthread_create(&worker->thread, NULL, sky_worker_run, worker);
-        check(rc == 0, "Unable to create worker thread");
-
-        // Destory thread attributes.
-        rc = pthread_attr_destroy(&attr);
-        check(rc == 0, "Unable to destroy thread attributes");
-
-        // Detach from the thread.
-        rc = pthread_detach(worker->thread);
-        check(rc == 0, "Unable to detach worker thread");
+        rc = sky_worker_pool_submit(worker->pool, worker);
+        check(rc == 0, "Unable to queue worker");
     }
     
     return 0;
 
 error:
-    sky_worker_free_push_sockets(worker);
-    sky_worker_free_pull_socket(worker);
     return -1;
 }
 
@@ -268,18 +215,20 @@ error:
 // Processing
 //--------------------------------------
 
-// The worker thread function.
+// Runs a worker over the channel it has been assigned. The worker is freed
+// once it finishes, even if one of its servlets was unable to map it.
 //
 // worker - The worker.
 //
-// Returns 0 if successful.
-void *sky_worker_run(void *_worker)
+// Returns 0 if successful, otherwise returns -1.
+int sky_worker_run(sky_worker *worker)
 {
     int rc;
     uint32_t i;
-    sky_worker *worker = (sky_worker*)_worker;
     sky_worklet *worklet = NULL;
     check(worker != NULL, "Worker required");
+    check(worker->channel != NULL, "Worker channel required");
+    sky_worker_channel *channel = worker->channel;
     
     // Start benchmark.
     struct timeval tv;
@@ -292,25 +241,63 @@ void *sky_worker_run(void *_worker)
         check(rc == 0, "Worker unable to read from stream");
     }
 
+    // Scan tablets in morsels if the worker supports it.
+    if(worker->map_morsel != NULL) {
+        worker->scheduler = sky_morsel_scheduler_create(worker->servlet_count);
+        check_mem(worker->scheduler);
+    }
+
     // Push a message to each servlet.
-    for(i=0; i<worker->push_socket_count; i++) {
+    for(i=0; i<worker->servlet_count; i++) {
         worklet = sky_worklet_create(worker); check_mem(worklet);
-        rc = sky_zmq_send_ptr(worker->push_sockets[i], &worklet);
+        worklet->index = i;
+        rc = sky_servlet_push(worker->servlets[i], worklet);
         check(rc == 0, "Worker unable to send worklet");
     }
+    worklet = NULL;
     
-    // Read in one pull message for every push message sent.
-    for(i=0; i<worker->push_socket_count; i++) {
+    // Read in one pull message for every push message sent. Every worklet is
+    // received even if one has failed since the servlets still hold them.
+    bool failed = false;
+    for(i=0; i<worker->servlet_count; i++) {
         // Receive worker back from servlet.
-        rc = sky_zmq_recv_ptr(worker->pull_socket, (void**)&worklet);
+        rc = sky_queue_pop(channel->queue, (void**)&worklet);
         check(rc == 0 && worklet != NULL, "Worker unable to receive worklet");
+        if(worklet->failed) {
+            failed = true;
+        }
         
+        // Send the worklet back to its servlet if it has more work to do.
+        // Other messages queued on the servlet are processed in between.
+        if(!failed && worker->requeue != NULL && worker->requeue(worker, worklet->data)) {
+            rc = sky_servlet_push(worker->servlets[worklet->index], worklet);
+            check(rc == 0, "Worker unable to requeue worklet");
+            worklet = NULL;
+            i--;
+            continue;
+        }
+
         // Reduce worklet.
-        if(worker->reduce != NULL && worklet->data != NULL) {
+        if(!failed && worker->reduce != NULL && worklet->data != NULL) {
             rc = worker->reduce(worker, worklet->data);
             check(rc == 0, "Worker unable to reduce");
         }
 
+        // Reduce the morsels of the worklet's tablet.
+        if(worker->scheduler != NULL) {
+            uint32_t j;
+            sky_morsel_set *set = &worker->scheduler->sets[worklet->index];
+            for(j=0; j<set->morsel_count; j++) {
+                sky_morsel *morsel = &set->morsels[j];
+                if(!failed && worker->reduce != NULL && morsel->data != NULL) {
+                    rc = worker->reduce(worker, morsel->data);
+                    check(rc == 0, "Worker unable to reduce morsel");
+                }
+                if(worker->map_free && morsel->data) worker->map_free(morsel->data);
+                morsel->data = NULL;
+            }
+        }
+
         // Free worklet.
         if(worker->map_free && worklet->data) worker->map_free(worklet->data);
         worklet->data = NULL;
@@ -318,8 +305,12 @@ void *sky_worker_run(void *_worker)
         worklet = NULL;
     }
     
-    // Output data to stream.
-    if(worker->write != NULL) {
+    // Output data to stream. Nothing is written for a failed worker so the
+    // client sees its connection closed instead of partial results.
+    if(failed) {
+        log_err("Worker unable to map tablet");
+    }
+    else if(worker->write != NULL) {
         rc = worker->write(worker, worker->output);
         check(rc == 0, "Worker unable to write output");
     }
@@ -333,9 +324,350 @@ void *sky_worker_run(void *_worker)
     worker->free(worker);
     sky_worker_free(worker);
     
-    return NULL;
+    return (failed ? -1 : 0);
 
 error:
     sky_worker_free(worker);
-    return NULL;
+    return -1;
+}
+
+// Retrieves the current time of the monotonic clock.
+//
+// Returns the number of nanoseconds since an arbitrary point.
+static uint64_t sky_worker_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+// Maps a single morsel and records the time spent against the worker. The
+// context of the calling thread is created before its first morsel.
+//
+// worker  - The worker.
+// servlet - The servlet whose turn is running or null for a helper.
+// morsel  - The morsel.
+// context - A pointer to the context of the calling thread.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_worker_map_morsel(sky_worker *worker, sky_servlet *servlet,
+                                 sky_morsel *morsel, void **context)
+{
+    int rc = 0;
+    uint64_t t0 = sky_worker_now();
+    if(*context == NULL && worker->context_create != NULL) {
+        rc = worker->context_create(worker, servlet, context);
+    }
+    if(rc == 0) {
+        rc = worker->map_morsel(worker, morsel, context, &morsel->data);
+    }
+    __atomic_add_fetch(&worker->service_time, sky_worker_now() - t0, __ATOMIC_RELAXED);
+    return rc;
+}
+
+// Maps a single morsel for every worker of a shared scan's group. The time
+// spent is split evenly between the workers in the group. The context of the
+// calling thread is created by the shared map function on its first morsel.
+//
+// group   - The group.
+// servlet - The servlet whose turn is running or null for a helper.
+// morsel  - The morsel.
+// context - A pointer to the context of the calling thread.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_worker_map_group_morsel(sky_worker_group *group,
+                                       sky_servlet *servlet,
+                                       sky_morsel *morsel, void **context)
+{
+    uint32_t i;
+    uint64_t t0 = sky_worker_now();
+    sky_worker_map_shared_func_t map_shared = group->worklets[0]->worker->map_shared;
+    int rc = map_shared(group->worklets, group->count, servlet, morsel, context, (void***)&morsel->data);
+    uint64_t elapsed = (sky_worker_now() - t0) / group->count;
+    for(i=0; i<group->count; i++) {
+        __atomic_add_fetch(&group->worklets[i]->worker->service_time, elapsed, __ATOMIC_RELAXED);
+    }
+    return rc;
+}
+
+// Steals morsels from a scan on an executor thread until there is nothing
+// left to steal. The worker or group is only accessed while one of its
+// morsels is running because it can be freed as soon as its last morsel has
+// been completed.
+//
+// _helper - The helper.
+//
+// Returns nothing.
+static void sky_worker_help(void *_helper)
+{
+    int rc;
+    void *context = NULL;
+    sky_worker_context_free_func_t context_free = NULL;
+    sky_worker_helper *helper = (sky_worker_helper*)_helper;
+    sky_morsel_scheduler *scheduler = helper->scheduler;
+
+    while(true) {
+        sky_morsel *morsel = NULL;
+        rc = sky_morsel_scheduler_steal(scheduler, &morsel);
+        if(rc != 0 || morsel == NULL) {
+            break;
+        }
+
+        if(helper->group != NULL) {
+            sky_worker_group *group = helper->group;
+            context_free = group->worklets[0]->worker->shared_context_free;
+            rc = sky_worker_map_group_morsel(group, NULL, morsel, &context);
+        }
+        else {
+            sky_worker *worker = helper->worker;
+            context_free = worker->context_free;
+            rc = sky_worker_map_morsel(worker, NULL, morsel, &context);
+        }
+        if(rc != 0) {
+            log_err("Unable to map morsel");
+        }
+        sky_morsel_scheduler_complete(scheduler, morsel);
+    }
+
+    if(context_free && context) context_free(context);
+    sky_morsel_scheduler_remove_helper(scheduler);
+    free(helper);
+}
+
+// Queues helpers on the executor to steal morsels from a scan. Helpers let
+// a scan use every executor thread even if it covers fewer tablets than
+// there are threads.
+//
+// scheduler - The scheduler of the scan.
+// worker    - The worker to map morsels for or null for a group.
+// group     - The group to map morsels for or null for a worker.
+// executor  - The executor to run helpers on.
+// count     - The maximum number of helpers to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+static int sky_worker_add_helpers(sky_morsel_scheduler *scheduler,
+                                  sky_worker *worker, sky_worker_group *group,
+                                  sky_executor *executor, uint32_t count)
+{
+    int rc;
+    uint32_t i;
+    sky_worker_helper *helper = NULL;
+
+    for(i=0; i<count; i++) {
+        if(!sky_morsel_scheduler_add_helper(scheduler, executor->thread_count - 1)) {
+            break;
+        }
+        helper = calloc(1, sizeof(*helper));
+        if(helper == NULL) {
+            sky_morsel_scheduler_remove_helper(scheduler);
+            sentinel("Unable to allocate helper");
+        }
+        helper->worker = worker;
+        helper->group = group;
+        helper->scheduler = scheduler;
+        rc = sky_executor_submit(executor, sky_worker_help, helper);
+        check(rc == 0, "Unable to submit helper");
+        helper = NULL;
+    }
+
+    return 0;
+
+error:
+    if(helper) {
+        sky_morsel_scheduler_remove_helper(helper->scheduler);
+        free(helper);
+    }
+    return -1;
+}
+
+// Maps a worklet against the tablet of the servlet that received it. Workers
+// that scan in morsels publish the tablet's morsels, queue helpers to steal
+// from them and then map morsels until every morsel of the tablet has been
+// completed. Morsels stolen from other tablets are mapped along the way. The
+// output of each morsel is attached to the morsel and reduced once the
+// worklet is returned. The time spent mapping is added to the worker's
+// service time.
+//
+// worker  - The worker.
+// worklet - The worklet.
+// servlet - The servlet that received the worklet.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_worker_map(sky_worker *worker, sky_worklet *worklet,
+                   sky_servlet *servlet)
+{
+    int rc;
+    void *context = NULL;
+    assert(worker != NULL);
+    assert(worklet != NULL);
+    assert(servlet != NULL);
+
+    if(worker->scheduler == NULL) {
+        uint64_t t0 = sky_worker_now();
+        rc = worker->map(worker, servlet->tablet, &worklet->data);
+        __atomic_add_fetch(&worker->service_time, sky_worker_now() - t0, __ATOMIC_RELAXED);
+        return rc;
+    }
+
+    // Split the tablet so that other threads can help scan it.
+    rc = sky_morsel_scheduler_publish(worker->scheduler, worklet->index, servlet->tablet, SKY_MORSEL_MAX_COUNT, SKY_MORSEL_MIN_SIZE);
+    check(rc == 0, "Unable to publish morsels");
+
+    // The scan can continue without helpers so a failure is not fatal. The
+    // servlet must stay in the scan once its morsels are published.
+    rc = sky_worker_add_helpers(worker->scheduler, worker, NULL, servlet->server->executor, worker->scheduler->sets[worklet->index].morsel_count - 1);
+    if(rc != 0) {
+        log_err("Unable to add scan helpers");
+    }
+
+    // Map morsels until our own tablet has been scanned. A morsel that fails
+    // is still completed so that its tablet's servlet is released.
+    int result = 0;
+    while(true) {
+        sky_morsel *morsel = NULL;
+        rc = sky_morsel_scheduler_next(worker->scheduler, worklet->index, &morsel);
+        check(rc == 0, "Unable to retrieve next morsel");
+        if(morsel == NULL) {
+            break;
+        }
+
+        rc = sky_worker_map_morsel(worker, servlet, morsel, &context);
+        if(rc != 0) {
+            log_err("Unable to map morsel");
+            result = -1;
+        }
+
+        rc = sky_morsel_scheduler_complete(worker->scheduler, morsel);
+        check(rc == 0, "Unable to complete morsel");
+    }
+
+    if(worker->context_free && context) worker->context_free(context);
+    return result;
+
+error:
+    if(worker->context_free && context) worker->context_free(context);
+    return -1;
+}
+
+// Frees the output of a shared scan that has not been handed to the workers
+// of its group.
+//
+// group     - The group.
+// scheduler - The group's scheduler.
+//
+// Returns nothing.
+static void sky_worker_free_group_output(sky_worker_group *group,
+                                         sky_morsel_scheduler *scheduler)
+{
+    uint32_t i, j;
+    sky_morsel_set *set = &scheduler->sets[0];
+    for(j=0; j<set->morsel_count; j++) {
+        void **outputs = (void**)set->morsels[j].data;
+        if(outputs == NULL) continue;
+        for(i=0; i<group->count; i++) {
+            sky_worker *worker = group->worklets[i]->worker;
+            if(worker->map_free && outputs[i]) worker->map_free(outputs[i]);
+        }
+        free(outputs);
+        set->morsels[j].data = NULL;
+    }
+}
+
+// Maps a group of worklets against the tablet of the servlet that received
+// them in a single pass. The tablet is split into morsels that are published
+// to a scheduler of the group's own and helpers are queued to steal from
+// them the same way as a single worker's scan. Each morsel is mapped for
+// every worker in the group. Once every morsel has been completed, each
+// worker's share of the output is attached to the worker's morsel set for
+// the servlet so that it is reduced when the worklet is returned. A worker
+// whose output is missing from any morsel is marked as failed.
+//
+// worklets - The worklets.
+// count    - The number of worklets.
+// servlet  - The servlet that received the worklets.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_worker_map_shared(sky_worklet **worklets, uint32_t count,
+                          sky_servlet *servlet)
+{
+    int rc;
+    uint32_t i, j;
+    void *context = NULL;
+    void **data = NULL;
+    sky_morsel_scheduler *scheduler = NULL;
+    assert(worklets != NULL);
+    assert(count > 0);
+    assert(servlet != NULL);
+
+    sky_worker *leader = worklets[0]->worker;
+    sky_worker_group group = {.worklets = worklets, .count = count};
+    check(leader->map_shared != NULL, "Worker does not support shared scans");
+    for(i=0; i<count; i++) {
+        check(worklets[i]->worker->scheduler != NULL, "Shared scans require morsel scheduling");
+    }
+
+    // Split the tablet so that other threads can help scan it.
+    scheduler = sky_morsel_scheduler_create(1); check_mem(scheduler);
+    rc = sky_morsel_scheduler_publish(scheduler, 0, servlet->tablet, SKY_MORSEL_MAX_COUNT, SKY_MORSEL_MIN_SIZE);
+    check(rc == 0, "Unable to publish morsels");
+    sky_morsel_set *set = &scheduler->sets[0];
+
+    // The scan can continue without helpers so a failure is not fatal.
+    rc = sky_worker_add_helpers(scheduler, NULL, &group, servlet->server->executor, set->morsel_count - 1);
+    if(rc != 0) {
+        log_err("Unable to add scan helpers");
+    }
+
+    // Map morsels until the tablet has been scanned. A morsel that fails is
+    // still completed so that the helpers are released.
+    while(true) {
+        sky_morsel *morsel = NULL;
+        rc = sky_morsel_scheduler_next(scheduler, 0, &morsel);
+        check(rc == 0, "Unable to retrieve next morsel");
+        if(morsel == NULL) {
+            break;
+        }
+
+        rc = sky_worker_map_group_morsel(&group, servlet, morsel, &context);
+        if(rc != 0) {
+            log_err("Unable to map shared morsel");
+        }
+
+        rc = sky_morsel_scheduler_complete(scheduler, morsel);
+        check(rc == 0, "Unable to complete morsel");
+    }
+    if(leader->shared_context_free && context) leader->shared_context_free(context);
+    context = NULL;
+
+    // Hand each worker its output from every morsel.
+    data = calloc(set->morsel_count, sizeof(*data)); check_mem(data);
+    for(i=0; i<count; i++) {
+        sky_worklet *worklet = worklets[i];
+        for(j=0; j<set->morsel_count; j++) {
+            void **outputs = (void**)set->morsels[j].data;
+            data[j] = (outputs ? outputs[i] : NULL);
+            if(data[j] == NULL) worklet->failed = true;
+        }
+
+        rc = sky_morsel_scheduler_attach(worklet->worker->scheduler, worklet->index, servlet->tablet, data, set->morsel_count);
+        check(rc == 0, "Unable to attach morsels");
+        for(j=0; j<set->morsel_count; j++) {
+            void **outputs = (void**)set->morsels[j].data;
+            if(outputs) outputs[i] = NULL;
+        }
+    }
+
+    free(data);
+    sky_worker_free_group_output(&group, scheduler);
+    sky_morsel_scheduler_release(scheduler);
+    return 0;
+
+error:
+    if(leader->shared_context_free && context) leader->shared_context_free(context);
+    free(data);
+    if(scheduler) {
+        sky_worker_free_group_output(&group, scheduler);
+        sky_morsel_scheduler_release(scheduler);
+    }
+    return -1;
 }
@@ -10,6 +10,9 @@ typedef struct sky_worker sky_worker;
 #include "bstring.h"
 #include "servlet.h"
 #include "tablet.h"
+#include "worker_pool.h"
+#include "worklet.h"
+#include "morsel.h"
 
 
 //==============================================================================
@@ -24,9 +27,35 @@ typedef int (*sky_worker_read_func_t)(sky_worker *worker, FILE *input);
 // Defines a function that maps tablet data to an output.
 typedef int (*sky_worker_map_func_t)(sky_worker *worker, sky_tablet *tablet, void **data);
 
+// Defines a function that maps a morsel of tablet data to an output. The
+// context is created before the first morsel that a thread maps for the
+// worker and is reused for every morsel the thread maps afterward.
+typedef int (*sky_worker_map_morsel_func_t)(sky_worker *worker, sky_morsel *morsel, void **context, void **data);
+
+// Defines a function that maps a morsel of tablet data for several workers in
+// a single pass. The output of each worker is returned in an array in the
+// same order as the worklets. Every worklet in the group belongs to a worker
+// with the same shared map function. The context is created by the function
+// on the first morsel that a thread maps for the group and is reused for the
+// thread's other morsels of the group. The servlet is the servlet whose turn
+// the thread is running or null if the thread is helping with the scan.
+typedef int (*sky_worker_map_shared_func_t)(sky_worklet **worklets, uint32_t count, sky_servlet *servlet, sky_morsel *morsel, void **context, void ***data);
+
+// Defines a function that creates the context of a thread before it maps its
+// first morsel for the worker. The servlet is the servlet whose turn the
+// thread is running or null if the thread is helping with the scan.
+typedef int (*sky_worker_context_create_func_t)(sky_worker *worker, sky_servlet *servlet, void **context);
+
+// Defines a function that frees a context created by the map morsel function.
+typedef int (*sky_worker_context_free_func_t)(void *context);
+
 // Defines a function that frees data generated by the map function.
 typedef int (*sky_worker_map_free_func_t)(void *data);
 
+// Defines a function that determines if a worklet should be sent back to its
+// servlet for another round of mapping instead of being reduced.
+typedef bool (*sky_worker_requeue_func_t)(sky_worker *worker, void *data);
+
 // Defines a function that reduces the output of the map function to a single
 // output.
 typedef int (*sky_worker_reduce_func_t)(sky_worker *worker, void *data);
@@ -47,23 +76,28 @@ struct sky_worker {
     int64_t id;
     sky_worker_state_e state;
     bool multi;
+    bool batchable;
     sky_servlet **servlets;
     uint32_t servlet_count;
-    void **push_sockets;
-    uint32_t push_socket_count;
-    void *pull_socket;
-    bstring pull_socket_uri;
+    sky_worker_pool *pool;
+    sky_worker_channel *channel;
+    sky_morsel_scheduler *scheduler;
+    uint64_t service_time;
     void *data;
-    void *context;
     FILE *input;
     FILE *output;
     sky_worker_read_func_t read;
     sky_worker_map_func_t map;
+    sky_worker_map_morsel_func_t map_morsel;
+    sky_worker_map_shared_func_t map_shared;
+    sky_worker_context_create_func_t context_create;
+    sky_worker_context_free_func_t context_free;
+    sky_worker_context_free_func_t shared_context_free;
     sky_worker_map_free_func_t map_free;
+    sky_worker_requeue_func_t requeue;
     sky_worker_reduce_func_t reduce;
     sky_worker_write_func_t write;
     sky_worker_free_func_t free;
-    pthread_t thread;
 };
 
 
@@ -94,4 +128,16 @@ int sky_worker_set_servlets(sky_worker *worker, sky_servlet **servlets,
 
 int sky_worker_start(sky_worker *worker);
 
+//--------------------------------------
+// Processing
+//--------------------------------------
+
+int sky_worker_run(sky_worker *worker);
+
+int sky_worker_map(sky_worker *worker, sky_worklet *worklet,
+    sky_servlet *servlet);
+
+int sky_worker_map_shared(sky_worklet **worklets, uint32_t count,
+    sky_servlet *servlet);
+
 #endif
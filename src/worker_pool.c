@@ -0,0 +1,273 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "worker_pool.h"
+#include "bstring.h"
+#include "dbg.h"
+#include "mem.h"
+
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+void *sky_worker_pool_run(void *_channel);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Channel Lifecycle
+//--------------------------------------
+
+// Creates a channel.
+//
+// pool - The pool the channel belongs to.
+//
+// Returns a reference to the channel.
+static sky_worker_channel *sky_worker_channel_create(sky_worker_pool *pool)
+{
+    sky_worker_channel *channel = calloc(1, sizeof(*channel)); check_mem(channel);
+    channel->pool = pool;
+    channel->queue = sky_queue_create(SKY_QUEUE_DEFAULT_CAPACITY);
+    check_mem(channel->queue);
+    return channel;
+
+error:
+    if(channel) free(channel);
+    return NULL;
+}
+
+// Frees a channel from memory.
+//
+// channel - The channel.
+//
+// Returns nothing.
+static void sky_worker_channel_free(sky_worker_channel *channel)
+{
+    if(channel) {
+        sky_queue_free(channel->queue);
+        channel->queue = NULL;
+        channel->pool = NULL;
+        free(channel);
+    }
+}
+
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a worker pool along with a channel for each thread and one for
+// serial workers.
+//
+// thread_count - The number of worker threads.
+//
+// Returns a reference to the pool.
+sky_worker_pool *sky_worker_pool_create(uint32_t thread_count)
+{
+    sky_worker_pool *pool = NULL;
+    check(thread_count > 0, "Thread count required");
+
+    pool = calloc(1, sizeof(sky_worker_pool)); check_mem(pool);
+    pool->thread_count = thread_count;
+    check(pthread_mutex_init(&pool->mutex, NULL) == 0, "Unable to init pool mutex");
+    check(pthread_cond_init(&pool->cond, NULL) == 0, "Unable to init pool condition");
+
+    pool->channels = calloc(thread_count + 1, sizeof(*pool->channels));
+    check_mem(pool->channels);
+    uint32_t i;
+    for(i=0; i<thread_count+1; i++) {
+        pool->channels[i] = sky_worker_channel_create(pool);
+        check_mem(pool->channels[i]);
+    }
+    pool->serial_channel = pool->channels[thread_count];
+
+    return pool;
+
+error:
+    sky_worker_pool_free(pool);
+    return NULL;
+}
+
+// Stops a worker pool and frees it from memory. Servlets must not be sending
+// worklets back to the pool's channels anymore.
+//
+// pool - The pool.
+//
+// Returns nothing.
+void sky_worker_pool_free(sky_worker_pool *pool)
+{
+    if(pool) {
+        sky_worker_pool_stop(pool);
+        if(pool->channels) {
+            uint32_t i;
+            for(i=0; i<pool->thread_count+1; i++) {
+                sky_worker_channel_free(pool->channels[i]);
+            }
+            free(pool->channels);
+        }
+        pool->channels = NULL;
+        pool->serial_channel = NULL;
+        free(pool->queue);
+        pool->queue = NULL;
+        pthread_mutex_destroy(&pool->mutex);
+        pthread_cond_destroy(&pool->cond);
+        free(pool);
+    }
+}
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+// Starts the threads of a pool.
+//
+// pool - The pool.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_worker_pool_start(sky_worker_pool *pool)
+{
+    int rc;
+    check(pool != NULL, "Pool required");
+    check(!pool->running, "Pool is already running");
+
+    pool->stopping = false;
+    pool->threads = calloc(pool->thread_count, sizeof(*pool->threads));
+    check_mem(pool->threads);
+    pool->running = true;
+
+    for(pool->started_count=0; pool->started_count<pool->thread_count; pool->started_count++) {
+        rc = pthread_create(&pool->threads[pool->started_count], NULL, sky_worker_pool_run, pool->channels[pool->started_count]);
+        check(rc == 0, "Unable to create worker pool thread");
+    }
+
+    return 0;
+
+error:
+    if(pool) sky_worker_pool_stop(pool);
+    return -1;
+}
+
+// Waits for queued workers to finish and then stops the pool's threads.
+//
+// pool - The pool.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_worker_pool_stop(sky_worker_pool *pool)
+{
+    uint32_t i;
+    check(pool != NULL, "Pool required");
+
+    if(pool->running) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->stopping = true;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->mutex);
+
+        for(i=0; i<pool->started_count; i++) {
+            pthread_join(pool->threads[i], NULL);
+        }
+        free(pool->threads);
+        pool->threads = NULL;
+        pool->started_count = 0;
+        pool->running = false;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Scheduling
+//--------------------------------------
+
+// Queues a worker to run on the next available pool thread. The pool thread
+// frees the worker once it has finished.
+//
+// pool   - The pool.
+// worker - The worker.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_worker_pool_submit(sky_worker_pool *pool, sky_worker *worker)
+{
+    check(pool != NULL, "Pool required");
+    check(worker != NULL, "Worker required");
+    check(pool->running, "Pool is not running");
+
+    pthread_mutex_lock(&pool->mutex);
+
+    // Grow the queue and unwrap any entries that wrapped around.
+    if(pool->queue_count == pool->queue_capacity) {
+        uint32_t capacity = (pool->queue_capacity > 0 ? pool->queue_capacity * 2 : 64);
+        sky_worker **queue = calloc(capacity, sizeof(*queue));
+        if(queue == NULL) {
+            pthread_mutex_unlock(&pool->mutex);
+            sentinel("Unable to grow worker pool queue");
+        }
+        uint32_t i;
+        for(i=0; i<pool->queue_count; i++) {
+            queue[i] = pool->queue[(pool->queue_head + i) % pool->queue_capacity];
+        }
+        free(pool->queue);
+        pool->queue = queue;
+        pool->queue_head = 0;
+        pool->queue_capacity = capacity;
+    }
+
+    pool->queue[(pool->queue_head + pool->queue_count) % pool->queue_capacity] = worker;
+    pool->queue_count++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// The pool thread function. Workers are taken off the queue and run until
+// the pool is stopped.
+//
+// _channel - The channel owned by the thread.
+//
+// Returns NULL.
+void *sky_worker_pool_run(void *_channel)
+{
+    sky_worker_channel *channel = (sky_worker_channel*)_channel;
+    sky_worker_pool *pool = channel->pool;
+
+    while(true) {
+        pthread_mutex_lock(&pool->mutex);
+        while(pool->queue_count == 0 && !pool->stopping) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if(pool->queue_count == 0) {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        sky_worker *worker = pool->queue[pool->queue_head];
+        pool->queue_head = (pool->queue_head + 1) % pool->queue_capacity;
+        pool->queue_count--;
+        pthread_mutex_unlock(&pool->mutex);
+
+        worker->channel = channel;
+        sky_worker_run(worker);
+    }
+
+    return NULL;
+}
+
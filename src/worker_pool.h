@@ -0,0 +1,94 @@
+#ifndef _sky_worker_pool_h
+#define _sky_worker_pool_h
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct sky_worker_pool sky_worker_pool;
+typedef struct sky_worker_channel sky_worker_channel;
+
+#include "bstring.h"
+#include "servlet.h"
+#include "worker.h"
+#include "queue.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A worker pool runs workers on a fixed set of long-lived threads instead of
+// starting a thread for every request. Each thread owns a channel: a queue
+// that servlets send finished worklets back to. An extra channel is reserved
+// for workers that run serially on the calling thread.
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+#define SKY_WORKER_POOL_DEFAULT_THREAD_COUNT 4
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_worker_channel {
+    sky_worker_pool *pool;
+    sky_queue *queue;
+};
+
+struct sky_worker_pool {
+    bool running;
+    bool stopping;
+    pthread_t *threads;
+    uint32_t thread_count;
+    uint32_t started_count;
+    sky_worker_channel **channels;
+    sky_worker_channel *serial_channel;
+    sky_worker **queue;
+    uint32_t queue_head;
+    uint32_t queue_count;
+    uint32_t queue_capacity;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_worker_pool *sky_worker_pool_create(uint32_t thread_count);
+
+void sky_worker_pool_free(sky_worker_pool *pool);
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+int sky_worker_pool_start(sky_worker_pool *pool);
+
+int sky_worker_pool_stop(sky_worker_pool *pool);
+
+//--------------------------------------
+// Scheduling
+//--------------------------------------
+
+int sky_worker_pool_submit(sky_worker_pool *pool, sky_worker *worker);
+
+#endif
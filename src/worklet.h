@@ -17,8 +17,12 @@ typedef struct sky_worklet sky_worklet;
 //
 //==============================================================================
 
+// A unit of work sent from a worker to a single servlet. A worklet is
+// marked as failed if its servlet was unable to map it.
 struct sky_worklet {
     sky_worker *worker;
+    uint32_t index;
+    bool failed;
     void *data;
 };
 
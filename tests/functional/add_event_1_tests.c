@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sky.h>
+#include <dbg.h>
+#include <mem.h>
+
+#include "server_helpers.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+int test() {
+    pthread_t thread;
+    importtmp("tests/functional/fixtures/add_event/1/data.json");
+
+    // Fill the dictionary of the property.
+    int64_t i;
+    bool added;
+    struct tagbstring ostring_str = bsStatic("ostring");
+    sky_property *property = NULL;
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+    sky_property_file_find_by_name(table->property_file, &ostring_str, &property);
+    mu_assert_bool(property != NULL);
+    for(i=0; i<SKY_DICTIONARY_MAX_COUNT; i++) {
+        sky_event_data *data = NULL;
+        bstring value = bformat("value%lld", (long long int)i);
+        mu_assert_int_equals(sky_property_encode_string(property, value, &data, &added), 0);
+        sky_event_data_free(data);
+        bdestroy(value);
+    }
+    sky_table_free(table);
+
+    // An event with a new value is rejected.
+    start_server(1, &thread);
+    send_msg("tests/functional/fixtures/add_event/1/input");
+    pthread_join(thread, NULL);
+    mu_assert_msg("tests/functional/fixtures/add_event/1/output");
+
+    // An event with an existing value is still added.
+    start_server(1, &thread);
+    send_msg("tests/functional/fixtures/add_event/1/input2");
+    pthread_join(thread, NULL);
+    mu_assert_msg("tests/functional/fixtures/add_event/1/output2");
+
+    void *data;
+    size_t data_length;
+    struct tagbstring one_str = bsStatic("1");
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+    sky_property_file_find_by_name(table->property_file, &ostring_str, &property);
+    mu_assert_int_equals(property->dictionary->count, SKY_DICTIONARY_MAX_COUNT);
+
+    // The path only holds the imported event and the accepted event.
+    sky_tablet_get_path(table->tablets[0], &one_str, &data, &data_length);
+    mu_assert_long_equals((long)data_length, 17L);
+    sky_table_free(table);
+    free(data);
+    return 0;
+}
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sky.h>
+#include <dbg.h>
+#include <mem.h>
+
+#include "server_helpers.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+int test() {
+    pthread_t thread;
+    importtmp_n("tests/functional/fixtures/next_actions/0/data.json", 4);
+    start_server(2, &thread);
+    send_msg("tests/functional/fixtures/reshard/0/input");
+    mu_assert_msg("tests/functional/fixtures/reshard/0/output");
+
+    // Queries should return the same results from the new layout.
+    send_msg("tests/functional/fixtures/next_actions/0/input");
+    pthread_join(thread, NULL);
+    mu_assert_msg("tests/functional/fixtures/next_actions/0/output");
+
+    // The table should reopen with the new layout.
+    void *data;
+    size_t data_length;
+    sky_tablet *tablet = NULL;
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+    mu_assert_int_equals(table->tablet_count, 8);
+    mu_assert_int_equals(table->generation, 1);
+    mu_assert_int_equals(table->hashing, SKY_TABLE_HASHING_JUMP);
+
+    // The previous tablets should be removed.
+    struct tagbstring legacy_path = bsStatic("tmp/0");
+    mu_assert_bool(!sky_file_exists(&legacy_path));
+
+    struct tagbstring one_str = bsStatic("1");
+    sky_table_get_target_tablet(table, &one_str, &tablet);
+    sky_tablet_get_path(tablet, &one_str, &data, &data_length);
+    mu_assert_bool(data_length > 0);
+    free(data);
+
+    sky_table_free(table);
+    return 0;
+}
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test);
+    return 0;
+}
+
+RUN_TESTS()
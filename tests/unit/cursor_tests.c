@@ -70,10 +70,10 @@ int test_sky_cursor_set_data() {
     table->path = bfromcstr("tmp");
     sky_table_open(table);
 
+    void *data;
     size_t data_length;
-    char *errptr = NULL;
     bstring object_id = bfromcstr("10");
-    char *data = leveldb_get(table->tablets[0]->leveldb_db, table->tablets[0]->readoptions, (const char*)bdata(object_id), blength(object_id), &data_length, &errptr);
+    sky_tablet_get_path(table->tablets[0], object_id, &data, &data_length);
     
     // Setup data object & data descriptor.
     test_t obj; memset(&obj, 0, sizeof(obj));
@@ -125,6 +125,87 @@ int test_sky_cursor_set_data() {
 }
 
 
+//--------------------------------------
+// Versions
+//--------------------------------------
+
+int test_sky_cursor_mixed_versions() {
+    // A version 1 event, a delta encoded version 2 event and another
+    // version 1 event.
+    char data[] =
+        "\x01\x00\x00\x10\x00\x00\x00\x00\x00\x01\x00"
+        "\x0d\x80\x80\x40\x02"
+        "\x01\x00\x00\x30\x00\x00\x00\x00\x00\x03\x00";
+
+    test_t obj; memset(&obj, 0, sizeof(obj));
+    sky_data_descriptor *descriptor = sky_data_descriptor_create();
+    descriptor->timestamp_descriptor.timestamp_offset = offsetof(test_t, timestamp);
+    descriptor->timestamp_descriptor.ts_offset = offsetof(test_t, ts);
+    descriptor->action_descriptor.offset = offsetof(test_t, action_id);
+
+    sky_cursor *cursor = sky_cursor_create();
+    cursor->data_descriptor = descriptor;
+    cursor->data = &obj;
+    sky_cursor_set_ptr(cursor, data, sizeof(data)-1);
+
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    ASSERT_OBJ_STATE2(obj, 1, 1, 0LL, 0LL);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    ASSERT_OBJ_STATE2(obj, 2, 2, 0LL, 0LL);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    ASSERT_OBJ_STATE2(obj, 3, 3, 0LL, 0LL);
+    mu_assert_bool(!sky_lua_cursor_next_event(cursor));
+
+    sky_cursor_free(cursor);
+    sky_data_descriptor_free(descriptor);
+    return 0;
+}
+
+
+//--------------------------------------
+// Seek
+//--------------------------------------
+
+int test_sky_cursor_seek() {
+    char data[] =
+        "\x01\x00\x00\x10\x00\x00\x00\x00\x00\x01\x00"
+        "\x0d\x80\x80\x40\x02"
+        "\x01\x00\x00\x30\x00\x00\x00\x00\x00\x03\x00";
+
+    test_t obj; memset(&obj, 0, sizeof(obj));
+    sky_data_descriptor *descriptor = sky_data_descriptor_create();
+    descriptor->timestamp_descriptor.timestamp_offset = offsetof(test_t, timestamp);
+    descriptor->timestamp_descriptor.ts_offset = offsetof(test_t, ts);
+    descriptor->action_descriptor.offset = offsetof(test_t, action_id);
+    sky_data_descriptor_set_property(descriptor, 2, offsetof(test_t, object_int), SKY_DATA_TYPE_INT);
+
+    sky_cursor *cursor = sky_cursor_create();
+    cursor->data_descriptor = descriptor;
+    cursor->data = &obj;
+    sky_cursor_set_ptr(cursor, data, sizeof(data)-1);
+
+    // Restore the state and resume from the delta encoded event.
+    mu_assert_int_equals(sky_cursor_set_state(cursor, "\x02\x05", 2), 0);
+    mu_assert_int64_equals(obj.object_int, 5LL);
+    mu_assert_int_equals(sky_cursor_seek(cursor, sky_timestamp_shift(2000000LL)), 0);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    ASSERT_OBJ_STATE2(obj, 2, 2, 5LL, 0LL);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    ASSERT_OBJ_STATE2(obj, 3, 3, 5LL, 0LL);
+    mu_assert_bool(!sky_lua_cursor_next_event(cursor));
+
+    // Seeking past the last event ends the path.
+    sky_cursor_set_ptr(cursor, data, sizeof(data)-1);
+    mu_assert_int_equals(sky_cursor_seek(cursor, sky_timestamp_shift(4000000LL)), 0);
+    mu_assert_bool(sky_cursor_eof(cursor));
+    mu_assert_bool(!sky_lua_cursor_next_event(cursor));
+
+    sky_cursor_free(cursor);
+    sky_data_descriptor_free(descriptor);
+    return 0;
+}
+
+
 //--------------------------------------
 // Sessionize
 //--------------------------------------
@@ -135,10 +216,10 @@ int test_sky_cursor_sessionize() {
     table->path = bfromcstr("tmp");
     sky_table_open(table);
 
+    void *data;
     size_t data_length;
-    char *errptr = NULL;
     bstring object_id = bfromcstr("10");
-    char *data = leveldb_get(table->tablets[0]->leveldb_db, table->tablets[0]->readoptions, (const char*)bdata(object_id), blength(object_id), &data_length, &errptr);
+    sky_tablet_get_path(table->tablets[0], object_id, &data, &data_length);
     
     // Setup data object & data descriptor.
     test_t obj; memset(&obj, 0, sizeof(obj));
@@ -238,6 +319,98 @@ int test_sky_cursor_sessionize() {
 }
 
 
+int test_sky_cursor_sessionize_decoded_events() {
+    importtmp("tests/fixtures/cursors/1/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    void *data;
+    size_t data_length;
+    bstring object_id = bfromcstr("10");
+    sky_tablet_get_path(table->tablets[0], object_id, &data, &data_length);
+    
+    // Setup data object & data descriptor.
+    test_t obj; memset(&obj, 0, sizeof(obj));
+    sky_data_descriptor *descriptor = sky_data_descriptor_create();
+    descriptor->timestamp_descriptor.timestamp_offset = offsetof(test_t, timestamp);
+    descriptor->timestamp_descriptor.ts_offset = offsetof(test_t, ts);
+    descriptor->action_descriptor.offset = offsetof(test_t, action_id);
+    sky_data_descriptor_set_property(descriptor, -1, offsetof(test_t, action_int), SKY_DATA_TYPE_INT);
+    sky_data_descriptor_set_property(descriptor, 1, offsetof(test_t, object_int), SKY_DATA_TYPE_INT);
+
+    // Decode the path once through a union descriptor.
+    sky_data_descriptor *union_descriptor = sky_data_descriptor_create();
+    mu_assert_int_equals(sky_data_descriptor_init_union(union_descriptor, &descriptor, 1), 0);
+    sky_data_projection projection;
+    mu_assert_int_equals(sky_data_projection_init(&projection, union_descriptor, descriptor), 0);
+    void *union_data = calloc(1, union_descriptor->data_sz);
+    sky_cursor_events events;
+    memset(&events, 0, sizeof(events));
+    events.data_descriptor = union_descriptor;
+
+    sky_cursor *decoder = sky_cursor_create();
+    decoder->data_descriptor = union_descriptor;
+    decoder->data = union_data;
+    sky_cursor_set_ptr(decoder, data, data_length);
+    mu_assert_int_equals(sky_cursor_decode_events(decoder, &events), 0);
+    mu_assert_int_equals(events.count, 6);
+
+    sky_cursor *cursor = sky_cursor_create();
+    cursor->data_descriptor = descriptor;
+    cursor->data = &obj;
+
+    // Decoded events are split into the same sessions as raw events.
+    sky_cursor_set_events(cursor, &events, &projection);
+    sky_cursor_set_session_idle(cursor, 10);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor) == false);
+    mu_assert_bool(sky_lua_cursor_next_session(cursor));
+    mu_assert_int_equals(cursor->session_event_index, -1);
+
+    // Session 1
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    ASSERT_OBJ_STATE2(obj, 0, 1, 1000LL, 0LL);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    ASSERT_OBJ_STATE2(obj, 1, 2, 1000LL, 100LL);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    mu_assert_int_equals(cursor->session_event_index, 2);
+    ASSERT_OBJ_STATE2(obj, 10, 3, 1000LL, 200LL);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor) == false);
+    ASSERT_OBJ_STATE2(obj, 10, 3, 1000LL, 200LL);
+
+    // Session 2
+    mu_assert_bool(sky_lua_cursor_next_session(cursor));
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    mu_assert_int_equals(cursor->session_event_index, 0);
+    ASSERT_OBJ_STATE2(obj, 20, 1, 1000LL, 300LL);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor) == false);
+
+    // Session 3
+    mu_assert_bool(sky_lua_cursor_next_session(cursor));
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    ASSERT_OBJ_STATE2(obj, 60, 1, 2000LL, 0LL);
+    mu_assert_bool(sky_lua_cursor_next_event(cursor));
+    mu_assert_int_equals(cursor->session_event_index, 1);
+    ASSERT_OBJ_STATE2(obj, 63, 2, 2000LL, 400LL);
+
+    // EOF!
+    mu_assert_bool(sky_lua_cursor_next_event(cursor) == false);
+    mu_assert_bool(sky_lua_cursor_next_session(cursor) == false);
+    mu_assert_bool(cursor->eof == true);
+
+    free(data);
+    free(union_data);
+    bdestroy(object_id);
+    sky_cursor_events_uninit(&events);
+    sky_data_projection_uninit(&projection);
+    sky_cursor_free(decoder);
+    sky_cursor_free(cursor);
+    sky_data_descriptor_free(union_descriptor);
+    sky_data_descriptor_free(descriptor);
+    sky_table_free(table);
+    return 0;
+}
+
 
 //==============================================================================
 //
@@ -247,7 +420,10 @@ int test_sky_cursor_sessionize() {
 
 int all_tests() {
     mu_run_test(test_sky_cursor_set_data);
+    mu_run_test(test_sky_cursor_mixed_versions);
+    mu_run_test(test_sky_cursor_seek);
     mu_run_test(test_sky_cursor_sessionize);
+    mu_run_test(test_sky_cursor_sessionize_decoded_events);
     return 0;
 }
 
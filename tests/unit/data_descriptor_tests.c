@@ -129,6 +129,67 @@ int test_sky_data_descriptor_set_string() {
 }
 
 
+//--------------------------------------
+// Union & Projection
+//--------------------------------------
+
+int test_sky_data_descriptor_init_union() {
+    size_t sz;
+    test_t obj;
+    memset(&obj, 0, sizeof(obj));
+    sky_data_descriptor *descriptors[2];
+    descriptors[0] = sky_data_descriptor_create();
+    sky_data_descriptor_set_property(descriptors[0], 1, offsetof(test_t, int_value), SKY_DATA_TYPE_INT);
+    sky_data_descriptor_set_property(descriptors[0], -1, offsetof(test_t, string_value), SKY_DATA_TYPE_STRING);
+    descriptors[1] = sky_data_descriptor_create();
+    sky_data_descriptor_set_property(descriptors[1], 1, offsetof(test_t, int_value), SKY_DATA_TYPE_INT);
+    sky_data_descriptor_set_property(descriptors[1], 2, offsetof(test_t, double_value), SKY_DATA_TYPE_DOUBLE);
+
+    // Shared properties are only tracked once.
+    sky_data_descriptor *descriptor = sky_data_descriptor_create();
+    int rc = sky_data_descriptor_init_union(descriptor, descriptors, 2);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_int_equals(descriptor->active_property_count, 3);
+    mu_assert_int_equals(descriptor->action_property_descriptor_count, 1);
+    mu_assert_int_equals(descriptor->property_zero_descriptor[-1].offset, (int)sizeof(sky_data_object));
+    mu_assert_int_equals(descriptor->property_zero_descriptor[1].offset, (int)sizeof(sky_data_object) + 16);
+    mu_assert_int_equals(descriptor->property_zero_descriptor[2].offset, (int)sizeof(sky_data_object) + 24);
+    mu_assert_int_equals(descriptor->data_sz, (int)sizeof(sky_data_object) + 32);
+
+    // Values decoded through the union are copied onto the second object.
+    void *data = calloc(1, descriptor->data_sz);
+    sky_data_object *header = (sky_data_object*)data;
+    header->ts = 10;
+    header->timestamp = 20;
+    header->action_id = 3;
+    sky_data_descriptor_set_value(descriptor, data, 1, INT_DATA, &sz);
+    sky_data_descriptor_set_value(descriptor, data, 2, DOUBLE_DATA, &sz);
+    sky_data_descriptor_set_value(descriptor, data, -1, STRING_DATA, &sz);
+
+    sky_data_projection projection;
+    rc = sky_data_projection_init(&projection, descriptor, descriptors[1]);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_int_equals(projection.field_count, 5);
+    sky_data_projection_apply(&projection, data, &obj);
+    mu_assert_int64_equals(obj.int_value, 1000LL);
+    mu_assert_bool(fabs(obj.double_value - 100.2) < 0.1);
+    mu_assert_int_equals(obj.string_value.length, 0);
+
+    // Properties missing from the union cannot be projected.
+    sky_data_projection invalid;
+    sky_data_descriptor_set_property(descriptors[1], 3, offsetof(test_t, boolean_value), SKY_DATA_TYPE_BOOLEAN);
+    rc = sky_data_projection_init(&invalid, descriptor, descriptors[1]);
+    mu_assert_int_equals(rc, -1);
+
+    free(data);
+    sky_data_projection_uninit(&projection);
+    sky_data_descriptor_free(descriptor);
+    sky_data_descriptor_free(descriptors[0]);
+    sky_data_descriptor_free(descriptors[1]);
+    return 0;
+}
+
+
 //==============================================================================
 //
 // Setup
@@ -141,6 +202,7 @@ int all_tests() {
     mu_run_test(test_sky_data_descriptor_set_double);
     mu_run_test(test_sky_data_descriptor_set_boolean);
     mu_run_test(test_sky_data_descriptor_set_string);
+    mu_run_test(test_sky_data_descriptor_init_union);
     return 0;
 }
 
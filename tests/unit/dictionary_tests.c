@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <dictionary.h>
+#include <mem.h>
+#include <dbg.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Encoding
+//--------------------------------------
+
+int test_sky_dictionary_encode() {
+    int64_t code;
+    bool added;
+    struct tagbstring foo = bsStatic("foo");
+    struct tagbstring bar = bsStatic("bar");
+    struct tagbstring baz = bsStatic("baz");
+    sky_dictionary *dictionary = sky_dictionary_create();
+    mu_assert_int_equals(sky_dictionary_encode(dictionary, &foo, &code, &added), 0);
+    mu_assert_int64_equals(code, 1);
+    mu_assert_bool(added);
+    mu_assert_int_equals(sky_dictionary_encode(dictionary, &bar, &code, &added), 0);
+    mu_assert_int64_equals(code, 2);
+    mu_assert_bool(added);
+    mu_assert_int_equals(sky_dictionary_encode(dictionary, &foo, &code, &added), 0);
+    mu_assert_int64_equals(code, 1);
+    mu_assert_bool(!added);
+
+    mu_assert_int_equals(sky_dictionary_find(dictionary, &baz, &code), 0);
+    mu_assert_int64_equals(code, 0);
+    mu_assert_int_equals(dictionary->count, 2);
+
+    mu_assert_bstring(sky_dictionary_decode(dictionary, 2), "bar");
+    mu_assert_bool(sky_dictionary_decode(dictionary, 0) == NULL);
+    mu_assert_bool(sky_dictionary_decode(dictionary, 3) == NULL);
+    sky_dictionary_free(dictionary);
+    return 0;
+}
+
+int test_sky_dictionary_encode_many() {
+    int64_t i, code;
+    sky_dictionary *dictionary = sky_dictionary_create();
+    for(i=0; i<1000; i++) {
+        bstring value = bformat("value%lld", (long long int)i);
+        mu_assert_int_equals(sky_dictionary_encode(dictionary, value, &code, NULL), 0);
+        mu_assert_int64_equals(code, i+1);
+        bdestroy(value);
+    }
+    for(i=0; i<1000; i++) {
+        bstring value = bformat("value%lld", (long long int)i);
+        mu_assert_int_equals(sky_dictionary_find(dictionary, value, &code), 0);
+        mu_assert_int64_equals(code, i+1);
+        bdestroy(value);
+    }
+    sky_dictionary_free(dictionary);
+    return 0;
+}
+
+int test_sky_dictionary_encode_full() {
+    int64_t i, code;
+    bool added;
+    struct tagbstring foo = bsStatic("foo");
+    sky_dictionary *dictionary = sky_dictionary_create();
+    for(i=0; i<SKY_DICTIONARY_MAX_COUNT; i++) {
+        bstring value = bformat("value%lld", (long long int)i);
+        mu_assert_int_equals(sky_dictionary_encode(dictionary, value, &code, NULL), 0);
+        bdestroy(value);
+    }
+
+    // New values are rejected once the dictionary is full.
+    mu_assert_int_equals(sky_dictionary_encode(dictionary, &foo, &code, &added), SKY_DICTIONARY_FULL);
+    mu_assert_bool(!added);
+    mu_assert_int_equals(dictionary->count, SKY_DICTIONARY_MAX_COUNT);
+    mu_assert_int_equals(sky_dictionary_find(dictionary, &foo, &code), 0);
+    mu_assert_int64_equals(code, 0);
+
+    // Existing values are still encoded.
+    bstring value = bformat("value%lld", (long long int)(SKY_DICTIONARY_MAX_COUNT - 1));
+    mu_assert_int_equals(sky_dictionary_encode(dictionary, value, &code, &added), 0);
+    mu_assert_int64_equals(code, SKY_DICTIONARY_MAX_COUNT);
+    mu_assert_bool(!added);
+    bdestroy(value);
+
+    sky_dictionary_free(dictionary);
+    return 0;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_dictionary_pack_unpack() {
+    cleantmp();
+    int64_t code;
+    struct tagbstring foo = bsStatic("foo");
+    struct tagbstring bar = bsStatic("bar");
+    sky_dictionary *dictionary = sky_dictionary_create();
+    sky_dictionary_encode(dictionary, &foo, &code, NULL);
+    sky_dictionary_encode(dictionary, &bar, &code, NULL);
+
+    FILE *file = fopen("tmp/dictionary", "w");
+    mu_assert_int_equals(sky_dictionary_pack(dictionary, file), 0);
+    fclose(file);
+    mu_assert_long_equals(sky_dictionary_sizeof(dictionary), 9L);
+    sky_dictionary_free(dictionary);
+
+    dictionary = sky_dictionary_create();
+    file = fopen("tmp/dictionary", "r");
+    mu_assert_int_equals(sky_dictionary_unpack(dictionary, file), 0);
+    fclose(file);
+    mu_assert_int_equals(dictionary->count, 2);
+    mu_assert_int_equals(sky_dictionary_find(dictionary, &bar, &code), 0);
+    mu_assert_int64_equals(code, 2);
+    sky_dictionary_free(dictionary);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_dictionary_encode);
+    mu_run_test(test_sky_dictionary_encode_many);
+    mu_run_test(test_sky_dictionary_encode_full);
+    mu_run_test(test_sky_dictionary_pack_unpack);
+    return 0;
+}
+
+RUN_TESTS()
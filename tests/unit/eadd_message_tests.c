@@ -135,9 +135,10 @@ int test_sky_add_event_message_worker_map() {
     size_t data_length;
     sky_tablet_get_path(table->tablets[0], &ten_str, &data, &data_length);
     mu_assert_int_equals(rc, 0);
+    mu_assert_long_equals(data_length, 32L);
     mu_assert_mem(
         data, 
-        "\x03\xE8\x03\x00\x00\x00\x00\x00\x00\x14\x00\x15\x00\x00\x00\x01"
+        "\x07\xE8\x03\x00\x00\x00\x00\x00\x00\x14\x15\x01"
         "\xA3\x78\x79\x7A\x02\xD1\x00\xC8\x03\xCB\x40\x59\x0C\xCC\xCC\xCC"
         "\xCC\xCD\x04\xC3",
         data_length
@@ -35,6 +35,16 @@ char ACTION_DATA_EVENT_DATA[] =
     "\xa3\x66\x6f\x6f\x02\xa3\x62\x61\x72"
 ;
 
+size_t V2_ACTION_EVENT_DATA_LENGTH = 10;
+char V2_ACTION_EVENT_DATA[] = 
+    "\x05\x1e\x00\x00\x00\x00\x00\x00\x00\x14"
+;
+
+size_t V2_DELTA_ACTION_DATA_EVENT_DATA_LENGTH = 14;
+char V2_DELTA_ACTION_DATA_EVENT_DATA[] = 
+    "\x0f\x14\x14\x0a\x01\xa3\x66\x6f\x6f\x02\xa3\x62\x61\x72"
+;
+
 
 //==============================================================================
 //
@@ -190,6 +200,37 @@ int test_sky_event_action_data_event_pack() {
     return 0;
 }
 
+// Version 2 action event.
+int test_sky_event_action_event_pack_v2() {
+    size_t sz;
+    void *addr = calloc(V2_ACTION_EVENT_DATA_LENGTH, 1);
+    sky_event *event = sky_event_create(0, 30LL, 20);
+    mu_assert_long_equals(sky_event_sizeof_v2(event, NULL), V2_ACTION_EVENT_DATA_LENGTH);
+    sky_event_pack_v2(event, NULL, addr, &sz);
+    sky_event_free(event);
+    mu_assert_long_equals(sz, V2_ACTION_EVENT_DATA_LENGTH);
+    mu_assert_mem(addr, &V2_ACTION_EVENT_DATA, V2_ACTION_EVENT_DATA_LENGTH);
+    free(addr);
+    return 0;
+}
+
+// Version 2 Action+Data event with a delta timestamp.
+int test_sky_event_delta_action_data_event_pack_v2() {
+    size_t sz;
+    sky_timestamp_t prev_ts = 10;
+    void *addr = calloc(V2_DELTA_ACTION_DATA_EVENT_DATA_LENGTH, 1);
+    sky_event *event = sky_event_create(0, 30LL, 20);
+    sky_event_set_data(event, 1, &foo);
+    sky_event_set_data(event, 2, &bar);
+    mu_assert_long_equals(sky_event_sizeof_v2(event, &prev_ts), V2_DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    sky_event_pack_v2(event, &prev_ts, addr, &sz);
+    sky_event_free(event);
+    mu_assert_long_equals(sz, V2_DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    mu_assert_mem(addr, &V2_DELTA_ACTION_DATA_EVENT_DATA, V2_DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    free(addr);
+    return 0;
+}
+
 //--------------------------------------
 // Deserialization
 //--------------------------------------
@@ -259,6 +300,50 @@ int test_sky_event_action_data_event_unpack() {
 
 
 
+// Raw headers in both versions.
+int test_sky_event_unpack_raw_hdr() {
+    size_t sz;
+    sky_timestamp_t ts;
+    sky_action_id_t action_id;
+    sky_event_data_length_t data_length;
+
+    sky_event_unpack_raw_hdr(&ACTION_DATA_EVENT_DATA, 0, &ts, &action_id, &data_length, &sz);
+    mu_assert_int64_equals(ts, 30LL);
+    mu_assert_int_equals(action_id, 20);
+    mu_assert_int_equals(data_length, 10);
+    mu_assert_long_equals(sz, 15L);
+    mu_assert_long_equals(sky_event_sizeof_raw(&ACTION_DATA_EVENT_DATA), ACTION_DATA_EVENT_DATA_LENGTH);
+
+    sky_event_unpack_raw_hdr(&V2_DELTA_ACTION_DATA_EVENT_DATA, 10, &ts, &action_id, &data_length, &sz);
+    mu_assert_int64_equals(ts, 30LL);
+    mu_assert_int_equals(action_id, 20);
+    mu_assert_int_equals(data_length, 10);
+    mu_assert_long_equals(sz, 4L);
+    mu_assert_long_equals(sky_event_sizeof_raw(&V2_DELTA_ACTION_DATA_EVENT_DATA), V2_DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    mu_assert_int64_equals(sky_event_get_raw_ts(&V2_DELTA_ACTION_DATA_EVENT_DATA, 10), 30LL);
+    return 0;
+}
+
+// Re-encoding a raw event.
+int test_sky_event_rebase_raw() {
+    size_t sz;
+    sky_timestamp_t prev_ts = 10;
+    char addr[ACTION_DATA_EVENT_DATA_LENGTH + SKY_EVENT_V2_MAX_HEADER_LENGTH];
+
+    // Version 1 events are converted to delta encoded version 2 events.
+    sky_event_rebase_raw(&ACTION_DATA_EVENT_DATA, 30LL, &prev_ts, addr, &sz);
+    mu_assert_long_equals(sz, V2_DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    mu_assert_mem(addr, &V2_DELTA_ACTION_DATA_EVENT_DATA, V2_DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+
+    // Delta encoded events can be given a full timestamp.
+    sky_event_rebase_raw(&V2_DELTA_ACTION_DATA_EVENT_DATA, 30LL, NULL, addr, &sz);
+    mu_assert_long_equals(sz, 21L);
+    mu_assert_int64_equals(sky_event_get_raw_ts(addr, 0), 30LL);
+    mu_assert_mem(addr+10, "\x0a\x01\xa3\x66\x6f\x6f\x02\xa3\x62\x61\x72", 11);
+    return 0;
+}
+
+
 //==============================================================================
 //
 // Setup
@@ -280,10 +365,14 @@ int all_tests() {
     mu_run_test(test_sky_event_action_event_pack);
     mu_run_test(test_sky_event_data_event_pack);
     mu_run_test(test_sky_event_action_data_event_pack);
+    mu_run_test(test_sky_event_action_event_pack_v2);
+    mu_run_test(test_sky_event_delta_action_data_event_pack_v2);
 
     mu_run_test(test_sky_event_action_event_unpack);
     mu_run_test(test_sky_event_data_event_unpack);
     mu_run_test(test_sky_event_action_data_event_unpack);
+    mu_run_test(test_sky_event_unpack_raw_hdr);
+    mu_run_test(test_sky_event_rebase_raw);
 
     return 0;
 }
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <execute_query_message.h>
+#include <lua_aggregate_message.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_execute_query_message_pack() {
+    cleantmp();
+    sky_execute_query_message *message = sky_execute_query_message_create();
+    message->handle = 1;
+    message->arguments = calloc(2, sizeof(*message->arguments));
+    message->arguments[0] = sky_query_argument_create();
+    message->arguments[0]->name = bfromcstr("action");
+    message->arguments[0]->data_type = SKY_DATA_TYPE_INT;
+    message->arguments[0]->int_value = 2;
+    message->arguments[1] = sky_query_argument_create();
+    message->arguments[1]->name = bfromcstr("label");
+    message->arguments[1]->data_type = SKY_DATA_TYPE_STRING;
+    message->arguments[1]->string_value = bfromcstr("foo");
+    message->argument_count = 2;
+
+    FILE *file = fopen("tmp/message", "w");
+    mu_assert_bool(sky_execute_query_message_pack(message, file) == 0);
+    fclose(file);
+    mu_assert_file("tmp/message", "tests/fixtures/execute_query_message/0/message");
+    sky_execute_query_message_free(message);
+    return 0;
+}
+
+int test_sky_execute_query_message_unpack() {
+    FILE *file = fopen("tests/fixtures/execute_query_message/0/message", "r");
+    sky_execute_query_message *message = sky_execute_query_message_create();
+    mu_assert_bool(sky_execute_query_message_unpack(message, file) == 0);
+    fclose(file);
+
+    mu_assert_int_equals(message->handle, 1);
+    mu_assert_int_equals(message->argument_count, 2);
+    mu_assert_bstring(message->arguments[0]->name, "action");
+    mu_assert_int_equals(message->arguments[0]->data_type, SKY_DATA_TYPE_INT);
+    mu_assert_long_equals(message->arguments[0]->int_value, 2L);
+    mu_assert_bstring(message->arguments[1]->name, "label");
+    mu_assert_int_equals(message->arguments[1]->data_type, SKY_DATA_TYPE_STRING);
+    mu_assert_bstring(message->arguments[1]->string_value, "foo");
+    sky_execute_query_message_free(message);
+    return 0;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int test_sky_execute_query_message_worker_map_with_arguments() {
+    importtmp("tests/fixtures/lua_aggregate_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    sky_lua_aggregate_message *message = sky_lua_aggregate_message_create();
+    message->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  data.count = data.count or 0\n"
+        "  while cursor:next() do\n"
+        "    if cursor.event.action_id == action and label == nil then\n"
+        "      data.count = data.count + 1\n"
+        "    end\n"
+        "  end\n"
+        "end\n"
+    );
+    message->parameters = calloc(2, sizeof(bstring));
+    message->parameters[0] = bfromcstr("action");
+    message->parameters[1] = bfromcstr("label");
+    message->parameter_count = 2;
+    message->arguments = calloc(1, sizeof(*message->arguments));
+    message->arguments[0] = sky_query_argument_create();
+    message->arguments[0]->name = bfromcstr("action");
+    message->arguments[0]->data_type = SKY_DATA_TYPE_INT;
+    message->arguments[0]->int_value = 2;
+    message->argument_count = 1;
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    // Parameters without an argument are nil.
+    bstring results = NULL;
+    int rc = sky_lua_aggregate_message_worker_map(worker, table->tablets[0], (void**)&results);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_mem(bdatae(results, ""), "\x81\xA5" "count" "\x02", blength(results));
+
+    bdestroy(results);
+    sky_lua_aggregate_message_free(message);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_execute_query_message_pack);
+    mu_run_test(test_sky_execute_query_message_unpack);
+    mu_run_test(test_sky_execute_query_message_worker_map_with_arguments);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <executor.h>
+#include <mem.h>
+#include <dbg.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+#define TASK_COUNT 1000
+
+typedef struct {
+    sky_executor *executor;
+    int32_t count;
+    int32_t resubmit_count;
+} executor_test_options;
+
+// Increments a counter.
+void increment(void *_options) {
+    executor_test_options *options = (executor_test_options*)_options;
+    __atomic_add_fetch(&options->count, 1, __ATOMIC_SEQ_CST);
+}
+
+// Increments a counter and resubmits itself until it has run enough times.
+void resubmit(void *_options) {
+    executor_test_options *options = (executor_test_options*)_options;
+    if(__atomic_add_fetch(&options->count, 1, __ATOMIC_SEQ_CST) < options->resubmit_count) {
+        sky_executor_submit(options->executor, resubmit, options);
+    }
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Submit
+//--------------------------------------
+
+int test_sky_executor_submit() {
+    executor_test_options options = {.count = 0};
+    sky_executor *executor = sky_executor_create(4);
+    mu_assert_int_equals(sky_executor_submit(executor, increment, &options), -1);
+    mu_assert_int_equals(sky_executor_start(executor), 0);
+
+    // Every queued task runs before the executor stops.
+    int i;
+    for(i=0; i<TASK_COUNT; i++) {
+        mu_assert_int_equals(sky_executor_submit(executor, increment, &options), 0);
+    }
+    mu_assert_int_equals(sky_executor_stop(executor), 0);
+    mu_assert_int_equals(options.count, TASK_COUNT);
+
+    sky_executor_free(executor);
+    return 0;
+}
+
+int test_sky_executor_resubmit() {
+    sky_executor *executor = sky_executor_create(2);
+    executor_test_options options = {.executor = executor, .count = 0, .resubmit_count = TASK_COUNT};
+    mu_assert_int_equals(sky_executor_start(executor), 0);
+
+    // Tasks submitted from a running task still run while stopping.
+    mu_assert_int_equals(sky_executor_submit(executor, resubmit, &options), 0);
+    mu_assert_int_equals(sky_executor_stop(executor), 0);
+    mu_assert_int_equals(options.count, TASK_COUNT);
+
+    sky_executor_free(executor);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_executor_submit);
+    mu_run_test(test_sky_executor_resubmit);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <funnel_message.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+// Runs a funnel message fixture across every tablet of a table and writes
+// the reduced results to tmp/output.
+int run_funnel_message(sky_table *table, const char *path) {
+    sky_funnel_message *message = sky_funnel_message_create();
+    FILE *file = fopen(path, "r");
+    mu_assert_int_equals(sky_funnel_message_unpack(message, file), 0);
+    fclose(file);
+    mu_assert_int_equals(sky_funnel_message_compile(message, table->property_file), 0);
+
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    uint32_t i;
+    for(i=0; i<table->tablet_count; i++) {
+        void *results = NULL;
+        mu_assert_int_equals(sky_funnel_message_worker_map(worker, table->tablets[i], &results), 0);
+        mu_assert_int_equals(sky_funnel_message_worker_reduce(worker, results), 0);
+        sky_funnel_message_worker_map_free(results);
+    }
+
+    FILE *output = fopen("tmp/output", "w");
+    mu_assert_int_equals(sky_funnel_message_worker_write(worker, output), 0);
+    fclose(output);
+
+    sky_funnel_message_worker_free(worker);
+    sky_worker_free(worker);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_funnel_message_unpack() {
+    FILE *file = fopen("tests/fixtures/funnel_message/1/message", "r");
+    sky_funnel_message *message = sky_funnel_message_create();
+    mu_assert_bool(sky_funnel_message_unpack(message, file) == 0);
+    fclose(file);
+
+    mu_assert_int_equals(message->step_count, 3);
+    mu_assert_int_equals(message->within, 0);
+    mu_assert_int_equals(message->session_idle, 100);
+    mu_assert_int_equals(message->steps[0].action_id, 1);
+    mu_assert_int_equals(message->steps[0].filter_index, 0);
+    mu_assert_int_equals(message->steps[0].filter_count, 1);
+    mu_assert_int_equals(message->steps[1].action_id, 2);
+    mu_assert_int_equals(message->steps[1].filter_index, 1);
+    mu_assert_int_equals(message->steps[1].filter_count, 2);
+    mu_assert_int_equals(message->steps[2].action_id, 3);
+    mu_assert_int_equals(message->steps[2].filter_index, 3);
+    mu_assert_int_equals(message->steps[2].filter_count, 1);
+
+    sky_query_plan *plan = message->plan;
+    mu_assert_int_equals(plan->filter_count, 4);
+    mu_assert_bstring(plan->filters[1].field_name, "action_id");
+    mu_assert_long_equals(plan->filters[1].value->int_value, 2L);
+    mu_assert_bstring(plan->filters[2].field_name, "price");
+    mu_assert_int_equals(plan->filters[2].op, SKY_QUERY_OP_GE);
+    mu_assert_long_equals(plan->filters[2].value->int_value, 10L);
+    sky_funnel_message_free(message);
+    return 0;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int test_sky_funnel_message_worker_within() {
+    importtmp("tests/fixtures/funnel_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    mu_assert_int_equals(run_funnel_message(table, "tests/fixtures/funnel_message/0/message"), 0);
+    mu_assert_file("tmp/output", "tests/fixtures/funnel_message/0/output");
+
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_funnel_message_worker_session_idle() {
+    importtmp("tests/fixtures/funnel_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    mu_assert_int_equals(run_funnel_message(table, "tests/fixtures/funnel_message/1/message"), 0);
+    mu_assert_file("tmp/output", "tests/fixtures/funnel_message/1/output");
+
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_funnel_message_worker_unbounded() {
+    importtmp("tests/fixtures/funnel_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    mu_assert_int_equals(run_funnel_message(table, "tests/fixtures/funnel_message/2/message"), 0);
+    mu_assert_file("tmp/output", "tests/fixtures/funnel_message/2/output");
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_funnel_message_unpack);
+    mu_run_test(test_sky_funnel_message_worker_within);
+    mu_run_test(test_sky_funnel_message_worker_session_idle);
+    mu_run_test(test_sky_funnel_message_worker_unbounded);
+    return 0;
+}
+
+RUN_TESTS()
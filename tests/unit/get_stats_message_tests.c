@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <get_stats_message.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_get_stats_message_pack() {
+    cleantmp();
+    sky_get_stats_message *message = sky_get_stats_message_create();
+    
+    FILE *file = fopen("tmp/message", "w");
+    mu_assert_bool(sky_get_stats_message_pack(message, file) == 0);
+    fclose(file);
+    mu_assert_file("tmp/message", "tests/fixtures/get_stats_message/0/message");
+    sky_get_stats_message_free(message);
+    return 0;
+}
+
+int test_sky_get_stats_message_unpack() {
+    FILE *file = fopen("tests/fixtures/get_stats_message/0/message", "r");
+    sky_get_stats_message *message = sky_get_stats_message_create();
+    mu_assert_bool(sky_get_stats_message_unpack(message, file) == 0);
+    fclose(file);
+
+    sky_get_stats_message_free(message);
+    return 0;
+}
+
+
+//--------------------------------------
+// Processing
+//--------------------------------------
+
+int test_sky_get_stats_message_process() {
+    cleantmp();
+    sky_server *server = sky_server_create(NULL);
+    sky_message_header *header = sky_message_header_create();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    // Add two events in order and one out of order.
+    struct tagbstring foo_str = bsStatic("foo");
+    sky_event *event = sky_event_create(&foo_str, 2000000LL, 1);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    event->timestamp = 3000000LL;
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    event->timestamp = 1000000LL;
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    
+    FILE *input = fopen("tests/fixtures/get_stats_message/1/input", "r");
+    FILE *output = fopen("tmp/output", "w");
+    int rc = sky_get_stats_message_process(server, header, table, input, output);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_file("tmp/output", "tests/fixtures/get_stats_message/1/output");
+
+    sky_table_free(table);
+    sky_message_header_free(header);
+    sky_server_free(server);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_get_stats_message_pack);
+    mu_run_test(test_sky_get_stats_message_unpack);
+    mu_run_test(test_sky_get_stats_message_process);
+    return 0;
+}
+
+RUN_TESTS()
\ No newline at end of file
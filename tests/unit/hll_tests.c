@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <hll.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Sketching
+//--------------------------------------
+
+int test_sky_hll_count_small() {
+    int64_t i;
+    sky_hll *hll = sky_hll_create();
+    mu_assert_bool(sky_hll_count(hll) == 0);
+    for(i=0; i<10; i++) {
+        sky_hll_add_int(hll, i);
+        sky_hll_add_int(hll, i);
+    }
+    sky_hll_add_string(hll, "foo", 3);
+    sky_hll_add_string(hll, "foo", 3);
+    mu_assert_bool(sky_hll_count(hll) == 11);
+    sky_hll_free(hll);
+    return 0;
+}
+
+int test_sky_hll_count_large() {
+    int64_t i;
+    sky_hll *hll = sky_hll_create();
+    for(i=0; i<1000000; i++) {
+        sky_hll_add_int(hll, i * 7);
+    }
+    double count = sky_hll_count(hll);
+    mu_assert_bool(fabs(count - 1000000) < 1000000 * 0.03);
+    sky_hll_free(hll);
+    return 0;
+}
+
+int test_sky_hll_add_number() {
+    sky_hll *hll1 = sky_hll_create();
+    sky_hll *hll2 = sky_hll_create();
+    sky_hll_add_int(hll1, -20);
+    sky_hll_add_number(hll2, -20.0);
+    mu_assert_mem(hll1->registers, hll2->registers, SKY_HLL_REGISTER_COUNT);
+    sky_hll_add_number(hll2, 1.5);
+    mu_assert_bool(sky_hll_count(hll2) == 2);
+    sky_hll_free(hll1);
+    sky_hll_free(hll2);
+    return 0;
+}
+
+int test_sky_hll_merge() {
+    int64_t i;
+    sky_hll *hll = sky_hll_create();
+    sky_hll *hll1 = sky_hll_create();
+    sky_hll *hll2 = sky_hll_create();
+    for(i=0; i<50000; i++) {
+        sky_hll_add_int(hll, i);
+        sky_hll_add_int((i % 2 == 0 ? hll1 : hll2), i);
+    }
+    sky_hll_merge(hll1, hll2);
+    mu_assert_mem(hll1->registers, hll->registers, SKY_HLL_REGISTER_COUNT);
+    sky_hll_free(hll);
+    sky_hll_free(hll1);
+    sky_hll_free(hll2);
+    return 0;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_hll_pack_sparse() {
+    char buffer[SKY_HLL_MAX_PACKED_SZ];
+    sky_hll *hll = sky_hll_create();
+    sky_hll *ret = sky_hll_create();
+    sky_hll_add_string(hll, "foo", 3);
+    sky_hll_add_string(hll, "bar", 3);
+    mu_assert_int_equals(sky_hll_pack(hll, buffer), SKY_HLL_HEADER_SZ + 6);
+    mu_assert_mem(buffer, SKY_HLL_MAGIC "\x0E\x00", SKY_HLL_HEADER_SZ);
+    mu_assert_bool(sky_hll_is_packed(buffer, SKY_HLL_HEADER_SZ + 6));
+    mu_assert_int_equals(sky_hll_unpack(ret, buffer, SKY_HLL_HEADER_SZ + 6), 0);
+    mu_assert_mem(ret->registers, hll->registers, SKY_HLL_REGISTER_COUNT);
+    sky_hll_free(hll);
+    sky_hll_free(ret);
+    return 0;
+}
+
+int test_sky_hll_pack_dense() {
+    int64_t i;
+    char buffer[SKY_HLL_MAX_PACKED_SZ];
+    sky_hll *hll = sky_hll_create();
+    sky_hll *ret = sky_hll_create();
+    for(i=0; i<100000; i++) {
+        sky_hll_add_int(hll, i);
+    }
+    mu_assert_int_equals(sky_hll_pack(hll, buffer), SKY_HLL_DENSE_SZ);
+    mu_assert_mem(buffer, SKY_HLL_MAGIC "\x0E\x01", SKY_HLL_HEADER_SZ);
+    mu_assert_int_equals(sky_hll_unpack(ret, buffer, SKY_HLL_DENSE_SZ), 0);
+    mu_assert_mem(ret->registers, hll->registers, SKY_HLL_REGISTER_COUNT);
+    sky_hll_free(hll);
+    sky_hll_free(ret);
+    return 0;
+}
+
+int test_sky_hll_unpack_invalid() {
+    sky_hll *hll = sky_hll_create();
+    mu_assert_int_equals(sky_hll_unpack(hll, "foo", 3), -1);
+    mu_assert_int_equals(sky_hll_unpack(hll, SKY_HLL_MAGIC "\x0C\x00", SKY_HLL_HEADER_SZ), -1);
+    mu_assert_int_equals(sky_hll_unpack(hll, SKY_HLL_MAGIC "\x0E\x00\x01", SKY_HLL_HEADER_SZ + 1), -1);
+    mu_assert_int_equals(sky_hll_unpack(hll, SKY_HLL_MAGIC "\x0E\x01\x01", SKY_HLL_HEADER_SZ + 1), -1);
+    sky_hll_free(hll);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_hll_count_small);
+    mu_run_test(test_sky_hll_count_large);
+    mu_run_test(test_sky_hll_add_number);
+    mu_run_test(test_sky_hll_merge);
+    mu_run_test(test_sky_hll_pack_sparse);
+    mu_run_test(test_sky_hll_pack_dense);
+    mu_run_test(test_sky_hll_unpack_invalid);
+    return 0;
+}
+
+RUN_TESTS()
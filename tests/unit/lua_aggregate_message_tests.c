@@ -2,6 +2,8 @@
 #include <stdlib.h>
 
 #include <lua_aggregate_message.h>
+#include <hll.h>
+#include <tdigest.h>
 #include <sky_string.h>
 #include <dbg.h>
 #include <mem.h>
@@ -92,6 +94,196 @@ int test_sky_lua_aggregate_message_worker_map() {
     return 0;
 }
 
+int test_sky_lua_aggregate_message_worker_map_with_dictionary() {
+    importtmp("tests/fixtures/lua_aggregate_message/1/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    sky_lua_aggregate_message *message = sky_lua_aggregate_message_create();
+    message->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  event = cursor.event\n"
+        "  data.count = data.count or 0\n"
+        "  \n"
+        "  while cursor:next() do\n"
+        "    mystr = event:mystr()\n"
+        "    data.count = data.count + 1\n"
+        "    data[event.action_id] = (data[event.action_id] or 0) + 1\n"
+        "    data[mystr] = (data[mystr] or 0) + event:mystr_code()\n"
+        "  end\n"
+        "end"
+    );
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    bstring results = NULL;
+    int rc = sky_lua_aggregate_message_worker_map(worker, table->tablets[0], (void**)&results);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_int_equals(blength(results), 31);
+    mu_assert_mem(
+        bdatae(results, ""), 
+        "\x88\x01\x02\x02\x02\x03\x01\x04\x01\xA3" "baz" "\x06\xA5" "count" "\x06\xA3" "foo" "\x03\xA3" "bar" "\x02",
+        blength(results)
+    );
+
+    bdestroy(results);
+    sky_lua_aggregate_message_free(message);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_lua_aggregate_message_worker_map_shared() {
+    importtmp("tests/fixtures/lua_aggregate_message/0/import.json");
+    sky_server *server = sky_server_create(NULL);
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->name = bfromcstr("foo");
+    sky_table_open(table);
+    sky_servlet *servlet = sky_servlet_create(server, table->tablets[0]);
+
+    sky_lua_aggregate_message *message1 = sky_lua_aggregate_message_create();
+    message1->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  event = cursor.event\n"
+        "  data.count = data.count or 0\n"
+        "  \n"
+        "  while cursor:next() do\n"
+        "    mystr = event:mystr()\n"
+        "    data.count = data.count + 1\n"
+        "    data[event.action_id] = (data[event.action_id] or 0) + 1\n"
+        "    data[mystr] = (data[mystr] or 0) + 1\n"
+        "  end\n"
+        "end"
+    );
+    sky_lua_aggregate_message *message2 = sky_lua_aggregate_message_create();
+    message2->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  data.paths = (data.paths or 0) + 1\n"
+        "end"
+    );
+    sky_worker *worker1 = sky_worker_create();
+    worker1->data = (void*)message1;
+    sky_worker *worker2 = sky_worker_create();
+    worker2->data = (void*)message2;
+    sky_worklet *worklets[2];
+    worklets[0] = sky_worklet_create(worker1);
+    worklets[1] = sky_worklet_create(worker2);
+
+    // Both queries are answered from a single pass over the tablet.
+    sky_morsel morsel;
+    memset(&morsel, 0, sizeof(morsel));
+    morsel.tablet = table->tablets[0];
+    void *context = NULL;
+    void **results = NULL;
+    int rc = sky_lua_aggregate_message_worker_map_shared(worklets, 2, servlet, &morsel, &context, &results);
+    mu_assert_int_equals(rc, 0);
+    bstring results1 = (bstring)results[0];
+    mu_assert_int_equals(blength(results1), 31);
+    mu_assert_mem(
+        bdatae(results1, ""), 
+        "\x88\x01\x02\x02\x02\x03\x01\x04\x01\xA3" "baz" "\x02\xA5" "count" "\x06\xA3" "foo" "\x03\xA3" "bar" "\x01",
+        blength(results1)
+    );
+    bstring results2 = (bstring)results[1];
+    mu_assert_int_equals(blength(results2), 8);
+    mu_assert_mem(bdatae(results2, ""), "\x81\xA5" "paths" "\x02", blength(results2));
+    bdestroy(results1);
+    bdestroy(results2);
+    free(results);
+
+    // The thread's context decodes paths through the union of the queries'
+    // descriptors and is reused for its next morsel.
+    sky_lua_aggregate_shared_context *ctx = (sky_lua_aggregate_shared_context*)context;
+    mu_assert_int_equals(ctx->descriptor->active_property_count, 1);
+    rc = sky_lua_aggregate_message_worker_map_shared(worklets, 2, servlet, &morsel, &context, &results);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(context == (void*)ctx);
+    mu_assert_int_equals(blength((bstring)results[0]), 31);
+    bdestroy((bstring)results[0]);
+    bdestroy((bstring)results[1]);
+    free(results);
+    sky_lua_aggregate_message_shared_context_free(context);
+
+    sky_worklet_free(worklets[0]);
+    sky_worklet_free(worklets[1]);
+    sky_lua_aggregate_message_free(message1);
+    sky_lua_aggregate_message_free(message2);
+    sky_worker_free(worker1);
+    sky_worker_free(worker2);
+    sky_servlet_free(servlet);
+    sky_table_free(table);
+    sky_server_free(server);
+    return 0;
+}
+
+int test_sky_worker_map_shared() {
+    importtmp("tests/fixtures/lua_aggregate_message/0/import.json");
+    sky_server *server = sky_server_create(NULL);
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->name = bfromcstr("foo");
+    sky_table_open(table);
+    sky_servlet *servlet = sky_servlet_create(server, table->tablets[0]);
+
+    sky_lua_aggregate_message *message1 = sky_lua_aggregate_message_create();
+    message1->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  while cursor:next() do\n"
+        "    data[cursor.event:mystr()] = (data[cursor.event:mystr()] or 0) + 1\n"
+        "  end\n"
+        "end"
+    );
+    sky_lua_aggregate_message *message2 = sky_lua_aggregate_message_create();
+    message2->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  error('boom')\n"
+        "end"
+    );
+    sky_worker *workers[2];
+    sky_worklet *worklets[2];
+    uint32_t i;
+    for(i=0; i<2; i++) {
+        workers[i] = sky_worker_create();
+        workers[i]->data = (void*)(i == 0 ? message1 : message2);
+        workers[i]->map_shared = sky_lua_aggregate_message_worker_map_shared;
+        workers[i]->shared_context_free = sky_lua_aggregate_message_shared_context_free;
+        workers[i]->map_free = sky_lua_aggregate_message_worker_map_free;
+        workers[i]->scheduler = sky_morsel_scheduler_create(1);
+        worklets[i] = sky_worklet_create(workers[i]);
+    }
+
+    // Each worker's output is attached to its own morsel set to be reduced.
+    int rc = sky_worker_map_shared(worklets, 2, servlet);
+    mu_assert_int_equals(rc, 0);
+    sky_morsel_set *set = &workers[0]->scheduler->sets[0];
+    mu_assert_bool(set->published);
+    mu_assert_int_equals(set->morsel_count, 1);
+    mu_assert_bool(set->head == set->tail);
+    bstring results = (bstring)set->morsels[0].data;
+    mu_assert_int_equals(blength(results), 16);
+    mu_assert_mem(bdatae(results, ""), "\x83\xA3" "baz" "\x02\xA3" "foo" "\x03\xA3" "bar" "\x01", blength(results));
+    mu_assert_bool(!worklets[0]->failed);
+    mu_assert_bool(workers[0]->service_time > 0);
+
+    // A query whose script fails is marked as failed without affecting the
+    // other query.
+    mu_assert_bool(worklets[1]->failed);
+    mu_assert_bool(workers[1]->scheduler->sets[0].morsels[0].data == NULL);
+
+    for(i=0; i<2; i++) {
+        sky_worklet_free(worklets[i]);
+        sky_worker_free(workers[i]);
+    }
+    sky_lua_aggregate_message_free(message1);
+    sky_lua_aggregate_message_free(message2);
+    sky_servlet_free(servlet);
+    sky_table_free(table);
+    sky_server_free(server);
+    return 0;
+}
+
 int test_sky_lua_aggregate_message_worker_reduce() {
     int rc;
     importtmp("tests/fixtures/lua_aggregate_message/0/import.json");
@@ -109,7 +301,7 @@ int test_sky_lua_aggregate_message_worker_reduce() {
         "  return results\n"
         "end"
     );
-    rc = sky_lua_initscript_with_table(message->source, table, NULL, &message->L);
+    rc = sky_lua_cache_checkout(NULL, message->source, table, &message->entry);
     mu_assert_int_equals(rc, 0);
     sky_worker *worker = sky_worker_create();
     worker->data = (void*)message;
@@ -133,6 +325,110 @@ int test_sky_lua_aggregate_message_worker_reduce() {
 }
 
 
+int test_sky_lua_aggregate_message_worker_hll() {
+    int rc;
+    importtmp("tests/fixtures/lua_aggregate_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    sky_lua_aggregate_message *message = sky_lua_aggregate_message_create();
+    message->results = bfromcstr("\x80");
+    message->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  event = cursor.event\n"
+        "  data.actions = data.actions or sky_hll()\n"
+        "  while cursor:next() do\n"
+        "    data.actions:add(event.action_id)\n"
+        "  end\n"
+        "end\n"
+        "function merge(results, data)\n"
+        "  results.actions = (results.actions or sky_hll()):merge(data.actions)\n"
+        "end"
+    );
+    rc = sky_lua_cache_checkout(NULL, message->source, table, &message->entry);
+    mu_assert_int_equals(rc, 0);
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    // The sketch is packed sparsely into the map results.
+    bstring results = NULL;
+    rc = sky_lua_aggregate_message_worker_map(worker, table->tablets[0], (void**)&results);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_int_equals(blength(results), 28);
+    mu_assert_mem(bdatae(results, ""), "\x81\xA7" "actions" "\xB2" SKY_HLL_MAGIC "\x0E\x00", 16);
+
+    // Merging the same sketch twice doesn't change the count.
+    rc = sky_lua_aggregate_message_worker_reduce(worker, results);
+    mu_assert_int_equals(rc, 0);
+    rc = sky_lua_aggregate_message_worker_reduce(worker, results);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_int_equals(blength(message->results), 28);
+
+    FILE *output = fopen("tmp/output", "w");
+    mu_assert_int_equals(sky_lua_aggregate_message_worker_write(worker, output), 0);
+    fclose(output);
+    mu_assert_file("tmp/output", "tests/fixtures/lua_aggregate_message/2/output");
+
+    bdestroy(results);
+    sky_lua_aggregate_message_free(message);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_lua_aggregate_message_worker_tdigest() {
+    int rc;
+    importtmp("tests/fixtures/lua_aggregate_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    sky_lua_aggregate_message *message = sky_lua_aggregate_message_create();
+    message->results = bfromcstr("\x80");
+    message->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  event = cursor.event\n"
+        "  data.actions = data.actions or sky_tdigest()\n"
+        "  while cursor:next() do\n"
+        "    data.actions:add(event.action_id)\n"
+        "  end\n"
+        "end\n"
+        "function merge(results, data)\n"
+        "  results.actions = (results.actions or sky_tdigest()):merge(data.actions)\n"
+        "end"
+    );
+    rc = sky_lua_cache_checkout(NULL, message->source, table, &message->entry);
+    mu_assert_int_equals(rc, 0);
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    // The digest is packed with one centroid per event.
+    bstring results = NULL;
+    rc = sky_lua_aggregate_message_worker_map(worker, table->tablets[0], (void**)&results);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_int_equals(blength(results), 132);
+    mu_assert_mem(bdatae(results, ""), "\x81\xA7" "actions" "\xDA\x00\x78" SKY_TDIGEST_MAGIC "\x00\x00\x00\x06", 20);
+
+    rc = sky_lua_aggregate_message_worker_reduce(worker, results);
+    mu_assert_int_equals(rc, 0);
+    rc = sky_lua_aggregate_message_worker_reduce(worker, results);
+    mu_assert_int_equals(rc, 0);
+
+    FILE *output = fopen("tmp/output", "w");
+    mu_assert_int_equals(sky_lua_aggregate_message_worker_write(worker, output), 0);
+    fclose(output);
+    mu_assert_file("tmp/output", "tests/fixtures/lua_aggregate_message/3/output");
+
+    bdestroy(results);
+    sky_lua_aggregate_message_free(message);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
+
 //==============================================================================
 //
 // Setup
@@ -143,7 +439,12 @@ int all_tests() {
     mu_run_test(test_sky_lua_aggregate_message_pack);
     mu_run_test(test_sky_lua_aggregate_message_unpack);
     mu_run_test(test_sky_lua_aggregate_message_worker_map);
+    mu_run_test(test_sky_lua_aggregate_message_worker_map_with_dictionary);
+    mu_run_test(test_sky_lua_aggregate_message_worker_map_shared);
+    mu_run_test(test_sky_worker_map_shared);
     mu_run_test(test_sky_lua_aggregate_message_worker_reduce);
+    mu_run_test(test_sky_lua_aggregate_message_worker_hll);
+    mu_run_test(test_sky_lua_aggregate_message_worker_tdigest);
     return 0;
 }
 
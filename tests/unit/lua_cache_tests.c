@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lua_cache.h>
+#include <mem.h>
+#include <dbg.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Fixtures
+//
+//==============================================================================
+
+struct tagbstring SOURCE_1 = bsStatic("function aggregate(cursor, data) return 1 end\n");
+struct tagbstring SOURCE_2 = bsStatic("function aggregate(cursor, data) return 2 end\n");
+struct tagbstring SOURCE_3 = bsStatic("function aggregate(cursor, data) return 3 end\n");
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Lookup
+//--------------------------------------
+
+int test_sky_lua_cache_checkout() {
+    importtmp("tests/fixtures/sky_lua/0/data.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+    sky_lua_cache *cache = sky_lua_cache_create(4);
+
+    // The first checkout compiles the script.
+    sky_lua_cache_entry *entry1 = NULL;
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_1, table, &entry1), 0);
+    mu_assert_bool(entry1 != NULL && entry1->L != NULL && entry1->descriptor != NULL);
+    mu_assert_long_equals(cache->miss_count, 1L);
+    sky_lua_cache_checkin(cache, entry1);
+    mu_assert_int_equals(cache->count, 1);
+
+    // The same source reuses the compiled script.
+    sky_lua_cache_entry *entry2 = NULL;
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_1, table, &entry2), 0);
+    mu_assert_bool(entry2 == entry1);
+    mu_assert_long_equals(cache->hit_count, 1L);
+    mu_assert_int_equals(cache->count, 0);
+
+    // A script that is checked out is not shared.
+    sky_lua_cache_entry *entry3 = NULL;
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_1, table, &entry3), 0);
+    mu_assert_bool(entry3 != entry2);
+    sky_lua_cache_checkin(cache, entry2);
+    sky_lua_cache_checkin(cache, entry3);
+    mu_assert_int_equals(cache->count, 2);
+
+    sky_lua_cache_free(cache);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_lua_cache_invalidate() {
+    importtmp("tests/fixtures/sky_lua/0/data.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+    sky_lua_cache *cache = sky_lua_cache_create(4);
+
+    sky_lua_cache_entry *entry = NULL;
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_1, table, &entry), 0);
+    sky_lua_cache_checkin(cache, entry);
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_2, table, &entry), 0);
+    sky_lua_cache_checkin(cache, entry);
+    mu_assert_int_equals(cache->count, 2);
+
+    // Adding a property discards every script compiled for the old version.
+    sky_property *property = sky_property_create();
+    property->type = SKY_PROPERTY_TYPE_OBJECT;
+    property->data_type = SKY_DATA_TYPE_INT;
+    property->name = bfromcstr("new_property");
+    mu_assert_int_equals(sky_property_file_add_property(table->property_file, property), 0);
+
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_1, table, &entry), 0);
+    mu_assert_int_equals(cache->count, 0);
+    mu_assert_long_equals(cache->hit_count, 0L);
+    mu_assert_long_equals(cache->miss_count, 3L);
+    mu_assert_bool(entry->version == sky_property_file_get_version(table->property_file));
+    sky_lua_cache_checkin(cache, entry);
+
+    sky_lua_cache_free(cache);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_lua_cache_evict() {
+    importtmp("tests/fixtures/sky_lua/0/data.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+    sky_lua_cache *cache = sky_lua_cache_create(2);
+
+    sky_lua_cache_entry *entry = NULL;
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_1, table, &entry), 0);
+    sky_lua_cache_checkin(cache, entry);
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_2, table, &entry), 0);
+    sky_lua_cache_checkin(cache, entry);
+
+    // Use the first script so that the second is least recently used.
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_1, table, &entry), 0);
+    sky_lua_cache_checkin(cache, entry);
+    mu_assert_int_equals(sky_lua_cache_checkout(cache, &SOURCE_3, table, &entry), 0);
+    sky_lua_cache_checkin(cache, entry);
+    mu_assert_int_equals(cache->count, 2);
+    mu_assert_bool(biseq(cache->head->source, &SOURCE_3));
+    mu_assert_bool(biseq(cache->tail->source, &SOURCE_1));
+
+    sky_lua_cache_free(cache);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_lua_cache_checkout);
+    mu_run_test(test_sky_lua_cache_invalidate);
+    mu_run_test(test_sky_lua_cache_evict);
+    return 0;
+}
+
+RUN_TESTS()
@@ -47,6 +47,38 @@ int test_sky_next_actions_message_unpack() {
     return 0;
 }
 
+int test_sky_next_actions_message_pack_sample() {
+    cleantmp();
+    sky_next_actions_message *message = sky_next_actions_message_create();
+    message->prior_action_id_count = 2;
+    message->prior_action_ids = calloc(message->prior_action_id_count, sizeof(*message->prior_action_ids));
+    message->prior_action_ids[0] = 1;
+    message->prior_action_ids[1] = 2;
+    message->sample_rate = 0.3;
+    
+    FILE *file = fopen("tmp/message", "w");
+    mu_assert_bool(sky_next_actions_message_pack(message, file) == 0);
+    fclose(file);
+    mu_assert_file("tmp/message", "tests/fixtures/next_actions_message/4/message");
+    sky_next_actions_message_free(message);
+    return 0;
+}
+
+int test_sky_next_actions_message_unpack_sample() {
+    FILE *file = fopen("tests/fixtures/next_actions_message/4/message", "r");
+    sky_next_actions_message *message = sky_next_actions_message_create();
+    mu_assert_bool(sky_next_actions_message_unpack(message, file) == 0);
+    fclose(file);
+
+    mu_assert_int_equals(message->prior_action_id_count, 2);
+    mu_assert_int_equals(message->prior_action_ids[0], 1);
+    mu_assert_int_equals(message->prior_action_ids[1], 2);
+    mu_assert_bool(message->sample_rate == 0.3);
+    sky_next_actions_message_free(message);
+    return 0;
+}
+
+
 
 //--------------------------------------
 // Worker
@@ -84,6 +116,7 @@ int test_sky_next_actions_message_worker_map() {
     message->prior_action_ids[0] = 1;
     message->prior_action_ids[1] = 2;
     sky_next_actions_message_init_data_descriptor(message, table->property_file);
+    mu_assert_int_equals(sky_next_actions_message_compile(message), 0);
     sky_worker *worker = sky_worker_create();
     worker->data = (void*)message;
 
@@ -104,6 +137,73 @@ int test_sky_next_actions_message_worker_map() {
     return 0;
 }
 
+int test_sky_next_actions_message_worker_map_pattern() {
+    importtmp("tests/fixtures/next_actions_message/1/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    sky_next_actions_message *message = sky_next_actions_message_create();
+    message->action_count = table->action_file->action_count;
+    sky_next_actions_message_init_data_descriptor(message, table->property_file);
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    FILE *file = fopen("tests/fixtures/next_actions_message/3/message", "r");
+    mu_assert_int_equals(sky_next_actions_message_worker_read(worker, file), 0);
+    fclose(file);
+    mu_assert_bstring(message->pattern_source, "1 (2|3)");
+
+    sky_next_actions_result *results;
+    int rc = sky_next_actions_message_worker_map(worker, table->tablets[0], (void*)&results);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_int_equals(results[0].count, 0);
+    mu_assert_int_equals(results[1].count, 1);
+    mu_assert_int_equals(results[2].count, 0);
+    mu_assert_int_equals(results[3].count, 2);
+    mu_assert_int_equals(results[4].count, 1);
+
+    sky_next_actions_message_worker_map_free(results);
+    sky_next_actions_message_free(message);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_next_actions_message_worker_map_sample() {
+    importtmp("tests/fixtures/next_actions_message/1/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    sky_next_actions_message *message = sky_next_actions_message_create();
+    message->action_count = table->action_file->action_count;
+    sky_next_actions_message_init_data_descriptor(message, table->property_file);
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    FILE *file = fopen("tests/fixtures/next_actions_message/4/message", "r");
+    mu_assert_int_equals(sky_next_actions_message_worker_read(worker, file), 0);
+    fclose(file);
+
+    sky_next_actions_result *results;
+    int rc = sky_next_actions_message_worker_map(worker, table->tablets[0], (void*)&results);
+    mu_assert_int_equals(rc, 0);
+    // Only objects "3" and "5" are in the sample.
+    mu_assert_long_equals(message->path_count, 2L);
+    mu_assert_int_equals(results[0].count, 0);
+    mu_assert_int_equals(results[1].count, 0);
+    mu_assert_int_equals(results[2].count, 0);
+    mu_assert_int_equals(results[3].count, 2);
+    mu_assert_int_equals(results[4].count, 1);
+
+    sky_next_actions_message_worker_map_free(results);
+    sky_next_actions_message_free(message);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
 int test_sky_next_actions_message_worker_reduce() {
     sky_next_actions_message *message = sky_next_actions_message_create();
     message->action_count = 2;
@@ -158,6 +258,30 @@ int test_sky_next_actions_message_worker_write() {
     return 0;
 }
 
+int test_sky_next_actions_message_worker_write_sample() {
+    sky_next_actions_message *message = sky_next_actions_message_create();
+    message->action_count = 2;
+    message->sample_rate = 0.5;
+    message->results = calloc(message->action_count+1, sizeof(*message->results));
+    message->results[1].count = 2;
+    sky_sample_variance_add(&message->results[1].variance, 1, 1);
+    sky_sample_variance_add(&message->results[1].variance, 2, 1);
+    message->results[2].count = 6;
+    sky_sample_variance_add(&message->results[2].variance, 1, 6);
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    FILE *file = fopen("tmp/message", "w");
+    int rc = sky_next_actions_message_worker_write(worker, file);
+    mu_assert_int_equals(rc, 0);
+    fclose(file);
+    mu_assert_file("tmp/message", "tests/fixtures/next_actions_message/4/output");
+
+    sky_next_actions_message_free(message);
+    sky_worker_free(worker);
+    return 0;
+}
+
 
 //==============================================================================
 //
@@ -168,10 +292,15 @@ int test_sky_next_actions_message_worker_write() {
 int all_tests() {
     mu_run_test(test_sky_next_actions_message_pack);
     mu_run_test(test_sky_next_actions_message_unpack);
+    mu_run_test(test_sky_next_actions_message_pack_sample);
+    mu_run_test(test_sky_next_actions_message_unpack_sample);
     mu_run_test(test_sky_next_actions_message_worker_read);
     mu_run_test(test_sky_next_actions_message_worker_map);
+    mu_run_test(test_sky_next_actions_message_worker_map_pattern);
+    mu_run_test(test_sky_next_actions_message_worker_map_sample);
     mu_run_test(test_sky_next_actions_message_worker_reduce);
     mu_run_test(test_sky_next_actions_message_worker_write);
+    mu_run_test(test_sky_next_actions_message_worker_write_sample);
     return 0;
 }
 
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <object_state_message.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_object_state_message_pack() {
+    cleantmp();
+    sky_object_state_message *message = sky_object_state_message_create();
+    message->object_id_count = 4;
+    message->object_ids = calloc(message->object_id_count, sizeof(bstring));
+    message->object_ids[0] = bfromcstr("1");
+    message->object_ids[1] = bfromcstr("2");
+    message->object_ids[2] = bfromcstr("3");
+    message->object_ids[3] = bfromcstr("4");
+    message->timestamp = 2500000LL;
+    message->property_name_count = 6;
+    message->property_names = calloc(message->property_name_count, sizeof(bstring));
+    message->property_names[0] = bfromcstr("plan");
+    message->property_names[1] = bfromcstr("country");
+    message->property_names[2] = bfromcstr("score");
+    message->property_names[3] = bfromcstr("active");
+    message->property_names[4] = bfromcstr("price");
+    message->property_names[5] = bfromcstr("missing");
+
+    FILE *file = fopen("tmp/message", "w");
+    mu_assert_bool(sky_object_state_message_pack(message, file) == 0);
+    fclose(file);
+    mu_assert_file("tmp/message", "tests/fixtures/object_state_message/0/message");
+    sky_object_state_message_free(message);
+    return 0;
+}
+
+int test_sky_object_state_message_unpack() {
+    FILE *file = fopen("tests/fixtures/object_state_message/0/message", "r");
+    sky_object_state_message *message = sky_object_state_message_create();
+    mu_assert_bool(sky_object_state_message_unpack(message, file) == 0);
+    fclose(file);
+
+    mu_assert_int_equals(message->object_id_count, 4);
+    mu_assert_bstring(message->object_ids[0], "1");
+    mu_assert_bstring(message->object_ids[3], "4");
+    mu_assert_int64_equals(message->timestamp, 2500000LL);
+    mu_assert_int_equals(message->property_name_count, 6);
+    mu_assert_bstring(message->property_names[0], "plan");
+    mu_assert_bstring(message->property_names[5], "missing");
+    sky_object_state_message_free(message);
+    return 0;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int test_sky_object_state_message_worker() {
+    importtmp("tests/fixtures/object_state_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    sky_object_state_message *message = sky_object_state_message_create();
+    FILE *file = fopen("tests/fixtures/object_state_message/0/message", "r");
+    mu_assert_int_equals(sky_object_state_message_unpack(message, file), 0);
+    fclose(file);
+    mu_assert_int_equals(sky_object_state_message_init(message, table), 0);
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    // Each tablet only looks up its own objects.
+    uint32_t i;
+    void *results = NULL;
+    for(i=0; i<table->tablet_count; i++) {
+        mu_assert_int_equals(sky_object_state_message_worker_map(worker, table->tablets[i], &results), 0);
+    }
+
+    FILE *output = fopen("tmp/output", "w");
+    mu_assert_int_equals(sky_object_state_message_worker_write(worker, output), 0);
+    fclose(output);
+    mu_assert_file("tmp/output", "tests/fixtures/object_state_message/0/output");
+
+    sky_object_state_message_worker_free(worker);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_object_state_message_pack);
+    mu_run_test(test_sky_object_state_message_unpack);
+    mu_run_test(test_sky_object_state_message_worker);
+    return 0;
+}
+
+RUN_TESTS()
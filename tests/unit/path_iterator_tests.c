@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <math.h>
 
 #include <path_iterator.h>
@@ -8,6 +9,20 @@
 
 #include "../minunit.h"
 
+//==============================================================================
+//
+// Declarations
+//
+//==============================================================================
+
+typedef struct {
+    uint32_t timestamp;
+    sky_timestamp_t ts;
+    sky_action_id_t action_id;
+    int64_t value;
+} test_t;
+
+
 //==============================================================================
 //
 // Test Cases
@@ -27,25 +42,277 @@ int test_sky_path_iterator_next() {
 
     sky_path_iterator *iterator = sky_path_iterator_create();
     sky_path_iterator_set_tablet(iterator, table->tablets[0]);
-    mu_assert_mem(iterator->cursor.startptr, "\x01\x00\x00\x00\x00\x00\x00\x00\x00\x01\x00", iterator->cursor.endptr-iterator->cursor.startptr);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x00\x00\x00\x00\x00\x00\x01", iterator->cursor.endptr-iterator->cursor.startptr);
 
     rc = sky_path_iterator_next(iterator);
     mu_assert_int_equals(rc, 0);
-    mu_assert_mem(iterator->cursor.startptr, "\x01\x00\x00\x10\x00\x00\x00\x00\x00\x02\x00", iterator->cursor.endptr-iterator->cursor.startptr);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x10\x00\x00\x00\x00\x00\x02", iterator->cursor.endptr-iterator->cursor.startptr);
+    
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x20\x00\x00\x00\x00\x00\x01", iterator->cursor.endptr-iterator->cursor.startptr);
     
     rc = sky_path_iterator_next(iterator);
     mu_assert_int_equals(rc, 0);
-    mu_assert_mem(iterator->cursor.startptr, "\x01\x00\x00\x20\x00\x00\x00\x00\x00\x01\x00", iterator->cursor.endptr-iterator->cursor.startptr);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x20\x00\x00\x00\x00\x00\x01", iterator->cursor.endptr-iterator->cursor.startptr);
     
+    sky_path_iterator_free(iterator);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_path_iterator_set_range() {
+    int rc;
+    struct tagbstring start = bsStatic("2");
+    struct tagbstring end = bsStatic("4");
+    importtmp("tests/fixtures/path_iterator/0/data.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    // Objects "2" and "3" are in the range.
+    sky_path_iterator *iterator = sky_path_iterator_create();
+    rc = sky_path_iterator_set_range(iterator, table->tablets[0], &start, &end);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x10\x00\x00\x00\x00\x00\x02", iterator->cursor.endptr-iterator->cursor.startptr);
+
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(!sky_path_iterator_eof(iterator));
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x20\x00\x00\x00\x00\x00\x01", iterator->cursor.endptr-iterator->cursor.startptr);
+
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(sky_path_iterator_eof(iterator));
+    sky_path_iterator_free(iterator);
+
+    // An open start reads from the first object.
+    iterator = sky_path_iterator_create();
+    rc = sky_path_iterator_set_range(iterator, table->tablets[0], NULL, &start);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x00\x00\x00\x00\x00\x00\x01", iterator->cursor.endptr-iterator->cursor.startptr);
     rc = sky_path_iterator_next(iterator);
     mu_assert_int_equals(rc, 0);
-    mu_assert_mem(iterator->cursor.startptr, "\x01\x00\x00\x20\x00\x00\x00\x00\x00\x01\x00", iterator->cursor.endptr-iterator->cursor.startptr);
+    mu_assert_bool(sky_path_iterator_eof(iterator));
     
     sky_path_iterator_free(iterator);
     sky_table_free(table);
     return 0;
 }
 
+int test_sky_path_iterator_sample() {
+    int rc;
+    struct tagbstring start = bsStatic("2");
+    importtmp("tests/fixtures/path_iterator/0/data.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    // Only objects "2" and "3" hash into a 30% sample.
+    sky_path_iterator *iterator = sky_path_iterator_create();
+    sky_path_iterator_set_sample_rate(iterator, 0.3);
+    rc = sky_path_iterator_set_tablet(iterator, table->tablets[0]);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x10\x00\x00\x00\x00\x00\x02", iterator->cursor.endptr-iterator->cursor.startptr);
+    mu_assert_bool(iterator->sample_hash == sky_sample_hash("2", 1));
+
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(!sky_path_iterator_eof(iterator));
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x20\x00\x00\x00\x00\x00\x01", iterator->cursor.endptr-iterator->cursor.startptr);
+
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(sky_path_iterator_eof(iterator));
+    sky_path_iterator_free(iterator);
+
+    // A smaller sample is a subset of the larger one.
+    iterator = sky_path_iterator_create();
+    sky_path_iterator_set_sample_rate(iterator, 0.1);
+    rc = sky_path_iterator_set_range(iterator, table->tablets[0], &start, NULL);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x20\x00\x00\x00\x00\x00\x01", iterator->cursor.endptr-iterator->cursor.startptr);
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(sky_path_iterator_eof(iterator));
+
+    sky_path_iterator_free(iterator);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_path_iterator_prune() {
+    int rc;
+    importtmp("tests/fixtures/path_iterator/0/data.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    // Only object "2" has an event within the time range.
+    sky_path_iterator *iterator = sky_path_iterator_create();
+    sky_path_iterator_set_time_range(iterator, 1, 1);
+    rc = sky_path_iterator_set_tablet(iterator, table->tablets[0]);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x10\x00\x00\x00\x00\x00\x02", iterator->cursor.endptr-iterator->cursor.startptr);
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(sky_path_iterator_eof(iterator));
+    sky_path_iterator_free(iterator);
+
+    // Objects "3" and "4" have the action within the overlap of the ranges.
+    iterator = sky_path_iterator_create();
+    sky_path_iterator_set_time_range(iterator, 0, 2);
+    sky_path_iterator_set_time_range(iterator, 1, 10);
+    sky_path_iterator_add_action(iterator, 1);
+    rc = sky_path_iterator_set_tablet(iterator, table->tablets[0]);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bstring(iterator->path.object_id, "3");
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x20\x00\x00\x00\x00\x00\x01", iterator->cursor.endptr-iterator->cursor.startptr);
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bstring(iterator->path.object_id, "4");
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(sky_path_iterator_eof(iterator));
+    sky_path_iterator_free(iterator);
+
+    // No path has an action that isn't in the table.
+    iterator = sky_path_iterator_create();
+    sky_path_iterator_add_action(iterator, 3);
+    rc = sky_path_iterator_set_tablet(iterator, table->tablets[0]);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(sky_path_iterator_eof(iterator));
+    sky_path_iterator_free(iterator);
+
+    // Compacted paths are pruned using the summaries in the segment.
+    mu_assert_int_equals(sky_tablet_compact(table->tablets[0]), 0);
+    iterator = sky_path_iterator_create();
+    sky_path_iterator_set_time_range(iterator, 1, 1);
+    rc = sky_path_iterator_set_tablet(iterator, table->tablets[0]);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_mem(iterator->cursor.startptr, "\x05\x00\x00\x10\x00\x00\x00\x00\x00\x02", iterator->cursor.endptr-iterator->cursor.startptr);
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(sky_path_iterator_eof(iterator));
+
+    sky_path_iterator_free(iterator);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_path_iterator_prune_zero_byte_id() {
+    int rc;
+    struct tagbstring foo = bsStatic("foo");
+    bstring foo_a = blk2bstr("foo\0a", 5);
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+
+    sky_event *event = sky_event_create(&foo, 10000000LL, 1);
+    mu_assert_int_equals(sky_tablet_add_event(table->tablets[0], event), 0);
+    sky_event_free(event);
+    event = sky_event_create(foo_a, 100000000LL, 1);
+    mu_assert_int_equals(sky_tablet_add_event(table->tablets[0], event), 0);
+    sky_event_free(event);
+
+    // Skipping "foo" doesn't skip an object id that extends it after a zero.
+    sky_path_iterator *iterator = sky_path_iterator_create();
+    sky_path_iterator_set_time_range(iterator, 50, 200);
+    rc = sky_path_iterator_set_tablet(iterator, table->tablets[0]);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(!sky_path_iterator_eof(iterator));
+    mu_assert_int_equals(biseq(iterator->path.object_id, foo_a), 1);
+    rc = sky_path_iterator_next(iterator);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(sky_path_iterator_eof(iterator));
+
+    sky_path_iterator_free(iterator);
+    sky_table_free(table);
+    bdestroy(foo_a);
+    return 0;
+}
+
+
+int test_sky_path_iterator_seek() {
+    int i, rc;
+    struct tagbstring foo = bsStatic("foo");
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+
+    // Each event sets the object state to its index.
+    for(i=1; i<=2100; i++) {
+        sky_event *event = sky_event_create(&foo, i * 10000000LL, 0);
+        event->data = calloc(1, sizeof(*event->data));
+        event->data[0] = sky_event_data_create_int(1, i);
+        event->data_count = 1;
+        mu_assert_int_equals(sky_tablet_add_event(table->tablets[0], event), 0);
+        sky_event_free(event);
+    }
+
+    test_t obj;
+    sky_data_descriptor *descriptor = sky_data_descriptor_create();
+    descriptor->timestamp_descriptor.timestamp_offset = offsetof(test_t, timestamp);
+    descriptor->timestamp_descriptor.ts_offset = offsetof(test_t, ts);
+    descriptor->action_descriptor.offset = offsetof(test_t, action_id);
+    sky_data_descriptor_set_property(descriptor, 1, offsetof(test_t, value), SKY_DATA_TYPE_INT);
+    sky_data_descriptor_set_data_sz(descriptor, sizeof(obj));
+
+    // The path starts at the checkpoint before the time range with the
+    // object state restored.
+    sky_path_iterator *iterator = sky_path_iterator_create();
+    iterator->cursor.data_descriptor = descriptor;
+    iterator->cursor.data = &obj;
+    sky_path_iterator_set_time_range(iterator, 15000, UINT32_MAX);
+    sky_path_iterator_enable_seek(iterator);
+    rc = sky_path_iterator_set_tablet(iterator, table->tablets[0]);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(iterator->path.held);
+    mu_assert_bool(iterator->path.has_checkpoint);
+    mu_assert_int64_equals(obj.value, 1024LL);
+
+    int count = 0;
+    mu_assert_int_equals(sky_cursor_next_event(&iterator->cursor), 0);
+    mu_assert_int_equals(obj.timestamp, 10250);
+    mu_assert_int64_equals(obj.value, 1025LL);
+    while(!iterator->cursor.eof) {
+        count++;
+        mu_assert_int64_equals(obj.value, (int64_t)(obj.timestamp / 10));
+        mu_assert_int_equals(sky_cursor_next_event(&iterator->cursor), 0);
+    }
+    mu_assert_int_equals(count, 1076);
+    sky_path_iterator_free(iterator);
+
+    // Compacted paths seek using the checkpoints in the segment.
+    mu_assert_int_equals(sky_tablet_compact(table->tablets[0]), 0);
+    iterator = sky_path_iterator_create();
+    iterator->cursor.data_descriptor = descriptor;
+    iterator->cursor.data = &obj;
+    sky_path_iterator_set_time_range(iterator, 15000, UINT32_MAX);
+    sky_path_iterator_enable_seek(iterator);
+    rc = sky_path_iterator_set_tablet(iterator, table->tablets[0]);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_bool(iterator->path.has_checkpoint);
+    mu_assert_int64_equals(obj.value, 1024LL);
+    count = 0;
+    mu_assert_int_equals(sky_cursor_next_event(&iterator->cursor), 0);
+    mu_assert_int_equals(obj.timestamp, 10250);
+    while(!iterator->cursor.eof) {
+        count++;
+        mu_assert_int_equals(sky_cursor_next_event(&iterator->cursor), 0);
+    }
+    mu_assert_int_equals(count, 1076);
+
+    sky_path_iterator_free(iterator);
+    sky_data_descriptor_free(descriptor);
+    sky_table_free(table);
+    return 0;
+}
+
 
 //==============================================================================
 //
@@ -55,6 +322,11 @@ int test_sky_path_iterator_next() {
 
 int all_tests() {
     mu_run_test(test_sky_path_iterator_next);
+    mu_run_test(test_sky_path_iterator_set_range);
+    mu_run_test(test_sky_path_iterator_sample);
+    mu_run_test(test_sky_path_iterator_prune);
+    mu_run_test(test_sky_path_iterator_prune_zero_byte_id);
+    mu_run_test(test_sky_path_iterator_seek);
     return 0;
 }
 
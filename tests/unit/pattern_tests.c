@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pattern.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+// Runs a pattern over a list of events and returns a bit mask of the
+// events that a match ended on.
+uint32_t match_pattern(const char *source, sky_action_id_t *action_ids,
+                       uint32_t *timestamps, uint32_t count)
+{
+    uint32_t i, mask = 0;
+    struct tagbstring str = bsStatic("");
+    str.data = (unsigned char*)source;
+    str.slen = (int)strlen(source);
+
+    sky_pattern *pattern = sky_pattern_create();
+    if(sky_pattern_compile(pattern, &str) != 0) {
+        sky_pattern_free(pattern);
+        return UINT32_MAX;
+    }
+
+    sky_pattern_matcher matcher;
+    sky_pattern_matcher_init(&matcher, pattern);
+    for(i=0; i<count; i++) {
+        if(sky_pattern_matcher_next(&matcher, action_ids[i], (timestamps ? timestamps[i] : i))) {
+            mask |= (1 << i);
+        }
+    }
+
+    sky_pattern_matcher_uninit(&matcher);
+    sky_pattern_free(pattern);
+    return mask;
+}
+
+// Checks if a pattern source fails to compile.
+bool pattern_is_invalid(const char *source)
+{
+    struct tagbstring str = bsStatic("");
+    str.data = (unsigned char*)source;
+    str.slen = (int)strlen(source);
+
+    sky_pattern *pattern = sky_pattern_create();
+    int rc = sky_pattern_compile(pattern, &str);
+    sky_pattern_free(pattern);
+    return (rc != 0);
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Compilation
+//--------------------------------------
+
+int test_sky_pattern_compile() {
+    struct tagbstring source = bsStatic("1 2 3");
+    sky_pattern *pattern = sky_pattern_create();
+    mu_assert_int_equals(sky_pattern_compile(pattern, &source), 0);
+    mu_assert_bstring(pattern->source, "1 2 3");
+    mu_assert_int_equals(pattern->within, 0);
+    mu_assert_int_equals(pattern->class_count, 4);
+    mu_assert_int_equals(pattern->class_map_size, 4);
+    mu_assert_int_equals(pattern->state_count, 5);
+    sky_pattern_free(pattern);
+    return 0;
+}
+
+int test_sky_pattern_compile_sequence() {
+    sky_action_id_t action_ids[] = {10, 20};
+    sky_pattern *pattern = sky_pattern_create();
+    mu_assert_int_equals(sky_pattern_compile_sequence(pattern, action_ids, 2), 0);
+    mu_assert_bstring(pattern->source, "10 20");
+    sky_pattern_free(pattern);
+    return 0;
+}
+
+int test_sky_pattern_compile_invalid() {
+    mu_assert_bool(pattern_is_invalid(""));
+    mu_assert_bool(pattern_is_invalid("1 (2"));
+    mu_assert_bool(pattern_is_invalid("1 2)"));
+    mu_assert_bool(pattern_is_invalid("0"));
+    mu_assert_bool(pattern_is_invalid("70000"));
+    mu_assert_bool(pattern_is_invalid("1{3,2}"));
+    mu_assert_bool(pattern_is_invalid("1 | "));
+    mu_assert_bool(pattern_is_invalid("2*"));
+    mu_assert_bool(pattern_is_invalid("1 within"));
+    mu_assert_bool(pattern_is_invalid("1 within 10 2"));
+    return 0;
+}
+
+
+//--------------------------------------
+// Matching
+//--------------------------------------
+
+int test_sky_pattern_match_overlapping() {
+    sky_action_id_t action_ids[] = {1, 1, 1, 2};
+    mu_assert_int_equals(match_pattern("1 1 2", action_ids, NULL, 4), 0x8);
+    mu_assert_int_equals(match_pattern("1 1", action_ids, NULL, 4), 0x6);
+    return 0;
+}
+
+int test_sky_pattern_match_alternation_and_repetition() {
+    sky_action_id_t action_ids[] = {1, 2, 3, 2, 4, 1, 4};
+    mu_assert_int_equals(match_pattern("1 (2|3)+ 4", action_ids, NULL, 7), 0x10);
+    mu_assert_int_equals(match_pattern("1 (2|3)* 4", action_ids, NULL, 7), 0x50);
+    mu_assert_int_equals(match_pattern("1 2? 3", action_ids, NULL, 7), 0x4);
+    mu_assert_int_equals(match_pattern("(2 3|3 2){1,}", action_ids, NULL, 7), 0xC);
+    return 0;
+}
+
+int test_sky_pattern_match_gaps() {
+    sky_action_id_t action_ids[] = {1, 2, 3, 1, 2, 2, 3};
+    mu_assert_int_equals(match_pattern("1 .{0,1} 3", action_ids, NULL, 7), 0x4);
+    mu_assert_int_equals(match_pattern("1 .* 3", action_ids, NULL, 7), 0x44);
+    mu_assert_int_equals(match_pattern("1, .{2}, 3", action_ids, NULL, 7), 0x40);
+    return 0;
+}
+
+int test_sky_pattern_match_within() {
+    sky_action_id_t action_ids[] = {1, 1, 2, 1, 2};
+    uint32_t timestamps[] = {0, 5, 12, 30, 45};
+    mu_assert_int_equals(match_pattern("1 2 within 10", action_ids, timestamps, 5), 0x4);
+    mu_assert_int_equals(match_pattern("1 .* 2 within 15", action_ids, timestamps, 5), 0x14);
+    mu_assert_int_equals(match_pattern("1 2", action_ids, timestamps, 5), 0x14);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_pattern_compile);
+    mu_run_test(test_sky_pattern_compile_sequence);
+    mu_run_test(test_sky_pattern_compile_invalid);
+    mu_run_test(test_sky_pattern_match_overlapping);
+    mu_run_test(test_sky_pattern_match_alternation_and_repetition);
+    mu_run_test(test_sky_pattern_match_gaps);
+    mu_run_test(test_sky_pattern_match_within);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <prepare_query_message.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Fixtures
+//
+//==============================================================================
+
+#define QUERY_SOURCE \
+    "function aggregate(cursor, data)\n" \
+    "  data.count = data.count or 0\n" \
+    "  while cursor:next() do\n" \
+    "    if cursor.event.action_id == action then\n" \
+    "      data.count = data.count + 1\n" \
+    "    end\n" \
+    "  end\n" \
+    "end\n"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_prepare_query_message_pack() {
+    cleantmp();
+    sky_prepare_query_message *message = sky_prepare_query_message_create();
+    message->query->name = bfromcstr("count_action");
+    message->query->source = bfromcstr(QUERY_SOURCE);
+    message->query->parameters = calloc(1, sizeof(bstring));
+    message->query->parameters[0] = bfromcstr("action");
+    message->query->parameter_count = 1;
+
+    FILE *file = fopen("tmp/message", "w");
+    mu_assert_bool(sky_prepare_query_message_pack(message, file) == 0);
+    fclose(file);
+    mu_assert_file("tmp/message", "tests/fixtures/prepare_query_message/0/message");
+    sky_prepare_query_message_free(message);
+    return 0;
+}
+
+int test_sky_prepare_query_message_unpack() {
+    FILE *file = fopen("tests/fixtures/prepare_query_message/0/message", "r");
+    sky_prepare_query_message *message = sky_prepare_query_message_create();
+    mu_assert_bool(sky_prepare_query_message_unpack(message, file) == 0);
+    fclose(file);
+
+    mu_assert_bstring(message->query->name, "count_action");
+    mu_assert_bstring(message->query->source, QUERY_SOURCE);
+    mu_assert_int_equals(message->query->parameter_count, 1);
+    mu_assert_bstring(message->query->parameters[0], "action");
+    sky_prepare_query_message_free(message);
+    return 0;
+}
+
+
+//--------------------------------------
+// Processing
+//--------------------------------------
+
+int test_sky_prepare_query_message_process() {
+    importtmp("tests/fixtures/lua_aggregate_message/0/import.json");
+    sky_server *server = sky_server_create(NULL);
+    sky_message_header *header = sky_message_header_create();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    FILE *input = fopen("tests/fixtures/prepare_query_message/1/input", "r");
+    FILE *output = fopen("tmp/output", "w");
+    int rc = sky_prepare_query_message_process(server, header, table, input, output);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_file("tmp/output", "tests/fixtures/prepare_query_message/1/output");
+    mu_assert_int_equals(server->query_count, 1);
+    mu_assert_int_equals(server->lua_cache->count, 1);
+
+    // Preparing the same name again keeps the handle.
+    input = fopen("tests/fixtures/prepare_query_message/1/input", "r");
+    output = fopen("tmp/output", "w");
+    rc = sky_prepare_query_message_process(server, header, table, input, output);
+    mu_assert_int_equals(rc, 0);
+    mu_assert_file("tmp/output", "tests/fixtures/prepare_query_message/1/output");
+    mu_assert_int_equals(server->query_count, 1);
+
+    sky_query *query = NULL;
+    mu_assert_int_equals(sky_server_get_query(server, 1, &query), 0);
+    mu_assert_bool(query != NULL);
+    mu_assert_bstring(query->name, "count_action");
+    mu_assert_bstring(query->table_path, "tmp");
+
+    sky_table_free(table);
+    sky_message_header_free(header);
+    sky_server_free(server);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_prepare_query_message_pack);
+    mu_run_test(test_sky_prepare_query_message_unpack);
+    mu_run_test(test_sky_prepare_query_message_process);
+    return 0;
+}
+
+RUN_TESTS()
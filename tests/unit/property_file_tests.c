@@ -82,6 +82,53 @@ int test_sky_property_file_save() {
 // Load
 //--------------------------------------
 
+int test_sky_property_file_save_if_dirty() {
+    cleantmp();
+    bool added;
+    sky_event_data *data = NULL;
+    struct tagbstring path = bsStatic("tmp/properties");
+    struct tagbstring tmp_path = bsStatic("tmp/properties.tmp");
+    struct tagbstring us = bsStatic("US");
+
+    sky_property_file *property_file = sky_property_file_create();
+    sky_property_file_set_path(property_file, &path);
+    mu_assert_bool(!property_file->dirty);
+
+    // Adding a property marks the file as dirty until it is saved.
+    sky_property *property = sky_property_create();
+    property->type = SKY_PROPERTY_TYPE_OBJECT;
+    property->data_type = SKY_DATA_TYPE_STRING;
+    property->name = bfromcstr("country");
+    property->dictionary = sky_dictionary_create();
+    mu_assert_int_equals(sky_property_file_add_property(property_file, property), 0);
+    mu_assert_bool(property_file->dirty);
+    mu_assert_int_equals(sky_property_file_save_if_dirty(property_file), 0);
+    mu_assert_bool(!property_file->dirty);
+    mu_assert_bool(sky_file_exists(&path));
+    mu_assert_bool(!sky_file_exists(&tmp_path));
+
+    // Only new dictionary values mark the file as dirty.
+    mu_assert_int_equals(sky_property_encode_string(property, &us, &data, &added), 0);
+    sky_event_data_free(data);
+    mu_assert_bool(added && property_file->dirty);
+    mu_assert_int_equals(sky_property_file_save_if_dirty(property_file), 0);
+    mu_assert_int_equals(sky_property_encode_string(property, &us, &data, &added), 0);
+    sky_event_data_free(data);
+    mu_assert_bool(!added && !property_file->dirty);
+    sky_property_file_free(property_file);
+
+    // The saved dictionary is loaded back.
+    int64_t code;
+    property_file = sky_property_file_create();
+    sky_property_file_set_path(property_file, &path);
+    mu_assert_int_equals(sky_property_file_load(property_file), 0);
+    mu_assert_int_equals(property_file->property_count, 1);
+    mu_assert_int_equals(sky_dictionary_find(property_file->properties[0]->dictionary, &us, &code), 0);
+    mu_assert_int64_equals(code, 1LL);
+    sky_property_file_free(property_file);
+    return 0;
+}
+
 int test_sky_property_file_load() {
     int rc;
     struct tagbstring path = bsStatic("tests/fixtures/property_files/0/properties");
@@ -109,6 +156,7 @@ int test_sky_property_file_load() {
 int all_tests() {
     mu_run_test(test_sky_property_file_path);
     mu_run_test(test_sky_property_file_save);
+    mu_run_test(test_sky_property_file_save_if_dirty);
     mu_run_test(test_sky_property_file_load);
     return 0;
 }
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <query_message.h>
+#include <lua_aggregate_message.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+// Runs a query message fixture across every tablet of a table and writes
+// the reduced results to tmp/output.
+int run_query_message(sky_table *table, const char *path) {
+    sky_query_message *message = sky_query_message_create();
+    FILE *file = fopen(path, "r");
+    mu_assert_int_equals(sky_query_message_unpack(message, file), 0);
+    fclose(file);
+    mu_assert_int_equals(sky_query_plan_compile(message->plan, table->property_file), 0);
+    message->result = sky_query_result_create(message->plan);
+
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    uint32_t i;
+    for(i=0; i<table->tablet_count; i++) {
+        sky_query_result *result = NULL;
+        mu_assert_int_equals(sky_query_message_worker_map(worker, table->tablets[i], (void**)&result), 0);
+        mu_assert_int_equals(sky_query_message_worker_reduce(worker, result), 0);
+        sky_query_message_worker_map_free(result);
+    }
+
+    FILE *output = fopen("tmp/output", "w");
+    mu_assert_int_equals(sky_query_message_worker_write(worker, output), 0);
+    fclose(output);
+
+    sky_query_message_worker_free(worker);
+    sky_worker_free(worker);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_query_message_unpack() {
+    FILE *file = fopen("tests/fixtures/query_message/0/message", "r");
+    sky_query_message *message = sky_query_message_create();
+    mu_assert_bool(sky_query_message_unpack(message, file) == 0);
+    fclose(file);
+
+    sky_query_plan *plan = message->plan;
+    mu_assert_int_equals(plan->filter_count, 2);
+    mu_assert_bstring(plan->filters[0].field_name, "country");
+    mu_assert_int_equals(plan->filters[0].op, SKY_QUERY_OP_EQ);
+    mu_assert_bstring(plan->filters[0].value->string_value, "US");
+    mu_assert_bstring(plan->filters[1].field_name, "timestamp");
+    mu_assert_int_equals(plan->filters[1].op, SKY_QUERY_OP_LT);
+    mu_assert_long_equals(plan->filters[1].value->int_value, 3L);
+    mu_assert_int_equals(plan->group_count, 1);
+    mu_assert_bstring(plan->group_names[0], "action_id");
+    mu_assert_int_equals(plan->selection_count, 4);
+    mu_assert_bstring(plan->selections[0].name, "count");
+    mu_assert_int_equals(plan->selections[0].fn, SKY_QUERY_FN_COUNT);
+    mu_assert_bstring(plan->selections[1].name, "total");
+    mu_assert_int_equals(plan->selections[1].fn, SKY_QUERY_FN_SUM);
+    mu_assert_bstring(plan->selections[1].field_name, "price");
+    mu_assert_int_equals(plan->selections[3].fn, SKY_QUERY_FN_AVG);
+    sky_query_message_free(message);
+    return 0;
+}
+
+
+//--------------------------------------
+// Compilation
+//--------------------------------------
+
+int test_sky_query_message_compile_invalid() {
+    importtmp("tests/fixtures/query_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    // Unknown fields are rejected.
+    sky_query_plan *plan = sky_query_plan_create();
+    plan->selections = calloc(1, sizeof(*plan->selections));
+    plan->selection_count = 1;
+    plan->selections[0].name = bfromcstr("total");
+    plan->selections[0].fn = SKY_QUERY_FN_SUM;
+    plan->selections[0].field_name = bfromcstr("no_such_field");
+    mu_assert_int_equals(sky_query_plan_compile(plan, table->property_file), -1);
+    sky_query_plan_free(plan);
+
+    // Strings cannot be summed.
+    plan = sky_query_plan_create();
+    plan->selections = calloc(1, sizeof(*plan->selections));
+    plan->selection_count = 1;
+    plan->selections[0].name = bfromcstr("total");
+    plan->selections[0].fn = SKY_QUERY_FN_SUM;
+    plan->selections[0].field_name = bfromcstr("country");
+    mu_assert_int_equals(sky_query_plan_compile(plan, table->property_file), -1);
+    sky_query_plan_free(plan);
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int test_sky_query_message_worker_filter_and_group() {
+    importtmp("tests/fixtures/query_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    mu_assert_int_equals(run_query_message(table, "tests/fixtures/query_message/0/message"), 0);
+    mu_assert_file("tmp/output", "tests/fixtures/query_message/0/output");
+
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_query_message_worker_group_by_dictionary() {
+    importtmp("tests/fixtures/query_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    mu_assert_int_equals(run_query_message(table, "tests/fixtures/query_message/1/message"), 0);
+    mu_assert_file("tmp/output", "tests/fixtures/query_message/1/output");
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_query_message_worker_quantile() {
+    importtmp("tests/fixtures/query_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    mu_assert_int_equals(run_query_message(table, "tests/fixtures/query_message/3/message"), 0);
+    mu_assert_file("tmp/output", "tests/fixtures/query_message/3/output");
+
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_query_message_worker_sample() {
+    importtmp("tests/fixtures/query_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    // Only objects "2" and "3" are in the sample.
+    mu_assert_int_equals(run_query_message(table, "tests/fixtures/query_message/4/message"), 0);
+    mu_assert_file("tmp/output", "tests/fixtures/query_message/4/output");
+
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_query_message_worker_filter_unseen_dictionary_value() {
+    importtmp("tests/fixtures/query_message/5/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    // No event equals a value that isn't in the dictionary, including the
+    // events of object "2" where the property is unset.
+    mu_assert_int_equals(run_query_message(table, "tests/fixtures/query_message/5/message"), 0);
+    mu_assert_file("tmp/output", "tests/fixtures/query_message/5/output");
+
+    // Every event differs from it.
+    mu_assert_int_equals(run_query_message(table, "tests/fixtures/query_message/6/message"), 0);
+    mu_assert_file("tmp/output", "tests/fixtures/query_message/6/output");
+
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_query_message_worker_matches_lua() {
+    importtmp("tests/fixtures/query_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    // Run the query natively and as a script. Only one group and one
+    // selection are used since the script's key order isn't defined.
+    sky_query_message *message = sky_query_message_create();
+    sky_query_plan *plan = message->plan;
+    plan->filters = calloc(1, sizeof(*plan->filters));
+    plan->filter_count = 1;
+    plan->filters[0].field_name = bfromcstr("country");
+    plan->filters[0].op = SKY_QUERY_OP_EQ;
+    plan->filters[0].value = sky_query_argument_create();
+    plan->filters[0].value->data_type = SKY_DATA_TYPE_STRING;
+    plan->filters[0].value->string_value = bfromcstr("US");
+    plan->group_names = calloc(1, sizeof(*plan->group_names));
+    plan->group_count = 1;
+    plan->group_names[0] = bfromcstr("country");
+    plan->selections = calloc(1, sizeof(*plan->selections));
+    plan->selection_count = 1;
+    plan->selections[0].name = bfromcstr("total");
+    plan->selections[0].fn = SKY_QUERY_FN_SUM;
+    plan->selections[0].field_name = bfromcstr("price");
+    mu_assert_int_equals(sky_query_plan_compile(plan, table->property_file), 0);
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+    sky_query_result *result = NULL;
+    mu_assert_int_equals(sky_query_message_worker_map(worker, table->tablets[0], (void**)&result), 0);
+    FILE *output = fopen("tmp/output", "w");
+    mu_assert_int_equals(sky_query_result_pack(result, plan, output), 0);
+    fclose(output);
+    mu_assert_file("tmp/output", "tests/fixtures/query_message/2/output");
+    sky_query_result_free(result);
+    sky_query_message_free(message);
+    sky_worker_free(worker);
+
+    sky_lua_aggregate_message *lua_message = sky_lua_aggregate_message_create();
+    lua_message->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  event = cursor.event\n"
+        "  while cursor:next() do\n"
+        "    if event:country() == 'US' then\n"
+        "      data[event:country()] = data[event:country()] or {total=0}\n"
+        "      data[event:country()].total = data[event:country()].total + event.price\n"
+        "    end\n"
+        "  end\n"
+        "end"
+    );
+    worker = sky_worker_create();
+    worker->data = (void*)lua_message;
+    bstring lua_results = NULL;
+    mu_assert_int_equals(sky_lua_aggregate_message_worker_map(worker, table->tablets[0], (void**)&lua_results), 0);
+    mu_assert_int_equals(blength(lua_results), 12);
+    mu_assert_mem(lua_results->data, "\x81\xA2" "US" "\x81\xA5" "total" "\x2A", 12);
+
+    bdestroy(lua_results);
+    sky_lua_aggregate_message_free(lua_message);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_query_message_unpack);
+    mu_run_test(test_sky_query_message_compile_invalid);
+    mu_run_test(test_sky_query_message_worker_filter_and_group);
+    mu_run_test(test_sky_query_message_worker_group_by_dictionary);
+    mu_run_test(test_sky_query_message_worker_quantile);
+    mu_run_test(test_sky_query_message_worker_sample);
+    mu_run_test(test_sky_query_message_worker_filter_unseen_dictionary_value);
+    mu_run_test(test_sky_query_message_worker_matches_lua);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <queue.h>
+#include <mem.h>
+#include <dbg.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+#define PRODUCER_COUNT 4
+#define PRODUCER_ITEM_COUNT 10000
+#define ROUND_TRIP_COUNT 100000
+
+typedef struct {
+    sky_queue *queue;
+    sky_queue *reply_queue;
+    intptr_t offset;
+} queue_thread_options;
+
+// Pushes a range of values onto a queue.
+void *produce(void *_options) {
+    queue_thread_options *options = (queue_thread_options*)_options;
+    intptr_t i;
+    for(i=1; i<=PRODUCER_ITEM_COUNT; i++) {
+        sky_queue_push(options->queue, (void*)(options->offset + i));
+    }
+    return NULL;
+}
+
+// Sends every value popped from a queue back on the reply queue.
+void *echo(void *_options) {
+    queue_thread_options *options = (queue_thread_options*)_options;
+    int i;
+    for(i=0; i<ROUND_TRIP_COUNT; i++) {
+        void *value;
+        sky_queue_pop(options->queue, &value);
+        sky_queue_push(options->reply_queue, value);
+    }
+    return NULL;
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Push / Pop
+//--------------------------------------
+
+int test_sky_queue_push_pop() {
+    void *value;
+    sky_queue *queue = sky_queue_create(4);
+    mu_assert_bool(!sky_queue_try_pop(queue, &value));
+
+    // Values come out in order and the ring wraps around.
+    intptr_t i;
+    for(i=1; i<=10; i++) {
+        mu_assert_int_equals(sky_queue_push(queue, (void*)i), 0);
+        mu_assert_int_equals(sky_queue_push(queue, NULL), 0);
+        mu_assert_int_equals(sky_queue_pop(queue, &value), 0);
+        mu_assert_bool(value == (void*)i);
+        mu_assert_bool(sky_queue_try_pop(queue, &value));
+        mu_assert_bool(value == NULL);
+    }
+    mu_assert_bool(!sky_queue_try_pop(queue, &value));
+
+    sky_queue_free(queue);
+    return 0;
+}
+
+int test_sky_queue_multiple_producers() {
+    pthread_t threads[PRODUCER_COUNT];
+    queue_thread_options options[PRODUCER_COUNT];
+    sky_queue *queue = sky_queue_create(64);
+
+    intptr_t i;
+    for(i=0; i<PRODUCER_COUNT; i++) {
+        options[i].queue = queue;
+        options[i].offset = i * PRODUCER_ITEM_COUNT;
+        pthread_create(&threads[i], NULL, produce, &options[i]);
+    }
+
+    // Each producer's values arrive in the order they were pushed.
+    intptr_t last[PRODUCER_COUNT] = {0};
+    for(i=0; i<PRODUCER_COUNT*PRODUCER_ITEM_COUNT; i++) {
+        void *value;
+        mu_assert_int_equals(sky_queue_pop(queue, &value), 0);
+        intptr_t producer = ((intptr_t)value - 1) / PRODUCER_ITEM_COUNT;
+        intptr_t index = (intptr_t)value - (producer * PRODUCER_ITEM_COUNT);
+        mu_assert_bool(producer >= 0 && producer < PRODUCER_COUNT);
+        mu_assert_bool(index == last[producer] + 1);
+        last[producer] = index;
+    }
+
+    for(i=0; i<PRODUCER_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    sky_queue_free(queue);
+    return 0;
+}
+
+int test_sky_queue_round_trip() {
+    pthread_t thread;
+    queue_thread_options options;
+    options.queue = sky_queue_create(SKY_QUEUE_DEFAULT_CAPACITY);
+    options.reply_queue = sky_queue_create(SKY_QUEUE_DEFAULT_CAPACITY);
+    pthread_create(&thread, NULL, echo, &options);
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t t0 = (tv.tv_sec*1000000) + tv.tv_usec;
+
+    int i;
+    for(i=0; i<ROUND_TRIP_COUNT; i++) {
+        void *value;
+        sky_queue_push(options.queue, &options);
+        mu_assert_int_equals(sky_queue_pop(options.reply_queue, &value), 0);
+        mu_assert_bool(value == &options);
+    }
+
+    gettimeofday(&tv, NULL);
+    int64_t t1 = (tv.tv_sec*1000000) + tv.tv_usec;
+    printf("[queue] round trip=%.0fns\n", ((double)(t1-t0) * 1000) / ROUND_TRIP_COUNT);
+
+    pthread_join(thread, NULL);
+    sky_queue_free(options.queue);
+    sky_queue_free(options.reply_queue);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_queue_push_pop);
+    mu_run_test(test_sky_queue_multiple_producers);
+    mu_run_test(test_sky_queue_round_trip);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <retention_message.h>
+#include <lua_aggregate_message.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_retention_message_unpack() {
+    FILE *file = fopen("tests/fixtures/retention_message/0/message", "r");
+    sky_retention_message *message = sky_retention_message_create();
+    mu_assert_bool(sky_retention_message_unpack(message, file) == 0);
+    fclose(file);
+
+    mu_assert_int_equals(message->cohort_action_id, 1);
+    mu_assert_int_equals(message->return_action_id, 2);
+    mu_assert_int_equals(message->start, 1000);
+    mu_assert_int_equals(message->bucket_size, 10);
+    mu_assert_int_equals(message->bucket_count, 3);
+    mu_assert_int_equals(sky_retention_message_init(message), 0);
+    sky_retention_message_free(message);
+    return 0;
+}
+
+int test_sky_retention_message_init_invalid() {
+    sky_retention_message *message = sky_retention_message_create();
+    message->cohort_action_id = 1;
+    message->return_action_id = 2;
+    message->bucket_size = 10;
+    message->bucket_count = SKY_RETENTION_MESSAGE_MAX_BUCKET_COUNT + 1;
+    mu_assert_int_equals(sky_retention_message_init(message), -1);
+    sky_retention_message_free(message);
+    return 0;
+}
+
+
+//--------------------------------------
+// Worker
+//--------------------------------------
+
+int test_sky_retention_message_worker() {
+    importtmp("tests/fixtures/retention_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    sky_retention_message *message = sky_retention_message_create();
+    FILE *file = fopen("tests/fixtures/retention_message/0/message", "r");
+    mu_assert_int_equals(sky_retention_message_unpack(message, file), 0);
+    fclose(file);
+    mu_assert_int_equals(sky_retention_message_init(message), 0);
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    void *results = NULL;
+    mu_assert_int_equals(sky_retention_message_worker_map(worker, table->tablets[0], &results), 0);
+    mu_assert_int_equals(sky_retention_message_worker_reduce(worker, results), 0);
+    sky_retention_message_worker_map_free(results);
+
+    FILE *output = fopen("tmp/output", "w");
+    mu_assert_int_equals(sky_retention_message_worker_write(worker, output), 0);
+    fclose(output);
+    mu_assert_file("tmp/output", "tests/fixtures/retention_message/0/output");
+
+    sky_retention_message_worker_free(worker);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_retention_message_worker_matches_lua() {
+    importtmp("tests/fixtures/retention_message/0/import.json");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+
+    sky_lua_aggregate_message *message = sky_lua_aggregate_message_create();
+    message->source = bfromcstr(
+        "function aggregate(cursor, data)\n"
+        "  event = cursor.event\n"
+        "  data.counts = data.counts or {{0,0,0},{0,0,0},{0,0,0}}\n"
+        "  local cohort = nil\n"
+        "  local active = {}\n"
+        "  while cursor:next() do\n"
+        "    local bucket = math.floor((event.timestamp - 1000) / 10)\n"
+        "    if cohort == nil and event.action_id == 1 then\n"
+        "      if bucket < 0 or bucket >= 3 then return end\n"
+        "      cohort = bucket\n"
+        "    end\n"
+        "    if cohort ~= nil and event.action_id == 2 and bucket - cohort < 3 then\n"
+        "      active[bucket - cohort] = true\n"
+        "    end\n"
+        "  end\n"
+        "  if cohort ~= nil then\n"
+        "    for p = 0, 2 do\n"
+        "      if active[p] then data.counts[cohort+1][p+1] = data.counts[cohort+1][p+1] + 1 end\n"
+        "    end\n"
+        "  end\n"
+        "end"
+    );
+    sky_worker *worker = sky_worker_create();
+    worker->data = (void*)message;
+
+    // The script's counts match the counts in the native output. Lua tables
+    // are encoded as maps keyed from one.
+    bstring results = NULL;
+    mu_assert_int_equals(sky_lua_aggregate_message_worker_map(worker, table->tablets[0], (void**)&results), 0);
+    mu_assert_int_equals(blength(results), 33);
+    mu_assert_mem(
+        results->data,
+        "\x81\xA6" "counts" "\x83"
+        "\x01\x83\x01\x01\x02\x00\x03\x01"
+        "\x02\x83\x01\x01\x02\x01\x03\x00"
+        "\x03\x83\x01\x01\x02\x00\x03\x00",
+        33
+    );
+
+    bdestroy(results);
+    sky_lua_aggregate_message_free(message);
+    sky_worker_free(worker);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_retention_message_unpack);
+    mu_run_test(test_sky_retention_message_init_invalid);
+    mu_run_test(test_sky_retention_message_worker);
+    mu_run_test(test_sky_retention_message_worker_matches_lua);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <sample.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+// Checks that a value is within a tolerance of the expected value.
+#define mu_assert_near(ACTUAL, EXPECTED, TOLERANCE) \
+    mu_assert_bool(fabs((ACTUAL) - (EXPECTED)) <= (TOLERANCE))
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Membership
+//--------------------------------------
+
+int test_sky_sample_hash() {
+    // The hash only depends on the object id.
+    mu_assert_bool(sky_sample_hash("foo", 3) == sky_sample_hash("foo", 3));
+    mu_assert_bool(sky_sample_hash("foo", 3) != sky_sample_hash("fop", 3));
+    mu_assert_bool(sky_sample_hash("2", 1) == 1020151135);
+    return 0;
+}
+
+int test_sky_sample_threshold() {
+    mu_assert_bool(sky_sample_threshold(1) == (1ULL << 32));
+    mu_assert_bool(sky_sample_threshold(0.5) == (1ULL << 31));
+    mu_assert_bool(sky_sample_threshold(0) == 0);
+    mu_assert_bool(sky_sample_is_enabled(0.5));
+    mu_assert_bool(!sky_sample_is_enabled(1));
+    return 0;
+}
+
+int test_sky_sample_nested() {
+    // Every object in a small sample is also in a larger one and each sample
+    // holds close to its share of the objects.
+    char object_id[16];
+    uint32_t i, small = 0, large = 0;
+    uint64_t small_threshold = sky_sample_threshold(0.01);
+    uint64_t large_threshold = sky_sample_threshold(0.1);
+    for(i=0; i<100000; i++) {
+        int length = snprintf(object_id, sizeof(object_id), "%u", i);
+        uint32_t hash = sky_sample_hash(object_id, length);
+        if(hash < small_threshold) {
+            mu_assert_bool(hash < large_threshold);
+            small++;
+        }
+        if(hash < large_threshold) large++;
+    }
+    mu_assert_near((double)small, 1000, 100);
+    mu_assert_near((double)large, 10000, 300);
+    return 0;
+}
+
+
+//--------------------------------------
+// Estimation
+//--------------------------------------
+
+int test_sky_sample_variance() {
+    sky_sample_variance variance, other;
+    memset(&variance, 0, sizeof(variance));
+    memset(&other, 0, sizeof(other));
+
+    // Contributions are squared per path.
+    sky_sample_variance_add(&variance, 1, 2);
+    sky_sample_variance_add(&variance, 1, 1);
+    sky_sample_variance_add(&variance, 2, 4);
+    mu_assert_bool(sky_sample_variance_sum_sq(&variance) == 25);
+
+    sky_sample_variance_add(&other, 1, 1);
+    sky_sample_variance_merge(&variance, &other);
+    mu_assert_bool(sky_sample_variance_sum_sq(&variance) == 26);
+    return 0;
+}
+
+int test_sky_sample_margin() {
+    mu_assert_bool(sky_sample_margin(100, 1) == 0);
+    mu_assert_near(sky_sample_margin(100, 0.5), 1.96 * sqrt(50) / 0.5, 0.0001);
+    return 0;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_sample_unpack_rate() {
+    double rate = 0;
+    cleantmp();
+    FILE *file = fopen("tmp/rate", "w");
+    fwrite("\xCB\x3F\xB9\x99\x99\x99\x99\x99\x9A" "\x01" "\x02" "\xCB\x00\x00\x00\x00\x00\x00\x00\x00", 20, 1, file);
+    fclose(file);
+
+    file = fopen("tmp/rate", "r");
+    mu_assert_int_equals(sky_sample_unpack_rate(&rate, file), 0);
+    mu_assert_bool(rate == 0.1);
+    mu_assert_int_equals(sky_sample_unpack_rate(&rate, file), 0);
+    mu_assert_bool(rate == 1);
+    mu_assert_int_equals(sky_sample_unpack_rate(&rate, file), -1);
+    mu_assert_int_equals(sky_sample_unpack_rate(&rate, file), -1);
+    fclose(file);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_sample_hash);
+    mu_run_test(test_sky_sample_threshold);
+    mu_run_test(test_sky_sample_nested);
+    mu_run_test(test_sky_sample_variance);
+    mu_run_test(test_sky_sample_margin);
+    mu_run_test(test_sky_sample_unpack_rate);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include <segment.h>
+#include <event.h>
+#include <timestamp.h>
+#include <dbg.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Write & Read
+//--------------------------------------
+
+int test_sky_segment_write_and_read() {
+    cleantmp();
+    struct tagbstring path = bsStatic("tmp/segment");
+    struct tagbstring foo = bsStatic("foo");
+
+    // Write an event to a path.
+    char data[64];
+    size_t sz;
+    sky_event *event = sky_event_create(&foo, 10000000LL, 3);
+    mu_assert_int_equals(sky_event_pack(event, data, &sz), 0);
+    sky_event_free(event);
+
+    sky_segment_writer *writer = sky_segment_writer_create(&path, 4);
+    mu_assert_int_equals(sky_segment_writer_write(writer, "bar", 3, data, sz, NULL, 0), 0);
+    mu_assert_int_equals(sky_segment_writer_write(writer, "foo", 3, data, sz, NULL, 0), 0);
+    mu_assert_int_equals(sky_segment_writer_write(writer, "foobar", 6, data, sz, NULL, 0), 0);
+    mu_assert_int_equals(sky_segment_writer_close(writer), 0);
+    sky_segment_writer_free(writer);
+
+    // Read it back.
+    sky_segment *segment = sky_segment_create();
+    mu_assert_int_equals(sky_segment_open(segment, &path), 0);
+    mu_assert_int64_equals(segment->generation, 4LL);
+    mu_assert_int64_equals(segment->entry_count, 3LL);
+
+    sky_segment_entry *entry = sky_segment_find(segment, "foo", 3);
+    mu_assert_bool(entry == &segment->entries[1]);
+    mu_assert_long_equals(entry->data_length, sz);
+    mu_assert_int64_equals(entry->max_timestamp, sky_timestamp_shift(10000000LL));
+    mu_assert_mem(sky_segment_get_data(segment, entry), data, sz);
+    mu_assert_mem(sky_segment_get_object_id(segment, &segment->entries[2]), "foobar", 6);
+    mu_assert_bool(sky_segment_find(segment, "fo", 2) == NULL);
+    mu_assert_bool(sky_segment_find(segment, "zzz", 3) == NULL);
+    mu_assert_bool(sky_segment_compare(segment, &segment->entries[1], "foobar", 6) < 0);
+
+    sky_segment_free(segment);
+    return 0;
+}
+
+int test_sky_segment_records() {
+    cleantmp();
+    struct tagbstring path = bsStatic("tmp/segment");
+
+    // Pack records in type and timestamp order.
+    bstring records = bfromcstr("");
+    mu_assert_int_equals(sky_segment_record_pack(records, 0, 0, "sum", 3), 0);
+    mu_assert_int_equals(sky_segment_record_pack(records, 2, 0, "tail", 4), 0);
+    mu_assert_int_equals(sky_segment_record_pack(records, 4, 100, "cp1", 3), 0);
+    mu_assert_int_equals(sky_segment_record_pack(records, 4, 200, "cp2", 3), 0);
+
+    sky_segment_writer *writer = sky_segment_writer_create(&path, 1);
+    mu_assert_int_equals(sky_segment_writer_write(writer, "bar", 3, NULL, 0, NULL, 0), 0);
+    mu_assert_int_equals(sky_segment_writer_write(writer, "foo", 3, NULL, 0, bdata(records), blength(records)), 0);
+    mu_assert_int_equals(sky_segment_writer_close(writer), 0);
+    sky_segment_writer_free(writer);
+    bdestroy(records);
+
+    sky_segment *segment = sky_segment_create();
+    mu_assert_int_equals(sky_segment_open(segment, &path), 0);
+    mu_assert_bool(segment->has_records);
+
+    // Records are found by type at or before a timestamp.
+    bool found;
+    sky_segment_record record;
+    sky_segment_entry *entry = sky_segment_find(segment, "foo", 3);
+    mu_assert_int_equals(sky_segment_find_record(segment, entry, 2, 0, &record, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_long_equals(record.value_length, 4L);
+    mu_assert_mem(record.value, "tail", 4);
+    mu_assert_int_equals(sky_segment_find_record(segment, entry, 4, 50, &record, &found), 0);
+    mu_assert_bool(!found);
+    mu_assert_int_equals(sky_segment_find_record(segment, entry, 4, 150, &record, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(record.ts, 100LL);
+    mu_assert_mem(record.value, "cp1", 3);
+    mu_assert_int_equals(sky_segment_find_record(segment, entry, 4, 200, &record, &found), 0);
+    mu_assert_mem(record.value, "cp2", 3);
+    mu_assert_int_equals(sky_segment_find_record(segment, sky_segment_find(segment, "bar", 3), 2, 0, &record, &found), 0);
+    mu_assert_bool(!found);
+
+    sky_segment_free(segment);
+    return 0;
+}
+
+int test_sky_segment_open_v1() {
+    cleantmp();
+    struct tagbstring path = bsStatic("tmp/segment");
+
+    // Write a segment with a single entry in the version 1 layout.
+    struct v1_segment {
+        sky_segment_header header;
+        char data[8];
+        uint64_t entry[5];
+    } file;
+    memset(&file, 0, sizeof(file));
+    memcpy(file.header.magic, SKY_SEGMENT_MAGIC_V1, SKY_SEGMENT_MAGIC_LENGTH);
+    file.header.generation = 3;
+    file.header.entry_count = 1;
+    file.header.entries_offset = offsetof(struct v1_segment, entry);
+    memcpy(file.data, "foo", 3);
+    file.entry[0] = offsetof(struct v1_segment, data);
+    file.entry[1] = offsetof(struct v1_segment, data) + 3;
+    file.entry[4] = 3;
+    FILE *f = fopen("tmp/segment", "w");
+    mu_assert_bool(fwrite(&file, sizeof(file), 1, f) == 1);
+    fclose(f);
+
+    sky_segment *segment = sky_segment_create();
+    mu_assert_int_equals(sky_segment_open(segment, &path), 0);
+    mu_assert_bool(!segment->has_records);
+    mu_assert_int64_equals(segment->generation, 3LL);
+    sky_segment_entry *entry = sky_segment_find(segment, "foo", 3);
+    mu_assert_bool(entry != NULL);
+    mu_assert_long_equals(entry->data_length, 0L);
+    mu_assert_long_equals(entry->records_length, 0L);
+    sky_segment_free(segment);
+    return 0;
+}
+
+int test_sky_segment_open_missing() {
+    cleantmp();
+    struct tagbstring path = bsStatic("tmp/segment");
+    sky_segment *segment = sky_segment_create();
+    mu_assert_int_equals(sky_segment_open(segment, &path), 0);
+    mu_assert_int64_equals(segment->entry_count, 0LL);
+    mu_assert_bool(sky_segment_find(segment, "foo", 3) == NULL);
+    sky_segment_free(segment);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_segment_write_and_read);
+    mu_run_test(test_sky_segment_records);
+    mu_run_test(test_sky_segment_open_v1);
+    mu_run_test(test_sky_segment_open_missing);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <server.h>
+#include <servlet.h>
+#include <worker.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+// Counts the number of times a worker has been mapped.
+int map_count = 0;
+
+// The result of the last event written by a failing worker.
+int add_event_rc = -1;
+
+int succeeding_map(sky_worker *worker, sky_tablet *tablet, void **data) {
+    (void)worker; (void)tablet;
+    map_count++;
+    *data = NULL;
+    return 0;
+}
+
+int failing_map(sky_worker *worker, sky_tablet *tablet, void **data) {
+    (void)worker; (void)tablet;
+    map_count++;
+    *data = NULL;
+    return -1;
+}
+
+// Writes an event and then fails.
+int partial_map(sky_worker *worker, sky_tablet *tablet, void **data) {
+    (void)worker;
+    struct tagbstring object_id = bsStatic("foo");
+    map_count++;
+    *data = NULL;
+    sky_event *event = sky_event_create(&object_id, 1000000LL, 1);
+    add_event_rc = sky_tablet_add_event(tablet, event);
+    sky_event_free(event);
+    return -1;
+}
+
+int noop_free(sky_worker *worker) {
+    (void)worker;
+    return 0;
+}
+
+// Runs a worker against the first servlet of a server on the calling thread.
+int run_worker(sky_server *server, sky_worker_map_func_t map, bool batchable) {
+    sky_worker *worker = sky_worker_create();
+    worker->pool = server->worker_pool;
+    worker->channel = server->worker_pool->serial_channel;
+    worker->multi = true;
+    worker->batchable = batchable;
+    worker->map = map;
+    worker->free = noop_free;
+    sky_worker_set_servlets(worker, server->servlets, 1);
+    return sky_worker_run(worker);
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Processing
+//--------------------------------------
+
+int test_sky_servlet_failed_worklets() {
+    cleantmp();
+    struct tagbstring tmp_str = bsStatic("tmp");
+    struct tagbstring foo_str = bsStatic("foo");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    mu_assert_int_equals(sky_table_open(table), 0);
+    sky_table_free(table);
+    table = NULL;
+    sky_server *server = sky_server_create(NULL);
+    server->executor_thread_count = 2;
+    mu_assert_int_equals(sky_server_open_table(server, &tmp_str, &tmp_str, &table), 0);
+    server->worker_pool = sky_worker_pool_create(1);
+    mu_assert_int_equals(sky_worker_pool_start(server->worker_pool), 0);
+
+    // Failed writers and readers return an error to their worker.
+    map_count = 0;
+    mu_assert_int_equals(run_worker(server, failing_map, true), -1);
+    mu_assert_int_equals(run_worker(server, failing_map, false), -1);
+
+    // A batch that can't be started fails its worklets without mapping them.
+    mu_assert_int_equals(sky_tablet_begin_batch(server->servlets[0]->tablet), 0);
+    mu_assert_int_equals(run_worker(server, succeeding_map, true), -1);
+    mu_assert_int_equals(map_count, 2);
+
+    // The servlet keeps processing later worklets.
+    mu_assert_int_equals(run_worker(server, succeeding_map, true), 0);
+    mu_assert_int_equals(run_worker(server, succeeding_map, false), 0);
+    mu_assert_int_equals(map_count, 4);
+
+    // The writes of a failed writer are never committed.
+    mu_assert_int_equals(run_worker(server, partial_map, true), -1);
+    mu_assert_int_equals(map_count, 5);
+    mu_assert_int_equals(add_event_rc, 0);
+    void *data = NULL;
+    size_t data_length = 0;
+    mu_assert_int_equals(sky_tablet_get_path(table->tablets[0], &foo_str, &data, &data_length), 0);
+    mu_assert_long_equals((long)data_length, 0L);
+    free(data);
+
+    mu_assert_int_equals(sky_server_stop(server), 0);
+    sky_server_free(server);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_servlet_failed_worklets);
+    return 0;
+}
+
+RUN_TESTS()
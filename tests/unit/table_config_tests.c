@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <table_config.h>
+#include <table.h>
+#include <dbg.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Load
+//--------------------------------------
+
+int test_sky_table_config_load() {
+    sky_table_config config;
+    sky_table_config_init(&config);
+    struct tagbstring path = bsStatic("tests/fixtures/table_config/0/config");
+    mu_assert_int_equals(sky_table_config_load(&config, &path), 0);
+    mu_assert_int_equals(config.bloom_bits_per_key, 16);
+    mu_assert_long_equals(config.write_buffer_size, 33554432L);
+    mu_assert_long_equals(config.block_size, (size_t)SKY_DEFAULT_BLOCK_SIZE);
+    mu_assert_int_equals(config.max_open_files, SKY_DEFAULT_MAX_OPEN_FILES);
+    mu_assert_bool(!config.compression);
+    return 0;
+}
+
+int test_sky_table_config_load_missing() {
+    sky_table_config config;
+    sky_table_config_init(&config);
+    struct tagbstring path = bsStatic("tests/fixtures/table_config/missing");
+    mu_assert_int_equals(sky_table_config_load(&config, &path), 0);
+    mu_assert_int_equals(config.bloom_bits_per_key, SKY_DEFAULT_BLOOM_BITS_PER_KEY);
+    mu_assert_bool(config.compression);
+    return 0;
+}
+
+int test_sky_table_config_load_invalid() {
+    sky_table_config config;
+    sky_table_config_init(&config);
+    struct tagbstring path = bsStatic("tests/fixtures/table_config/1/config");
+    mu_assert_int_equals(sky_table_config_load(&config, &path), -1);
+    return 0;
+}
+
+
+//--------------------------------------
+// Table
+//--------------------------------------
+
+int test_sky_table_open_with_config() {
+    loadtmp("tests/fixtures/table_config/0");
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    table->block_cache = leveldb_cache_create_lru(1024 * 1024);
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_int_equals(table->config.bloom_bits_per_key, 16);
+    mu_assert_bool(table->tablets[0]->filter_policy != NULL);
+
+    leveldb_cache_t *block_cache = table->block_cache;
+    sky_table_free(table);
+    leveldb_cache_destroy(block_cache);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_table_config_load);
+    mu_run_test(test_sky_table_config_load_missing);
+    mu_run_test(test_sky_table_config_load_invalid);
+    mu_run_test(test_sky_table_open_with_config);
+    return 0;
+}
+
+RUN_TESTS()
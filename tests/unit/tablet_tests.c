@@ -0,0 +1,942 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <tablet.h>
+#include <table.h>
+#include <path_iterator.h>
+#include <timestamp.h>
+#include <dbg.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+//==============================================================================
+//
+// Globals
+//
+//==============================================================================
+
+struct tagbstring foo = bsStatic("foo");
+
+struct tagbstring foobar = bsStatic("foobar");
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+// Adds an action-only event to a tablet.
+#define add_action_event(TABLET, OBJECT_ID, SECONDS, ACTION_ID) do {\
+    sky_event *event = sky_event_create(OBJECT_ID, SECONDS * 1000000LL, ACTION_ID); \
+    mu_assert_int_equals(sky_tablet_add_event(TABLET, event), 0); \
+    sky_event_free(event); \
+} while(0)
+
+// Adds a data-only event that sets an object property to a value.
+#define add_state_event(TABLET, OBJECT_ID, SECONDS, VALUE) do {\
+    sky_event *event = sky_event_create(OBJECT_ID, SECONDS * 1000000LL, 0); \
+    event->data = calloc(1, sizeof(*event->data)); \
+    event->data[0] = sky_event_data_create_int(1, VALUE); \
+    event->data_count = 1; \
+    mu_assert_int_equals(sky_tablet_add_event(TABLET, event), 0); \
+    sky_event_free(event); \
+} while(0)
+
+// Asserts the action ids and timestamps of each event on a raw path.
+#define mu_assert_path_actions(DATA, DATA_LENGTH, COUNT, ...) do {\
+    int64_t _expected[] = {__VA_ARGS__}; \
+    sky_timestamp_t _ts = 0; \
+    sky_action_id_t _action_id; \
+    sky_event_data_length_t _data_length; \
+    size_t _sz; \
+    int _i; \
+    void *_ptr = DATA; \
+    for(_i=0; _i<COUNT; _i++) { \
+        mu_assert_bool(_ptr < DATA + DATA_LENGTH); \
+        mu_assert_int_equals(sky_event_unpack_raw_hdr(_ptr, _ts, &_ts, &_action_id, &_data_length, &_sz), 0); \
+        mu_assert_int64_equals(_ts, sky_timestamp_shift(_expected[_i*2] * 1000000LL)); \
+        mu_assert_int_equals(_action_id, (int)_expected[_i*2+1]); \
+        _ptr += _sz + _data_length; \
+    } \
+    mu_assert_bool(_ptr == DATA + DATA_LENGTH); \
+} while(0)
+
+// Counts the number of chunks stored in a tablet and verifies that none of
+// them exceeds the given size.
+int count_chunks(sky_tablet *tablet, size_t max_length) {
+    int count = 0;
+    leveldb_iterator_t *iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    for(leveldb_iter_seek_to_first(iterator); leveldb_iter_valid(iterator); leveldb_iter_next(iterator)) {
+        uint8_t key_type;
+        size_t key_length, value_length;
+        const char *key = leveldb_iter_key(iterator, &key_length);
+        sky_tablet_key_parse(key, key_length, NULL, &key_type, NULL);
+        if(key_type == SKY_TABLET_KEY_TYPE_CHUNK) {
+            leveldb_iter_value(iterator, &value_length);
+            if(value_length > max_length) count = -1000;
+            count++;
+        }
+    }
+    leveldb_iter_destroy(iterator);
+    return count;
+}
+
+// Counts the number of keys stored in LevelDB for objects. The tablet's own
+// metadata keys are not counted.
+int count_object_keys(sky_tablet *tablet) {
+    int count = 0;
+    leveldb_iterator_t *iterator = leveldb_create_iterator(tablet->leveldb_db, tablet->readoptions);
+    for(leveldb_iter_seek_to_first(iterator); leveldb_iter_valid(iterator); leveldb_iter_next(iterator)) {
+        size_t key_length, object_id_length;
+        const char *key = leveldb_iter_key(iterator, &key_length);
+        if(sky_tablet_key_parse(key, key_length, &object_id_length, NULL, NULL) != 0 || object_id_length > 0) {
+            count++;
+        }
+    }
+    leveldb_iter_destroy(iterator);
+    return count;
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Keys
+//--------------------------------------
+
+int test_sky_tablet_key() {
+    bstring key1 = sky_tablet_key_create(&foo, SKY_TABLET_KEY_TYPE_CHUNK, -10);
+    bstring key2 = sky_tablet_key_create(&foo, SKY_TABLET_KEY_TYPE_CHUNK, 20);
+    bstring key3 = sky_tablet_key_create(&foobar, SKY_TABLET_KEY_TYPE_CHUNK, 0);
+    mu_assert_int_equals(blength(key1), 13);
+    mu_assert_mem(key2->data, "foo\x00\x01\x80\x00\x00\x00\x00\x00\x00\x14", 13);
+    mu_assert_bool(memcmp(key1->data, key2->data, 13) < 0);
+    mu_assert_bool(memcmp(key2->data, key3->data, 13) < 0);
+
+    size_t object_id_length;
+    uint8_t key_type;
+    sky_timestamp_t timestamp;
+    mu_assert_int_equals(sky_tablet_key_parse((char*)key1->data, blength(key1), &object_id_length, &key_type, &timestamp), 0);
+    mu_assert_long_equals(object_id_length, 3L);
+    mu_assert_int_equals(key_type, SKY_TABLET_KEY_TYPE_CHUNK);
+    mu_assert_int64_equals(timestamp, -10LL);
+    mu_assert_int_equals(sky_tablet_key_parse("foo", 3, &object_id_length, &key_type, &timestamp), -1);
+
+    bdestroy(key1);
+    bdestroy(key2);
+    bdestroy(key3);
+    return 0;
+}
+
+
+//--------------------------------------
+// Chunks
+//--------------------------------------
+
+int test_sky_tablet_add_event_split_chunks() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+    tablet->max_chunk_size = 32;
+
+    // Append events.
+    int i;
+    for(i=1; i<=6; i++) {
+        add_action_event(tablet, &foo, i*10, i);
+    }
+    mu_assert_bool(count_chunks(tablet, 32) > 1);
+
+    // Insert events out of order, before the start and between chunks.
+    add_action_event(tablet, &foo, 5, 7);
+    add_action_event(tablet, &foo, 35, 8);
+    add_action_event(tablet, &foo, 30, 9);
+    add_action_event(tablet, &foobar, 1, 10);
+    mu_assert_bool(count_chunks(tablet, 32) > 2);
+
+    // Verify the stitched path.
+    void *data;
+    size_t data_length;
+    sky_tablet_get_path(tablet, &foo, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 9,
+        5,7, 10,1, 20,2, 30,9, 30,3, 35,8, 40,4, 50,5, 60,6);
+    free(data);
+
+    sky_tablet_get_path(tablet, &foobar, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 1, 1,10);
+    free(data);
+    mu_assert_int64_equals(tablet->stats.append_count, 7LL);
+    mu_assert_int64_equals(tablet->stats.merge_count, 3LL);
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_tablet_path_in_place() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+    tablet->max_chunk_size = 32;
+
+    int i;
+    add_action_event(tablet, &foo, 10, 1);
+    add_action_event(tablet, &foo, 30, 2);
+    add_action_event(tablet, &foo, 20, 3);
+    for(i=1; i<=6; i++) {
+        add_action_event(tablet, &foobar, i*10, i);
+    }
+
+    // A path held in a single chunk is read in place and longer paths are
+    // copied.
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_tablet(&iterator, tablet), 0);
+    mu_assert_bool(iterator.path.held);
+    mu_assert_bool(iterator.path.data != iterator.path.buffer);
+    mu_assert_path_actions(iterator.path.data, iterator.path.data_length, 3, 10,1, 20,3, 30,2);
+    mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    mu_assert_bool(!iterator.path.held);
+    mu_assert_bool(iterator.path.chunk_count > 1);
+    mu_assert_path_actions(iterator.path.data, iterator.path.data_length, 6, 10,1, 20,2, 30,3, 40,4, 50,5, 60,6);
+    mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    mu_assert_bool(sky_path_iterator_eof(&iterator));
+    sky_path_iterator_uninit(&iterator);
+
+    // A chunk that only holds events newer than the segment is copied
+    // behind the segment's copy.
+    mu_assert_int_equals(sky_tablet_compact(tablet), 0);
+    add_action_event(tablet, &foo, 40, 4);
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_tablet(&iterator, tablet), 0);
+    mu_assert_bool(iterator.path.held);
+    mu_assert_bool(iterator.path.data == iterator.path.buffer);
+    mu_assert_path_actions(iterator.path.data, iterator.path.data_length, 4, 10,1, 20,3, 30,2, 40,4);
+    mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    mu_assert_path_actions(iterator.cursor.startptr, (size_t)(iterator.cursor.endptr - iterator.cursor.startptr), 6, 10,1, 20,2, 30,3, 40,4, 50,5, 60,6);
+    sky_path_iterator_uninit(&iterator);
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Migration
+//--------------------------------------
+
+int test_sky_tablet_migrate() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+
+    // Write a path under its bare object id and drop the format version.
+    int i;
+    size_t sz, data_length = 0;
+    char data[256];
+    for(i=1; i<=3; i++) {
+        sky_event *event = sky_event_create(&foo, i * 10000000LL, i);
+        mu_assert_int_equals(sky_event_pack(event, data + data_length, &sz), 0);
+        data_length += sz;
+        sky_event_free(event);
+    }
+    char *errptr = NULL;
+    struct tagbstring empty = bsStatic("");
+    bstring key = sky_tablet_key_create(&empty, SKY_TABLET_KEY_TYPE_META, 1);
+    leveldb_delete(tablet->leveldb_db, tablet->writeoptions, bdata(key), blength(key), &errptr);
+    leveldb_put(tablet->leveldb_db, tablet->writeoptions, bdata(&foo), blength(&foo), data, data_length, &errptr);
+    mu_assert_bool(errptr == NULL);
+    bdestroy(key);
+
+    // Reopening the tablet moves the path into chunks.
+    mu_assert_int_equals(sky_tablet_open(tablet), 0);
+    mu_assert_int_equals(count_chunks(tablet, 256), 1);
+    size_t value_length;
+    char *value = leveldb_get(tablet->leveldb_db, tablet->readoptions, bdata(&foo), blength(&foo), &value_length, &errptr);
+    mu_assert_bool(value == NULL);
+
+    void *path_data;
+    size_t path_data_length;
+    mu_assert_int_equals(sky_tablet_get_path(tablet, &foo, &path_data, &path_data_length), 0);
+    mu_assert_path_actions(path_data, path_data_length, 3, 10,1, 20,2, 30,3);
+    free(path_data);
+
+    bool found;
+    sky_tablet_summary summary;
+    mu_assert_int_equals(sky_tablet_get_summary(tablet, &foo, &summary, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(summary.event_count, 3LL);
+
+    // New events are appended to the migrated path.
+    add_action_event(tablet, &foo, 40, 4);
+    mu_assert_int_equals(sky_tablet_get_path(tablet, &foo, &path_data, &path_data_length), 0);
+    mu_assert_path_actions(path_data, path_data_length, 4, 10,1, 20,2, 30,3, 40,4);
+    free(path_data);
+    mu_assert_int64_equals(tablet->stats.append_count, 1LL);
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Tail Summary
+//--------------------------------------
+
+int test_sky_tablet_add_event_tail() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+
+    // Append an event with object state and then a redundant one.
+    sky_event *event = sky_event_create(&foo, 10000000LL, 1);
+    event->data = calloc(2, sizeof(*event->data));
+    event->data[0] = sky_event_data_create_int(1, 100);
+    event->data[1] = sky_event_data_create_string(2, &foobar);
+    event->data_count = 2;
+    mu_assert_int_equals(sky_tablet_add_event(tablet, event), 0);
+    sky_event_free(event);
+
+    event = sky_event_create(&foo, 20000000LL, 0);
+    event->data = calloc(2, sizeof(*event->data));
+    event->data[0] = sky_event_data_create_int(1, 100);
+    event->data[1] = sky_event_data_create_string(2, &foo);
+    event->data_count = 2;
+    mu_assert_int_equals(sky_tablet_add_event(tablet, event), 0);
+    mu_assert_int_equals(event->data_count, 1);
+    sky_event_free(event);
+
+    // Verify the tail summary.
+    bool found;
+    sky_tablet_tail tail; memset(&tail, 0, sizeof(tail));
+    mu_assert_int_equals(sky_tablet_get_tail(tablet, &foo, &tail, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(tail.ts, sky_timestamp_shift(20000000LL));
+    mu_assert_int64_equals(tail.chunk_ts, sky_timestamp_shift(10000000LL));
+    mu_assert_int_equals(tail.data_count, 2);
+    mu_assert_int64_equals(tail.data[0]->int_value, 100LL);
+    mu_assert_bstring(tail.data[1]->string_value, "foo");
+
+    // Merging an older event rebuilds the tail summary.
+    event = sky_event_create(&foo, 15000000LL, 0);
+    event->data = calloc(1, sizeof(*event->data));
+    event->data[0] = sky_event_data_create_int(3, 20);
+    event->data_count = 1;
+    mu_assert_int_equals(sky_tablet_add_event(tablet, event), 0);
+    sky_event_free(event);
+
+    mu_assert_int_equals(sky_tablet_get_tail(tablet, &foo, &tail, &found), 0);
+    mu_assert_int64_equals(tail.ts, sky_timestamp_shift(20000000LL));
+    mu_assert_int_equals(tail.data_count, 3);
+    mu_assert_int64_equals(tail.data[2]->int_value, 20LL);
+    sky_tablet_tail_uninit(&tail);
+
+    mu_assert_int64_equals(tablet->stats.append_count, 2LL);
+    mu_assert_int64_equals(tablet->stats.merge_count, 1LL);
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_tablet_summary() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+    tablet->max_chunk_size = 32;
+
+    // Appends extend the summary.
+    bool found;
+    sky_tablet_summary summary;
+    add_action_event(tablet, &foo, 20, 1);
+    add_action_event(tablet, &foo, 30, 260);
+    mu_assert_int_equals(sky_tablet_get_summary(tablet, &foo, &summary, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(summary.min_ts, sky_timestamp_shift(20000000LL));
+    mu_assert_int64_equals(summary.max_ts, sky_timestamp_shift(30000000LL));
+    mu_assert_int64_equals(summary.event_count, 2LL);
+    mu_assert_int_equals(summary.actions[0], 0x12);
+
+    // Merges rebuild the summary from the full path.
+    add_action_event(tablet, &foo, 10, 9);
+    mu_assert_int_equals(sky_tablet_get_summary(tablet, &foo, &summary, &found), 0);
+    mu_assert_int64_equals(summary.min_ts, sky_timestamp_shift(10000000LL));
+    mu_assert_int64_equals(summary.event_count, 3LL);
+    mu_assert_int_equals(summary.actions[1], 0x02);
+
+    uint8_t actions[SKY_TABLET_SUMMARY_ACTION_BYTES];
+    memset(actions, 0, sizeof(actions));
+    sky_tablet_summary_set_action(actions, 2);
+    mu_assert_bool(!sky_tablet_summary_has_any_action(&summary, actions));
+    sky_tablet_summary_set_action(actions, 9);
+    mu_assert_bool(sky_tablet_summary_has_any_action(&summary, actions));
+
+    // Compaction keeps the summary and later appends still extend it.
+    mu_assert_int_equals(sky_tablet_compact(tablet), 0);
+    add_action_event(tablet, &foo, 40, 2);
+    mu_assert_int_equals(sky_tablet_get_summary(tablet, &foo, &summary, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(summary.max_ts, sky_timestamp_shift(40000000LL));
+    mu_assert_int64_equals(summary.event_count, 4LL);
+    mu_assert_int_equals(summary.actions[0], 0x16);
+
+    // Objects without a path have no summary.
+    mu_assert_int_equals(sky_tablet_get_summary(tablet, &foobar, &summary, &found), 0);
+    mu_assert_bool(!found);
+    mu_assert_int64_equals(summary.event_count, 0LL);
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_tablet_checkpoint() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+    tablet->max_chunk_size = 1024;
+
+    // Each event sets the object state to its index.
+    int i;
+    mu_assert_int_equals(sky_tablet_begin_batch(tablet), 0);
+    for(i=1; i<=2100; i++) {
+        add_state_event(tablet, &foo, i*10, i);
+    }
+    mu_assert_int_equals(sky_tablet_end_batch(tablet), 0);
+    mu_assert_bool(count_chunks(tablet, 1024) > 1);
+
+    // A checkpoint is kept before every 1024th event.
+    bool found;
+    size_t sz;
+    sky_event_data *data = sky_event_data_create(0);
+    sky_tablet_checkpoint checkpoint; memset(&checkpoint, 0, sizeof(checkpoint));
+    mu_assert_int_equals(sky_tablet_get_checkpoint(tablet, &foo, sky_timestamp_shift(100000000LL), &checkpoint, &found), 0);
+    mu_assert_bool(!found);
+    mu_assert_int_equals(sky_tablet_get_checkpoint(tablet, &foo, sky_timestamp_shift(15000000000LL), &checkpoint, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(checkpoint.ts, sky_timestamp_shift(10250000000LL));
+    mu_assert_int64_equals(checkpoint.prev_ts, sky_timestamp_shift(10240000000LL));
+    mu_assert_int64_equals(checkpoint.event_index, 1024LL);
+    mu_assert_int_equals(sky_event_data_unpack(data, checkpoint.state, &sz), 0);
+    mu_assert_int64_equals(data->int_value, 1024LL);
+    mu_assert_int_equals(sky_tablet_get_checkpoint(tablet, &foo, sky_timestamp_shift(20490000000LL), &checkpoint, &found), 0);
+    mu_assert_int64_equals(checkpoint.event_index, 2048LL);
+
+    // Merging an older event rebuilds the checkpoints.
+    add_state_event(tablet, &foo, 5, 9999);
+    mu_assert_int_equals(sky_tablet_get_checkpoint(tablet, &foo, sky_timestamp_shift(20485000000LL), &checkpoint, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(checkpoint.ts, sky_timestamp_shift(20480000000LL));
+    mu_assert_int64_equals(checkpoint.event_index, 2048LL);
+    mu_assert_int_equals(sky_event_data_unpack(data, checkpoint.state, &sz), 0);
+    mu_assert_int64_equals(data->int_value, 2047LL);
+
+    // Merging between checkpoints keeps the earlier ones and rebuilds the
+    // later ones.
+    sky_tablet_summary summary;
+    add_state_event(tablet, &foo, 15005, 7777);
+    mu_assert_int_equals(sky_tablet_get_checkpoint(tablet, &foo, sky_timestamp_shift(15005000000LL), &checkpoint, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(checkpoint.ts, sky_timestamp_shift(10240000000LL));
+    mu_assert_int64_equals(checkpoint.event_index, 1024LL);
+    mu_assert_int_equals(sky_tablet_get_checkpoint(tablet, &foo, sky_timestamp_shift(20485000000LL), &checkpoint, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(checkpoint.ts, sky_timestamp_shift(20470000000LL));
+    mu_assert_int64_equals(checkpoint.event_index, 2048LL);
+    mu_assert_int_equals(sky_event_data_unpack(data, checkpoint.state, &sz), 0);
+    mu_assert_int64_equals(data->int_value, 2046LL);
+    mu_assert_int_equals(sky_tablet_get_summary(tablet, &foo, &summary, &found), 0);
+    mu_assert_int64_equals(summary.event_count, 2102LL);
+    mu_assert_int64_equals(summary.checkpoint_event_count, 2048LL);
+    mu_assert_int64_equals(summary.min_ts, sky_timestamp_shift(5000000LL));
+
+    // Checkpoints are moved into the segment by compaction.
+    mu_assert_int_equals(sky_tablet_compact(tablet), 0);
+    mu_assert_int_equals(count_object_keys(tablet), 0);
+    mu_assert_int_equals(sky_tablet_get_checkpoint(tablet, &foo, sky_timestamp_shift(15000000000LL), &checkpoint, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(checkpoint.ts, sky_timestamp_shift(10240000000LL));
+    mu_assert_int_equals(sky_tablet_get_checkpoint(tablet, &foo, sky_timestamp_shift(20485000000LL), &checkpoint, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(checkpoint.ts, sky_timestamp_shift(20470000000LL));
+    mu_assert_int64_equals(checkpoint.event_index, 2048LL);
+    mu_assert_int_equals(sky_tablet_get_summary(tablet, &foo, &summary, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(summary.event_count, 2102LL);
+
+    // They are copied back into LevelDB when the object is merged into.
+    add_state_event(tablet, &foo, 15, 8888);
+    mu_assert_bool(count_object_keys(tablet) > 0);
+    mu_assert_int_equals(sky_tablet_get_checkpoint(tablet, &foo, sky_timestamp_shift(15000000000LL), &checkpoint, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(checkpoint.event_index, 1024LL);
+    mu_assert_int_equals(sky_tablet_get_summary(tablet, &foo, &summary, &found), 0);
+    mu_assert_int64_equals(summary.event_count, 2103LL);
+
+    sky_event_data_free(data);
+    sky_tablet_checkpoint_uninit(&checkpoint);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Object State
+//--------------------------------------
+
+int test_sky_tablet_get_state() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+    tablet->max_chunk_size = 1024;
+
+    // Each event sets the object state to its index.
+    int i;
+    mu_assert_int_equals(sky_tablet_begin_batch(tablet), 0);
+    for(i=1; i<=2100; i++) {
+        add_state_event(tablet, &foo, i*10, i);
+    }
+    mu_assert_int_equals(sky_tablet_end_batch(tablet), 0);
+    mu_assert_bool(count_chunks(tablet, 1024) > 1);
+
+    // Missing objects and times before the first event have no state.
+    bool found;
+    sky_tablet_tail state; memset(&state, 0, sizeof(state));
+    mu_assert_int_equals(sky_tablet_get_state(tablet, &foobar, sky_timestamp_shift(100000000LL), &state, &found), 0);
+    mu_assert_bool(!found);
+    mu_assert_int_equals(sky_tablet_get_state(tablet, &foo, sky_timestamp_shift(5000000LL), &state, &found), 0);
+    mu_assert_bool(!found);
+    mu_assert_int_equals(state.data_count, 0);
+
+    // Times before the first checkpoint are replayed from the start.
+    mu_assert_int_equals(sky_tablet_get_state(tablet, &foo, sky_timestamp_shift(25000000LL), &state, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int_equals(state.data_count, 1);
+    mu_assert_int64_equals(state.data[0]->int_value, 2LL);
+    mu_assert_int64_equals(state.ts, sky_timestamp_shift(20000000LL));
+
+    // Later times are replayed from a checkpoint, inclusive of the time.
+    mu_assert_int_equals(sky_tablet_get_state(tablet, &foo, sky_timestamp_shift(15000000000LL), &state, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(state.data[0]->int_value, 1500LL);
+    mu_assert_int_equals(sky_tablet_get_state(tablet, &foo, sky_timestamp_shift(10250000000LL), &state, &found), 0);
+    mu_assert_int64_equals(state.data[0]->int_value, 1025LL);
+
+    // Times after the last event come from the tail summary.
+    mu_assert_int_equals(sky_tablet_get_state(tablet, &foo, sky_timestamp_shift(99000000000LL), &state, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(state.data[0]->int_value, 2100LL);
+
+    // Checkpoints in the segment's copy of the path are replayed from the
+    // segment and continue into the chunks appended after compaction.
+    mu_assert_int_equals(sky_tablet_compact(tablet), 0);
+    mu_assert_int_equals(sky_tablet_get_state(tablet, &foo, sky_timestamp_shift(15000000000LL), &state, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(state.data[0]->int_value, 1500LL);
+    mu_assert_int_equals(sky_tablet_begin_batch(tablet), 0);
+    for(i=2101; i<=2200; i++) {
+        add_state_event(tablet, &foo, i*10, i);
+    }
+    mu_assert_int_equals(sky_tablet_end_batch(tablet), 0);
+    mu_assert_int_equals(sky_tablet_get_state(tablet, &foo, sky_timestamp_shift(15000000000LL), &state, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(state.data[0]->int_value, 1500LL);
+    mu_assert_int64_equals(state.ts, sky_timestamp_shift(15000000000LL));
+    mu_assert_int_equals(sky_tablet_get_state(tablet, &foo, sky_timestamp_shift(21505000000LL), &state, &found), 0);
+    mu_assert_int64_equals(state.data[0]->int_value, 2150LL);
+
+    sky_tablet_tail_uninit(&state);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Write Batch
+//--------------------------------------
+
+int test_sky_tablet_batch() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+    tablet->max_chunk_size = 32;
+
+    // Appends within a batch are held until the batch is flushed.
+    mu_assert_int_equals(sky_tablet_begin_batch(tablet), 0);
+    int i;
+    for(i=1; i<=5; i++) {
+        add_action_event(tablet, &foo, i*10, i);
+    }
+    add_action_event(tablet, &foobar, 10, 6);
+    mu_assert_int_equals(count_chunks(tablet, 32), 0);
+    mu_assert_int_equals(sky_tablet_flush_batch(tablet), 0);
+    mu_assert_int64_equals(tablet->stats.write_count, 1LL);
+    mu_assert_int_equals(count_chunks(tablet, 32), 3);
+
+    // Merges commit the pending writes before reading the path.
+    add_action_event(tablet, &foo, 60, 7);
+    add_action_event(tablet, &foo, 5, 8);
+    mu_assert_int64_equals(tablet->stats.write_count, 2LL);
+    mu_assert_int_equals(sky_tablet_end_batch(tablet), 0);
+    mu_assert_int64_equals(tablet->stats.write_count, 3LL);
+    mu_assert_bool(tablet->batch == NULL);
+
+    void *data;
+    size_t data_length;
+    sky_tablet_get_path(tablet, &foo, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 7,
+        5,8, 10,1, 20,2, 30,3, 40,4, 50,5, 60,7);
+    free(data);
+
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_tablet_rollback_batch() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+    tablet->max_chunk_size = 32;
+
+    // Writes after the savepoint are undone, including replaced entries.
+    mu_assert_int_equals(sky_tablet_begin_batch(tablet), 0);
+    mu_assert_int_equals(sky_tablet_rollback_batch(tablet), -1);
+    add_action_event(tablet, &foo, 10, 1);
+    add_action_event(tablet, &foo, 20, 2);
+    mu_assert_int_equals(sky_tablet_save_batch(tablet), 0);
+    add_action_event(tablet, &foo, 30, 3);
+    add_action_event(tablet, &foo, 40, 4);
+    add_action_event(tablet, &foobar, 10, 5);
+    mu_assert_int_equals(sky_tablet_rollback_batch(tablet), 0);
+    add_action_event(tablet, &foo, 50, 6);
+
+    // A merge flushes the batch so only the writes after the flush are undone.
+    mu_assert_int_equals(sky_tablet_save_batch(tablet), 0);
+    add_action_event(tablet, &foo, 5, 7);
+    add_action_event(tablet, &foo, 60, 8);
+    mu_assert_int_equals(sky_tablet_rollback_batch(tablet), 0);
+    mu_assert_int64_equals(tablet->stats.write_count, 1LL);
+    mu_assert_int_equals(sky_tablet_end_batch(tablet), 0);
+
+    void *data;
+    size_t data_length;
+    sky_tablet_get_path(tablet, &foo, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 3,
+        10,1, 20,2, 50,6);
+    free(data);
+    sky_tablet_get_path(tablet, &foobar, &data, &data_length);
+    mu_assert_long_equals((long)data_length, 0L);
+    free(data);
+
+    bool found;
+    sky_tablet_tail tail; memset(&tail, 0, sizeof(tail));
+    mu_assert_int_equals(sky_tablet_get_tail(tablet, &foo, &tail, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(tail.ts, sky_timestamp_shift(50000000LL));
+    sky_tablet_tail_uninit(&tail);
+
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_tablet_sync_if_due() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    table->durability = SKY_TABLET_DURABILITY_INTERVAL;
+    table->sync_interval = 1000000;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+
+    // The first write syncs and the next one waits for the interval.
+    add_action_event(tablet, &foo, 10, 1);
+    mu_assert_bool(!tablet->unsynced);
+    add_action_event(tablet, &foo, 20, 2);
+    mu_assert_bool(tablet->unsynced);
+    mu_assert_int_equals(sky_tablet_sync_if_due(tablet), 0);
+    mu_assert_bool(tablet->unsynced);
+
+    // An idle tablet is synced once the interval has elapsed.
+    tablet->last_sync_time -= 1000000;
+    mu_assert_int_equals(sky_tablet_sync_if_due(tablet), 0);
+    mu_assert_bool(!tablet->unsynced);
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Compaction
+//--------------------------------------
+
+int test_sky_tablet_compact() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+    tablet->max_chunk_size = 32;
+
+    int i;
+    for(i=1; i<=4; i++) {
+        add_action_event(tablet, &foo, i*10, i);
+    }
+    add_action_event(tablet, &foobar, 10, 5);
+
+    // Compaction moves all chunks, summaries and checkpoints into the segment.
+    bool found;
+    sky_tablet_tail tail; memset(&tail, 0, sizeof(tail));
+    mu_assert_int_equals(sky_tablet_compact(tablet), 0);
+    mu_assert_int_equals(count_object_keys(tablet), 0);
+    mu_assert_int64_equals(tablet->segment->entry_count, 2LL);
+    mu_assert_int_equals(sky_tablet_get_tail(tablet, &foo, &tail, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int64_equals(tail.ts, sky_timestamp_shift(40000000LL));
+
+    void *data;
+    size_t data_length;
+    sky_tablet_get_path(tablet, &foo, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 4, 10,1, 20,2, 30,3, 40,4);
+    free(data);
+
+    // New events are appended to LevelDB and combined with the segment.
+    add_action_event(tablet, &foo, 50, 6);
+    mu_assert_int_equals(count_chunks(tablet, 32), 1);
+    sky_tablet_get_path(tablet, &foo, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 5, 10,1, 20,2, 30,3, 40,4, 50,6);
+    free(data);
+
+    // Older events copy the segment path back into LevelDB.
+    add_action_event(tablet, &foo, 25, 7);
+    sky_tablet_get_path(tablet, &foo, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 6, 10,1, 20,2, 25,7, 30,3, 40,4, 50,6);
+    free(data);
+
+    // Compacting again replaces the segment.
+    mu_assert_int_equals(sky_tablet_compact(tablet), 0);
+    mu_assert_int64_equals(tablet->segment->generation, 2LL);
+    mu_assert_int_equals(count_chunks(tablet, 32), 0);
+    sky_table_close(table);
+    sky_table_free(table);
+
+    // Reopen the table and read from the segment.
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+    tablet = table->tablets[0];
+    sky_tablet_get_path(tablet, &foo, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 6, 10,1, 20,2, 25,7, 30,3, 40,4, 50,6);
+    free(data);
+    sky_tablet_get_path(tablet, &foobar, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 1, 10,5);
+    free(data);
+
+    // Objects that were only in the segment continue from their tail.
+    mu_assert_int_equals(count_object_keys(tablet), 0);
+    add_action_event(tablet, &foobar, 20, 8);
+    add_action_event(tablet, &foobar, 15, 9);
+    sky_tablet_get_path(tablet, &foobar, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 3, 10,5, 15,9, 20,8);
+    free(data);
+    mu_assert_int_equals(sky_tablet_get_tail(tablet, &foobar, &tail, &found), 0);
+    mu_assert_int64_equals(tail.ts, sky_timestamp_shift(20000000LL));
+
+    sky_tablet_tail_uninit(&tail);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Splitting
+//--------------------------------------
+
+int test_sky_tablet_get_split_keys() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+
+    int i;
+    for(i=0; i<100; i++) {
+        bstring object_id = bformat("obj%03d", i);
+        add_action_event(tablet, object_id, 10, 1);
+        add_action_event(tablet, object_id, 20, 2);
+        bdestroy(object_id);
+    }
+
+    // Data in the memtable is not counted so nothing is split.
+    bstring *keys = NULL;
+    uint32_t count = 0;
+    mu_assert_int_equals(sky_tablet_get_split_keys(tablet, 4, 0, &keys, &count), 0);
+    mu_assert_int_equals(count, 0);
+
+    // Segment entries are split into ranges of roughly equal size.
+    mu_assert_int_equals(sky_tablet_compact(tablet), 0);
+    mu_assert_int_equals(sky_tablet_get_split_keys(tablet, 4, 0, &keys, &count), 0);
+    mu_assert_int_equals(count, 3);
+    int total = 0;
+    for(i=0; i<=(int)count; i++) {
+        int path_count = 0;
+        sky_path_iterator iterator;
+        sky_path_iterator_init(&iterator);
+        mu_assert_int_equals(sky_path_iterator_set_range(&iterator, tablet, (i > 0 ? keys[i-1] : NULL), (i < (int)count ? keys[i] : NULL)), 0);
+        while(!sky_path_iterator_eof(&iterator)) {
+            path_count++;
+            mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+        }
+        sky_path_iterator_uninit(&iterator);
+        mu_assert_bool(path_count >= 20 && path_count <= 30);
+        total += path_count;
+    }
+    mu_assert_int_equals(total, 100);
+    for(i=0; i<(int)count; i++) bdestroy(keys[i]);
+    free(keys);
+
+    // Ranges below the minimum size are not split.
+    mu_assert_int_equals(sky_tablet_get_split_keys(tablet, 4, 1000000, &keys, &count), 0);
+    mu_assert_int_equals(count, 0);
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Resharding
+//--------------------------------------
+
+int test_sky_tablet_reshard() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_tablet_count = 1;
+    sky_table_open(table);
+    sky_tablet *tablet = table->tablets[0];
+    tablet->max_chunk_size = 32;
+
+    // Objects are found in both the segment and LevelDB.
+    int i;
+    for(i=1; i<=4; i++) {
+        add_action_event(tablet, &foo, i*10, i);
+    }
+    mu_assert_int_equals(sky_tablet_compact(tablet), 0);
+    add_action_event(tablet, &foo, 50, 5);
+    add_action_event(tablet, &foobar, 10, 6);
+
+    bstring *object_ids = NULL;
+    uint32_t count = 0;
+    mu_assert_int_equals(sky_tablet_get_object_ids(tablet, NULL, 10, &object_ids, &count), 0);
+    mu_assert_int_equals(count, 2);
+    mu_assert_bstring(object_ids[0], "foo");
+    mu_assert_bstring(object_ids[1], "foobar");
+    for(i=0; i<(int)count; i++) bdestroy(object_ids[i]);
+    free(object_ids);
+    mu_assert_int_equals(sky_tablet_get_object_ids(tablet, &foo, 10, &object_ids, &count), 0);
+    mu_assert_int_equals(count, 1);
+    mu_assert_bstring(object_ids[0], "foobar");
+    bdestroy(object_ids[0]);
+    free(object_ids);
+
+    // Copy each object into the new layout.
+    sky_tablet *target = NULL;
+    mu_assert_int_equals(sky_table_begin_reshard(table, 3), 0);
+    tablet->track_changes = true;
+    mu_assert_int_equals(sky_table_get_reshard_target(table, &foo, &target), 0);
+    mu_assert_int_equals(sky_tablet_copy_object(tablet, &foo, target), 0);
+    mu_assert_int_equals(sky_table_get_reshard_target(table, &foobar, &target), 0);
+    mu_assert_int_equals(sky_tablet_copy_object(tablet, &foobar, target), 0);
+
+    // Changes after the copy are applied during the switchover.
+    add_action_event(tablet, &foo, 60, 7);
+    mu_assert_int_equals(tablet->changed_object_id_count, 1);
+    sky_table_set_reshard_state(table, SKY_TABLE_RESHARD_STATE_COPIED);
+    mu_assert_int_equals(sky_table_finish_reshard(table), 0);
+    mu_assert_int_equals(table->tablet_count, 3);
+    mu_assert_bool(table->reshard == NULL);
+    sky_table_close(table);
+    sky_table_free(table);
+
+    // Reopen the table with the new layout.
+    void *data;
+    size_t data_length;
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    sky_table_open(table);
+    mu_assert_int_equals(table->tablet_count, 3);
+    mu_assert_int_equals(sky_table_get_target_tablet(table, &foo, &tablet), 0);
+    sky_tablet_get_path(tablet, &foo, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 6, 10,1, 20,2, 30,3, 40,4, 50,5, 60,7);
+    free(data);
+    mu_assert_int_equals(sky_table_get_target_tablet(table, &foobar, &tablet), 0);
+    sky_tablet_get_path(tablet, &foobar, &data, &data_length);
+    mu_assert_path_actions(data, data_length, 1, 10,6);
+    free(data);
+
+    sky_table_free(table);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_tablet_key);
+    mu_run_test(test_sky_tablet_add_event_split_chunks);
+    mu_run_test(test_sky_tablet_path_in_place);
+    mu_run_test(test_sky_tablet_migrate);
+    mu_run_test(test_sky_tablet_add_event_tail);
+    mu_run_test(test_sky_tablet_summary);
+    mu_run_test(test_sky_tablet_checkpoint);
+    mu_run_test(test_sky_tablet_get_state);
+    mu_run_test(test_sky_tablet_batch);
+    mu_run_test(test_sky_tablet_rollback_batch);
+    mu_run_test(test_sky_tablet_sync_if_due);
+    mu_run_test(test_sky_tablet_compact);
+    mu_run_test(test_sky_tablet_get_split_keys);
+    mu_run_test(test_sky_tablet_reshard);
+    return 0;
+}
+
+RUN_TESTS()
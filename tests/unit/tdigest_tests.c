@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <tdigest.h>
+#include <mem.h>
+
+#include "../minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+// Checks that a value is within a tolerance of the expected value.
+#define mu_assert_near(ACTUAL, EXPECTED, TOLERANCE) \
+    mu_assert_bool(fabs((ACTUAL) - (EXPECTED)) <= (TOLERANCE))
+
+// Adds the values from 0 to count-1 to a digest in a shuffled order.
+void add_shuffled(sky_tdigest *digest, uint32_t count, uint32_t step, uint32_t offset)
+{
+    uint32_t i;
+    for(i=offset; i<count; i+=step) {
+        sky_tdigest_add(digest, (double)(((uint64_t)i * 7919) % count), 1);
+    }
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Sketching
+//--------------------------------------
+
+int test_sky_tdigest_empty() {
+    sky_tdigest *digest = sky_tdigest_create();
+    mu_assert_bool(isnan(sky_tdigest_quantile(digest, 0.5)));
+    mu_assert_bool(isnan(sky_tdigest_min(digest)));
+    mu_assert_bool(sky_tdigest_count(digest) == 0);
+    sky_tdigest_free(digest);
+    return 0;
+}
+
+int test_sky_tdigest_small() {
+    sky_tdigest *digest = sky_tdigest_create();
+    sky_tdigest_add(digest, 10, 1);
+    mu_assert_bool(sky_tdigest_quantile(digest, 0.5) == 10);
+    sky_tdigest_add(digest, 20, 1);
+    sky_tdigest_add(digest, 30, 2);
+    mu_assert_bool(sky_tdigest_count(digest) == 4);
+    mu_assert_bool(sky_tdigest_min(digest) == 10);
+    mu_assert_bool(sky_tdigest_max(digest) == 30);
+    mu_assert_bool(sky_tdigest_quantile(digest, 0) == 10);
+    mu_assert_bool(sky_tdigest_quantile(digest, 1) == 30);
+    mu_assert_near(sky_tdigest_quantile(digest, 0.5), 23.333, 0.001);
+    sky_tdigest_free(digest);
+    return 0;
+}
+
+int test_sky_tdigest_quantile() {
+    sky_tdigest *digest = sky_tdigest_create();
+    add_shuffled(digest, 1000000, 1, 0);
+    mu_assert_bool(sky_tdigest_count(digest) == 1000000);
+    mu_assert_near(sky_tdigest_quantile(digest, 0.5), 500000, 500);
+    mu_assert_near(sky_tdigest_quantile(digest, 0.95), 950000, 300);
+    mu_assert_near(sky_tdigest_quantile(digest, 0.99), 990000, 200);
+    mu_assert_near(sky_tdigest_quantile(digest, 0.999), 999000, 100);
+
+    // Memory is bounded by the compression.
+    sky_tdigest_compress(digest);
+    mu_assert_bool(digest->count <= SKY_TDIGEST_COMPRESSION);
+    sky_tdigest_free(digest);
+    return 0;
+}
+
+int test_sky_tdigest_merge() {
+    uint32_t i;
+    sky_tdigest *digest = sky_tdigest_create();
+    sky_tdigest *others[4];
+    for(i=0; i<4; i++) {
+        others[i] = sky_tdigest_create();
+        add_shuffled(others[i], 100000, 4, i);
+        sky_tdigest_merge(digest, others[i]);
+        sky_tdigest_free(others[i]);
+    }
+    mu_assert_bool(sky_tdigest_count(digest) == 100000);
+    mu_assert_bool(sky_tdigest_min(digest) == 0);
+    mu_assert_bool(sky_tdigest_max(digest) == 99999);
+    mu_assert_near(sky_tdigest_quantile(digest, 0.5), 50000, 500);
+    mu_assert_near(sky_tdigest_quantile(digest, 0.99), 99000, 50);
+    sky_tdigest_free(digest);
+    return 0;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int test_sky_tdigest_pack() {
+    char buffer[SKY_TDIGEST_MAX_PACKED_SZ];
+    sky_tdigest *digest = sky_tdigest_create();
+    sky_tdigest *ret = sky_tdigest_create();
+    add_shuffled(digest, 10000, 1, 0);
+    uint32_t sz = sky_tdigest_pack(digest, buffer);
+    mu_assert_int_equals(sz, SKY_TDIGEST_HEADER_SZ + (digest->count * SKY_TDIGEST_CENTROID_SZ));
+    mu_assert_mem(buffer, SKY_TDIGEST_MAGIC, SKY_TDIGEST_MAGIC_SZ);
+    mu_assert_bool(sky_tdigest_is_packed(buffer, sz));
+    mu_assert_int_equals(sky_tdigest_unpack(ret, buffer, sz), 0);
+    mu_assert_int_equals(ret->count, digest->count);
+    mu_assert_bool(sky_tdigest_min(ret) == 0);
+    mu_assert_bool(sky_tdigest_max(ret) == 9999);
+    mu_assert_bool(sky_tdigest_quantile(ret, 0.9) == sky_tdigest_quantile(digest, 0.9));
+    sky_tdigest_free(digest);
+    sky_tdigest_free(ret);
+    return 0;
+}
+
+int test_sky_tdigest_unpack_invalid() {
+    sky_tdigest *digest = sky_tdigest_create();
+    mu_assert_int_equals(sky_tdigest_unpack(digest, "foo", 3), -1);
+    mu_assert_int_equals(sky_tdigest_unpack(digest, SKY_TDIGEST_MAGIC "\x00\x00\x00\x01" "0000000000000000", SKY_TDIGEST_HEADER_SZ), -1);
+    mu_assert_int_equals(sky_tdigest_unpack(digest, SKY_TDIGEST_MAGIC "\xFF\x00\x00\x00" "0000000000000000", SKY_TDIGEST_HEADER_SZ), -1);
+    sky_tdigest_free(digest);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_tdigest_empty);
+    mu_run_test(test_sky_tdigest_small);
+    mu_run_test(test_sky_tdigest_quantile);
+    mu_run_test(test_sky_tdigest_merge);
+    mu_run_test(test_sky_tdigest_pack);
+    mu_run_test(test_sky_tdigest_unpack_invalid);
+    return 0;
+}
+
+RUN_TESTS()